@@ -0,0 +1,372 @@
+/**
+ * @file      acq_sched.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     Periodic acquisition scheduler. Sensor read jobs run from a
+ *            dedicated thread paced by a k_timer, so the sampling does not
+ *            drift with the time the jobs take. Periods missed because a
+ *            job overran are either caught up or reported as skipped, and
+ *            the period jitter and execution time of every job are kept
+ *            in histograms.
+ * 
+ * @version   0.1
+ * @date      2024-07-18
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "acq_sched.h"
+#include "utils.h"
+
+LOG_MODULE_REGISTER(acq_sched_component, CONFIG_APP_ACQ_SCHED_LOG_LEVEL);
+
+/**@brief A job and its statistics. */
+typedef struct
+{
+    acq_job_t   job;
+    uint32_t    runs;
+    uint32_t    errors;
+    uint32_t    skipped;
+    uint32_t    caught_up;
+#if defined(CONFIG_APP_ACQ_SCHED_TIMING)
+    histogram_t jitter;
+    histogram_t exec;
+#endif
+} acq_sched_slot_t;
+
+/**@brief State of the scheduler. */
+typedef struct
+{
+    acq_sched_config_t config;
+    acq_sched_slot_t   slots[ACQ_SCHED_MAX_JOBS];
+    uint8_t            job_count;
+    uint32_t           period_ticks;
+    int64_t            start_ticks;   // ideal time of period 0
+    uint64_t           next_period;   // first period the jobs have not run for
+    bool               initialized;
+    volatile bool      running;
+} acq_sched_t;
+
+static acq_sched_t       acq_sched;
+static struct k_spinlock acq_sched_stats_lock;
+static struct k_timer    acq_sched_timer;
+static struct k_thread   acq_sched_thread;
+#if defined(CONFIG_SCHED_THREAD_USAGE)
+static uint64_t          acq_sched_cpu_cycles;  // used by the threads of the previous starts
+#endif
+
+K_THREAD_STACK_DEFINE(acq_sched_stack, ACQ_SCHED_STACK_SIZE);
+
+static inline uint32_t acq_sched_ticks_to_us(int64_t ticks)
+{
+    return (ticks > 0) ? (uint32_t)k_ticks_to_us_floor64((uint64_t)ticks) : 0U;
+}
+
+/**
+ * @brief Runs the jobs due in one period.
+ * 
+ * @param[in] period_index index of the period
+ * @param[in] caught_up    true if the period had already passed
+ */
+static void acq_sched_run_period(uint64_t period_index, bool caught_up)
+{
+    int64_t ideal_ticks = acq_sched.start_ticks + (int64_t)(period_index * acq_sched.period_ticks);
+
+    for (uint8_t i = 0; i < acq_sched.job_count; i++)
+    {
+        acq_sched_slot_t * p_slot = &acq_sched.slots[i];
+
+        if ((period_index % p_slot->job.divider) != 0U)
+        {
+            continue;
+        }
+
+        int64_t start_ticks = k_uptime_ticks();
+        int     err         = p_slot->job.read(p_slot->job.p_context);
+        int64_t end_ticks   = k_uptime_ticks();
+
+        k_spinlock_key_t key = k_spin_lock(&acq_sched_stats_lock);
+
+        p_slot->runs++;
+        p_slot->errors    += (err != 0) ? 1U : 0U;
+        p_slot->caught_up += caught_up ? 1U : 0U;
+#if defined(CONFIG_APP_ACQ_SCHED_TIMING)
+        histogram_record(&p_slot->jitter, acq_sched_ticks_to_us(start_ticks - ideal_ticks));
+        histogram_record(&p_slot->exec, acq_sched_ticks_to_us(end_ticks - start_ticks));
+#else
+        ARG_UNUSED(ideal_ticks);
+        ARG_UNUSED(start_ticks);
+        ARG_UNUSED(end_ticks);
+#endif
+
+        k_spin_unlock(&acq_sched_stats_lock, key);
+
+        if (err != 0)
+        {
+            LOG_DBG("%s failed with error: %d", p_slot->job.p_name, err);
+        }
+    }
+}
+
+/**
+ * @brief Counts the periods dropped without running the jobs.
+ * 
+ * @param[in] first index of the first dropped period
+ * @param[in] count number of dropped periods
+ */
+static void acq_sched_skip_periods(uint64_t first, uint64_t count)
+{
+    k_spinlock_key_t key = k_spin_lock(&acq_sched_stats_lock);
+
+    for (uint8_t i = 0; i < acq_sched.job_count; i++)
+    {
+        acq_sched_slot_t * p_slot  = &acq_sched.slots[i];
+        uint32_t           divider = p_slot->job.divider;
+
+        // multiples of the divider in [first, first + count)
+        p_slot->skipped += (uint32_t)(((first + count + divider - 1U) / divider) - ((first + divider - 1U) / divider));
+    }
+
+    k_spin_unlock(&acq_sched_stats_lock, key);
+}
+
+/**
+ * @brief Scheduler thread. Every timer expiry runs the jobs of one period,
+ * more than one expiry means periods were missed.
+ */
+static void acq_sched_thread_entry(void * p1, void * p2, void * p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (acq_sched.running)
+    {
+        uint32_t expirations = k_timer_status_sync(&acq_sched_timer);
+
+        // the timer was stopped
+        if ((expirations == 0U) || !acq_sched.running)
+        {
+            break;
+        }
+
+        uint64_t missed = expirations - 1U;
+        uint64_t first  = acq_sched.next_period;
+
+        if (missed > 0U)
+        {
+            uint64_t catch_up = (acq_sched.config.overrun == ACQ_SCHED_CATCH_UP) ? MIN(missed, acq_sched.config.max_catch_up) : 0U;
+
+            // the oldest periods are the ones given up on
+            acq_sched_skip_periods(first, missed - catch_up);
+            for (uint64_t n = first + missed - catch_up; n < (first + missed); n++)
+            {
+                acq_sched_run_period(n, true);
+            }
+
+            LOG_DBG("%u periods missed, %u caught up", (uint32_t)missed, (uint32_t)catch_up);
+        }
+
+        acq_sched.next_period = first + missed + 1U;
+        acq_sched_run_period(first + missed, false);
+    }
+}
+
+int acq_sched_init(const acq_sched_config_t * p_config)
+{
+    if ((p_config == NULL) || (p_config->period_us == 0U))
+    {
+        return -EINVAL;
+    }
+
+    if (acq_sched.running)
+    {
+        return -EBUSY;
+    }
+
+    memset(&acq_sched, 0, sizeof(acq_sched));
+    acq_sched.config       = *p_config;
+    acq_sched.period_ticks = MAX(k_us_to_ticks_ceil32(p_config->period_us), 1U);
+    acq_sched.initialized  = true;
+
+    k_timer_init(&acq_sched_timer, NULL, NULL);
+
+    if (acq_sched_ticks_to_us(acq_sched.period_ticks) != p_config->period_us)
+    {
+        LOG_WRN("period of %u us rounded to %u us", p_config->period_us, acq_sched_ticks_to_us(acq_sched.period_ticks));
+    }
+
+    return 0;
+}
+
+int acq_sched_job_add(const acq_job_t * p_job)
+{
+    acq_sched_slot_t * p_slot;
+
+    if ((p_job == NULL) || (p_job->read == NULL))
+    {
+        return -EINVAL;
+    }
+
+    if (acq_sched.running)
+    {
+        return -EBUSY;
+    }
+
+    if (acq_sched.job_count >= ACQ_SCHED_MAX_JOBS)
+    {
+        return -ENOMEM;
+    }
+
+    p_slot = &acq_sched.slots[acq_sched.job_count];
+    memset(p_slot, 0, sizeof(*p_slot));
+    p_slot->job         = *p_job;
+    p_slot->job.divider = MAX(p_job->divider, 1U);
+
+    return acq_sched.job_count++;
+}
+
+int acq_sched_start(void)
+{
+    k_tid_t tid;
+
+    if (!acq_sched.initialized)
+    {
+        return -EINVAL;
+    }
+
+    if (acq_sched.running)
+    {
+        return -EBUSY;
+    }
+
+    acq_sched.running     = true;
+    acq_sched.next_period = 0U;
+
+    tid = k_thread_create(&acq_sched_thread, acq_sched_stack, K_THREAD_STACK_SIZEOF(acq_sched_stack),
+                          acq_sched_thread_entry, NULL, NULL, NULL,
+                          acq_sched.config.thread_prio, 0, K_NO_WAIT);
+    k_thread_name_set(tid, "acq_sched");
+
+    // period 0 runs one period after the start, on an absolute tick so a relative timeout cannot add one
+    acq_sched.start_ticks = k_uptime_ticks() + acq_sched.period_ticks;
+    k_timer_start(&acq_sched_timer, K_TIMEOUT_ABS_TICKS(acq_sched.start_ticks), K_TICKS(acq_sched.period_ticks));
+
+    LOG_INF("acquisition started, %u jobs every %u us", acq_sched.job_count, acq_sched_ticks_to_us(acq_sched.period_ticks));
+    return 0;
+}
+
+int acq_sched_stop(void)
+{
+    if (!acq_sched.running)
+    {
+        return -EALREADY;
+    }
+
+    acq_sched.running = false;
+    k_timer_stop(&acq_sched_timer);
+    (void)k_thread_join(&acq_sched_thread, K_FOREVER);
+
+#if defined(CONFIG_SCHED_THREAD_USAGE)
+    // the usage of the thread starts over when it is created again
+    k_thread_runtime_stats_t usage;
+    if (k_thread_runtime_stats_get(&acq_sched_thread, &usage) == 0)
+    {
+        k_spinlock_key_t key = k_spin_lock(&acq_sched_stats_lock);
+        acq_sched_cpu_cycles += usage.execution_cycles;
+        k_spin_unlock(&acq_sched_stats_lock, key);
+    }
+#endif
+
+    return 0;
+}
+
+int acq_sched_job_stats_get(const uint8_t index, acq_job_stats_t * p_stats)
+{
+    k_spinlock_key_t         key;
+    const acq_sched_slot_t * p_slot;
+
+    if ((p_stats == NULL) || (index >= acq_sched.job_count))
+    {
+        return -EINVAL;
+    }
+
+    p_slot = &acq_sched.slots[index];
+    key    = k_spin_lock(&acq_sched_stats_lock);
+
+    p_stats->runs          = p_slot->runs;
+    p_stats->errors        = p_slot->errors;
+    p_stats->skipped       = p_slot->skipped;
+    p_stats->caught_up     = p_slot->caught_up;
+#if defined(CONFIG_APP_ACQ_SCHED_TIMING)
+    p_stats->jitter_p50_us = histogram_percentile(&p_slot->jitter, 50U);
+    p_stats->jitter_p99_us = histogram_percentile(&p_slot->jitter, 99U);
+    p_stats->jitter_max_us = p_slot->jitter.max;
+    p_stats->exec_p50_us   = histogram_percentile(&p_slot->exec, 50U);
+    p_stats->exec_p99_us   = histogram_percentile(&p_slot->exec, 99U);
+    p_stats->exec_max_us   = p_slot->exec.max;
+#else
+    p_stats->jitter_p50_us = 0U;
+    p_stats->jitter_p99_us = 0U;
+    p_stats->jitter_max_us = 0U;
+    p_stats->exec_p50_us   = 0U;
+    p_stats->exec_p99_us   = 0U;
+    p_stats->exec_max_us   = 0U;
+#endif
+
+    k_spin_unlock(&acq_sched_stats_lock, key);
+
+    return 0;
+}
+
+void acq_sched_stats_reset(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&acq_sched_stats_lock);
+
+    for (uint8_t i = 0; i < acq_sched.job_count; i++)
+    {
+        acq_sched_slot_t * p_slot = &acq_sched.slots[i];
+
+        p_slot->runs      = 0U;
+        p_slot->errors    = 0U;
+        p_slot->skipped   = 0U;
+        p_slot->caught_up = 0U;
+#if defined(CONFIG_APP_ACQ_SCHED_TIMING)
+        histogram_reset(&p_slot->jitter);
+        histogram_reset(&p_slot->exec);
+#endif
+    }
+
+    k_spin_unlock(&acq_sched_stats_lock, key);
+}
+
+int acq_sched_cpu_us_get(uint64_t * p_cpu_us)
+{
+    if (p_cpu_us == NULL)
+    {
+        return -EINVAL;
+    }
+
+#if defined(CONFIG_SCHED_THREAD_USAGE)
+    k_thread_runtime_stats_t usage  = { 0 };
+    uint64_t                 cycles;
+    k_spinlock_key_t         key;
+
+    if (acq_sched.running)
+    {
+        (void)k_thread_runtime_stats_get(&acq_sched_thread, &usage);
+    }
+
+    key    = k_spin_lock(&acq_sched_stats_lock);
+    cycles = acq_sched_cpu_cycles + usage.execution_cycles;
+    k_spin_unlock(&acq_sched_stats_lock, key);
+
+    *p_cpu_us = k_cyc_to_us_floor64(cycles);
+
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
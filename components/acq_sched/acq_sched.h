@@ -0,0 +1,148 @@
+/**
+ * @file      acq_sched.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     Periodic acquisition scheduler. Sensor read jobs run from a
+ *            dedicated thread paced by a k_timer, so the sampling does not
+ *            drift with the time the jobs take. Periods missed because a
+ *            job overran are either caught up or reported as skipped, and
+ *            the period jitter and execution time of every job are kept
+ *            in histograms.
+ * 
+ * @version   0.1
+ * @date      2024-07-18
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef ACQ_SCHED_H_
+#define ACQ_SCHED_H_
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+#define ACQ_SCHED_STACK_SIZE    CONFIG_APP_ACQ_SCHED_STACK_SIZE                   ///< stack of the scheduler thread, the jobs run on it
+#define ACQ_SCHED_THREAD_PRIO   K_PRIO_PREEMPT(CONFIG_APP_ACQ_SCHED_THREAD_PRIO)  ///< default priority of the scheduler thread
+
+#define ACQ_SCHED_MAX_JOBS      4U    ///< jobs one scheduler can run
+
+/**@brief What to do with periods missed because the jobs overran. */
+enum acq_sched_overrun
+{
+    ACQ_SCHED_CATCH_UP = 0,  // Run the jobs of the missed periods right away, up to max_catch_up periods
+    ACQ_SCHED_SKIP,          // Drop the missed periods and count them
+};
+
+/**@brief A read job. */
+typedef struct
+{
+    const char * p_name;                  ///< name of the job, for the logs
+    int       (* read)(void * p_context); ///< reads the sensor, 0 on success
+    void *       p_context;               ///< passed to read
+    uint16_t     divider;                 ///< runs every divider periods, 0 is taken as 1
+} acq_job_t;
+
+/**@brief Configuration of the scheduler. */
+typedef struct
+{
+    uint32_t               period_us;     ///< base period, rounded up to the kernel tick
+    int                    thread_prio;   ///< priority of the scheduler thread
+    enum acq_sched_overrun overrun;       ///< handling of missed periods
+    uint8_t                max_catch_up;  ///< most missed periods caught up at once, the others are skipped
+} acq_sched_config_t;
+
+/**@brief Configuration with the default thread priority, catching up to one period. */
+#define ACQ_SCHED_CONFIG_DEFAULT(period)          \
+    {                                             \
+        .period_us    = (period),                 \
+        .thread_prio  = ACQ_SCHED_THREAD_PRIO,    \
+        .overrun      = ACQ_SCHED_CATCH_UP,       \
+        .max_catch_up = 1U,                       \
+    }
+
+/**@brief Statistics of a job. Jitter is how late a run started against its
+ * ideal time, execution time is how long the read took. Both read as zero
+ * without CONFIG_APP_ACQ_SCHED_TIMING.
+ */
+typedef struct
+{
+    uint32_t runs;           ///< runs
+    uint32_t errors;         ///< runs that returned an error
+    uint32_t skipped;        ///< periods the job did not run in
+    uint32_t caught_up;      ///< runs for a period that had already passed
+    uint32_t jitter_p50_us;  ///< median jitter
+    uint32_t jitter_p99_us;  ///< 99th percentile jitter
+    uint32_t jitter_max_us;  ///< largest jitter
+    uint32_t exec_p50_us;    ///< median execution time
+    uint32_t exec_p99_us;    ///< 99th percentile execution time
+    uint32_t exec_max_us;    ///< longest execution time
+} acq_job_stats_t;
+
+/**
+ * @brief Initializes the scheduler, it must be stopped.
+ * 
+ * @param[in] p_config configuration, copied
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or a zero period
+ * @return -EBUSY if the scheduler is running.
+ */
+int acq_sched_init(const acq_sched_config_t * p_config);
+
+/**
+ * @brief Adds a job, the scheduler must be stopped.
+ * 
+ * @param[in] p_job job, copied
+ * 
+ * @return the index of the job on success
+ * @return -EINVAL on a NULL pointer or a job without read function
+ * @return -ENOMEM if there are ACQ_SCHED_MAX_JOBS jobs already
+ * @return -EBUSY if the scheduler is running.
+ */
+int acq_sched_job_add(const acq_job_t * p_job);
+
+/**
+ * @brief Starts the scheduler thread and its timer.
+ * 
+ * @return 0 on success
+ * @return -EINVAL if the scheduler is not initialized
+ * @return -EBUSY if it is running already.
+ */
+int acq_sched_start(void);
+
+/**
+ * @brief Stops the scheduler and waits for the running jobs to end.
+ * 
+ * @return 0 on success
+ * @return -EALREADY if it is not running.
+ */
+int acq_sched_stop(void);
+
+/**
+ * @brief Gets the statistics of a job.
+ * 
+ * @param[in]  index   index returned by acq_sched_job_add()
+ * @param[out] p_stats statistics
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or an unknown job.
+ */
+int acq_sched_job_stats_get(const uint8_t index, acq_job_stats_t * p_stats);
+
+/**
+ * @brief Clears the statistics of all jobs.
+ */
+void acq_sched_stats_reset(void);
+
+/**
+ * @brief Gets the CPU time the scheduler thread has used since boot, the
+ * jobs included. It keeps counting over a stop and a restart.
+ * 
+ * @param[out] p_cpu_us CPU time
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer
+ * @return -ENOTSUP if CONFIG_SCHED_THREAD_USAGE is disabled.
+ */
+int acq_sched_cpu_us_get(uint64_t * p_cpu_us);
+
+#endif // ACQ_SCHED_H_
@@ -0,0 +1,381 @@
+/**
+ * @file      bringup.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     Bring-up manager for the sensors. Every device is probed through
+ *            its identification register and initialized through its register
+ *            sequence, and while one device settles the others keep going, so
+ *            the boot time is that of the slowest device instead of the sum.
+ * 
+ * @version   0.1
+ * @date      2024-07-01
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "bringup.h"
+#if defined(CONFIG_APP_MPU9250)
+#include "mpu9250.h"
+#endif
+#if defined(CONFIG_APP_LIS2DH12)
+#include "lis2dh12.h"
+#endif
+
+LOG_MODULE_REGISTER(bringup_component, CONFIG_APP_BRINGUP_LOG_LEVEL);
+
+/**@brief Stages every device goes through. */
+enum bringup_stage
+{
+    BRINGUP_WAIT_DEPENDENCY = 0,  // Waiting for the device it depends on to be initialized
+    BRINGUP_PRE_PROBE,            // Running the sequence that makes the device reachable
+    BRINGUP_PROBE,                // Reading the identification register
+    BRINGUP_INIT,                 // Running the init sequence
+    BRINGUP_FIRST_SAMPLE,         // Waiting for the first sample
+    BRINGUP_DONE,                 // Up and sampling
+    BRINGUP_FAILED                // Gave up, the error is in the result
+};
+
+/**@brief Bring-up state of one device. */
+typedef struct
+{
+    enum bringup_stage stage;         ///< current stage
+    regseq_ctx_t       sequence;      ///< sequence of the current stage
+    int64_t            ready_at;      ///< tick after which the device can continue
+    uint8_t            sample_tries;  ///< first sample attempts so far
+} bringup_state_t;
+
+/**
+ * @brief Time in microseconds from the start of the bring-up until now.
+ */
+static uint32_t bringup_elapsed_us(const int64_t start)
+{
+    return (uint32_t)k_ticks_to_us_floor64((uint64_t)(k_uptime_ticks() - start));
+}
+
+/**
+ * @brief Moves a device to the failed stage.
+ */
+static void bringup_fail(bringup_state_t * p_state, bringup_result_t * p_result, const int err)
+{
+    p_state->stage = BRINGUP_FAILED;
+    p_result->err  = err;
+    LOG_ERR("bringup_fail:%s failed with error: %d", p_result->p_name, err);
+}
+
+/**
+ * @brief Runs the sequence of the current stage as far as it goes without
+ * waiting.
+ * 
+ * @return 1 while the sequence settles, 0 once it is done, a negative error otherwise
+ */
+static int bringup_sequence_step(bringup_state_t * p_state, bringup_result_t * p_result)
+{
+    int err = regseq_step(&p_state->sequence);
+
+    if (err == 1)
+    {
+        p_state->ready_at = p_state->sequence.ready_at;
+    }
+    else if (err == 0)
+    {
+        p_result->transactions += p_state->sequence.report.transactions;
+    }
+
+    return err;
+}
+
+/**
+ * @brief Takes a device through as many stages as possible without waiting.
+ * 
+ * @param[in]     p_entry  device to bring up
+ * @param[in,out] p_states states of all the devices, the dependency is looked up here
+ * @param[in]     index    index of the device
+ * @param[out]    p_result outcome of the device
+ * @param[in]     start    tick at which the bring-up started
+ * 
+ * @return true if the device went through at least one stage
+ */
+static bool bringup_advance(const bringup_entry_t * p_entry, bringup_state_t * p_states, const size_t index,
+                            bringup_result_t * p_result, const int64_t start)
+{
+    const regseq_device_t * p_device = p_entry->p_device;
+    bringup_state_t * p_state = &p_states[index];
+    bool progressed = false;
+    int err;
+
+    for (;;)
+    {
+        if ((p_state->stage != BRINGUP_WAIT_DEPENDENCY) && (k_uptime_ticks() < p_state->ready_at))
+        {
+            return progressed;
+        }
+
+        switch (p_state->stage)
+        {
+            case BRINGUP_WAIT_DEPENDENCY:
+                if (p_entry->depends_on != BRINGUP_NO_DEPENDENCY)
+                {
+                    const enum bringup_stage dependency = p_states[p_entry->depends_on].stage;
+
+                    if (dependency == BRINGUP_FAILED)
+                    {
+                        bringup_fail(p_state, p_result, -ENODEV);
+                        return true;
+                    }
+                    if (dependency < BRINGUP_FIRST_SAMPLE)
+                    {
+                        return progressed;
+                    }
+                }
+                regseq_ctx_init(&p_state->sequence, p_device->p_pre_bus, p_device->p_pre_sequence, p_device->pre_sequence_length);
+                p_state->stage = BRINGUP_PRE_PROBE;
+                break;
+
+            case BRINGUP_PRE_PROBE:
+                err = (p_device->pre_sequence_length == 0U) ? 0 : bringup_sequence_step(p_state, p_result);
+                if (err < 0)
+                {
+                    bringup_fail(p_state, p_result, err);
+                    return true;
+                }
+                if (err == 1)
+                {
+                    return true;
+                }
+                p_state->stage = BRINGUP_PROBE;
+                break;
+
+            case BRINGUP_PROBE:
+                err = regseq_probe(p_device, &p_result->id);
+                p_result->transactions++;
+                if (err != 0)
+                {
+                    bringup_fail(p_state, p_result, err);
+                    return true;
+                }
+                p_result->probe_us = bringup_elapsed_us(start);
+                regseq_ctx_init(&p_state->sequence, p_device->p_bus, p_device->p_sequence, p_device->sequence_length);
+                p_state->stage = BRINGUP_INIT;
+                break;
+
+            case BRINGUP_INIT:
+                err = bringup_sequence_step(p_state, p_result);
+                if (err < 0)
+                {
+                    bringup_fail(p_state, p_result, err);
+                    return true;
+                }
+                if (err == 1)
+                {
+                    return true;
+                }
+                p_result->init_us = bringup_elapsed_us(start);
+                p_state->stage = BRINGUP_FIRST_SAMPLE;
+                break;
+
+            case BRINGUP_FIRST_SAMPLE:
+                err = (p_entry->first_sample == NULL) ? 0 : p_entry->first_sample(p_entry->p_context);
+                p_state->sample_tries++;
+                if ((err == -ENODATA) && (p_state->sample_tries < BRINGUP_SAMPLE_TRIES))
+                {
+                    p_state->ready_at = k_uptime_ticks() + (int64_t)k_us_to_ticks_ceil64(BRINGUP_SAMPLE_POLL_US);
+                    return true;
+                }
+                if (err != 0)
+                {
+                    bringup_fail(p_state, p_result, err);
+                    return true;
+                }
+                p_result->first_sample_us = bringup_elapsed_us(start);
+                p_state->stage = BRINGUP_DONE;
+                return true;
+
+            default:
+                return progressed;
+        }
+
+        progressed = true;
+    }
+}
+
+/**
+ * @brief Brings up a set of devices. The bus owner initializes the bus
+ * beforehand.
+ * 
+ * @param[in]  p_entries devices to bring up
+ * @param[in]  count     number of devices
+ * @param[out] p_report  outcome per device, can be NULL
+ * 
+ * @return 0 if every device is up and sampling
+ * @return -EINVAL on too many devices or a dependency that is not an earlier entry
+ * @return the error of the first device that failed otherwise.
+ */
+int bringup_run(const bringup_entry_t * p_entries, const size_t count, bringup_report_t * p_report)
+{
+    bringup_state_t  states[BRINGUP_MAX_DEVICES];
+    bringup_report_t report = { 0 };
+    const int64_t    start  = k_uptime_ticks();
+    int err = 0;
+
+    if (count > BRINGUP_MAX_DEVICES)
+    {
+        return -EINVAL;
+    }
+
+    for (size_t i = 0U; i < count; i++)
+    {
+        if ((p_entries[i].depends_on != BRINGUP_NO_DEPENDENCY) &&
+            ((p_entries[i].depends_on < 0) || ((size_t)p_entries[i].depends_on >= i)))
+        {
+            return -EINVAL;
+        }
+
+        states[i] = (bringup_state_t){ .stage = BRINGUP_WAIT_DEPENDENCY, .ready_at = 0, .sample_tries = 0U };
+        report.devices[i].p_name = p_entries[i].p_device->p_name;
+    }
+    report.count = (uint8_t)count;
+
+    for (;;)
+    {
+        bool    pending    = false;
+        bool    progressed = false;
+        int64_t wake_at    = INT64_MAX;
+
+        for (size_t i = 0U; i < count; i++)
+        {
+            progressed |= bringup_advance(&p_entries[i], states, i, &report.devices[i], start);
+
+            if ((states[i].stage != BRINGUP_DONE) && (states[i].stage != BRINGUP_FAILED))
+            {
+                pending = true;
+                if ((states[i].stage != BRINGUP_WAIT_DEPENDENCY) && (states[i].ready_at < wake_at))
+                {
+                    wake_at = states[i].ready_at;
+                }
+            }
+        }
+
+        if (!pending)
+        {
+            break;
+        }
+
+        // everyone is settling, sleep until the first of them can continue
+        if (!progressed && (wake_at != INT64_MAX))
+        {
+            (void)k_sleep(K_TIMEOUT_ABS_TICKS(wake_at));
+        }
+    }
+
+    report.total_us                = bringup_elapsed_us(start);
+    report.boot_to_first_sample_us = (uint32_t)k_ticks_to_us_floor64((uint64_t)k_uptime_ticks());
+
+    for (size_t i = 0U; i < count; i++)
+    {
+        const bringup_result_t * p_result = &report.devices[i];
+
+        LOG_INF("%s: id 0x%02X, probed %u us, initialized %u us, first sample %u us, %u transactions, err %d",
+                p_result->p_name, p_result->id, p_result->probe_us, p_result->init_us,
+                p_result->first_sample_us, p_result->transactions, p_result->err);
+
+        if ((err == 0) && (p_result->err != 0))
+        {
+            err = p_result->err;
+        }
+    }
+    LOG_INF("bring-up took %u us, first samples %u us after boot", report.total_us, report.boot_to_first_sample_us);
+
+    if (p_report != NULL)
+    {
+        *p_report = report;
+    }
+
+    return err;
+}
+
+#if defined(CONFIG_APP_MPU9250)
+static int bringup_mpu_first_sample(void * p_context)
+{
+    accel_values_t accel_values;
+    return app_mpu_read_accel((app_mpu_t *)p_context, &accel_values);
+}
+#endif
+
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
+static int bringup_mpu_magn_first_sample(void * p_context)
+{
+    magn_values_t magn_values;
+    return app_mpu_read_magnetometer((app_mpu_t *)p_context, &magn_values, NULL);
+}
+#endif
+
+#if defined(CONFIG_APP_LIS2DH12)
+static int bringup_lis2dh12_first_sample(void * p_context)
+{
+    accel_values_t accel_values;
+    return lis2dh12_read_accel((lis2dh12_t *)p_context, &accel_values);
+}
+#endif
+
+/**
+ * @brief Brings up all the sensors of the board: every MPU9250 and LIS2DH12
+ * of the devicetree and the AK8963 magnetometers that are used. A
+ * magnetometer is only reachable once its MPU is initialized.
+ * 
+ * @param[out] p_report outcome per device, can be NULL
+ * 
+ * @return 0 if every sensor is up and sampling
+ * @return -EINVAL if the devicetree has more than BRINGUP_MAX_DEVICES sensors
+ * @return the error of the first sensor that failed otherwise.
+ */
+int bringup_sensors(bringup_report_t * p_report)
+{
+    bringup_entry_t sensors[BRINGUP_MAX_DEVICES];
+    size_t          count = 0U;
+
+#if defined(CONFIG_APP_MPU9250)
+    for (uint8_t i = 0U; i < APP_MPU_COUNT; i++)
+    {
+        app_mpu_t * p_mpu = &app_mpu_instances[i];
+
+        if (count >= BRINGUP_MAX_DEVICES)
+        {
+            return -EINVAL;
+        }
+        sensors[count++] = (bringup_entry_t){ .p_device     = &p_mpu->regseq_device,
+                                              .depends_on   = BRINGUP_NO_DEPENDENCY,
+                                              .first_sample = bringup_mpu_first_sample,
+                                              .p_context    = p_mpu };
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
+        if (app_mpu_has_magnetometer(p_mpu))
+        {
+            if (count >= BRINGUP_MAX_DEVICES)
+            {
+                return -EINVAL;
+            }
+            sensors[count] = (bringup_entry_t){ .p_device     = &p_mpu->magn_regseq_device,
+                                                .depends_on   = (int8_t)(count - 1U),
+                                                .first_sample = bringup_mpu_magn_first_sample,
+                                                .p_context    = p_mpu };
+            count++;
+        }
+#endif
+    }
+#endif
+#if defined(CONFIG_APP_LIS2DH12)
+    for (uint8_t i = 0U; i < LIS2DH12_COUNT; i++)
+    {
+        if (count >= BRINGUP_MAX_DEVICES)
+        {
+            return -EINVAL;
+        }
+        sensors[count++] = (bringup_entry_t){ .p_device     = &lis2dh12_instances[i].regseq_device,
+                                              .depends_on   = BRINGUP_NO_DEPENDENCY,
+                                              .first_sample = bringup_lis2dh12_first_sample,
+                                              .p_context    = &lis2dh12_instances[i] };
+    }
+#endif
+
+    return bringup_run(sensors, count, p_report);
+}
@@ -0,0 +1,85 @@
+/**
+ * @file      bringup.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     Bring-up manager for the sensors. Every device is probed through
+ *            its identification register and initialized through its register
+ *            sequence, and while one device settles the others keep going, so
+ *            the boot time is that of the slowest device instead of the sum.
+ * 
+ * @version   0.1
+ * @date      2024-07-01
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef BRINGUP_H_
+#define BRINGUP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "regseq.h"
+
+#define BRINGUP_MAX_DEVICES     6U     ///< devices a single bring-up can handle
+#define BRINGUP_NO_DEPENDENCY   (-1)   ///< the device does not need another one to be up first
+#define BRINGUP_SAMPLE_POLL_US  1000U  ///< time between two first sample attempts
+#define BRINGUP_SAMPLE_TRIES    50U    ///< first sample attempts before giving up
+
+/**@brief A device to bring up. */
+typedef struct
+{
+    const regseq_device_t * p_device;       ///< identification and sequences of the device
+    int8_t                  depends_on;     ///< index of an earlier entry that has to be initialized first, or BRINGUP_NO_DEPENDENCY
+    int                  (* first_sample)(void * p_context);  ///< reads one sample, -ENODATA while none is ready, NULL to skip
+    void *                  p_context;      ///< passed to first_sample, the driver instance
+} bringup_entry_t;
+
+/**@brief Outcome of the bring-up of one device. All times are from the start
+ * of the bring-up.
+ */
+typedef struct
+{
+    const char * p_name;           ///< name of the device
+    int          err;              ///< 0 if the device is up and sampling
+    uint8_t      id;               ///< value read from the identification register
+    uint32_t     probe_us;         ///< when the device was identified
+    uint32_t     init_us;          ///< when its init sequence, including the settling, was over
+    uint32_t     first_sample_us;  ///< when its first sample was read
+    uint16_t     transactions;     ///< bus transfers used by its sequences
+} bringup_result_t;
+
+/**@brief Outcome of a bring-up. */
+typedef struct
+{
+    bringup_result_t devices[BRINGUP_MAX_DEVICES];  ///< per device outcome, in the order of the entries
+    uint8_t          count;                         ///< number of devices
+    uint32_t         total_us;                      ///< from the start of the bring-up to the last first sample
+    uint32_t         boot_to_first_sample_us;       ///< from boot to the last first sample
+} bringup_report_t;
+
+/**
+ * @brief Brings up a set of devices. The bus owner initializes the bus
+ * beforehand.
+ * 
+ * @param[in]  p_entries devices to bring up
+ * @param[in]  count     number of devices
+ * @param[out] p_report  outcome per device, can be NULL
+ * 
+ * @return 0 if every device is up and sampling
+ * @return -EINVAL on too many devices or a dependency that is not an earlier entry
+ * @return the error of the first device that failed otherwise.
+ */
+int bringup_run(const bringup_entry_t * p_entries, const size_t count, bringup_report_t * p_report);
+
+/**
+ * @brief Brings up all the sensors of the board: every MPU9250 and LIS2DH12
+ * of the devicetree and the AK8963 magnetometers that are used.
+ * 
+ * @param[out] p_report outcome per device, can be NULL
+ * 
+ * @return 0 if every sensor is up and sampling
+ * @return -EINVAL if the devicetree has more than BRINGUP_MAX_DEVICES sensors
+ * @return the error of the first sensor that failed otherwise.
+ */
+int bringup_sensors(bringup_report_t * p_report);
+
+#endif // BRINGUP_H_
@@ -0,0 +1,35 @@
+# Components of the application, shared by the application and the tests.
+# APP_ROOT has to point at the application directory.
+
+set(COMPONENTS 
+    utils
+    evlog
+    twi
+    trace
+    regseq
+    mpu9250
+    lis2dh12
+    bringup
+    odr_ctrl
+    tsalign
+    sample_pool
+    acq_sched
+    fifo_tune
+    gyro_bias
+    mag_cal
+    evcap
+    motion_evt
+    seqchk
+    loadstat
+    motion_cls
+)
+
+# components left out in Kconfig are not compiled at all
+macro(app_components_add)
+  foreach(COMPONENT ${COMPONENTS})
+    string(TOUPPER ${COMPONENT} COMPONENT_OPTION)
+    if(CONFIG_APP_${COMPONENT_OPTION})
+      add_subdirectory(${APP_ROOT}/components/${COMPONENT} ${CMAKE_BINARY_DIR}/components/${COMPONENT})
+    endif()
+  endforeach()
+endmacro()
@@ -0,0 +1,346 @@
+/**
+ * @file      evcap.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Pre-trigger event capture, see evcap.h. The sampling thread
+ *            owns the recording ring, a ring becomes a capture by handing
+ *            its pointer through a message queue to the system work queue
+ *            and comes back with evcap_release().
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include "evcap.h"
+#if defined(CONFIG_APP_LIS2DH12)
+#include "lis2dh12.h"
+#endif
+
+LOG_MODULE_REGISTER(evcap_component, CONFIG_APP_EVCAP_LOG_LEVEL);
+
+#define EVCAP_NONE (-1)  ///< no ring is recording
+
+/**@brief Recording state, only touched by the sampling thread. */
+typedef struct
+{
+    int8_t             active;          ///< ring being recorded, EVCAP_NONE if all are handed out
+    uint16_t           head;            ///< next sample to write
+    uint16_t           count;           ///< samples in the ring
+    uint16_t           post_remaining;  ///< samples still to take after a trigger
+    bool               triggered;       ///< a capture is being completed
+    enum evcap_trigger trigger;
+    uint8_t            int_src;
+} evcap_recorder_t;
+
+static evcap_capture_t  evcap_captures[EVCAP_BUFFERS];
+static evcap_recorder_t evcap_recorder = { .active = EVCAP_NONE };
+static evcap_config_t   evcap_config;
+static uint32_t         evcap_accel_threshold_sq;
+static uint32_t         evcap_gyro_threshold_sq;
+static bool             evcap_initialized;
+
+static ATOMIC_DEFINE(evcap_busy, EVCAP_BUFFERS);  ///< rings recording or handed out
+static atomic_t evcap_pending = ATOMIC_INIT(0);    ///< 0, or 1 + trigger | int_src << 8
+
+static evcap_stats_t     evcap_stats;
+static struct k_spinlock evcap_lock;
+
+static void evcap_deliver_work_handler(struct k_work * p_work);
+
+K_MSGQ_DEFINE(evcap_msgq, sizeof(evcap_capture_t *), EVCAP_BUFFERS, sizeof(evcap_capture_t *));
+static K_WORK_DEFINE(evcap_deliver_work, evcap_deliver_work_handler);
+
+/**
+ * @brief Hands every frozen capture to the handler.
+ */
+static void evcap_deliver_work_handler(struct k_work * p_work)
+{
+    evcap_capture_t * p_capture;
+
+    ARG_UNUSED(p_work);
+
+    while (k_msgq_get(&evcap_msgq, &p_capture, K_NO_WAIT) == 0)
+    {
+        if (evcap_config.handler != NULL)
+        {
+            evcap_config.handler(p_capture, evcap_config.p_user_data);
+        }
+        else
+        {
+            evcap_capture_log(p_capture);
+            evcap_release(p_capture);
+        }
+    }
+}
+
+/**
+ * @brief Makes a free ring the recording one, its history starts empty.
+ *
+ * @return true if there was a free ring
+ */
+static bool evcap_claim(void)
+{
+    for (uint8_t i = 0U; i < EVCAP_BUFFERS; i++)
+    {
+        if (!atomic_test_and_set_bit(evcap_busy, i))
+        {
+            evcap_recorder.active    = (int8_t)i;
+            evcap_recorder.head      = 0U;
+            evcap_recorder.count     = 0U;
+            evcap_recorder.triggered = false;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Freezes the recording ring as a capture and queues it for the
+ * handler. Recording moves on to the next free ring.
+ */
+static void evcap_freeze(void)
+{
+    evcap_capture_t * p_capture = &evcap_captures[evcap_recorder.active];
+    k_spinlock_key_t  key;
+
+    p_capture->first   = (uint16_t)((evcap_recorder.head + EVCAP_RING_SAMPLES - evcap_recorder.count) %
+                                    EVCAP_RING_SAMPLES);
+    p_capture->count   = evcap_recorder.count;
+    p_capture->pre     = (uint16_t)(evcap_recorder.count - 1U - EVCAP_POST_SAMPLES);
+    p_capture->trigger = evcap_recorder.trigger;
+    p_capture->int_src = evcap_recorder.int_src;
+
+    // the queue holds every ring, so it cannot be full
+    (void)k_msgq_put(&evcap_msgq, &p_capture, K_NO_WAIT);
+    (void)k_work_submit(&evcap_deliver_work);
+
+    key = k_spin_lock(&evcap_lock);
+    evcap_stats.captures++;
+    k_spin_unlock(&evcap_lock, key);
+
+    evcap_recorder.active = EVCAP_NONE;
+    (void)evcap_claim();
+}
+
+/**
+ * @brief Squared magnitude of a sample, fits 32 bits for any 16-bit axes.
+ */
+static inline uint32_t evcap_magnitude_sq(const int16_t x, const int16_t y, const int16_t z)
+{
+    return (uint32_t)((int32_t)x * x) + (uint32_t)((int32_t)y * y) + (uint32_t)((int32_t)z * z);
+}
+
+/**
+ * @brief Checks a sample against the thresholds.
+ *
+ * @param[in]  p_accel   accelerometer sample
+ * @param[in]  p_gyro    gyroscope sample, or NULL
+ * @param[out] p_trigger threshold that was crossed
+ *
+ * @return true if a threshold was crossed
+ */
+static bool evcap_threshold_crossed(const accel_values_t * p_accel, const gyro_values_t * p_gyro,
+                                    enum evcap_trigger * p_trigger)
+{
+    if ((evcap_accel_threshold_sq != 0U) &&
+        (evcap_magnitude_sq(p_accel->x, p_accel->y, p_accel->z) > evcap_accel_threshold_sq))
+    {
+        *p_trigger = EVCAP_TRIGGER_ACCEL;
+        return true;
+    }
+
+    if ((p_gyro != NULL) && (evcap_gyro_threshold_sq != 0U) &&
+        (evcap_magnitude_sq(p_gyro->x, p_gyro->y, p_gyro->z) > evcap_gyro_threshold_sq))
+    {
+        *p_trigger = EVCAP_TRIGGER_GYRO;
+        return true;
+    }
+
+    return false;
+}
+
+int evcap_init(const evcap_config_t * p_config)
+{
+    if (p_config == NULL)
+    {
+        return -EINVAL;
+    }
+
+    evcap_config             = *p_config;
+    evcap_accel_threshold_sq = (uint32_t)p_config->accel_threshold_lsb * p_config->accel_threshold_lsb;
+    evcap_gyro_threshold_sq  = (uint32_t)p_config->gyro_threshold_lsb * p_config->gyro_threshold_lsb;
+
+    if (evcap_recorder.active == EVCAP_NONE)
+    {
+        (void)evcap_claim();
+    }
+
+    evcap_initialized = true;
+
+    LOG_INF("evcap_init:%u pre and %u post samples, %u buffers", EVCAP_PRE_SAMPLES, EVCAP_POST_SAMPLES,
+            EVCAP_BUFFERS);
+
+    return 0;
+}
+
+void evcap_push(const accel_values_t * p_accel, const gyro_values_t * p_gyro, const int64_t t_us)
+{
+    evcap_sample_t * p_sample;
+    atomic_val_t     pending;
+    k_spinlock_key_t key;
+    bool             skipped = false;
+
+    if (!evcap_initialized || (p_accel == NULL))
+    {
+        return;
+    }
+
+    pending = atomic_set(&evcap_pending, 0);
+
+    if ((evcap_recorder.active == EVCAP_NONE) && !evcap_claim())
+    {
+        // every ring is still with the handler, a trigger now has no history to capture
+        skipped = true;
+        pending = 0;
+    }
+    else
+    {
+        p_sample        = &evcap_captures[evcap_recorder.active].ring[evcap_recorder.head];
+        p_sample->t_us  = t_us;
+        p_sample->accel = *p_accel;
+        if (p_gyro != NULL)
+        {
+            p_sample->gyro = *p_gyro;
+        }
+        else
+        {
+            p_sample->gyro = (gyro_values_t){ 0 };
+        }
+
+        evcap_recorder.head  = (uint16_t)((evcap_recorder.head + 1U) % EVCAP_RING_SAMPLES);
+        evcap_recorder.count = (uint16_t)MIN(evcap_recorder.count + 1U, EVCAP_RING_SAMPLES);
+
+        if (evcap_recorder.triggered)
+        {
+            evcap_recorder.post_remaining--;
+        }
+        else if (pending != 0)
+        {
+            evcap_recorder.triggered      = true;
+            evcap_recorder.post_remaining = EVCAP_POST_SAMPLES;
+            evcap_recorder.trigger        = (enum evcap_trigger)((pending & 0xFF) - 1);
+            evcap_recorder.int_src        = (uint8_t)(pending >> 8);
+            pending                       = 0;
+        }
+        else if (evcap_threshold_crossed(p_accel, p_gyro, &evcap_recorder.trigger))
+        {
+            evcap_recorder.triggered      = true;
+            evcap_recorder.post_remaining = EVCAP_POST_SAMPLES;
+            evcap_recorder.int_src        = 0U;
+        }
+
+        if (evcap_recorder.triggered && (evcap_recorder.post_remaining == 0U))
+        {
+            evcap_freeze();
+        }
+    }
+
+    key = k_spin_lock(&evcap_lock);
+    evcap_stats.samples++;
+    evcap_stats.skipped += skipped ? 1U : 0U;
+    evcap_stats.merged  += (pending != 0) ? 1U : 0U;
+    k_spin_unlock(&evcap_lock, key);
+}
+
+void evcap_trigger(const enum evcap_trigger trigger, const uint8_t int_src)
+{
+    // the first trigger until the next sample wins
+    (void)atomic_cas(&evcap_pending, 0, (atomic_val_t)(((uint32_t)trigger + 1U) | ((uint32_t)int_src << 8)));
+}
+
+#if defined(CONFIG_APP_LIS2DH12)
+/**
+ * @brief Reads the interrupt sources of the LIS2DH12 off the interrupt.
+ */
+static void evcap_lis2dh12_work_handler(struct k_work * p_work)
+{
+    uint8_t int1_src  = 0U;
+    uint8_t click_src = 0U;
+    int     err;
+
+    ARG_UNUSED(p_work);
+
+    err = lis2dh12_int_src_get(LIS2DH12_DEFAULT, &int1_src, &click_src);
+    if (err != 0)
+    {
+        LOG_WRN("evcap_lis2dh12_work_handler:lis2dh12_int_src_get failed with error: %d", err);
+        return;
+    }
+
+    if (int1_src & LIS2DH12_SRC_IA)
+    {
+        evcap_trigger(EVCAP_TRIGGER_INT1, int1_src);
+    }
+    else if (click_src & LIS2DH12_SRC_IA)
+    {
+        evcap_trigger(EVCAP_TRIGGER_CLICK, click_src);
+    }
+}
+
+static K_WORK_DEFINE(evcap_lis2dh12_work, evcap_lis2dh12_work_handler);
+
+void evcap_lis2dh12_notify(void)
+{
+    (void)k_work_submit(&evcap_lis2dh12_work);
+}
+#endif
+
+void evcap_release(const evcap_capture_t * p_capture)
+{
+    if ((p_capture < &evcap_captures[0]) || (p_capture >= &evcap_captures[EVCAP_BUFFERS]))
+    {
+        LOG_WRN("evcap_release:not a capture");
+        return;
+    }
+
+    atomic_clear_bit(evcap_busy, (int)(p_capture - evcap_captures));
+}
+
+void evcap_capture_log(const evcap_capture_t * p_capture)
+{
+    const int64_t t0_us = evcap_capture_sample(p_capture, p_capture->pre)->t_us;
+
+    printk("evcap:trigger %u src 0x%02X, %u samples, %u before\n", p_capture->trigger, p_capture->int_src,
+           p_capture->count, p_capture->pre);
+
+    // index and time relative to the trigger sample, then the axes
+    for (uint16_t i = 0U; i < p_capture->count; i++)
+    {
+        const evcap_sample_t * s = evcap_capture_sample(p_capture, i);
+
+        printk("evcap:%d,%d,%d,%d,%d,%d,%d,%d\n", (int)i - (int)p_capture->pre, (int32_t)(s->t_us - t0_us),
+               s->accel.x, s->accel.y, s->accel.z, s->gyro.x, s->gyro.y, s->gyro.z);
+    }
+}
+
+int evcap_stats_get(evcap_stats_t * p_stats)
+{
+    k_spinlock_key_t key;
+
+    if (p_stats == NULL)
+    {
+        return -EINVAL;
+    }
+
+    key      = k_spin_lock(&evcap_lock);
+    *p_stats = evcap_stats;
+    k_spin_unlock(&evcap_lock, key);
+
+    return 0;
+}
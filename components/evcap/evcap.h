@@ -0,0 +1,167 @@
+/**
+ * @file      evcap.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Pre-trigger event capture. The sampling thread pushes every
+ *            accelerometer and gyroscope sample into a ring that always
+ *            holds the last EVCAP_PRE_SAMPLES of history. A trigger, a
+ *            magnitude above a threshold or a sensor interrupt, lets
+ *            EVCAP_POST_SAMPLES more samples in and then freezes the ring
+ *            as a capture. The capture is the ring itself, it is handed to
+ *            the handler as is and recording goes on in the next free ring,
+ *            so samples are written once and never copied.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef EVCAP_H_
+#define EVCAP_H_
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include "sensor_types.h"
+
+#define EVCAP_PRE_SAMPLES  CONFIG_APP_EVCAP_PRE_SAMPLES                 ///< history kept before the trigger
+#define EVCAP_POST_SAMPLES CONFIG_APP_EVCAP_POST_SAMPLES                ///< samples taken after the trigger
+#define EVCAP_BUFFERS      CONFIG_APP_EVCAP_BUFFERS                     ///< rings, one records while the others are handled
+#define EVCAP_RING_SAMPLES (EVCAP_PRE_SAMPLES + 1 + EVCAP_POST_SAMPLES)  ///< history, the trigger sample and the rest
+
+/**@brief What started a capture. */
+enum evcap_trigger
+{
+    EVCAP_TRIGGER_ACCEL = 0,  ///< accelerometer magnitude above its threshold
+    EVCAP_TRIGGER_GYRO,       ///< gyroscope magnitude above its threshold
+    EVCAP_TRIGGER_INT1,       ///< LIS2DH12 interrupt generator 1
+    EVCAP_TRIGGER_CLICK,      ///< LIS2DH12 click detection
+    EVCAP_TRIGGER_MANUAL,     ///< evcap_trigger() from the application
+};
+
+/**@brief One sample of the ring. */
+typedef struct
+{
+    int64_t        t_us;   ///< timestamp given to evcap_push()
+    accel_values_t accel;
+    gyro_values_t  gyro;   ///< zero if the sample had no gyroscope part
+} evcap_sample_t;
+
+/**
+ * @brief A frozen ring. Sample i, oldest first, is at
+ * ring[(first + i) % EVCAP_RING_SAMPLES], see evcap_capture_sample().
+ */
+typedef struct
+{
+    evcap_sample_t     ring[EVCAP_RING_SAMPLES];
+    uint16_t           first;    ///< index of the oldest sample
+    uint16_t           count;    ///< samples held
+    uint16_t           pre;      ///< samples before the trigger sample, less than EVCAP_PRE_SAMPLES early on
+    enum evcap_trigger trigger;  ///< cause of the capture
+    uint8_t            int_src;  ///< INT1_SRC or CLICK_SRC for the interrupt triggers
+} evcap_capture_t;
+
+/**
+ * @brief Called from the system work queue for every capture. The capture
+ * stays valid until it is given back with evcap_release(), which can happen
+ * later from another thread, for example once telemetry has sent it.
+ *
+ * @param[in] p_capture   capture
+ * @param[in] p_user_data pointer given in the configuration
+ */
+typedef void (*evcap_handler_t)(const evcap_capture_t * p_capture, void * p_user_data);
+
+/**@brief Configuration of the capture. */
+typedef struct
+{
+    uint16_t        accel_threshold_lsb;  ///< accelerometer magnitude that triggers, 0 for none
+    uint16_t        gyro_threshold_lsb;   ///< gyroscope magnitude that triggers, 0 for none
+    evcap_handler_t handler;              ///< NULL logs the captures with evcap_capture_log() and releases them
+    void *          p_user_data;          ///< passed to the handler
+} evcap_config_t;
+
+/**@brief Statistics of the capture. */
+typedef struct
+{
+    uint32_t samples;   ///< samples pushed
+    uint32_t captures;  ///< captures handed over
+    uint32_t merged;    ///< triggers that came while a capture was being completed
+    uint32_t skipped;   ///< samples not recorded because all rings were being handled
+} evcap_stats_t;
+
+/**
+ * @brief Initializes the capture and starts recording history.
+ *
+ * @param[in] p_config configuration, copied
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int evcap_init(const evcap_config_t * p_config);
+
+/**
+ * @brief Records a sample, checks the triggers and completes a capture.
+ * Called from the one thread that samples.
+ *
+ * @param[in] p_accel accelerometer sample
+ * @param[in] p_gyro  gyroscope sample, NULL if there is none
+ * @param[in] t_us    timestamp of the sample
+ */
+void evcap_push(const accel_values_t * p_accel, const gyro_values_t * p_gyro, const int64_t t_us);
+
+/**
+ * @brief Triggers a capture at the next pushed sample. Can be called from
+ * any thread or interrupt.
+ *
+ * @param[in] trigger cause of the capture
+ * @param[in] int_src interrupt source register, 0 if none
+ */
+void evcap_trigger(const enum evcap_trigger trigger, const uint8_t int_src);
+
+#if defined(CONFIG_APP_LIS2DH12)
+/**
+ * @brief To be called from the LIS2DH12 INT1 interrupt. Reads INT1_SRC and
+ * CLICK_SRC from the system work queue, which also clears the latched
+ * interrupt, and triggers with the active one.
+ */
+void evcap_lis2dh12_notify(void);
+#endif
+
+/**
+ * @brief Gives a capture back so its ring can record again.
+ *
+ * @param[in] p_capture capture passed to the handler
+ */
+void evcap_release(const evcap_capture_t * p_capture);
+
+/**
+ * @brief Prints a capture to the console, one "evcap:" line per sample with
+ * its index relative to the trigger sample.
+ *
+ * @param[in] p_capture capture
+ */
+void evcap_capture_log(const evcap_capture_t * p_capture);
+
+/**
+ * @brief Gets the statistics of the capture.
+ *
+ * @param[out] p_stats statistics
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int evcap_stats_get(evcap_stats_t * p_stats);
+
+/**
+ * @brief Gets a sample of a capture.
+ *
+ * @param[in] p_capture capture
+ * @param[in] index     sample, 0 is the oldest
+ *
+ * @return the sample
+ */
+static inline const evcap_sample_t * evcap_capture_sample(const evcap_capture_t * p_capture, const uint16_t index)
+{
+    return &p_capture->ring[(p_capture->first + index) % EVCAP_RING_SAMPLES];
+}
+
+#endif // EVCAP_H_
@@ -0,0 +1,249 @@
+/**
+ * @file      evlog.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Deferred binary event log, see evlog.h. The ring is a bounded
+ *            queue where every slot carries a sequence number: a producer
+ *            claims the next slot with a compare and swap on the write
+ *            position and publishes it by advancing the slot sequence, the
+ *            drain thread is the only consumer. No producer ever waits on
+ *            another one or on the drain.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include "evlog.h"
+#include "utils.h"
+
+LOG_MODULE_REGISTER(evlog_component, CONFIG_APP_EVLOG_LOG_LEVEL);
+
+#define EVLOG_MASK ((uint32_t)CONFIG_APP_EVLOG_RECORDS - 1U)
+
+BUILD_ASSERT((CONFIG_APP_EVLOG_RECORDS & (CONFIG_APP_EVLOG_RECORDS - 1)) == 0,
+             "CONFIG_APP_EVLOG_RECORDS must be a power of two");
+
+/**@brief Slot of the ring. */
+typedef struct
+{
+    atomic_t       seq;     ///< position + 1 once written, position + size once drained
+    evlog_record_t record;
+} evlog_slot_t;
+
+static evlog_slot_t evlog_slots[CONFIG_APP_EVLOG_RECORDS];
+static atomic_t     evlog_head    = ATOMIC_INIT(0);  ///< next position to write
+static uint32_t     evlog_tail    = 0U;              ///< next position to drain, drain thread only
+static atomic_t     evlog_records = ATOMIC_INIT(0);
+static atomic_t     evlog_dropped = ATOMIC_INIT(0);
+
+void evlog_put(const enum evlog_event event, const uint8_t address, const uint8_t reg_address, const int err,
+               const uint32_t value)
+{
+    uint32_t       pos = (uint32_t)atomic_get(&evlog_head);
+    evlog_slot_t * p_slot;
+
+    for (;;)
+    {
+        int32_t lag;
+
+        p_slot = &evlog_slots[pos & EVLOG_MASK];
+        lag    = (int32_t)((uint32_t)atomic_get(&p_slot->seq) - pos);
+
+        if (lag == 0)
+        {
+            // the slot is free for this position, claim it
+            if (atomic_cas(&evlog_head, (atomic_val_t)pos, (atomic_val_t)(pos + 1U)))
+            {
+                break;
+            }
+        }
+        else if (lag < 0)
+        {
+            // the slot still holds a record of the previous lap, the ring is full
+            (void)atomic_inc(&evlog_dropped);
+            return;
+        }
+
+        pos = (uint32_t)atomic_get(&evlog_head);
+    }
+
+    p_slot->record.timestamp_us = (uint32_t)k_ticks_to_us_floor64((uint64_t)k_uptime_ticks());
+    p_slot->record.event        = (uint8_t)event;
+    p_slot->record.address      = address;
+    p_slot->record.reg_address  = reg_address;
+    p_slot->record.err          = (int8_t)CLAMP(err, INT8_MIN, 0);
+    p_slot->record.value        = value;
+
+    (void)atomic_set(&p_slot->seq, (atomic_val_t)(pos + 1U));
+    (void)atomic_inc(&evlog_records);
+}
+
+int evlog_stats_get(evlog_stats_t * p_stats)
+{
+    if (p_stats == NULL)
+    {
+        return -EINVAL;
+    }
+
+    p_stats->records = (uint32_t)atomic_get(&evlog_records);
+    p_stats->dropped = (uint32_t)atomic_get(&evlog_dropped);
+
+    return 0;
+}
+
+/**
+ * @brief Takes the oldest record out of the ring.
+ *
+ * @param[out] p_record record
+ *
+ * @return true if there was one
+ */
+static bool evlog_take(evlog_record_t * p_record)
+{
+    evlog_slot_t * p_slot = &evlog_slots[evlog_tail & EVLOG_MASK];
+
+    if ((int32_t)((uint32_t)atomic_get(&p_slot->seq) - (evlog_tail + 1U)) < 0)
+    {
+        return false;
+    }
+
+    *p_record = p_slot->record;
+    (void)atomic_set(&p_slot->seq, (atomic_val_t)(evlog_tail + CONFIG_APP_EVLOG_RECORDS));
+    evlog_tail++;
+
+    return true;
+}
+
+#if defined(CONFIG_APP_EVLOG_HOST)
+/**
+ * @brief Prints a record as an "evlog:" line of hex.
+ */
+static void evlog_emit(const evlog_record_t * p_record)
+{
+    const uint8_t * p_bytes = (const uint8_t *)p_record;
+    char            hex[(2U * sizeof(*p_record)) + 1U];
+
+    for (uint32_t i = 0U; i < sizeof(*p_record); i++)
+    {
+        (void)snprintk(&hex[2U * i], 3U, "%02x", p_bytes[i]);
+    }
+    hex[2U * sizeof(*p_record)] = '\0';
+    printk("evlog:%s\n", hex);
+}
+#else
+/**
+ * @brief Formats a record into the log.
+ */
+static void evlog_emit(const evlog_record_t * p_record)
+{
+    const evlog_record_t * r = p_record;  // keeps the formats on one line
+
+    switch ((enum evlog_event)r->event)
+    {
+        case EVLOG_DROPPED:
+            LOG_WRN("evlog:%u records dropped", r->value);
+            break;
+        case EVLOG_TWI_BUS_TIMEOUT:
+            LOG_ERR("twi:[%u us] bus timed out for device 0x%02X", r->timestamp_us, r->address);
+            break;
+        case EVLOG_TWI_READ_FAILED:
+        case EVLOG_TWI_WRITE_FAILED:
+            LOG_ERR("twi:[%u us] %s of device 0x%02X register 0x%02X failed after %u attempts with error: %d",
+                    r->timestamp_us, (r->event == EVLOG_TWI_READ_FAILED) ? "read" : "write", r->address,
+                    r->reg_address, r->value, r->err);
+            break;
+        case EVLOG_TWI_RELEASE_FAILED:
+            LOG_ERR("twi:[%u us] twi_arbiter_release failed with error: %d", r->timestamp_us, r->err);
+            break;
+        case EVLOG_TWI_RECOVERY:
+            LOG_WRN("twi:[%u us] bus recovery took %u us, err: %d", r->timestamp_us, r->value, r->err);
+            break;
+#if defined(CONFIG_HAS_NRFX)
+        case EVLOG_TWI_NRFX_XFER:
+            LOG_ERR("twi:[%u us] nrfx_twi_xfer failed with error: %s", r->timestamp_us,
+                    nrfx_err_string((nrfx_err_t)r->value));
+            break;
+        case EVLOG_TWI_NRFX_RECOVER:
+            LOG_ERR("twi:[%u us] nrfx_twi_twim_bus_recover failed with error: %s", r->timestamp_us,
+                    nrfx_err_string((nrfx_err_t)r->value));
+            break;
+        case EVLOG_TWI_NRFX_INIT:
+            LOG_ERR("twi:[%u us] nrfx_twi_init failed with error: %s", r->timestamp_us,
+                    nrfx_err_string((nrfx_err_t)r->value));
+            break;
+        case EVLOG_SPI_NRFX_XFER:
+            LOG_ERR("mpu_spi:[%u us] nrfx_spim_xfer failed with error: %s", r->timestamp_us,
+                    nrfx_err_string((nrfx_err_t)r->value));
+            break;
+#endif
+        case EVLOG_SPI_SLV4_TIMEOUT:
+            LOG_WRN("mpu_spi:[%u us] magnetometer register 0x%02x timed out", r->timestamp_us, r->reg_address);
+            break;
+        default:
+            LOG_WRN("evlog:[%u us] unknown event %u", r->timestamp_us, r->event);
+            break;
+    }
+}
+#endif
+
+/**
+ * @brief Drains the ring, reporting the drops since the last run as a
+ * record of its own.
+ */
+static void evlog_drain_fn(void * p1, void * p2, void * p3)
+{
+    uint32_t       reported = 0U;
+    evlog_record_t record;
+
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    for (;;)
+    {
+        const uint32_t dropped = (uint32_t)atomic_get(&evlog_dropped);
+
+        while (evlog_take(&record))
+        {
+            evlog_emit(&record);
+        }
+
+        if (dropped != reported)
+        {
+            record = (evlog_record_t){
+                .timestamp_us = (uint32_t)k_ticks_to_us_floor64((uint64_t)k_uptime_ticks()),
+                .event        = EVLOG_DROPPED,
+                .value        = dropped - reported,
+            };
+            evlog_emit(&record);
+            reported = dropped;
+        }
+
+        k_msleep(CONFIG_APP_EVLOG_DRAIN_INTERVAL_MS);
+    }
+}
+
+K_THREAD_DEFINE(evlog_drain, CONFIG_APP_EVLOG_STACK_SIZE, evlog_drain_fn, NULL, NULL, NULL,
+                CONFIG_APP_EVLOG_THREAD_PRIO, 0, 0);
+
+/**
+ * @brief Gives every slot the sequence of its first lap, before any driver
+ * runs.
+ */
+static int evlog_init(void)
+{
+    for (uint32_t i = 0U; i < CONFIG_APP_EVLOG_RECORDS; i++)
+    {
+        (void)atomic_set(&evlog_slots[i].seq, (atomic_val_t)i);
+    }
+
+    return 0;
+}
+
+SYS_INIT(evlog_init, PRE_KERNEL_1, 0);
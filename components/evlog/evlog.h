@@ -0,0 +1,90 @@
+/**
+ * @file      evlog.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Deferred binary event log for the driver hot paths. A driver
+ *            puts a fixed size record of an event ID, the device and
+ *            register it concerns, an error code and a value into a lock
+ *            free ring, which costs a few atomics and no formatting. A low
+ *            priority thread drains the ring and formats the records with
+ *            the string tables, or with CONFIG_APP_EVLOG_HOST prints them as
+ *            "evlog:" lines of hex for scripts/evlog_decode.py. Records that
+ *            find the ring full are dropped and counted.
+ *
+ *            Records can be put from any thread or interrupt.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef EVLOG_H_
+#define EVLOG_H_
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+/**
+ * @brief Events, the numbers are part of the host format and must not be
+ * reused, see scripts/evlog_decode.py.
+ */
+enum evlog_event
+{
+    EVLOG_DROPPED            = 0,   ///< value records were dropped, only put by the drain
+    EVLOG_TWI_BUS_TIMEOUT    = 1,   ///< the bus could not be owned in time
+    EVLOG_TWI_READ_FAILED    = 2,   ///< err of the last attempt, value attempts
+    EVLOG_TWI_WRITE_FAILED   = 3,   ///< err of the last attempt, value attempts
+    EVLOG_TWI_RELEASE_FAILED = 4,   ///< err of twi_arbiter_release()
+    EVLOG_TWI_RECOVERY       = 5,   ///< err of the recovery, value its duration in us
+    EVLOG_TWI_NRFX_XFER      = 6,   ///< value nrfx error of nrfx_twi_xfer()
+    EVLOG_TWI_NRFX_RECOVER   = 7,   ///< value nrfx error of nrfx_twi_twim_bus_recover()
+    EVLOG_TWI_NRFX_INIT      = 8,   ///< value nrfx error of nrfx_twi_init()
+    EVLOG_SPI_NRFX_XFER      = 9,   ///< value nrfx error of nrfx_spim_xfer()
+    EVLOG_SPI_SLV4_TIMEOUT   = 10,  ///< magnetometer access through SLV4 did not finish
+    EVLOG_EVENT_COUNT,
+};
+
+/**@brief One event, little endian when sent to the host. */
+typedef struct __packed
+{
+    uint32_t timestamp_us;  ///< uptime when the event was put
+    uint8_t  event;         ///< enum evlog_event
+    uint8_t  address;       ///< 7-bit device address, 0 if none
+    uint8_t  reg_address;   ///< register address, 0 if none
+    int8_t   err;           ///< 0 or a negative errno
+    uint32_t value;         ///< event specific
+} evlog_record_t;
+
+/**@brief Statistics of the log. */
+typedef struct
+{
+    uint32_t records;  ///< records put
+    uint32_t dropped;  ///< records lost to a full ring
+} evlog_stats_t;
+
+#if defined(CONFIG_APP_EVLOG)
+/**
+ * @brief Puts an event into the ring, or counts it as dropped if the ring
+ * is full. Never blocks and never formats.
+ *
+ * @param[in] event       event ID
+ * @param[in] address     device address
+ * @param[in] reg_address register address
+ * @param[in] err         0 or a negative errno
+ * @param[in] value       event specific
+ */
+void evlog_put(const enum evlog_event event, const uint8_t address, const uint8_t reg_address, const int err,
+               const uint32_t value);
+
+/**
+ * @brief Gets the statistics of the log.
+ *
+ * @param[out] p_stats statistics
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int evlog_stats_get(evlog_stats_t * p_stats);
+#endif
+
+#endif // EVLOG_H_
@@ -0,0 +1,292 @@
+/**
+ * @file      fifo_tune.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     FIFO batch size policy. The application states how old a
+ *            sample may be when it reaches the consumer, and for every
+ *            sensor the largest batch that still meets that age is picked,
+ *            which gives the fewest wakeups and bus transactions. The
+ *            LIS2DH12 gets it as its FIFO watermark, the MPU9250 has no
+ *            watermark and gets it as the drain period of its reader.
+ * 
+ * @version   0.1
+ * @date      2024-07-22
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "fifo_tune.h"
+#if defined(CONFIG_APP_LIS2DH12_FIFO)
+#include "lis2dh12.h"
+#endif
+#if defined(CONFIG_APP_MPU9250_FIFO)
+#include "mpu9250.h"
+#endif
+
+LOG_MODULE_REGISTER(fifo_tune_component, CONFIG_APP_FIFO_TUNE_LOG_LEVEL);
+
+/**@brief Age targets of fifo_tune_sweep_log(), in us. */
+static const uint32_t fifo_tune_sweep_targets[] = { 5000U, 10000U, 20000U, 50000U, 100000U, 200000U, 500000U };
+
+/**@brief State of the policy. */
+typedef struct
+{
+    const fifo_tune_sensor_t * p_sensors[FIFO_TUNE_MAX_SENSORS];
+    fifo_tune_plan_t           plans[FIFO_TUNE_MAX_SENSORS];
+    uint8_t                    sensor_count;
+    uint32_t                   max_age_us;
+    uint32_t                   wake_latency_us;
+    uint32_t                   bus_hz;
+} fifo_tune_t;
+
+static fifo_tune_t fifo_tune = {
+    .wake_latency_us = FIFO_TUNE_WAKE_LATENCY_US,
+    .bus_hz          = FIFO_TUNE_BUS_HZ,
+};
+
+static K_MUTEX_DEFINE(fifo_tune_lock);
+
+#if defined(CONFIG_APP_LIS2DH12_FIFO)
+static uint32_t fifo_tune_lis2dh12_odr_mhz_get(void)
+{
+    return (uint32_t)lis2dh12_odr_hz_get(LIS2DH12_DEFAULT) * 1000U;
+}
+
+static int fifo_tune_lis2dh12_apply(const fifo_tune_plan_t * p_plan)
+{
+    return lis2dh12_fifo_watermark_set(LIS2DH12_DEFAULT, (uint8_t)MIN(p_plan->batch, LIS2DH12_FIFO_DEPTH - 1U));
+}
+
+const fifo_tune_sensor_t fifo_tune_lis2dh12 = {
+    .p_name          = "LIS2DH12",
+    .fifo_depth      = LIS2DH12_FIFO_DEPTH,
+    .frame_bytes     = 6U,
+    .status_bytes    = 1U,
+    .frames_per_read = LIS2DH12_FIFO_READ_FRAMES,
+    .odr_mhz_get     = fifo_tune_lis2dh12_odr_mhz_get,
+    .apply           = fifo_tune_lis2dh12_apply,
+};
+#endif
+
+#if defined(CONFIG_APP_MPU9250_FIFO)
+static uint32_t fifo_tune_mpu9250_odr_mhz_get(void)
+{
+    return app_mpu_sample_rate_mhz_get(APP_MPU_DEFAULT);
+}
+
+const fifo_tune_sensor_t fifo_tune_mpu9250 = {
+    .p_name          = "MPU9250",
+    .fifo_depth      = MPU_FIFO_DEPTH_BYTES / MPU_FIFO_FRAME_BYTES,
+    .frame_bytes     = MPU_FIFO_FRAME_BYTES,
+    .status_bytes    = 2U,
+    .frames_per_read = MPU_FIFO_READ_FRAMES,
+    .odr_mhz_get     = fifo_tune_mpu9250_odr_mhz_get,
+    .apply           = NULL,
+};
+#endif
+
+/**
+ * @brief Bus bytes and transactions of one drain.
+ * 
+ * @param[in]  p_sensor       sensor
+ * @param[in]  batch          samples drained
+ * @param[out] p_transactions transactions of the drain
+ * 
+ * @return uint32_t bytes on the bus
+ */
+static uint32_t fifo_tune_drain_bytes(const fifo_tune_sensor_t * p_sensor, const uint32_t batch, uint32_t * p_transactions)
+{
+    uint32_t reads = DIV_ROUND_UP(batch, p_sensor->frames_per_read);
+
+    *p_transactions = 1U + reads;
+    return (p_sensor->status_bytes + FIFO_TUNE_XFER_OVERHEAD) +
+           (batch * p_sensor->frame_bytes) + (reads * FIFO_TUNE_XFER_OVERHEAD);
+}
+
+int fifo_tune_plan_compute(const fifo_tune_sensor_t * p_sensor, const uint32_t odr_mhz, const uint32_t max_age_us,
+                           const uint32_t wake_latency_us, const uint32_t bus_hz, fifo_tune_plan_t * p_plan)
+{
+    uint64_t period_ns;
+    uint32_t best = 0U;
+    uint32_t best_age_us = 0U;
+    uint32_t transactions;
+
+    if ((p_sensor == NULL) || (p_plan == NULL) || (odr_mhz == 0U) || (bus_hz == 0U) ||
+        (p_sensor->fifo_depth == 0U) || (p_sensor->frames_per_read == 0U))
+    {
+        return -EINVAL;
+    }
+
+    period_ns = 1000000000000ULL / odr_mhz;
+
+    // the age grows with the batch, the first batch over the target ends the search
+    for (uint32_t batch = 1U; batch <= p_sensor->fifo_depth; batch++)
+    {
+        uint32_t bytes    = fifo_tune_drain_bytes(p_sensor, batch, &transactions);
+        uint64_t drain_ns = (uint64_t)wake_latency_us * 1000U + ((uint64_t)bytes * 9U * 1000000000U) / bus_hz;
+        uint64_t age_ns   = (batch - 1U) * period_ns + drain_ns;
+
+        // samples keep coming while the batch is drained, the FIFO must not overflow meanwhile
+        uint32_t headroom = (uint32_t)DIV_ROUND_UP(drain_ns, period_ns);
+
+        if ((best != 0U) && ((age_ns > (uint64_t)max_age_us * 1000U) || ((batch + headroom) > p_sensor->fifo_depth)))
+        {
+            break;
+        }
+
+        best        = batch;
+        best_age_us = (uint32_t)(age_ns / 1000U);
+    }
+
+    uint32_t bytes = fifo_tune_drain_bytes(p_sensor, best, &transactions);
+
+    p_plan->batch              = (uint16_t)best;
+    p_plan->drain_period_us    = (uint32_t)((best * period_ns) / 1000U);
+    p_plan->worst_age_us       = best_age_us;
+    p_plan->wakeups_mhz        = odr_mhz / best;
+    p_plan->transactions_per_s = (uint32_t)(((uint64_t)transactions * odr_mhz) / (best * 1000U));
+    p_plan->bus_bytes_per_s    = (uint32_t)(((uint64_t)bytes * odr_mhz) / (best * 1000U));
+
+    return (best_age_us > max_age_us) ? -ERANGE : 0;
+}
+
+int fifo_tune_init(const uint32_t max_age_us, const uint32_t wake_latency_us, const uint32_t bus_hz)
+{
+    if ((max_age_us == 0U) || (bus_hz == 0U))
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&fifo_tune_lock, K_FOREVER);
+    fifo_tune.max_age_us      = max_age_us;
+    fifo_tune.wake_latency_us = wake_latency_us;
+    fifo_tune.bus_hz          = bus_hz;
+    k_mutex_unlock(&fifo_tune_lock);
+
+    return 0;
+}
+
+int fifo_tune_sensor_add(const fifo_tune_sensor_t * p_sensor)
+{
+    int index;
+
+    if ((p_sensor == NULL) || (p_sensor->odr_mhz_get == NULL))
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&fifo_tune_lock, K_FOREVER);
+
+    if (fifo_tune.sensor_count >= FIFO_TUNE_MAX_SENSORS)
+    {
+        index = -ENOMEM;
+    }
+    else
+    {
+        index = fifo_tune.sensor_count++;
+        fifo_tune.p_sensors[index] = p_sensor;
+        memset(&fifo_tune.plans[index], 0, sizeof(fifo_tune.plans[index]));
+    }
+
+    k_mutex_unlock(&fifo_tune_lock);
+
+    return index;
+}
+
+int fifo_tune_retune(void)
+{
+    int first_err = 0;
+
+    k_mutex_lock(&fifo_tune_lock, K_FOREVER);
+
+    for (uint8_t i = 0; i < fifo_tune.sensor_count; i++)
+    {
+        const fifo_tune_sensor_t * p_sensor = fifo_tune.p_sensors[i];
+        fifo_tune_plan_t           plan;
+        int                        err;
+
+        err = fifo_tune_plan_compute(p_sensor, p_sensor->odr_mhz_get(), fifo_tune.max_age_us,
+                                     fifo_tune.wake_latency_us, fifo_tune.bus_hz, &plan);
+        if (err == -ERANGE)
+        {
+            LOG_WRN("%s cannot meet %u us, oldest sample is %u us old", p_sensor->p_name, fifo_tune.max_age_us, plan.worst_age_us);
+        }
+        else if (err != 0)
+        {
+            LOG_ERR("fifo_tune_retune:%s plan failed with error: %d", p_sensor->p_name, err);
+            first_err = (first_err == 0) ? err : first_err;
+            continue;
+        }
+
+        if (p_sensor->apply != NULL)
+        {
+            int apply_err = p_sensor->apply(&plan);
+            if (apply_err != 0)
+            {
+                LOG_ERR("fifo_tune_retune:%s apply failed with error: %d", p_sensor->p_name, apply_err);
+                first_err = (first_err == 0) ? apply_err : first_err;
+                continue;
+            }
+        }
+
+        fifo_tune.plans[i] = plan;
+        first_err = ((first_err == 0) && (err != 0)) ? err : first_err;
+
+        LOG_INF("%s batch %u, drain every %u us, %u.%03u wakeups/s, %u B/s",
+                p_sensor->p_name, plan.batch, plan.drain_period_us,
+                plan.wakeups_mhz / 1000U, plan.wakeups_mhz % 1000U, plan.bus_bytes_per_s);
+    }
+
+    k_mutex_unlock(&fifo_tune_lock);
+
+    return first_err;
+}
+
+int fifo_tune_plan_get(const uint8_t index, fifo_tune_plan_t * p_plan)
+{
+    if ((p_plan == NULL) || (index >= fifo_tune.sensor_count))
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&fifo_tune_lock, K_FOREVER);
+    *p_plan = fifo_tune.plans[index];
+    k_mutex_unlock(&fifo_tune_lock);
+
+    return 0;
+}
+
+int fifo_tune_sweep_log(const uint8_t index)
+{
+    const fifo_tune_sensor_t * p_sensor;
+    fifo_tune_plan_t           plan;
+    uint32_t                   odr_mhz;
+
+    if (index >= fifo_tune.sensor_count)
+    {
+        return -EINVAL;
+    }
+
+    p_sensor = fifo_tune.p_sensors[index];
+    odr_mhz  = p_sensor->odr_mhz_get();
+
+    LOG_INF("%s at %u mHz: target us, batch, worst age us, wakeups/s, transactions/s, B/s", p_sensor->p_name, odr_mhz);
+
+    for (uint8_t i = 0; i < ARRAY_SIZE(fifo_tune_sweep_targets); i++)
+    {
+        int err = fifo_tune_plan_compute(p_sensor, odr_mhz, fifo_tune_sweep_targets[i],
+                                         fifo_tune.wake_latency_us, fifo_tune.bus_hz, &plan);
+        if ((err != 0) && (err != -ERANGE))
+        {
+            return err;
+        }
+
+        LOG_INF("%7u %3u %7u %4u.%03u %5u %6u%s", fifo_tune_sweep_targets[i], plan.batch, plan.worst_age_us,
+                plan.wakeups_mhz / 1000U, plan.wakeups_mhz % 1000U, plan.transactions_per_s, plan.bus_bytes_per_s,
+                (err == -ERANGE) ? " missed" : "");
+    }
+
+    return 0;
+}
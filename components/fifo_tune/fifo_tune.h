@@ -0,0 +1,134 @@
+/**
+ * @file      fifo_tune.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     FIFO batch size policy. The application states how old a
+ *            sample may be when it reaches the consumer, and for every
+ *            sensor the largest batch that still meets that age is picked,
+ *            which gives the fewest wakeups and bus transactions. The
+ *            LIS2DH12 gets it as its FIFO watermark, the MPU9250 has no
+ *            watermark and gets it as the drain period of its reader.
+ * 
+ * @version   0.1
+ * @date      2024-07-22
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef FIFO_TUNE_H_
+#define FIFO_TUNE_H_
+
+#include <stdint.h>
+
+#define FIFO_TUNE_MAX_SENSORS       4U       ///< sensors one policy tunes
+#define FIFO_TUNE_WAKE_LATENCY_US   500U     ///< default time from the watermark to the first bus byte
+#define FIFO_TUNE_BUS_HZ            400000U  ///< default bus clock
+#define FIFO_TUNE_XFER_OVERHEAD     3U       ///< bytes on the bus per transaction on top of the data: address, register and read address
+
+/**@brief Outcome of the tuning of one sensor. */
+typedef struct
+{
+    uint16_t batch;               ///< samples per drain
+    uint32_t drain_period_us;     ///< time between two drains
+    uint32_t worst_age_us;        ///< age of the oldest sample of a batch when the drain ends
+    uint32_t wakeups_mhz;         ///< drains per 1000 s
+    uint32_t transactions_per_s;  ///< bus transactions per second
+    uint32_t bus_bytes_per_s;     ///< bus bytes per second, overhead included
+} fifo_tune_plan_t;
+
+/**@brief A sensor the policy tunes. */
+typedef struct
+{
+    const char * p_name;           ///< name, for the logs
+    uint16_t     fifo_depth;       ///< samples the FIFO holds
+    uint8_t      frame_bytes;      ///< bytes per sample
+    uint8_t      status_bytes;     ///< bytes of the fill level read that starts a drain
+    uint8_t      frames_per_read;  ///< samples per burst read
+    uint32_t  (* odr_mhz_get)(void);                       ///< current output data rate in mHz
+    int       (* apply)(const fifo_tune_plan_t * p_plan);  ///< programs the batch, NULL if the reader polls
+} fifo_tune_sensor_t;
+
+#if defined(CONFIG_APP_LIS2DH12_FIFO)
+/**@brief The first LIS2DH12, the batch becomes its FIFO watermark. */
+extern const fifo_tune_sensor_t fifo_tune_lis2dh12;
+#endif
+
+#if defined(CONFIG_APP_MPU9250_FIFO)
+/**@brief The accelerometer FIFO of the first MPU9250, the batch is left to its reader. */
+extern const fifo_tune_sensor_t fifo_tune_mpu9250;
+#endif
+
+/**
+ * @brief Computes the plan of a sensor. Does not touch the hardware, so the
+ * policy can be evaluated for any rate and target.
+ * 
+ * @param[in]  p_sensor        sensor
+ * @param[in]  odr_mhz         output data rate in mHz
+ * @param[in]  max_age_us      sample age target
+ * @param[in]  wake_latency_us time from the watermark to the first bus byte
+ * @param[in]  bus_hz          bus clock
+ * @param[out] p_plan          plan
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or a zero rate
+ * @return -ERANGE if even single samples miss the target, p_plan then holds the single sample plan.
+ */
+int fifo_tune_plan_compute(const fifo_tune_sensor_t * p_sensor, const uint32_t odr_mhz, const uint32_t max_age_us,
+                           const uint32_t wake_latency_us, const uint32_t bus_hz, fifo_tune_plan_t * p_plan);
+
+/**
+ * @brief Sets the sample age target, the wake latency and the bus clock
+ * used by fifo_tune_retune().
+ * 
+ * @param[in] max_age_us      sample age target
+ * @param[in] wake_latency_us time from the watermark to the first bus byte
+ * @param[in] bus_hz          bus clock
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a zero target or bus clock.
+ */
+int fifo_tune_init(const uint32_t max_age_us, const uint32_t wake_latency_us, const uint32_t bus_hz);
+
+/**
+ * @brief Adds a sensor to the policy.
+ * 
+ * @param[in] p_sensor sensor, kept by reference
+ * 
+ * @return the index of the sensor on success
+ * @return -EINVAL on a NULL pointer
+ * @return -ENOMEM if FIFO_TUNE_MAX_SENSORS sensors were added already.
+ */
+int fifo_tune_sensor_add(const fifo_tune_sensor_t * p_sensor);
+
+/**
+ * @brief Recomputes and applies the plan of every sensor from its current
+ * rate. To be called after a rate change, e.g. from the odr_ctrl callback.
+ * 
+ * @return 0 on success
+ * @return the first error of fifo_tune_plan_compute() or of an apply
+ * callback otherwise, the other sensors are still tuned.
+ */
+int fifo_tune_retune(void);
+
+/**
+ * @brief Gets the plan last applied to a sensor.
+ * 
+ * @param[in]  index  index returned by fifo_tune_sensor_add()
+ * @param[out] p_plan plan
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or an unknown sensor.
+ */
+int fifo_tune_plan_get(const uint8_t index, fifo_tune_plan_t * p_plan);
+
+/**
+ * @brief Logs the wakeups per second and bus load of a sensor at its
+ * current rate for a range of age targets, to pick a target.
+ * 
+ * @param[in] index index returned by fifo_tune_sensor_add()
+ * 
+ * @return 0 on success
+ * @return -EINVAL on an unknown sensor.
+ */
+int fifo_tune_sweep_log(const uint8_t index);
+
+#endif // FIFO_TUNE_H_
@@ -0,0 +1,584 @@
+/**
+ * @file      gyro_bias.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Temperature compensated gyroscope bias. Learns the bias from
+ *            stationary windows into a piecewise-linear table over
+ *            temperature and removes the bias interpolated for the current
+ *            temperature from the samples.
+ *
+ * @version   0.1
+ * @date      2024-07-25
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#if defined(CONFIG_APP_GYRO_BIAS_SETTINGS)
+#include <zephyr/settings/settings.h>
+#endif
+#include "gyro_bias.h"
+
+LOG_MODULE_REGISTER(gyro_bias_component, CONFIG_APP_GYRO_BIAS_LOG_LEVEL);
+
+#define GYRO_BIAS_TEMP_LSB_PER_C_X100  33387  // MPU9250 temperature sensitivity, 333.87 LSB per degree
+#define GYRO_BIAS_TEMP_OFFSET_CC       2100   // MPU9250 temperature at a reading of 0
+#define GYRO_BIAS_TABLE_VERSION        1U     // bumped whenever the stored layout changes
+#define GYRO_BIAS_SETTINGS_KEY         "gyro_bias/table"
+
+/**@brief Bias learned at the temperature of a node. */
+typedef struct
+{
+    int32_t  bias[3];  // x, y, z, scaled by 2^GYRO_BIAS_FRAC_SHIFT
+    uint16_t weight;   // windows learned here, scaled by GYRO_BIAS_WEIGHT_ONE
+} gyro_bias_node_t;
+
+/**@brief The table as it is kept in the settings. */
+typedef struct
+{
+    uint32_t         version;
+    gyro_bias_node_t nodes[GYRO_BIAS_NODES];
+} gyro_bias_table_t;
+
+/**@brief Sums of the current window. */
+typedef struct
+{
+    uint16_t samples;
+    int32_t  gyro_sum[3];
+    int64_t  gyro_sum_sq[3];
+    int32_t  accel_sum[3];
+    int64_t  accel_sum_sq[3];
+} gyro_bias_window_t;
+
+/**@brief State of the engine. */
+typedef struct
+{
+    gyro_bias_config_t config;
+    gyro_bias_table_t  table;
+    gyro_bias_window_t window;
+    int16_t            temp_cc;
+    int16_t            bias[3];  // x, y, z, applied to the samples
+    int64_t            accel_mag_sq_min;
+    int64_t            accel_mag_sq_max;
+    uint32_t           windows_since_save;
+    gyro_bias_stats_t  stats;
+    bool               initialized;
+} gyro_bias_t;
+
+static gyro_bias_t gyro_bias;
+
+/**@brief Protects the table and the window, held while learning. */
+static K_MUTEX_DEFINE(gyro_bias_lock);
+
+/**@brief Protects the applied bias, held for a few instructions only. */
+static struct k_spinlock gyro_bias_apply_lock;
+
+static void gyro_bias_save_work_handler(struct k_work * p_work);
+
+static K_WORK_DEFINE(gyro_bias_save_work, gyro_bias_save_work_handler);
+
+/**
+ * @brief Converts a raw MPU9250 temperature to centi-degrees Celsius.
+ *
+ * @param[in] temp raw temperature
+ *
+ * @return int16_t temperature in centi-degrees Celsius
+ */
+static int16_t gyro_bias_temp_to_cc(temp_value_t temp)
+{
+    return (int16_t)(((int32_t)temp * 10000) / GYRO_BIAS_TEMP_LSB_PER_C_X100 + GYRO_BIAS_TEMP_OFFSET_CC);
+}
+
+/**
+ * @brief Finds the node below a temperature and the position between it and
+ * the next one. Temperatures outside the table are clamped to its ends.
+ *
+ * @param[in]  temp_cc    temperature
+ * @param[out] p_fraction position towards the next node, 0 to GYRO_BIAS_WEIGHT_ONE - 1
+ *
+ * @return uint8_t node below the temperature
+ */
+static uint8_t gyro_bias_node_find(int16_t temp_cc, uint16_t * p_fraction)
+{
+    int32_t offset = (int32_t)temp_cc - GYRO_BIAS_TEMP_MIN_CC;
+
+    if (offset <= 0)
+    {
+        *p_fraction = 0U;
+        return 0U;
+    }
+
+    if (offset >= (GYRO_BIAS_NODES - 1) * GYRO_BIAS_TEMP_STEP_CC)
+    {
+        *p_fraction = 0U;
+        return GYRO_BIAS_NODES - 1U;
+    }
+
+    *p_fraction = (uint16_t)(((offset % GYRO_BIAS_TEMP_STEP_CC) * GYRO_BIAS_WEIGHT_ONE) / GYRO_BIAS_TEMP_STEP_CC);
+    return (uint8_t)(offset / GYRO_BIAS_TEMP_STEP_CC);
+}
+
+/**
+ * @brief Tells if a node has seen enough stationary windows to be used.
+ *
+ * @param[in] p_node node
+ *
+ * @return true if the node is learned
+ */
+static bool gyro_bias_node_learned(const gyro_bias_node_t * p_node)
+{
+    return p_node->weight >= GYRO_BIAS_WEIGHT_ONE;
+}
+
+/**
+ * @brief Interpolates the bias at the current temperature between the
+ * closest learned nodes below and above it and publishes it to
+ * gyro_bias_apply(). Beyond the learned nodes the closest one is used.
+ * Called with the lock held.
+ */
+static void gyro_bias_interpolate(void)
+{
+    const gyro_bias_node_t * p_nodes  = gyro_bias.table.nodes;
+    int32_t                  bias[3]  = { 0 };
+    int16_t                  below    = -1;
+    int16_t                  above    = -1;
+    uint16_t                 fraction;
+    uint8_t                  low      = gyro_bias_node_find(gyro_bias.temp_cc, &fraction);
+    int32_t                  position = ((int32_t)low * GYRO_BIAS_WEIGHT_ONE) + fraction;  // in nodes, scaled by GYRO_BIAS_WEIGHT_ONE
+
+    for (int16_t i = low; i >= 0; i--)
+    {
+        if (gyro_bias_node_learned(&p_nodes[i]))
+        {
+            below = i;
+            break;
+        }
+    }
+
+    for (int16_t i = low + 1; i < GYRO_BIAS_NODES; i++)
+    {
+        if (gyro_bias_node_learned(&p_nodes[i]))
+        {
+            above = i;
+            break;
+        }
+    }
+
+    if ((below >= 0) && (above >= 0))
+    {
+        int32_t span   = (int32_t)(above - below) * GYRO_BIAS_WEIGHT_ONE;
+        int32_t offset = position - ((int32_t)below * GYRO_BIAS_WEIGHT_ONE);
+
+        for (uint8_t axis = 0; axis < 3U; axis++)
+        {
+            bias[axis] = p_nodes[below].bias[axis] +
+                         (int32_t)(((int64_t)(p_nodes[above].bias[axis] - p_nodes[below].bias[axis]) * offset) / span);
+        }
+    }
+    else if ((below >= 0) || (above >= 0))
+    {
+        memcpy(bias, p_nodes[(below >= 0) ? below : above].bias, sizeof(bias));
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&gyro_bias_apply_lock);
+
+    for (uint8_t axis = 0; axis < 3U; axis++)
+    {
+        int32_t rounded = (bias[axis] + (1 << (GYRO_BIAS_FRAC_SHIFT - 1U))) >> GYRO_BIAS_FRAC_SHIFT;
+        gyro_bias.bias[axis] = (int16_t)CLAMP(rounded, INT16_MIN, INT16_MAX);
+    }
+
+    k_spin_unlock(&gyro_bias_apply_lock, key);
+}
+
+/**
+ * @brief Counts the nodes that were learned. Called with the lock held.
+ *
+ * @return uint8_t learned nodes
+ */
+static uint8_t gyro_bias_learned_nodes(void)
+{
+    uint8_t learned = 0U;
+
+    for (uint8_t i = 0; i < GYRO_BIAS_NODES; i++)
+    {
+        learned += gyro_bias_node_learned(&gyro_bias.table.nodes[i]) ? 1U : 0U;
+    }
+
+    return learned;
+}
+
+/**
+ * @brief Learns a stationary window into the two nodes around the current
+ * temperature, each weighted by how close the temperature is to it. Every
+ * node keeps a running mean whose weight is capped so it follows the slow
+ * ageing of the sensor. Called with the lock held.
+ *
+ * @param[in] mean mean gyroscope reading of the window, x, y, z, scaled by 2^GYRO_BIAS_FRAC_SHIFT
+ *
+ * @return true if a node became learned
+ */
+static bool gyro_bias_learn(const int32_t mean[3])
+{
+    uint16_t fraction;
+    uint8_t  low        = gyro_bias_node_find(gyro_bias.temp_cc, &fraction);
+    uint8_t  nodes[2]   = { low, (uint8_t)MIN(low + 1U, GYRO_BIAS_NODES - 1U) };
+    uint16_t weights[2] = { (uint16_t)(GYRO_BIAS_WEIGHT_ONE - fraction), fraction };
+    bool     new_node   = false;
+
+    for (uint8_t i = 0; i < 2U; i++)
+    {
+        gyro_bias_node_t * p_node = &gyro_bias.table.nodes[nodes[i]];
+
+        if (weights[i] == 0U)
+        {
+            continue;
+        }
+
+        bool was_learned = gyro_bias_node_learned(p_node);
+
+        p_node->weight = (uint16_t)MIN((uint32_t)p_node->weight + weights[i], GYRO_BIAS_WEIGHT_MAX);
+
+        for (uint8_t axis = 0; axis < 3U; axis++)
+        {
+            p_node->bias[axis] += ((mean[axis] - p_node->bias[axis]) * (int32_t)weights[i]) / (int32_t)p_node->weight;
+        }
+
+        new_node = new_node || (!was_learned && gyro_bias_node_learned(p_node));
+    }
+
+    return new_node;
+}
+
+/**
+ * @brief Tests the finished window for stationarity and learns from it.
+ * Called with the lock held.
+ *
+ * @return true if the table should be saved
+ */
+static bool gyro_bias_window_close(void)
+{
+    gyro_bias_window_t * p_window     = &gyro_bias.window;
+    int64_t              n            = p_window->samples;
+    int64_t              accel_mag_sq = 0;
+    int32_t              mean[3];
+    bool                 stationary   = true;
+    bool                 save         = false;
+
+    gyro_bias.stats.windows++;
+
+    for (uint8_t axis = 0; (axis < 3U) && stationary; axis++)
+    {
+        int64_t gyro_var   = (p_window->gyro_sum_sq[axis] - ((int64_t)p_window->gyro_sum[axis] * p_window->gyro_sum[axis]) / n) / n;
+        int64_t accel_var  = (p_window->accel_sum_sq[axis] - ((int64_t)p_window->accel_sum[axis] * p_window->accel_sum[axis]) / n) / n;
+        int64_t accel_mean = p_window->accel_sum[axis] / n;
+
+        mean[axis]    = (int32_t)(((int64_t)p_window->gyro_sum[axis] << GYRO_BIAS_FRAC_SHIFT) / n);
+        accel_mag_sq += accel_mean * accel_mean;
+
+        stationary = (gyro_var <= (int64_t)gyro_bias.config.gyro_var_max) &&
+                     (accel_var <= (int64_t)gyro_bias.config.accel_var_max) &&
+                     (abs(mean[axis]) <= ((int32_t)gyro_bias.config.gyro_mean_max << GYRO_BIAS_FRAC_SHIFT));
+    }
+
+    stationary = stationary &&
+                 (accel_mag_sq >= gyro_bias.accel_mag_sq_min) &&
+                 (accel_mag_sq <= gyro_bias.accel_mag_sq_max);
+
+    if (stationary)
+    {
+        gyro_bias.stats.stationary_windows++;
+        gyro_bias.windows_since_save++;
+
+        bool new_node = gyro_bias_learn(mean);
+        gyro_bias_interpolate();
+
+        if (new_node)
+        {
+            LOG_INF("gyro_bias:learned the bias at %d.%02u C",
+                    gyro_bias.temp_cc / 100, (unsigned int)(abs(gyro_bias.temp_cc) % 100));
+        }
+
+        save = gyro_bias.config.persist &&
+               (new_node || (gyro_bias.windows_since_save >= GYRO_BIAS_SAVE_WINDOWS));
+    }
+
+    memset(p_window, 0, sizeof(gyro_bias_window_t));
+
+    return save;
+}
+
+#if defined(CONFIG_APP_GYRO_BIAS_SETTINGS)
+/**
+ * @brief Settings handler, restores the table. A table of another layout is
+ * dropped.
+ */
+static int gyro_bias_settings_set(const char * p_name, size_t length, settings_read_cb read_cb, void * p_cb_arg)
+{
+    const char *      p_next;
+    gyro_bias_table_t table;
+    ssize_t           read;
+
+    if (!settings_name_steq(p_name, "table", &p_next) || (p_next != NULL))
+    {
+        return -ENOENT;
+    }
+
+    if (length != sizeof(gyro_bias_table_t))
+    {
+        LOG_WRN("gyro_bias:stored table has %u bytes, dropped", (unsigned int)length);
+        return 0;
+    }
+
+    read = read_cb(p_cb_arg, &table, sizeof(table));
+    if (read < 0)
+    {
+        return (int)read;
+    }
+
+    if (table.version != GYRO_BIAS_TABLE_VERSION)
+    {
+        LOG_WRN("gyro_bias:stored table version %u, dropped", (unsigned int)table.version);
+        return 0;
+    }
+
+    k_mutex_lock(&gyro_bias_lock, K_FOREVER);
+    gyro_bias.table = table;
+    k_mutex_unlock(&gyro_bias_lock);
+
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(gyro_bias, "gyro_bias", NULL, gyro_bias_settings_set, NULL, NULL);
+#endif
+
+static void gyro_bias_save_work_handler(struct k_work * p_work)
+{
+    ARG_UNUSED(p_work);
+
+    int err = gyro_bias_save();
+    if (err != 0)
+    {
+        LOG_ERR("gyro_bias:saving the table failed with error: %d", err);
+    }
+}
+
+int gyro_bias_init(const gyro_bias_config_t * p_config)
+{
+    int     err = 0;
+    int64_t one_g;
+
+    if ((p_config == NULL) || (p_config->window < 2U) || (p_config->accel_lsb_per_g == 0U) ||
+        (p_config->accel_tolerance_mg >= 1000U))
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&gyro_bias_lock, K_FOREVER);
+
+    memset(&gyro_bias, 0, sizeof(gyro_bias));
+    gyro_bias.config        = *p_config;
+#if !defined(CONFIG_APP_GYRO_BIAS_SETTINGS)
+    gyro_bias.config.persist = false;  // nowhere to keep the table
+#endif
+    gyro_bias.table.version = GYRO_BIAS_TABLE_VERSION;
+    gyro_bias.temp_cc       = GYRO_BIAS_TEMP_OFFSET_CC;
+
+    one_g = p_config->accel_lsb_per_g;
+    gyro_bias.accel_mag_sq_min = ((one_g * (1000 - p_config->accel_tolerance_mg)) / 1000) *
+                                 ((one_g * (1000 - p_config->accel_tolerance_mg)) / 1000);
+    gyro_bias.accel_mag_sq_max = ((one_g * (1000 + p_config->accel_tolerance_mg)) / 1000) *
+                                 ((one_g * (1000 + p_config->accel_tolerance_mg)) / 1000);
+
+    k_mutex_unlock(&gyro_bias_lock);
+
+#if defined(CONFIG_APP_GYRO_BIAS_SETTINGS)
+    if (p_config->persist)
+    {
+        err = settings_subsys_init();
+        if (err == 0)
+        {
+            err = settings_load_subtree("gyro_bias");
+        }
+
+        if (err != 0)
+        {
+            LOG_ERR("gyro_bias:loading the table failed with error: %d", err);
+        }
+    }
+#endif
+
+    k_mutex_lock(&gyro_bias_lock, K_FOREVER);
+
+    gyro_bias.initialized         = true;
+    gyro_bias.stats.learned_nodes = gyro_bias_learned_nodes();
+    gyro_bias_interpolate();
+
+    k_mutex_unlock(&gyro_bias_lock);
+
+    LOG_INF("gyro_bias:%u nodes learned", gyro_bias.stats.learned_nodes);
+
+    return err;
+}
+
+void gyro_bias_temp_update(temp_value_t temp)
+{
+    k_mutex_lock(&gyro_bias_lock, K_FOREVER);
+
+    gyro_bias.temp_cc = gyro_bias_temp_to_cc(temp);
+    gyro_bias_interpolate();
+
+    k_mutex_unlock(&gyro_bias_lock);
+}
+
+int gyro_bias_feed(const gyro_values_t * p_gyro, const accel_values_t * p_accel, uint16_t count)
+{
+    bool save = false;
+
+    if ((p_gyro == NULL) || (p_accel == NULL))
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&gyro_bias_lock, K_FOREVER);
+
+    if (!gyro_bias.initialized)
+    {
+        k_mutex_unlock(&gyro_bias_lock);
+        return -EPERM;
+    }
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        gyro_bias_window_t * p_window = &gyro_bias.window;
+        const int32_t        gyro[3]  = { p_gyro[i].x, p_gyro[i].y, p_gyro[i].z };
+        const int32_t        accel[3] = { p_accel[i].x, p_accel[i].y, p_accel[i].z };
+
+        for (uint8_t axis = 0; axis < 3U; axis++)
+        {
+            p_window->gyro_sum[axis]     += gyro[axis];
+            p_window->gyro_sum_sq[axis]  += (int64_t)gyro[axis] * gyro[axis];
+            p_window->accel_sum[axis]    += accel[axis];
+            p_window->accel_sum_sq[axis] += (int64_t)accel[axis] * accel[axis];
+        }
+
+        p_window->samples++;
+        if (p_window->samples >= gyro_bias.config.window)
+        {
+            save = gyro_bias_window_close() || save;
+        }
+    }
+
+    gyro_bias.stats.learned_nodes = gyro_bias_learned_nodes();
+
+    k_mutex_unlock(&gyro_bias_lock);
+
+    if (save)
+    {
+        // flash writes are slow, keep them off the acquisition thread
+        (void)k_work_submit(&gyro_bias_save_work);
+    }
+
+    return 0;
+}
+
+void gyro_bias_apply(gyro_values_t * p_gyro, uint16_t count)
+{
+    k_spinlock_key_t key = k_spin_lock(&gyro_bias_apply_lock);
+    int16_t          bias_x = gyro_bias.bias[0];
+    int16_t          bias_y = gyro_bias.bias[1];
+    int16_t          bias_z = gyro_bias.bias[2];
+
+    k_spin_unlock(&gyro_bias_apply_lock, key);
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        p_gyro[i].x = (int16_t)CLAMP((int32_t)p_gyro[i].x - bias_x, INT16_MIN, INT16_MAX);
+        p_gyro[i].y = (int16_t)CLAMP((int32_t)p_gyro[i].y - bias_y, INT16_MIN, INT16_MAX);
+        p_gyro[i].z = (int16_t)CLAMP((int32_t)p_gyro[i].z - bias_z, INT16_MIN, INT16_MAX);
+    }
+}
+
+int gyro_bias_save(void)
+{
+#if defined(CONFIG_APP_GYRO_BIAS_SETTINGS)
+    gyro_bias_table_t table;
+    int               err;
+
+    k_mutex_lock(&gyro_bias_lock, K_FOREVER);
+
+    if (!gyro_bias.config.persist)
+    {
+        k_mutex_unlock(&gyro_bias_lock);
+        return -ENOTSUP;
+    }
+
+    table = gyro_bias.table;
+    gyro_bias.windows_since_save = 0U;
+
+    k_mutex_unlock(&gyro_bias_lock);
+
+    err = settings_save_one(GYRO_BIAS_SETTINGS_KEY, &table, sizeof(table));
+
+    k_mutex_lock(&gyro_bias_lock, K_FOREVER);
+    if (err == 0)
+    {
+        gyro_bias.stats.saves++;
+    }
+    else
+    {
+        gyro_bias.stats.save_errors++;
+    }
+    k_mutex_unlock(&gyro_bias_lock);
+
+    return err;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+int gyro_bias_reset(void)
+{
+    int err = 0;
+
+    k_mutex_lock(&gyro_bias_lock, K_FOREVER);
+
+    memset(gyro_bias.table.nodes, 0, sizeof(gyro_bias.table.nodes));
+    memset(&gyro_bias.window, 0, sizeof(gyro_bias.window));
+    gyro_bias.windows_since_save  = 0U;
+    gyro_bias.stats.learned_nodes = 0U;
+    gyro_bias_interpolate();
+
+#if defined(CONFIG_APP_GYRO_BIAS_SETTINGS)
+    if (gyro_bias.config.persist)
+    {
+        err = settings_delete(GYRO_BIAS_SETTINGS_KEY);
+    }
+#endif
+
+    k_mutex_unlock(&gyro_bias_lock);
+
+    return err;
+}
+
+int gyro_bias_stats_get(gyro_bias_stats_t * p_stats)
+{
+    if (p_stats == NULL)
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&gyro_bias_lock, K_FOREVER);
+
+    *p_stats         = gyro_bias.stats;
+    p_stats->temp_cc = gyro_bias.temp_cc;
+    p_stats->bias_x  = gyro_bias.bias[0];
+    p_stats->bias_y  = gyro_bias.bias[1];
+    p_stats->bias_z  = gyro_bias.bias[2];
+
+    k_mutex_unlock(&gyro_bias_lock);
+
+    return 0;
+}
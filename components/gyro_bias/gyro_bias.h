@@ -0,0 +1,148 @@
+/**
+ * @file      gyro_bias.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Temperature compensated gyroscope bias. The fed samples are cut
+ *            into windows, a window in which the gyroscope variance and the
+ *            accelerometer variance are low and the acceleration magnitude
+ *            is close to 1 g is stationary, and its mean gyroscope reading
+ *            is the bias at the current temperature. The bias is learned
+ *            into a piecewise-linear table over temperature, the bias at the
+ *            current temperature is interpolated once per temperature update
+ *            so the correction of a sample is one subtraction per axis. With
+ *            APP_GYRO_BIAS_SETTINGS the table is kept in the settings so a
+ *            warm restart starts with it.
+ *
+ * @version   0.1
+ * @date      2024-07-25
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef GYRO_BIAS_H_
+#define GYRO_BIAS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sensor_types.h"
+#include "mpu9250.h"
+
+#define GYRO_BIAS_NODES           18     ///< temperatures the table holds a bias for
+#define GYRO_BIAS_TEMP_MIN_CC     -2000  ///< temperature of the first node, centi-degrees Celsius
+#define GYRO_BIAS_TEMP_STEP_CC    500    ///< temperature between two nodes, centi-degrees Celsius
+#define GYRO_BIAS_FRAC_SHIFT      4U     ///< the learned biases are scaled by 2^GYRO_BIAS_FRAC_SHIFT
+#define GYRO_BIAS_WEIGHT_ONE      256U   ///< weight of a stationary window right on a node
+#define GYRO_BIAS_WEIGHT_MAX      (32U * GYRO_BIAS_WEIGHT_ONE)  ///< caps the weight of a node, older windows fade out
+#define GYRO_BIAS_SAVE_WINDOWS    64U    ///< stationary windows between two saves of the table
+
+/**@brief Configuration of the engine. */
+typedef struct
+{
+    uint16_t window;              ///< samples per stationarity test
+    uint32_t gyro_var_max;        ///< largest gyroscope variance of a stationary window, LSB^2
+    int16_t  gyro_mean_max;       ///< largest gyroscope mean of a stationary window, a larger one is a steady rotation, LSB
+    uint32_t accel_var_max;       ///< largest accelerometer variance of a stationary window, LSB^2
+    uint16_t accel_lsb_per_g;     ///< sensitivity of the fed accelerometer samples
+    uint16_t accel_tolerance_mg;  ///< largest distance of the acceleration magnitude from 1 g
+    bool     persist;             ///< keeps the table in the settings
+} gyro_bias_config_t;
+
+/**@brief Configuration for the ±250 deg/s gyroscope and ±2 g accelerometer ranges. */
+#define GYRO_BIAS_CONFIG_DEFAULT           \
+    {                                      \
+        .window             = 128U,        \
+        .gyro_var_max       = 400U,        \
+        .gyro_mean_max      = 1000,        \
+        .accel_var_max      = 10000U,      \
+        .accel_lsb_per_g    = 16384U,      \
+        .accel_tolerance_mg = 50U,         \
+        .persist            = true,        \
+    }
+
+/**@brief Statistics of the engine. */
+typedef struct
+{
+    uint32_t windows;             ///< windows tested
+    uint32_t stationary_windows;  ///< windows the bias was learned from
+    uint8_t  learned_nodes;       ///< nodes of the table with a bias
+    uint32_t saves;               ///< table saves to the settings
+    uint32_t save_errors;         ///< table saves that failed
+    int16_t  temp_cc;             ///< current temperature, centi-degrees Celsius
+    int16_t  bias_x;              ///< bias applied at the current temperature
+    int16_t  bias_y;
+    int16_t  bias_z;
+} gyro_bias_stats_t;
+
+/**
+ * @brief Initializes the engine and loads the learned table from the
+ * settings. The settings subsystem is initialized if needed.
+ *
+ * @param[in] p_config configuration, copied
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or an invalid configuration
+ * @return a settings error if the table could not be loaded.
+ */
+int gyro_bias_init(const gyro_bias_config_t * p_config);
+
+/**
+ * @brief Sets the temperature the following samples were taken at and
+ * interpolates the bias for it.
+ *
+ * @param[in] temp raw temperature from app_mpu_read_temp()
+ */
+void gyro_bias_temp_update(temp_value_t temp);
+
+/**
+ * @brief Feeds samples to the stationarity detection, the bias is learned
+ * from every stationary window. The gyroscope samples have to be the raw
+ * ones, before gyro_bias_apply().
+ *
+ * @param[in] p_gyro  gyroscope samples
+ * @param[in] p_accel accelerometer samples taken with them
+ * @param[in] count   samples
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer
+ * @return -EPERM if the engine is not initialized.
+ */
+int gyro_bias_feed(const gyro_values_t * p_gyro, const accel_values_t * p_accel, uint16_t count);
+
+/**
+ * @brief Removes the bias at the current temperature from a batch of
+ * samples, in place.
+ *
+ * @param[in,out] p_gyro gyroscope samples
+ * @param[in]     count  samples
+ */
+void gyro_bias_apply(gyro_values_t * p_gyro, uint16_t count);
+
+/**
+ * @brief Saves the table to the settings, the engine also saves it on its
+ * own every GYRO_BIAS_SAVE_WINDOWS stationary windows and whenever a node
+ * has seen enough windows to be used.
+ *
+ * @return 0 on success
+ * @return -ENOTSUP if the table is not persisted
+ * @return a settings error if the save failed.
+ */
+int gyro_bias_save(void);
+
+/**
+ * @brief Forgets the learned table, also in the settings.
+ *
+ * @return 0 on success
+ * @return a settings error if the stored table could not be deleted.
+ */
+int gyro_bias_reset(void);
+
+/**
+ * @brief Gets the statistics.
+ *
+ * @param[out] p_stats statistics
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int gyro_bias_stats_get(gyro_bias_stats_t * p_stats);
+
+#endif // GYRO_BIAS_H_
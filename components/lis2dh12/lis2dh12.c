@@ -14,20 +14,655 @@
 #include <string.h>
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
+#include <zephyr/logging/log.h>
 
 #include "lis2dh12.h"
+#include "regseq.h"
 #include "twi.h"
 
-int lis2dh12_init()
+#define DT_DRV_COMPAT app_lis2dh12
+
+LOG_MODULE_REGISTER(lis2dh12_component, CONFIG_APP_LIS2DH12_LOG_LEVEL);
+
+#define LIS2DH12_AUTO_INCREMENT   0x80U  ///< MSB of the sub-address, increments the register over a multi-byte access
+#define LIS2DH12_ACCEL_READ_BYTES 7U     ///< STATUS_REG followed by OUT_X_L to OUT_Z_H
+
+static int lis2dh12_regseq_write(void * p_context, uint8_t reg, uint8_t * p_data, uint32_t length)
+{
+    const lis2dh12_t * p_dev = (const lis2dh12_t *)p_context;
+
+    reg |= (length > 1U) ? LIS2DH12_AUTO_INCREMENT : 0U;
+    return twi_write(p_dev->address, reg, p_data, (uint16_t)length);
+}
+
+static int lis2dh12_regseq_read(void * p_context, uint8_t reg, uint8_t * p_data, uint32_t length)
+{
+    const lis2dh12_t * p_dev = (const lis2dh12_t *)p_context;
+
+    reg |= (length > 1U) ? LIS2DH12_AUTO_INCREMENT : 0U;
+    return twi_read(p_dev->address, reg, p_data, (uint16_t)length);
+}
+
+/**
+ * @brief Bring-up sequence run by lis2dh12_init(). A warm reset of the MCU
+ * leaves the chip configured, so the registers the driver keeps shadows of
+ * are written with their power-on values after the reboot, which only
+ * reloads the trimming. The shadows of lis2dh12_t are zero to match.
+ */
+static const regseq_entry_t lis2dh12_init_sequence[] = {
+    REGSEQ_WRITE_DELAY(LIS2DH12_CTRL_REG5, LIS2DH12_CTRL_REG5_BOOT, LIS2DH12_BOOT_US),  // reboot, reloads the trimming
+    REGSEQ_WRITE(LIS2DH12_CTRL_REG2, 0x00U),                                            // no high-pass filters
+    REGSEQ_WRITE(LIS2DH12_CTRL_REG3, 0x00U),                                            // nothing on INT1
+    REGSEQ_WRITE(LIS2DH12_CTRL_REG4, 0x00U),                                            // +-2 g
+    REGSEQ_WRITE(LIS2DH12_CTRL_REG5, 0x00U),                                            // FIFO off, nothing latched
+    REGSEQ_WRITE_VERIFY(LIS2DH12_CTRL_REG6, 0x00U),                                     // nothing on INT2
+    REGSEQ_WRITE(LIS2DH12_FIFO_CTRL_REG, LIS2DH12_FIFO_MODE_BYPASS),                    // watermark 0
+    REGSEQ_ENTRY(LIS2DH12_CTRL_REG1, 0x57U, REGSEQ_VERIFY, LIS2DH12_TURN_ON_US),        // 100 Hz, normal mode, X, Y and Z enabled
+};
+
+static const uint8_t lis2dh12_ids[] = { LIS2DH12_WHO_AM_I_VALUE };
+
+/**
+ * @brief Output data rates in Hz, indexed by enum lis2dh12_odr
+ */
+static const uint16_t lis2dh12_odr_hz[] = { 0U, 1U, 10U, 25U, 50U, 100U, 200U, 400U };
+
+BUILD_ASSERT(LIS2DH12_COUNT > 0, "CONFIG_APP_LIS2DH12 needs an \"app,lis2dh12\" node in the devicetree");
+BUILD_ASSERT(LIS2DH12_COUNT <= TWI_BATCH_MAX_READS, "More LIS2DH12 than a batched read handles");
+
+/**
+ * @brief One instance per devicetree node, at the output data rate the init
+ * sequence sets
+ */
+#define LIS2DH12_INIT(inst)                                                \
+    [inst] = {                                                             \
+        .p_name     = DT_NODE_FULL_NAME(DT_DRV_INST(inst)),                \
+        .address    = DT_INST_PROP(inst, twi_address),                     \
+        .regseq_bus = {                                                    \
+            .write     = lis2dh12_regseq_write,                            \
+            .read      = lis2dh12_regseq_read,                             \
+            .p_context = &lis2dh12_instances[inst],                        \
+        },                                                                 \
+        .regseq_device = {                                                 \
+            .p_name              = DT_NODE_FULL_NAME(DT_DRV_INST(inst)),   \
+            .p_bus               = &lis2dh12_instances[inst].regseq_bus,   \
+            .id_reg              = LIS2DH12_WHO_AM_I,                      \
+            .p_ids               = lis2dh12_ids,                           \
+            .id_count            = ARRAY_SIZE(lis2dh12_ids),               \
+            .p_pre_bus           = NULL,                                   \
+            .p_pre_sequence      = NULL,                                   \
+            .pre_sequence_length = 0U,                                     \
+            .p_sequence          = lis2dh12_init_sequence,                 \
+            .sequence_length     = ARRAY_SIZE(lis2dh12_init_sequence),     \
+        },                                                                 \
+        .odr = LIS2DH12_ODR_100HZ,                                         \
+    },
+
+lis2dh12_t lis2dh12_instances[LIS2DH12_COUNT] = {
+    DT_INST_FOREACH_STATUS_OKAY(LIS2DH12_INIT)
+};
+
+int lis2dh12_init(lis2dh12_t * p_dev)
 {
-    uint8_t ctrl_reg = 0x57U;
     int err;
-    err = twi_write(LIS2DH12_I2C_ADDR, LIS2DH12_CTRL_REG1, &ctrl_reg, sizeof(ctrl_reg));
+
+    err = regseq_probe(&p_dev->regseq_device, NULL);
     if (err != 0)
     {
-        printk("\rFailed to twi_write");
-        return 0;
+        return err;
     }
+
+    err = regseq_run(&p_dev->regseq_bus, lis2dh12_init_sequence, ARRAY_SIZE(lis2dh12_init_sequence), &p_dev->init_report);
+    if (err != 0)
+    {
+        LOG_ERR("lis2dh12_init:regseq_run failed with error: %d", err);
+        return err;
+    }
+
+    // the registers are back at the values the sequence wrote, so are the shadows
+    p_dev->odr           = LIS2DH12_ODR_100HZ;
+    p_dev->ctrl_reg2     = 0U;
+    p_dev->ctrl_reg3     = 0U;
+    p_dev->ctrl_reg5_lir = 0U;
+    p_dev->ctrl_reg6     = 0U;
+#if defined(CONFIG_APP_LIS2DH12_FIFO)
+    p_dev->fifo_fth      = 0U;
+#endif
+
+    LOG_INF("%s init took %u us in %u transactions", p_dev->p_name, p_dev->init_report.duration_us,
+            p_dev->init_report.transactions);
     
     return 0;
-}
\ No newline at end of file
+}
+
+int lis2dh12_init_report_get(lis2dh12_t * p_dev, regseq_report_t * p_report)
+{
+    if (p_report == NULL)
+    {
+        return -EINVAL;
+    }
+
+    *p_report = p_dev->init_report;
+    return 0;
+}
+
+/**
+ * @brief Decodes STATUS_REG followed by OUT_X_L to OUT_Z_H.
+ *
+ * @param[in]  p_raw          the 7 registers
+ * @param[out] p_accel_values raw left-aligned acceleration, not modified when no new sample is available
+ *
+ * @return 0 on success
+ * @return -ENODATA if no new sample arrived since the last read.
+ */
+static int lis2dh12_accel_decode(const uint8_t * p_raw, accel_values_t * p_accel_values)
+{
+    if ((p_raw[0] & LIS2DH12_STATUS_ZYXDA) == 0U)
+    {
+        return -ENODATA;
+    }
+
+    p_accel_values->x = (int16_t)((uint16_t)p_raw[1] | ((uint16_t)p_raw[2] << 8));
+    p_accel_values->y = (int16_t)((uint16_t)p_raw[3] | ((uint16_t)p_raw[4] << 8));
+    p_accel_values->z = (int16_t)((uint16_t)p_raw[5] | ((uint16_t)p_raw[6] << 8));
+
+    return 0;
+}
+
+int lis2dh12_read_accel(lis2dh12_t * p_dev, accel_values_t * p_accel_values)
+{
+    // STATUS_REG followed by OUT_X_L to OUT_Z_H
+    uint8_t raw[LIS2DH12_ACCEL_READ_BYTES];
+    int err;
+
+    err = lis2dh12_regseq_read(p_dev, LIS2DH12_STATUS_REG, raw, sizeof(raw));
+    if (err != 0)
+    {
+        return err;
+    }
+
+    return lis2dh12_accel_decode(raw, p_accel_values);
+}
+
+int lis2dh12_read_accel_multi(lis2dh12_t * const * pp_devs, uint8_t count, accel_values_t * p_accel_values,
+                              int * p_errs)
+{
+    twi_read_batch_t reads[TWI_BATCH_MAX_READS];
+    uint8_t          raw[TWI_BATCH_MAX_READS][LIS2DH12_ACCEL_READ_BYTES];
+    int              first_err = 0;
+
+    if ((pp_devs == NULL) || (p_accel_values == NULL) || (p_errs == NULL) || (count == 0U) ||
+        (count > TWI_BATCH_MAX_READS))
+    {
+        return -EINVAL;
+    }
+
+    for (uint8_t i = 0U; i < count; i++)
+    {
+        reads[i] = (twi_read_batch_t){
+            .address     = pp_devs[i]->address,
+            .reg_address = LIS2DH12_STATUS_REG | LIS2DH12_AUTO_INCREMENT,
+            .p_data      = raw[i],
+            .length      = LIS2DH12_ACCEL_READ_BYTES,
+        };
+    }
+
+    (void)twi_read_batch(reads, count, NULL);
+
+    for (uint8_t i = 0U; i < count; i++)
+    {
+        p_errs[i] = (reads[i].err != 0) ? reads[i].err : lis2dh12_accel_decode(raw[i], &p_accel_values[i]);
+        first_err = (first_err == 0) ? p_errs[i] : first_err;
+    }
+
+    return first_err;
+}
+
+int lis2dh12_odr_set(lis2dh12_t * p_dev, enum lis2dh12_odr odr)
+{
+    uint8_t ctrl_reg1;
+    int err;
+
+    if ((uint32_t)odr >= ARRAY_SIZE(lis2dh12_odr_hz))
+    {
+        return -EINVAL;
+    }
+
+    ctrl_reg1 = (uint8_t)(((uint8_t)odr << 4) | LIS2DH12_CTRL_REG1_XYZ_EN);
+    err = lis2dh12_regseq_write(p_dev, LIS2DH12_CTRL_REG1, &ctrl_reg1, 1U);
+    if (err != 0)
+    {
+        LOG_ERR("lis2dh12_odr_set:write failed with error: %d", err);
+        return err;
+    }
+
+    p_dev->odr = odr;
+    return 0;
+}
+
+uint16_t lis2dh12_odr_hz_get(lis2dh12_t * p_dev)
+{
+    return lis2dh12_odr_hz[p_dev->odr];
+}
+
+/**
+ * @brief Converts a time to samples at the output data rate.
+ *
+ * @param[in]  p_dev     device
+ * @param[in]  time_ms   time
+ * @param[in]  max       largest number of samples the register holds
+ * @param[out] p_samples samples
+ *
+ * @return 0 on success
+ * @return -EINVAL if the time does not fit or the device is powered down.
+ */
+static int lis2dh12_ms_to_samples(lis2dh12_t * p_dev, uint32_t time_ms, uint32_t max, uint8_t * p_samples)
+{
+    uint32_t odr_hz  = lis2dh12_odr_hz[p_dev->odr];
+    uint32_t samples = ((time_ms * odr_hz) + 500U) / 1000U;
+
+    if ((odr_hz == 0U) || (samples > max))
+    {
+        return -EINVAL;
+    }
+
+    *p_samples = (uint8_t)samples;
+    return 0;
+}
+
+/**
+ * @brief Routes interrupt sources to a pin, or takes them off it.
+ *
+ * @param[in] p_dev  device
+ * @param[in] pin    1 for INT1, 2 for INT2
+ * @param[in] mask   LIS2DH12_INT_ROUTE_* bits, or bits of CTRL_REG3 or CTRL_REG6 for the pin
+ * @param[in] enable true to route the sources to the pin
+ *
+ * @return 0 on success
+ * @return -ETIMEDOUT or -ENOTTY on a bus error.
+ */
+static int lis2dh12_int_route(lis2dh12_t * p_dev, uint8_t pin, uint8_t mask, bool enable)
+{
+    uint8_t * p_shadow = (pin == 1U) ? &p_dev->ctrl_reg3 : &p_dev->ctrl_reg6;
+    uint8_t   ctrl     = enable ? (*p_shadow | mask) : (*p_shadow & ~mask);
+    int       err;
+
+    err = lis2dh12_regseq_write(p_dev, (pin == 1U) ? LIS2DH12_CTRL_REG3 : LIS2DH12_CTRL_REG6, &ctrl, 1U);
+    *p_shadow = (err == 0) ? ctrl : *p_shadow;
+
+    return err;
+}
+
+/**
+ * @brief Configures an interrupt generator and routes it to the pin of the
+ * same number.
+ *
+ * @param[in] p_dev     device
+ * @param[in] gen       1 or 2
+ * @param[in] cfg       INTx_CFG, 0 disables the generator and takes it off its pin
+ * @param[in] threshold INTx_THS
+ * @param[in] duration  INTx_DURATION in samples
+ * @param[in] high_pass true to compare the high-pass filtered acceleration
+ * @param[in] latch     true to hold the event until INTx_SRC is read
+ *
+ * @return 0 on success
+ * @return -ETIMEDOUT or -ENOTTY on a bus error.
+ */
+static int lis2dh12_int_gen_write(lis2dh12_t * p_dev, uint8_t gen, uint8_t cfg, uint8_t threshold, uint8_t duration,
+                                  bool high_pass, bool latch)
+{
+    const uint8_t reg_offset = (gen == 1U) ? 0U : (LIS2DH12_INT2_CFG - LIS2DH12_INT1_CFG);
+    const uint8_t hp_mask    = (gen == 1U) ? LIS2DH12_CTRL_REG2_HP_IA1 : LIS2DH12_CTRL_REG2_HP_IA2;
+    const uint8_t lir_mask   = (gen == 1U) ? LIS2DH12_CTRL_REG5_LIR_INT1 : LIS2DH12_CTRL_REG5_LIR_INT2;
+    const uint8_t route_mask = (gen == 1U) ? LIS2DH12_INT_ROUTE_IA1 : LIS2DH12_INT_ROUTE_IA2;
+    uint8_t       regs[3];
+    uint8_t       ctrl;
+    int           err;
+
+    // INTx_CFG, INTx_SRC (read only, skipped by the write), INTx_THS and INTx_DURATION
+    regs[0] = cfg;
+    regs[1] = threshold & 0x7FU;
+    regs[2] = duration & 0x7FU;
+
+    err = lis2dh12_regseq_write(p_dev, LIS2DH12_INT1_CFG + reg_offset, &regs[0], 1U);
+    if (err == 0)
+    {
+        err = lis2dh12_regseq_write(p_dev, LIS2DH12_INT1_THS + reg_offset, &regs[1], 2U);
+    }
+
+    // the filter removes gravity so the threshold applies to the change of acceleration only
+    if (err == 0)
+    {
+        ctrl = high_pass ? (p_dev->ctrl_reg2 | hp_mask) : (p_dev->ctrl_reg2 & ~hp_mask);
+        err = lis2dh12_regseq_write(p_dev, LIS2DH12_CTRL_REG2, &ctrl, 1U);
+        p_dev->ctrl_reg2 = (err == 0) ? ctrl : p_dev->ctrl_reg2;
+    }
+
+    // CTRL_REG5 also holds the FIFO enable, it is read back and only when the latch changes
+    if ((err == 0) && (((p_dev->ctrl_reg5_lir & lir_mask) != 0U) != latch))
+    {
+        err = lis2dh12_regseq_read(p_dev, LIS2DH12_CTRL_REG5, &ctrl, 1U);
+        if (err != 0)
+        {
+            return err;
+        }
+
+        ctrl = latch ? (ctrl | lir_mask) : (ctrl & ~lir_mask);
+        err = lis2dh12_regseq_write(p_dev, LIS2DH12_CTRL_REG5, &ctrl, 1U);
+        p_dev->ctrl_reg5_lir = (err == 0) ? (ctrl & (LIS2DH12_CTRL_REG5_LIR_INT1 | LIS2DH12_CTRL_REG5_LIR_INT2))
+                                            : p_dev->ctrl_reg5_lir;
+    }
+
+    if (err == 0)
+    {
+        err = lis2dh12_int_route(p_dev, gen, route_mask, cfg != 0U);
+    }
+
+    // clears an event latched with the previous configuration
+    if (err == 0)
+    {
+        err = lis2dh12_regseq_read(p_dev, LIS2DH12_INT1_SRC + reg_offset, &regs[0], 1U);
+    }
+
+    return err;
+}
+
+int lis2dh12_motion_int1_config(lis2dh12_t * p_dev, uint16_t threshold_mg, uint8_t duration)
+{
+    uint16_t threshold = threshold_mg / LIS2DH12_MG_PR_LSB_THS;
+    int      err;
+
+    if (threshold > 0x7FU)
+    {
+        return -EINVAL;
+    }
+
+    err = lis2dh12_int_gen_write(p_dev, 1U, (threshold != 0U) ? LIS2DH12_INT_CFG_XYZ_HIE : 0U, (uint8_t)threshold, duration,
+                                 threshold != 0U, (p_dev->ctrl_reg5_lir & LIS2DH12_CTRL_REG5_LIR_INT1) != 0U);
+    if (err != 0)
+    {
+        LOG_ERR("lis2dh12_motion_int1_config:bus access failed with error: %d", err);
+    }
+
+    return err;
+}
+
+int lis2dh12_int_gen_config(lis2dh12_t * p_dev, uint8_t gen, uint8_t cfg, uint16_t threshold_mg, uint16_t duration_ms,
+                            bool high_pass)
+{
+    uint16_t threshold = threshold_mg / LIS2DH12_MG_PR_LSB_THS;
+    uint8_t  duration  = 0U;
+    int      err;
+
+    if (((gen != 1U) && (gen != 2U)) || (threshold > 0x7FU))
+    {
+        return -EINVAL;
+    }
+
+    if (cfg != 0U)
+    {
+        err = lis2dh12_ms_to_samples(p_dev, duration_ms, 0x7FU, &duration);
+        if (err != 0)
+        {
+            return err;
+        }
+    }
+
+    err = lis2dh12_int_gen_write(p_dev, gen, cfg, (uint8_t)threshold, duration, high_pass && (cfg != 0U), cfg != 0U);
+    if (err != 0)
+    {
+        LOG_ERR("lis2dh12_int_gen_config:bus access failed with error: %d", err);
+    }
+
+    return err;
+}
+
+int lis2dh12_click_config(lis2dh12_t * p_dev, uint8_t cfg, uint16_t threshold_mg, uint16_t time_limit_ms,
+                          uint16_t latency_ms, uint16_t window_ms, uint8_t pin)
+{
+    uint16_t threshold = threshold_mg / LIS2DH12_MG_PR_LSB_THS;
+    uint8_t  regs[4]   = { 0U };
+    uint8_t  ctrl;
+    int      err = 0;
+
+    if (((pin != 1U) && (pin != 2U)) || (threshold > 0x7FU))
+    {
+        return -EINVAL;
+    }
+
+    // CLICK_THS with the latch, TIME_LIMIT, TIME_LATENCY and TIME_WINDOW are consecutive
+    if (cfg != 0U)
+    {
+        regs[0] = (uint8_t)threshold | LIS2DH12_CLICK_THS_LIR;
+        err = lis2dh12_ms_to_samples(p_dev, time_limit_ms, 0x7FU, &regs[1]);
+        if (err == 0)
+        {
+            err = lis2dh12_ms_to_samples(p_dev, latency_ms, 0xFFU, &regs[2]);
+        }
+        if (err == 0)
+        {
+            err = lis2dh12_ms_to_samples(p_dev, window_ms, 0xFFU, &regs[3]);
+        }
+        if (err != 0)
+        {
+            return err;
+        }
+    }
+
+    err = lis2dh12_regseq_write(p_dev, LIS2DH12_CLICK_CFG, &cfg, 1U);
+    if (err == 0)
+    {
+        err = lis2dh12_regseq_write(p_dev, LIS2DH12_CLICK_THS, regs, sizeof(regs));
+    }
+
+    // a click is a short peak on top of gravity
+    if (err == 0)
+    {
+        ctrl = (cfg != 0U) ? (p_dev->ctrl_reg2 | LIS2DH12_CTRL_REG2_HPCLICK)
+                           : (p_dev->ctrl_reg2 & ~LIS2DH12_CTRL_REG2_HPCLICK);
+        err = lis2dh12_regseq_write(p_dev, LIS2DH12_CTRL_REG2, &ctrl, 1U);
+        p_dev->ctrl_reg2 = (err == 0) ? ctrl : p_dev->ctrl_reg2;
+    }
+
+    // off both pins first, so moving the click to the other pin leaves nothing behind
+    if (err == 0)
+    {
+        err = lis2dh12_int_route(p_dev, (pin == 1U) ? 2U : 1U, LIS2DH12_INT_ROUTE_CLICK, false);
+    }
+    if (err == 0)
+    {
+        err = lis2dh12_int_route(p_dev, pin, LIS2DH12_INT_ROUTE_CLICK, cfg != 0U);
+    }
+
+    if (err != 0)
+    {
+        LOG_ERR("lis2dh12_click_config:bus access failed with error: %d", err);
+    }
+
+    return err;
+}
+
+int lis2dh12_activity_config(lis2dh12_t * p_dev, uint16_t threshold_mg, uint32_t duration_ms)
+{
+    uint16_t threshold = threshold_mg / LIS2DH12_MG_PR_LSB_THS;
+    uint32_t odr_hz    = lis2dh12_odr_hz[p_dev->odr];
+    uint32_t samples;
+    uint8_t  regs[2];
+    int      err;
+
+    if ((threshold > 0x7FU) || (odr_hz == 0U))
+    {
+        return -EINVAL;
+    }
+
+    // the sleep-to-wake duration is (8 * ACT_DUR + 1) samples
+    samples = (duration_ms * odr_hz) / 1000U;
+    samples = (samples > 0U) ? ((samples - 1U) / 8U) : 0U;
+    if (samples > 0xFFU)
+    {
+        return -EINVAL;
+    }
+
+    regs[0] = (uint8_t)threshold;
+    regs[1] = (uint8_t)samples;
+
+    err = lis2dh12_regseq_write(p_dev, LIS2DH12_ACT_THS, regs, sizeof(regs));
+    if (err != 0)
+    {
+        LOG_ERR("lis2dh12_activity_config:write failed with error: %d", err);
+    }
+
+    return err;
+}
+
+int lis2dh12_int_src_get(lis2dh12_t * p_dev, uint8_t * p_int1_src, uint8_t * p_click_src)
+{
+    int err;
+
+    err = lis2dh12_regseq_read(p_dev, LIS2DH12_INT1_SRC, p_int1_src, 1U);
+    if (err == 0)
+    {
+        err = lis2dh12_regseq_read(p_dev, LIS2DH12_CLICK_SRC, p_click_src, 1U);
+    }
+
+    return err;
+}
+
+int lis2dh12_activity_int2_route(lis2dh12_t * p_dev, bool enable)
+{
+    int err = lis2dh12_int_route(p_dev, 2U, LIS2DH12_CTRL_REG6_I2_ACT, enable);
+
+    if (err != 0)
+    {
+        LOG_ERR("lis2dh12_activity_int2_route:write failed with error: %d", err);
+    }
+
+    return err;
+}
+
+int lis2dh12_int_gen_src_get(lis2dh12_t * p_dev, uint8_t gen, uint8_t * p_src)
+{
+    if ((gen != 1U) && (gen != 2U))
+    {
+        return -EINVAL;
+    }
+
+    return lis2dh12_regseq_read(p_dev, (gen == 1U) ? LIS2DH12_INT1_SRC : LIS2DH12_INT2_SRC, p_src, 1U);
+}
+
+int lis2dh12_click_src_get(lis2dh12_t * p_dev, uint8_t * p_click_src)
+{
+    return lis2dh12_regseq_read(p_dev, LIS2DH12_CLICK_SRC, p_click_src, 1U);
+}
+
+#if defined(CONFIG_APP_LIS2DH12_FIFO)
+int lis2dh12_fifo_enable(lis2dh12_t * p_dev, bool enable)
+{
+    uint8_t value = LIS2DH12_FIFO_MODE_BYPASS;
+    int     err;
+
+    err = lis2dh12_regseq_write(p_dev, LIS2DH12_FIFO_CTRL_REG, &value, 1U);
+    if (err == 0)
+    {
+        value = (enable ? LIS2DH12_CTRL_REG5_FIFO_EN : 0U) | p_dev->ctrl_reg5_lir;
+        err = lis2dh12_regseq_write(p_dev, LIS2DH12_CTRL_REG5, &value, 1U);
+    }
+
+    if ((err == 0) && enable)
+    {
+        value = LIS2DH12_FIFO_MODE_STREAM | p_dev->fifo_fth;
+        err = lis2dh12_regseq_write(p_dev, LIS2DH12_FIFO_CTRL_REG, &value, 1U);
+    }
+
+    if (err != 0)
+    {
+        LOG_ERR("lis2dh12_fifo_enable:write failed with error: %d", err);
+    }
+
+    return err;
+}
+
+int lis2dh12_fifo_read_accel(lis2dh12_t * p_dev, accel_values_t * p_accel_values, uint16_t max_frames,
+                             uint16_t * p_frames, bool * p_overrun)
+{
+    uint8_t  raw[LIS2DH12_FIFO_READ_FRAMES * 6U];
+    uint16_t count;
+    int      err;
+
+    *p_frames = 0U;
+
+    err = lis2dh12_regseq_read(p_dev, LIS2DH12_FIFO_SRC_REG, raw, 1U);
+    if (err != 0)
+    {
+        return err;
+    }
+
+    if (p_overrun != NULL)
+    {
+        *p_overrun = (raw[0] & LIS2DH12_FIFO_SRC_OVRN) != 0U;
+    }
+
+    // FSS wraps to 0 when the FIFO is full
+    count = ((raw[0] & LIS2DH12_FIFO_SRC_OVRN) != 0U) ? LIS2DH12_FIFO_DEPTH : (raw[0] & LIS2DH12_FIFO_SRC_FSS);
+    count = MIN(count, max_frames);
+
+    while (*p_frames < count)
+    {
+        uint16_t chunk = MIN(count - *p_frames, LIS2DH12_FIFO_READ_FRAMES);
+
+        // with the FIFO enabled the auto increment wraps from OUT_Z_H back to OUT_X_L
+        err = lis2dh12_regseq_read(p_dev, LIS2DH12_OUT_X_L, raw, chunk * 6U);
+        if (err != 0)
+        {
+            return err;
+        }
+
+        for (uint16_t i = 0; i < chunk; i++)
+        {
+            accel_values_t * p_sample = &p_accel_values[*p_frames];
+
+            p_sample->x = (int16_t)((uint16_t)raw[i * 6U]      | ((uint16_t)raw[i * 6U + 1U] << 8));
+            p_sample->y = (int16_t)((uint16_t)raw[i * 6U + 2U] | ((uint16_t)raw[i * 6U + 3U] << 8));
+            p_sample->z = (int16_t)((uint16_t)raw[i * 6U + 4U] | ((uint16_t)raw[i * 6U + 5U] << 8));
+            (*p_frames)++;
+        }
+    }
+
+    return 0;
+}
+
+int lis2dh12_fifo_watermark_set(lis2dh12_t * p_dev, uint8_t frames)
+{
+    uint8_t regs[2];
+    int     err;
+
+    if ((frames == 0U) || (frames >= LIS2DH12_FIFO_DEPTH))
+    {
+        return -EINVAL;
+    }
+
+    // the mode bits are kept, the FIFO has to stay in stream mode
+    err = lis2dh12_regseq_read(p_dev, LIS2DH12_FIFO_CTRL_REG, &regs[0], 1U);
+    if (err == 0)
+    {
+        regs[0] = (uint8_t)((regs[0] & ~LIS2DH12_FIFO_SRC_FSS) | frames);
+        err = lis2dh12_regseq_write(p_dev, LIS2DH12_FIFO_CTRL_REG, &regs[0], 1U);
+    }
+
+    if (err == 0)
+    {
+        regs[1] = p_dev->ctrl_reg3 | LIS2DH12_CTRL_REG3_I1_WTM;
+        err = lis2dh12_regseq_write(p_dev, LIS2DH12_CTRL_REG3, &regs[1], 1U);
+    }
+
+    if (err != 0)
+    {
+        LOG_ERR("lis2dh12_fifo_watermark_set:bus access failed with error: %d", err);
+        return err;
+    }
+
+    p_dev->fifo_fth  = frames;
+    p_dev->ctrl_reg3 = regs[1];
+    return 0;
+}
+#endif
@@ -15,9 +15,12 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <zephyr/devicetree.h>
+
+#include "regseq.h"
+#include "sensor_types.h"
 
 // Register addresses
-#define LIS2DH12_I2C_ADDR         0x18
 #define LIS2DH12_STATUS_REG_AUX   0x07
 #define LIS2DH12_OUT_TEMP_L       0x0C
 #define LIS2DH12_OUT_TEMP_H       0x0D
@@ -57,54 +60,329 @@
 #define LIS2DH12_ACT_THS          0x3E
 #define LIS2DH12_ACT_DUR          0x3F
 
-/**@brief Enum defining Accelerometer's Full Scale range posibillities in Gs. */
-enum accel_range
-{
-    AFS_2G = 0, // 2 G
-    AFS_4G,     // 4 G
-    AFS_8G,     // 8 G
-    AFS_16G     // 16 G
-};
+#define LIS2DH12_WHO_AM_I_VALUE   0x33   // Value of the WHO_AM_I register
+#define LIS2DH12_STATUS_ZYXDA     0x08   // STATUS_REG: a new X, Y and Z sample is available
+#define LIS2DH12_TURN_ON_US       1000   // Turn-on time after leaving power down, the first sample follows after 1/ODR
+#define LIS2DH12_BOOT_US          5000   // Time the reboot of the memory content takes
+#define LIS2DH12_CTRL_REG5_BOOT   0x80   // CTRL_REG5: reboot the memory content, clears itself when done
+#define LIS2DH12_CTRL_REG1_XYZ_EN 0x07   // CTRL_REG1: X, Y and Z axes enabled
+#define LIS2DH12_CTRL_REG3_I1_IA1 0x40   // CTRL_REG3: interrupt generator 1 on INT1
+#define LIS2DH12_CTRL_REG3_I1_WTM 0x04   // CTRL_REG3: FIFO watermark on INT1
+#define LIS2DH12_CTRL_REG2_HP_IA1 0x01   // CTRL_REG2: high-pass filter on interrupt generator 1
+#define LIS2DH12_CTRL_REG2_HP_IA2 0x02   // CTRL_REG2: high-pass filter on interrupt generator 2
+#define LIS2DH12_CTRL_REG2_HPCLICK 0x04  // CTRL_REG2: high-pass filter on the click detection
+#define LIS2DH12_CTRL_REG5_LIR_INT1 0x08 // CTRL_REG5: interrupt generator 1 latched until INT1_SRC is read
+#define LIS2DH12_CTRL_REG5_LIR_INT2 0x02 // CTRL_REG5: interrupt generator 2 latched until INT2_SRC is read
+#define LIS2DH12_CTRL_REG6_I2_ACT 0x08   // CTRL_REG6: sleep-to-wake state on INT2
+#define LIS2DH12_INT_ROUTE_CLICK  0x80   // CTRL_REG3 and CTRL_REG6: click detection on the pin
+#define LIS2DH12_INT_ROUTE_IA1    0x40   // CTRL_REG3 and CTRL_REG6: interrupt generator 1 on the pin
+#define LIS2DH12_INT_ROUTE_IA2    0x20   // CTRL_REG3 and CTRL_REG6: interrupt generator 2 on the pin
+#define LIS2DH12_INT_CFG_XYZ_HIE  0x2A   // INTx_CFG: OR of the X, Y and Z high events
+#define LIS2DH12_INT_CFG_XYZ_LIE  0x15   // INTx_CFG: X, Y and Z low events
+#define LIS2DH12_INT_CFG_AOI      0x80   // INTx_CFG: AND of the enabled events instead of OR
+#define LIS2DH12_INT_SRC_X        0x03   // INTx_SRC: XL or XH
+#define LIS2DH12_INT_SRC_Y        0x0C   // INTx_SRC: YL or YH
+#define LIS2DH12_INT_SRC_Z        0x30   // INTx_SRC: ZL or ZH
+#define LIS2DH12_SRC_IA           0x40   // INTx_SRC and CLICK_SRC: an interrupt is active
+#define LIS2DH12_CLICK_CFG_XYZ_S  0x15   // CLICK_CFG: single click on X, Y and Z
+#define LIS2DH12_CLICK_CFG_XYZ_D  0x2A   // CLICK_CFG: double click on X, Y and Z
+#define LIS2DH12_CLICK_THS_LIR    0x80   // CLICK_THS: click latched until CLICK_SRC is read
+#define LIS2DH12_CLICK_SRC_DCLICK 0x20   // CLICK_SRC: double click
+#define LIS2DH12_CLICK_SRC_SCLICK 0x10   // CLICK_SRC: single click
+#define LIS2DH12_CLICK_SRC_SIGN   0x08   // CLICK_SRC: the click was negative
+#define LIS2DH12_CLICK_SRC_X      0x01   // CLICK_SRC: click on X
+#define LIS2DH12_CLICK_SRC_Y      0x02   // CLICK_SRC: click on Y
+#define LIS2DH12_CLICK_SRC_Z      0x04   // CLICK_SRC: click on Z
+#define LIS2DH12_MG_PR_LSB_THS    16     // INTx_THS and ACT_THS resolution at +-2 g
+#define LIS2DH12_CTRL_REG5_FIFO_EN 0x40  // CTRL_REG5: FIFO enabled
+#define LIS2DH12_FIFO_MODE_BYPASS 0x00   // FIFO_CTRL_REG: bypass mode, also empties the FIFO
+#define LIS2DH12_FIFO_MODE_STREAM 0x80   // FIFO_CTRL_REG: stream mode, the oldest sample is dropped when full
+#define LIS2DH12_FIFO_SRC_OVRN    0x40   // FIFO_SRC_REG: the FIFO is full and samples are being dropped
+#define LIS2DH12_FIFO_SRC_FSS     0x1F   // FIFO_SRC_REG: unread samples
+#define LIS2DH12_FIFO_DEPTH       32     // Samples the FIFO holds
+#define LIS2DH12_FIFO_READ_FRAMES 8      // Samples moved per FIFO burst read
 
-/**@brief Enum defining Gyroscopes? Full Scale range posibillities in Degrees Pr Second. */
-enum gyro_range
+/**
+ * @brief Output data rates, the value of CTRL_REG1 ODR[3:0]
+ */
+enum lis2dh12_odr
 {
-    GFS_250DPS = 0, // 250 deg/s
-    GFS_500DPS,     // 500 deg/s
-    GFS_1000DPS,    // 1000 deg/s
-    GFS_2000DPS     // 2000 deg/s
+    LIS2DH12_ODR_POWER_DOWN = 0,
+    LIS2DH12_ODR_1HZ,
+    LIS2DH12_ODR_10HZ,
+    LIS2DH12_ODR_25HZ,
+    LIS2DH12_ODR_50HZ,
+    LIS2DH12_ODR_100HZ,
+    LIS2DH12_ODR_200HZ,
+    LIS2DH12_ODR_400HZ,
 };
 
-/**@brief Structure to hold acceleromter values.
- * Sequence of z, y, and x is important to correspond with
- * the sequence of which z, y, and x data are read from the sensor.
- * All values are unsigned 16 bit integers
+/**
+ * @brief One LIS2DH12: its address on the TWI bus, the shadow of the
+ * registers it shares between features and its state. The instances are
+ * allocated from the devicetree nodes with the "app,lis2dh12" compatible,
+ * see lis2dh12_instances.
  */
 typedef struct
 {
-    int16_t z;
-    int16_t y;
-    int16_t x;
-} accel_values_t;
+    const char *      p_name;         ///< devicetree node name, for logs
+    uint8_t           address;        ///< TWI address, 0x18, or 0x19 with SA0 high
+    regseq_bus_t      regseq_bus;     ///< register access used by the init sequence
+    regseq_device_t   regseq_device;  ///< identification and init sequence, used by lis2dh12_init() and the bring-up manager
+    regseq_report_t   init_report;    ///< outcome of the last init sequence
+    enum lis2dh12_odr odr;            ///< output data rate set by the init sequence or lis2dh12_odr_set()
+    // the shadows below hold what the init sequence writes, it resets the registers they mirror
+    uint8_t           ctrl_reg2;      ///< high-pass filter of the interrupt generators and the click, CTRL_REG2
+    uint8_t           ctrl_reg3;      ///< interrupts routed to INT1, CTRL_REG3 is shared by the motion and FIFO interrupts
+    uint8_t           ctrl_reg5_lir;  ///< latched interrupt generators, kept in CTRL_REG5 next to the FIFO enable
+    uint8_t           ctrl_reg6;      ///< interrupts routed to INT2, CTRL_REG6
+#if defined(CONFIG_APP_LIS2DH12_FIFO)
+    uint8_t           fifo_fth;       ///< FIFO watermark, kept in FIFO_CTRL_REG next to the FIFO mode
+#endif
+} lis2dh12_t;
 
-/**@brief Structure to hold gyroscope values.
- * Sequence of z, y, and x is important to correspond with
- * the sequence of which z, y, and x data are read from the sensor.
- * All values are unsigned 16 bit integers
+#define LIS2DH12_COUNT   DT_NUM_INST_STATUS_OKAY(app_lis2dh12)  ///< devices in the devicetree
+#define LIS2DH12_DEFAULT (&lis2dh12_instances[0])               ///< first device, used by the components that handle a single one
+
+/**
+ * @brief Devices of the devicetree, in instance order
  */
-typedef struct
-{
-    int16_t z;
-    int16_t y;
-    int16_t x;
-} gyro_values_t;
+extern lis2dh12_t lis2dh12_instances[LIS2DH12_COUNT];
 
 /**
  * @brief  LIS2DH12 initialization function
  * 
+ * @param[in] p_dev device
  * @return int 
  */
-int lis2dh12_init(void);
+int lis2dh12_init(lis2dh12_t * p_dev);
+
+/**
+ * @brief Gets the outcome of the last lis2dh12_init() sequence, including
+ * how long the cold-boot initialization took.
+ * 
+ * @param[in] p_dev device
+ * @param[out] p_report report of the init sequence
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int lis2dh12_init_report_get(lis2dh12_t * p_dev, regseq_report_t * p_report);
+
+/**
+ * @brief Reads the latest acceleration sample. STATUS_REG and the output
+ * registers are read in a single burst.
+ * 
+ * @param[in] p_dev device
+ * @param[out] p_accel_values raw left-aligned acceleration, not modified when no new sample is available
+ * 
+ * @return 0 on success
+ * @return -ENODATA if no new sample arrived since the last read
+ * @return -ETIMEDOUT or -ENOTTY on a bus error.
+ */
+int lis2dh12_read_accel(lis2dh12_t * p_dev, accel_values_t * p_accel_values);
+
+/**
+ * @brief Reads the latest acceleration sample of several devices. The reads
+ * share one bus ownership, so the devices are sampled within the same
+ * scheduling period.
+ * 
+ * @param[in]  pp_devs        devices
+ * @param[in]  count          number of devices, at most TWI_BATCH_MAX_READS
+ * @param[out] p_accel_values one sample per device, in the order of pp_devs, not modified for a device without a new sample
+ * @param[out] p_errs         result per device, as lis2dh12_read_accel() returns it
+ * 
+ * @return 0 if every device had a new sample
+ * @return -EINVAL on a NULL pointer or a count out of range
+ * @return the result of the first device that had none otherwise.
+ */
+int lis2dh12_read_accel_multi(lis2dh12_t * const * pp_devs, uint8_t count, accel_values_t * p_accel_values,
+                              int * p_errs);
+
+/**
+ * @brief Changes the output data rate, the axes stay enabled.
+ * 
+ * @param[in] p_dev device
+ * @param[in] odr new output data rate
+ * 
+ * @return 0 on success
+ * @return -EINVAL on an unknown rate
+ * @return -ETIMEDOUT or -ENOTTY on a bus error.
+ */
+int lis2dh12_odr_set(lis2dh12_t * p_dev, enum lis2dh12_odr odr);
+
+/**
+ * @brief Gets the output data rate in Hz.
+ * 
+ * @param[in] p_dev device
+ * @return uint16_t output data rate, 0 in power down
+ */
+uint16_t lis2dh12_odr_hz_get(lis2dh12_t * p_dev);
+
+/**
+ * @brief Configures interrupt generator 1 to raise INT1 as soon as the
+ * high-pass filtered acceleration of any axis exceeds the threshold.
+ * 
+ * @param[in] p_dev device
+ * @param[in] threshold_mg motion threshold in mg, a threshold of 0 disables the interrupt
+ * @param[in] duration     samples the threshold has to be exceeded for
+ * 
+ * @return 0 on success
+ * @return -EINVAL if the threshold is out of range
+ * @return -ETIMEDOUT or -ENOTTY on a bus error.
+ */
+int lis2dh12_motion_int1_config(lis2dh12_t * p_dev, uint16_t threshold_mg, uint8_t duration);
+
+/**
+ * @brief Configures interrupt generator 1 or 2, routes it to the pin of the
+ * same number and latches its events until its source register is read.
+ * Free fall is the AND of the low events on the unfiltered acceleration,
+ * motion the OR of the high events on the high-pass filtered one.
+ * 
+ * @param[in] p_dev device
+ * @param[in] gen          1 or 2
+ * @param[in] cfg          INTx_CFG, LIS2DH12_INT_CFG_* bits, 0 disables the generator
+ * @param[in] threshold_mg threshold in mg
+ * @param[in] duration_ms  time the condition has to hold, in steps of the output data rate
+ * @param[in] high_pass    true to compare the high-pass filtered acceleration
+ * 
+ * @return 0 on success
+ * @return -EINVAL if a parameter is out of range or the device is powered down
+ * @return -ETIMEDOUT or -ENOTTY on a bus error.
+ */
+int lis2dh12_int_gen_config(lis2dh12_t * p_dev, uint8_t gen, uint8_t cfg, uint16_t threshold_mg, uint16_t duration_ms,
+                            bool high_pass);
+
+/**
+ * @brief Configures the click detection on the high-pass filtered
+ * acceleration, routes it to a pin and latches it until CLICK_SRC is read.
+ * The times are in steps of the output data rate.
+ * 
+ * @param[in] p_dev device
+ * @param[in] cfg           CLICK_CFG, LIS2DH12_CLICK_CFG_* bits, 0 disables the detection
+ * @param[in] threshold_mg  click threshold in mg
+ * @param[in] time_limit_ms longest time above the threshold that still counts as a click
+ * @param[in] latency_ms    dead time after the first click of a double click
+ * @param[in] window_ms     time the second click of a double click has to start in
+ * @param[in] pin           1 for INT1, 2 for INT2
+ * 
+ * @return 0 on success
+ * @return -EINVAL if a parameter is out of range or the device is powered down
+ * @return -ETIMEDOUT or -ENOTTY on a bus error.
+ */
+int lis2dh12_click_config(lis2dh12_t * p_dev, uint8_t cfg, uint16_t threshold_mg, uint16_t time_limit_ms,
+                          uint16_t latency_ms,                           uint16_t window_ms, uint8_t pin);
+
+/**
+ * @brief Configures the sleep-to-wake function. Once the acceleration stays
+ * below the threshold for the duration the device drops to 10 Hz low-power
+ * mode on its own and goes back to the configured rate on the first sample
+ * above it.
+ * 
+ * @param[in] p_dev device
+ * @param[in] threshold_mg activity threshold in mg, a threshold of 0 disables the function
+ * @param[in] duration_ms  inactivity time before the rate is lowered
+ * 
+ * @return 0 on success
+ * @return -EINVAL if a parameter is out of range or the device is powered down
+ * @return -ETIMEDOUT or -ENOTTY on a bus error.
+ */
+int lis2dh12_activity_config(lis2dh12_t * p_dev, uint16_t threshold_mg, uint32_t duration_ms);
+
+/**
+ * @brief Reads the sources of interrupt generator 1 and of the click
+ * detection. Reading them clears the latched interrupts.
+ * 
+ * @param[in] p_dev device
+ * @param[out] p_int1_src  INT1_SRC
+ * @param[out] p_click_src CLICK_SRC
+ * 
+ * @return 0 on success
+ * @return -ETIMEDOUT or -ENOTTY on a bus error.
+ */
+int lis2dh12_int_src_get(lis2dh12_t * p_dev, uint8_t * p_int1_src, uint8_t * p_click_src);
+
+/**
+ * @brief Routes the sleep-to-wake state to INT2, which is high while the
+ * device is in its low-power inactive state.
+ * 
+ * @param[in] p_dev device
+ * @param[in] enable true to route the state to INT2
+ * 
+ * @return 0 on success
+ * @return -ETIMEDOUT or -ENOTTY on a bus error.
+ */
+int lis2dh12_activity_int2_route(lis2dh12_t * p_dev, bool enable);
+
+/**
+ * @brief Reads the source of an interrupt generator, which clears its
+ * latched interrupt.
+ * 
+ * @param[in] p_dev device
+ * @param[in]  gen   1 or 2
+ * @param[out] p_src INT1_SRC or INT2_SRC
+ * 
+ * @return 0 on success
+ * @return -EINVAL on an unknown generator
+ * @return -ETIMEDOUT or -ENOTTY on a bus error.
+ */
+int lis2dh12_int_gen_src_get(lis2dh12_t * p_dev, uint8_t gen, uint8_t * p_src);
+
+/**
+ * @brief Reads the source of the click detection, which clears a latched
+ * click.
+ * 
+ * @param[in] p_dev device
+ * @param[out] p_click_src CLICK_SRC
+ * 
+ * @return 0 on success
+ * @return -ETIMEDOUT or -ENOTTY on a bus error.
+ */
+int lis2dh12_click_src_get(lis2dh12_t * p_dev, uint8_t * p_click_src);
+
+#if defined(CONFIG_APP_LIS2DH12_FIFO)
+/**
+ * @brief Enables the FIFO in stream mode, or disables it. The FIFO is
+ * emptied in both cases.
+ * 
+ * @param[in] p_dev device
+ * @param[in] enable true to enable the FIFO
+ * 
+ * @return 0 on success
+ * @return -ETIMEDOUT or -ENOTTY on a bus error.
+ */
+int lis2dh12_fifo_enable(lis2dh12_t * p_dev, bool enable);
+
+/**
+ * @brief Drains samples from the FIFO, oldest first.
+ * 
+ * @param[in] p_dev device
+ * @param[out] p_accel_values samples read
+ * @param[in]  max_frames     size of p_accel_values
+ * @param[out] p_frames       number of samples read
+ * @param[out] p_overrun      set if samples were dropped since the last drain, can be NULL
+ * 
+ * @return 0 on success
+ * @return -ETIMEDOUT or -ENOTTY on a bus error.
+ */
+int lis2dh12_fifo_read_accel(lis2dh12_t * p_dev, accel_values_t * p_accel_values, uint16_t max_frames,
+                             uint16_t * p_frames, bool * p_overrun);
+#endif
+
+#if defined(CONFIG_APP_LIS2DH12_FIFO)
+/**
+ * @brief Sets the FIFO watermark and routes the watermark interrupt to INT1.
+ * The watermark survives lis2dh12_fifo_enable().
+ * 
+ * @param[in] p_dev device
+ * @param[in] frames samples in the FIFO that raise the interrupt, 1 to 31
+ * 
+ * @return 0 on success
+ * @return -EINVAL if the watermark is out of range
+ * @return -ETIMEDOUT or -ENOTTY on a bus error.
+ */
+int lis2dh12_fifo_watermark_set(lis2dh12_t * p_dev, uint8_t frames);
+#endif
 
 int lis2dh12_register_write();
 
@@ -0,0 +1,127 @@
+/**
+ * @file      loadstat.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Bus and CPU load accounting, see loadstat.h.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "loadstat.h"
+#include "twi.h"
+#include "acq_sched.h"
+
+LOG_MODULE_REGISTER(loadstat_component, CONFIG_APP_LOADSTAT_LOG_LEVEL);
+
+static struct k_spinlock   sample_lock;         ///< protects sample_prev
+static loadstat_snapshot_t sample_prev = { 0 };  ///< snapshot of the previous loadstat_sample()
+
+/**
+ * @brief Gets the share of an increase of a total in the wall time, 0 if the
+ * total went down because it was reset.
+ */
+static uint32_t loadstat_permille(const uint64_t from, const uint64_t to, const uint64_t wall_us)
+{
+    return (to > from) ? (uint32_t)MIN(((to - from) * 1000U) / wall_us, UINT32_MAX) : 0U;
+}
+
+int loadstat_snapshot(loadstat_snapshot_t * p_snapshot)
+{
+    twi_power_stats_t        power;
+    twi_wait_stats_t         wait;
+    k_thread_runtime_stats_t usage;
+    int                      err;
+
+    if (p_snapshot == NULL)
+    {
+        return -EINVAL;
+    }
+
+    p_snapshot->wall_us = (int64_t)k_ticks_to_us_floor64((uint64_t)k_uptime_ticks());
+
+    err = twi_power_stats_get(&power);
+    if (err != 0)
+    {
+        return err;
+    }
+    p_snapshot->bus_busy_us = power.busy_us;
+    p_snapshot->twi_call_us = power.call_us;
+
+    p_snapshot->bus_wait_us = 0U;
+    for (uint8_t prio = 0U; prio < TWI_PRIO_COUNT; prio++)
+    {
+        err = twi_wait_stats_get((enum twi_prio)prio, &wait);
+        if (err != 0)
+        {
+            return err;
+        }
+        p_snapshot->bus_wait_us += wait.total_us;
+    }
+
+    err = acq_sched_cpu_us_get(&p_snapshot->sampling_us);
+    if (err != 0)
+    {
+        return err;
+    }
+
+    err = k_thread_runtime_stats_all_get(&usage);
+    if (err != 0)
+    {
+        return err;
+    }
+    p_snapshot->idle_us = k_cyc_to_us_floor64(usage.idle_cycles);
+
+    return 0;
+}
+
+int loadstat_interval(const loadstat_snapshot_t * p_from, const loadstat_snapshot_t * p_to,
+                      loadstat_report_t * p_report)
+{
+    if ((p_from == NULL) || (p_to == NULL) || (p_report == NULL) || (p_to->wall_us <= p_from->wall_us))
+    {
+        return -EINVAL;
+    }
+
+    const uint64_t wall_us = (uint64_t)(p_to->wall_us - p_from->wall_us);
+
+    p_report->interval_ms       = (uint32_t)MIN(wall_us / 1000U, UINT32_MAX);
+    p_report->bus_busy_permille = loadstat_permille(p_from->bus_busy_us, p_to->bus_busy_us, wall_us);
+    p_report->bus_wait_permille = loadstat_permille(p_from->bus_wait_us, p_to->bus_wait_us, wall_us);
+    p_report->twi_call_permille = loadstat_permille(p_from->twi_call_us, p_to->twi_call_us, wall_us);
+    p_report->sampling_permille = loadstat_permille(p_from->sampling_us, p_to->sampling_us, wall_us);
+    p_report->idle_permille     = loadstat_permille(p_from->idle_us, p_to->idle_us, wall_us);
+
+    return 0;
+}
+
+int loadstat_sample(loadstat_report_t * p_report)
+{
+    loadstat_snapshot_t now;
+    loadstat_snapshot_t prev;
+    k_spinlock_key_t    key;
+    int                 err;
+
+    if (p_report == NULL)
+    {
+        return -EINVAL;
+    }
+
+    err = loadstat_snapshot(&now);
+    if (err != 0)
+    {
+        LOG_WRN("loadstat_sample:loadstat_snapshot failed with error: %d", err);
+        return err;
+    }
+
+    key         = k_spin_lock(&sample_lock);
+    prev        = sample_prev;
+    sample_prev = now;
+    k_spin_unlock(&sample_lock, key);
+
+    return loadstat_interval(&prev, &now, p_report);
+}
@@ -0,0 +1,88 @@
+/**
+ * @file      loadstat.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Bus and CPU load accounting. A snapshot holds the running
+ *            totals of the time the TWI bus was busy, the time the callers
+ *            waited for it and sat in the transfer calls, and the CPU time
+ *            of the acquisition thread and of the idle thread. The
+ *            difference of two snapshots gives each of them as a share of
+ *            the wall time in between, so configurations can be compared
+ *            over the same interval.
+ *
+ *            The waiting and calling times add up over all the threads
+ *            that use the bus, so with several of them they can go past
+ *            100 %. A reset of the TWI statistics inside an interval reads
+ *            as 0 for the totals it clears.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef LOADSTAT_H_
+#define LOADSTAT_H_
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+/**@brief Running totals since boot. */
+typedef struct
+{
+    int64_t  wall_us;      ///< uptime
+    uint64_t bus_busy_us;  ///< time spent in transfer attempts
+    uint64_t bus_wait_us;  ///< time spent waiting for the bus, all priority classes
+    uint64_t twi_call_us;  ///< time spent in the transfer calls, waiting included
+    uint64_t sampling_us;  ///< CPU time of the acquisition thread
+    uint64_t idle_us;      ///< CPU time of the idle thread
+} loadstat_snapshot_t;
+
+/**@brief Shares of the wall time over an interval, in permille. */
+typedef struct
+{
+    uint32_t interval_ms;        ///< wall time between the two snapshots
+    uint32_t bus_busy_permille;  ///< the bus was busy
+    uint32_t bus_wait_permille;  ///< callers waited for the bus
+    uint32_t twi_call_permille;  ///< callers were blocked in the transfer calls
+    uint32_t sampling_permille;  ///< the acquisition thread ran
+    uint32_t idle_permille;      ///< the CPU was idle
+} loadstat_report_t;
+
+/**
+ * @brief Takes the running totals.
+ *
+ * @param[out] p_snapshot totals
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer
+ * @return the error of the TWI or the scheduler statistics.
+ */
+int loadstat_snapshot(loadstat_snapshot_t * p_snapshot);
+
+/**
+ * @brief Computes the shares between two snapshots.
+ *
+ * @param[in]  p_from   earlier snapshot, zeroed for the time since boot
+ * @param[in]  p_to     later snapshot
+ * @param[out] p_report shares
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or if no time passed between the snapshots.
+ */
+int loadstat_interval(const loadstat_snapshot_t * p_from, const loadstat_snapshot_t * p_to,
+                      loadstat_report_t * p_report);
+
+/**
+ * @brief Gets the shares since the previous call, or since boot for the
+ * first one. Meant for a single periodic reporter, the shell command keeps
+ * its own snapshots.
+ *
+ * @param[out] p_report shares
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or if no time passed since the previous call
+ * @return the error of loadstat_snapshot().
+ */
+int loadstat_sample(loadstat_report_t * p_report);
+
+#endif // LOADSTAT_H_
@@ -0,0 +1,111 @@
+/**
+ * @file      loadstat_shell.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     loadstat shell command. "loadstat measure [ms]" takes the
+ *            shares over the given time, 1 s by default, and
+ *            "loadstat boot" the ones since boot.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include "loadstat.h"
+
+#define LOADSTAT_SHELL_DEFAULT_MS 1000U   ///< measuring time without an argument
+#define LOADSTAT_SHELL_MAX_MS     60000U  ///< longest measuring time, the shell is blocked meanwhile
+
+/**
+ * @brief Prints the shares of a report.
+ */
+static void loadstat_shell_print(const struct shell * p_shell, const loadstat_report_t * p_report)
+{
+    shell_print(p_shell, "interval:     %u ms", p_report->interval_ms);
+    shell_print(p_shell, "bus busy:     %u.%u %%", p_report->bus_busy_permille / 10U, p_report->bus_busy_permille % 10U);
+    shell_print(p_shell, "bus wait:     %u.%u %%", p_report->bus_wait_permille / 10U, p_report->bus_wait_permille % 10U);
+    shell_print(p_shell, "twi calls:    %u.%u %%", p_report->twi_call_permille / 10U, p_report->twi_call_permille % 10U);
+    shell_print(p_shell, "sampling cpu: %u.%u %%", p_report->sampling_permille / 10U, p_report->sampling_permille % 10U);
+    shell_print(p_shell, "cpu idle:     %u.%u %%", p_report->idle_permille / 10U, p_report->idle_permille % 10U);
+}
+
+static int loadstat_cmd_measure(const struct shell * p_shell, size_t argc, char ** argv)
+{
+    loadstat_snapshot_t from;
+    loadstat_snapshot_t to;
+    loadstat_report_t   report;
+    uint32_t            time_ms = LOADSTAT_SHELL_DEFAULT_MS;
+    int                 err;
+
+    if (argc > 1)
+    {
+        char * p_end;
+
+        time_ms = (uint32_t)strtoul(argv[1], &p_end, 10);
+        if ((*p_end != '\0') || (time_ms == 0U) || (time_ms > LOADSTAT_SHELL_MAX_MS))
+        {
+            shell_error(p_shell, "time must be 1 to %u ms", LOADSTAT_SHELL_MAX_MS);
+            return -EINVAL;
+        }
+    }
+
+    err = loadstat_snapshot(&from);
+    if (err == 0)
+    {
+        k_msleep(time_ms);
+        err = loadstat_snapshot(&to);
+    }
+    if (err == 0)
+    {
+        err = loadstat_interval(&from, &to, &report);
+    }
+
+    if (err != 0)
+    {
+        shell_error(p_shell, "measuring failed with error: %d", err);
+        return err;
+    }
+
+    loadstat_shell_print(p_shell, &report);
+
+    return 0;
+}
+
+static int loadstat_cmd_boot(const struct shell * p_shell, size_t argc, char ** argv)
+{
+    const loadstat_snapshot_t boot = { 0 };
+    loadstat_snapshot_t       now;
+    loadstat_report_t         report;
+    int                       err;
+
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    err = loadstat_snapshot(&now);
+    if (err == 0)
+    {
+        err = loadstat_interval(&boot, &now, &report);
+    }
+
+    if (err != 0)
+    {
+        shell_error(p_shell, "reading failed with error: %d", err);
+        return err;
+    }
+
+    loadstat_shell_print(p_shell, &report);
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(loadstat_cmds,
+    SHELL_CMD_ARG(measure, NULL, "Shares over a time: measure [ms]", loadstat_cmd_measure, 1, 1),
+    SHELL_CMD_ARG(boot, NULL, "Shares since boot", loadstat_cmd_boot, 1, 0),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(loadstat, &loadstat_cmds, "Bus and CPU load", NULL);
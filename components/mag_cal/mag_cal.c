@@ -0,0 +1,793 @@
+/**
+ * @file      mag_cal.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Online hard and soft iron calibration of the magnetometer,
+ *            incremental ellipsoid fit solved in steps.
+ *
+ *            The fit is the algebraic one, every sample u gives a row
+ *            d = [x², y², z², 2yz, 2xz, 2xy, 2x, 2y, 2z] of d·k = 1 and the
+ *            normal equations (Σ d dᵀ) k = Σ d are accumulated. The quadric
+ *            uᵀAu + 2vᵀu = 1 it solves for has its centre at c = -A⁻¹v, and
+ *            (u - c)ᵀ (A / (1 + cᵀAc)) (u - c) = 1. The square root of that
+ *            matrix, from its eigen decomposition, maps the ellipsoid onto
+ *            the unit sphere, it is scaled by the geometric mean radius so
+ *            the corrected samples keep their size.
+ *
+ * @version   0.1
+ * @date      2024-07-29
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "mag_cal.h"
+
+LOG_MODULE_REGISTER(mag_cal_component, CONFIG_APP_MAG_CAL_LOG_LEVEL);
+
+#define MAG_CAL_TERMS          9U          // unknowns of the ellipsoid fit
+#define MAG_CAL_PACKED         45U         // entries of the upper triangle of the normal matrix
+#define MAG_CAL_WEIGHT_LIMIT   1.0e6f      // the growing sample weight is folded back into the sums above this
+#define MAG_CAL_JACOBI_EPS     1.0e-12     // off-diagonal entries below this count as zero
+#define MAG_CAL_BINS           6U          // directions, the sign of the dominant axis
+
+/**@brief Steps of a solve. */
+enum mag_cal_stage
+{
+    MAG_CAL_IDLE = 0,       // waiting for enough samples
+    MAG_CAL_CHOLESKY,       // one column of the factorization per step
+    MAG_CAL_SUBSTITUTE,     // forward and back substitution
+    MAG_CAL_CENTRE,         // centre and normalized quadric matrix
+    MAG_CAL_EIGEN,          // one Jacobi sweep per step
+    MAG_CAL_PUBLISH,        // matrix square root, checks, fixed point
+};
+
+/**@brief State of a solve, kept between its steps. */
+typedef struct
+{
+    enum mag_cal_stage stage;
+    uint8_t            column;                            // next Cholesky column
+    uint8_t            sweep;                             // Jacobi sweeps done
+    double             l[MAG_CAL_TERMS][MAG_CAL_TERMS];   // normal matrix, then its Cholesky factor
+    double             k[MAG_CAL_TERMS];                  // right hand side, then the solution
+    double             centre[3];                         // in fitted units
+    double             s[3][3];                           // normalized quadric matrix, diagonalized in place
+    double             v[3][3];                           // its eigenvectors, in columns
+} mag_cal_solver_t;
+
+/**@brief State of the calibration. */
+typedef struct
+{
+    mag_cal_config_t  config;
+    float             ata[MAG_CAL_PACKED];  // Σ w d dᵀ, upper triangle, row major
+    float             atb[MAG_CAL_TERMS];   // Σ w d
+    float             weight;               // weight of the next sample, grows instead of decaying the sums
+    float             forget_gain;          // weight growth per sample
+    magn_values_t     last;                 // last accepted sample
+    bool              has_last;
+    int16_t           min[3];               // range of the accepted samples, centres the
+    int16_t           max[3];               // direction bins until there is a calibration
+    uint8_t           bins;                 // directions seen, one bit per bin
+    uint16_t          since_solve;          // accepted samples since the last solve
+    mag_cal_solver_t  solver;
+    mag_cal_quality_t quality;
+    bool              initialized;
+} mag_cal_t;
+
+static mag_cal_t mag_cal;
+
+/**@brief The calibration applied to the samples, and the residual average. */
+static mag_cal_params_t  mag_cal_params;
+static bool              mag_cal_params_valid;
+static uint32_t          mag_cal_residual;  // permille, scaled by 2^MAG_CAL_QUALITY_SHIFT
+static struct k_spinlock mag_cal_params_lock;
+
+/**@brief Serializes the fit, held by mag_cal_feed() and the resets. */
+static K_MUTEX_DEFINE(mag_cal_lock);
+
+/**
+ * @brief Forgets the fitted samples. Called with the lock held.
+ */
+static void mag_cal_fit_clear(void)
+{
+    memset(mag_cal.ata, 0, sizeof(mag_cal.ata));
+    memset(mag_cal.atb, 0, sizeof(mag_cal.atb));
+    mag_cal.weight       = 1.0f;
+    mag_cal.has_last     = false;
+    mag_cal.bins         = 0U;
+    mag_cal.since_solve  = 0U;
+    mag_cal.solver.stage = MAG_CAL_IDLE;
+
+    for (uint8_t axis = 0; axis < 3U; axis++)
+    {
+        mag_cal.min[axis] = INT16_MAX;
+        mag_cal.max[axis] = INT16_MIN;
+    }
+}
+
+/**
+ * @brief Marks the direction of a sample, taken from the calibration centre
+ * or, without one, from the middle of the range seen so far. Called with the
+ * lock held.
+ *
+ * @param[in] p_magn sample
+ */
+static void mag_cal_bin_mark(const magn_values_t * p_magn)
+{
+    const int32_t raw[3]    = { p_magn->x, p_magn->y, p_magn->z };
+    int32_t       centre[3];
+    uint8_t       dominant  = 0U;
+    int32_t       magnitude = -1;
+    bool          negative  = false;
+
+    k_spinlock_key_t key = k_spin_lock(&mag_cal_params_lock);
+    for (uint8_t axis = 0; axis < 3U; axis++)
+    {
+        centre[axis] = mag_cal_params_valid ? mag_cal_params.offset[axis] :
+                                              ((int32_t)mag_cal.min[axis] + mag_cal.max[axis]) / 2;
+    }
+    k_spin_unlock(&mag_cal_params_lock, key);
+
+    for (uint8_t axis = 0; axis < 3U; axis++)
+    {
+        int32_t delta = raw[axis] - centre[axis];
+
+        if (abs(delta) > magnitude)
+        {
+            magnitude = abs(delta);
+            dominant  = axis;
+            negative  = delta < 0;
+        }
+    }
+
+    mag_cal.bins |= (uint8_t)(1U << (dominant * 2U + (negative ? 1U : 0U)));
+}
+
+/**
+ * @brief Adds a sample to the normal equations, if it is far enough from the
+ * last one. Called with the lock held.
+ *
+ * @param[in] p_magn sample
+ */
+static void mag_cal_accumulate(const magn_values_t * p_magn)
+{
+    const float scale = 1.0f / (float)(1UL << mag_cal.config.input_shift);
+    float       d[MAG_CAL_TERMS];
+    uint8_t     index = 0U;
+
+    if (mag_cal.has_last)
+    {
+        int32_t dx = p_magn->x - mag_cal.last.x;
+        int32_t dy = p_magn->y - mag_cal.last.y;
+        int32_t dz = p_magn->z - mag_cal.last.z;
+        int32_t min_distance = mag_cal.config.min_distance_lsb;
+
+        if ((dx * dx + dy * dy + dz * dz) < (min_distance * min_distance))
+        {
+            return;
+        }
+    }
+
+    mag_cal.last     = *p_magn;
+    mag_cal.has_last = true;
+
+    mag_cal.min[0] = MIN(mag_cal.min[0], p_magn->x);
+    mag_cal.min[1] = MIN(mag_cal.min[1], p_magn->y);
+    mag_cal.min[2] = MIN(mag_cal.min[2], p_magn->z);
+    mag_cal.max[0] = MAX(mag_cal.max[0], p_magn->x);
+    mag_cal.max[1] = MAX(mag_cal.max[1], p_magn->y);
+    mag_cal.max[2] = MAX(mag_cal.max[2], p_magn->z);
+    mag_cal_bin_mark(p_magn);
+
+    float x = (float)p_magn->x * scale;
+    float y = (float)p_magn->y * scale;
+    float z = (float)p_magn->z * scale;
+
+    d[0] = x * x;
+    d[1] = y * y;
+    d[2] = z * z;
+    d[3] = 2.0f * y * z;
+    d[4] = 2.0f * x * z;
+    d[5] = 2.0f * x * y;
+    d[6] = 2.0f * x;
+    d[7] = 2.0f * y;
+    d[8] = 2.0f * z;
+
+    for (uint8_t i = 0; i < MAG_CAL_TERMS; i++)
+    {
+        float wd = mag_cal.weight * d[i];
+
+        mag_cal.atb[i] += wd;
+        for (uint8_t j = i; j < MAG_CAL_TERMS; j++)
+        {
+            mag_cal.ata[index++] += wd * d[j];
+        }
+    }
+
+    // Growing the weight of new samples fades out the old ones without touching every sum
+    mag_cal.weight *= mag_cal.forget_gain;
+    if (mag_cal.weight > MAG_CAL_WEIGHT_LIMIT)
+    {
+        float fold = 1.0f / mag_cal.weight;
+
+        for (uint8_t i = 0; i < MAG_CAL_PACKED; i++)
+        {
+            mag_cal.ata[i] *= fold;
+        }
+        for (uint8_t i = 0; i < MAG_CAL_TERMS; i++)
+        {
+            mag_cal.atb[i] *= fold;
+        }
+        mag_cal.weight = 1.0f;
+    }
+
+    mag_cal.quality.accepted++;
+    if (mag_cal.since_solve < UINT16_MAX)
+    {
+        mag_cal.since_solve++;
+    }
+}
+
+/**
+ * @brief Starts a solve on a copy of the normal equations. Called with the
+ * lock held.
+ */
+static void mag_cal_solve_start(void)
+{
+    mag_cal_solver_t * p_solver = &mag_cal.solver;
+    uint8_t            index    = 0U;
+
+    for (uint8_t i = 0; i < MAG_CAL_TERMS; i++)
+    {
+        p_solver->k[i] = mag_cal.atb[i];
+        for (uint8_t j = i; j < MAG_CAL_TERMS; j++)
+        {
+            p_solver->l[i][j] = mag_cal.ata[index];
+            p_solver->l[j][i] = mag_cal.ata[index];
+            index++;
+        }
+    }
+
+    p_solver->column = 0U;
+    p_solver->sweep  = 0U;
+    p_solver->stage  = MAG_CAL_CHOLESKY;
+
+    mag_cal.bins        = 0U;
+    mag_cal.since_solve = 0U;
+}
+
+/**
+ * @brief Gives up the solve.
+ *
+ * @param[in] p_reason what went wrong
+ */
+static void mag_cal_solve_reject(const char * p_reason)
+{
+    mag_cal.quality.rejected++;
+    mag_cal.solver.stage = MAG_CAL_IDLE;
+    LOG_WRN("mag_cal:fit rejected, %s", p_reason);
+}
+
+/**
+ * @brief One column of the Cholesky factorization, the factor overwrites
+ * the lower triangle.
+ *
+ * @return false if the normal matrix is not positive definite
+ */
+static bool mag_cal_cholesky_column(mag_cal_solver_t * p_solver)
+{
+    uint8_t k   = p_solver->column;
+    double  sum = p_solver->l[k][k];
+
+    for (uint8_t p = 0; p < k; p++)
+    {
+        sum -= p_solver->l[k][p] * p_solver->l[k][p];
+    }
+
+    if (sum <= 0.0)
+    {
+        return false;
+    }
+
+    p_solver->l[k][k] = sqrt(sum);
+
+    for (uint8_t i = k + 1U; i < MAG_CAL_TERMS; i++)
+    {
+        double value = p_solver->l[i][k];
+
+        for (uint8_t p = 0; p < k; p++)
+        {
+            value -= p_solver->l[i][p] * p_solver->l[k][p];
+        }
+        p_solver->l[i][k] = value / p_solver->l[k][k];
+    }
+
+    p_solver->column++;
+    return true;
+}
+
+/**
+ * @brief Solves L Lᵀ k = b in place of b.
+ */
+static void mag_cal_substitute(mag_cal_solver_t * p_solver)
+{
+    for (uint8_t i = 0; i < MAG_CAL_TERMS; i++)
+    {
+        for (uint8_t p = 0; p < i; p++)
+        {
+            p_solver->k[i] -= p_solver->l[i][p] * p_solver->k[p];
+        }
+        p_solver->k[i] /= p_solver->l[i][i];
+    }
+
+    for (int8_t i = MAG_CAL_TERMS - 1; i >= 0; i--)
+    {
+        for (uint8_t p = (uint8_t)i + 1U; p < MAG_CAL_TERMS; p++)
+        {
+            p_solver->k[i] -= p_solver->l[p][i] * p_solver->k[p];
+        }
+        p_solver->k[i] /= p_solver->l[i][i];
+    }
+}
+
+/**
+ * @brief Finds the centre of the quadric and normalizes its matrix.
+ *
+ * @return false if the quadric is not an ellipsoid
+ */
+static bool mag_cal_centre(mag_cal_solver_t * p_solver)
+{
+    const double * k = p_solver->k;
+    const double   a[3][3] = {
+        { k[0], k[5], k[4] },
+        { k[5], k[1], k[3] },
+        { k[4], k[3], k[2] },
+    };
+    double cof[3][3];
+    double det;
+    double scale;
+
+    cof[0][0] = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+    cof[0][1] = a[0][2] * a[2][1] - a[0][1] * a[2][2];
+    cof[0][2] = a[0][1] * a[1][2] - a[0][2] * a[1][1];
+    cof[1][0] = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+    cof[1][1] = a[0][0] * a[2][2] - a[0][2] * a[2][0];
+    cof[1][2] = a[0][2] * a[1][0] - a[0][0] * a[1][2];
+    cof[2][0] = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+    cof[2][1] = a[0][1] * a[2][0] - a[0][0] * a[2][1];
+    cof[2][2] = a[0][0] * a[1][1] - a[0][1] * a[1][0];
+
+    det = a[0][0] * cof[0][0] + a[0][1] * cof[1][0] + a[0][2] * cof[2][0];
+    if (det <= 0.0)
+    {
+        return false;
+    }
+
+    // c = -A⁻¹v
+    for (uint8_t i = 0; i < 3U; i++)
+    {
+        p_solver->centre[i] = -(cof[i][0] * k[6] + cof[i][1] * k[7] + cof[i][2] * k[8]) / det;
+    }
+
+    // 1 + cᵀAc = 1 - vᵀc
+    scale = 1.0 - (k[6] * p_solver->centre[0] + k[7] * p_solver->centre[1] + k[8] * p_solver->centre[2]);
+    if (scale <= 0.0)
+    {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < 3U; i++)
+    {
+        for (uint8_t j = 0; j < 3U; j++)
+        {
+            p_solver->s[i][j] = a[i][j] / scale;
+            p_solver->v[i][j] = (i == j) ? 1.0 : 0.0;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief One cyclic Jacobi sweep over the normalized quadric matrix.
+ *
+ * @return true once the matrix is diagonal
+ */
+static bool mag_cal_jacobi_sweep(mag_cal_solver_t * p_solver)
+{
+    static const uint8_t pairs[3][2] = { { 0, 1 }, { 0, 2 }, { 1, 2 } };
+    bool                 diagonal    = true;
+
+    for (uint8_t n = 0; n < 3U; n++)
+    {
+        uint8_t p = pairs[n][0];
+        uint8_t q = pairs[n][1];
+
+        if (fabs(p_solver->s[p][q]) < MAG_CAL_JACOBI_EPS)
+        {
+            continue;
+        }
+
+        diagonal = false;
+
+        double theta = (p_solver->s[q][q] - p_solver->s[p][p]) / (2.0 * p_solver->s[p][q]);
+        double t     = ((theta >= 0.0) ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+        double c     = 1.0 / sqrt(t * t + 1.0);
+        double s     = t * c;
+
+        for (uint8_t i = 0; i < 3U; i++)
+        {
+            double sip = p_solver->s[i][p];
+            double siq = p_solver->s[i][q];
+
+            p_solver->s[i][p] = c * sip - s * siq;
+            p_solver->s[i][q] = s * sip + c * siq;
+        }
+
+        for (uint8_t i = 0; i < 3U; i++)
+        {
+            double spi = p_solver->s[p][i];
+            double sqi = p_solver->s[q][i];
+
+            p_solver->s[p][i] = c * spi - s * sqi;
+            p_solver->s[q][i] = s * spi + c * sqi;
+        }
+
+        for (uint8_t i = 0; i < 3U; i++)
+        {
+            double vip = p_solver->v[i][p];
+            double viq = p_solver->v[i][q];
+
+            p_solver->v[i][p] = c * vip - s * viq;
+            p_solver->v[i][q] = s * vip + c * viq;
+        }
+    }
+
+    p_solver->sweep++;
+    return diagonal;
+}
+
+/**
+ * @brief Builds the fixed point calibration from the eigen decomposition,
+ * checks it and applies it.
+ */
+static void mag_cal_publish(mag_cal_solver_t * p_solver)
+{
+    const double     unit = (double)(1UL << mag_cal.config.input_shift);
+    double           eigen[3];
+    double           root[3];
+    double           radius;
+    double           eigen_min;
+    double           eigen_max;
+    mag_cal_params_t params;
+
+    for (uint8_t i = 0; i < 3U; i++)
+    {
+        eigen[i] = p_solver->s[i][i];
+        if (eigen[i] <= 0.0)
+        {
+            mag_cal_solve_reject("not an ellipsoid");
+            return;
+        }
+        root[i] = sqrt(eigen[i]);
+    }
+
+    eigen_min = MIN(MIN(eigen[0], eigen[1]), eigen[2]);
+    eigen_max = MAX(MAX(eigen[0], eigen[1]), eigen[2]);
+
+    // semi-axes are 1 / sqrt(eigenvalue)
+    uint32_t axis_ratio_pct = (uint32_t)(100.0 * sqrt(eigen_max / eigen_min));
+    if (axis_ratio_pct > mag_cal.config.max_axis_ratio_pct)
+    {
+        mag_cal_solve_reject("too eccentric");
+        return;
+    }
+
+    // geometric mean of the semi-axes, in LSB
+    radius = unit / sqrt(cbrt(eigen[0] * eigen[1] * eigen[2]));
+    if ((radius < 1.0) || (radius > (double)UINT16_MAX))
+    {
+        mag_cal_solve_reject("implausible field strength");
+        return;
+    }
+
+    for (uint8_t i = 0; i < 3U; i++)
+    {
+        double offset = p_solver->centre[i] * unit;
+
+        if ((offset < (double)INT16_MIN) || (offset > (double)INT16_MAX))
+        {
+            mag_cal_solve_reject("offset out of range");
+            return;
+        }
+        params.offset[i] = (int16_t)lround(offset);
+    }
+
+    // matrix = radius · V diag(√λ) Vᵀ
+    for (uint8_t i = 0; i < 3U; i++)
+    {
+        for (uint8_t j = 0; j < 3U; j++)
+        {
+            double value = 0.0;
+
+            for (uint8_t n = 0; n < 3U; n++)
+            {
+                value += p_solver->v[i][n] * root[n] * p_solver->v[j][n];
+            }
+            params.matrix[i * 3U + j] = (int32_t)lround(value * (radius / unit) * (double)(1UL << MAG_CAL_MATRIX_SHIFT));
+        }
+    }
+    params.radius = (uint16_t)lround(radius);
+
+    k_spinlock_key_t key = k_spin_lock(&mag_cal_params_lock);
+    mag_cal_params       = params;
+    mag_cal_params_valid = true;
+    k_spin_unlock(&mag_cal_params_lock, key);
+
+    mag_cal.quality.solves++;
+    mag_cal.quality.radius         = params.radius;
+    mag_cal.quality.axis_ratio_pct = (uint16_t)axis_ratio_pct;
+    p_solver->stage                = MAG_CAL_IDLE;
+
+    LOG_INF("mag_cal:offset %d %d %d, radius %u, axis ratio %u%%",
+            params.offset[0], params.offset[1], params.offset[2],
+            params.radius, (unsigned int)axis_ratio_pct);
+}
+
+/**
+ * @brief Runs one step of the pending solve, or starts one when enough new
+ * samples from all directions went in. Called with the lock held.
+ */
+static void mag_cal_solve_step(void)
+{
+    mag_cal_solver_t * p_solver = &mag_cal.solver;
+
+    switch (p_solver->stage)
+    {
+        case MAG_CAL_IDLE:
+            if ((mag_cal.since_solve >= mag_cal.config.solve_interval) &&
+                (mag_cal.bins == BIT_MASK(MAG_CAL_BINS)))
+            {
+                mag_cal_solve_start();
+            }
+            break;
+
+        case MAG_CAL_CHOLESKY:
+            if (!mag_cal_cholesky_column(p_solver))
+            {
+                mag_cal_solve_reject("samples do not span an ellipsoid");
+            }
+            else if (p_solver->column == MAG_CAL_TERMS)
+            {
+                p_solver->stage = MAG_CAL_SUBSTITUTE;
+            }
+            break;
+
+        case MAG_CAL_SUBSTITUTE:
+            mag_cal_substitute(p_solver);
+            p_solver->stage = MAG_CAL_CENTRE;
+            break;
+
+        case MAG_CAL_CENTRE:
+            if (!mag_cal_centre(p_solver))
+            {
+                mag_cal_solve_reject("not an ellipsoid");
+            }
+            else
+            {
+                p_solver->stage = MAG_CAL_EIGEN;
+            }
+            break;
+
+        case MAG_CAL_EIGEN:
+            if (mag_cal_jacobi_sweep(p_solver) || (p_solver->sweep >= MAG_CAL_JACOBI_SWEEPS))
+            {
+                p_solver->stage = MAG_CAL_PUBLISH;
+            }
+            break;
+
+        case MAG_CAL_PUBLISH:
+            mag_cal_publish(p_solver);
+            break;
+
+        default:
+            p_solver->stage = MAG_CAL_IDLE;
+            break;
+    }
+}
+
+int mag_cal_init(const mag_cal_config_t * p_config)
+{
+    if ((p_config == NULL) || (p_config->input_shift > 15U) || (p_config->solve_interval == 0U) ||
+        (p_config->steps_per_sample == 0U) || (p_config->max_axis_ratio_pct < 100U))
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&mag_cal_lock, K_FOREVER);
+
+    memset(&mag_cal, 0, sizeof(mag_cal));
+    mag_cal.config      = *p_config;
+    mag_cal.forget_gain = 1.0f + 1.0f / (float)(1UL << MAG_CAL_FORGET_SHIFT);
+    mag_cal_fit_clear();
+
+    k_spinlock_key_t key = k_spin_lock(&mag_cal_params_lock);
+    mag_cal_params_valid = false;
+    mag_cal_residual     = 0U;
+    k_spin_unlock(&mag_cal_params_lock, key);
+
+    mag_cal.initialized = true;
+
+    k_mutex_unlock(&mag_cal_lock);
+
+    return 0;
+}
+
+int mag_cal_feed(const magn_values_t * p_magn, uint16_t count)
+{
+    if (p_magn == NULL)
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&mag_cal_lock, K_FOREVER);
+
+    if (!mag_cal.initialized)
+    {
+        k_mutex_unlock(&mag_cal_lock);
+        return -EPERM;
+    }
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        uint32_t start = k_cycle_get_32();
+
+        mag_cal_accumulate(&p_magn[i]);
+        for (uint8_t step = 0; step < mag_cal.config.steps_per_sample; step++)
+        {
+            mag_cal_solve_step();
+        }
+
+        mag_cal.quality.max_update_cycles = MAX(mag_cal.quality.max_update_cycles, k_cycle_get_32() - start);
+    }
+
+    k_mutex_unlock(&mag_cal_lock);
+
+    return 0;
+}
+
+void mag_cal_apply(magn_values_t * p_magn, uint16_t count)
+{
+    mag_cal_params_t params;
+    uint32_t         residual;
+    int64_t          radius_sq;
+
+    k_spinlock_key_t key = k_spin_lock(&mag_cal_params_lock);
+    if (!mag_cal_params_valid)
+    {
+        k_spin_unlock(&mag_cal_params_lock, key);
+        return;
+    }
+    params   = mag_cal_params;
+    residual = mag_cal_residual;
+    k_spin_unlock(&mag_cal_params_lock, key);
+
+    radius_sq = (int64_t)params.radius * params.radius;
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        const int32_t raw[3] = {
+            (int32_t)p_magn[i].x - params.offset[0],
+            (int32_t)p_magn[i].y - params.offset[1],
+            (int32_t)p_magn[i].z - params.offset[2],
+        };
+        int32_t out[3];
+
+        for (uint8_t axis = 0; axis < 3U; axis++)
+        {
+            const int32_t * p_row = &params.matrix[axis * 3U];
+            int64_t         value = ((int64_t)p_row[0] * raw[0] + (int64_t)p_row[1] * raw[1] +
+                                     (int64_t)p_row[2] * raw[2]) >> MAG_CAL_MATRIX_SHIFT;
+
+            out[axis] = (int32_t)CLAMP(value, INT16_MIN, INT16_MAX);
+        }
+
+        p_magn[i].x = (int16_t)out[0];
+        p_magn[i].y = (int16_t)out[1];
+        p_magn[i].z = (int16_t)out[2];
+
+        // (|m|² - r²) / 2r² is the relative distance from the sphere, to first order
+        int64_t  magnitude_sq = (int64_t)out[0] * out[0] + (int64_t)out[1] * out[1] + (int64_t)out[2] * out[2];
+        int64_t  error        = magnitude_sq - radius_sq;
+        uint32_t permille     = (uint32_t)MIN(((error < 0 ? -error : error) * 500) / MAX(radius_sq, 1), 1000);
+
+        residual = residual - (residual >> MAG_CAL_QUALITY_SHIFT) + permille;
+    }
+
+    key              = k_spin_lock(&mag_cal_params_lock);
+    mag_cal_residual = residual;
+    k_spin_unlock(&mag_cal_params_lock, key);
+}
+
+int mag_cal_params_get(mag_cal_params_t * p_params)
+{
+    int err = 0;
+
+    if (p_params == NULL)
+    {
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&mag_cal_params_lock);
+    if (mag_cal_params_valid)
+    {
+        *p_params = mag_cal_params;
+    }
+    else
+    {
+        err = -ENODATA;
+    }
+    k_spin_unlock(&mag_cal_params_lock, key);
+
+    return err;
+}
+
+int mag_cal_params_set(const mag_cal_params_t * p_params)
+{
+    if (p_params == NULL)
+    {
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&mag_cal_params_lock);
+    mag_cal_params       = *p_params;
+    mag_cal_params_valid = true;
+    mag_cal_residual     = 0U;
+    k_spin_unlock(&mag_cal_params_lock, key);
+
+    return 0;
+}
+
+int mag_cal_quality_get(mag_cal_quality_t * p_quality)
+{
+    if (p_quality == NULL)
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&mag_cal_lock, K_FOREVER);
+
+    *p_quality          = mag_cal.quality;
+    p_quality->coverage = (uint8_t)__builtin_popcount(mag_cal.bins);
+
+    k_mutex_unlock(&mag_cal_lock);
+
+    k_spinlock_key_t key = k_spin_lock(&mag_cal_params_lock);
+    p_quality->calibrated        = mag_cal_params_valid;
+    p_quality->residual_permille = (uint16_t)(mag_cal_residual >> MAG_CAL_QUALITY_SHIFT);
+    if (mag_cal_params_valid)
+    {
+        p_quality->radius = mag_cal_params.radius;
+    }
+    k_spin_unlock(&mag_cal_params_lock, key);
+
+    return 0;
+}
+
+void mag_cal_reset(void)
+{
+    k_mutex_lock(&mag_cal_lock, K_FOREVER);
+
+    mag_cal_fit_clear();
+    memset(&mag_cal.quality, 0, sizeof(mag_cal.quality));
+
+    k_spinlock_key_t key = k_spin_lock(&mag_cal_params_lock);
+    mag_cal_params_valid = false;
+    mag_cal_residual     = 0U;
+    k_spin_unlock(&mag_cal_params_lock, key);
+
+    k_mutex_unlock(&mag_cal_lock);
+}
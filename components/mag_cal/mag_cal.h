@@ -0,0 +1,148 @@
+/**
+ * @file      mag_cal.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Online hard and soft iron calibration of the magnetometer. The
+ *            sample stream is reduced to the normal equations of an
+ *            ellipsoid fit, a fixed amount of memory whatever the number of
+ *            samples, with older samples slowly fading out. Every so often
+ *            the equations are solved for the ellipsoid centre, the hard
+ *            iron offset, and the matrix that maps the ellipsoid back onto
+ *            a sphere, the soft iron correction. The solve is cut into
+ *            steps that run one at a time alongside the fed samples, so no
+ *            single call takes much longer than another. The correction is
+ *            applied to the samples in fixed point.
+ *
+ * @version   0.1
+ * @date      2024-07-29
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef MAG_CAL_H_
+#define MAG_CAL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "mpu9250.h"
+
+#define MAG_CAL_MATRIX_SHIFT   14U  ///< the soft iron matrix is scaled by 2^MAG_CAL_MATRIX_SHIFT
+#define MAG_CAL_FORGET_SHIFT   10U  ///< samples fade out with a time constant of 2^MAG_CAL_FORGET_SHIFT accepted samples
+#define MAG_CAL_JACOBI_SWEEPS  8U   ///< most eigen decomposition sweeps of a solve
+#define MAG_CAL_QUALITY_SHIFT  6U   ///< weight of a sample in the residual average is 1 / 2^MAG_CAL_QUALITY_SHIFT
+
+/**@brief Configuration of the calibration. */
+typedef struct
+{
+    uint8_t  input_shift;         ///< samples are divided by 2^input_shift before fitting, about the field strength in LSB
+    uint16_t min_distance_lsb;    ///< a sample closer than this to the last accepted one is not fitted
+    uint16_t solve_interval;      ///< accepted samples between two solves, once all directions were seen
+    uint8_t  steps_per_sample;    ///< solve steps run per fed sample
+    uint16_t max_axis_ratio_pct;  ///< largest ratio of the longest to the shortest ellipsoid axis a fit may have
+} mag_cal_config_t;
+
+/**@brief Configuration for the AK8963 in 16 bit mode, about 330 LSB of
+ * earth field.
+ */
+#define MAG_CAL_CONFIG_DEFAULT         \
+    {                                  \
+        .input_shift        = 9U,      \
+        .min_distance_lsb   = 8U,      \
+        .solve_interval     = 256U,    \
+        .steps_per_sample   = 1U,      \
+        .max_axis_ratio_pct = 200U,    \
+    }
+
+/**@brief A calibration, corrected = matrix * (raw - offset). */
+typedef struct
+{
+    int16_t  offset[3];  ///< hard iron offset, x, y, z, LSB
+    int32_t  matrix[9];  ///< soft iron correction, row major, scaled by 2^MAG_CAL_MATRIX_SHIFT
+    uint16_t radius;     ///< field strength the corrected samples have, LSB
+} mag_cal_params_t;
+
+/**@brief Quality of the calibration. */
+typedef struct
+{
+    bool     calibrated;          ///< a calibration is applied
+    uint32_t accepted;            ///< samples that went into the fit
+    uint32_t solves;              ///< solves that produced a calibration
+    uint32_t rejected;            ///< solves whose ellipsoid was degenerate or too eccentric
+    uint8_t  coverage;            ///< directions seen since the last solve, out of 6
+    uint16_t radius;              ///< field strength of the calibration, LSB
+    uint16_t axis_ratio_pct;      ///< ratio of the longest to the shortest ellipsoid axis
+    uint16_t residual_permille;   ///< average distance of the corrected samples from the sphere
+    uint32_t max_update_cycles;   ///< longest time a single fed sample took, including its solve step
+} mag_cal_quality_t;
+
+/**
+ * @brief Initializes the calibration, no calibration is applied until the
+ * first solve or mag_cal_params_set().
+ *
+ * @param[in] p_config configuration, copied
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or an invalid configuration.
+ */
+int mag_cal_init(const mag_cal_config_t * p_config);
+
+/**
+ * @brief Feeds raw samples, from app_mpu_read_magnetometer(), to the fit and
+ * runs the pending solve steps.
+ *
+ * @param[in] p_magn raw samples
+ * @param[in] count  samples
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer
+ * @return -EPERM if the calibration is not initialized.
+ */
+int mag_cal_feed(const magn_values_t * p_magn, uint16_t count);
+
+/**
+ * @brief Corrects samples in place with the current calibration, and tracks
+ * how far they are from the sphere. Samples are left as they are until a
+ * calibration exists.
+ *
+ * @param[in,out] p_magn samples
+ * @param[in]     count  samples
+ */
+void mag_cal_apply(magn_values_t * p_magn, uint16_t count);
+
+/**
+ * @brief Gets the current calibration, to keep it across restarts.
+ *
+ * @param[out] p_params calibration
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer
+ * @return -ENODATA if there is no calibration yet.
+ */
+int mag_cal_params_get(mag_cal_params_t * p_params);
+
+/**
+ * @brief Applies a known calibration, a stored or an offline one. Later
+ * solves replace it.
+ *
+ * @param[in] p_params calibration
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int mag_cal_params_set(const mag_cal_params_t * p_params);
+
+/**
+ * @brief Gets the quality of the calibration.
+ *
+ * @param[out] p_quality quality
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int mag_cal_quality_get(mag_cal_quality_t * p_quality);
+
+/**
+ * @brief Forgets the fitted samples and the calibration.
+ */
+void mag_cal_reset(void);
+
+#endif // MAG_CAL_H_
@@ -0,0 +1,460 @@
+/**
+ * @file      motion_cls.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Machine state classifier, see motion_cls.h. Everything up to
+ *            the logits is integer arithmetic that scripts/motion_cls_train.py
+ *            mirrors bit for bit, the generator of the windows of
+ *            tests/motion_cls as well, so changing either side means
+ *            generating the model again.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "motion_cls.h"
+#include "motion_cls_model.h"
+
+LOG_MODULE_REGISTER(motion_cls_component, CONFIG_APP_MOTION_CLS_LOG_LEVEL);
+
+#define MOTION_CLS_BINS       (MOTION_CLS_WINDOW / 2U)  ///< DFT bins up to the Nyquist frequency, bin 0 is unused
+#define MOTION_CLS_BANDS      4U
+#define MOTION_CLS_EXP_STEPS  64U                       ///< entries of motion_cls_exp_q16
+#define MOTION_CLS_NONE       MOTION_CLS_COUNT          ///< no class confirmed yet
+
+BUILD_ASSERT(MOTION_CLS_MODEL_CLASSES == MOTION_CLS_COUNT, "the model does not have the classes of motion_cls.h");
+BUILD_ASSERT(MOTION_CLS_MODEL_FEATURES == MOTION_CLS_FEATURES, "the model does not have the features of motion_cls_features()");
+BUILD_ASSERT((MOTION_CLS_WINDOW % MOTION_CLS_HOP) == 0U, "windows have to start at a multiple of the hop");
+
+/**@brief Features of a window, in the order of the model inputs. */
+enum motion_cls_feature
+{
+    MOTION_CLS_F_STD = 0,    ///< standard deviation of the magnitude, mg
+    MOTION_CLS_F_P2P,        ///< peak to peak of the magnitude, mg
+    MOTION_CLS_F_ZC,         ///< zero crossings of the magnitude around its mean
+    MOTION_CLS_F_BAND0,      ///< log2 of the energy of bins 1 - 2, 1.6 - 3.1 Hz, in eighths
+    MOTION_CLS_F_BAND1,      ///< bins 3 - 6, 4.7 - 9.4 Hz
+    MOTION_CLS_F_BAND2,      ///< bins 7 - 14, 10.9 - 21.9 Hz
+    MOTION_CLS_F_BAND3,      ///< bins 15 - 31, 23.4 - 48.4 Hz
+    MOTION_CLS_F_DOMINANT,   ///< bin with the most energy
+};
+
+/**@brief First and last DFT bin of every band. */
+static const uint8_t motion_cls_bands[MOTION_CLS_BANDS][2] = { { 1U, 2U }, { 3U, 6U }, { 7U, 14U }, { 15U, 31U } };
+
+/**@brief sin(2 pi k / MOTION_CLS_WINDOW) in Q15, the cosine is a quarter turn later. */
+static const int16_t motion_cls_sin_q15[MOTION_CLS_WINDOW] = {
+         0,   3212,   6393,   9512,  12539,  15446,  18204,  20787,
+     23170,  25329,  27245,  28898,  30273,  31356,  32137,  32609,
+     32767,  32609,  32137,  31356,  30273,  28898,  27245,  25329,
+     23170,  20787,  18204,  15446,  12539,   9512,   6393,   3212,
+         0,  -3212,  -6393,  -9512, -12539, -15446, -18204, -20787,
+    -23170, -25329, -27245, -28898, -30273, -31356, -32137, -32609,
+    -32767, -32609, -32137, -31356, -30273, -28898, -27245, -25329,
+    -23170, -20787, -18204, -15446, -12539,  -9512,  -6393,  -3212,
+};
+
+/**@brief 65535 * exp(-k / 8), turns logit differences in eighths of a nat into weights. */
+static const uint16_t motion_cls_exp_q16[MOTION_CLS_EXP_STEPS] = {
+     65535,  57834,  51039,  45042,  39749,  35078,  30957,  27319,
+     24109,  21276,  18776,  16570,  14623,  12905,  11388,  10050,
+      8869,   7827,   6907,   6096,   5379,   4747,   4190,   3697,
+      3263,   2879,   2541,   2242,   1979,   1746,   1541,   1360,
+      1200,   1059,    935,    825,    728,    642,    567,    500,
+       442,    390,    344,    303,    268,    236,    209,    184,
+       162,    143,    127,    112,     99,     87,     77,     68,
+        60,     53,     47,     41,     36,     32,     28,     25,
+};
+
+static const char * const motion_cls_class_names[MOTION_CLS_COUNT] = { "off", "idle", "running", "fault" };
+
+/**@brief Recording state, only touched by the sampling thread. */
+typedef struct
+{
+    motion_cls_window_t ring;   ///< last MOTION_CLS_WINDOW samples
+    uint16_t            head;   ///< next sample to write
+    uint16_t            count;  ///< samples in the ring
+    uint16_t            hop;    ///< samples since the last window
+} motion_cls_recorder_t;
+
+/**@brief Decision state, only touched by the work handler. */
+typedef struct
+{
+    enum motion_cls_class current;    ///< class handed out last, MOTION_CLS_NONE before the first
+    enum motion_cls_class candidate;  ///< class that differs from it
+    uint8_t               streak;     ///< windows in a row the candidate was seen
+} motion_cls_decision_t;
+
+static motion_cls_config_t   motion_cls_config;
+static motion_cls_recorder_t motion_cls_recorder;
+static motion_cls_decision_t motion_cls_decision;
+static motion_cls_window_t   motion_cls_window;       ///< handed to the work handler, only written while it is idle
+static int64_t               motion_cls_window_ms;    ///< uptime of the last sample of motion_cls_window
+static bool                  motion_cls_initialized;
+
+static motion_cls_stats_t motion_cls_stats;
+static uint64_t           motion_cls_total_us;
+static struct k_spinlock  motion_cls_stats_lock;
+
+static void motion_cls_work_handler(struct k_work * p_work);
+static K_WORK_DEFINE(motion_cls_work, motion_cls_work_handler);
+
+/**
+ * @brief Floor of the square root.
+ */
+static uint32_t motion_cls_isqrt(uint64_t value)
+{
+    uint64_t root = 0U;
+    uint64_t bit  = 1ULL << 62;
+
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+
+    while (bit != 0U)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root   = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return (uint32_t)root;
+}
+
+/**
+ * @brief log2 in eighths, the integer part and the three bits below the
+ * leading one. 0 for 0.
+ */
+static int32_t motion_cls_log2_q3(const uint64_t value)
+{
+    uint32_t msb = 63U;
+    uint32_t frac;
+
+    if (value == 0U)
+    {
+        return 0;
+    }
+
+    while ((value & (1ULL << msb)) == 0U)
+    {
+        msb--;
+    }
+    frac = (msb >= 3U) ? (uint32_t)(value >> (msb - 3U)) : (uint32_t)(value << (3U - msb));
+
+    return (int32_t)((msb * 8U) + (frac & 7U));
+}
+
+/**
+ * @brief Rounding arithmetic right shift.
+ */
+static inline int64_t motion_cls_rshift_round(const int64_t value, const uint32_t shift)
+{
+    return (value + (1LL << (shift - 1U))) >> shift;
+}
+
+void motion_cls_features(const motion_cls_window_t * p_window, int32_t * p_f)
+{
+    int32_t  d[MOTION_CLS_WINDOW];
+    uint64_t energy[MOTION_CLS_BINS];
+    int32_t  min     = INT32_MAX;
+    int32_t  max     = 0;
+    int32_t  sum     = 0;
+    uint64_t sum_sq  = 0U;
+    int32_t  zc      = 0;
+    uint32_t dominant = 1U;
+
+    for (uint32_t n = 0U; n < MOTION_CLS_WINDOW; n++)
+    {
+        const int32_t x = p_window->x[n];
+        const int32_t y = p_window->y[n];
+        const int32_t z = p_window->z[n];
+
+        // at most 3 * 16000^2, the axes are clamped
+        d[n] = (int32_t)motion_cls_isqrt((uint64_t)((uint32_t)(x * x) + (uint32_t)(y * y) + (uint32_t)(z * z)));
+        sum += d[n];
+        min  = MIN(min, d[n]);
+        max  = MAX(max, d[n]);
+    }
+
+    // the magnitudes are positive, the floor of the mean is a plain division
+    const int32_t mean = sum / (int32_t)MOTION_CLS_WINDOW;
+    for (uint32_t n = 0U; n < MOTION_CLS_WINDOW; n++)
+    {
+        d[n]   -= mean;
+        sum_sq += (uint64_t)((int64_t)d[n] * d[n]);
+        if ((n > 0U) && ((d[n - 1U] < 0) != (d[n] < 0)))
+        {
+            zc++;
+        }
+    }
+
+    // a direct DFT of the bins up to Nyquist, 31 * 64 multiply-accumulates each for re and im
+    for (uint32_t k = 1U; k < MOTION_CLS_BINS; k++)
+    {
+        int64_t re = 0;
+        int64_t im = 0;
+
+        for (uint32_t n = 0U; n < MOTION_CLS_WINDOW; n++)
+        {
+            const uint32_t idx = (k * n) & (MOTION_CLS_WINDOW - 1U);
+
+            re += (int64_t)d[n] * motion_cls_sin_q15[(idx + (MOTION_CLS_WINDOW / 4U)) & (MOTION_CLS_WINDOW - 1U)];
+            im += (int64_t)d[n] * motion_cls_sin_q15[idx];
+        }
+        re >>= 15;
+        im >>= 15;
+        energy[k] = (uint64_t)((re * re) + (im * im));
+
+        if (energy[k] > energy[dominant])
+        {
+            dominant = k;
+        }
+    }
+
+    p_f[MOTION_CLS_F_STD] = (int32_t)motion_cls_isqrt(sum_sq / MOTION_CLS_WINDOW);
+    p_f[MOTION_CLS_F_P2P] = max - min;
+    p_f[MOTION_CLS_F_ZC]  = zc;
+    for (uint32_t b = 0U; b < MOTION_CLS_BANDS; b++)
+    {
+        uint64_t band = 0U;
+
+        for (uint32_t k = motion_cls_bands[b][0]; k <= motion_cls_bands[b][1]; k++)
+        {
+            band += energy[k];
+        }
+        p_f[MOTION_CLS_F_BAND0 + b] = motion_cls_log2_q3(band);
+    }
+    p_f[MOTION_CLS_F_DOMINANT] = (int32_t)dominant;
+}
+
+enum motion_cls_class motion_cls_infer(const int32_t * p_f, uint8_t * p_confidence_pct)
+{
+    int8_t   in[MOTION_CLS_MODEL_FEATURES];
+    int8_t   hidden[MOTION_CLS_MODEL_HIDDEN];
+    int32_t  logits[MOTION_CLS_MODEL_CLASSES];
+    uint32_t best  = 0U;
+    uint32_t total = 0U;
+
+    for (uint32_t j = 0U; j < MOTION_CLS_MODEL_FEATURES; j++)
+    {
+        const int64_t q = motion_cls_rshift_round((int64_t)(p_f[j] - motion_cls_in_offset[j]) * motion_cls_in_mult[j], 16U);
+
+        in[j] = (int8_t)CLAMP(q, INT8_MIN, INT8_MAX);
+    }
+
+    for (uint32_t k = 0U; k < MOTION_CLS_MODEL_HIDDEN; k++)
+    {
+        int32_t acc = motion_cls_b1[k];
+
+        for (uint32_t j = 0U; j < MOTION_CLS_MODEL_FEATURES; j++)
+        {
+            acc += (int32_t)motion_cls_w1[k][j] * in[j];
+        }
+
+        // ReLU and requantization in one
+        const int64_t h = motion_cls_rshift_round((int64_t)acc * MOTION_CLS_M1, MOTION_CLS_S1);
+        hidden[k] = (int8_t)CLAMP(h, 0, INT8_MAX);
+    }
+
+    for (uint32_t c = 0U; c < MOTION_CLS_MODEL_CLASSES; c++)
+    {
+        int32_t acc = motion_cls_b2[c];
+
+        for (uint32_t k = 0U; k < MOTION_CLS_MODEL_HIDDEN; k++)
+        {
+            acc += (int32_t)motion_cls_w2[c][k] * hidden[k];
+        }
+        logits[c] = acc;
+
+        if (acc > logits[best])
+        {
+            best = c;
+        }
+    }
+
+    // softmax of the best class from the logit differences, every term is at most 65535
+    for (uint32_t c = 0U; c < MOTION_CLS_MODEL_CLASSES; c++)
+    {
+        const int64_t step = motion_cls_rshift_round((int64_t)(logits[best] - logits[c]) * MOTION_CLS_M2, MOTION_CLS_S2);
+
+        total += (step < (int64_t)MOTION_CLS_EXP_STEPS) ? motion_cls_exp_q16[step] : 0U;
+    }
+    *p_confidence_pct = (uint8_t)(((100U * motion_cls_exp_q16[0]) + (total / 2U)) / total);
+
+    return (enum motion_cls_class)best;
+}
+
+/**
+ * @brief Confirms a class over CONFIG_APP_MOTION_CLS_CONFIRM_WINDOWS windows
+ * in a row.
+ *
+ * @return true if the class changed.
+ */
+static bool motion_cls_decide(const enum motion_cls_class cls)
+{
+    motion_cls_decision_t * p_decision = &motion_cls_decision;
+
+    if (cls == p_decision->current)
+    {
+        p_decision->streak = 0U;
+        return false;
+    }
+
+    if ((p_decision->streak == 0U) || (cls != p_decision->candidate))
+    {
+        p_decision->candidate = cls;
+        p_decision->streak    = 0U;
+    }
+    p_decision->streak++;
+
+    if (p_decision->streak < CONFIG_APP_MOTION_CLS_CONFIRM_WINDOWS)
+    {
+        return false;
+    }
+
+    p_decision->current = cls;
+    p_decision->streak  = 0U;
+    return true;
+}
+
+/**
+ * @brief Classifies the window handed over and reports a change.
+ */
+static void motion_cls_work_handler(struct k_work * p_work)
+{
+    int32_t               features[MOTION_CLS_FEATURES];
+    motion_cls_event_t    evt;
+    enum motion_cls_class cls;
+    uint32_t              window_us;
+    bool                  changed;
+    k_spinlock_key_t      key;
+    const uint32_t        start = k_cycle_get_32();
+
+    ARG_UNUSED(p_work);
+
+    motion_cls_features(&motion_cls_window, features);
+    cls       = motion_cls_infer(features, &evt.confidence_pct);
+    window_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    changed   = motion_cls_decide(cls);
+
+    key = k_spin_lock(&motion_cls_stats_lock);
+    motion_cls_stats.windows++;
+    motion_cls_stats.changes      += changed ? 1U : 0U;
+    motion_cls_stats.max_window_us = MAX(motion_cls_stats.max_window_us, window_us);
+    motion_cls_total_us           += window_us;
+    motion_cls_stats.avg_window_us = (uint32_t)(motion_cls_total_us / motion_cls_stats.windows);
+    k_spin_unlock(&motion_cls_stats_lock, key);
+
+    if (changed)
+    {
+        evt.cls          = cls;
+        evt.timestamp_ms = motion_cls_window_ms;
+
+        LOG_DBG("motion_cls_work_handler:%s at %u %%", motion_cls_class_str(cls), evt.confidence_pct);
+        motion_cls_config.handler(&evt, motion_cls_config.p_user_data);
+    }
+}
+
+int motion_cls_init(const motion_cls_config_t * p_config)
+{
+    if ((p_config == NULL) || (p_config->handler == NULL) || (p_config->lsb_per_g == 0U))
+    {
+        return -EINVAL;
+    }
+
+    motion_cls_config   = *p_config;
+    motion_cls_recorder = (motion_cls_recorder_t){ 0 };
+    motion_cls_decision = (motion_cls_decision_t){ .current = MOTION_CLS_NONE, .candidate = MOTION_CLS_NONE };
+    motion_cls_initialized = true;
+
+    return 0;
+}
+
+/**
+ * @brief Converts a raw axis to mg, clamped to MOTION_CLS_MAX_MG.
+ */
+static inline int16_t motion_cls_mg(const int16_t raw)
+{
+    const int32_t mg = ((int32_t)raw * 1000) / (int32_t)motion_cls_config.lsb_per_g;
+
+    return (int16_t)CLAMP(mg, -MOTION_CLS_MAX_MG, MOTION_CLS_MAX_MG);
+}
+
+void motion_cls_push(const accel_values_t * p_accel)
+{
+    motion_cls_recorder_t * p_rec = &motion_cls_recorder;
+    k_spinlock_key_t        key;
+
+    if (!motion_cls_initialized || (p_accel == NULL))
+    {
+        return;
+    }
+
+    p_rec->ring.x[p_rec->head] = motion_cls_mg(p_accel->x);
+    p_rec->ring.y[p_rec->head] = motion_cls_mg(p_accel->y);
+    p_rec->ring.z[p_rec->head] = motion_cls_mg(p_accel->z);
+    p_rec->head                = (p_rec->head + 1U) % MOTION_CLS_WINDOW;
+    p_rec->count               = MIN(p_rec->count + 1U, MOTION_CLS_WINDOW);
+    p_rec->hop++;
+
+    if ((p_rec->count < MOTION_CLS_WINDOW) || (p_rec->hop < MOTION_CLS_HOP))
+    {
+        return;
+    }
+    p_rec->hop = 0U;
+
+    // the handler reads motion_cls_window until it returns, only this thread submits
+    if (k_work_busy_get(&motion_cls_work) != 0)
+    {
+        key = k_spin_lock(&motion_cls_stats_lock);
+        motion_cls_stats.dropped++;
+        k_spin_unlock(&motion_cls_stats_lock, key);
+        return;
+    }
+
+    // oldest sample first, the ring is full so head is the oldest
+    for (uint32_t i = 0U; i < MOTION_CLS_WINDOW; i++)
+    {
+        const uint32_t src = (p_rec->head + i) % MOTION_CLS_WINDOW;
+
+        motion_cls_window.x[i] = p_rec->ring.x[src];
+        motion_cls_window.y[i] = p_rec->ring.y[src];
+        motion_cls_window.z[i] = p_rec->ring.z[src];
+    }
+    motion_cls_window_ms = k_uptime_get();
+
+    (void)k_work_submit(&motion_cls_work);
+}
+
+const char * motion_cls_class_str(const enum motion_cls_class cls)
+{
+    return ((uint32_t)cls < MOTION_CLS_COUNT) ? motion_cls_class_names[cls] : "unknown";
+}
+
+int motion_cls_stats_get(motion_cls_stats_t * p_stats)
+{
+    k_spinlock_key_t key;
+
+    if (p_stats == NULL)
+    {
+        return -EINVAL;
+    }
+
+    key      = k_spin_lock(&motion_cls_stats_lock);
+    *p_stats = motion_cls_stats;
+    k_spin_unlock(&motion_cls_stats_lock, key);
+
+    return 0;
+}
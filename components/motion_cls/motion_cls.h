@@ -0,0 +1,151 @@
+/**
+ * @file      motion_cls.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Machine state classifier. Accelerometer samples at 100 Hz are
+ *            cut into windows of MOTION_CLS_WINDOW samples every
+ *            MOTION_CLS_HOP samples. Every window is reduced to integer time
+ *            and frequency domain features of the magnitude: spread, peak
+ *            to peak, zero crossings, the energy of four bands and the
+ *            dominant frequency. An int8 dense net generated by
+ *            scripts/motion_cls_train.py turns them into off, idle, running
+ *            or fault, and only a confirmed change of the class is handed
+ *            to the handler, with the confidence of the net.
+ *
+ *            The samples are only copied by the sampling thread, features
+ *            and inference run from the system work queue on a window of
+ *            static memory. A window that comes while the previous one is
+ *            still being classified is dropped, so the work per hop is
+ *            bounded.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef MOTION_CLS_H_
+#define MOTION_CLS_H_
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include "sensor_types.h"
+
+#define MOTION_CLS_WINDOW   64U      ///< samples of a window, 640 ms at 100 Hz
+#define MOTION_CLS_HOP      32U      ///< samples between the starts of two windows
+#define MOTION_CLS_MAX_MG   16000    ///< every axis is clamped to this, in mg
+#define MOTION_CLS_FEATURES 8U       ///< features of a window, the inputs of the net
+
+/**@brief States of the machine. */
+enum motion_cls_class
+{
+    MOTION_CLS_OFF = 0,  ///< only gravity and sensor noise
+    MOTION_CLS_IDLE,     ///< weak high frequency vibration
+    MOTION_CLS_RUNNING,  ///< strong periodic vibration
+    MOTION_CLS_FAULT,    ///< running with repeated impacts
+    MOTION_CLS_COUNT,
+};
+
+/**@brief Window in mg, one array per axis, oldest sample first. */
+typedef struct
+{
+    int16_t x[MOTION_CLS_WINDOW];
+    int16_t y[MOTION_CLS_WINDOW];
+    int16_t z[MOTION_CLS_WINDOW];
+} motion_cls_window_t;
+
+/**@brief A confirmed change of the class. */
+typedef struct
+{
+    enum motion_cls_class cls;
+    uint8_t               confidence_pct;  ///< probability the net gives the class, of the window that confirmed it
+    int64_t               timestamp_ms;    ///< uptime when the last sample of that window was pushed
+} motion_cls_event_t;
+
+/**
+ * @brief Called from the system work queue for every change of the class,
+ * the first class included.
+ *
+ * @param[in] p_evt       change
+ * @param[in] p_user_data pointer given in the configuration
+ */
+typedef void (*motion_cls_handler_t)(const motion_cls_event_t * p_evt, void * p_user_data);
+
+/**@brief Configuration of the classifier. */
+typedef struct
+{
+    uint16_t             lsb_per_g;    ///< sensitivity of the pushed samples
+    motion_cls_handler_t handler;      ///< called for every change
+    void *               p_user_data;  ///< passed to the handler
+} motion_cls_config_t;
+
+/**@brief Statistics of the classifier. */
+typedef struct
+{
+    uint32_t windows;        ///< windows classified
+    uint32_t changes;        ///< changes handed to the handler
+    uint32_t dropped;        ///< windows dropped while the previous one was being classified
+    uint32_t avg_window_us;  ///< average time of the features and the inference of a window
+    uint32_t max_window_us;  ///< longest time of the features and the inference of a window
+} motion_cls_stats_t;
+
+/**
+ * @brief Initializes the classifier. The class is unknown until the first
+ * one is confirmed.
+ *
+ * @param[in] p_config configuration, copied
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or handler or a sensitivity of 0.
+ */
+int motion_cls_init(const motion_cls_config_t * p_config);
+
+/**
+ * @brief Adds a sample and hands a full window to the system work queue
+ * every MOTION_CLS_HOP samples. Called from the one thread that samples,
+ * at the 100 Hz the model was trained for.
+ *
+ * @param[in] p_accel accelerometer sample
+ */
+void motion_cls_push(const accel_values_t * p_accel);
+
+/**
+ * @brief Gets the name of a class for the logs.
+ *
+ * @param[in] cls class
+ *
+ * @return name of the class, "unknown" if it is out of range.
+ */
+const char * motion_cls_class_str(const enum motion_cls_class cls);
+
+/**
+ * @brief Gets the statistics of the classifier.
+ *
+ * @param[out] p_stats statistics
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int motion_cls_stats_get(motion_cls_stats_t * p_stats);
+
+/**
+ * @brief Computes the features of a window, what the work handler does
+ * first with every window. Exposed so windows can be classified outside
+ * the sample stream.
+ *
+ * @param[in]  p_window window in mg
+ * @param[out] p_f      MOTION_CLS_FEATURES features
+ */
+void motion_cls_features(const motion_cls_window_t * p_window, int32_t * p_f);
+
+/**
+ * @brief Runs the int8 net on the features of a window, without the
+ * confirmation over several windows.
+ *
+ * @param[in]  p_f              features from motion_cls_features()
+ * @param[out] p_confidence_pct probability of the class, in percent
+ *
+ * @return class with the largest logit, the first one on a tie.
+ */
+enum motion_cls_class motion_cls_infer(const int32_t * p_f, uint8_t * p_confidence_pct);
+
+#endif // MOTION_CLS_H_
@@ -0,0 +1,62 @@
+/**
+ * @file      motion_cls_model.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Generated by scripts/motion_cls_train.py, do not edit. Int8
+ *            dense net of the motion_cls component.
+ *
+ *            training: 1200 windows, int8 100.0 %, float 100.0 %, agreement 100.0 %
+ *            test: 256 windows, int8 100.0 %, float 100.0 %, agreement 100.0 %
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef MOTION_CLS_MODEL_H_
+#define MOTION_CLS_MODEL_H_
+
+#include <stdint.h>
+
+#define MOTION_CLS_MODEL_RATE_HZ  100  ///< sample rate the model was trained for
+#define MOTION_CLS_MODEL_FEATURES 8
+#define MOTION_CLS_MODEL_HIDDEN   16
+#define MOTION_CLS_MODEL_CLASSES  4
+
+// input quantization: q = ((feature - offset) * mult) >> 16, 32 steps per standard deviation
+static const int32_t motion_cls_in_offset[MOTION_CLS_MODEL_FEATURES] = { 78, 307, 30, 110, 128, 148, 152, 15 };
+static const int32_t motion_cls_in_mult[MOTION_CLS_MODEL_FEATURES]   = { 25768, 6183, 182029, 77674, 56098, 47067, 65721, 250924 };
+
+static const int8_t motion_cls_w1[MOTION_CLS_MODEL_HIDDEN][MOTION_CLS_MODEL_FEATURES] = {
+    { 56, 60, 13, -43, -64, -32, -90, -23 },
+    { -15, -16, 37, -49, -24, -34, -73, 27 },
+    { -32, 125, 7, 12, 50, 20, 48, -53 },
+    { 5, -22, 38, -8, -45, 18, 56, 43 },
+    { -37, 84, 10, 17, 23, -26, 3, -56 },
+    { 99, -31, 3, 22, -11, -38, 62, -2 },
+    { 38, -23, -11, 21, 22, -60, -75, 7 },
+    { 58, -62, -36, -9, 3, 71, -89, -15 },
+    { 15, -10, -74, 9, -26, 24, 20, 12 },
+    { 9, -21, 105, 11, 0, 17, -33, 17 },
+    { 28, -18, 8, -11, -74, -1, -37, -21 },
+    { -23, -2, 41, -18, 6, -71, 74, -8 },
+    { 37, -60, -48, -5, 50, 40, -50, -3 },
+    { 37, 34, -82, 18, -48, -5, -127, -13 },
+    { -9, 38, 26, 40, 39, -38, 18, -77 },
+    { -12, 59, -20, -5, 7, 16, 7, -35 },
+};
+static const int32_t motion_cls_b1[MOTION_CLS_MODEL_HIDDEN] = { -1152, 719, 440, 1432, 330, 1061, -1065, 842, 1044, 1477, -916, 1218, 109, 408, -298, 677 };
+#define MOTION_CLS_M1 1986762395LL  ///< hidden layer requantization, (acc * M1) >> S1
+#define MOTION_CLS_S1 38
+
+static const int8_t motion_cls_w2[MOTION_CLS_MODEL_CLASSES][MOTION_CLS_MODEL_HIDDEN] = {
+    { 127, 74, -43, -41, 10, 9, 59, 6, -18, -23, 60, -27, -5, 85, -32, -16 },
+    { -48, 55, -56, 27, -41, -59, -39, -18, -9, 58, -6, 68, -26, -98, -3, 45 },
+    { -9, -90, -39, 83, -78, 93, -1, 107, 66, -17, 12, 28, 72, 67, -52, 31 },
+    { 4, -37, 121, -25, 70, -30, 6, -102, -16, -11, 36, -71, -55, -61, 47, 81 },
+};
+static const int32_t motion_cls_b2[MOTION_CLS_MODEL_CLASSES] = { -1058, 268, 1099, -310 };
+#define MOTION_CLS_M2 1096415617LL  ///< logit differences to eighths of a nat, (diff * M2) >> S2
+#define MOTION_CLS_S2 37
+
+#endif // MOTION_CLS_MODEL_H_
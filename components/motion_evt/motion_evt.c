@@ -0,0 +1,581 @@
+/**
+ * @file      motion_evt.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Motion events detected on the sensors themselves, see
+ *            motion_evt.h. The events routed to every pin are kept so that
+ *            a fired pin only costs the reads of the sources that can be
+ *            behind it.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include "motion_evt.h"
+#if defined(CONFIG_APP_MPU9250)
+#include "mpu9250.h"
+#endif
+#if defined(CONFIG_APP_LIS2DH12)
+#include "lis2dh12.h"
+#endif
+
+LOG_MODULE_REGISTER(motion_evt_component, CONFIG_APP_MOTION_EVT_LOG_LEVEL);
+
+#define MOTION_EVT_SLOTS (MOTION_EVT_SENSOR_COUNT * MOTION_EVT_PIN_COUNT)  ///< one pending interrupt per pin of every sensor
+
+/**@brief Events of the LIS2DH12 raised by the interrupt generator of a pin. */
+#define MOTION_EVT_GEN_MASK \
+    (MOTION_EVT_MASK(MOTION_EVT_FREE_FALL) | MOTION_EVT_MASK(MOTION_EVT_MOTION) | MOTION_EVT_MASK(MOTION_EVT_ZERO_MOTION))
+
+/**@brief Events of the LIS2DH12 raised by the click detection. */
+#define MOTION_EVT_CLICK_MASK (MOTION_EVT_MASK(MOTION_EVT_CLICK) | MOTION_EVT_MASK(MOTION_EVT_DOUBLE_CLICK))
+
+/**@brief A subscriber and its user data. */
+typedef struct
+{
+    uint32_t             type_mask;
+    motion_evt_handler_t handler;
+    void *               p_user_data;
+} motion_evt_subscription_t;
+
+/**@brief State of the engine, protected by motion_evt_lock. */
+typedef struct
+{
+    uint32_t routed[MOTION_EVT_SENSOR_COUNT][MOTION_EVT_PIN_COUNT];  ///< MOTION_EVT_MASK() of the events on every pin
+    bool     mpu9150;                                                ///< the MPU has the MPU9150 detectors
+#if defined(CONFIG_APP_MPU9250)
+    app_mpu_int_enable_t mpu_int_enable;                             ///< INT_ENABLE
+#endif
+} motion_evt_state_t;
+
+static motion_evt_state_t motion_evt;
+static K_MUTEX_DEFINE(motion_evt_lock);
+
+static motion_evt_subscription_t motion_evt_subscribers[MOTION_EVT_MAX_SUBSCRIBERS];
+static uint8_t                   motion_evt_subscriber_count;
+
+static ATOMIC_DEFINE(motion_evt_pending, MOTION_EVT_SLOTS);  ///< pins that fired
+static atomic_t motion_evt_notified_cycles[MOTION_EVT_SLOTS];  ///< cycle count of the first notification, 0 if none
+
+static motion_evt_stats_t motion_evt_stats;
+static struct k_spinlock  motion_evt_stats_lock;
+
+static void motion_evt_work_handler(struct k_work * p_work);
+static K_WORK_DEFINE(motion_evt_work, motion_evt_work_handler);
+
+#if defined(CONFIG_APP_MPU9250)
+/**
+ * @brief Converts the status of the MPU drivers to a negative errno.
+ */
+static inline int motion_evt_mpu_err(const int err_code)
+{
+    return (err_code == MPU_BAD_PARAMETER) ? -EINVAL : err_code;
+}
+
+/**
+ * @brief Configures a detector of the MPU, all of them are raised on its
+ * only interrupt pin.
+ */
+static int motion_evt_mpu_set(const motion_evt_detector_t * p_detector)
+{
+    const bool           enable     = (p_detector->threshold_mg != 0U);
+    const uint16_t       mg         = p_detector->threshold_mg;
+    app_mpu_int_enable_t int_enable = motion_evt.mpu_int_enable;
+    int                  err;
+
+    if (p_detector->pin != MOTION_EVT_PIN_INT1)
+    {
+        return -ENOTSUP;
+    }
+
+    // FF_DUR and MOT_DUR count in ms
+    if (motion_evt.mpu9150 && (p_detector->duration_ms > UINT8_MAX) && (p_detector->type != MOTION_EVT_ZERO_MOTION))
+    {
+        return -EINVAL;
+    }
+
+    switch (p_detector->type)
+    {
+        case MOTION_EVT_FREE_FALL:
+            if (!motion_evt.mpu9150)
+            {
+                return -ENOTSUP;
+            }
+            err              = app_mpu_config_ff_detection(APP_MPU_DEFAULT, mg,
+                                                           enable ? (uint8_t)p_detector->duration_ms : 0U);
+            int_enable.ff_en = enable;
+            break;
+
+        case MOTION_EVT_MOTION:
+            if (motion_evt.mpu9150)
+            {
+                err = app_mpu_config_motion_detection(APP_MPU_DEFAULT, mg, enable ? (uint8_t)p_detector->duration_ms : 0U);
+            }
+            else
+            {
+                err = app_mpu_config_wom_detection(APP_MPU_DEFAULT, mg);
+            }
+            int_enable.mot_en = enable;
+            break;
+
+        case MOTION_EVT_ZERO_MOTION:
+            if (!motion_evt.mpu9150)
+            {
+                return -ENOTSUP;
+            }
+            err                = app_mpu_config_zero_motion_detection(APP_MPU_DEFAULT, mg,
+                                                                      enable ? p_detector->duration_ms : 0U);
+            int_enable.zmot_en = enable;
+            break;
+
+        default:
+            return -ENOTSUP;
+    }
+
+    err = motion_evt_mpu_err(err);
+    if (err == 0)
+    {
+        err = app_mpu_int_enable(APP_MPU_DEFAULT, &int_enable);
+    }
+    if (err == 0)
+    {
+        motion_evt.mpu_int_enable = int_enable;
+    }
+
+    return err;
+}
+
+/**
+ * @brief Reads the interrupt status of the MPU, which clears it, and decodes
+ * the events routed to its pin.
+ */
+static int motion_evt_mpu_decode(const uint32_t routed, motion_evt_t * p_events, uint8_t * p_count)
+{
+    uint8_t status;
+    uint8_t motion = 0U;
+    int     err;
+
+    err = app_mpu_read_int_source(APP_MPU_DEFAULT, &status);
+    if ((err == 0) && motion_evt.mpu9150 && ((status & (MPU_INT_STATUS_MOT | MPU_INT_STATUS_ZMOT)) != 0U))
+    {
+        err = app_mpu_read_motion_status(APP_MPU_DEFAULT, &motion);
+    }
+    if (err != 0)
+    {
+        return err;
+    }
+
+    if ((status & MPU_INT_STATUS_FF) && (routed & MOTION_EVT_MASK(MOTION_EVT_FREE_FALL)))
+    {
+        p_events[(*p_count)++] = (motion_evt_t){ .type = MOTION_EVT_FREE_FALL };
+    }
+
+    if ((status & MPU_INT_STATUS_MOT) && (routed & MOTION_EVT_MASK(MOTION_EVT_MOTION)))
+    {
+        p_events[(*p_count)++] = (motion_evt_t){
+            .type  = MOTION_EVT_MOTION,
+            .axes  = ((motion & MPU_MOT_DETECT_X) ? MOTION_EVT_AXIS_X : 0U) |
+                     ((motion & MPU_MOT_DETECT_Y) ? MOTION_EVT_AXIS_Y : 0U) |
+                     ((motion & MPU_MOT_DETECT_Z) ? MOTION_EVT_AXIS_Z : 0U),
+            .flags = (motion & MPU_MOT_DETECT_NEG) ? MOTION_EVT_FLAG_NEGATIVE : 0U,
+        };
+    }
+
+    // raised both when zero motion starts and when it ends
+    if ((status & MPU_INT_STATUS_ZMOT) && (routed & MOTION_EVT_MASK(MOTION_EVT_ZERO_MOTION)))
+    {
+        p_events[(*p_count)++] = (motion_evt_t){
+            .type  = MOTION_EVT_ZERO_MOTION,
+            .flags = (motion & MPU_MOT_DETECT_ZRMOT) ? 0U : MOTION_EVT_FLAG_ENDED,
+        };
+    }
+
+    return 0;
+}
+#endif
+
+#if defined(CONFIG_APP_LIS2DH12)
+/**
+ * @brief Configures a detector of the LIS2DH12.
+ */
+static int motion_evt_lis2dh12_set(const motion_evt_detector_t * p_detector)
+{
+    const uint32_t mask      = MOTION_EVT_MASK(p_detector->type);
+    const uint32_t routed    = motion_evt.routed[MOTION_EVT_LIS2DH12][p_detector->pin];
+    const uint32_t other     = motion_evt.routed[MOTION_EVT_LIS2DH12][(p_detector->pin == MOTION_EVT_PIN_INT1) ? 1 : 0];
+    const uint8_t  pin       = (uint8_t)p_detector->pin + 1U;
+    const uint8_t  other_pin = (pin == 1U) ? 2U : 1U;
+    const bool     enable    = (p_detector->threshold_mg != 0U);
+    const uint16_t mg        = p_detector->threshold_mg;
+    const uint16_t ms        = p_detector->duration_ms;
+
+    switch (p_detector->type)
+    {
+        case MOTION_EVT_FREE_FALL:
+        case MOTION_EVT_MOTION:
+        case MOTION_EVT_ZERO_MOTION:
+            // one generator per pin
+            if (enable && ((routed & MOTION_EVT_GEN_MASK & ~mask) != 0U))
+            {
+                return -EBUSY;
+            }
+            // the event moves to the other pin
+            if ((other & mask) != 0U)
+            {
+                int err = lis2dh12_int_gen_config(LIS2DH12_DEFAULT, other_pin, 0U, 0U, 0U, false);
+                if (err != 0)
+                {
+                    return err;
+                }
+            }
+            if (!enable)
+            {
+                // leaves the generator alone if it runs another event
+                return ((routed & mask) != 0U) ? lis2dh12_int_gen_config(LIS2DH12_DEFAULT, pin, 0U, 0U, 0U, false) : 0;
+            }
+            if (p_detector->type == MOTION_EVT_FREE_FALL)
+            {
+                return lis2dh12_int_gen_config(LIS2DH12_DEFAULT, pin, LIS2DH12_INT_CFG_AOI | LIS2DH12_INT_CFG_XYZ_LIE, mg,
+                                               ms, false);
+            }
+            if (p_detector->type == MOTION_EVT_MOTION)
+            {
+                return lis2dh12_int_gen_config(LIS2DH12_DEFAULT, pin, LIS2DH12_INT_CFG_XYZ_HIE, mg, ms, true);
+            }
+            return lis2dh12_int_gen_config(LIS2DH12_DEFAULT, pin, LIS2DH12_INT_CFG_AOI | LIS2DH12_INT_CFG_XYZ_LIE, mg, ms,
+                                           true);
+
+        case MOTION_EVT_CLICK:
+        case MOTION_EVT_DOUBLE_CLICK:
+            // one click detection for both pins
+            if (enable && (((routed | other) & MOTION_EVT_CLICK_MASK & ~mask) != 0U))
+            {
+                return -EBUSY;
+            }
+            if (!enable)
+            {
+                return (((routed | other) & mask) != 0U)
+                           ? lis2dh12_click_config(LIS2DH12_DEFAULT, 0U, 0U, 0U, 0U, 0U, pin)
+                           : 0;
+            }
+            return lis2dh12_click_config(LIS2DH12_DEFAULT,
+                                         (p_detector->type == MOTION_EVT_CLICK) ? LIS2DH12_CLICK_CFG_XYZ_S
+                                                                                : LIS2DH12_CLICK_CFG_XYZ_D,
+                                         mg, ms, p_detector->latency_ms, p_detector->window_ms, pin);
+
+        case MOTION_EVT_ACTIVITY:
+        {
+            int err;
+
+            if (p_detector->pin != MOTION_EVT_PIN_INT2)
+            {
+                return -ENOTSUP;
+            }
+
+            err = lis2dh12_activity_config(LIS2DH12_DEFAULT, mg, ms);
+            if (err == 0)
+            {
+                err = lis2dh12_activity_int2_route(LIS2DH12_DEFAULT, enable);
+            }
+            return err;
+        }
+
+        default:
+            return -ENOTSUP;
+    }
+}
+
+/**
+ * @brief Reads the sources routed to a pin of the LIS2DH12, which clears the
+ * latched ones, and decodes their events.
+ */
+static int motion_evt_lis2dh12_decode(const enum motion_evt_pin pin, const uint32_t routed, motion_evt_t * p_events,
+                                      uint8_t * p_count)
+{
+    const uint8_t first = *p_count;
+    uint8_t       src;
+    int           err;
+
+    if ((routed & MOTION_EVT_GEN_MASK) != 0U)
+    {
+        err = lis2dh12_int_gen_src_get(LIS2DH12_DEFAULT, (uint8_t)pin + 1U, &src);
+        if (err != 0)
+        {
+            return err;
+        }
+
+        if (src & LIS2DH12_SRC_IA)
+        {
+            // the generator runs the only one of these events routed to the pin
+            p_events[(*p_count)++] = (motion_evt_t){
+                .type = (enum motion_evt_type)(find_lsb_set(routed & MOTION_EVT_GEN_MASK) - 1),
+                .axes = ((src & LIS2DH12_INT_SRC_X) ? MOTION_EVT_AXIS_X : 0U) |
+                        ((src & LIS2DH12_INT_SRC_Y) ? MOTION_EVT_AXIS_Y : 0U) |
+                        ((src & LIS2DH12_INT_SRC_Z) ? MOTION_EVT_AXIS_Z : 0U),
+            };
+        }
+    }
+
+    if ((routed & MOTION_EVT_CLICK_MASK) != 0U)
+    {
+        err = lis2dh12_click_src_get(LIS2DH12_DEFAULT, &src);
+        if (err != 0)
+        {
+            return err;
+        }
+
+        if (src & LIS2DH12_SRC_IA)
+        {
+            p_events[(*p_count)++] = (motion_evt_t){
+                .type  = (src & LIS2DH12_CLICK_SRC_DCLICK) ? MOTION_EVT_DOUBLE_CLICK : MOTION_EVT_CLICK,
+                .axes  = ((src & LIS2DH12_CLICK_SRC_X) ? MOTION_EVT_AXIS_X : 0U) |
+                         ((src & LIS2DH12_CLICK_SRC_Y) ? MOTION_EVT_AXIS_Y : 0U) |
+                         ((src & LIS2DH12_CLICK_SRC_Z) ? MOTION_EVT_AXIS_Z : 0U),
+                .flags = (src & LIS2DH12_CLICK_SRC_SIGN) ? MOTION_EVT_FLAG_NEGATIVE : 0U,
+            };
+        }
+    }
+
+    // the sleep-to-wake state has no source register, it is what is left
+    if ((routed & MOTION_EVT_MASK(MOTION_EVT_ACTIVITY)) && (*p_count == first))
+    {
+        p_events[(*p_count)++] = (motion_evt_t){ .type = MOTION_EVT_ACTIVITY };
+    }
+
+    return 0;
+}
+#endif
+
+int motion_evt_init(void)
+{
+    int err = 0;
+
+#if defined(CONFIG_APP_MPU9250)
+    app_mpu_int_pin_cfg_t pin_cfg;
+    uint8_t               id = 0U;
+
+    err = regseq_probe(&APP_MPU_DEFAULT->regseq_device, &id);
+
+    // held until INT_STATUS is read, so the work queue still finds the source
+    if (err == 0)
+    {
+        err = app_mpu_int_cfg_pin_get(APP_MPU_DEFAULT, &pin_cfg);
+    }
+    if (err == 0)
+    {
+        pin_cfg.latch_int_en = 1;
+        pin_cfg.int_rd_clear = 0;
+        err = app_mpu_int_cfg_pin(APP_MPU_DEFAULT, &pin_cfg);
+    }
+
+    if (err != 0)
+    {
+        LOG_ERR("motion_evt_init:MPU interrupt configuration failed with error: %d", err);
+        return err;
+    }
+
+    k_mutex_lock(&motion_evt_lock, K_FOREVER);
+    motion_evt.mpu9150        = (id == MPU_WHO_AM_I_MPU9150);
+    motion_evt.mpu_int_enable = (app_mpu_int_enable_t)MPU_DEFAULT_INT_ENABLE_CONFIG();
+    k_mutex_unlock(&motion_evt_lock);
+#endif
+
+    return err;
+}
+
+int motion_evt_detector_set(const enum motion_evt_sensor sensor, const motion_evt_detector_t * p_detector)
+{
+    int err;
+
+    if ((p_detector == NULL) || (sensor >= MOTION_EVT_SENSOR_COUNT) || (p_detector->pin >= MOTION_EVT_PIN_COUNT) ||
+        (p_detector->type >= MOTION_EVT_TYPE_COUNT))
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&motion_evt_lock, K_FOREVER);
+
+    switch (sensor)
+    {
+#if defined(CONFIG_APP_MPU9250)
+        case MOTION_EVT_MPU9250:
+            err = motion_evt_mpu_set(p_detector);
+            break;
+#endif
+#if defined(CONFIG_APP_LIS2DH12)
+        case MOTION_EVT_LIS2DH12:
+            err = motion_evt_lis2dh12_set(p_detector);
+            break;
+#endif
+        default:
+            err = -ENODEV;
+            break;
+    }
+
+    if (err == 0)
+    {
+        const uint32_t mask = MOTION_EVT_MASK(p_detector->type);
+
+        // an event is on one pin at most, the click detection moves along
+        for (uint8_t pin = 0U; pin < MOTION_EVT_PIN_COUNT; pin++)
+        {
+            motion_evt.routed[sensor][pin] &= ~mask;
+        }
+        if (p_detector->threshold_mg != 0U)
+        {
+            motion_evt.routed[sensor][p_detector->pin] |= mask;
+        }
+    }
+
+    k_mutex_unlock(&motion_evt_lock);
+
+    if (err != 0)
+    {
+        LOG_WRN("motion_evt_detector_set:event %u of sensor %u failed with error: %d", p_detector->type, sensor, err);
+    }
+
+    return err;
+}
+
+int motion_evt_subscribe(const uint32_t type_mask, motion_evt_handler_t handler, void * p_user_data)
+{
+    int err = 0;
+
+    if (handler == NULL)
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&motion_evt_lock, K_FOREVER);
+
+    if (motion_evt_subscriber_count >= MOTION_EVT_MAX_SUBSCRIBERS)
+    {
+        err = -ENOMEM;
+    }
+    else
+    {
+        motion_evt_subscribers[motion_evt_subscriber_count] = (motion_evt_subscription_t){
+            .type_mask   = type_mask,
+            .handler     = handler,
+            .p_user_data = p_user_data,
+        };
+        motion_evt_subscriber_count++;
+    }
+
+    k_mutex_unlock(&motion_evt_lock);
+
+    return err;
+}
+
+void motion_evt_irq_notify(const enum motion_evt_sensor sensor, const enum motion_evt_pin pin)
+{
+    const uint32_t slot = ((uint32_t)sensor * MOTION_EVT_PIN_COUNT) + (uint32_t)pin;
+
+    if (slot >= MOTION_EVT_SLOTS)
+    {
+        return;
+    }
+
+    // 0 means nothing pending, a cycle count of exactly 0 is reported without latency
+    (void)atomic_cas(&motion_evt_notified_cycles[slot], 0, (atomic_val_t)k_cycle_get_32());
+    atomic_set_bit(motion_evt_pending, (int)slot);
+    (void)k_work_submit(&motion_evt_work);
+}
+
+/**
+ * @brief Reads the sources behind every pin that fired and hands the events
+ * to the subscribers.
+ */
+static void motion_evt_work_handler(struct k_work * p_work)
+{
+    ARG_UNUSED(p_work);
+
+    for (uint32_t slot = 0U; slot < MOTION_EVT_SLOTS; slot++)
+    {
+        const enum motion_evt_sensor sensor = (enum motion_evt_sensor)(slot / MOTION_EVT_PIN_COUNT);
+        const enum motion_evt_pin    pin    = (enum motion_evt_pin)(slot % MOTION_EVT_PIN_COUNT);
+        motion_evt_t                 events[MOTION_EVT_TYPE_COUNT];
+        uint8_t                      count = 0U;
+        uint32_t                     cycles;
+        uint32_t                     latency_us;
+        int64_t                      timestamp_ms;
+        k_spinlock_key_t             key;
+        int                          err = 0;
+
+        if (!atomic_test_and_clear_bit(motion_evt_pending, (int)slot))
+        {
+            continue;
+        }
+        cycles = (uint32_t)atomic_set(&motion_evt_notified_cycles[slot], 0);
+
+        k_mutex_lock(&motion_evt_lock, K_FOREVER);
+        switch (sensor)
+        {
+#if defined(CONFIG_APP_MPU9250)
+            case MOTION_EVT_MPU9250:
+                err = motion_evt_mpu_decode(motion_evt.routed[sensor][pin], events, &count);
+                break;
+#endif
+#if defined(CONFIG_APP_LIS2DH12)
+            case MOTION_EVT_LIS2DH12:
+                err = motion_evt_lis2dh12_decode(pin, motion_evt.routed[sensor][pin], events, &count);
+                break;
+#endif
+            default:
+                break;
+        }
+        k_mutex_unlock(&motion_evt_lock);
+
+        latency_us   = k_cyc_to_us_floor32(k_cycle_get_32() - cycles);
+        timestamp_ms = k_uptime_get() - (int64_t)(latency_us / 1000U);
+
+        key = k_spin_lock(&motion_evt_stats_lock);
+        motion_evt_stats.events        += count;
+        motion_evt_stats.errors        += (err != 0) ? 1U : 0U;
+        motion_evt_stats.spurious      += ((err == 0) && (count == 0U)) ? 1U : 0U;
+        motion_evt_stats.max_latency_us = MAX(motion_evt_stats.max_latency_us, latency_us);
+        k_spin_unlock(&motion_evt_stats_lock, key);
+
+        if (err != 0)
+        {
+            LOG_WRN("motion_evt_work_handler:sources of sensor %u pin %u could not be read, error: %d", sensor, pin, err);
+            continue;
+        }
+
+        for (uint8_t i = 0U; i < count; i++)
+        {
+            events[i].sensor       = sensor;
+            events[i].timestamp_ms = timestamp_ms;
+
+            // subscribers are only ever added, the ones seen here stay valid
+            for (uint8_t s = 0U; s < motion_evt_subscriber_count; s++)
+            {
+                if (motion_evt_subscribers[s].type_mask & MOTION_EVT_MASK(events[i].type))
+                {
+                    motion_evt_subscribers[s].handler(&events[i], motion_evt_subscribers[s].p_user_data);
+                }
+            }
+        }
+    }
+}
+
+int motion_evt_stats_get(motion_evt_stats_t * p_stats)
+{
+    k_spinlock_key_t key;
+
+    if (p_stats == NULL)
+    {
+        return -EINVAL;
+    }
+
+    key      = k_spin_lock(&motion_evt_stats_lock);
+    *p_stats = motion_evt_stats;
+    k_spin_unlock(&motion_evt_stats_lock, key);
+
+    return 0;
+}
@@ -0,0 +1,182 @@
+/**
+ * @file      motion_evt.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Motion events detected on the sensors themselves. Free fall,
+ *            motion, zero motion, click and activity detectors of the
+ *            MPU9250 and the LIS2DH12 are configured in mg and ms and routed
+ *            to an interrupt pin. When a pin fires, its sources are read
+ *            from the system work queue and every detected event is handed
+ *            to the subscribers, so nothing has to run these detections on
+ *            the full rate sample stream.
+ *
+ *            Not every sensor has every detector:
+ *
+ *            | event        | MPU9150 | MPU9250 | LIS2DH12          |
+ *            |--------------|---------|---------|-------------------|
+ *            | free fall    | INT     |         | INT1 or INT2      |
+ *            | motion       | INT     | INT     | INT1 or INT2      |
+ *            | zero motion  | INT     |         | INT1 or INT2      |
+ *            | click        |         |         | INT1 or INT2      |
+ *            | double click |         |         | INT1 or INT2      |
+ *            | activity     |         |         | INT2              |
+ *
+ *            The LIS2DH12 has one interrupt generator per pin, free fall,
+ *            motion and zero motion routed to the same pin exclude each
+ *            other, as do click and double click. Its times are in steps of
+ *            the output data rate at the time of the configuration.
+ *
+ *            The detectors share registers with lis2dh12_motion_int1_config(),
+ *            app_mpu_config_motion_detection() and the odr_ctrl and evcap
+ *            components, which should not be used on the same pins. With
+ *            several sensors of a kind in the devicetree the engine handles
+ *            the first one.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef MOTION_EVT_H_
+#define MOTION_EVT_H_
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+#define MOTION_EVT_MAX_SUBSCRIBERS CONFIG_APP_MOTION_EVT_MAX_SUBSCRIBERS  ///< callbacks events can be delivered to
+
+#define MOTION_EVT_AXIS_X 0x01U  ///< event on the X axis
+#define MOTION_EVT_AXIS_Y 0x02U  ///< event on the Y axis
+#define MOTION_EVT_AXIS_Z 0x04U  ///< event on the Z axis
+
+#define MOTION_EVT_FLAG_NEGATIVE 0x01U  ///< the acceleration went negative, clicks and MPU9150 motion
+#define MOTION_EVT_FLAG_ENDED    0x02U  ///< the condition ended, MPU9150 zero motion only
+
+/**@brief Sensors with detectors. */
+enum motion_evt_sensor
+{
+    MOTION_EVT_MPU9250 = 0,  ///< MPU9250, MPU9255 or MPU9150, told apart by WHO_AM_I
+    MOTION_EVT_LIS2DH12,
+    MOTION_EVT_SENSOR_COUNT,
+};
+
+/**@brief Interrupt pins, the MPU only has INT1. */
+enum motion_evt_pin
+{
+    MOTION_EVT_PIN_INT1 = 0,
+    MOTION_EVT_PIN_INT2,
+    MOTION_EVT_PIN_COUNT,
+};
+
+/**@brief Events, also the bit of the type mask of a subscriber. */
+enum motion_evt_type
+{
+    MOTION_EVT_FREE_FALL = 0,  ///< acceleration below the threshold on all axes
+    MOTION_EVT_MOTION,         ///< change of acceleration above the threshold on an axis
+    MOTION_EVT_ZERO_MOTION,    ///< change of acceleration below the threshold on all axes
+    MOTION_EVT_CLICK,          ///< short peak above the threshold
+    MOTION_EVT_DOUBLE_CLICK,   ///< two peaks within the window
+    MOTION_EVT_ACTIVITY,       ///< the LIS2DH12 changed between its sleep and wake rates
+    MOTION_EVT_TYPE_COUNT,
+};
+
+#define MOTION_EVT_MASK(type) (1UL << (type))                          ///< type mask of one event
+#define MOTION_EVT_MASK_ALL   (MOTION_EVT_MASK(MOTION_EVT_TYPE_COUNT) - 1UL)  ///< type mask of every event
+
+/**@brief A decoded event. */
+typedef struct
+{
+    enum motion_evt_sensor sensor;
+    enum motion_evt_type   type;
+    uint8_t                axes;          ///< MOTION_EVT_AXIS_* bits, 0 if the sensor does not tell
+    uint8_t                flags;         ///< MOTION_EVT_FLAG_* bits
+    int64_t                timestamp_ms;  ///< uptime when the interrupt was notified
+} motion_evt_t;
+
+/**@brief Configuration of one detector. */
+typedef struct
+{
+    enum motion_evt_type type;
+    enum motion_evt_pin  pin;           ///< pin the event is raised on
+    uint16_t             threshold_mg;  ///< 0 disables the detector
+    uint16_t             duration_ms;   ///< time the condition has to hold, for clicks the longest click, for activity the inactivity before sleep; the MPU9250 motion detection has none
+    uint16_t             latency_ms;    ///< double click: dead time after the first click
+    uint16_t             window_ms;     ///< double click: time the second click has to start in
+} motion_evt_detector_t;
+
+/**
+ * @brief Called from the system work queue for every event.
+ *
+ * @param[in] p_evt       event
+ * @param[in] p_user_data pointer given to motion_evt_subscribe()
+ */
+typedef void (*motion_evt_handler_t)(const motion_evt_t * p_evt, void * p_user_data);
+
+/**@brief Statistics of the event delivery. */
+typedef struct
+{
+    uint32_t events;          ///< events delivered
+    uint32_t spurious;        ///< interrupts without an enabled source
+    uint32_t errors;          ///< interrupts whose sources could not be read
+    uint32_t max_latency_us;  ///< longest time from the interrupt to the delivery
+} motion_evt_stats_t;
+
+/**
+ * @brief Initializes the event engine. Reads WHO_AM_I of the MPU and latches
+ * its interrupt pin until INT_STATUS is read. The sensors have to be
+ * initialized beforehand.
+ *
+ * @return 0 on success
+ * @return a bus error if the MPU could not be configured.
+ */
+int motion_evt_init(void);
+
+/**
+ * @brief Configures a detector of a sensor and routes it to its pin, or
+ * disables it with a threshold of 0.
+ *
+ * @param[in] sensor     sensor
+ * @param[in] p_detector detector
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or a parameter out of range
+ * @return -ENODEV if the sensor is not part of the build
+ * @return -ENOTSUP if the sensor has no such detector or cannot raise it on the pin
+ * @return -EBUSY if the detector shares its hardware with another enabled one
+ * @return a bus error if the sensor could not be configured.
+ */
+int motion_evt_detector_set(const enum motion_evt_sensor sensor, const motion_evt_detector_t * p_detector);
+
+/**
+ * @brief Adds a subscriber, for the events from now on.
+ *
+ * @param[in] type_mask   MOTION_EVT_MASK() of the events to deliver
+ * @param[in] handler     callback
+ * @param[in] p_user_data passed to the callback
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL callback
+ * @return -ENOMEM if there are MOTION_EVT_MAX_SUBSCRIBERS subscribers already.
+ */
+int motion_evt_subscribe(const uint32_t type_mask, motion_evt_handler_t handler, void * p_user_data);
+
+/**
+ * @brief Notifies the engine that an interrupt pin of a sensor fired. Can be
+ * called from an ISR, the sources are read from the system work queue.
+ *
+ * @param[in] sensor sensor
+ * @param[in] pin    pin
+ */
+void motion_evt_irq_notify(const enum motion_evt_sensor sensor, const enum motion_evt_pin pin);
+
+/**
+ * @brief Gets the statistics of the event delivery.
+ *
+ * @param[out] p_stats statistics
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int motion_evt_stats_get(motion_evt_stats_t * p_stats);
+
+#endif // MOTION_EVT_H_
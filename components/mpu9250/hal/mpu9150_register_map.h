@@ -91,6 +91,44 @@
 #define MPU_REG_FIFO_R_W           0x74  // Dec 116, R/W,  FIFO_DATA[7:0]
 #define MPU_REG_WHO_AM_I           0x75  // Dec 117, R,    - WHO_AM_I[6:1] -
 
+#define MPU_PWR_MGMT_1_SLEEP       0x40  // PWR_MGMT_1: SLEEP
+#define MPU_PWR_MGMT_1_CYCLE       0x20  // PWR_MGMT_1: CYCLE
+#define MPU_PWR_MGMT_1_TEMP_DIS    0x08  // PWR_MGMT_1: TEMP_DIS
+#define MPU_PWR_MGMT_2_STBY_G      0x07  // PWR_MGMT_2: STBY_XG STBY_YG STBY_ZG
+#define MPU_FIFO_EN_ACCEL          0x08  // FIFO_EN: ACCEL_FIFO_EN
+#define MPU_USER_CTRL_FIFO_EN      0x40  // USER_CTRL: FIFO_EN
+#define MPU_USER_CTRL_FIFO_RESET   0x04  // USER_CTRL: FIFO_RESET
+#define MPU_USER_CTRL_I2C_MST_EN   0x20  // USER_CTRL: I2C_MST_EN
+#define MPU_USER_CTRL_I2C_IF_DIS   0x10  // USER_CTRL: I2C_IF_DIS, SPI only
+#define MPU_I2C_MST_CTRL_400KHZ    0x0D  // I2C_MST_CTRL: I2C_MST_CLK for 400 kHz
+#define MPU_I2C_SLV_RNW            0x80  // I2C_SLVx_ADDR: I2C_SLVx_RNW, read from the slave
+#define MPU_I2C_SLV_EN             0x80  // I2C_SLVx_CTRL: I2C_SLVx_EN
+#define MPU_I2C_SLV4_DONE          0x40  // I2C_MST_STATUS: I2C_SLV4_DONE
+#define MPU_I2C_SLV4_NACK          0x10  // I2C_MST_STATUS: I2C_SLV4_NACK
+#define MPU_INT_PIN_CFG_INT_LEVEL  0x80  // INT_PIN_CFG: INT_LEVEL, active low
+#define MPU_INT_PIN_CFG_LATCH_INT  0x20  // INT_PIN_CFG: LATCH_INT_EN, held until cleared instead of a 50 us pulse
+#define MPU_INT_PIN_CFG_RD_CLEAR   0x10  // INT_PIN_CFG: INT_RD_CLEAR, cleared by any read
+#define MPU_INT_ENABLE_DATA_RDY    0x01  // INT_ENABLE: DATA_RDY_EN
+#define MPU_INT_STATUS_FF          0x80  // INT_STATUS: FF_INT, MPU9150 only
+#define MPU_INT_STATUS_MOT         0x40  // INT_STATUS: MOT_INT, WOM_INT on the MPU9250
+#define MPU_INT_STATUS_ZMOT        0x20  // INT_STATUS: ZMOT_INT, MPU9150 only
+#define MPU_MOT_DETECT_X           0xC0  // MOT_DETECT_STATUS: MOT_XNEG MOT_XPOS
+#define MPU_MOT_DETECT_Y           0x30  // MOT_DETECT_STATUS: MOT_YNEG MOT_YPOS
+#define MPU_MOT_DETECT_Z           0x0C  // MOT_DETECT_STATUS: MOT_ZNEG MOT_ZPOS
+#define MPU_MOT_DETECT_NEG         0xA8  // MOT_DETECT_STATUS: MOT_XNEG MOT_YNEG MOT_ZNEG
+#define MPU_MOT_DETECT_ZRMOT       0x01  // MOT_DETECT_STATUS: MOT_ZRMOT, zero motion is detected
+
+/*******************************************************************************
+ * MPU9250 REGISTERS IN PLACE OF MPU9150 ONES
+ *******************************************************************************/
+
+#define MPU_REG_LP_ACCEL_ODR       0x1E  // Dec 30,  R/W,  - - - - LPOSC_CLKSEL[3:0], FF_DUR of the MPU9150
+#define MPU_REG_WOM_THR            0x1F  // Dec 31,  R/W,  WOM_THRESHOLD[7:0], MOT_THR of the MPU9150
+#define MPU_REG_ACCEL_INTEL_CTRL   0x69  // Dec 105, R/W,  ACCEL_INTEL_EN ACCEL_INTEL_MODE - - - - - -, MOT_DETECT_CTRL of the MPU9150
+
+#define MPU_ACCEL_INTEL_EN_CMP     0xC0  // ACCEL_INTEL_CTRL: wake-on-motion, every sample compared to the previous one
+#define MPU_INT_ENABLE_WOM         0x40  // INT_ENABLE: WOM_EN, MOT_EN of the MPU9150
+
 /*******************************************************************************
  * MAGNETOMETER REGISTERS
  *******************************************************************************/
@@ -115,4 +153,11 @@
 #define MPU_AK89XX_REG_ASAY        0x11  // READ Y-axis sensitivity adjustment value Fuse ROM
 #define MPU_AK89XX_REG_ASAZ        0x12  // READ Z-axis sensitivity adjustment value Fuse ROM
 
+#define MPU_AK89XX_ST1_DRDY        0x01  // ST1: DRDY, a new measurement is ready
+#define MPU_AK89XX_ST1_DOR         0x02  // ST1: DOR, a measurement was skipped since the last read
+#define MPU_AK89XX_ST2_HOFL        0x08  // ST2: HOFL, magnetic sensor overflow
+#define MPU_AK89XX_ST2_BITM        0x10  // ST2: BITM, mirror of the output resolution
+#define MPU_AK89XX_CNTL_MODE       0x0F  // CNTL: MODE[3:0]
+#define MPU_AK89XX_CNTL_BIT        0x10  // CNTL: BIT, 16-bit output (AK8963 only)
+
 #endif // MPU9150_REG_MAP_H
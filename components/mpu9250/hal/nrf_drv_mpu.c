@@ -7,39 +7,122 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
-#include <nrfx_twi.h>
-#include "twi.h"
+#include <errno.h>
+#include <zephyr/kernel.h>
 #include "nrf_drv_mpu.h"
+#include "mpu9150_register_map.h"
 
-#define MPU_ADDRESS               0x68
-#define MPU_AK89XX_MAGN_ADDRESS   0x0C
+int nrf_drv_mpu_bus_set(nrf_drv_mpu_t *p_mpu, const nrf_drv_mpu_bus_t *p_bus)
+{
+    if ((p_mpu == NULL) || (p_bus == NULL))
+        return -EINVAL;
+
+    p_mpu->p_bus = p_bus;
+    return 0;
+}
 
-int nrf_drv_mpu_init(void)
+const nrf_drv_mpu_bus_t *nrf_drv_mpu_bus_get(const nrf_drv_mpu_t *p_mpu)
 {
-    return 0; // there is no extra initialization required.
+    return p_mpu->p_bus;
 }
 
-int nrf_drv_mpu_write_registers(uint8_t reg, uint8_t *p_data, uint32_t length)
+int nrf_drv_mpu_init(const nrf_drv_mpu_t *p_mpu)
 {
-    return twi_write(MPU_ADDRESS, reg, p_data, length);
+    return p_mpu->p_bus->init(p_mpu);
 }
 
-int nrf_drv_mpu_write_single_register(uint8_t reg, uint8_t data)
+int nrf_drv_mpu_write_registers(const nrf_drv_mpu_t *p_mpu, uint8_t reg, uint8_t *p_data, uint32_t length)
 {
-    return twi_write(MPU_ADDRESS, reg, &data, 1U);
+    return p_mpu->p_bus->write(p_mpu, reg, p_data, length);
 }
 
-int nrf_drv_mpu_read_registers(uint8_t reg, uint8_t *p_data, uint32_t length)
+int nrf_drv_mpu_write_single_register(const nrf_drv_mpu_t *p_mpu, uint8_t reg, uint8_t data)
 {
-    return twi_read(MPU_ADDRESS, reg, p_data, length);
+    return p_mpu->p_bus->write(p_mpu, reg, &data, 1U);
 }
 
-int nrf_drv_mpu_read_magnetometer_registers(uint8_t reg, uint8_t *p_data, uint32_t length)
+int nrf_drv_mpu_read_registers(const nrf_drv_mpu_t *p_mpu, uint8_t reg, uint8_t *p_data, uint32_t length)
 {
-    return twi_read(MPU_AK89XX_MAGN_ADDRESS, reg, p_data, length);
+    return p_mpu->p_bus->read(p_mpu, reg, p_data, length);
+}
+
+int nrf_drv_mpu_read_registers_multi(const nrf_drv_mpu_t * const *pp_mpus, uint8_t count, uint8_t reg,
+                                     uint8_t *p_data, uint32_t length, int *p_errs)
+{
+    const nrf_drv_mpu_bus_t *p_batch_bus = NULL;
+    const nrf_drv_mpu_t *batch[NRF_DRV_MPU_MAX_BATCH];
+    uint8_t *batch_data[NRF_DRV_MPU_MAX_BATCH];
+    uint8_t batch_index[NRF_DRV_MPU_MAX_BATCH];
+    int batch_errs[NRF_DRV_MPU_MAX_BATCH];
+    uint8_t batch_count = 0;
+    int first_err = 0;
+
+    if ((pp_mpus == NULL) || (p_data == NULL) || (p_errs == NULL) || (count == 0) || (count > NRF_DRV_MPU_MAX_BATCH))
+        return -EINVAL;
+
+    // The MPUs on the bus of the first one that can batch go together, the rest one by one
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const nrf_drv_mpu_bus_t *p_bus = pp_mpus[i]->p_bus;
+
+        if ((p_bus->read_batch != NULL) && ((p_batch_bus == NULL) || (p_bus == p_batch_bus)))
+        {
+            p_batch_bus = p_bus;
+            batch[batch_count] = pp_mpus[i];
+            batch_index[batch_count] = i;
+            batch_data[batch_count++] = &p_data[i * length];
+            continue;
+        }
+
+        p_errs[i] = p_bus->read(pp_mpus[i], reg, &p_data[i * length], length);
+    }
+
+    if (batch_count != 0)
+    {
+        (void)p_batch_bus->read_batch(batch, batch_count, reg, batch_data, length, batch_errs);
+
+        for (uint8_t i = 0; i < batch_count; i++)
+            p_errs[batch_index[i]] = batch_errs[i];
+    }
+
+    for (uint8_t i = 0; (i < count) && (first_err == 0); i++)
+        first_err = p_errs[i];
+
+    return first_err;
 }
 
-int nrf_drv_mpu_write_magnetometer_register(uint8_t reg, uint8_t data)
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
+int nrf_drv_mpu_read_magnetometer_registers(const nrf_drv_mpu_t *p_mpu, uint8_t reg, uint8_t *p_data, uint32_t length)
 {
-    return twi_write(MPU_AK89XX_MAGN_ADDRESS, reg, &data, 1U);
+    return p_mpu->p_bus->magn_read(p_mpu, reg, p_data, length);
+}
+
+int nrf_drv_mpu_write_magnetometer_register(const nrf_drv_mpu_t *p_mpu, uint8_t reg, uint8_t data)
+{
+    return p_mpu->p_bus->magn_write(p_mpu, reg, data);
+}
+#endif
+
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+int nrf_drv_mpu_stream_start(const nrf_drv_mpu_t *p_mpu, const nrf_drv_mpu_stream_t *p_stream)
+{
+    if ((p_mpu == NULL) || (p_stream == NULL))
+        return -EINVAL;
+
+    if (p_mpu->p_bus->stream_start == NULL)
+        return -ENOTSUP;
+
+    return p_mpu->p_bus->stream_start(p_mpu, p_stream);
+}
+
+int nrf_drv_mpu_stream_stop(const nrf_drv_mpu_t *p_mpu)
+{
+    if (p_mpu == NULL)
+        return -EINVAL;
+
+    if (p_mpu->p_bus->stream_stop == NULL)
+        return -ENOTSUP;
+
+    return p_mpu->p_bus->stream_stop(p_mpu);
 }
+#endif
@@ -10,58 +10,197 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-/**@brief Function to initiate TWI drivers
+#define NRF_DRV_MPU_SAMPLE_BYTES 14U  // ACCEL_XOUT_H..GYRO_ZOUT_L, one sample of every sensor
+#define NRF_DRV_MPU_MAX_BATCH    8U   // MPUs a single nrf_drv_mpu_read_registers_multi() reads
+
+typedef struct nrf_drv_mpu_s nrf_drv_mpu_t;
+
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+/**@brief Called from the system work queue with a full block of stream samples.
+ *
+ * @param[in]   p_samples       Samples, oldest first, length bytes each
+ * @param[in]   count           Number of samples
+ * @param[in]   p_context       Pointer given with the stream
+ */
+typedef void (*nrf_drv_mpu_stream_handler_t)(const uint8_t *p_samples, const uint16_t count, void *p_context);
+
+/**@brief Burst reads started in hardware by the interrupt pin of the MPU, see
+ * twi_stream_start(). The CPU wakes once per samples_per_wake reads.
+ */
+typedef struct
+{
+    uint8_t reg;                           // Register the reads start at
+    uint16_t length;                       // Bytes of each read
+    uint16_t samples_per_wake;             // Reads per block handed to the handler
+    uint8_t *p_buffer;                     // NRF_DRV_MPU_STREAM_BUFFER_SIZE() bytes of RAM
+    uint32_t trigger_pin;                  // Pin the INT pin of the MPU is wired to
+    nrf_drv_mpu_stream_handler_t handler;  // Called for every full block
+    void *p_context;                       // Passed to the handler
+} nrf_drv_mpu_stream_t;
+
+// Two blocks of samples and a spare one
+#define NRF_DRV_MPU_STREAM_BUFFER_SIZE(length, samples_per_wake) (((2U * (samples_per_wake)) + 1U) * (length))
+#endif
+
+/**@brief Register access over one bus. An MPU is reached through the bus
+ * selected with nrf_drv_mpu_bus_set(), the one chosen in Kconfig by default.
+ */
+typedef struct
+{
+    const char * p_name;                                                                  // Bus name for logs
+    int (*init)(const nrf_drv_mpu_t *p_mpu);                                              // Prepares the bus and the MPU interface for it
+    int (*write)(const nrf_drv_mpu_t *p_mpu, uint8_t reg, const uint8_t *p_data, uint32_t length);  // Burst write from reg on
+    int (*read)(const nrf_drv_mpu_t *p_mpu, uint8_t reg, uint8_t *p_data, uint32_t length);         // Burst read from reg on
+    // Same burst read of several MPUs in one bus ownership, sets the result of every one in p_errs, NULL if the bus cannot batch
+    int (*read_batch)(const nrf_drv_mpu_t * const *pp_mpus, uint8_t count, uint8_t reg, uint8_t * const *pp_data, uint32_t length,
+                      int *p_errs);
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
+    int (*magn_write)(const nrf_drv_mpu_t *p_mpu, uint8_t reg, uint8_t data);                       // Single magnetometer register write
+    int (*magn_read)(const nrf_drv_mpu_t *p_mpu, uint8_t reg, uint8_t *p_data, uint32_t length);    // Burst magnetometer read from reg on
+#endif
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+    // Burst reads started by the interrupt pin, NULL if the bus cannot run them without the CPU
+    int (*stream_start)(const nrf_drv_mpu_t *p_mpu, const nrf_drv_mpu_stream_t *p_stream);
+    int (*stream_stop)(const nrf_drv_mpu_t *p_mpu);
+#endif
+} nrf_drv_mpu_bus_t;
+
+/**@brief One MPU, the bus it is reached through and its addresses on the
+ * TWI bus. SPI has a single chip select and reaches one MPU only.
+ */
+struct nrf_drv_mpu_s
+{
+    const nrf_drv_mpu_bus_t *p_bus;  // Bus the MPU is reached through
+    uint8_t address;                 // TWI address, 0x68, or 0x69 with AD0 high
+    uint8_t magn_address;            // TWI address of the AK8963 through the bypass, 0 if it is not used
+};
+
+extern const nrf_drv_mpu_bus_t nrf_drv_mpu_bus_twi;   // MPU and AK8963 at their addresses on the TWI bus
+#if defined(CONFIG_APP_MPU9250_SPI)
+extern const nrf_drv_mpu_bus_t nrf_drv_mpu_bus_spi;   // MPU on SPIM, the AK8963 behind its I2C master
+#endif
+
+#if defined(CONFIG_APP_MPU9250_SPI_DEFAULT)
+#define NRF_DRV_MPU_BUS_DEFAULT (&nrf_drv_mpu_bus_spi)  // Bus every MPU starts on
+#else
+#define NRF_DRV_MPU_BUS_DEFAULT (&nrf_drv_mpu_bus_twi)  // Bus every MPU starts on
+#endif
+
+/**@brief Selects the bus an MPU is reached through, nrf_drv_mpu_init()
+ * has to be called again afterwards.
+ *
+ * @param[in]   p_mpu           MPU
+ * @param[in]   p_bus           Bus
+ * @retval      0 on success, -EINVAL on a NULL pointer
+ */
+int nrf_drv_mpu_bus_set(nrf_drv_mpu_t *p_mpu, const nrf_drv_mpu_bus_t *p_bus);
+
+/**@brief Function to get the bus an MPU is reached through
  *
+ * @param[in]   p_mpu           MPU
+ * @retval      The selected bus
+ */
+const nrf_drv_mpu_bus_t *nrf_drv_mpu_bus_get(const nrf_drv_mpu_t *p_mpu);
+
+/**@brief Function to initiate the selected bus of an MPU
+ *
+ * @param[in]   p_mpu           MPU
  * @retval      uint32_t        Error code
  */
-int nrf_drv_mpu_init(void);
+int nrf_drv_mpu_init(const nrf_drv_mpu_t *p_mpu);
 
 /**
  * @brief Function for reading an arbitrary register
  *
+ * @param[in]   p_mpu           MPU
  * @param[in]   reg             Register to write
  * @param[in]   data            Value
  * @param[in]   length          Number of bytes to write
  * @retval      uint32_t        Error code
  */
-int nrf_drv_mpu_write_registers(uint8_t reg, uint8_t *p_data, uint32_t length);
+int nrf_drv_mpu_write_registers(const nrf_drv_mpu_t *p_mpu, uint8_t reg, uint8_t *p_data, uint32_t length);
 
 /**
  * @brief Function for reading an arbitrary register
  *
+ * @param[in]   p_mpu           MPU
  * @param[in]   reg             Register to write
  * @param[in]   data            Value
  * @retval      uint32_t        Error code
  */
-int nrf_drv_mpu_write_single_register(uint8_t reg, uint8_t data);
+int nrf_drv_mpu_write_single_register(const nrf_drv_mpu_t *p_mpu, uint8_t reg, uint8_t data);
 
 /**
  * @brief Function for reading arbitrary register(s)
  *
+ * @param[in]   p_mpu           MPU
  * @param[in]   reg             Register to read
  * @param[in]   p_data          Pointer to place to store value(s)
  * @param[in]   length          Number of registers to read
  * @retval      uint32_t        Error code
  */
-int nrf_drv_mpu_read_registers(uint8_t reg, uint8_t *p_data, uint32_t length);
+int nrf_drv_mpu_read_registers(const nrf_drv_mpu_t *p_mpu, uint8_t reg, uint8_t *p_data, uint32_t length);
+
+/**
+ * @brief Reads the same registers of several MPUs. MPUs that share a bus
+ * that can batch are read in one bus ownership, the others one by one.
+ *
+ * @param[in]   pp_mpus         MPUs
+ * @param[in]   count           Number of MPUs, at most NRF_DRV_MPU_MAX_BATCH
+ * @param[in]   reg             Register to read
+ * @param[out]  p_data          length bytes per MPU, in the order of pp_mpus
+ * @param[in]   length          Number of registers to read
+ * @param[out]  p_errs          Result per MPU, in the order of pp_mpus
+ * @retval      0 on success, -EINVAL on a NULL pointer or a count out of
+ *              range, or the error of the first MPU that failed, the others
+ *              are still read
+ */
+int nrf_drv_mpu_read_registers_multi(const nrf_drv_mpu_t * const *pp_mpus, uint8_t count, uint8_t reg,
+                                     uint8_t *p_data, uint32_t length, int *p_errs);
 
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
 /**
  * @brief
  *
+ * @param[in] p_mpu
  * @param[in] reg
  * @param[in] p_data
  * @param[in] length
  * @return
  */
-int nrf_drv_mpu_read_magnetometer_registers(uint8_t reg, uint8_t *p_data, uint32_t length);
+int nrf_drv_mpu_read_magnetometer_registers(const nrf_drv_mpu_t *p_mpu, uint8_t reg, uint8_t *p_data, uint32_t length);
 
 /**
  * @brief
  *
+ * @param p_mpu
  * @param reg
  * @param data
  * @return
  */
-int nrf_drv_mpu_write_magnetometer_register(uint8_t reg, uint8_t data);
+int nrf_drv_mpu_write_magnetometer_register(const nrf_drv_mpu_t *p_mpu, uint8_t reg, uint8_t data);
+#endif
+
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+/**
+ * @brief Starts burst reads that the interrupt pin of the MPU starts in
+ * hardware, the MPU has to raise it for every new sample.
+ *
+ * @param[in]   p_mpu           MPU
+ * @param[in]   p_stream        Stream, copied
+ * @retval      0 on success, -EINVAL on a NULL pointer, -ENOTSUP if the bus
+ *              of the MPU cannot stream, or the error of twi_stream_start()
+ */
+int nrf_drv_mpu_stream_start(const nrf_drv_mpu_t *p_mpu, const nrf_drv_mpu_stream_t *p_stream);
+
+/**
+ * @brief Stops the stream of an MPU.
+ *
+ * @param[in]   p_mpu           MPU
+ * @retval      0 on success, -EINVAL on a NULL pointer, -ENOTSUP if the bus
+ *              of the MPU cannot stream, or the error of twi_stream_stop()
+ */
+int nrf_drv_mpu_stream_stop(const nrf_drv_mpu_t *p_mpu);
+#endif
 
 #endif /* NRF_DRV_MPU__ */
@@ -0,0 +1,291 @@
+/**
+ * @file      nrf_drv_mpu_spi.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     MPU register access over SPI. The first byte of a transfer is
+ *            the register address with the read bit on top. The MPU9250
+ *            takes 1 MHz for any register but 20 MHz for the sensor,
+ *            interrupt and FIFO registers, so reads of those run at the read
+ *            clock and everything else at the configuration clock. The
+ *            AK8963 is not on the SPI bus, it is reached one register at a
+ *            time through the I2C master of the MPU and its slave 4.
+ *
+ * @version   0.1
+ * @date      2024-07-31
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "nrf_drv_mpu.h"
+#include "nrf_drv_mpu_spi_port.h"
+#include "mpu9150_register_map.h"
+#if defined(CONFIG_APP_EVLOG)
+#include "evlog.h"
+#endif
+
+LOG_MODULE_DECLARE(mpu9250_component, CONFIG_APP_MPU9250_LOG_LEVEL);
+
+#define MPU_SPI_READ_BIT          0x80U  ///< set in the address byte of a read
+#define MPU_SPI_MAX_DATA          (NRF_DRV_MPU_SPI_PORT_MAX_LENGTH - 1U)
+#define MPU_AK89XX_MAGN_ADDRESS   0x0CU
+#define MPU_SLV4_POLL_US          100U   ///< slave 4 runs once per sample period, 1 ms at the default rate
+#define MPU_SLV4_POLL_TRIES       50U
+
+static K_MUTEX_DEFINE(mpu_spi_lock);
+static uint8_t mpu_spi_tx[NRF_DRV_MPU_SPI_PORT_MAX_LENGTH];
+static uint8_t mpu_spi_rx[NRF_DRV_MPU_SPI_PORT_MAX_LENGTH];
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
+static bool    mpu_spi_master_ready = false;
+#endif
+
+/**
+ * @brief Tells whether a register may be read at the read clock, the
+ * datasheet only allows it for the sensor, interrupt and FIFO registers.
+ *
+ * @param[in] reg    first register of the read
+ * @param[in] length number of registers
+ *
+ * @return true for the read clock, false for the configuration clock
+ */
+static bool mpu_spi_fast_read(const uint8_t reg, const uint32_t length)
+{
+    const uint32_t last = reg + length - 1U;
+
+    if ((reg >= MPU_REG_INT_STATUS) && (last <= MPU_REG_EXT_SENS_DATA_23))
+    {
+        return true;
+    }
+
+    return (reg >= MPU_REG_FIFO_COUNTH) && (last <= MPU_REG_FIFO_R_W);
+}
+
+/**
+ * @brief Writes registers at the configuration clock.
+ */
+static int mpu_spi_write(uint8_t reg, const uint8_t * p_data, uint32_t length)
+{
+    int err;
+
+    if ((length == 0U) || (length > MPU_SPI_MAX_DATA))
+    {
+        return -EINVAL;
+    }
+
+    (void)k_mutex_lock(&mpu_spi_lock, K_FOREVER);
+    mpu_spi_tx[0] = reg & (uint8_t)~MPU_SPI_READ_BIT;
+    memcpy(&mpu_spi_tx[1], p_data, length);
+    err = nrf_drv_mpu_spi_port_transfer(mpu_spi_tx, (uint16_t)(length + 1U), NULL, 0U,
+                                        CONFIG_APP_MPU9250_SPI_CONFIG_HZ);
+    (void)k_mutex_unlock(&mpu_spi_lock);
+
+    return err;
+}
+
+/**
+ * @brief Reads registers, at the read clock if all of them allow it.
+ */
+static int mpu_spi_read(uint8_t reg, uint8_t * p_data, uint32_t length)
+{
+    int err;
+    const uint32_t frequency = mpu_spi_fast_read(reg, length) ? CONFIG_APP_MPU9250_SPI_READ_HZ
+                                                              : CONFIG_APP_MPU9250_SPI_CONFIG_HZ;
+
+    if ((length == 0U) || (length > MPU_SPI_MAX_DATA))
+    {
+        return -EINVAL;
+    }
+
+    (void)k_mutex_lock(&mpu_spi_lock, K_FOREVER);
+    mpu_spi_tx[0] = reg | MPU_SPI_READ_BIT;
+    err = nrf_drv_mpu_spi_port_transfer(mpu_spi_tx, 1U, mpu_spi_rx, (uint16_t)(length + 1U), frequency);
+    if (err == 0)
+    {
+        // the first byte was clocked in with the address
+        memcpy(p_data, &mpu_spi_rx[1], length);
+    }
+    (void)k_mutex_unlock(&mpu_spi_lock);
+
+    return err;
+}
+
+/**
+ * @brief Switches the MPU to SPI only, a stray I2C start on the shared pins
+ * would otherwise be taken for an I2C transfer.
+ */
+static int mpu_spi_init(const nrf_drv_mpu_t * p_mpu)
+{
+    int err;
+    uint8_t user_ctrl;
+
+    ARG_UNUSED(p_mpu);
+
+    err = nrf_drv_mpu_spi_port_init();
+    if (err != 0)
+    {
+        return err;
+    }
+
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
+    // the I2C master is set up again on the next magnetometer access
+    mpu_spi_master_ready = false;
+#endif
+
+    err = mpu_spi_read(MPU_REG_USER_CTRL, &user_ctrl, 1U);
+    if (err != 0)
+    {
+        return err;
+    }
+
+    user_ctrl |= MPU_USER_CTRL_I2C_IF_DIS;
+    return mpu_spi_write(MPU_REG_USER_CTRL, &user_ctrl, 1U);
+}
+
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
+/**
+ * @brief Enables the I2C master of the MPU at 400 kHz, once. The bypass
+ * multiplexer has no effect while the master runs.
+ */
+static int mpu_spi_master_enable(void)
+{
+    int err;
+    uint8_t value;
+
+    if (mpu_spi_master_ready)
+    {
+        return 0;
+    }
+
+    value = MPU_I2C_MST_CTRL_400KHZ;
+    err   = mpu_spi_write(MPU_REG_I2C_MST_CTRL, &value, 1U);
+    if (err == 0)
+    {
+        err = mpu_spi_read(MPU_REG_USER_CTRL, &value, 1U);
+    }
+    if (err == 0)
+    {
+        value |= MPU_USER_CTRL_I2C_MST_EN | MPU_USER_CTRL_I2C_IF_DIS;
+        err = mpu_spi_write(MPU_REG_USER_CTRL, &value, 1U);
+    }
+
+    mpu_spi_master_ready = (err == 0);
+    return err;
+}
+
+/**
+ * @brief Runs one slave 4 transfer of a single magnetometer register and
+ * waits for it to complete.
+ *
+ * @param[in]     read    true to read the register, false to write it
+ * @param[in]     reg     magnetometer register
+ * @param[in,out] p_data  value to write, or the value read
+ *
+ * @return 0 on success
+ * @return -ENXIO if the magnetometer did not acknowledge
+ * @return -ETIMEDOUT if the transfer did not complete
+ * @return a bus error.
+ */
+static int mpu_spi_slv4_transfer(const bool read, const uint8_t reg, uint8_t * p_data)
+{
+    int err;
+    uint8_t status = 0U;
+
+    err = mpu_spi_master_enable();
+    if (err != 0)
+    {
+        return err;
+    }
+
+    // I2C_SLV4_ADDR, I2C_SLV4_REG, I2C_SLV4_DO and I2C_SLV4_CTRL are adjacent
+    const uint8_t slv4[] = {
+        MPU_AK89XX_MAGN_ADDRESS | (read ? MPU_I2C_SLV_RNW : 0U),
+        reg,
+        read ? 0U : *p_data,
+        MPU_I2C_SLV_EN,
+    };
+
+    err = mpu_spi_write(MPU_REG_I2C_SLV4_ADDR, slv4, sizeof(slv4));
+    for (uint32_t i = 0U; (err == 0) && ((status & MPU_I2C_SLV4_DONE) == 0U); i++)
+    {
+        if (i == MPU_SLV4_POLL_TRIES)
+        {
+#if defined(CONFIG_APP_EVLOG)
+            evlog_put(EVLOG_SPI_SLV4_TIMEOUT, 0U, reg, -ETIMEDOUT, 0U);
+#else
+            LOG_WRN("mpu_spi_slv4_transfer:register 0x%02x timed out", reg);
+#endif
+            return -ETIMEDOUT;
+        }
+        k_busy_wait(MPU_SLV4_POLL_US);
+
+        // reading the status clears it
+        err = mpu_spi_read(MPU_REG_I2C_MST_STATUS, &status, 1U);
+    }
+    if (err != 0)
+    {
+        return err;
+    }
+
+    if (status & MPU_I2C_SLV4_NACK)
+    {
+        return -ENXIO;
+    }
+
+    return read ? mpu_spi_read(MPU_REG_I2C_SLV4_DI, p_data, 1U) : 0;
+}
+
+static int mpu_spi_magn_write(const nrf_drv_mpu_t * p_mpu, uint8_t reg, uint8_t data)
+{
+    ARG_UNUSED(p_mpu);
+    return mpu_spi_slv4_transfer(false, reg, &data);
+}
+
+static int mpu_spi_magn_read(const nrf_drv_mpu_t * p_mpu, uint8_t reg, uint8_t * p_data, uint32_t length)
+{
+    int err = 0;
+
+    ARG_UNUSED(p_mpu);
+
+    for (uint32_t i = 0U; (i < length) && (err == 0); i++)
+    {
+        err = mpu_spi_slv4_transfer(true, (uint8_t)(reg + i), &p_data[i]);
+    }
+
+    return err;
+}
+#endif
+
+/**
+ * @brief Register access of the bus, there is a single chip select so the
+ * TWI addresses of the MPU do not matter.
+ */
+static int mpu_spi_bus_write(const nrf_drv_mpu_t * p_mpu, uint8_t reg, const uint8_t * p_data, uint32_t length)
+{
+    ARG_UNUSED(p_mpu);
+    return mpu_spi_write(reg, p_data, length);
+}
+
+static int mpu_spi_bus_read(const nrf_drv_mpu_t * p_mpu, uint8_t reg, uint8_t * p_data, uint32_t length)
+{
+    ARG_UNUSED(p_mpu);
+    return mpu_spi_read(reg, p_data, length);
+}
+
+const nrf_drv_mpu_bus_t nrf_drv_mpu_bus_spi = {
+    .p_name     = "spi",
+    .init       = mpu_spi_init,
+    .write      = mpu_spi_bus_write,
+    .read       = mpu_spi_bus_read,
+    .read_batch = NULL,
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
+    .magn_write = mpu_spi_magn_write,
+    .magn_read  = mpu_spi_magn_read,
+#endif
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+    .stream_start = NULL,
+    .stream_stop  = NULL,
+#endif
+};
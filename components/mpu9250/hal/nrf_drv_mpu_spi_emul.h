@@ -0,0 +1,37 @@
+/**
+ * @file      nrf_drv_mpu_spi_emul.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Control of the emulated MPU SPI target on native_sim. The
+ *            target serves an MPU register file, runs slave 4 transfers of
+ *            its I2C master against a magnetometer register file, and spends
+ *            the time the transfers would take at their clock.
+ *
+ * @version   0.1
+ * @date      2024-07-31
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef NRF_DRV_MPU_SPI_EMUL_H_
+#define NRF_DRV_MPU_SPI_EMUL_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Sets the register files of the target, they are read and written
+ * in place. Without an MPU register file transfers read back 0xFF.
+ *
+ * @param[in] p_mpu  MPU registers, 128 of them
+ * @param[in] p_magn magnetometer registers, 32 of them, may be NULL
+ */
+void nrf_drv_mpu_spi_emul_registers_set(uint8_t * p_mpu, uint8_t * p_magn);
+
+/**
+ * @brief Gets the clock of the last transfer, to check which clock an
+ * access ran at.
+ *
+ * @return clock in Hz
+ */
+uint32_t nrf_drv_mpu_spi_emul_last_frequency(void);
+
+#endif // NRF_DRV_MPU_SPI_EMUL_H_
@@ -0,0 +1,49 @@
+/**
+ * @file      nrf_drv_mpu_spi_port.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Interface between the MPU SPI bus and the peripheral that
+ *            actually moves the bytes. The nrfx backend drives SPIM2 with
+ *            EasyDMA, the emulated backend serves an MPU register file on
+ *            native_sim. Callers serialize the transfers.
+ *
+ * @version   0.1
+ * @date      2024-07-31
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef NRF_DRV_MPU_SPI_PORT_H_
+#define NRF_DRV_MPU_SPI_PORT_H_
+
+#include <stdint.h>
+
+#define NRF_DRV_MPU_SPI_PORT_MAX_LENGTH 64U  ///< longest transfer, the address byte included
+
+/**
+ * @brief Initializes the backend, the pins come from Kconfig.
+ *
+ * @return 0 on success
+ * @return -ENOTTY on error.
+ */
+int nrf_drv_mpu_spi_port_init(void);
+
+/**
+ * @brief Runs one full duplex transfer with chip select held low for its
+ * whole length. The clock runs for the longer of the two buffers, rx byte n
+ * is clocked in with tx byte n and the missing tx bytes are sent as 0xFF.
+ *
+ * @param[in]  p_tx      bytes to send
+ * @param[in]  tx_length number of bytes to send
+ * @param[out] p_rx      buffer for the received bytes, may be NULL
+ * @param[in]  rx_length number of bytes to receive
+ * @param[in]  frequency clock of this transfer in Hz, rounded down to one the
+ *                       peripheral supports
+ *
+ * @return 0 on success
+ * @return -EINVAL if the transfer is too long
+ * @return -EIO if the peripheral refused the transfer.
+ */
+int nrf_drv_mpu_spi_port_transfer(const uint8_t * p_tx, uint16_t tx_length, uint8_t * p_rx, uint16_t rx_length,
+                                  uint32_t frequency);
+
+#endif // NRF_DRV_MPU_SPI_PORT_H_
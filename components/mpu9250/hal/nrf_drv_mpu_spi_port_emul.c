@@ -0,0 +1,166 @@
+/**
+ * @file      nrf_drv_mpu_spi_port_emul.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     MPU SPI backend for native_sim. Decodes the address byte
+ *            against an MPU register file, runs slave 4 transfers against a
+ *            magnetometer register file, and spends the time a real bus
+ *            would take at the clock of every transfer.
+ *
+ * @version   0.1
+ * @date      2024-07-31
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "nrf_drv_mpu_spi_port.h"
+#include "nrf_drv_mpu_spi_emul.h"
+#include "mpu9150_register_map.h"
+
+LOG_MODULE_DECLARE(mpu9250_component, CONFIG_APP_MPU9250_LOG_LEVEL);
+
+#define EMUL_READ_BIT        0x80U
+#define EMUL_MPU_REGISTERS   128U
+#define EMUL_MAGN_REGISTERS  32U
+#define EMUL_MAGN_ADDRESS    0x0CU
+#define EMUL_OVERHEAD_US     2U    ///< chip select and DMA set-up around a transfer
+
+static uint8_t * p_mpu_registers  = NULL;
+static uint8_t * p_magn_registers = NULL;
+static uint32_t  last_frequency   = 0U;
+
+/**
+ * @brief Sets the register files of the target, they are read and written
+ * in place. Without an MPU register file transfers read back 0xFF.
+ *
+ * @param[in] p_mpu  MPU registers, 128 of them
+ * @param[in] p_magn magnetometer registers, 32 of them, may be NULL
+ */
+void nrf_drv_mpu_spi_emul_registers_set(uint8_t * p_mpu, uint8_t * p_magn)
+{
+    p_mpu_registers  = p_mpu;
+    p_magn_registers = p_magn;
+}
+
+/**
+ * @brief Gets the clock of the last transfer, to check which clock an
+ * access ran at.
+ *
+ * @return clock in Hz
+ */
+uint32_t nrf_drv_mpu_spi_emul_last_frequency(void)
+{
+    return last_frequency;
+}
+
+/**
+ * @brief Runs the slave 4 transfer just enabled through I2C_SLV4_CTRL, the
+ * way the I2C master of the MPU would.
+ */
+static void emul_slv4_run(void)
+{
+    uint8_t * p_regs  = p_mpu_registers;
+    uint8_t   address = p_regs[MPU_REG_I2C_SLV4_ADDR];
+    uint8_t   reg     = p_regs[MPU_REG_I2C_SLV4_REG] % EMUL_MAGN_REGISTERS;
+
+    p_regs[MPU_REG_I2C_SLV4_CTRL] &= (uint8_t)~MPU_I2C_SLV_EN;
+
+    if ((p_regs[MPU_REG_USER_CTRL] & MPU_USER_CTRL_I2C_MST_EN) == 0U)
+    {
+        // the master is off, the transfer never happens
+        return;
+    }
+
+    if ((p_magn_registers == NULL) || ((address & (uint8_t)~MPU_I2C_SLV_RNW) != EMUL_MAGN_ADDRESS))
+    {
+        p_regs[MPU_REG_I2C_MST_STATUS] |= MPU_I2C_SLV4_DONE | MPU_I2C_SLV4_NACK;
+        return;
+    }
+
+    if (address & MPU_I2C_SLV_RNW)
+    {
+        p_regs[MPU_REG_I2C_SLV4_DI] = p_magn_registers[reg];
+    }
+    else
+    {
+        p_magn_registers[reg] = p_regs[MPU_REG_I2C_SLV4_DO];
+    }
+    p_regs[MPU_REG_I2C_MST_STATUS] |= MPU_I2C_SLV4_DONE;
+}
+
+/**
+ * @brief Nothing to initialize, the pins only exist on real hardware.
+ */
+int nrf_drv_mpu_spi_port_init(void)
+{
+    return 0;
+}
+
+/**
+ * @brief Runs a transfer against the MPU register file. The first byte
+ * addresses a register, the following ones access it and the registers
+ * after it.
+ */
+int nrf_drv_mpu_spi_port_transfer(const uint8_t * p_tx, uint16_t tx_length, uint8_t * p_rx, uint16_t rx_length,
+                                  uint32_t frequency)
+{
+    const uint16_t length = MAX(tx_length, rx_length);
+
+    if ((tx_length > NRF_DRV_MPU_SPI_PORT_MAX_LENGTH) || (rx_length > NRF_DRV_MPU_SPI_PORT_MAX_LENGTH) ||
+        (frequency == 0U))
+    {
+        return -EINVAL;
+    }
+
+    last_frequency = frequency;
+    k_busy_wait(EMUL_OVERHEAD_US + (uint32_t)DIV_ROUND_UP((uint64_t)length * 8U * 1000000U, frequency));
+
+    if ((tx_length == 0U) || (p_mpu_registers == NULL))
+    {
+        if (p_rx != NULL)
+        {
+            memset(p_rx, 0xFF, rx_length);
+        }
+        return 0;
+    }
+
+    const bool    read = (p_tx[0] & EMUL_READ_BIT) != 0U;
+    const uint8_t reg  = p_tx[0] & (uint8_t)~EMUL_READ_BIT;
+    bool          slv4 = false;
+
+    for (uint16_t i = 1U; i < length; i++)
+    {
+        uint8_t pointer = (uint8_t)((reg + i - 1U) % EMUL_MPU_REGISTERS);
+
+        if (read && (p_rx != NULL) && (i < rx_length))
+        {
+            p_rx[i] = p_mpu_registers[pointer];
+            if (pointer == MPU_REG_I2C_MST_STATUS)
+            {
+                // cleared by reading it
+                p_mpu_registers[pointer] = 0U;
+            }
+        }
+        else if (!read && (i < tx_length))
+        {
+            p_mpu_registers[pointer] = p_tx[i];
+            slv4 |= (pointer == MPU_REG_I2C_SLV4_CTRL) && (p_tx[i] & MPU_I2C_SLV_EN);
+        }
+    }
+
+    if ((p_rx != NULL) && (rx_length != 0U))
+    {
+        // nothing is driven while the address is clocked out
+        p_rx[0] = 0xFF;
+    }
+
+    if (slv4)
+    {
+        emul_slv4_run();
+    }
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+/**
+ * @file      nrf_drv_mpu_spi_port_nrfx.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     MPU SPI backend on the SPIM2 peripheral. EasyDMA moves the
+ *            bytes, chip select is driven by the peripheral and the clock is
+ *            set before every transfer, SPI mode 3.
+ *
+ * @version   0.1
+ * @date      2024-07-31
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <nrfx_spim.h>
+#include "nrf_drv_mpu_spi_port.h"
+#if defined(CONFIG_APP_EVLOG)
+#include "evlog.h"
+#endif
+
+LOG_MODULE_DECLARE(mpu9250_component, CONFIG_APP_MPU9250_LOG_LEVEL);
+
+#define NO_CONTEXT    NULL
+#define NO_HANDLER    NULL  ///< blocking transfers
+#define NO_FLAGS      0U
+
+/**@brief A clock of the peripheral. */
+typedef struct
+{
+    uint32_t            hz;
+    nrf_spim_frequency_t setting;
+} spim_clock_t;
+
+// fastest first, a requested clock is rounded down to the first one not above it
+static const spim_clock_t spim_clocks[] = {
+    { 8000000U, NRF_SPIM_FREQ_8M   },
+    { 4000000U, NRF_SPIM_FREQ_4M   },
+    { 2000000U, NRF_SPIM_FREQ_2M   },
+    { 1000000U, NRF_SPIM_FREQ_1M   },
+    { 500000U,  NRF_SPIM_FREQ_500K },
+    { 250000U,  NRF_SPIM_FREQ_250K },
+    { 125000U,  NRF_SPIM_FREQ_125K },
+};
+
+static const nrfx_spim_t spim_instance = NRFX_SPIM_INSTANCE(2);
+
+// EasyDMA can only reach RAM, the buffers of the callers may be in flash
+static uint8_t spim_tx[NRF_DRV_MPU_SPI_PORT_MAX_LENGTH];
+static uint8_t spim_rx[NRF_DRV_MPU_SPI_PORT_MAX_LENGTH];
+static bool    spim_initialized = false;
+
+/**
+ * @brief Finds the peripheral setting of a clock.
+ *
+ * @param[in] frequency requested clock in Hz
+ *
+ * @return the fastest setting not above the requested clock
+ */
+static nrf_spim_frequency_t spim_clock_find(const uint32_t frequency)
+{
+    for (uint8_t i = 0U; i < ARRAY_SIZE(spim_clocks); i++)
+    {
+        if (spim_clocks[i].hz <= frequency)
+        {
+            return spim_clocks[i].setting;
+        }
+    }
+
+    return spim_clocks[ARRAY_SIZE(spim_clocks) - 1U].setting;
+}
+
+/**
+ * @brief Initializes SPIM2 in blocking mode, once.
+ */
+int nrf_drv_mpu_spi_port_init(void)
+{
+    nrfx_err_t nrfx_err;
+
+    if (spim_initialized)
+    {
+        return 0;
+    }
+
+    nrfx_spim_config_t config = NRFX_SPIM_DEFAULT_CONFIG(CONFIG_APP_MPU9250_SPI_SCK_PIN,
+                                                         CONFIG_APP_MPU9250_SPI_MOSI_PIN,
+                                                         CONFIG_APP_MPU9250_SPI_MISO_PIN,
+                                                         CONFIG_APP_MPU9250_SPI_CS_PIN);
+    config.mode = NRF_SPIM_MODE_3;
+    config.orc  = 0xFF;
+
+    nrfx_err = nrfx_spim_init(&spim_instance, &config, NO_HANDLER, NO_CONTEXT);
+    if (nrfx_err != NRFX_SUCCESS)
+    {
+        LOG_ERR("nrf_drv_mpu_spi_port_init:nrfx_spim_init failed with error: %d", nrfx_err);
+        return -ENOTTY;
+    }
+
+    spim_initialized = true;
+    return 0;
+}
+
+/**
+ * @brief Runs one transfer at the requested clock and waits for it.
+ */
+int nrf_drv_mpu_spi_port_transfer(const uint8_t * p_tx, uint16_t tx_length, uint8_t * p_rx, uint16_t rx_length,
+                                  uint32_t frequency)
+{
+    nrfx_err_t nrfx_err;
+
+    if ((tx_length > NRF_DRV_MPU_SPI_PORT_MAX_LENGTH) || (rx_length > NRF_DRV_MPU_SPI_PORT_MAX_LENGTH))
+    {
+        return -EINVAL;
+    }
+
+    memcpy(spim_tx, p_tx, tx_length);
+
+    // the peripheral is idle between blocking transfers, the clock can change
+    nrf_spim_frequency_set(spim_instance.p_reg, spim_clock_find(frequency));
+
+    const nrfx_spim_xfer_desc_t xfer_desc = NRFX_SPIM_XFER_TRX(spim_tx, tx_length, spim_rx, rx_length);
+    nrfx_err = nrfx_spim_xfer(&spim_instance, &xfer_desc, NO_FLAGS);
+    if (nrfx_err != NRFX_SUCCESS)
+    {
+#if defined(CONFIG_APP_EVLOG)
+        evlog_put(EVLOG_SPI_NRFX_XFER, 0U, (tx_length != 0U) ? (p_tx[0] & 0x7FU) : 0U, -EIO, (uint32_t)nrfx_err);
+#else
+        LOG_ERR("nrf_drv_mpu_spi_port_transfer:nrfx_spim_xfer failed with error: %d", nrfx_err);
+#endif
+        return -EIO;
+    }
+
+    if (p_rx != NULL)
+    {
+        memcpy(p_rx, spim_rx, rx_length);
+    }
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * The library is not extensively tested and only
+ * meant as a simple explanation and for inspiration.
+ * NO WARRANTY of ANY KIND is provided.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include "twi.h"
+#include "nrf_drv_mpu.h"
+
+static int mpu_twi_init(const nrf_drv_mpu_t *p_mpu)
+{
+    ARG_UNUSED(p_mpu);
+    return 0; // the TWI component is brought up by the application.
+}
+
+static int mpu_twi_write(const nrf_drv_mpu_t *p_mpu, uint8_t reg, const uint8_t *p_data, uint32_t length)
+{
+    return twi_write(p_mpu->address, reg, (uint8_t *)p_data, length);
+}
+
+static int mpu_twi_read(const nrf_drv_mpu_t *p_mpu, uint8_t reg, uint8_t *p_data, uint32_t length)
+{
+    return twi_read(p_mpu->address, reg, p_data, length);
+}
+
+// All the MPUs share the one TWI bus, their reads go out in one bus ownership
+static int mpu_twi_read_batch(const nrf_drv_mpu_t * const *pp_mpus, uint8_t count, uint8_t reg,
+                              uint8_t * const *pp_data, uint32_t length, int *p_errs)
+{
+    int err_code;
+    twi_read_batch_t reads[TWI_BATCH_MAX_READS];
+
+    if (count > TWI_BATCH_MAX_READS)
+    {
+        for (uint8_t i = 0; i < count; i++)
+            p_errs[i] = -EINVAL;
+        return -EINVAL;
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        reads[i] = (twi_read_batch_t){
+            .address     = pp_mpus[i]->address,
+            .reg_address = reg,
+            .p_data      = pp_data[i],
+            .length      = (uint16_t)length,
+        };
+    }
+
+    err_code = twi_read_batch(reads, count, NULL);
+
+    for (uint8_t i = 0; i < count; i++)
+        p_errs[i] = reads[i].err;
+
+    return err_code;
+}
+
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
+// The AK8963 sits on the same bus once the MPU bypasses its auxiliary bus
+static int mpu_twi_magn_write(const nrf_drv_mpu_t *p_mpu, uint8_t reg, uint8_t data)
+{
+    if (p_mpu->magn_address == 0)
+        return -ENODEV;
+
+    return twi_write(p_mpu->magn_address, reg, &data, 1U);
+}
+
+static int mpu_twi_magn_read(const nrf_drv_mpu_t *p_mpu, uint8_t reg, uint8_t *p_data, uint32_t length)
+{
+    if (p_mpu->magn_address == 0)
+        return -ENODEV;
+
+    return twi_read(p_mpu->magn_address, reg, p_data, length);
+}
+#endif
+
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+// The interrupt pin starts the reads through PPI, the TWI component holds them back for the other transfers
+static int mpu_twi_stream_start(const nrf_drv_mpu_t *p_mpu, const nrf_drv_mpu_stream_t *p_stream)
+{
+    const twi_stream_config_t config = {
+        .address     = p_mpu->address,
+        .reg_address = p_stream->reg,
+        .slot_length = p_stream->length,
+        .slot_count  = p_stream->samples_per_wake,
+        .p_buffer    = p_stream->p_buffer,
+        .trigger_pin = p_stream->trigger_pin,
+        .handler     = p_stream->handler,
+        .p_context   = p_stream->p_context,
+    };
+
+    return twi_stream_start(&config);
+}
+
+static int mpu_twi_stream_stop(const nrf_drv_mpu_t *p_mpu)
+{
+    ARG_UNUSED(p_mpu);
+    return twi_stream_stop();
+}
+#endif
+
+const nrf_drv_mpu_bus_t nrf_drv_mpu_bus_twi = {
+    .p_name     = "twi",
+    .init       = mpu_twi_init,
+    .write      = mpu_twi_write,
+    .read       = mpu_twi_read,
+    .read_batch = mpu_twi_read_batch,
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
+    .magn_write = mpu_twi_magn_write,
+    .magn_read  = mpu_twi_magn_read,
+#endif
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+    .stream_start = mpu_twi_stream_start,
+    .stream_stop  = mpu_twi_stream_stop,
+#endif
+};
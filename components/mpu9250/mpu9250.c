@@ -2,97 +2,285 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
 
 #include "mpu9250.h"
 #include "hal/nrf_drv_mpu.h"
 
-int app_mpu_config(app_mpu_config_t *config)
+#define DT_DRV_COMPAT app_mpu9250
+
+LOG_MODULE_REGISTER(mpu9250_component, CONFIG_APP_MPU9250_LOG_LEVEL);
+
+static int mpu_regseq_write(void *p_context, uint8_t reg, uint8_t *p_data, uint32_t length)
 {
-    uint8_t *data;
-    data = (uint8_t *)config;
-    return nrf_drv_mpu_write_registers(MPU_REG_SMPLRT_DIV, data, 4);
+    app_mpu_t *p_mpu = (app_mpu_t *)p_context;
+    return nrf_drv_mpu_write_registers(&p_mpu->drv, reg, p_data, length);
+}
+
+static int mpu_regseq_read(void *p_context, uint8_t reg, uint8_t *p_data, uint32_t length)
+{
+    app_mpu_t *p_mpu = (app_mpu_t *)p_context;
+    return nrf_drv_mpu_read_registers(&p_mpu->drv, reg, p_data, length);
+}
+
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
+static int mpu_magn_regseq_write(void *p_context, uint8_t reg, uint8_t *p_data, uint32_t length)
+{
+    int err_code = 0;
+    app_mpu_t *p_mpu = (app_mpu_t *)p_context;
+
+    // The magnetometer registers are written one at a time
+    for (uint32_t i = 0; (i < length) && (err_code == 0); i++)
+    {
+        err_code = nrf_drv_mpu_write_magnetometer_register(&p_mpu->drv, reg + i, p_data[i]);
+    }
+    return err_code;
+}
+
+static int mpu_magn_regseq_read(void *p_context, uint8_t reg, uint8_t *p_data, uint32_t length)
+{
+    app_mpu_t *p_mpu = (app_mpu_t *)p_context;
+    return nrf_drv_mpu_read_magnetometer_registers(&p_mpu->drv, reg, p_data, length);
+}
+#endif
+
+// Bring-up sequence run by app_mpu_init()
+static const regseq_entry_t mpu_init_sequence[] = {
+    REGSEQ_WRITE_DELAY(MPU_REG_SIGNAL_PATH_RESET, 0x07, MPU_SIGNAL_PATH_RESET_US),  // Resets gyro, accelerometer and temperature sensor signal paths.
+    REGSEQ_ENTRY(MPU_REG_PWR_MGMT_1, 0x01, REGSEQ_VERIFY, MPU_PLL_SETTLE_US),       // Chose PLL with X axis gyroscope reference as clock source
+};
+
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
+// Routes the magnetometer onto the main bus, INT_PIN_CFG with only I2C_BYPASS_EN set
+static const regseq_entry_t mpu_magn_bypass_sequence[] = {
+    REGSEQ_WRITE_VERIFY(MPU_REG_INT_PIN_CFG, 0x02),
+};
+
+// CNTL of an instance after bring-up, 100 Hz continuous measurement at the resolution of its node
+#define APP_MPU_MAGN_CNTL(inst)                                                               \
+    (CONTINUOUS_MEASUREMENT_100Hz_MODE | ((DT_INST_PROP(inst, magn_resolution) == 16) ? MPU_AK89XX_CNTL_BIT : 0))
+#endif
+
+static const uint8_t mpu_ids[]      = { MPU_WHO_AM_I_MPU9250, MPU_WHO_AM_I_MPU9255, MPU_WHO_AM_I_MPU9150 };
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
+static const uint8_t mpu_magn_ids[] = { MPU_AK89XX_WIA_VALUE };
+#endif
+
+BUILD_ASSERT(APP_MPU_COUNT > 0, "CONFIG_APP_MPU9250 needs an \"app,mpu9250\" node in the devicetree");
+BUILD_ASSERT(APP_MPU_COUNT <= NRF_DRV_MPU_MAX_BATCH, "More MPUs than a batched read handles");
+
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
+// Magnetometer part of an instance, a mode change has to go through power down
+#define APP_MPU_MAGN_INIT(inst)                                                               \
+    .magn_regseq_bus = {                                                                      \
+        .write     = mpu_magn_regseq_write,                                                   \
+        .read      = mpu_magn_regseq_read,                                                    \
+        .p_context = &app_mpu_instances[inst],                                                \
+    },                                                                                        \
+    .magn_regseq_device = {                                                                   \
+        .p_name              = DT_NODE_FULL_NAME(DT_DRV_INST(inst)) "/AK8963",                \
+        .p_bus               = &app_mpu_instances[inst].magn_regseq_bus,                      \
+        .id_reg              = MPU_AK89XX_REG_WIA,                                            \
+        .p_ids               = mpu_magn_ids,                                                  \
+        .id_count            = ARRAY_SIZE(mpu_magn_ids),                                      \
+        .p_pre_bus           = &app_mpu_instances[inst].regseq_bus,                           \
+        .p_pre_sequence      = mpu_magn_bypass_sequence,                                      \
+        .pre_sequence_length = ARRAY_SIZE(mpu_magn_bypass_sequence),                          \
+        .p_sequence          = app_mpu_instances[inst].magn_init_sequence,                    \
+        .sequence_length     = ARRAY_SIZE(app_mpu_instances[inst].magn_init_sequence),        \
+    },                                                                                        \
+    .magn_init_sequence = {                                                                   \
+        REGSEQ_WRITE_DELAY(MPU_AK89XX_REG_CNTL, POWER_DOWN_MODE, MPU_AK89XX_MODE_SWITCH_US),  \
+        REGSEQ_WRITE_DELAY(MPU_AK89XX_REG_CNTL, APP_MPU_MAGN_CNTL(inst),                      \
+                           MPU_AK89XX_MODE_SWITCH_US),                                        \
+    },                                                                                        \
+    .magn_cntl = APP_MPU_MAGN_CNTL(inst),
+#else
+#define APP_MPU_MAGN_INIT(inst)
+#endif
+
+// One instance per devicetree node, the gyroscope rate and divider start at their reset values: DLPF disabled, divider 0
+#define APP_MPU_INIT(inst)                                                                    \
+    [inst] = {                                                                                \
+        .p_name = DT_NODE_FULL_NAME(DT_DRV_INST(inst)),                                       \
+        .drv    = {                                                                           \
+            .p_bus        = NRF_DRV_MPU_BUS_DEFAULT,                                          \
+            .address      = DT_INST_PROP(inst, twi_address),                                  \
+            .magn_address = DT_INST_PROP_OR(inst, magn_address, 0),                           \
+        },                                                                                    \
+        .regseq_bus = {                                                                       \
+            .write     = mpu_regseq_write,                                                    \
+            .read      = mpu_regseq_read,                                                     \
+            .p_context = &app_mpu_instances[inst],                                            \
+        },                                                                                    \
+        .regseq_device = {                                                                    \
+            .p_name              = DT_NODE_FULL_NAME(DT_DRV_INST(inst)),                      \
+            .p_bus               = &app_mpu_instances[inst].regseq_bus,                       \
+            .id_reg              = MPU_REG_WHO_AM_I,                                          \
+            .p_ids               = mpu_ids,                                                   \
+            .id_count            = ARRAY_SIZE(mpu_ids),                                       \
+            .p_pre_bus           = NULL,                                                      \
+            .p_pre_sequence      = NULL,                                                      \
+            .pre_sequence_length = 0,                                                         \
+            .p_sequence          = mpu_init_sequence,                                         \
+            .sequence_length     = ARRAY_SIZE(mpu_init_sequence),                             \
+        },                                                                                    \
+        .gyro_rate_mhz = MPU_GYRO_RATE_MHZ,                                                   \
+        APP_MPU_MAGN_INIT(inst)                                                               \
+    },
+
+app_mpu_t app_mpu_instances[APP_MPU_COUNT] = {
+    DT_INST_FOREACH_STATUS_OKAY(APP_MPU_INIT)
+};
+
+int app_mpu_config(app_mpu_t *p_mpu, app_mpu_config_t *config)
+{
+    // Registers 25 to 28 are consecutive and go out as a single burst
+    const regseq_entry_t config_sequence[] = {
+        REGSEQ_WRITE_VERIFY(MPU_REG_SMPLRT_DIV, config->smplrt_div),
+        REGSEQ_WRITE_VERIFY(MPU_REG_CONFIG, (uint8_t)((config->sync_dlpf_gonfig.dlpf_cfg & 0x07) |
+                                                      ((config->sync_dlpf_gonfig.ext_sync_set & 0x07) << 3) |
+                                                      ((config->sync_dlpf_gonfig.fifo_mode & 0x01) << 6))),
+        REGSEQ_WRITE_VERIFY(MPU_REG_GYRO_CONFIG, (uint8_t)((config->gyro_config.fs_sel & 0x03) << 3)),
+        REGSEQ_WRITE_VERIFY(MPU_REG_ACCEL_CONFIG, (uint8_t)((config->accel_config.accel_hpf & 0x07) |
+                                                            ((config->accel_config.afs_sel & 0x03) << 3) |
+                                                            ((config->accel_config.za_st & 0x01) << 5) |
+                                                            ((config->accel_config.ya_st & 0x01) << 6) |
+                                                            ((config->accel_config.xa_st & 0x01) << 7))),
+    };
+
+    int err_code = regseq_run(&p_mpu->regseq_bus, config_sequence, ARRAY_SIZE(config_sequence), NULL);
+    if (err_code != 0)
+        return err_code;
+
+    // DLPF_CFG 0 and 7 leave the low pass filter disabled
+    p_mpu->gyro_rate_mhz = ((config->sync_dlpf_gonfig.dlpf_cfg == 0) || (config->sync_dlpf_gonfig.dlpf_cfg == 7)) ? MPU_GYRO_RATE_MHZ : MPU_GYRO_RATE_DLPF_MHZ;
+    p_mpu->smplrt_div    = config->smplrt_div;
+    return 0;
 }
 
-int app_mpu_int_cfg_pin(app_mpu_int_pin_cfg_t *cfg)
+int app_mpu_int_cfg_pin(app_mpu_t *p_mpu, app_mpu_int_pin_cfg_t *cfg)
 {
     uint8_t *data;
     data = (uint8_t *)cfg;
-    return nrf_drv_mpu_write_single_register(MPU_REG_INT_PIN_CFG, *data);
+    return nrf_drv_mpu_write_single_register(&p_mpu->drv, MPU_REG_INT_PIN_CFG, *data);
 }
 
-int app_mpu_int_enable(app_mpu_int_enable_t *cfg)
+int app_mpu_int_enable(app_mpu_t *p_mpu, app_mpu_int_enable_t *cfg)
 {
     uint8_t *data;
     data = (uint8_t *)cfg;
-    return nrf_drv_mpu_write_single_register(MPU_REG_INT_ENABLE, *data);
+    return nrf_drv_mpu_write_single_register(&p_mpu->drv, MPU_REG_INT_ENABLE, *data);
 }
 
-int app_mpu_init(void)
+int app_mpu_init(app_mpu_t *p_mpu)
 {
     int err_code;
 
     // Initate TWI or SPI driver dependent on what is defined from the project
-    err_code = nrf_drv_mpu_init();
+    err_code = nrf_drv_mpu_init(&p_mpu->drv);
     if (err_code != 0)
         return err_code;
 
-    uint8_t reset_value = 7; // Resets gyro, accelerometer and temperature sensor signal paths.
-    err_code = nrf_drv_mpu_write_single_register(MPU_REG_SIGNAL_PATH_RESET, reset_value);
+    err_code = regseq_probe(&p_mpu->regseq_device, NULL);
     if (err_code != 0)
         return err_code;
 
-    // Chose  PLL with X axis gyroscope reference as clock source
-    err_code = nrf_drv_mpu_write_single_register(MPU_REG_PWR_MGMT_1, 1);
+    err_code = regseq_run(&p_mpu->regseq_bus, mpu_init_sequence, ARRAY_SIZE(mpu_init_sequence), &p_mpu->init_report);
     if (err_code != 0)
         return err_code;
 
+    LOG_INF("%s init took %u us in %u transactions", p_mpu->p_name, p_mpu->init_report.duration_us, p_mpu->init_report.transactions);
+
     return 0;
 }
 
-int app_mpu_read_accel(accel_values_t *accel_values)
+int app_mpu_init_report_get(app_mpu_t *p_mpu, regseq_report_t *p_report)
+{
+    if (p_report == NULL)
+        return -EINVAL;
+
+    *p_report = p_mpu->init_report;
+    return 0;
+}
+
+int app_mpu_read_accel(app_mpu_t *p_mpu, accel_values_t *accel_values)
 {
     int err_code;
     uint8_t raw_values[6];
-    err_code = nrf_drv_mpu_read_registers(MPU_REG_ACCEL_XOUT_H, raw_values, 6);
+    err_code = nrf_drv_mpu_read_registers(&p_mpu->drv, MPU_REG_ACCEL_XOUT_H, raw_values, 6);
     if (err_code != 0)
         return err_code;
 
-    // Reorganize read sensor values and put them into value struct
-    uint8_t *data;
-    data = (uint8_t *)accel_values;
-    for (uint8_t i = 0; i < 6; i++)
+    // Output registers are big endian X, Y, Z
+    accel_values->x = (int16_t)sys_get_be16(&raw_values[0]);
+    accel_values->y = (int16_t)sys_get_be16(&raw_values[2]);
+    accel_values->z = (int16_t)sys_get_be16(&raw_values[4]);
+    return 0;
+}
+
+int app_mpu_read_multi(app_mpu_t * const *pp_mpus, uint8_t count, accel_values_t *accel_values,
+                       gyro_values_t *gyro_values, int *p_errs)
+{
+    int err_code;
+    const nrf_drv_mpu_t *drvs[NRF_DRV_MPU_MAX_BATCH];
+    // ACCEL_XOUT_H..GYRO_ZOUT_L, the gyroscope registers follow the two of the temperature
+    uint8_t raw_values[NRF_DRV_MPU_MAX_BATCH][NRF_DRV_MPU_SAMPLE_BYTES];
+    uint32_t length = (gyro_values != NULL) ? NRF_DRV_MPU_SAMPLE_BYTES : 6;
+
+    if ((pp_mpus == NULL) || (accel_values == NULL) || (p_errs == NULL) || (count == 0) ||
+        (count > NRF_DRV_MPU_MAX_BATCH))
+        return -EINVAL;
+
+    for (uint8_t i = 0; i < count; i++)
+        drvs[i] = &pp_mpus[i]->drv;
+
+    err_code = nrf_drv_mpu_read_registers_multi(drvs, count, MPU_REG_ACCEL_XOUT_H, &raw_values[0][0], length, p_errs);
+
+    // length bytes per MPU, back to back, the slot of an MPU that failed keeps its last sample
+    for (uint8_t i = 0; i < count; i++)
     {
-        *data = raw_values[5 - i];
-        data++;
+        const uint8_t *raw = &raw_values[0][0] + (i * length);
+        if (p_errs[i] != 0)
+            continue;
+
+        accel_values[i].x = (int16_t)sys_get_be16(&raw[0]);
+        accel_values[i].y = (int16_t)sys_get_be16(&raw[2]);
+        accel_values[i].z = (int16_t)sys_get_be16(&raw[4]);
+        if (gyro_values != NULL)
+        {
+            gyro_values[i].x = (int16_t)sys_get_be16(&raw[8]);
+            gyro_values[i].y = (int16_t)sys_get_be16(&raw[10]);
+            gyro_values[i].z = (int16_t)sys_get_be16(&raw[12]);
+        }
     }
-    return 0;
+
+    return err_code;
 }
 
-int app_mpu_read_gyro(gyro_values_t *gyro_values)
+int app_mpu_read_gyro(app_mpu_t *p_mpu, gyro_values_t *gyro_values)
 {
     int err_code;
     uint8_t raw_values[6];
-    err_code = nrf_drv_mpu_read_registers(MPU_REG_GYRO_XOUT_H, raw_values, 6);
+    err_code = nrf_drv_mpu_read_registers(&p_mpu->drv, MPU_REG_GYRO_XOUT_H, raw_values, 6);
     if (err_code != 0)
         return err_code;
 
-    // Reorganize read sensor values and put them into value struct
-    uint8_t *data;
-    data = (uint8_t *)gyro_values;
-    for (uint8_t i = 0; i < 6; i++)
-    {
-        *data = raw_values[5 - i];
-        data++;
-    }
+    // Output registers are big endian X, Y, Z
+    gyro_values->x = (int16_t)sys_get_be16(&raw_values[0]);
+    gyro_values->y = (int16_t)sys_get_be16(&raw_values[2]);
+    gyro_values->z = (int16_t)sys_get_be16(&raw_values[4]);
 
     return 0;
 }
 
-int app_mpu_read_temp(temp_value_t *temperature)
+int app_mpu_read_temp(app_mpu_t *p_mpu, temp_value_t *temperature)
 {
     int err_code;
     uint8_t raw_values[2];
-    err_code = nrf_drv_mpu_read_registers(MPU_REG_TEMP_OUT_H, raw_values, 2);
+    err_code = nrf_drv_mpu_read_registers(&p_mpu->drv, MPU_REG_TEMP_OUT_H, raw_values, 2);
     if (err_code != 0)
         return err_code;
 
@@ -101,73 +289,486 @@ int app_mpu_read_temp(temp_value_t *temperature)
     return 0;
 }
 
-int app_mpu_read_int_source(uint8_t *int_source)
+int app_mpu_read_int_source(app_mpu_t *p_mpu, uint8_t *int_source)
+{
+    return nrf_drv_mpu_read_registers(&p_mpu->drv, MPU_REG_INT_STATUS, int_source, 1);
+}
+
+int app_mpu_read_motion_status(app_mpu_t *p_mpu, uint8_t *status)
+{
+    return nrf_drv_mpu_read_registers(&p_mpu->drv, MPU_REG_MOT_DETECT_STATUS, status, 1);
+}
+
+int app_mpu_int_cfg_pin_get(app_mpu_t *p_mpu, app_mpu_int_pin_cfg_t *cfg)
+{
+    return nrf_drv_mpu_read_registers(&p_mpu->drv, MPU_REG_INT_PIN_CFG, (uint8_t *)cfg, 1);
+}
+
+// The free fall, motion and zero motion registers of the MPU9150 are other registers on the MPU9250 and MPU9255
+static int mpu_mpu9150_check(app_mpu_t *p_mpu)
+{
+    int err_code;
+    uint8_t id;
+
+    err_code = nrf_drv_mpu_read_registers(&p_mpu->drv, MPU_REG_WHO_AM_I, &id, 1);
+    if (err_code != 0)
+        return err_code;
+
+    return (id == MPU_WHO_AM_I_MPU9150) ? 0 : -ENOTSUP;
+}
+
+int app_mpu_config_ff_detection(app_mpu_t *p_mpu, uint16_t mg, uint8_t duration)
+{
+    int err_code;
+    uint16_t threshold = mg / MPU_MG_PR_LSB_FF_THR;
+    if (threshold > 255)
+        return MPU_BAD_PARAMETER;
+
+    err_code = mpu_mpu9150_check(p_mpu);
+    if (err_code != 0)
+        return err_code;
+
+    err_code = nrf_drv_mpu_write_single_register(&p_mpu->drv, MPU_REG_FF_THR, threshold);
+    if (err_code != 0)
+        return err_code;
+
+    return nrf_drv_mpu_write_single_register(&p_mpu->drv, MPU_REG_FF_DUR, duration);
+}
+
+int app_mpu_sample_rate_div_set(app_mpu_t *p_mpu, uint8_t smplrt_div)
+{
+    int err_code = nrf_drv_mpu_write_single_register(&p_mpu->drv, MPU_REG_SMPLRT_DIV, smplrt_div);
+    if (err_code != 0)
+        return err_code;
+
+    p_mpu->smplrt_div = smplrt_div;
+    return 0;
+}
+
+uint32_t app_mpu_sample_rate_mhz_get(app_mpu_t *p_mpu)
 {
-    return nrf_drv_mpu_read_registers(MPU_REG_INT_STATUS, int_source, 1);
+    return p_mpu->gyro_rate_mhz / (1U + p_mpu->smplrt_div);
 }
 
-int app_mpu_config_ff_detection(uint16_t mg, uint8_t duration)
+int app_mpu_config_motion_detection(app_mpu_t *p_mpu, uint16_t mg, uint8_t duration)
 {
     int err_code;
-    uint8_t threshold = (uint8_t)(mg / MPU_MG_PR_LSB_FF_THR);
+    uint16_t threshold = mg / MPU_MG_PR_LSB_MOT_THR;
     if (threshold > 255)
         return MPU_BAD_PARAMETER;
 
-    err_code = nrf_drv_mpu_write_single_register(MPU_REG_FF_THR, threshold);
+    err_code = mpu_mpu9150_check(p_mpu);
+    if (err_code != 0)
+        return err_code;
+
+    // MOT_THR and MOT_DUR are consecutive
+    uint8_t data[2] = { (uint8_t)threshold, duration };
+    err_code = nrf_drv_mpu_write_registers(&p_mpu->drv, MPU_REG_MOT_THR, data, sizeof(data));
+    return err_code;
+}
+
+int app_mpu_config_zero_motion_detection(app_mpu_t *p_mpu, uint16_t mg, uint16_t duration)
+{
+    int err_code;
+    uint16_t threshold = mg / MPU_MG_PR_LSB_MOT_THR;
+    uint16_t counts = duration / MPU_MS_PR_LSB_ZRMOT;
+    if ((threshold > 255) || (counts > 255))
+        return MPU_BAD_PARAMETER;
+
+    err_code = mpu_mpu9150_check(p_mpu);
+    if (err_code != 0)
+        return err_code;
+
+    // ZRMOT_THR and ZRMOT_DUR are consecutive
+    uint8_t data[2] = { (uint8_t)threshold, (uint8_t)counts };
+    return nrf_drv_mpu_write_registers(&p_mpu->drv, MPU_REG_ZRMOT_THR, data, sizeof(data));
+}
+
+int app_mpu_config_wom_detection(app_mpu_t *p_mpu, uint16_t mg)
+{
+    int err_code;
+    uint16_t threshold = mg / MPU_MG_PR_LSB_WOM_THR;
+    if (threshold > 255)
+        return MPU_BAD_PARAMETER;
+
+    err_code = nrf_drv_mpu_write_single_register(&p_mpu->drv, MPU_REG_WOM_THR, (uint8_t)threshold);
+    if (err_code != 0)
+        return err_code;
+
+    return nrf_drv_mpu_write_single_register(&p_mpu->drv, MPU_REG_ACCEL_INTEL_CTRL, (threshold != 0) ? MPU_ACCEL_INTEL_EN_CMP : 0);
+}
+
+// Enters or leaves the cycle mode, pwr_mgmt_2 is written to PWR_MGMT_2 while in it
+static int mpu_cycle_mode_set(app_mpu_t *p_mpu, bool enable, uint8_t pwr_mgmt_2)
+{
+    int err_code;
+    uint8_t pwr_mgmt[2];
+
+    // PWR_MGMT_1 and PWR_MGMT_2 are consecutive
+    err_code = nrf_drv_mpu_read_registers(&p_mpu->drv, MPU_REG_PWR_MGMT_1, pwr_mgmt, sizeof(pwr_mgmt));
+    if (err_code != 0)
+        return err_code;
+
+    if (enable)
+    {
+        pwr_mgmt[0] = (pwr_mgmt[0] & ~MPU_PWR_MGMT_1_SLEEP) | MPU_PWR_MGMT_1_CYCLE | MPU_PWR_MGMT_1_TEMP_DIS;
+        pwr_mgmt[1] = pwr_mgmt_2;
+    }
+    else
+    {
+        pwr_mgmt[0] &= ~(MPU_PWR_MGMT_1_CYCLE | MPU_PWR_MGMT_1_TEMP_DIS);
+        pwr_mgmt[1] = 0;
+    }
+
+    return nrf_drv_mpu_write_registers(&p_mpu->drv, MPU_REG_PWR_MGMT_1, pwr_mgmt, sizeof(pwr_mgmt));
+}
+
+// Sets or clears interrupt sources in INT_ENABLE, the other ones are kept
+static int mpu_int_sources_set(app_mpu_t *p_mpu, uint8_t sources, bool enable)
+{
+    int err_code;
+    uint8_t int_enable;
+
+    err_code = nrf_drv_mpu_read_registers(&p_mpu->drv, MPU_REG_INT_ENABLE, &int_enable, 1);
+    if (err_code != 0)
+        return err_code;
+
+    int_enable &= ~sources;
+    int_enable |= enable ? sources : 0;
+    return nrf_drv_mpu_write_single_register(&p_mpu->drv, MPU_REG_INT_ENABLE, int_enable);
+}
+
+int app_mpu_low_power_accel_mode(app_mpu_t *p_mpu, bool enable, enum lp_wake_ctrl wake_rate)
+{
+    // LP_WAKE_CTRL is the top of PWR_MGMT_2
+    return mpu_cycle_mode_set(p_mpu, enable, (uint8_t)(((uint8_t)wake_rate << 6) | MPU_PWR_MGMT_2_STBY_G));
+}
+
+int app_mpu_low_power_wom_mode(app_mpu_t *p_mpu, bool enable, enum lp_accel_odr odr)
+{
+    int err_code;
+
+    if (enable)
+    {
+        err_code = nrf_drv_mpu_write_single_register(&p_mpu->drv, MPU_REG_LP_ACCEL_ODR, (uint8_t)odr);
+        if (err_code != 0)
+            return err_code;
+    }
+
+    err_code = mpu_int_sources_set(p_mpu, MPU_INT_ENABLE_WOM, enable);
+    if (err_code != 0)
+        return err_code;
+
+    // The wake-up rate is in LP_ACCEL_ODR, PWR_MGMT_2 only puts the gyroscopes in standby
+    return mpu_cycle_mode_set(p_mpu, enable, MPU_PWR_MGMT_2_STBY_G);
+}
+
+#if defined(CONFIG_APP_MPU9250_FIFO)
+int app_mpu_fifo_accel_enable(app_mpu_t *p_mpu, bool enable)
+{
+    int err_code;
+    uint8_t user_ctrl;
+
+    err_code = nrf_drv_mpu_write_single_register(&p_mpu->drv, MPU_REG_FIFO_EN, enable ? MPU_FIFO_EN_ACCEL : 0);
+    if (err_code != 0)
+        return err_code;
+
+    // Keep the I2C master bits, they may be in use for the magnetometer
+    err_code = nrf_drv_mpu_read_registers(&p_mpu->drv, MPU_REG_USER_CTRL, &user_ctrl, 1);
+    if (err_code != 0)
+        return err_code;
+
+    user_ctrl &= ~MPU_USER_CTRL_FIFO_EN;
+    user_ctrl |= MPU_USER_CTRL_FIFO_RESET | (enable ? MPU_USER_CTRL_FIFO_EN : 0);
+    return nrf_drv_mpu_write_single_register(&p_mpu->drv, MPU_REG_USER_CTRL, user_ctrl);
+}
+
+// Number of whole accelerometer frames in the FIFO, at most max_frames
+static int mpu_fifo_accel_count(app_mpu_t *p_mpu, uint16_t max_frames, uint16_t *count)
+{
+    int err_code;
+    uint8_t raw_values[2];
+
+    err_code = nrf_drv_mpu_read_registers(&p_mpu->drv, MPU_REG_FIFO_COUNTH, raw_values, 2);
+    if (err_code != 0)
+        return err_code;
+
+    *count = sys_get_be16(raw_values);
+
+    // A partial frame means the FIFO overflowed and lost its alignment
+    if ((*count % MPU_FIFO_FRAME_BYTES) != 0)
+    {
+        *count = 0;
+        err_code = app_mpu_fifo_accel_enable(p_mpu, true);
+        return (err_code != 0) ? err_code : -EOVERFLOW;
+    }
+
+    *count = MIN(*count / MPU_FIFO_FRAME_BYTES, max_frames);
+    return 0;
+}
+
+int app_mpu_fifo_read_accel(app_mpu_t *p_mpu, accel_values_t *accel_values, uint16_t max_frames, uint16_t *frames)
+{
+    int err_code;
+    uint8_t raw_values[MPU_FIFO_READ_FRAMES * MPU_FIFO_FRAME_BYTES];
+    uint16_t count;
+
+    *frames = 0;
+
+    err_code = mpu_fifo_accel_count(p_mpu, max_frames, &count);
+    if (err_code != 0)
+        return err_code;
+
+    while (*frames < count)
+    {
+        uint16_t chunk = MIN(count - *frames, MPU_FIFO_READ_FRAMES);
+        err_code = nrf_drv_mpu_read_registers(&p_mpu->drv, MPU_REG_FIFO_R_W, raw_values, chunk * MPU_FIFO_FRAME_BYTES);
+        if (err_code != 0)
+            return err_code;
+
+        // Frames are big endian X, Y, Z like the output registers
+        for (uint16_t i = 0; i < chunk; i++)
+        {
+            uint8_t *raw = &raw_values[i * MPU_FIFO_FRAME_BYTES];
+            accel_values[*frames].x = (int16_t)sys_get_be16(&raw[0]);
+            accel_values[*frames].y = (int16_t)sys_get_be16(&raw[2]);
+            accel_values[*frames].z = (int16_t)sys_get_be16(&raw[4]);
+            (*frames)++;
+        }
+    }
+
+    return 0;
+}
+
+int app_mpu_fifo_read_accel_soa(app_mpu_t *p_mpu, const frame_soa_t *p_out, uint16_t max_frames, uint16_t *frames)
+{
+    int err_code;
+    uint8_t raw_values[MPU_FIFO_READ_FRAMES * MPU_FIFO_FRAME_BYTES];
+    uint16_t count;
+
+    *frames = 0;
+
+    err_code = mpu_fifo_accel_count(p_mpu, max_frames, &count);
+    if (err_code != 0)
+        return err_code;
+
+    while (*frames < count)
+    {
+        uint16_t chunk = MIN(count - *frames, MPU_FIFO_READ_FRAMES);
+        err_code = nrf_drv_mpu_read_registers(&p_mpu->drv, MPU_REG_FIFO_R_W, raw_values, chunk * MPU_FIFO_FRAME_BYTES);
+        if (err_code != 0)
+            return err_code;
+
+        // Each chunk lands right after the previous one in every axis array
+        const frame_soa_t out = {
+            .p_accel = { &p_out->p_accel[0][*frames], &p_out->p_accel[1][*frames], &p_out->p_accel[2][*frames] },
+        };
+        frame_decode_accel(raw_values, chunk, &out);
+        *frames += chunk;
+    }
+
+    return 0;
+}
+
+#endif
+
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+int app_mpu_stream_start(app_mpu_t *p_mpu, uint32_t int_pin, bool with_gyro, uint16_t samples_per_wake,
+                         uint8_t *p_buffer, nrf_drv_mpu_stream_handler_t handler, void *p_context)
+{
+    int err_code;
+    uint8_t int_pin_cfg;
+    const nrf_drv_mpu_stream_t stream = {
+        .reg              = MPU_REG_ACCEL_XOUT_H,
+        .length           = with_gyro ? APP_MPU_STREAM_GYRO_BYTES : APP_MPU_STREAM_ACCEL_BYTES,
+        .samples_per_wake = samples_per_wake,
+        .p_buffer         = p_buffer,
+        .trigger_pin      = int_pin,
+        .handler          = handler,
+        .p_context        = p_context,
+    };
+
+    if ((p_mpu == NULL) || (p_buffer == NULL) || (handler == NULL))
+        return -EINVAL;
+
+    // A rising edge per sample: active high pulses, cleared by the data read itself
+    err_code = nrf_drv_mpu_read_registers(&p_mpu->drv, MPU_REG_INT_PIN_CFG, &int_pin_cfg, 1);
+    if (err_code != 0)
+        return err_code;
+
+    int_pin_cfg &= ~(MPU_INT_PIN_CFG_INT_LEVEL | MPU_INT_PIN_CFG_LATCH_INT);
+    int_pin_cfg |= MPU_INT_PIN_CFG_RD_CLEAR;
+    err_code = nrf_drv_mpu_write_single_register(&p_mpu->drv, MPU_REG_INT_PIN_CFG, int_pin_cfg);
+    if (err_code != 0)
+        return err_code;
+
+    // Arm the reads before the first pulse
+    err_code = nrf_drv_mpu_stream_start(&p_mpu->drv, &stream);
+    if (err_code != 0)
+        return err_code;
+
+    err_code = mpu_int_sources_set(p_mpu, MPU_INT_ENABLE_DATA_RDY, true);
+    if (err_code != 0)
+        (void)nrf_drv_mpu_stream_stop(&p_mpu->drv);
+
+    return err_code;
+}
+
+int app_mpu_stream_stop(app_mpu_t *p_mpu)
+{
+    int err_code;
+
+    if (p_mpu == NULL)
+        return -EINVAL;
+
+    err_code = nrf_drv_mpu_stream_stop(&p_mpu->drv);
     if (err_code != 0)
         return err_code;
 
-    return nrf_drv_mpu_write_single_register(MPU_REG_FF_DUR, duration);
+    return mpu_int_sources_set(p_mpu, MPU_INT_ENABLE_DATA_RDY, false);
+}
+
+void app_mpu_stream_decode(const uint8_t *p_sample, accel_values_t *accel_values, gyro_values_t *gyro_values)
+{
+    // Output registers are big endian X, Y, Z, the gyroscope follows the two temperature bytes
+    accel_values->x = (int16_t)sys_get_be16(&p_sample[0]);
+    accel_values->y = (int16_t)sys_get_be16(&p_sample[2]);
+    accel_values->z = (int16_t)sys_get_be16(&p_sample[4]);
+
+    if (gyro_values == NULL)
+        return;
+
+    gyro_values->x = (int16_t)sys_get_be16(&p_sample[8]);
+    gyro_values->y = (int16_t)sys_get_be16(&p_sample[10]);
+    gyro_values->z = (int16_t)sys_get_be16(&p_sample[12]);
+}
+#endif
+
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
+static int mpu_magn_mode_set(app_mpu_t *p_mpu, uint8_t cntl)
+{
+    int err_code = nrf_drv_mpu_write_magnetometer_register(&p_mpu->drv, MPU_AK89XX_REG_CNTL, cntl);
+    k_usleep(MPU_AK89XX_MODE_SWITCH_US);
+    return err_code;
+}
+
+// Sets the CNTL the magnetometer runs with, the bring-up sequence ends with it too
+static void mpu_magn_cntl_set(app_mpu_t *p_mpu, uint8_t cntl)
+{
+    p_mpu->magn_cntl = cntl;
+    p_mpu->magn_init_sequence[ARRAY_SIZE(p_mpu->magn_init_sequence) - 1].value = cntl;
 }
 
-int app_mpu_magnetometer_init(app_mpu_magn_config_t *p_magnetometer_conf)
+// Reads ASAX..ASAZ out of the fuse ROM, which is only reachable from power down, then restarts in the CNTL the magnetometer runs with
+static int mpu_magn_asa_load(app_mpu_t *p_mpu)
+{
+    int err_code;
+    uint8_t asa[3];
+
+    // Only a sequence that got the magnetometer back into its mode leaves the adjustment cached
+    p_mpu->magn_asa_loaded = false;
+    err_code = mpu_magn_mode_set(p_mpu, POWER_DOWN_MODE);
+    if (err_code != 0)
+        return err_code;
+    err_code = mpu_magn_mode_set(p_mpu, FUSE_ROM_ACCESS_MODE);
+    if (err_code != 0)
+        return err_code;
+    err_code = nrf_drv_mpu_read_magnetometer_registers(&p_mpu->drv, MPU_AK89XX_REG_ASAX, asa, sizeof(asa));
+    if (err_code != 0)
+        return err_code;
+    err_code = mpu_magn_mode_set(p_mpu, POWER_DOWN_MODE);
+    if (err_code != 0)
+        return err_code;
+    err_code = mpu_magn_mode_set(p_mpu, p_mpu->magn_cntl);
+    if (err_code != 0)
+        return err_code;
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        // Hadj = H * ((ASA - 128) / 256 + 1) = H * (ASA + 128) / 256
+        p_mpu->magn_asa_scale[i] = ((int32_t)asa[i] + 128) << (MPU_AK89XX_ASA_SHIFT - 8);
+    }
+    p_mpu->magn_asa_loaded = true;
+
+    return 0;
+}
+
+static int16_t mpu_magn_adjust(uint8_t low, uint8_t high, int32_t scale)
+{
+    int32_t value = ((int32_t)(int16_t)((uint16_t)high << 8 | low) * scale) >> MPU_AK89XX_ASA_SHIFT;
+    return (int16_t)CLAMP(value, INT16_MIN, INT16_MAX);
+}
+
+int app_mpu_magnetometer_init(app_mpu_t *p_mpu, app_mpu_magn_config_t *p_magnetometer_conf)
 {
     int err_code;
 
     // Read out MPU configuration register
     app_mpu_int_pin_cfg_t bypass_config;
-    err_code = nrf_drv_mpu_read_registers(MPU_REG_INT_PIN_CFG, (uint8_t *)&bypass_config, 1);
+    err_code = nrf_drv_mpu_read_registers(&p_mpu->drv, MPU_REG_INT_PIN_CFG, (uint8_t *)&bypass_config, 1);
+    if (err_code != 0)
+        return err_code;
 
     // Set I2C bypass enable bit to be able to communicate with magnetometer via I2C
     bypass_config.i2c_bypass_en = 1;
     // Write config value back to MPU config register
-    err_code = app_mpu_int_cfg_pin(&bypass_config);
+    err_code = app_mpu_int_cfg_pin(p_mpu, &bypass_config);
     if (err_code != 0)
         return err_code;
 
-    // Write magnetometer config data
-    uint8_t *data;
-    data = (uint8_t *)p_magnetometer_conf;
-    return nrf_drv_mpu_write_magnetometer_register(MPU_AK89XX_REG_CNTL, *data);
+    // Write magnetometer config data, the sensitivity adjustment is read on the way
+    mpu_magn_cntl_set(p_mpu, (p_magnetometer_conf->mode & MPU_AK89XX_CNTL_MODE) |
+                             ((p_magnetometer_conf->resolution == MAGN_RESOLUTION_16_BIT) ? MPU_AK89XX_CNTL_BIT : 0));
+    return mpu_magn_asa_load(p_mpu);
 }
 
-int app_mpu_read_magnetometer(magn_values_t *p_magnetometer_values, app_mpu_magn_read_status_t *p_read_status)
+int app_mpu_read_magnetometer(app_mpu_t *p_mpu, magn_values_t *p_magnetometer_values, app_mpu_magn_read_status_t *p_read_status)
 {
     int err_code;
-    err_code = nrf_drv_mpu_read_magnetometer_registers(MPU_AK89XX_REG_HXL, (uint8_t *)p_magnetometer_values, 6);
-    if (err_code != 0)
-        return err_code;
+    uint8_t raw[MPU_AK89XX_READ_BYTES];
+
+    if (!p_mpu->magn_asa_loaded)
+    {
+        err_code = mpu_magn_asa_load(p_mpu);
+        if (err_code != 0)
+            return err_code;
+    }
 
     /* Quote from datasheet: MPU_AK89XX_REG_ST2 register has a role as data reading end register, also. When any of measurement data register is read
     in continuous measurement mode or external trigger measurement mode, it means data reading start and
     taken as data reading until ST2 register is read. Therefore, when any of measurement data is read, be
     sure to read ST2 register at the end. */
-    if (p_read_status == NULL)
-    {
-        // If p_read_status equals NULL perform dummy read
-        uint8_t status_2_reg;
-        err_code = nrf_drv_mpu_read_magnetometer_registers(MPU_AK89XX_REG_ST2, &status_2_reg, 1);
-    }
-    else
+    // ST1, HXL..HZH and ST2 are adjacent, one burst reads them all and ends the read cycle
+    err_code = nrf_drv_mpu_read_magnetometer_registers(&p_mpu->drv, MPU_AK89XX_REG_ST1, raw, sizeof(raw));
+    if (err_code != 0)
+        return err_code;
+
+    uint8_t st1 = raw[0];
+    uint8_t st2 = raw[MPU_AK89XX_READ_BYTES - 1];
+
+    if (p_read_status != NULL)
     {
-        // If p_read_status NOT equals NULL read and return value of MPU_AK89XX_REG_ST2
-        err_code = nrf_drv_mpu_read_magnetometer_registers(MPU_AK89XX_REG_ST2, (uint8_t *)p_read_status, 1);
+        p_read_status->data_overrun = (st1 & MPU_AK89XX_ST1_DOR) ? 1 : 0;
+        p_read_status->overflow     = (st2 & MPU_AK89XX_ST2_HOFL) ? 1 : 0;
+        p_read_status->res_mirror   = (st2 & MPU_AK89XX_ST2_BITM) ? 1 : 0;
     }
-    return err_code;
+
+    // The data registers still hold the previous measurement
+    if ((st1 & MPU_AK89XX_ST1_DRDY) == 0)
+        return -ENODATA;
+    if (st2 & MPU_AK89XX_ST2_HOFL)
+        return -ERANGE;
+
+    p_magnetometer_values->x = mpu_magn_adjust(raw[1], raw[2], p_mpu->magn_asa_scale[0]);
+    p_magnetometer_values->y = mpu_magn_adjust(raw[3], raw[4], p_mpu->magn_asa_scale[1]);
+    p_magnetometer_values->z = mpu_magn_adjust(raw[5], raw[6], p_mpu->magn_asa_scale[2]);
+
+    return 0;
 }
 
 // Test function for development purposes
-int app_mpu_read_magnetometer_test(uint8_t reg, uint8_t *registers, uint8_t len)
+int app_mpu_read_magnetometer_test(app_mpu_t *p_mpu, uint8_t reg, uint8_t *registers, uint8_t len)
 {
-    return nrf_drv_mpu_read_magnetometer_registers(reg, registers, len);
+    return nrf_drv_mpu_read_magnetometer_registers(&p_mpu->drv, reg, registers, len);
 }
+#endif
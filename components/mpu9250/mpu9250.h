@@ -4,54 +4,79 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <zephyr/devicetree.h>
 
 #include "hal/mpu9150_register_map.h"
+#include "hal/nrf_drv_mpu.h"
+#include "regseq.h"
+#include "sensor_types.h"
+#include "frame_decode.h"
 
 #define MPU_MG_PR_LSB_FF_THR  32
+#define MPU_MG_PR_LSB_MOT_THR 2
+#define MPU_MS_PR_LSB_ZRMOT   64
+#define MPU_MG_PR_LSB_WOM_THR 4
 #define MPU_MPU_BASE_NUM      0x4000
 #define MPU_BAD_PARAMETER     (MPU_MPU_BASE_NUM + 0) // An invalid paramater has been passed to function.
 
-/**@brief Enum defining Accelerometer's Full Scale range posibillities in Gs. */
-enum accel_range
-{
-    AFS_2G = 0, // 2 G
-    AFS_4G,     // 4 G
-    AFS_8G,     // 8 G
-    AFS_16G     // 16 G
-};
-
-/**@brief Enum defining Gyroscopes? Full Scale range posibillities in Degrees Pr Second. */
-enum gyro_range
-{
-    GFS_250DPS = 0, // 250 deg/s
-    GFS_500DPS,     // 500 deg/s
-    GFS_1000DPS,    // 1000 deg/s
-    GFS_2000DPS     // 2000 deg/s
-};
-
-/**@brief Structure to hold acceleromter values.
- * Sequence of z, y, and x is important to correspond with
- * the sequence of which z, y, and x data are read from the sensor.
- * All values are unsigned 16 bit integers
+#define MPU_WHO_AM_I_MPU9250        0x71   // WHO_AM_I of the MPU9250
+#define MPU_WHO_AM_I_MPU9255        0x73   // WHO_AM_I of the MPU9255
+#define MPU_WHO_AM_I_MPU9150        0x68   // WHO_AM_I of the MPU9150 and MPU60x0
+#define MPU_AK89XX_WIA_VALUE        0x48   // Device ID of the AK8963 and AK8975C
+
+#define MPU_SIGNAL_PATH_RESET_US    1000   // Settling time after resetting the signal paths
+#define MPU_PLL_SETTLE_US           10000  // Settling time after switching the clock source to the gyro PLL
+#define MPU_AK89XX_MODE_SWITCH_US   100    // Time the magnetometer needs between two mode changes
+#define MPU_AK89XX_READ_BYTES       8      // Burst from ST1 through ST2
+#define MPU_AK89XX_ASA_SHIFT        14     // Fixed point shift of the sensitivity adjustment scale
+#define MPU_FIFO_READ_FRAMES        8      // Frames moved per FIFO burst read
+#define MPU_FIFO_FRAME_BYTES        6      // Bytes of an accelerometer FIFO frame
+#define MPU_FIFO_DEPTH_BYTES        512    // FIFO size of the MPU9250, the MPU9150 has 1024 bytes
+#define MPU_GYRO_RATE_DLPF_MHZ      1000000  // Gyroscope output rate with the DLPF enabled
+#define MPU_GYRO_RATE_MHZ           8000000  // Gyroscope output rate with the DLPF disabled
+
+/**@brief One MPU: its address on the bus, the shadow of its configuration
+ * and its state. The instances are allocated from the devicetree nodes with
+ * the "app,mpu9250" compatible, see app_mpu_instances.
  */
 typedef struct
 {
-    int16_t z;
-    int16_t y;
-    int16_t x;
-} accel_values_t;
+    const char *    p_name;              // Devicetree node name, for logs
+    nrf_drv_mpu_t   drv;                 // Bus and addresses
+    regseq_bus_t    regseq_bus;          // Register access used by the init sequences
+    regseq_device_t regseq_device;       // Identification and init sequence, used by app_mpu_init() and the bring-up manager
+    regseq_report_t init_report;         // Outcome of the last init sequence
+    uint32_t        gyro_rate_mhz;       // Gyroscope output rate, the sample rate is it divided by 1 + smplrt_div
+    uint8_t         smplrt_div;          // Sample rate divider
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
+    regseq_bus_t    magn_regseq_bus;     // Register access of the magnetometer, reachable once the MPU bypasses its auxiliary bus
+    regseq_device_t magn_regseq_device;  // Identification and init sequence of the magnetometer, the pre-probe sequence enables the
+                                         // I2C bypass of the MPU. It leaves the magnetometer in magn_cntl.
+    regseq_entry_t  magn_init_sequence[2];  // Init sequence of the magnetometer, through power down into magn_cntl
+    uint8_t         magn_cntl;           // CNTL the magnetometer runs with
+    int32_t         magn_asa_scale[3];   // Sensitivity adjustment per axis, (ASA + 128) / 256 scaled by 2^MPU_AK89XX_ASA_SHIFT
+    bool            magn_asa_loaded;     // magn_asa_scale was read out of the fuse ROM
+#endif
+} app_mpu_t;
 
-/**@brief Structure to hold gyroscope values.
- * Sequence of z, y, and x is important to correspond with
- * the sequence of which z, y, and x data are read from the sensor.
- * All values are unsigned 16 bit integers
+#define APP_MPU_COUNT   DT_NUM_INST_STATUS_OKAY(app_mpu9250)  // Number of MPUs in the devicetree
+#define APP_MPU_DEFAULT (&app_mpu_instances[0])               // First MPU, used by the components that handle a single one
+
+/**@brief MPUs of the devicetree, in instance order */
+extern app_mpu_t app_mpu_instances[APP_MPU_COUNT];
+
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
+/**@brief Function to tell whether the magnetometer of an MPU is used, it
+ * is if the devicetree node gives its address
+ *
+ * @param[in]   p_mpu           MPU
+ * @retval      true if the magnetometer is used
  */
-typedef struct
+static inline bool app_mpu_has_magnetometer(const app_mpu_t *p_mpu)
 {
-    int16_t z;
-    int16_t y;
-    int16_t x;
-} gyro_values_t;
+    return p_mpu->drv.magn_address != 0;
+}
+#endif
 
 /**@brief Simple typedef to hold temperature values */
 typedef int16_t temp_value_t;
@@ -158,15 +183,25 @@ typedef struct
 
 /**@brief Function for initiating MPU and MPU library
  *
- * Resets gyro, accelerometer and temperature sensor signal paths.
+ * Checks WHO_AM_I, then resets gyro, accelerometer and temperature sensor signal paths.
  * Function resets the analog and digital signal paths of the gyroscope, accelerometer,
  * and temperature sensors.
  * The reset will revert the signal path analog to digital converters and filters to their power up
  * configurations.
  *
+ * @param[in]   p_mpu           MPU
  * @retval      int        Error code
  */
-int app_mpu_init(void);
+int app_mpu_init(app_mpu_t *p_mpu);
+
+/**@brief Function for getting the outcome of the last app_mpu_init() sequence,
+ * including how long the cold-boot initialization took.
+ *
+ * @param[in]   p_mpu           MPU
+ * @param[out]  p_report        Pointer to variable to hold the report
+ * @retval      int        Error code
+ */
+int app_mpu_init_report_get(app_mpu_t *p_mpu, regseq_report_t *p_report);
 
 /**
  * @brief Function for basic configuring of the MPU
@@ -184,65 +219,286 @@ int app_mpu_init(void);
  * used to trigger accelerometer self test and configure the accelerometer full scale range.
  * This register also configures the Digital High Pass Filter (DHPF).
  *
+ * The four registers are written in a single burst and read back for verification.
+ *
+ * @param[in]   p_mpu           MPU
  * @param[in]   config          Pointer to configuration structure
  * @retval      int        Error code
  */
-int app_mpu_config(app_mpu_config_t *config);
+int app_mpu_config(app_mpu_t *p_mpu, app_mpu_config_t *config);
 
 /**@brief Function for configuring the behaviour of the interrupt pin of the MPU
  *
+ * @param[in]   p_mpu           MPU
  * @param[in]   config          Pointer to configuration structure
  * @retval      int        Error code
  */
-int app_mpu_int_cfg_pin(app_mpu_int_pin_cfg_t *cfg);
+int app_mpu_int_cfg_pin(app_mpu_t *p_mpu, app_mpu_int_pin_cfg_t *cfg);
 
 /**@brief Function for eneabling interrupts sources in MPU
  *
+ * @param[in]   p_mpu           MPU
  * @param[in]   config          Pointer to configuration structure
  * @retval      int        Error code
  */
-int app_mpu_int_enable(app_mpu_int_enable_t *cfg);
+int app_mpu_int_enable(app_mpu_t *p_mpu, app_mpu_int_enable_t *cfg);
 
 /**@brief Function for reading MPU accelerometer data.
  *
+ * @param[in]   p_mpu           MPU
  * @param[in]   accel_values    Pointer to variable to hold accelerometer data
  * @retval      int        Error code
  */
-int app_mpu_read_accel(accel_values_t *accel_values);
+int app_mpu_read_accel(app_mpu_t *p_mpu, accel_values_t *accel_values);
+
+/**@brief Function for reading accelerometer, and optionally gyroscope, data of several MPUs.
+ *
+ * MPUs on the same TWI bus are read in one bus ownership, so they sample
+ * within the same scheduling period. With p_gyro_values the 14 registers
+ * from ACCEL_XOUT_H to GYRO_ZOUT_L are read in a single burst per MPU.
+ *
+ * @param[in]   pp_mpus         MPUs
+ * @param[in]   count           Number of MPUs, at most NRF_DRV_MPU_MAX_BATCH
+ * @param[out]  accel_values    One sample per MPU, in the order of pp_mpus, not modified for an MPU that failed
+ * @param[out]  gyro_values     One sample per MPU, NULL if not needed, not modified for an MPU that failed
+ * @param[out]  p_errs          Result per MPU, in the order of pp_mpus
+ * @retval      int        0 if every MPU was read, -EINVAL on a NULL pointer or a count out of range,
+ *                         the error of the first MPU that failed otherwise
+ */
+int app_mpu_read_multi(app_mpu_t * const *pp_mpus, uint8_t count, accel_values_t *accel_values,
+                       gyro_values_t *gyro_values, int *p_errs);
 
 /**@brief Function for reading MPU gyroscope data.
  *
+ * @param[in]   p_mpu           MPU
  * @param[in]   gyro_values     Pointer to variable to hold gyroscope data
  * @retval      int        Error code
  */
-int app_mpu_read_gyro(gyro_values_t *gyro_values);
+int app_mpu_read_gyro(app_mpu_t *p_mpu, gyro_values_t *gyro_values);
 
 /**@brief Function for reading MPU temperature data.
  *
+ * @param[in]   p_mpu           MPU
  * @param[in]   temp_values     Pointer to variable to hold temperature data
  * @retval      int        Error code
  */
-int app_mpu_read_temp(temp_value_t *temp_values);
+int app_mpu_read_temp(app_mpu_t *p_mpu, temp_value_t *temp_values);
 
 /**@brief Function for reading the source of the MPU generated interrupts.
  *
+ * @param[in]   p_mpu           MPU
  * @param[in]   int_source      Pointer to variable to hold interrupt source
  * @retval      int        Error code
  */
-int app_mpu_read_int_source(uint8_t *int_source);
+int app_mpu_read_int_source(app_mpu_t *p_mpu, uint8_t *int_source);
+
+/**@brief Function for reading the motion detection status, which tells the axes and polarity of the last motion
+ * and whether zero motion is detected. MPU9150 only.
+ *
+ * @param[in]   p_mpu           MPU
+ * @param[out]  status          Pointer to variable to hold MOT_DETECT_STATUS
+ * @retval      int        Error code
+ */
+int app_mpu_read_motion_status(app_mpu_t *p_mpu, uint8_t *status);
+
+/**@brief Function for reading the interrupt pin configuration, to change single bits of it
+ *
+ * @param[in]   p_mpu           MPU
+ * @param[out]  cfg             Pointer to variable to hold the configuration
+ * @retval      int        Error code
+ */
+int app_mpu_int_cfg_pin_get(app_mpu_t *p_mpu, app_mpu_int_pin_cfg_t *cfg);
 
 /**@brief Function for configuring free fall interrupts
  *
- * THIS FUNCTION DOES NOT WORK ON MPU60x0 and MPU9255 AS THEY DON'T HAVE THE
- * THE SAME FREE FALL FUNCTIONALLITY AS THE MPU9150
+ * The MPU9250 and MPU9255 don't have the free fall detection of the MPU9150, their
+ * ACCEL_CONFIG2 and LP_ACCEL_ODR sit at FF_THR and FF_DUR. WHO_AM_I is read first and
+ * nothing is written on those parts.
+ *
+ * @param[in]   p_mpu           MPU
+ * @param[in]   mg              Free fall threshold in mg
+ * @param[in]   duration        Required free fall duration in ms
+ * @retval      int        Error code, -ENOTSUP if the MPU is not an MPU9150
+ */
+int app_mpu_config_ff_detection(app_mpu_t *p_mpu, uint16_t mg, uint8_t duration);
+
+/**@brief Function for configuring the wake-on-motion detection of the MPU9250 and MPU9255
+ *
+ * Every accelerometer sample is compared to the previous one, the interrupt is raised as
+ * soon as one axis changed by more than the threshold. It takes the place of the motion
+ * detection of the MPU9150, which app_mpu_config_motion_detection() configures.
  *
- * @param[in]   uint16_t       Free fall threshold in mg
- * @retval      uint8_t        Required free fall duration in ms
+ * @param[in]   p_mpu           MPU
+ * @param[in]   mg              Wake-on-motion threshold in mg, 0 disables the detection
+ * @retval      int        Error code
+ */
+int app_mpu_config_wom_detection(app_mpu_t *p_mpu, uint16_t mg);
+
+/**@brief Enum defining the wake-up rates of the accelerometer only low power cycle mode. */
+enum lp_wake_ctrl
+{
+    LP_WAKE_1_25HZ = 0, // 1.25 Hz
+    LP_WAKE_5HZ,        // 5 Hz
+    LP_WAKE_20HZ,       // 20 Hz
+    LP_WAKE_40HZ        // 40 Hz
+};
+
+/**@brief Enum defining the wake-up rates of the low power accelerometer mode of the MPU9250 and MPU9255, LP_ACCEL_ODR. */
+enum lp_accel_odr
+{
+    LP_ACCEL_ODR_0_24HZ = 0, // 0.24 Hz
+    LP_ACCEL_ODR_0_49HZ,     // 0.49 Hz
+    LP_ACCEL_ODR_0_98HZ,     // 0.98 Hz
+    LP_ACCEL_ODR_1_95HZ,     // 1.95 Hz
+    LP_ACCEL_ODR_3_91HZ,     // 3.91 Hz
+    LP_ACCEL_ODR_7_81HZ,     // 7.81 Hz
+    LP_ACCEL_ODR_15_63HZ,    // 15.63 Hz
+    LP_ACCEL_ODR_31_25HZ,    // 31.25 Hz
+    LP_ACCEL_ODR_62_50HZ,    // 62.50 Hz
+    LP_ACCEL_ODR_125HZ,      // 125 Hz
+    LP_ACCEL_ODR_250HZ,      // 250 Hz
+    LP_ACCEL_ODR_500HZ       // 500 Hz
+};
+
+/**@brief Function for changing the sample rate divider without rewriting the rest of the configuration.
+ *
+ * Sample Rate = Gyroscope Output Rate / (1 + SMPLRT_DIV)
+ *
+ * @param[in]   p_mpu           MPU
+ * @param[in]   smplrt_div      Sample rate divider
+ * @retval      int        Error code
  */
-#if defined(MPU9150)
-int app_mpu_config_ff_detection(uint16_t mg, uint8_t duration);
+int app_mpu_sample_rate_div_set(app_mpu_t *p_mpu, uint8_t smplrt_div);
+
+/**@brief Function for getting the sample rate set by app_mpu_config() or app_mpu_sample_rate_div_set()
+ *
+ * @param[in]   p_mpu           MPU
+ * @retval      uint32_t   Sample rate in mHz
+ */
+uint32_t app_mpu_sample_rate_mhz_get(app_mpu_t *p_mpu);
+
+/**@brief Function for configuring motion detection
+ *
+ * MPU9150 only, WHO_AM_I is read first. The MPU9250 and MPU9255 have
+ * app_mpu_config_wom_detection() instead.
+ *
+ * @param[in]   p_mpu           MPU
+ * @param[in]   mg              Motion threshold in mg
+ * @param[in]   duration        Required motion duration in ms
+ * @retval      int        Error code, -ENOTSUP if the MPU is not an MPU9150
+ */
+int app_mpu_config_motion_detection(app_mpu_t *p_mpu, uint16_t mg, uint8_t duration);
+
+/**@brief Function for configuring zero motion detection
+ *
+ * MPU9150 only, WHO_AM_I is read first.
+ *
+ * @param[in]   p_mpu           MPU
+ * @param[in]   mg              Zero motion threshold in mg
+ * @param[in]   duration        Required zero motion duration in ms, in steps of 64 ms
+ * @retval      int        Error code, -ENOTSUP if the MPU is not an MPU9150
+ */
+int app_mpu_config_zero_motion_detection(app_mpu_t *p_mpu, uint16_t mg, uint16_t duration);
+
+/**@brief Function for entering or leaving the accelerometer only low power cycle mode.
+ *
+ * While enabled the gyroscopes and the temperature sensor are in standby and the MPU
+ * wakes up at the given rate to take a single accelerometer sample, which together
+ * with motion detection gives a wake-on-motion mode. MPU9150 only, the MPU9250 and
+ * MPU9255 use app_mpu_low_power_wom_mode().
+ *
+ * @param[in]   p_mpu           MPU
+ * @param[in]   enable          true to enter the cycle mode, false to go back to continuous sampling
+ * @param[in]   wake_rate       Wake-up rate while in cycle mode
+ * @retval      int        Error code
+ */
+int app_mpu_low_power_accel_mode(app_mpu_t *p_mpu, bool enable, enum lp_wake_ctrl wake_rate);
+
+/**@brief Function for entering or leaving the wake-on-motion low power mode of the MPU9250 and MPU9255.
+ *
+ * The MPU9250 counterpart of app_mpu_low_power_accel_mode(): the wake-up rate goes to LP_ACCEL_ODR
+ * instead of PWR_MGMT_2, and the wake-on-motion interrupt is enabled while in the mode. The threshold
+ * is set beforehand with app_mpu_config_wom_detection(). The other interrupt sources are kept.
+ *
+ * @param[in]   p_mpu           MPU
+ * @param[in]   enable          true to enter the cycle mode, false to go back to continuous sampling
+ * @param[in]   odr             Wake-up rate while in cycle mode
+ * @retval      int        Error code
+ */
+int app_mpu_low_power_wom_mode(app_mpu_t *p_mpu, bool enable, enum lp_accel_odr odr);
+
+#if defined(CONFIG_APP_MPU9250_FIFO)
+/**@brief Function for enabling or disabling the accelerometer FIFO
+ *
+ * The FIFO is reset and, when enabled, filled with one accelerometer frame per sample.
+ *
+ * @param[in]   p_mpu           MPU
+ * @param[in]   enable          true to fill the FIFO with accelerometer frames, false to stop it
+ * @retval      int        Error code
+ */
+int app_mpu_fifo_accel_enable(app_mpu_t *p_mpu, bool enable);
+
+/**@brief Function for draining accelerometer frames from the FIFO, oldest first
+ *
+ * @param[in]   p_mpu           MPU
+ * @param[out]  accel_values    Frames read from the FIFO
+ * @param[in]   max_frames      Size of accel_values
+ * @param[out]  frames          Number of frames read
+ * @retval      int        Error code, -EOVERFLOW if the FIFO overflowed and had to be reset
+ */
+int app_mpu_fifo_read_accel(app_mpu_t *p_mpu, accel_values_t *accel_values, uint16_t max_frames, uint16_t *frames);
+
+/**@brief Function for draining accelerometer frames from the FIFO into one array per axis, oldest first
+ *
+ * @param[in]   p_mpu           MPU
+ * @param[out]  p_out           Axis arrays the frames are decoded into, p_accel only
+ * @param[in]   max_frames      Size of every axis array
+ * @param[out]  frames          Number of frames read
+ * @retval      int        Error code, -EOVERFLOW if the FIFO overflowed and had to be reset
+ */
+int app_mpu_fifo_read_accel_soa(app_mpu_t *p_mpu, const frame_soa_t *p_out, uint16_t max_frames, uint16_t *frames);
 #endif
 
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+#define APP_MPU_STREAM_ACCEL_BYTES  6   // ACCEL_XOUT_H through ACCEL_ZOUT_L
+#define APP_MPU_STREAM_GYRO_BYTES   14  // ACCEL_XOUT_H through GYRO_ZOUT_L, the temperature sits between them
+
+/**@brief Function for streaming samples read in hardware on every data ready pulse
+ *
+ * The INT pin is set to a 50 us active high pulse on data ready and the reads are
+ * started through PPI, see nrf_drv_mpu_stream_start(). The handler gets samples_per_wake
+ * raw samples at once from the system work queue, app_mpu_stream_decode() unpacks them.
+ * The interrupt pin cannot be used for the motion detection at the same time.
+ *
+ * @param[in]   p_mpu           MPU
+ * @param[in]   int_pin         Pin the INT pin of the MPU is wired to
+ * @param[in]   with_gyro       true to read the gyroscope with the accelerometer
+ * @param[in]   samples_per_wake Samples handed to the handler at once
+ * @param[in]   p_buffer        NRF_DRV_MPU_STREAM_BUFFER_SIZE() bytes for the sample length
+ * @param[in]   handler         Called with every samples_per_wake samples
+ * @param[in]   p_context       Passed to the handler
+ * @retval      int        Error code, -ENOTSUP on a bus that cannot stream
+ */
+int app_mpu_stream_start(app_mpu_t *p_mpu, uint32_t int_pin, bool with_gyro, uint16_t samples_per_wake,
+                         uint8_t *p_buffer, nrf_drv_mpu_stream_handler_t handler, void *p_context);
+
+/**@brief Function for stopping the stream and the data ready interrupt
+ *
+ * @param[in]   p_mpu           MPU
+ * @retval      int        Error code
+ */
+int app_mpu_stream_stop(app_mpu_t *p_mpu);
+
+/**@brief Function for decoding one raw sample of the stream
+ *
+ * @param[in]   p_sample        Sample, APP_MPU_STREAM_ACCEL_BYTES or APP_MPU_STREAM_GYRO_BYTES long
+ * @param[out]  accel_values    Accelerometer values
+ * @param[out]  gyro_values     Gyroscope values, NULL for a stream without the gyroscope
+ */
+void app_mpu_stream_decode(const uint8_t *p_sample, accel_values_t *accel_values, gyro_values_t *gyro_values);
+#endif
+
+#if defined(CONFIG_APP_MPU9250_MAGNETOMETER)
 /*********************************************************************************************************************
  * FUNCTIONS FOR MAGNETOMETER.
  * MPU9150 has an AK8975C and MPU9255 an AK8963 internal magnetometer. Their register maps
@@ -258,7 +514,14 @@ enum magn_op_mode
     EXTERNAL_TRIGGER_MODE             = 4,    // When external trigger measurement mode is set, AK89xx waits for trigger input. When a pulse is input from TRG pin, sensor measurement is started on the rising edge of TRG pin.
     CONTINUOUS_MEASUREMENT_100Hz_MODE = 6,    //  Sensor is measured periodically at 100Hz
     SELF_TEST_MODE                    = 8,    // Self-test mode is used to check if the sensor is working normally
-    FUSE_ROM_ACCESS_MODE              = 0xFF  // Fuse ROM access mode is used to read Fuse ROM data. Sensitivity adjustment data for each axis is stored in fuse ROM.
+    FUSE_ROM_ACCESS_MODE              = 0x0F  // Fuse ROM access mode is used to read Fuse ROM data. Sensitivity adjustment data for each axis is stored in fuse ROM.
+};
+
+/**@brief Output resolution of the magnetometer, only the AK8963 has the 16 bit mode */
+enum magn_resolution
+{
+    MAGN_RESOLUTION_14_BIT = 0,  // 0.6 uT per LSB
+    MAGN_RESOLUTION_16_BIT = 1,  // 0.15 uT per LSB
 };
 
 typedef struct
@@ -273,34 +536,46 @@ typedef struct
  */
 typedef struct
 {
-    uint8_t mode : 4;
+    uint8_t mode       : 4;  // enum magn_op_mode
+    uint8_t resolution : 1;  // enum magn_resolution, must be 14 bit on the AK8975C
 } app_mpu_magn_config_t;
 
-/**@brief Structure to hold data read from MPU_AK89XX_REG_ST2 after reading sensor values.
+/**@brief Status of a magnetometer read, laid out like MPU_AK89XX_REG_ST2 with
+ * the data overrun flag of MPU_AK89XX_REG_ST1 in a reserved bit.
  */
 typedef struct
 {
-    uint8_t            : 3;
-    uint8_t overflow   : 1;  //  single measurement mode, continuous measurement mode, external trigger measurement mode and self-test mode, magnetic sensor may overflow even though measurement data regiseter is not saturated.
-    uint8_t res_mirror : 1;  // Output bit setting (mirror)
+    uint8_t data_overrun : 1;  // measurements were skipped since the previous read
+    uint8_t              : 2;
+    uint8_t overflow     : 1;  //  single measurement mode, continuous measurement mode, external trigger measurement mode and self-test mode, magnetic sensor may overflow even though measurement data regiseter is not saturated.
+    uint8_t res_mirror   : 1;  // Output bit setting (mirror)
 } app_mpu_magn_read_status_t;
 
-/**@brief Function for enabling and starting the magnetometer
+/**@brief Function for enabling and starting the magnetometer. The factory
+ * sensitivity adjustment values are read out of the fuse ROM on the way and
+ * cached for app_mpu_read_magnetometer(), only once the magnetometer is back
+ * in the configured mode.
  *
+ * @param[in]   p_mpu           MPU
  * @param[in]   app_mpu_magn_config_t 	Magnetometer config struct
  * @retval      int        	Error code
  */
-int app_mpu_magnetometer_init(app_mpu_magn_config_t *p_magnetometer_conf);
+int app_mpu_magnetometer_init(app_mpu_t *p_mpu, app_mpu_magn_config_t *p_magnetometer_conf);
 
-/**@brief Function for reading out magnetometer values
+/**@brief Function for reading out magnetometer values. ST1 through ST2 are
+ * read in one burst, the values are sensitivity adjusted. If the sensitivity
+ * adjustment is not cached yet, as after the bring-up manager, the first call
+ * loads it.
  *
- * @param[in]   magn_values_t *				Magnetometer values struct
- * @param[in]   app_mpu_magn_read_status_t *	Value of status register 2 (MPU_AK89XX_REG_ST2) after magnetometer data is read. NULL can be passed as argument if status is not needed
- * @retval      int     				Error code
+ * @param[in]   p_mpu           MPU
+ * @param[in]   magn_values_t *				Magnetometer values struct, left untouched on error
+ * @param[in]   app_mpu_magn_read_status_t *	Status of the read. NULL can be passed as argument if status is not needed
+ * @retval      int     				Error code, -ENODATA if no new measurement is ready, -ERANGE if the sensor overflowed
  */
-int app_mpu_read_magnetometer(magn_values_t *p_magnetometer_values, app_mpu_magn_read_status_t *p_read_status);
+int app_mpu_read_magnetometer(app_mpu_t *p_mpu, magn_values_t *p_magnetometer_values, app_mpu_magn_read_status_t *p_read_status);
 
 // Test function for development purposes
-int app_mpu_read_magnetometer_test(uint8_t reg, uint8_t *registers, uint8_t len);
+int app_mpu_read_magnetometer_test(app_mpu_t *p_mpu, uint8_t reg, uint8_t *registers, uint8_t len);
+#endif
 
 #endif /* APP_MPU_H__ */
@@ -0,0 +1,390 @@
+/**
+ * @file      odr_ctrl.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     Motion-adaptive output data rate controller. While the sensors
+ *            report motion they run at full rate, after a period of
+ *            inactivity the LIS2DH12 drops to a low rate and the MPU to its
+ *            accelerometer only wake-on-motion cycle mode. Motion, either
+ *            seen in the fed samples or raised by a sensor interrupt, brings
+ *            both back to full rate.
+ * 
+ * @version   0.1
+ * @date      2024-07-08
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "odr_ctrl.h"
+
+LOG_MODULE_REGISTER(odr_ctrl_component, CONFIG_APP_ODR_CTRL_LOG_LEVEL);
+
+/**@brief State of the controller. */
+typedef struct
+{
+    odr_ctrl_config_t   config;
+    enum odr_ctrl_state state;
+    int64_t             state_since_ms;   // start of the current state
+    int64_t             last_motion_ms;   // last sample that showed motion
+    int32_t             gravity[3];       // gravity estimate, scaled by 2^ODR_CTRL_GRAVITY_SHIFT
+    bool                has_gravity;
+    int32_t             threshold_lsb;
+    bool                mpu9150;          // the MPU has the MPU9150 motion detection, WHO_AM_I read at init
+    odr_ctrl_stats_t    stats;
+    bool                initialized;
+} odr_ctrl_t;
+
+static odr_ctrl_t odr_ctrl;
+
+static K_MUTEX_DEFINE(odr_ctrl_lock);
+
+/**@brief Time the last motion interrupt was notified at, 0 if none is pending. */
+static atomic_t odr_ctrl_notified_cycles;
+
+static void odr_ctrl_wake_work_handler(struct k_work * p_work);
+
+static K_WORK_DEFINE(odr_ctrl_wake_work, odr_ctrl_wake_work_handler);
+
+/**
+ * @brief Adds the time spent in the current state to the statistics.
+ * Called with the lock held.
+ * 
+ * @param[in] now_ms current time
+ */
+static void odr_ctrl_account(int64_t now_ms)
+{
+    int64_t elapsed_ms = now_ms - odr_ctrl.state_since_ms;
+
+    if (elapsed_ms <= 0)
+    {
+        return;
+    }
+
+    if (odr_ctrl.state == ODR_CTRL_ACTIVE)
+    {
+        odr_ctrl.stats.active_ms += (uint64_t)elapsed_ms;
+    }
+    else
+    {
+        odr_ctrl.stats.idle_ms += (uint64_t)elapsed_ms;
+
+        if (odr_ctrl.config.active_rate_hz > odr_ctrl.config.idle_rate_hz)
+        {
+            uint32_t bytes_per_s = (uint32_t)(odr_ctrl.config.active_rate_hz - odr_ctrl.config.idle_rate_hz) *
+                                   odr_ctrl.config.bytes_per_sample;
+            odr_ctrl.stats.bus_bytes_saved += ((uint64_t)elapsed_ms * bytes_per_s) / 1000U;
+        }
+    }
+
+    odr_ctrl.state_since_ms = now_ms;
+}
+
+/**
+ * @brief Puts the sensors at full rate, with the motion interrupts off.
+ * 
+ * @return 0 on success, the first bus error otherwise
+ */
+static int odr_ctrl_sensors_active(void)
+{
+    int err = 0;
+
+    if (odr_ctrl.config.use_lis2dh12)
+    {
+        err = lis2dh12_odr_set(LIS2DH12_DEFAULT, odr_ctrl.config.lis2dh12_active_odr);
+        if (err == 0)
+        {
+            err = lis2dh12_motion_int1_config(LIS2DH12_DEFAULT, 0U, 0U);
+        }
+    }
+
+    if ((err == 0) && odr_ctrl.config.use_mpu)
+    {
+        if (odr_ctrl.mpu9150)
+        {
+            err = app_mpu_low_power_accel_mode(APP_MPU_DEFAULT, false, odr_ctrl.config.mpu_wake_rate);
+        }
+        else
+        {
+            err = app_mpu_low_power_wom_mode(APP_MPU_DEFAULT, false, odr_ctrl.config.mpu_wom_odr);
+            if (err == 0)
+            {
+                err = app_mpu_config_wom_detection(APP_MPU_DEFAULT, 0U);
+            }
+        }
+        if (err == 0)
+        {
+            err = app_mpu_sample_rate_div_set(APP_MPU_DEFAULT, odr_ctrl.config.mpu_active_div);
+        }
+    }
+
+    return err;
+}
+
+/**
+ * @brief Puts the sensors at the low rate, with the motion interrupts armed.
+ * 
+ * @return 0 on success, the first bus error otherwise
+ */
+static int odr_ctrl_sensors_idle(void)
+{
+    int err = 0;
+
+    if (odr_ctrl.config.use_lis2dh12)
+    {
+        err = lis2dh12_odr_set(LIS2DH12_DEFAULT, odr_ctrl.config.lis2dh12_idle_odr);
+        if (err == 0)
+        {
+            err = lis2dh12_motion_int1_config(LIS2DH12_DEFAULT, odr_ctrl.config.motion_threshold_mg, 0U);
+        }
+    }
+
+    if ((err == 0) && odr_ctrl.config.use_mpu)
+    {
+        // MOT_THR and LP_WAKE_CTRL of the MPU9150 are LP_ACCEL_ODR and WOM_THR on the MPU9250
+        if (odr_ctrl.mpu9150)
+        {
+            err = app_mpu_config_motion_detection(APP_MPU_DEFAULT, odr_ctrl.config.motion_threshold_mg, 1U);
+            if (err == 0)
+            {
+                err = app_mpu_low_power_accel_mode(APP_MPU_DEFAULT, true, odr_ctrl.config.mpu_wake_rate);
+            }
+        }
+        else
+        {
+            err = app_mpu_config_wom_detection(APP_MPU_DEFAULT, odr_ctrl.config.motion_threshold_mg);
+            if (err == 0)
+            {
+                err = app_mpu_low_power_wom_mode(APP_MPU_DEFAULT, true, odr_ctrl.config.mpu_wom_odr);
+            }
+        }
+    }
+
+    return err;
+}
+
+/**
+ * @brief Moves to a new state. Called with the lock held.
+ * 
+ * @param[in] state  new state
+ * @param[in] now_ms current time
+ * 
+ * @return 0 on success, a bus error otherwise
+ */
+static int odr_ctrl_transition(enum odr_ctrl_state state, int64_t now_ms)
+{
+    int64_t in_state_ms = now_ms - odr_ctrl.state_since_ms;
+    int     err;
+
+    if (state == odr_ctrl.state)
+    {
+        return 0;
+    }
+
+    err = (state == ODR_CTRL_ACTIVE) ? odr_ctrl_sensors_active() : odr_ctrl_sensors_idle();
+    if (err != 0)
+    {
+        odr_ctrl.stats.errors++;
+        LOG_ERR("odr_ctrl_transition:sensor configuration failed with error: %d", err);
+        return err;
+    }
+
+    odr_ctrl_account(now_ms);
+    odr_ctrl.state = state;
+    odr_ctrl.stats.transitions++;
+
+    if (state == ODR_CTRL_ACTIVE)
+    {
+        odr_ctrl.last_motion_ms = now_ms;
+        LOG_INF("motion, full rate after %u ms idle", (uint32_t)in_state_ms);
+    }
+    else
+    {
+        LOG_INF("no motion for %u ms, low rate after %u ms active",
+                (uint32_t)(now_ms - odr_ctrl.last_motion_ms), (uint32_t)in_state_ms);
+    }
+
+    if (odr_ctrl.config.state_changed != NULL)
+    {
+        odr_ctrl.config.state_changed(state);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Raises the rate after a motion interrupt.
+ * 
+ * @param[in] p_work unused
+ */
+static void odr_ctrl_wake_work_handler(struct k_work * p_work)
+{
+    ARG_UNUSED(p_work);
+
+    uint32_t notified = (uint32_t)atomic_set(&odr_ctrl_notified_cycles, 0);
+
+    k_mutex_lock(&odr_ctrl_lock, K_FOREVER);
+
+    if (odr_ctrl.initialized &&
+        (odr_ctrl.state == ODR_CTRL_IDLE) &&
+        (odr_ctrl_transition(ODR_CTRL_ACTIVE, k_uptime_get()) == 0) &&
+        (notified != 0U))
+    {
+        uint32_t latency_us = k_cyc_to_us_floor32(k_cycle_get_32() - notified);
+
+        odr_ctrl.stats.wake_latency_us = latency_us;
+        if (latency_us > odr_ctrl.stats.max_wake_latency_us)
+        {
+            odr_ctrl.stats.max_wake_latency_us = latency_us;
+        }
+    }
+
+    k_mutex_unlock(&odr_ctrl_lock);
+}
+
+int odr_ctrl_init(const odr_ctrl_config_t * p_config)
+{
+    uint8_t id  = 0U;
+    int     err = 0;
+
+    if ((p_config == NULL) || (p_config->lsb_per_g == 0U))
+    {
+        return -EINVAL;
+    }
+
+    if (p_config->use_mpu)
+    {
+        err = regseq_probe(&APP_MPU_DEFAULT->regseq_device, &id);
+        if (err != 0)
+        {
+            LOG_ERR("odr_ctrl_init:MPU identification failed with error: %d", err);
+            return err;
+        }
+    }
+
+    k_mutex_lock(&odr_ctrl_lock, K_FOREVER);
+
+    odr_ctrl.mpu9150        = (id == MPU_WHO_AM_I_MPU9150);
+
+    odr_ctrl.config         = *p_config;
+    odr_ctrl.has_gravity    = false;
+    odr_ctrl.threshold_lsb  = (int32_t)(((uint32_t)p_config->motion_threshold_mg * p_config->lsb_per_g) / 1000U);
+    odr_ctrl.state_since_ms = k_uptime_get();
+    odr_ctrl.last_motion_ms = odr_ctrl.state_since_ms;
+    odr_ctrl.state          = ODR_CTRL_ACTIVE;
+    memset(&odr_ctrl.stats, 0, sizeof(odr_ctrl.stats));
+
+    err = odr_ctrl_sensors_active();
+    odr_ctrl.initialized = (err == 0);
+
+    k_mutex_unlock(&odr_ctrl_lock);
+
+    if (err != 0)
+    {
+        LOG_ERR("odr_ctrl_init:sensor configuration failed with error: %d", err);
+    }
+
+    return err;
+}
+
+int odr_ctrl_feed(const accel_values_t * p_accel, int64_t timestamp_ms)
+{
+    int32_t sample[3];
+    bool    motion = false;
+    int     err    = 0;
+
+    if (p_accel == NULL)
+    {
+        return -EINVAL;
+    }
+
+    sample[0] = p_accel->x;
+    sample[1] = p_accel->y;
+    sample[2] = p_accel->z;
+
+    k_mutex_lock(&odr_ctrl_lock, K_FOREVER);
+
+    if (!odr_ctrl.initialized)
+    {
+        k_mutex_unlock(&odr_ctrl_lock);
+        return -EINVAL;
+    }
+
+    if (!odr_ctrl.has_gravity)
+    {
+        for (uint8_t i = 0; i < 3U; i++)
+        {
+            odr_ctrl.gravity[i] = sample[i] * (1 << ODR_CTRL_GRAVITY_SHIFT);
+        }
+        odr_ctrl.has_gravity = true;
+    }
+
+    for (uint8_t i = 0; i < 3U; i++)
+    {
+        int32_t gravity = odr_ctrl.gravity[i] / (1 << ODR_CTRL_GRAVITY_SHIFT);
+
+        if (abs(sample[i] - gravity) > odr_ctrl.threshold_lsb)
+        {
+            motion = true;
+        }
+
+        odr_ctrl.gravity[i] += sample[i] - gravity;
+    }
+
+    if (motion)
+    {
+        odr_ctrl.last_motion_ms = timestamp_ms;
+        err = odr_ctrl_transition(ODR_CTRL_ACTIVE, timestamp_ms);
+    }
+    else if ((timestamp_ms - odr_ctrl.last_motion_ms) >= (int64_t)odr_ctrl.config.idle_after_ms)
+    {
+        err = odr_ctrl_transition(ODR_CTRL_IDLE, timestamp_ms);
+    }
+
+    k_mutex_unlock(&odr_ctrl_lock);
+
+    return err;
+}
+
+void odr_ctrl_motion_notify(void)
+{
+    // 0 means nothing pending, a cycle count of exactly 0 is reported without latency
+    (void)atomic_cas(&odr_ctrl_notified_cycles, 0, (atomic_val_t)k_cycle_get_32());
+    k_work_submit(&odr_ctrl_wake_work);
+}
+
+enum odr_ctrl_state odr_ctrl_state_get(void)
+{
+    return odr_ctrl.state;
+}
+
+int odr_ctrl_stats_get(odr_ctrl_stats_t * p_stats, int64_t now_ms)
+{
+    uint64_t total_ms;
+
+    if (p_stats == NULL)
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&odr_ctrl_lock, K_FOREVER);
+
+    odr_ctrl_account(now_ms);
+    *p_stats = odr_ctrl.stats;
+
+    k_mutex_unlock(&odr_ctrl_lock);
+
+    total_ms = p_stats->active_ms + p_stats->idle_ms;
+    p_stats->avg_bytes_per_s_saved = (total_ms > 0U) ? (uint32_t)((p_stats->bus_bytes_saved * 1000U) / total_ms) : 0U;
+
+    return 0;
+}
+
+void odr_ctrl_stats_reset(void)
+{
+    k_mutex_lock(&odr_ctrl_lock, K_FOREVER);
+    memset(&odr_ctrl.stats, 0, sizeof(odr_ctrl.stats));
+    k_mutex_unlock(&odr_ctrl_lock);
+}
@@ -0,0 +1,123 @@
+/**
+ * @file      odr_ctrl.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     Motion-adaptive output data rate controller. While the sensors
+ *            report motion they run at full rate, after a period of
+ *            inactivity the LIS2DH12 drops to a low rate and the MPU to its
+ *            accelerometer only wake-on-motion cycle mode. Motion, either
+ *            seen in the fed samples or raised by a sensor interrupt, brings
+ *            both back to full rate.
+ * 
+ * @version   0.1
+ * @date      2024-07-08
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef ODR_CTRL_H_
+#define ODR_CTRL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sensor_types.h"
+#include "mpu9250.h"
+#include "lis2dh12.h"
+
+#define ODR_CTRL_GRAVITY_SHIFT  4U  ///< weight of a new sample in the gravity estimate is 1 / 2^ODR_CTRL_GRAVITY_SHIFT
+
+/**@brief States of the controller. */
+enum odr_ctrl_state
+{
+    ODR_CTRL_ACTIVE = 0,  // Full rate
+    ODR_CTRL_IDLE,        // Low rate or wake-on-motion
+};
+
+/**@brief Configuration of the controller. */
+typedef struct
+{
+    uint16_t          motion_threshold_mg;  ///< change of acceleration that counts as motion
+    uint32_t          idle_after_ms;        ///< time without motion before the rate is lowered
+    uint16_t          lsb_per_g;            ///< sensitivity of the samples given to odr_ctrl_feed()
+    bool              use_lis2dh12;         ///< the controller owns the rate of the first LIS2DH12
+    enum lis2dh12_odr lis2dh12_active_odr;  ///< LIS2DH12 rate while active
+    enum lis2dh12_odr lis2dh12_idle_odr;    ///< LIS2DH12 rate while idle
+    bool              use_mpu;              ///< the controller owns the rate of the first MPU
+    uint8_t           mpu_active_div;       ///< MPU sample rate divider while active
+    enum lp_wake_ctrl mpu_wake_rate;        ///< MPU wake-up rate while idle, MPU9150
+    enum lp_accel_odr mpu_wom_odr;          ///< MPU wake-up rate while idle, MPU9250 and MPU9255
+    uint16_t          active_rate_hz;       ///< rate the application reads the sensors at while active
+    uint16_t          idle_rate_hz;         ///< rate the application reads the sensors at while idle
+    uint16_t          bytes_per_sample;     ///< bus bytes of one read of all sensors
+    void           (* state_changed)(enum odr_ctrl_state state);  ///< called after every transition, can be NULL
+} odr_ctrl_config_t;
+
+/**@brief Statistics of the controller. */
+typedef struct
+{
+    uint32_t transitions;            ///< transitions in both directions
+    uint64_t active_ms;              ///< time spent at full rate
+    uint64_t idle_ms;                ///< time spent at the low rate
+    uint64_t bus_bytes_saved;        ///< bus bytes not transferred thanks to the low rate
+    uint32_t avg_bytes_per_s_saved;  ///< bus_bytes_saved over the total time
+    uint32_t wake_latency_us;        ///< last time from a motion interrupt to full rate
+    uint32_t max_wake_latency_us;    ///< longest time from a motion interrupt to full rate
+    uint32_t errors;                 ///< transitions that failed on the bus
+} odr_ctrl_stats_t;
+
+/**
+ * @brief Initializes the controller and puts the sensors at full rate. The
+ * sensors have to be initialized beforehand, WHO_AM_I of the MPU tells which
+ * of its wake-on-motion modes is used while idle.
+ * 
+ * @param[in] p_config configuration, copied
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or an invalid configuration
+ * @return a bus error if the sensors could not be configured.
+ */
+int odr_ctrl_init(const odr_ctrl_config_t * p_config);
+
+/**
+ * @brief Feeds a sample to the motion detection. Motion is a deviation from
+ * the slowly tracked gravity vector above the threshold on any axis. Also
+ * lowers the rate once no motion was seen for the configured time.
+ * 
+ * @param[in] p_accel      acceleration sample
+ * @param[in] timestamp_ms time of the sample, from k_uptime_get() or a replayed trace
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer
+ * @return a bus error if a transition failed.
+ */
+int odr_ctrl_feed(const accel_values_t * p_accel, int64_t timestamp_ms);
+
+/**
+ * @brief Notifies the controller that a sensor raised its motion interrupt.
+ * Can be called from an ISR, the rate is raised from the system work queue.
+ */
+void odr_ctrl_motion_notify(void);
+
+/**
+ * @brief Gets the current state.
+ * 
+ * @return enum odr_ctrl_state 
+ */
+enum odr_ctrl_state odr_ctrl_state_get(void);
+
+/**
+ * @brief Gets the statistics, up to now.
+ * 
+ * @param[out] p_stats statistics
+ * @param[in]  now_ms  current time, in the timebase of odr_ctrl_feed()
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int odr_ctrl_stats_get(odr_ctrl_stats_t * p_stats, int64_t now_ms);
+
+/**
+ * @brief Resets the statistics.
+ */
+void odr_ctrl_stats_reset(void);
+
+#endif // ODR_CTRL_H_
@@ -0,0 +1,254 @@
+/**
+ * @file      regseq.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     Register sequences describe the bring-up of a device as a const
+ *            table of register writes. The interpreter merges writes to
+ *            consecutive registers into burst transfers, reads them back
+ *            when asked to, and honours the settling delays in between.
+ * 
+ * @version   0.1
+ * @date      2024-06-27
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "regseq.h"
+
+LOG_MODULE_REGISTER(regseq_component, CONFIG_APP_REGSEQ_LOG_LEVEL);
+
+/**
+ * @brief Counts how many entries, starting at first, can go out as one burst.
+ * A burst ends at a register gap, a delay, a REGSEQ_NO_BURST entry or
+ * REGSEQ_MAX_BURST entries.
+ * 
+ * @param[in] p_ctx sequence state
+ * @param[in] first first entry of the burst
+ * 
+ * @return the number of entries in the burst, at least 1
+ */
+static size_t regseq_burst_length(const regseq_ctx_t * p_ctx, const size_t first)
+{
+    size_t length = 1U;
+
+    if ((p_ctx->p_table[first].flags & REGSEQ_NO_BURST) != 0U)
+    {
+        return length;
+    }
+
+    while (((first + length) < p_ctx->count) && (length < REGSEQ_MAX_BURST))
+    {
+        const regseq_entry_t * p_prev  = &p_ctx->p_table[first + length - 1U];
+        const regseq_entry_t * p_entry = &p_ctx->p_table[first + length];
+
+        if ((p_prev->delay_us != 0U) || ((p_entry->flags & REGSEQ_NO_BURST) != 0U) ||
+            (p_entry->reg != (uint8_t)(p_prev->reg + 1U)))
+        {
+            break;
+        }
+        length++;
+    }
+
+    return length;
+}
+
+/**
+ * @brief Writes one burst, and reads it back if any of its entries asks for it.
+ * 
+ * @param[in,out] p_ctx  sequence state
+ * @param[in]     first  first entry of the burst
+ * @param[in]     length number of entries in the burst
+ * 
+ * @return 0 on success
+ * @return -EIO on a verification failure
+ * @return any error of the register access functions.
+ */
+static int regseq_burst_write(regseq_ctx_t * p_ctx, const size_t first, const size_t length)
+{
+    const regseq_entry_t * p_first = &p_ctx->p_table[first];
+    uint8_t data[REGSEQ_MAX_BURST];
+    bool verify = false;
+    int err;
+
+    for (size_t i = 0U; i < length; i++)
+    {
+        data[i] = p_first[i].value;
+        verify |= ((p_first[i].flags & REGSEQ_VERIFY) != 0U);
+    }
+
+    err = p_ctx->p_bus->write(p_ctx->p_bus->p_context, p_first->reg, data, (uint32_t)length);
+    p_ctx->report.transactions++;
+    if (err != 0)
+    {
+        LOG_ERR("regseq_burst_write:writing register 0x%02X failed with error: %d", p_first->reg, err);
+        return err;
+    }
+    p_ctx->report.entries += (uint16_t)length;
+
+    if (!verify)
+    {
+        return 0;
+    }
+
+    err = p_ctx->p_bus->read(p_ctx->p_bus->p_context, p_first->reg, data, (uint32_t)length);
+    p_ctx->report.transactions++;
+    if (err != 0)
+    {
+        LOG_ERR("regseq_burst_write:reading back register 0x%02X failed with error: %d", p_first->reg, err);
+        return err;
+    }
+
+    for (size_t i = 0U; i < length; i++)
+    {
+        if (((p_first[i].flags & REGSEQ_VERIFY) != 0U) && (data[i] != p_first[i].value))
+        {
+            LOG_ERR("regseq_burst_write:register 0x%02X reads 0x%02X instead of 0x%02X",
+                    p_first[i].reg, data[i], p_first[i].value);
+            p_ctx->report.verify_failures++;
+            err = -EIO;
+        }
+    }
+
+    return err;
+}
+
+/**
+ * @brief Prepares a sequence to be run with \ref regseq_step.
+ * 
+ * @param[out] p_ctx   sequence state
+ * @param[in]  p_bus   register access of the device
+ * @param[in]  p_table sequence, usually a const table
+ * @param[in]  count   number of entries in the sequence
+ */
+void regseq_ctx_init(regseq_ctx_t * p_ctx, const regseq_bus_t * p_bus, const regseq_entry_t * p_table, const size_t count)
+{
+    p_ctx->p_bus    = p_bus;
+    p_ctx->p_table  = p_table;
+    p_ctx->count    = count;
+    p_ctx->next     = 0U;
+    p_ctx->start    = 0;
+    p_ctx->ready_at = 0;
+    p_ctx->report   = (regseq_report_t){ 0 };
+}
+
+/**
+ * @brief Runs a sequence until it reaches a settling delay or its end. It
+ * never sleeps, so other sequences can run while this one settles.
+ * 
+ * @param[in,out] p_ctx sequence state
+ * 
+ * @return 1 if the sequence is waiting, it may continue once ready_at is reached
+ * @return 0 once the sequence is done
+ * @return -EIO if a register did not read back what was written
+ * @return any error of the register access functions.
+ */
+int regseq_step(regseq_ctx_t * p_ctx)
+{
+    if (p_ctx->next == 0U)
+    {
+        p_ctx->start = k_uptime_ticks();
+    }
+
+    while (p_ctx->next < p_ctx->count)
+    {
+        const size_t length = regseq_burst_length(p_ctx, p_ctx->next);
+        const uint16_t delay_us = p_ctx->p_table[p_ctx->next + length - 1U].delay_us;
+        int err;
+
+        err = regseq_burst_write(p_ctx, p_ctx->next, length);
+        if (err != 0)
+        {
+            return err;
+        }
+        p_ctx->next += length;
+
+        if (delay_us != 0U)
+        {
+            p_ctx->ready_at = k_uptime_ticks() + (int64_t)k_us_to_ticks_ceil64(delay_us);
+            p_ctx->report.duration_us = (uint32_t)k_ticks_to_us_floor64((uint64_t)(p_ctx->ready_at - p_ctx->start));
+            return 1;
+        }
+    }
+
+    p_ctx->report.duration_us = (uint32_t)k_ticks_to_us_floor64((uint64_t)(k_uptime_ticks() - p_ctx->start));
+
+    return 0;
+}
+
+/**
+ * @brief Runs a whole sequence, sleeping through its settling delays.
+ * 
+ * @param[in]  p_bus    register access of the device
+ * @param[in]  p_table  sequence, usually a const table
+ * @param[in]  count    number of entries in the sequence
+ * @param[out] p_report outcome of the sequence, can be NULL
+ * 
+ * @return 0 on success
+ * @return -EIO if a register did not read back what was written
+ * @return any error of the register access functions.
+ */
+int regseq_run(const regseq_bus_t * p_bus, const regseq_entry_t * p_table, const size_t count, regseq_report_t * p_report)
+{
+    regseq_ctx_t ctx;
+    int err;
+
+    regseq_ctx_init(&ctx, p_bus, p_table, count);
+
+    do
+    {
+        err = regseq_step(&ctx);
+        if (err == 1)
+        {
+            (void)k_sleep(K_TIMEOUT_ABS_TICKS(ctx.ready_at));
+        }
+    } while (err == 1);
+
+    if (p_report != NULL)
+    {
+        *p_report = ctx.report;
+    }
+
+    return err;
+}
+
+/**
+ * @brief Reads the identification register of a device and checks it
+ * against the accepted values.
+ * 
+ * @param[in]  p_device device to probe
+ * @param[out] p_id     value read from the identification register, can be NULL
+ * 
+ * @return 0 if the device answered with an accepted value
+ * @return -ENODEV if it answered with anything else
+ * @return any error of the register access functions.
+ */
+int regseq_probe(const regseq_device_t * p_device, uint8_t * p_id)
+{
+    uint8_t id = 0U;
+    int err;
+
+    err = p_device->p_bus->read(p_device->p_bus->p_context, p_device->id_reg, &id, 1U);
+    if (err != 0)
+    {
+        LOG_ERR("regseq_probe:%s did not answer, error: %d", p_device->p_name, err);
+        return err;
+    }
+
+    if (p_id != NULL)
+    {
+        *p_id = id;
+    }
+
+    for (uint8_t i = 0U; i < p_device->id_count; i++)
+    {
+        if (p_device->p_ids[i] == id)
+        {
+            return 0;
+        }
+    }
+
+    LOG_ERR("regseq_probe:%s answered with unknown id 0x%02X", p_device->p_name, id);
+
+    return -ENODEV;
+}
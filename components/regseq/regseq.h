@@ -0,0 +1,147 @@
+/**
+ * @file      regseq.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     Register sequences describe the bring-up of a device as a const
+ *            table of register writes. The interpreter merges writes to
+ *            consecutive registers into burst transfers, reads them back
+ *            when asked to, and honours the settling delays in between.
+ * 
+ * @version   0.1
+ * @date      2024-06-27
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef REGSEQ_H_
+#define REGSEQ_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define REGSEQ_VERIFY     (1U << 0)  ///< read the register back after writing and compare it
+#define REGSEQ_NO_BURST   (1U << 1)  ///< always write the register in its own transfer
+#define REGSEQ_MAX_BURST  16U        ///< longest burst write, within the longest TWI write
+
+/**@brief One register write of a sequence. */
+typedef struct
+{
+    uint8_t  reg;       ///< register address
+    uint8_t  value;     ///< value to write
+    uint8_t  flags;     ///< REGSEQ_VERIFY, REGSEQ_NO_BURST
+    uint16_t delay_us;  ///< time to wait after the write before the next one
+} regseq_entry_t;
+
+/**@brief A plain register write. */
+#define REGSEQ_WRITE(_reg, _value) \
+    { .reg = (_reg), .value = (_value), .flags = 0U, .delay_us = 0U }
+
+/**@brief A register write that is read back and compared. */
+#define REGSEQ_WRITE_VERIFY(_reg, _value) \
+    { .reg = (_reg), .value = (_value), .flags = REGSEQ_VERIFY, .delay_us = 0U }
+
+/**@brief A register write that has to settle before the sequence continues. */
+#define REGSEQ_WRITE_DELAY(_reg, _value, _delay_us) \
+    { .reg = (_reg), .value = (_value), .flags = 0U, .delay_us = (_delay_us) }
+
+/**@brief A register write with explicit flags and settling delay. */
+#define REGSEQ_ENTRY(_reg, _value, _flags, _delay_us) \
+    { .reg = (_reg), .value = (_value), .flags = (_flags), .delay_us = (_delay_us) }
+
+/**@brief Register access of the device a sequence runs on. Both functions
+ * must auto-increment the register address over a multi-byte access.
+ */
+typedef struct
+{
+    int (*write)(void * p_context, uint8_t reg, uint8_t * p_data, uint32_t length);
+    int (*read)(void * p_context, uint8_t reg, uint8_t * p_data, uint32_t length);
+    void * p_context;
+} regseq_bus_t;
+
+/**@brief Everything needed to identify and bring up a device. */
+typedef struct
+{
+    const char *           p_name;               ///< name used in logs and reports
+    const regseq_bus_t *   p_bus;                ///< register access of the device
+    uint8_t                id_reg;               ///< identification register, WHO_AM_I or similar
+    const uint8_t *        p_ids;                ///< accepted identification values
+    uint8_t                id_count;             ///< number of accepted identification values
+    const regseq_bus_t *   p_pre_bus;            ///< register access of the pre-probe sequence, NULL for none
+    const regseq_entry_t * p_pre_sequence;       ///< sequence that makes the device reachable, e.g. a bus bypass
+    size_t                 pre_sequence_length;  ///< number of entries in the pre-probe sequence
+    const regseq_entry_t * p_sequence;           ///< init sequence run after a successful probe
+    size_t                 sequence_length;      ///< number of entries in the init sequence
+} regseq_device_t;
+
+/**@brief Outcome of running a sequence. */
+typedef struct
+{
+    uint32_t duration_us;      ///< from the first transfer to the end of the last delay
+    uint16_t entries;          ///< register writes done
+    uint16_t transactions;     ///< bus transfers used, including read-backs
+    uint16_t verify_failures;  ///< registers that did not read back what was written
+} regseq_report_t;
+
+/**@brief State of a sequence that is run step by step. */
+typedef struct
+{
+    const regseq_bus_t *   p_bus;     ///< register access
+    const regseq_entry_t * p_table;   ///< sequence
+    size_t                 count;     ///< number of entries in the sequence
+    size_t                 next;      ///< next entry to write
+    int64_t                start;     ///< tick of the first transfer
+    int64_t                ready_at;  ///< tick after which the next step may run
+    regseq_report_t        report;    ///< filled while the sequence runs
+} regseq_ctx_t;
+
+/**
+ * @brief Prepares a sequence to be run with \ref regseq_step.
+ * 
+ * @param[out] p_ctx   sequence state
+ * @param[in]  p_bus   register access of the device
+ * @param[in]  p_table sequence, usually a const table
+ * @param[in]  count   number of entries in the sequence
+ */
+void regseq_ctx_init(regseq_ctx_t * p_ctx, const regseq_bus_t * p_bus, const regseq_entry_t * p_table, const size_t count);
+
+/**
+ * @brief Runs a sequence until it reaches a settling delay or its end. It
+ * never sleeps, so other sequences can run while this one settles.
+ * 
+ * @param[in,out] p_ctx sequence state
+ * 
+ * @return 1 if the sequence is waiting, it may continue once ready_at is reached
+ * @return 0 once the sequence is done
+ * @return -EIO if a register did not read back what was written
+ * @return any error of the register access functions.
+ */
+int regseq_step(regseq_ctx_t * p_ctx);
+
+/**
+ * @brief Runs a whole sequence, sleeping through its settling delays.
+ * 
+ * @param[in]  p_bus    register access of the device
+ * @param[in]  p_table  sequence, usually a const table
+ * @param[in]  count    number of entries in the sequence
+ * @param[out] p_report outcome of the sequence, can be NULL
+ * 
+ * @return 0 on success
+ * @return -EIO if a register did not read back what was written
+ * @return any error of the register access functions.
+ */
+int regseq_run(const regseq_bus_t * p_bus, const regseq_entry_t * p_table, const size_t count, regseq_report_t * p_report);
+
+/**
+ * @brief Reads the identification register of a device and checks it
+ * against the accepted values.
+ * 
+ * @param[in]  p_device device to probe
+ * @param[out] p_id     value read from the identification register, can be NULL
+ * 
+ * @return 0 if the device answered with an accepted value
+ * @return -ENODEV if it answered with anything else
+ * @return any error of the register access functions.
+ */
+int regseq_probe(const regseq_device_t * p_device, uint8_t * p_id);
+
+#endif // REGSEQ_H_
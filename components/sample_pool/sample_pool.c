@@ -0,0 +1,173 @@
+/**
+ * @file      sample_pool.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     Pool of reference counted sample blocks. A producer fills a
+ *            block straight from the driver, publishes it and every
+ *            subscriber gets the same block instead of a copy. The block
+ *            goes back to the pool when the last reference is released.
+ * 
+ * @version   0.1
+ * @date      2024-07-15
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "sample_pool.h"
+
+LOG_MODULE_REGISTER(sample_pool_component, CONFIG_APP_SAMPLE_POOL_LOG_LEVEL);
+
+// 8 byte alignment for the timestamp
+K_MEM_SLAB_DEFINE_STATIC(sample_pool_slab, sizeof(sample_block_t), SAMPLE_POOL_BLOCKS, 8);
+
+/**@brief A subscriber and its user data. */
+typedef struct
+{
+    sample_pool_subscriber_t callback;
+    void *                   p_user_data;
+} sample_pool_subscription_t;
+
+static sample_pool_subscription_t sample_pool_subscribers[SAMPLE_POOL_MAX_SUBSCRIBERS];
+static uint8_t                    sample_pool_subscriber_count;
+
+static sample_pool_stats_t sample_pool_stats;
+static struct k_spinlock   sample_pool_lock;
+
+sample_block_t * sample_pool_alloc(k_timeout_t timeout)
+{
+    sample_block_t * p_block;
+    k_spinlock_key_t key;
+
+    if (k_mem_slab_alloc(&sample_pool_slab, (void **)&p_block, timeout) != 0)
+    {
+        key = k_spin_lock(&sample_pool_lock);
+        sample_pool_stats.alloc_failures++;
+        k_spin_unlock(&sample_pool_lock, key);
+        return NULL;
+    }
+
+    key = k_spin_lock(&sample_pool_lock);
+    sample_pool_stats.in_use++;
+    sample_pool_stats.high_water = MAX(sample_pool_stats.high_water, sample_pool_stats.in_use);
+    k_spin_unlock(&sample_pool_lock, key);
+
+    atomic_set(&p_block->refs, 1);
+    p_block->source    = 0U;
+    p_block->count     = 0U;
+    p_block->t_us      = 0;
+    p_block->period_ns = 0U;
+    p_block->seq       = 0U;
+    p_block->expected  = 0U;
+    p_block->flags     = 0U;
+
+    return p_block;
+}
+
+void sample_block_ref(sample_block_t * p_block)
+{
+    __ASSERT(atomic_get(&p_block->refs) > 0, "reference on a free block");
+    (void)atomic_inc(&p_block->refs);
+}
+
+void sample_block_unref(sample_block_t * p_block)
+{
+    k_spinlock_key_t key;
+
+    __ASSERT(atomic_get(&p_block->refs) > 0, "released a free block");
+
+    // atomic_dec returns the value before the decrement
+    if (atomic_dec(&p_block->refs) != 1)
+    {
+        return;
+    }
+
+    // counted out before the free so a concurrent allocation cannot overshoot the high-water mark
+    key = k_spin_lock(&sample_pool_lock);
+    sample_pool_stats.in_use--;
+    k_spin_unlock(&sample_pool_lock, key);
+
+    k_mem_slab_free(&sample_pool_slab, p_block);
+}
+
+int sample_pool_subscribe(sample_pool_subscriber_t subscriber, void * p_user_data)
+{
+    k_spinlock_key_t key;
+    int              err = 0;
+
+    if (subscriber == NULL)
+    {
+        return -EINVAL;
+    }
+
+    key = k_spin_lock(&sample_pool_lock);
+
+    if (sample_pool_subscriber_count >= SAMPLE_POOL_MAX_SUBSCRIBERS)
+    {
+        err = -ENOMEM;
+    }
+    else
+    {
+        sample_pool_subscribers[sample_pool_subscriber_count].callback    = subscriber;
+        sample_pool_subscribers[sample_pool_subscriber_count].p_user_data = p_user_data;
+        sample_pool_subscriber_count++;
+    }
+
+    k_spin_unlock(&sample_pool_lock, key);
+
+    return err;
+}
+
+int sample_pool_publish(sample_block_t * p_block)
+{
+    k_spinlock_key_t key;
+    uint8_t          count;
+
+    if (p_block == NULL)
+    {
+        return -EINVAL;
+    }
+
+    key = k_spin_lock(&sample_pool_lock);
+    count = sample_pool_subscriber_count;
+    sample_pool_stats.published++;
+    k_spin_unlock(&sample_pool_lock, key);
+
+    // subscribers are only ever appended, the first count entries are stable
+    for (uint8_t i = 0; i < count; i++)
+    {
+        sample_block_ref(p_block);
+        sample_pool_subscribers[i].callback(p_block, sample_pool_subscribers[i].p_user_data);
+    }
+
+    sample_block_unref(p_block);
+
+    return 0;
+}
+
+int sample_pool_stats_get(sample_pool_stats_t * p_stats)
+{
+    k_spinlock_key_t key;
+
+    if (p_stats == NULL)
+    {
+        return -EINVAL;
+    }
+
+    key = k_spin_lock(&sample_pool_lock);
+    *p_stats = sample_pool_stats;
+    k_spin_unlock(&sample_pool_lock, key);
+
+    return 0;
+}
+
+void sample_pool_stats_reset(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&sample_pool_lock);
+
+    sample_pool_stats.high_water     = sample_pool_stats.in_use;
+    sample_pool_stats.alloc_failures = 0U;
+    sample_pool_stats.published      = 0U;
+
+    k_spin_unlock(&sample_pool_lock, key);
+}
@@ -0,0 +1,121 @@
+/**
+ * @file      sample_pool.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     Pool of reference counted sample blocks. A producer fills a
+ *            block straight from the driver, publishes it and every
+ *            subscriber gets the same block instead of a copy. The block
+ *            goes back to the pool when the last reference is released.
+ * 
+ * @version   0.1
+ * @date      2024-07-15
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef SAMPLE_POOL_H_
+#define SAMPLE_POOL_H_
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include "sensor_types.h"
+
+#define SAMPLE_POOL_BLOCKS          CONFIG_APP_SAMPLE_POOL_BLOCKS  ///< blocks in the pool
+#define SAMPLE_POOL_BLOCK_SAMPLES   32U  ///< samples per block, a full LIS2DH12 FIFO
+#define SAMPLE_POOL_MAX_SUBSCRIBERS 4U   ///< consumers a block can be published to
+
+/**@brief A block of samples from one sensor. */
+typedef struct
+{
+    atomic_t       refs;                                ///< references held, do not touch
+    uint8_t        source;                              ///< producer defined sensor id
+    uint16_t       count;                               ///< valid samples
+    int64_t        t_us;                                ///< timestamp of the first sample
+    uint32_t       period_ns;                           ///< time between two samples
+    uint32_t       seq;                                 ///< sequence number of the first sample, set by seqchk_block()
+    uint16_t       expected;                            ///< samples expected since the previous block, lost ones included
+    uint8_t        flags;                               ///< SEQCHK_FLAG_* bits
+    accel_values_t before;                              ///< last sample of the previous block, to fill a gap
+    accel_values_t samples[SAMPLE_POOL_BLOCK_SAMPLES];  ///< the samples
+} sample_block_t;
+
+/**
+ * @brief Called for every published block. The subscriber owns one
+ * reference and releases it with sample_block_unref(), right away or after
+ * handing the block to its own thread.
+ * 
+ * @param[in] p_block     published block
+ * @param[in] p_user_data pointer given to sample_pool_subscribe()
+ */
+typedef void (*sample_pool_subscriber_t)(sample_block_t * p_block, void * p_user_data);
+
+/**@brief Statistics of the pool, to size it. */
+typedef struct
+{
+    uint32_t in_use;          ///< blocks currently allocated
+    uint32_t high_water;      ///< most blocks ever allocated at the same time
+    uint32_t alloc_failures;  ///< allocations that found the pool empty
+    uint32_t published;       ///< blocks published
+} sample_pool_stats_t;
+
+/**
+ * @brief Allocates a block holding one reference, for the producer.
+ * 
+ * @param[in] timeout how long to wait for a free block
+ * 
+ * @return sample_block_t* the block, NULL if none was free in time
+ */
+sample_block_t * sample_pool_alloc(k_timeout_t timeout);
+
+/**
+ * @brief Takes one more reference on a block.
+ * 
+ * @param[in] p_block block
+ */
+void sample_block_ref(sample_block_t * p_block);
+
+/**
+ * @brief Releases a reference, the last one returns the block to the pool.
+ * 
+ * @param[in] p_block block
+ */
+void sample_block_unref(sample_block_t * p_block);
+
+/**
+ * @brief Adds a subscriber, for the blocks published from now on.
+ * 
+ * @param[in] subscriber  callback, runs in the context of the producer
+ * @param[in] p_user_data passed to the callback
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL callback
+ * @return -ENOMEM if there are SAMPLE_POOL_MAX_SUBSCRIBERS subscribers already.
+ */
+int sample_pool_subscribe(sample_pool_subscriber_t subscriber, void * p_user_data);
+
+/**
+ * @brief Publishes a block to every subscriber and releases the reference
+ * of the producer.
+ * 
+ * @param[in] p_block block from sample_pool_alloc()
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int sample_pool_publish(sample_block_t * p_block);
+
+/**
+ * @brief Gets the statistics of the pool.
+ * 
+ * @param[out] p_stats statistics
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int sample_pool_stats_get(sample_pool_stats_t * p_stats);
+
+/**
+ * @brief Resets the high-water mark to the current use and clears the counters.
+ */
+void sample_pool_stats_reset(void);
+
+#endif // SAMPLE_POOL_H_
@@ -0,0 +1,194 @@
+/**
+ * @file      seqchk.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Sequence numbering and integrity checks of sensor sample
+ *            batches, see seqchk.h.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "seqchk.h"
+
+LOG_MODULE_REGISTER(seqchk_component, CONFIG_APP_SEQCHK_LOG_LEVEL);
+
+/**
+ * @brief Checks a batch with a given period.
+ */
+static void seqchk_check(seqchk_stream_t * p_stream, const accel_values_t * p_samples, const uint16_t count,
+                         const int64_t t_us, const uint32_t period_ns, const bool overflow, seqchk_batch_t * p_batch)
+{
+    uint32_t         steps      = 1U;  // periods from the previous last sample to the first one
+    uint32_t         lost       = 0U;
+    uint32_t         duplicates = 0U;
+    k_spinlock_key_t key;
+
+    if (p_stream->started)
+    {
+        const int64_t dt_ns = (t_us - p_stream->last_us) * 1000;
+
+        steps = (dt_ns > 0) ? (uint32_t)MIN((dt_ns + (period_ns / 2U)) / period_ns, (int64_t)UINT16_MAX) : 0U;
+        lost  = (steps > 1U) ? MIN(steps - 1U, (uint32_t)(UINT16_MAX - count)) : 0U;
+
+        // taken in the period of the last sample, the register had no new data. Equal
+        // values alone say nothing, a sensor at rest repeats its output.
+        duplicates = (steps == 0U) ? 1U : 0U;
+    }
+
+    p_batch->seq      = p_stream->next_seq + lost;
+    p_batch->expected = (uint16_t)(count + lost - ((steps == 0U) ? 1U : 0U));
+    p_batch->received = count;
+    p_batch->before   = p_stream->last;
+    p_batch->flags    = ((lost != 0U) ? SEQCHK_FLAG_GAP : 0U) | (overflow ? SEQCHK_FLAG_OVERFLOW : 0U) |
+                     ((duplicates != 0U) ? SEQCHK_FLAG_DUPLICATE : 0U);
+
+    p_stream->next_seq = p_batch->seq + count;
+    p_stream->last_us  = t_us + ((int64_t)(count - 1U) * period_ns) / 1000;
+    p_stream->last     = p_samples[count - 1U];
+    p_stream->started  = true;
+
+    key = k_spin_lock(&p_stream->lock);
+    p_stream->stats.batches++;
+    p_stream->stats.received   += count;
+    p_stream->stats.expected   += p_batch->expected;
+    p_stream->stats.lost       += lost;
+    p_stream->stats.gaps       += (lost != 0U) ? 1U : 0U;
+    p_stream->stats.duplicates += duplicates;
+    p_stream->stats.overflows  += overflow ? 1U : 0U;
+    k_spin_unlock(&p_stream->lock, key);
+
+    if (lost != 0U)
+    {
+        LOG_DBG("seqchk_check:%s lost %u samples before %u", p_stream->p_name, lost, p_batch->seq);
+    }
+}
+
+int seqchk_stream_rate_set(seqchk_stream_t * p_stream, uint32_t odr_mhz)
+{
+    if ((p_stream == NULL) || (odr_mhz == 0U))
+    {
+        return -EINVAL;
+    }
+
+    p_stream->period_ns = (uint32_t)(1000000000000ULL / odr_mhz);
+    p_stream->started   = false;
+
+    return 0;
+}
+
+int seqchk_stream_init(seqchk_stream_t * p_stream, const char * p_name, uint32_t odr_mhz)
+{
+    if ((p_stream == NULL) || (odr_mhz == 0U))
+    {
+        return -EINVAL;
+    }
+
+    memset(p_stream, 0, sizeof(*p_stream));
+    p_stream->p_name = p_name;
+
+    return seqchk_stream_rate_set(p_stream, odr_mhz);
+}
+
+int seqchk_batch(seqchk_stream_t * p_stream, const accel_values_t * p_samples, uint16_t count, int64_t t_us,
+                 bool overflow, seqchk_batch_t * p_batch)
+{
+    seqchk_batch_t batch;
+
+    if ((p_stream == NULL) || (p_samples == NULL) || (count == 0U))
+    {
+        return -EINVAL;
+    }
+
+    seqchk_check(p_stream, p_samples, count, t_us, p_stream->period_ns, overflow,
+                 (p_batch != NULL) ? p_batch : &batch);
+
+    return 0;
+}
+
+#if defined(CONFIG_APP_SAMPLE_POOL)
+int seqchk_block(seqchk_stream_t * p_stream, sample_block_t * p_block, bool overflow)
+{
+    seqchk_batch_t batch;
+
+    if ((p_stream == NULL) || (p_block == NULL) || (p_block->count == 0U) ||
+        (p_block->count > SAMPLE_POOL_BLOCK_SAMPLES))
+    {
+        return -EINVAL;
+    }
+
+    seqchk_check(p_stream, p_block->samples, p_block->count, p_block->t_us,
+                 (p_block->period_ns != 0U) ? p_block->period_ns : p_stream->period_ns, overflow, &batch);
+
+    p_block->seq      = batch.seq;
+    p_block->expected = batch.expected;
+    p_block->flags    = batch.flags;
+    p_block->before   = batch.before;
+
+    return 0;
+}
+#endif
+
+int seqchk_gap_fill(enum seqchk_fill mode, const accel_values_t * p_before, const accel_values_t * p_after,
+                    uint16_t lost, accel_values_t * p_out, uint16_t max)
+{
+    const uint16_t count = MIN(lost, max);
+
+    if ((p_before == NULL) || (p_after == NULL) || (p_out == NULL))
+    {
+        return -EINVAL;
+    }
+
+    switch (mode)
+    {
+        case SEQCHK_FILL_HOLD:
+            for (uint16_t i = 0U; i < count; i++)
+            {
+                p_out[i] = *p_before;
+            }
+            break;
+
+        case SEQCHK_FILL_ZERO:
+            memset(p_out, 0, count * sizeof(*p_out));
+            break;
+
+        case SEQCHK_FILL_LINEAR:
+            // sample i of the gap is i + 1 steps of lost + 1 past the one before
+            for (uint16_t i = 0U; i < count; i++)
+            {
+                const int32_t num = (int32_t)i + 1;
+                const int32_t den = (int32_t)lost + 1;
+
+                p_out[i].x = (int16_t)(p_before->x + (((int32_t)p_after->x - p_before->x) * num) / den);
+                p_out[i].y = (int16_t)(p_before->y + (((int32_t)p_after->y - p_before->y) * num) / den);
+                p_out[i].z = (int16_t)(p_before->z + (((int32_t)p_after->z - p_before->z) * num) / den);
+            }
+            break;
+
+        default:
+            return -EINVAL;
+    }
+
+    return (int)count;
+}
+
+int seqchk_stats_get(seqchk_stream_t * p_stream, seqchk_stats_t * p_stats)
+{
+    k_spinlock_key_t key;
+
+    if ((p_stream == NULL) || (p_stats == NULL))
+    {
+        return -EINVAL;
+    }
+
+    key      = k_spin_lock(&p_stream->lock);
+    *p_stats = p_stream->stats;
+    k_spin_unlock(&p_stream->lock, key);
+
+    return 0;
+}
@@ -0,0 +1,181 @@
+/**
+ * @file      seqchk.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Sequence numbering and integrity checks of sensor sample
+ *            batches. Every batch of a stream, a single read or a FIFO
+ *            drain, gets the sequence number of its first sample and the
+ *            number of samples the output data rate says should have come
+ *            since the previous batch. Samples missing from that, a FIFO
+ *            overflow or a repeated read of the same data register are
+ *            counted per stream and marked on the batch, and the missing
+ *            samples can be filled in by the consumer.
+ *
+ *            The checks are a few integer operations per batch, they stay
+ *            on at full rate.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef SEQCHK_H_
+#define SEQCHK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include "sensor_types.h"
+#if defined(CONFIG_APP_SAMPLE_POOL)
+#include "sample_pool.h"
+#endif
+
+#define SEQCHK_FLAG_GAP       0x01U  ///< samples were lost right before the batch
+#define SEQCHK_FLAG_OVERFLOW  0x02U  ///< the sensor FIFO overflowed before the batch was read
+#define SEQCHK_FLAG_DUPLICATE 0x04U  ///< the batch starts with the previous last sample read again
+
+/**@brief How seqchk_gap_fill() makes up the lost samples. */
+enum seqchk_fill
+{
+    SEQCHK_FILL_HOLD = 0,  ///< repeat the last sample before the gap
+    SEQCHK_FILL_ZERO,      ///< zero on every axis
+    SEQCHK_FILL_LINEAR,    ///< straight line from the sample before to the sample after the gap
+};
+
+/**@brief Integrity counters of a stream. */
+typedef struct
+{
+    uint32_t batches;     ///< batches checked
+    uint32_t received;    ///< samples received
+    uint32_t expected;    ///< samples the output data rate gave over the same time
+    uint32_t lost;        ///< samples missing from the expected ones
+    uint32_t gaps;        ///< batches with lost samples before them
+    uint32_t duplicates;  ///< batches that started in the period of the previous last sample
+    uint32_t overflows;   ///< FIFO overflows reported by the producer
+} seqchk_stats_t;
+
+/**@brief Result of the check of one batch. */
+typedef struct
+{
+    uint32_t       seq;       ///< sequence number of the first sample, lost samples use up numbers too
+    uint16_t       expected;  ///< samples expected since the previous batch, the received ones and the lost ones
+    uint16_t       received;  ///< samples in the batch
+    uint8_t        flags;     ///< SEQCHK_FLAG_* bits
+    accel_values_t before;    ///< last sample of the previous batch, for seqchk_gap_fill()
+} seqchk_batch_t;
+
+/**@brief A stream of samples from one sensor. */
+typedef struct
+{
+    const char *      p_name;     ///< name of the sensor, for the logs
+    uint32_t          period_ns;  ///< period from the configured output data rate
+    uint32_t          next_seq;   ///< sequence number of the next sample
+    int64_t           last_us;    ///< timestamp of the last sample
+    accel_values_t    last;       ///< last sample
+    bool              started;    ///< a batch was checked since the init or the last rate change
+    seqchk_stats_t    stats;      ///< integrity counters
+    struct k_spinlock lock;       ///< protects the counters against seqchk_stats_get()
+} seqchk_stream_t;
+
+/**
+ * @brief Initializes a stream.
+ *
+ * @param[out] p_stream stream
+ * @param[in]  p_name   name of the sensor
+ * @param[in]  odr_mhz  output data rate of the stream in mHz, the read rate for single reads
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or a zero rate.
+ */
+int seqchk_stream_init(seqchk_stream_t * p_stream, const char * p_name, uint32_t odr_mhz);
+
+/**
+ * @brief Changes the output data rate, after the sensor rate was changed.
+ * The next batch starts a new reference and is not checked for a gap, the
+ * sequence numbers go on.
+ *
+ * @param[in,out] p_stream stream
+ * @param[in]     odr_mhz  new output data rate in mHz
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or a zero rate.
+ */
+int seqchk_stream_rate_set(seqchk_stream_t * p_stream, uint32_t odr_mhz);
+
+/**
+ * @brief Numbers and checks a batch of samples, oldest first, one period
+ * apart. Samples lost before the batch are found from the time since the
+ * last sample of the previous batch, rounded to whole periods. A batch that
+ * starts in the period of the previous last sample read the same data again
+ * and counts as a duplicate. Called from the one thread that reads the
+ * sensor.
+ *
+ * @param[in,out] p_stream  stream
+ * @param[in]     p_samples samples
+ * @param[in]     count     number of samples
+ * @param[in]     t_us      timestamp of the first sample
+ * @param[in]     overflow  the FIFO overflowed before this drain
+ * @param[out]    p_batch   result, can be NULL
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or an empty batch.
+ */
+int seqchk_batch(seqchk_stream_t * p_stream, const accel_values_t * p_samples, uint16_t count, int64_t t_us,
+                 bool overflow, seqchk_batch_t * p_batch);
+
+#if defined(CONFIG_APP_SAMPLE_POOL)
+/**
+ * @brief Numbers and checks a filled sample block before it is published,
+ * and stores the result in the block. Uses the period of the block if it has
+ * one, the period of the stream otherwise.
+ *
+ * @param[in,out] p_stream stream
+ * @param[in,out] p_block  block
+ * @param[in]     overflow the FIFO overflowed before this drain
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or an empty block.
+ */
+int seqchk_block(seqchk_stream_t * p_stream, sample_block_t * p_block, bool overflow);
+#endif
+
+/**
+ * @brief Makes up the samples lost in a gap.
+ *
+ * @param[in]  mode     how to fill
+ * @param[in]  p_before last sample before the gap
+ * @param[in]  p_after  first sample after the gap
+ * @param[in]  lost     samples lost
+ * @param[out] p_out    filled samples
+ * @param[in]  max      room in p_out
+ *
+ * @return the number of samples filled, at most max
+ * @return -EINVAL on a NULL pointer or an unknown mode.
+ */
+int seqchk_gap_fill(enum seqchk_fill mode, const accel_values_t * p_before, const accel_values_t * p_after,
+                    uint16_t lost, accel_values_t * p_out, uint16_t max);
+
+/**
+ * @brief Gets the integrity counters of a stream.
+ *
+ * @param[in]  p_stream stream
+ * @param[out] p_stats  counters
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int seqchk_stats_get(seqchk_stream_t * p_stream, seqchk_stats_t * p_stats);
+
+/**
+ * @brief Samples lost right before a batch.
+ *
+ * @param[in] p_batch result of seqchk_batch()
+ *
+ * @return the number of lost samples
+ */
+static inline uint16_t seqchk_batch_lost(const seqchk_batch_t * p_batch)
+{
+    return (p_batch->expected > p_batch->received) ? (uint16_t)(p_batch->expected - p_batch->received) : 0U;
+}
+
+#endif // SEQCHK_H_
@@ -0,0 +1,227 @@
+/**
+ * @file      trace.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Trace recorder. Every transfer attempt the TWI component hands
+ *            to its backend is written to a ring buffer as one record, or
+ *            dropped whole when it does not fit. The buffer is drained by
+ *            the console stream or by trace_record_read().
+ *
+ * @version   0.1
+ * @date      2024-08-02
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/ring_buffer.h>
+#include "trace.h"
+#include "twi.h"
+
+LOG_MODULE_REGISTER(trace_component, CONFIG_APP_TRACE_LOG_LEVEL);
+
+#if defined(CONFIG_APP_TRACE_RECORD)
+
+#define TRACE_CONSOLE_LINE_BYTES 32U  ///< bytes per console line, printed as hex
+
+RING_BUF_DECLARE(trace_ring, CONFIG_APP_TRACE_BUFFER_SIZE);
+
+static struct k_spinlock    trace_lock;             ///< protects the ring and the state below
+static bool                 recording   = false;
+static bool                 gap         = false;    ///< the next record follows dropped ones
+static int64_t              start_ticks = 0;
+static trace_record_stats_t stats       = { 0 };
+
+#if defined(CONFIG_APP_TRACE_CONSOLE)
+static void trace_console_work_fn(struct k_work * p_work);
+static K_WORK_DELAYABLE_DEFINE(trace_console_work, trace_console_work_fn);
+#endif
+
+/**
+ * @brief Stores a transfer attempt, runs in the thread that owns the bus.
+ *
+ * @param[in] p_xfer transfer
+ * @param[in] err    result of the backend
+ */
+static void trace_tap(const twi_port_xfer_t * p_xfer, int err)
+{
+    const uint32_t   length = (err == 0) ? p_xfer->length : 0U;
+    k_spinlock_key_t key;
+    trace_record_t   record = {
+        .timestamp_us = 0U,
+        .length       = p_xfer->length,
+        .address      = p_xfer->address,
+        .reg_address  = p_xfer->reg_address,
+        .flags        = (p_xfer->read ? TRACE_FLAG_READ : 0U) | (p_xfer->has_reg ? TRACE_FLAG_HAS_REG : 0U),
+        .err          = (int8_t)CLAMP(err, INT8_MIN, 0),
+    };
+
+    key = k_spin_lock(&trace_lock);
+
+    if (recording)
+    {
+        record.timestamp_us = (uint32_t)k_ticks_to_us_floor64((uint64_t)(k_uptime_ticks() - start_ticks));
+        if (ring_buf_space_get(&trace_ring) < (sizeof(record) + length))
+        {
+            stats.dropped++;
+            gap = true;
+        }
+        else
+        {
+            record.flags |= gap ? TRACE_FLAG_GAP : 0U;
+            (void)ring_buf_put(&trace_ring, (const uint8_t *)&record, sizeof(record));
+            (void)ring_buf_put(&trace_ring, p_xfer->p_data, length);
+            stats.records++;
+            stats.bytes += sizeof(record) + length;
+            gap = false;
+        }
+    }
+
+    k_spin_unlock(&trace_lock, key);
+}
+
+#if defined(CONFIG_APP_TRACE_CONSOLE)
+/**
+ * @brief Prints the buffered bytes as "trace:" lines of hex, and comes back
+ * while the recording runs.
+ */
+static void trace_console_work_fn(struct k_work * p_work)
+{
+    uint8_t  line[TRACE_CONSOLE_LINE_BYTES];
+    char     hex[(2U * TRACE_CONSOLE_LINE_BYTES) + 1U];
+    uint32_t count;
+
+    ARG_UNUSED(p_work);
+
+    while ((count = trace_record_read(line, sizeof(line))) != 0U)
+    {
+        for (uint32_t i = 0U; i < count; i++)
+        {
+            (void)snprintk(&hex[2U * i], 3U, "%02x", line[i]);
+        }
+        hex[2U * count] = '\0';
+        printk("trace:%s\n", hex);
+    }
+
+    if (recording)
+    {
+        (void)k_work_reschedule(&trace_console_work, K_MSEC(CONFIG_APP_TRACE_CONSOLE_INTERVAL_MS));
+    }
+}
+#endif
+
+/**
+ * @brief Starts a recording, the buffer is cleared and starts with the
+ * trace header. With CONFIG_APP_TRACE_CONSOLE the buffer is streamed to the
+ * console as it fills, scripts/trace_extract.py turns the console output
+ * back into a trace file.
+ *
+ * @return 0 on success
+ * @return -EALREADY if a recording is running.
+ */
+int trace_record_start(void)
+{
+    const trace_file_header_t header = {
+        .magic       = TRACE_MAGIC,
+        .version     = TRACE_VERSION,
+        .record_size = sizeof(trace_record_t),
+    };
+    k_spinlock_key_t key = k_spin_lock(&trace_lock);
+
+    if (recording)
+    {
+        k_spin_unlock(&trace_lock, key);
+        return -EALREADY;
+    }
+
+    ring_buf_reset(&trace_ring);
+    (void)ring_buf_put(&trace_ring, (const uint8_t *)&header, sizeof(header));
+    memset(&stats, 0, sizeof(stats));
+    stats.bytes = sizeof(header);
+    gap         = false;
+    start_ticks = k_uptime_ticks();
+    recording   = true;
+
+    k_spin_unlock(&trace_lock, key);
+
+    twi_tap_set(trace_tap);
+
+#if defined(CONFIG_APP_TRACE_CONSOLE)
+    (void)k_work_reschedule(&trace_console_work, K_MSEC(CONFIG_APP_TRACE_CONSOLE_INTERVAL_MS));
+#endif
+
+    LOG_INF("trace_record_start:recording into %u bytes", CONFIG_APP_TRACE_BUFFER_SIZE);
+    return 0;
+}
+
+/**
+ * @brief Stops the recording, the bytes still in the buffer can be read.
+ */
+void trace_record_stop(void)
+{
+    k_spinlock_key_t key;
+
+    twi_tap_set(NULL);
+
+    key       = k_spin_lock(&trace_lock);
+    recording = false;
+    k_spin_unlock(&trace_lock, key);
+
+#if defined(CONFIG_APP_TRACE_CONSOLE)
+    // one last run prints what is left
+    (void)k_work_reschedule(&trace_console_work, K_NO_WAIT);
+#endif
+}
+
+/**
+ * @brief Takes recorded bytes out of the buffer, for a sink other than the
+ * console.
+ *
+ * @param[out] p_buffer buffer to copy into
+ * @param[in]  size     size of the buffer
+ *
+ * @return number of bytes copied.
+ */
+uint32_t trace_record_read(uint8_t * p_buffer, uint32_t size)
+{
+    uint32_t         count;
+    k_spinlock_key_t key;
+
+    if (p_buffer == NULL)
+    {
+        return 0U;
+    }
+
+    key   = k_spin_lock(&trace_lock);
+    count = ring_buf_get(&trace_ring, p_buffer, size);
+    k_spin_unlock(&trace_lock, key);
+
+    return count;
+}
+
+/**
+ * @brief Gets the statistics of the recorder.
+ *
+ * @param[out] p_stats statistics
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int trace_record_stats_get(trace_record_stats_t * p_stats)
+{
+    k_spinlock_key_t key;
+
+    if (p_stats == NULL)
+    {
+        return -EINVAL;
+    }
+
+    key      = k_spin_lock(&trace_lock);
+    *p_stats = stats;
+    k_spin_unlock(&trace_lock, key);
+
+    return 0;
+}
+
+#endif // CONFIG_APP_TRACE_RECORD
@@ -0,0 +1,151 @@
+/**
+ * @file      trace.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Capture and replay of the raw TWI traffic of the sensors. The
+ *            recorder taps the TWI component and stores every transfer
+ *            attempt, its bytes and its result with a timestamp. On
+ *            native_sim the replay backend takes the place of the bus and
+ *            serves a recorded trace back to the drivers, at the recorded
+ *            pace or as fast as the host runs, so the processing chain sees
+ *            the same input on every run.
+ *
+ *            A trace is a trace_file_header_t followed by records, each a
+ *            trace_record_t followed by the transferred bytes when the
+ *            transfer succeeded. All fields are little endian.
+ *
+ * @version   0.1
+ * @date      2024-08-02
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+#define TRACE_MAGIC          0x31435254U  ///< "TRC1"
+#define TRACE_VERSION        1U
+
+#define TRACE_FLAG_READ      0x01U  ///< the bytes were read from the device
+#define TRACE_FLAG_HAS_REG   0x02U  ///< the register address was sent before the bytes
+#define TRACE_FLAG_GAP       0x04U  ///< records before this one were dropped, the buffer was full
+
+/**@brief Start of a trace. */
+typedef struct __packed
+{
+    uint32_t magic;        ///< TRACE_MAGIC
+    uint16_t version;      ///< TRACE_VERSION
+    uint16_t record_size;  ///< size of trace_record_t, without the bytes
+} trace_file_header_t;
+
+/**@brief One transfer attempt, followed by its bytes if err is 0. */
+typedef struct __packed
+{
+    uint32_t timestamp_us;  ///< end of the transfer, from the start of the recording
+    uint16_t length;        ///< bytes transferred
+    uint8_t  address;       ///< 7-bit device address
+    uint8_t  reg_address;   ///< register address, only valid with TRACE_FLAG_HAS_REG
+    uint8_t  flags;         ///< TRACE_FLAG_*
+    int8_t   err;           ///< result of the backend, 0 or a negative errno
+} trace_record_t;
+
+#if defined(CONFIG_APP_TRACE_RECORD)
+/**@brief Statistics of the recorder. */
+typedef struct
+{
+    uint32_t records;  ///< records stored
+    uint32_t bytes;    ///< bytes stored, headers included
+    uint32_t dropped;  ///< records lost to a full buffer
+} trace_record_stats_t;
+
+/**
+ * @brief Starts a recording, the buffer is cleared and starts with the
+ * trace header. With CONFIG_APP_TRACE_CONSOLE the buffer is streamed to the
+ * console as it fills, scripts/trace_extract.py turns the console output
+ * back into a trace file.
+ *
+ * @return 0 on success
+ * @return -EALREADY if a recording is running.
+ */
+int trace_record_start(void);
+
+/**
+ * @brief Stops the recording, the bytes still in the buffer can be read.
+ */
+void trace_record_stop(void);
+
+/**
+ * @brief Takes recorded bytes out of the buffer, for a sink other than the
+ * console.
+ *
+ * @param[out] p_buffer buffer to copy into
+ * @param[in]  size     size of the buffer
+ *
+ * @return number of bytes copied.
+ */
+uint32_t trace_record_read(uint8_t * p_buffer, uint32_t size);
+
+/**
+ * @brief Gets the statistics of the recorder.
+ *
+ * @param[out] p_stats statistics
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int trace_record_stats_get(trace_record_stats_t * p_stats);
+#endif
+
+#if defined(CONFIG_APP_TRACE_REPLAY)
+/**@brief Pace of a replay. */
+enum trace_replay_speed
+{
+    TRACE_REPLAY_REALTIME = 0,  ///< a transfer completes at its recorded time
+    TRACE_REPLAY_MAX_SPEED,     ///< transfers complete at once
+};
+
+/**@brief Statistics of the replay. */
+typedef struct
+{
+    uint32_t served;     ///< transfers answered from a record
+    uint32_t skipped;    ///< records passed over to find a matching one
+    uint32_t missed;     ///< transfers no record matched
+    uint32_t loops;      ///< times the trace was started over
+    uint32_t max_lag_us; ///< longest time a real time transfer ended after its recorded time
+} trace_replay_stats_t;
+
+/**
+ * @brief Replaces the trace served on the bus, the one embedded with
+ * CONFIG_APP_TRACE_REPLAY_FILE is used by default. The replay starts over
+ * with its time base at this call.
+ *
+ * @param[in] p_trace trace, it is used in place
+ * @param[in] size    size of the trace
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or a trace that is not valid.
+ */
+int trace_replay_load(const uint8_t * p_trace, const uint32_t size);
+
+/**
+ * @brief Sets the pace of the replay.
+ *
+ * @param[in] speed pace
+ */
+void trace_replay_speed_set(const enum trace_replay_speed speed);
+
+/**
+ * @brief Gets the statistics of the replay.
+ *
+ * @param[out] p_stats statistics
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int trace_replay_stats_get(trace_replay_stats_t * p_stats);
+#endif
+
+#endif // TRACE_H_
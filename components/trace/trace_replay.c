@@ -0,0 +1,314 @@
+/**
+ * @file      trace_replay.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     TWI backend for native_sim that serves a recorded trace. A
+ *            transfer is answered by the next record of the same device,
+ *            register, direction and length, records that the drivers do
+ *            not ask for again, like extra polls of a status register, are
+ *            passed over. Reads get the recorded bytes and every transfer
+ *            gets the recorded result, so retries and recoveries replay as
+ *            well. At the end the trace starts over.
+ *
+ * @version   0.1
+ * @date      2024-08-02
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "trace.h"
+#include "twi_port.h"
+
+LOG_MODULE_DECLARE(trace_component, CONFIG_APP_TRACE_LOG_LEVEL);
+
+#define REPLAY_LOOKAHEAD 32U  ///< records searched for a match before a transfer counts as missed
+
+#if defined(TRACE_REPLAY_EMBEDDED)
+// CONFIG_APP_TRACE_REPLAY_FILE, converted at build time
+static const uint8_t replay_embedded[] = {
+#include "trace_replay.inc"
+};
+#endif
+
+static struct k_spinlock       replay_lock;                 ///< protects the state below
+static const uint8_t *         p_replay       = NULL;       ///< trace being served
+static uint32_t                replay_size    = 0U;
+static uint32_t                replay_first   = 0U;         ///< offset of the first record
+static uint32_t                replay_next    = 0U;         ///< offset of the next record to match
+static int64_t                 replay_base    = 0;          ///< uptime in us at timestamp 0 of the current loop
+static uint32_t                replay_last_us = 0U;         ///< timestamp of the last record of the trace
+static enum trace_replay_speed replay_speed   =
+    IS_ENABLED(CONFIG_APP_TRACE_REPLAY_REALTIME) ? TRACE_REPLAY_REALTIME : TRACE_REPLAY_MAX_SPEED;
+static trace_replay_stats_t    stats          = { 0 };
+static bool                    enabled        = false;
+
+/**
+ * @brief Gets the uptime in microseconds.
+ */
+static int64_t replay_now_us(void)
+{
+    return (int64_t)k_ticks_to_us_floor64((uint64_t)k_uptime_ticks());
+}
+
+/**
+ * @brief Reads the record at an offset of the trace.
+ *
+ * @param[in]  offset   offset of the record
+ * @param[out] p_record record header
+ *
+ * @return offset of the record after it, or 0 if there is no complete record
+ * at the offset
+ */
+static uint32_t replay_record_get(const uint32_t offset, trace_record_t * p_record)
+{
+    uint32_t end;
+
+    if ((offset + sizeof(*p_record)) > replay_size)
+    {
+        return 0U;
+    }
+
+    memcpy(p_record, &p_replay[offset], sizeof(*p_record));
+    end = offset + sizeof(*p_record) + ((p_record->err == 0) ? p_record->length : 0U);
+
+    return (end <= replay_size) ? end : 0U;
+}
+
+/**
+ * @brief Tells whether a record answers a transfer.
+ */
+static bool replay_record_matches(const trace_record_t * p_record, const twi_port_xfer_t * p_xfer)
+{
+    const uint8_t flags = (p_xfer->read ? TRACE_FLAG_READ : 0U) | (p_xfer->has_reg ? TRACE_FLAG_HAS_REG : 0U);
+
+    return (p_record->address == p_xfer->address) &&
+           ((p_record->flags & (TRACE_FLAG_READ | TRACE_FLAG_HAS_REG)) == flags) &&
+           (!p_xfer->has_reg || (p_record->reg_address == p_xfer->reg_address)) &&
+           (p_record->length == p_xfer->length);
+}
+
+/**
+ * @brief Replaces the trace served on the bus, the one embedded with
+ * CONFIG_APP_TRACE_REPLAY_FILE is used by default. The replay starts over
+ * with its time base at this call.
+ */
+int trace_replay_load(const uint8_t * p_trace, const uint32_t size)
+{
+    trace_file_header_t header;
+    trace_record_t      record;
+    uint32_t            offset;
+    uint32_t            next;
+    uint32_t            last_us = 0U;
+    k_spinlock_key_t    key;
+
+    if ((p_trace == NULL) || (size < sizeof(header)))
+    {
+        return -EINVAL;
+    }
+
+    memcpy(&header, p_trace, sizeof(header));
+    if ((header.magic != TRACE_MAGIC) || (header.version != TRACE_VERSION) ||
+        (header.record_size != sizeof(trace_record_t)))
+    {
+        LOG_ERR("trace_replay_load:not a version %u trace", TRACE_VERSION);
+        return -EINVAL;
+    }
+
+    key = k_spin_lock(&replay_lock);
+
+    p_replay    = p_trace;
+    replay_size = size;
+
+    // the last timestamp is where the next loop starts
+    for (offset = sizeof(header); (next = replay_record_get(offset, &record)) != 0U; offset = next)
+    {
+        last_us = record.timestamp_us;
+    }
+
+    replay_first   = sizeof(header);
+    replay_next    = replay_first;
+    replay_last_us = last_us;
+    replay_base    = replay_now_us();
+    memset(&stats, 0, sizeof(stats));
+
+    k_spin_unlock(&replay_lock, key);
+
+    return 0;
+}
+
+/**
+ * @brief Sets the pace of the replay.
+ */
+void trace_replay_speed_set(const enum trace_replay_speed speed)
+{
+    replay_speed = speed;
+}
+
+/**
+ * @brief Gets the statistics of the replay.
+ */
+int trace_replay_stats_get(trace_replay_stats_t * p_stats)
+{
+    k_spinlock_key_t key;
+
+    if (p_stats == NULL)
+    {
+        return -EINVAL;
+    }
+
+    key      = k_spin_lock(&replay_lock);
+    *p_stats = stats;
+    k_spin_unlock(&replay_lock, key);
+
+    return 0;
+}
+
+/**
+ * @brief Loads the embedded trace, the pins only exist on real hardware.
+ */
+int twi_port_init(const uint32_t scl_pin, const uint32_t sda_pin)
+{
+    ARG_UNUSED(scl_pin);
+    ARG_UNUSED(sda_pin);
+
+#if defined(TRACE_REPLAY_EMBEDDED)
+    if (trace_replay_load(replay_embedded, sizeof(replay_embedded)) != 0)
+    {
+        return -ENOTTY;
+    }
+#endif
+
+    return 0;
+}
+
+/**
+ * @brief Records are only served while the bus is enabled.
+ */
+void twi_port_enable(void)
+{
+    enabled = true;
+}
+
+/**
+ * @brief Disables the bus, devices stop answering.
+ */
+void twi_port_disable(void)
+{
+    enabled = false;
+}
+
+/**
+ * @brief The recorded timestamps already carry the bus clock of the
+ * recording.
+ */
+void twi_port_frequency_set(const uint32_t frequency_hz)
+{
+    ARG_UNUSED(frequency_hz);
+}
+
+/**
+ * @brief Answers a transfer from the next matching record, waiting for its
+ * recorded time when replaying in real time.
+ */
+int twi_port_transfer(const twi_port_xfer_t * p_xfer, const k_timeout_t timeout)
+{
+    trace_record_t   record;
+    uint32_t         offset;
+    uint32_t         next;
+    uint32_t         loops   = 0U;
+    int64_t          base;
+    int64_t          due_us  = 0;
+    bool             matched = false;
+    int              err     = -ENXIO;
+    k_spinlock_key_t key;
+
+    ARG_UNUSED(timeout);
+
+    if (!p_xfer->read && (p_xfer->length > TWI_PORT_MAX_WRITE_LENGTH))
+    {
+        return -EINVAL;
+    }
+
+    key = k_spin_lock(&replay_lock);
+
+    if (!enabled || (p_replay == NULL))
+    {
+        k_spin_unlock(&replay_lock, key);
+        return -ENXIO;
+    }
+
+    // the search only moves the replay on when it finds a match
+    offset = replay_next;
+    base   = replay_base;
+    for (uint32_t i = 0U; i < REPLAY_LOOKAHEAD; i++)
+    {
+        next = replay_record_get(offset, &record);
+        if ((next == 0U) && (loops == 0U))
+        {
+            // end of the trace, the next loop starts after its last record
+            offset = replay_first;
+            base  += replay_last_us;
+            loops++;
+            next = replay_record_get(offset, &record);
+        }
+        if (next == 0U)
+        {
+            break;
+        }
+
+        if (replay_record_matches(&record, p_xfer))
+        {
+            if (p_xfer->read && (record.err == 0))
+            {
+                memcpy(p_xfer->p_data, &p_replay[offset + sizeof(record)], p_xfer->length);
+            }
+            err           = record.err;
+            due_us        = base + record.timestamp_us;
+            matched       = true;
+            replay_next   = next;
+            replay_base   = base;
+            stats.loops  += loops;
+            stats.skipped += i;
+            stats.served++;
+            break;
+        }
+
+        offset = next;
+    }
+
+    if (!matched)
+    {
+        stats.missed++;
+    }
+
+    k_spin_unlock(&replay_lock, key);
+
+    if (matched && (replay_speed == TRACE_REPLAY_REALTIME))
+    {
+        int64_t now_us = replay_now_us();
+
+        if (due_us > now_us)
+        {
+            (void)k_usleep((int32_t)MIN(due_us - now_us, INT32_MAX));
+        }
+        else
+        {
+            key              = k_spin_lock(&replay_lock);
+            stats.max_lag_us = MAX(stats.max_lag_us, (uint32_t)MIN(now_us - due_us, UINT32_MAX));
+            k_spin_unlock(&replay_lock, key);
+        }
+    }
+
+    return err;
+}
+
+/**
+ * @brief Nothing is ever stuck on a replayed bus, a recorded recovery shows
+ * up as the results of the transfers around it.
+ */
+int twi_port_bus_recover(void)
+{
+    return 0;
+}
@@ -0,0 +1,471 @@
+/**
+ * @file      tsalign.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     Timestamping of sensor samples and resampling of several
+ *            sensors onto a common timebase. Every sensor stream gets a
+ *            monotonic timestamp per sample, taken from its interrupt for
+ *            single reads and back-computed with the measured output data
+ *            rate for FIFO drains. The measured rate also gives the drift
+ *            of the sensor clock against the MCU clock. The resampler then
+ *            interpolates all streams at one output rate.
+ * 
+ * @version   0.1
+ * @date      2024-07-12
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "tsalign.h"
+
+LOG_MODULE_REGISTER(tsalign_component, CONFIG_APP_TSALIGN_LOG_LEVEL);
+
+#define TSALIGN_COEF_SHIFT  14  ///< fraction bits of the polyphase coefficients
+
+/**
+ * @brief Catmull-Rom cubic interpolation kernel, one row per phase, taps
+ * for the samples k-1, k, k+1 and k+2. Every row adds up to 1 << TSALIGN_COEF_SHIFT.
+ */
+static const int16_t tsalign_polyphase[TSALIGN_PHASES][TSALIGN_TAPS] = {
+    {      0,  16384,      0,      0 },  //  0/16
+    {   -450,  16230,    634,    -30 },  //  1/16
+    {   -784,  15792,   1488,   -112 },  //  2/16
+    {  -1014,  15106,   2526,   -234 },  //  3/16
+    {  -1152,  14208,   3712,   -384 },  //  4/16
+    {  -1210,  13134,   5010,   -550 },  //  5/16
+    {  -1200,  11920,   6384,   -720 },  //  6/16
+    {  -1134,  10602,   7798,   -882 },  //  7/16
+    {  -1024,   9216,   9216,  -1024 },  //  8/16
+    {   -882,   7798,  10602,  -1134 },  //  9/16
+    {   -720,   6384,  11920,  -1200 },  // 10/16
+    {   -550,   5010,  13134,  -1210 },  // 11/16
+    {   -384,   3712,  14208,  -1152 },  // 12/16
+    {   -234,   2526,  15106,  -1014 },  // 13/16
+    {   -112,   1488,  15792,   -784 },  // 14/16
+    {    -30,    634,  16230,   -450 },  // 15/16
+};
+
+BUILD_ASSERT((TSALIGN_HISTORY & (TSALIGN_HISTORY - 1U)) == 0U, "TSALIGN_HISTORY must be a power of 2");
+
+int64_t tsalign_now_us(void)
+{
+    return (int64_t)k_ticks_to_us_floor64((uint64_t)k_uptime_ticks());
+}
+
+/**
+ * @brief Takes the pending interrupt time, or the current time.
+ * 
+ * @param[in,out] p_stream stream
+ * @param[out]    p_from_irq set if the time comes from an interrupt
+ * 
+ * @return int64_t time in microseconds
+ */
+static int64_t tsalign_anchor_take(tsalign_stream_t * p_stream, bool * p_from_irq)
+{
+    k_spinlock_key_t key = k_spin_lock(&p_stream->lock);
+    int64_t          t_us = p_stream->irq_us;
+
+    p_stream->irq_us = 0;
+    k_spin_unlock(&p_stream->lock, key);
+
+    *p_from_irq = (t_us != 0);
+    return (t_us != 0) ? t_us : tsalign_now_us();
+}
+
+/**
+ * @brief Updates the measured period and the drift with the time between
+ * two anchors.
+ * 
+ * @param[in,out] p_stream stream
+ * @param[in]     t_us     time of the new anchor
+ * @param[in]     frames   samples produced since the previous anchor, 0 to derive it from the period
+ */
+static void tsalign_period_update(tsalign_stream_t * p_stream, int64_t t_us, uint32_t frames)
+{
+    int64_t  dt_ns;
+    int64_t  measured_ns;
+    int64_t  tolerance_ns;
+
+    if (p_stream->anchor_us != 0)
+    {
+        dt_ns = (t_us - p_stream->anchor_us) * 1000;
+
+        if ((frames == 0U) && (dt_ns > 0))
+        {
+            frames = (uint32_t)((dt_ns + (p_stream->period_ns / 2U)) / p_stream->period_ns);
+        }
+
+        if ((frames != 0U) && (dt_ns > 0))
+        {
+            measured_ns  = dt_ns / frames;
+            tolerance_ns = ((int64_t)p_stream->nominal_period_ns * TSALIGN_PERIOD_TOL_PCT) / 100;
+
+            // skipped interrupts or FIFO overruns give wrong frame counts, those measurements are dropped
+            if ((measured_ns > ((int64_t)p_stream->nominal_period_ns - tolerance_ns)) &&
+                (measured_ns < ((int64_t)p_stream->nominal_period_ns + tolerance_ns)))
+            {
+                p_stream->period_ns = (uint32_t)((int64_t)p_stream->period_ns +
+                                                 ((measured_ns - (int64_t)p_stream->period_ns) / (1 << TSALIGN_PERIOD_SHIFT)));
+                p_stream->drift_ppm = (int32_t)((((int64_t)p_stream->nominal_period_ns - (int64_t)p_stream->period_ns) * 1000000) /
+                                                (int64_t)p_stream->period_ns);
+            }
+        }
+    }
+
+    p_stream->anchor_us = t_us;
+}
+
+/**
+ * @brief Appends a tagged sample to the history of the stream.
+ * 
+ * @param[in,out] p_stream stream
+ * @param[in]     t_us     timestamp
+ * @param[in]     p_value  sample
+ * @param[out]    p_out    copy of the tagged sample, can be NULL
+ */
+static void tsalign_push(tsalign_stream_t * p_stream, int64_t t_us, const accel_values_t * p_value, tsalign_sample_t * p_out)
+{
+    tsalign_sample_t * p_sample = &p_stream->history[p_stream->count & (TSALIGN_HISTORY - 1U)];
+
+    p_sample->t_us  = t_us;
+    p_sample->value = *p_value;
+
+    p_stream->last_us = t_us;
+    p_stream->count++;
+
+    if (p_out != NULL)
+    {
+        *p_out = *p_sample;
+    }
+}
+
+int tsalign_stream_rate_set(tsalign_stream_t * p_stream, uint32_t odr_mhz)
+{
+    if ((p_stream == NULL) || (odr_mhz == 0U))
+    {
+        return -EINVAL;
+    }
+
+    p_stream->nominal_period_ns = (uint32_t)(1000000000000ULL / odr_mhz);
+    p_stream->period_ns         = p_stream->nominal_period_ns;
+    p_stream->drift_ppm         = 0;
+    p_stream->anchor_us         = 0;
+
+    return 0;
+}
+
+int tsalign_stream_init(tsalign_stream_t * p_stream, const char * p_name, uint32_t odr_mhz)
+{
+    if ((p_stream == NULL) || (odr_mhz == 0U))
+    {
+        return -EINVAL;
+    }
+
+    memset(p_stream, 0, sizeof(*p_stream));
+    p_stream->p_name = p_name;
+
+    return tsalign_stream_rate_set(p_stream, odr_mhz);
+}
+
+void tsalign_irq_stamp(tsalign_stream_t * p_stream)
+{
+    int64_t          t_us = tsalign_now_us();
+    k_spinlock_key_t key  = k_spin_lock(&p_stream->lock);
+
+    p_stream->irq_us = t_us;
+    k_spin_unlock(&p_stream->lock, key);
+}
+
+int tsalign_tag_single(tsalign_stream_t * p_stream, const accel_values_t * p_value, tsalign_sample_t * p_out)
+{
+    bool    from_irq;
+    int64_t t_us;
+
+    if ((p_stream == NULL) || (p_value == NULL))
+    {
+        return -EINVAL;
+    }
+
+    t_us = tsalign_anchor_take(p_stream, &from_irq);
+    tsalign_period_update(p_stream, t_us, 0U);
+
+    // timestamps stay monotonic even if the interrupt was stamped late
+    if (t_us <= p_stream->last_us)
+    {
+        t_us = p_stream->last_us + 1;
+    }
+
+    tsalign_push(p_stream, t_us, p_value, p_out);
+    return 0;
+}
+
+int tsalign_tag_fifo(tsalign_stream_t * p_stream, const accel_values_t * p_values, uint16_t count, tsalign_sample_t * p_out)
+{
+    bool    from_irq;
+    int64_t anchor_us;
+    int64_t estimate_us;
+    int64_t newest_us;
+    int64_t period_us;
+
+    if ((p_stream == NULL) || (p_values == NULL))
+    {
+        return -EINVAL;
+    }
+
+    if (count == 0U)
+    {
+        return 0;
+    }
+
+    anchor_us = tsalign_anchor_take(p_stream, &from_irq);
+    tsalign_period_update(p_stream, anchor_us, count);
+
+    period_us = p_stream->period_ns / 1000U;
+
+    // without an interrupt the newest sample was taken somewhere in the last period
+    estimate_us = from_irq ? anchor_us : (anchor_us - (period_us / 2));
+
+    newest_us = p_stream->last_us + ((int64_t)count * p_stream->period_ns) / 1000;
+    if ((p_stream->last_us == 0) ||
+        (estimate_us - newest_us > period_us) ||
+        (newest_us - estimate_us > period_us))
+    {
+        // first drain, or samples were lost
+        if (p_stream->last_us != 0)
+        {
+            p_stream->resyncs++;
+            LOG_WRN("%s timestamps resynchronized by %d us", p_stream->p_name, (int32_t)(estimate_us - newest_us));
+        }
+        newest_us = estimate_us;
+    }
+    else
+    {
+        // continuous, only a fraction of the measured error is corrected so the drain time does not add jitter
+        newest_us += (estimate_us - newest_us) / 8;
+    }
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        int64_t t_us = newest_us - ((int64_t)(count - 1U - i) * p_stream->period_ns) / 1000;
+
+        if (t_us <= p_stream->last_us)
+        {
+            t_us = p_stream->last_us + 1;
+        }
+
+        tsalign_push(p_stream, t_us, &p_values[i], (p_out != NULL) ? &p_out[i] : NULL);
+    }
+
+    return 0;
+}
+
+int tsalign_resampler_init(tsalign_resampler_t * p_resampler, uint32_t out_rate_hz, enum tsalign_interp interp)
+{
+    if ((p_resampler == NULL) || (out_rate_hz == 0U))
+    {
+        return -EINVAL;
+    }
+
+    memset(p_resampler, 0, sizeof(*p_resampler));
+    p_resampler->interp        = interp;
+    p_resampler->out_period_us = 1000000U / out_rate_hz;
+
+    return 0;
+}
+
+int tsalign_resampler_add(tsalign_resampler_t * p_resampler, tsalign_stream_t * p_stream)
+{
+    if ((p_resampler == NULL) || (p_stream == NULL))
+    {
+        return -EINVAL;
+    }
+
+    if (p_resampler->stream_count >= TSALIGN_MAX_STREAMS)
+    {
+        return -ENOMEM;
+    }
+
+    p_resampler->p_streams[p_resampler->stream_count++] = p_stream;
+    return 0;
+}
+
+/**
+ * @brief Gets a sample from the history.
+ * 
+ * @param[in] p_stream stream
+ * @param[in] index    index of the sample, from the start of the stream
+ * 
+ * @return const tsalign_sample_t* the sample
+ */
+static inline const tsalign_sample_t * tsalign_at(const tsalign_stream_t * p_stream, uint32_t index)
+{
+    return &p_stream->history[index & (TSALIGN_HISTORY - 1U)];
+}
+
+/**
+ * @brief Gets the index of the oldest sample still in the history.
+ * 
+ * @param[in] p_stream stream
+ * 
+ * @return uint32_t index of the sample, from the start of the stream
+ */
+static inline uint32_t tsalign_oldest(const tsalign_stream_t * p_stream)
+{
+    return (p_stream->count > TSALIGN_HISTORY) ? (p_stream->count - TSALIGN_HISTORY) : 0U;
+}
+
+static inline int16_t tsalign_clamp(int32_t value)
+{
+    return (int16_t)CLAMP(value, INT16_MIN, INT16_MAX);
+}
+
+/**
+ * @brief Interpolates one axis.
+ * 
+ * @param[in] p_taps  the four samples k-1 to k+2, only k and k+1 are used for the linear interpolation
+ * @param[in] axis    offset of the axis in accel_values_t
+ * @param[in] num     time from sample k
+ * @param[in] den     time from sample k to sample k+1
+ * @param[in] polyphase true for the polyphase interpolation
+ * 
+ * @return int16_t interpolated value
+ */
+static int16_t tsalign_interp_axis(const tsalign_sample_t * p_taps[TSALIGN_TAPS], size_t axis, int64_t num, int64_t den, bool polyphase)
+{
+    int32_t v[TSALIGN_TAPS];
+
+    for (uint8_t i = 0; i < TSALIGN_TAPS; i++)
+    {
+        v[i] = (p_taps[i] != NULL) ? *(const int16_t *)((const uint8_t *)&p_taps[i]->value + axis) : 0;
+    }
+
+    if (!polyphase)
+    {
+        return tsalign_clamp(v[1] + (int32_t)(((int64_t)(v[2] - v[1]) * num) / den));
+    }
+
+    const int16_t * p_coef = tsalign_polyphase[MIN((uint32_t)((num * TSALIGN_PHASES) / den), TSALIGN_PHASES - 1U)];
+    int64_t         sum    = 0;
+
+    for (uint8_t i = 0; i < TSALIGN_TAPS; i++)
+    {
+        sum += (int64_t)p_coef[i] * v[i];
+    }
+
+    return tsalign_clamp((int32_t)((sum + (1 << (TSALIGN_COEF_SHIFT - 1))) >> TSALIGN_COEF_SHIFT));
+}
+
+/**
+ * @brief Interpolates one stream at a time.
+ * 
+ * @param[in]  p_stream  stream
+ * @param[in]  t_us      time
+ * @param[in]  interp    interpolation
+ * @param[out] p_value   interpolated sample
+ * 
+ * @return 0 on success
+ * @return -EAGAIN if the stream has no sample after t_us yet
+ * @return -ERANGE if t_us is older than the history of the stream.
+ */
+static int tsalign_interp_stream(const tsalign_stream_t * p_stream, int64_t t_us, enum tsalign_interp interp, accel_values_t * p_value)
+{
+    const tsalign_sample_t * p_taps[TSALIGN_TAPS];
+    uint32_t                 oldest = tsalign_oldest(p_stream);
+    uint32_t                 k;
+    uint32_t                 needed = (interp == TSALIGN_POLYPHASE) ? 2U : 1U;
+    bool                     polyphase;
+
+    if ((p_stream->count < 2U) || (tsalign_at(p_stream, p_stream->count - 1U)->t_us < t_us))
+    {
+        return -EAGAIN;
+    }
+
+    if (tsalign_at(p_stream, oldest)->t_us > t_us)
+    {
+        return -ERANGE;
+    }
+
+    // newest sample at or before t_us
+    k = p_stream->count - 1U;
+    while ((k > oldest) && (tsalign_at(p_stream, k)->t_us > t_us))
+    {
+        k--;
+    }
+
+    if (k == (p_stream->count - 1U))
+    {
+        k--;
+    }
+
+    // wait for the look-ahead tap, so the output does not depend on when it is asked for
+    if ((k + needed) >= p_stream->count)
+    {
+        return -EAGAIN;
+    }
+
+    polyphase = (interp == TSALIGN_POLYPHASE) && (k > oldest);
+
+    p_taps[0] = polyphase ? tsalign_at(p_stream, k - 1U) : NULL;
+    p_taps[1] = tsalign_at(p_stream, k);
+    p_taps[2] = tsalign_at(p_stream, k + 1U);
+    p_taps[3] = polyphase ? tsalign_at(p_stream, k + 2U) : NULL;
+
+    int64_t num = t_us - p_taps[1]->t_us;
+    int64_t den = p_taps[2]->t_us - p_taps[1]->t_us;
+
+    p_value->x = tsalign_interp_axis(p_taps, offsetof(accel_values_t, x), num, den, polyphase);
+    p_value->y = tsalign_interp_axis(p_taps, offsetof(accel_values_t, y), num, den, polyphase);
+    p_value->z = tsalign_interp_axis(p_taps, offsetof(accel_values_t, z), num, den, polyphase);
+
+    return 0;
+}
+
+int tsalign_resampler_next(tsalign_resampler_t * p_resampler, int64_t * p_t_us, accel_values_t * p_values)
+{
+    int err;
+
+    if ((p_resampler == NULL) || (p_t_us == NULL) || (p_values == NULL) || (p_resampler->stream_count == 0U))
+    {
+        return -EINVAL;
+    }
+
+    if (p_resampler->next_us == 0)
+    {
+        // starts once every stream has a sample, at the latest first sample
+        for (uint8_t i = 0; i < p_resampler->stream_count; i++)
+        {
+            const tsalign_stream_t * p_stream = p_resampler->p_streams[i];
+
+            if (p_stream->count == 0U)
+            {
+                return -EAGAIN;
+            }
+
+            p_resampler->next_us = MAX(p_resampler->next_us, tsalign_at(p_stream, tsalign_oldest(p_stream))->t_us);
+        }
+    }
+
+    for (uint8_t i = 0; i < p_resampler->stream_count; i++)
+    {
+        err = tsalign_interp_stream(p_resampler->p_streams[i], p_resampler->next_us, p_resampler->interp, &p_values[i]);
+        if (err == -ERANGE)
+        {
+            // the stream moved on while the output was waiting for another one, restart the outputs from the samples still available
+            p_resampler->skipped++;
+            p_resampler->next_us = 0;
+            return -EAGAIN;
+        }
+
+        if (err != 0)
+        {
+            return err;
+        }
+    }
+
+    *p_t_us = p_resampler->next_us;
+    p_resampler->next_us += p_resampler->out_period_us;
+
+    return 0;
+}
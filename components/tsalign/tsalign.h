@@ -0,0 +1,183 @@
+/**
+ * @file      tsalign.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     Timestamping of sensor samples and resampling of several
+ *            sensors onto a common timebase. Every sensor stream gets a
+ *            monotonic timestamp per sample, taken from its interrupt for
+ *            single reads and back-computed with the measured output data
+ *            rate for FIFO drains. The measured rate also gives the drift
+ *            of the sensor clock against the MCU clock. The resampler then
+ *            interpolates all streams at one output rate.
+ * 
+ * @version   0.1
+ * @date      2024-07-12
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef TSALIGN_H_
+#define TSALIGN_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+#include "sensor_types.h"
+
+#define TSALIGN_HISTORY         32U   ///< samples kept per stream, a power of 2 covering a full FIFO drain and the look-ahead of the slowest stream
+#define TSALIGN_MAX_STREAMS     4U    ///< streams one resampler can align
+#define TSALIGN_PHASES          16U   ///< phases of the polyphase interpolation filter
+#define TSALIGN_TAPS            4U    ///< taps per phase of the polyphase interpolation filter
+#define TSALIGN_PERIOD_SHIFT    5U    ///< weight of a new period measurement is 1 / 2^TSALIGN_PERIOD_SHIFT
+#define TSALIGN_PERIOD_TOL_PCT  10U   ///< period measurements further than this from the nominal period are dropped
+
+/**@brief Interpolation used by the resampler. */
+enum tsalign_interp
+{
+    TSALIGN_LINEAR = 0,  // Linear interpolation between the two neighbouring samples
+    TSALIGN_POLYPHASE,   // 4 tap cubic interpolation with 16 precomputed phases
+};
+
+/**@brief A timestamped sample. */
+typedef struct
+{
+    int64_t        t_us;   ///< time the sample was taken, on the uptime timebase
+    accel_values_t value;  ///< the sample
+} tsalign_sample_t;
+
+/**@brief A stream of samples from one sensor. */
+typedef struct
+{
+    const char *      p_name;              ///< name of the sensor, for the logs
+    uint32_t          nominal_period_ns;   ///< period from the configured output data rate
+    uint32_t          period_ns;           ///< measured period, on the MCU clock
+    int32_t           drift_ppm;           ///< how much faster the sensor clock runs than the MCU clock
+    int64_t           irq_us;              ///< time of the last data-ready interrupt, 0 if none is pending
+    int64_t           anchor_us;           ///< time of the last interrupt or drain used for the period measurement
+    uint32_t          frames_since_anchor; ///< samples tagged since anchor_us
+    int64_t           last_us;             ///< timestamp of the last tagged sample, 0 before the first one
+    uint32_t          resyncs;             ///< times the timestamps jumped to the measured time after a gap
+    uint32_t          count;               ///< samples tagged since the init
+    tsalign_sample_t  history[TSALIGN_HISTORY];  ///< last samples, indexed by count modulo TSALIGN_HISTORY
+    struct k_spinlock lock;                ///< protects irq_us against the interrupt
+} tsalign_stream_t;
+
+/**@brief Aligns several streams onto one output rate. */
+typedef struct
+{
+    tsalign_stream_t *  p_streams[TSALIGN_MAX_STREAMS];  ///< aligned streams
+    uint8_t             stream_count;                    ///< number of streams
+    enum tsalign_interp interp;                          ///< interpolation
+    uint32_t            out_period_us;                   ///< output period
+    int64_t             next_us;                         ///< time of the next output, 0 before the first one
+    uint32_t            skipped;                         ///< restarts of the outputs because a stream had moved past them
+} tsalign_resampler_t;
+
+/**
+ * @brief Gets the current time on the timebase of the timestamps.
+ * 
+ * @return int64_t microseconds since boot
+ */
+int64_t tsalign_now_us(void);
+
+/**
+ * @brief Initializes a stream.
+ * 
+ * @param[out] p_stream stream
+ * @param[in]  p_name   name of the sensor
+ * @param[in]  odr_mhz  configured output data rate in mHz
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or a zero rate.
+ */
+int tsalign_stream_init(tsalign_stream_t * p_stream, const char * p_name, uint32_t odr_mhz);
+
+/**
+ * @brief Changes the nominal output data rate, after the sensor rate was
+ * changed. The measured period restarts from the new nominal one.
+ * 
+ * @param[in,out] p_stream stream
+ * @param[in]     odr_mhz  new output data rate in mHz
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or a zero rate.
+ */
+int tsalign_stream_rate_set(tsalign_stream_t * p_stream, uint32_t odr_mhz);
+
+/**
+ * @brief Records the time of a data-ready or FIFO watermark interrupt. To be
+ * called from the ISR, the next tag call uses it.
+ * 
+ * @param[in,out] p_stream stream
+ */
+void tsalign_irq_stamp(tsalign_stream_t * p_stream);
+
+/**
+ * @brief Tags a single read sample with the time of the pending interrupt,
+ * or with the current time if there is none.
+ * 
+ * @param[in,out] p_stream stream
+ * @param[in]     p_value  sample
+ * @param[out]    p_out    timestamped sample, can be NULL
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int tsalign_tag_single(tsalign_stream_t * p_stream, const accel_values_t * p_value, tsalign_sample_t * p_out);
+
+/**
+ * @brief Tags the samples of a FIFO drain, oldest first. The newest sample
+ * is taken at the time of the pending interrupt or at the current time, the
+ * others one measured period apart. Samples that continue the previous
+ * drain within one period keep the spacing of the stream instead, so the
+ * timestamps do not jitter with the drain time.
+ * 
+ * @param[in,out] p_stream stream
+ * @param[in]     p_values samples
+ * @param[in]     count    number of samples
+ * @param[out]    p_out    timestamped samples, count entries, can be NULL
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int tsalign_tag_fifo(tsalign_stream_t * p_stream, const accel_values_t * p_values, uint16_t count, tsalign_sample_t * p_out);
+
+/**
+ * @brief Initializes a resampler.
+ * 
+ * @param[out] p_resampler resampler
+ * @param[in]  out_rate_hz output rate
+ * @param[in]  interp      interpolation
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or a zero rate.
+ */
+int tsalign_resampler_init(tsalign_resampler_t * p_resampler, uint32_t out_rate_hz, enum tsalign_interp interp);
+
+/**
+ * @brief Adds a stream to a resampler.
+ * 
+ * @param[in,out] p_resampler resampler
+ * @param[in]     p_stream    stream
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer
+ * @return -ENOMEM if the resampler has TSALIGN_MAX_STREAMS streams already.
+ */
+int tsalign_resampler_add(tsalign_resampler_t * p_resampler, tsalign_stream_t * p_stream);
+
+/**
+ * @brief Produces the next output, if every stream has samples on both
+ * sides of its time. Called in a loop after new samples were tagged, until
+ * it returns -EAGAIN.
+ * 
+ * @param[in,out] p_resampler resampler
+ * @param[out]    p_t_us      time of the output
+ * @param[out]    p_values    one interpolated sample per stream, in the order they were added
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or a resampler without streams
+ * @return -EAGAIN if a stream has no sample after the next output time yet.
+ */
+int tsalign_resampler_next(tsalign_resampler_t * p_resampler, int64_t * p_t_us, accel_values_t * p_values);
+
+#endif // TSALIGN_H_
@@ -3,41 +3,552 @@
  * @author    Usman Mehmood (usmanmehmood55@gmail.com)
  * 
  * @brief     This is a very rudimentary implementation of a TWI or i2c library
- *            using the nrfx library. The read-write functions can be modified
- *            and expanded into more functions such as single-register read/write,
- *            non-stop write, device scanning etc.
+ *            on top of a peripheral backend, see twi_port.h. Every transfer
+ *            owns the bus through the arbiter, is bounded by a timeout and is
+ *            retried, with a bus recovery when the bus looks stuck.
  * 
  * @version   0.1
  * @date      2023-08-14
  * @copyright 2023, Usman Mehmood
  */
 
+
 #include <zephyr/kernel.h>
-#include <zephyr/irq.h>
-#include <nrfx_twi.h>
 #include <zephyr/logging/log.h>
 #include "twi.h"
+#include "twi_arbiter.h"
+#include "twi_port.h"
 #include "utils.h"
+#if defined(CONFIG_APP_EVLOG)
+#include "evlog.h"
+#endif
+
+LOG_MODULE_REGISTER(twi_component, CONFIG_APP_TWI_LOG_LEVEL);
+
+#define NO_DEADLINE       0U            ///< 0 -> request the bus without a deadline
+#define THREAD_PRIO_SLOTS 4U            ///< number of threads that can have a non default priority class
+
+/**
+ * @brief Threads whose calls without transfer options are not in the
+ * TWI_PRIO_NORMAL class. Kept tiny since it is scanned on every call.
+ */
+static struct
+{
+    k_tid_t       thread;
+    enum twi_prio prio;
+} thread_prio[THREAD_PRIO_SLOTS] = { 0 };
+
+static uint32_t policy_timeout_us = TWI_DEFAULT_TIMEOUT_US;  ///< timeout of the calls without transfer options
+static uint8_t  policy_retries    = TWI_DEFAULT_RETRIES;     ///< retries of the calls without transfer options
+
+#if defined(CONFIG_APP_TWI_STATS)
+static struct k_spinlock    stats_lock;             ///< protects recovery_stats
+static twi_recovery_stats_t recovery_stats = { 0 }; ///< failed transfers and bus recoveries
+
+#define TWI_STATS_COUNT(counter) twi_stats_count(&recovery_stats.counter)
+#else
+#define TWI_STATS_COUNT(counter) do { } while (0)
+#endif
+
+#if defined(CONFIG_APP_TWI_TAP)
+static twi_port_tap_t xfer_tap = NULL;  ///< observer of every transfer attempt
+#endif
+
+static const uint32_t speed_hz[TWI_SPEED_COUNT] = { 100000U, 250000U, 400000U };
+
+static const twi_speed_profile_t * p_speed_profiles    = NULL;            ///< bus clock of each device
+static uint8_t                     speed_profile_count = 0U;
+static enum twi_speed              bus_speed           = TWI_SPEED_100K;  ///< clock the peripheral runs at, NRFX_TWI_DEFAULT_CONFIG
+static bool                        bus_powered         = false;           ///< the peripheral is enabled
+static int64_t                     powered_ticks       = 0;               ///< uptime the peripheral was last enabled at
+
+#if defined(CONFIG_APP_TWI_POWER_GATING)
+static bool     bus_enabled = false;                      ///< set by twi_enable, transfers power the peripheral up
+static uint32_t idle_off_us = CONFIG_APP_TWI_IDLE_OFF_US; ///< idle time before powering down, 0 for never
+
+static void twi_idle_work_fn(struct k_work * p_work);
+static K_WORK_DELAYABLE_DEFINE(idle_work, twi_idle_work_fn);
+#endif
+
+#if defined(CONFIG_APP_TWI_STATS)
+static twi_power_stats_t power_stats = { 0 };  ///< bus activity, protected by stats_lock
+
+#define TWI_STATS_LATENCY(counter, total, max, cycles) twi_stats_latency(&power_stats.counter, &power_stats.total, &power_stats.max, (cycles))
+#else
+#define TWI_STATS_LATENCY(counter, total, max, cycles) ((void)(cycles))
+#endif
+
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+static twi_stream_config_t stream_config;         ///< running stream
+static bool                stream_active = false; ///< set and cleared with the bus owned
+static volatile uint8_t    stream_block;          ///< last full block
+static struct k_spinlock   stream_lock;           ///< protects stream_stats
+static twi_stream_stats_t  stream_stats = { 0 };
+
+static void twi_stream_work_fn(struct k_work * p_work);
+static K_WORK_DEFINE(stream_work, twi_stream_work_fn);
+#endif
+
+/**
+ * @brief Looks up the priority class of the calling thread.
+ * 
+ * @return the class set through \ref twi_thread_prio_set, or TWI_PRIO_NORMAL
+ */
+static enum twi_prio twi_current_prio(void)
+{
+    const k_tid_t current = k_current_get();
+
+    for (uint8_t i = 0U; i < THREAD_PRIO_SLOTS; i++)
+    {
+        if (thread_prio[i].thread == current)
+        {
+            return thread_prio[i].prio;
+        }
+    }
+
+    return TWI_PRIO_NORMAL;
+}
+
+/**
+ * @brief Fills the options of a call that does not take any.
+ * 
+ * @param[out] p_opts options of the calling thread and the current policy
+ */
+static void twi_current_opts(twi_xfer_opts_t * p_opts)
+{
+    p_opts->prio        = twi_current_prio();
+    p_opts->deadline_us = NO_DEADLINE;
+    p_opts->timeout_us  = policy_timeout_us;
+    p_opts->retries     = policy_retries;
+}
+
+/**
+ * @brief Converts a timeout in microseconds into a kernel timeout.
+ * 
+ * @param[in] timeout_us timeout, 0 waits forever
+ * 
+ * @return the kernel timeout
+ */
+static k_timeout_t twi_timeout(const uint32_t timeout_us)
+{
+    return (timeout_us == 0U) ? K_FOREVER : K_USEC(timeout_us);
+}
+
+/**
+ * @brief Increments one of the recovery statistics counters.
+ * 
+ * @param[in] p_counter counter inside recovery_stats
+ */
+#if defined(CONFIG_APP_TWI_STATS)
+static void twi_stats_count(uint32_t * p_counter)
+{
+    k_spinlock_key_t key = k_spin_lock(&stats_lock);
+    (*p_counter)++;
+    k_spin_unlock(&stats_lock, key);
+}
+#endif
+
+#if defined(CONFIG_APP_TWI_STATS)
+/**
+ * @brief Records the latency of a power up or a clock switch.
+ * 
+ * @param[in,out] p_count    number of events
+ * @param[in,out] p_total_ns summed latency
+ * @param[in,out] p_max_ns   longest latency
+ * @param[in]     cycles     latency of this event
+ */
+static void twi_stats_latency(uint32_t * p_count, uint64_t * p_total_ns, uint32_t * p_max_ns, const uint32_t cycles)
+{
+    const uint32_t   ns  = (uint32_t)MIN(k_cyc_to_ns_floor64(cycles), UINT32_MAX);
+    k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+    (*p_count)++;
+    *p_total_ns += ns;
+    *p_max_ns    = MAX(*p_max_ns, ns);
+
+    k_spin_unlock(&stats_lock, key);
+}
+#endif
+
+#if defined(CONFIG_APP_TWI_STATS)
+/**
+ * @brief Adds the time a caller spent in a transfer call.
+ * 
+ * @param[in] call_start cycle count at the start of the call
+ */
+static void twi_stats_call(const uint32_t call_start)
+{
+    const uint32_t   call_us = k_cyc_to_us_floor32(k_cycle_get_32() - call_start);
+    k_spinlock_key_t key     = k_spin_lock(&stats_lock);
 
-LOG_MODULE_REGISTER(twi_component, LOG_LEVEL_INF);
+    power_stats.call_us += call_us;
 
-#define TWI_INSTANCE_ID   0             ///< 0 -> NRFX_TWI0, which has been configured in prj.conf
-#define NO_FLAGS          (uint32_t)0U  ///< 0 -> default settings for nrfx_twi_xfer
-#define NO_CONTEXT        NULL          ///< NULL -> no context passed to nrfx_twi_init 
-#define NO_HANDLER        NULL          ///< NULL -> no event handler passed to nrfx_twi_init 
+    k_spin_unlock(&stats_lock, key);
+}
+#else
+#define twi_stats_call(call_start) do { } while (0)
+#endif
 
 /**
- * @brief Used to ensure thread safety of the TWI peripheral, and its functioning
- * as a singleton.
+ * @brief Powers the peripheral up or down and accounts for the time it was
+ * powered. The bus must be owned.
+ * 
+ * @param[in] on true to enable the peripheral
  */
-static struct k_mutex twi_mutex = { 0 };
+static void twi_power_set(const bool on)
+{
+    if (on == bus_powered)
+    {
+        return;
+    }
+
+    if (on)
+    {
+        twi_port_enable();
+        powered_ticks = k_uptime_ticks();
+    }
+    else
+    {
+        twi_port_disable();
+#if defined(CONFIG_APP_TWI_STATS)
+        const uint64_t   powered_us = k_ticks_to_us_floor64((uint64_t)(k_uptime_ticks() - powered_ticks));
+        k_spinlock_key_t key        = k_spin_lock(&stats_lock);
+        power_stats.powered_us += powered_us;
+        k_spin_unlock(&stats_lock, key);
+#endif
+    }
+
+    bus_powered = on;
+}
 
 /**
- * @brief This instance is being set/populated by the NRFX_TWI_INSTANCE macro
- * which gives all the relevant parameters to a nrfx_twi_t variable. Any use
- * of this instance must be guarded by the twi_mutex lock.
+ * @brief Looks up the bus clock of a device.
+ * 
+ * @param[in] address device address
+ * 
+ * @return the clock of its profile, or TWI_SPEED_100K
  */
-static const nrfx_twi_t twi_instance = NRFX_TWI_INSTANCE(TWI_INSTANCE_ID);
+static enum twi_speed twi_device_speed(const uint8_t address)
+{
+    for (uint8_t i = 0U; i < speed_profile_count; i++)
+    {
+        if (p_speed_profiles[i].address == address)
+        {
+            return p_speed_profiles[i].speed;
+        }
+    }
+
+    return TWI_SPEED_100K;
+}
+
+/**
+ * @brief Gets the peripheral ready for a transfer to a device, powering it
+ * up and switching the bus clock when needed. The bus must be owned.
+ * 
+ * @param[in] address device address
+ */
+static void twi_bus_prepare(const uint8_t address)
+{
+    const enum twi_speed speed = twi_device_speed(address);
+    uint32_t             start;
+
+#if defined(CONFIG_APP_TWI_POWER_GATING)
+    if (bus_enabled && !bus_powered)
+    {
+        start = k_cycle_get_32();
+        twi_power_set(true);
+        TWI_STATS_LATENCY(power_ups, power_up_ns, power_up_max_ns, k_cycle_get_32() - start);
+    }
+#endif
+
+    if (speed != bus_speed)
+    {
+        start = k_cycle_get_32();
+        twi_port_frequency_set(speed_hz[speed]);
+        bus_speed = speed;
+        TWI_STATS_LATENCY(speed_changes, speed_change_ns, speed_change_max_ns, k_cycle_get_32() - start);
+    }
+}
+
+/**
+ * @brief Holds the triggers of a running stream back while the bus is used
+ * for other transfers, or lets them run again. The bus must be owned.
+ * 
+ * @param[in] hold true before the transfers, false once they are done
+ */
+static void twi_stream_hold(const bool hold)
+{
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+    bool             replayed = false;
+    k_spinlock_key_t key;
+
+    if (!stream_active)
+    {
+        return;
+    }
+
+    if (hold)
+    {
+        twi_port_stream_pause();
+    }
+    else
+    {
+        replayed = twi_port_stream_resume();
+    }
+
+    key = k_spin_lock(&stream_lock);
+    stream_stats.pauses  += hold ? 1U : 0U;
+    stream_stats.replays += replayed ? 1U : 0U;
+    k_spin_unlock(&stream_lock, key);
+#else
+    ARG_UNUSED(hold);
+#endif
+}
+
+#if defined(CONFIG_APP_TWI_POWER_GATING)
+/**
+ * @brief Powers the peripheral down once the bus has been idle for the idle
+ * time. Every transfer pushes this back.
+ */
+static void twi_idle_work_fn(struct k_work * p_work)
+{
+    ARG_UNUSED(p_work);
+
+    if (twi_arbiter_acquire(TWI_PRIO_BACKGROUND, NO_DEADLINE, K_NO_WAIT) != 0)
+    {
+        // a transfer is running, it pushes the power down back anyway
+        (void)k_work_reschedule(&idle_work, K_USEC(idle_off_us));
+        return;
+    }
+
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+    // a stream needs the peripheral between its triggers
+    if (bus_powered && !stream_active)
+#else
+    if (bus_powered)
+#endif
+    {
+        twi_power_set(false);
+#if defined(CONFIG_APP_TWI_STATS)
+        k_spinlock_key_t key = k_spin_lock(&stats_lock);
+        power_stats.power_downs++;
+        k_spin_unlock(&stats_lock, key);
+#endif
+    }
+
+    (void)twi_arbiter_release();
+}
+#endif
+
+/**
+ * @brief Recovers the bus and records how long it took. The bus must be owned.
+ * 
+ * @return 0 on success
+ * @return -EIO if SDA is still held low.
+ */
+static int twi_recover_owned(void)
+{
+    const int64_t start = k_uptime_ticks();
+    const int err = twi_port_bus_recover();
+    const uint32_t duration_us = (uint32_t)k_ticks_to_us_floor64((uint64_t)(k_uptime_ticks() - start));
+
+#if defined(CONFIG_APP_TWI_STATS)
+    k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+    recovery_stats.recoveries++;
+    if (err != 0)
+    {
+        recovery_stats.recovery_failures++;
+    }
+    recovery_stats.last_recovery_us   = duration_us;
+    recovery_stats.total_recovery_us += duration_us;
+    if (duration_us > recovery_stats.max_recovery_us)
+    {
+        recovery_stats.max_recovery_us = duration_us;
+    }
+
+    k_spin_unlock(&stats_lock, key);
+#endif
+
+#if defined(CONFIG_APP_EVLOG)
+    evlog_put(EVLOG_TWI_RECOVERY, 0U, 0U, err, duration_us);
+#else
+    LOG_WRN("twi_recover_owned:bus recovery took %u us, err: %d", duration_us, err);
+#endif
+
+    return err;
+}
+
+/**
+ * @brief Runs a transfer on the owned bus, retrying it as configured. NACKs
+ * are simply retried, anything that may have left the bus or the peripheral
+ * stuck is followed by a bus recovery first.
+ * 
+ * @param[in] p_xfer   transfer to run
+ * @param[in] p_opts   transfer options
+ * @param[in] timeout  bound on each attempt
+ * @param[in] p_caller name of the public function, for the error message,
+ *                     unused with CONFIG_APP_EVLOG where the event carries
+ *                     the direction instead
+ * 
+ * @return 0 on success
+ * @return -ETIMEDOUT if the last attempt timed out
+ * @return -ENOTTY on error.
+ */
+static int twi_transfer_owned(const twi_port_xfer_t * p_xfer, const twi_xfer_opts_t * p_opts, const k_timeout_t timeout,
+                              const char * p_caller)
+{
+    int xfer_err = 0;
+
+#if defined(CONFIG_APP_EVLOG)
+    ARG_UNUSED(p_caller);
+#endif
+
+    twi_bus_prepare(p_xfer->address);
+
+#if defined(CONFIG_APP_TWI_STATS)
+    const uint32_t busy_start = k_cycle_get_32();
+#endif
+
+    for (uint8_t attempt = 0U; attempt <= p_opts->retries; attempt++)
+    {
+        if (attempt != 0U)
+        {
+            TWI_STATS_COUNT(retries);
+        }
+
+        xfer_err = twi_port_transfer(p_xfer, timeout);
+#if defined(CONFIG_APP_TWI_TAP)
+        const twi_port_tap_t tap = xfer_tap;
+        if (tap != NULL)
+        {
+            tap(p_xfer, xfer_err);
+        }
+#endif
+        if (xfer_err == 0)
+        {
+            break;
+        }
+
+        if ((xfer_err == -ENXIO) || (xfer_err == -EIO))
+        {
+            TWI_STATS_COUNT(nacks);
+        }
+        else
+        {
+            if (xfer_err == -ETIMEDOUT)
+            {
+                TWI_STATS_COUNT(xfer_timeouts);
+            }
+            (void)twi_recover_owned();
+        }
+    }
+
+#if defined(CONFIG_APP_TWI_STATS)
+    const uint32_t   busy_us = k_cyc_to_us_floor32(k_cycle_get_32() - busy_start);
+    k_spinlock_key_t key     = k_spin_lock(&stats_lock);
+    power_stats.busy_us += busy_us;
+    k_spin_unlock(&stats_lock, key);
+#endif
+
+    if (xfer_err == 0)
+    {
+        return 0;
+    }
+
+    TWI_STATS_COUNT(failures);
+#if defined(CONFIG_APP_EVLOG)
+    evlog_put(p_xfer->read ? EVLOG_TWI_READ_FAILED : EVLOG_TWI_WRITE_FAILED, p_xfer->address,
+              p_xfer->reg_address, xfer_err, p_opts->retries + 1U);
+#else
+    LOG_ERR("%s:transfer to device 0x%02X register 0x%02X failed after %u attempts with error: %d",
+            p_caller, p_xfer->address, p_xfer->reg_address, p_opts->retries + 1U, xfer_err);
+#endif
+
+    return (xfer_err == -ETIMEDOUT) ? -ETIMEDOUT : -ENOTTY;
+}
+
+/**
+ * @brief Owns the bus once and runs one or more transfers on it, each with
+ * its own retries. A transfer that fails does not stop the ones after it.
+ * 
+ * @param[in]  p_xfers  transfers to run, in order
+ * @param[in]  count    number of transfers
+ * @param[in]  p_opts   transfer options
+ * @param[in]  p_caller name of the public function, for the error message
+ * @param[out] p_errs   result of every transfer, NULL if not needed
+ * 
+ * @return 0 on success
+ * @return -ETIMEDOUT if the bus or the last attempt of a transfer timed out
+ * @return -ENOTTY on error, the first error of the transfers is returned.
+ */
+static int twi_transfer(const twi_port_xfer_t * p_xfers, const uint8_t count, const twi_xfer_opts_t * p_opts,
+                        const char * p_caller, int * p_errs)
+{
+    int err;
+    int xfer_err = 0;
+    const k_timeout_t timeout = twi_timeout(p_opts->timeout_us);
+
+#if defined(CONFIG_APP_EVLOG)
+    ARG_UNUSED(p_caller);
+#endif
+
+#if defined(CONFIG_APP_TWI_STATS)
+    const uint32_t call_start = k_cycle_get_32();
+#endif
+
+    err = twi_arbiter_acquire(p_opts->prio, p_opts->deadline_us, timeout);
+    if (err != 0)
+    {
+        twi_stats_call(call_start);
+        TWI_STATS_COUNT(bus_timeouts);
+#if defined(CONFIG_APP_EVLOG)
+        evlog_put(EVLOG_TWI_BUS_TIMEOUT, p_xfers[0].address, p_xfers[0].reg_address, -ETIMEDOUT, 0U);
+#else
+        LOG_ERR("%s:twi_arbiter_acquire timed out for device 0x%02X", p_caller, p_xfers[0].address);
+#endif
+        for (uint8_t i = 0U; (p_errs != NULL) && (i < count); i++)
+        {
+            p_errs[i] = -ETIMEDOUT;
+        }
+        return -ETIMEDOUT;
+    }
+
+    twi_stream_hold(true);
+
+    for (uint8_t i = 0U; i < count; i++)
+    {
+        err = twi_transfer_owned(&p_xfers[i], p_opts, timeout, p_caller);
+        xfer_err = (xfer_err == 0) ? err : xfer_err;
+        if (p_errs != NULL)
+        {
+            p_errs[i] = err;
+        }
+    }
+
+    twi_stream_hold(false);
+
+#if defined(CONFIG_APP_TWI_POWER_GATING)
+    if (idle_off_us != 0U)
+    {
+        (void)k_work_reschedule(&idle_work, K_USEC(idle_off_us));
+    }
+#endif
+
+    err = twi_arbiter_release();
+    if (err != 0)
+    {
+#if defined(CONFIG_APP_EVLOG)
+        evlog_put(EVLOG_TWI_RELEASE_FAILED, p_xfers[0].address, p_xfers[0].reg_address, err, 0U);
+#else
+        LOG_ERR("%s:twi_arbiter_release failed with error: %d", p_caller, err);
+#endif
+    }
+
+    twi_stats_call(call_start);
+
+    return (xfer_err != 0) ? xfer_err : err;
+}
 
 /**
  * @brief Initializes the TWI peripheral based on given SCL and SDA pins, and 
@@ -51,28 +562,16 @@ static const nrfx_twi_t twi_instance = NRFX_TWI_INSTANCE(TWI_INSTANCE_ID);
  */
 int twi_init(const uint32_t scl_pin, const uint32_t sda_pin)
 {
-    int err = -ENOTTY;
-    nrfx_err_t nrfx_err = NRFX_ERROR_NOT_SUPPORTED;
-
-    /**
-     * @brief NRFX_TWI_DEFAULT_CONFIG is used to fill the default values for the bus
-     * priority etc, but this nrfx_twi_config_t struct can be manually filled
-     * as well if any other settings are to be used
-     */
-    const nrfx_twi_config_t config = NRFX_TWI_DEFAULT_CONFIG(scl_pin, sda_pin);
+    int err;
 
-    nrfx_err = nrfx_twi_init(&twi_instance, &config, NO_HANDLER, NO_CONTEXT);
-    if (nrfx_err == NRFX_SUCCESS)
+    err = twi_port_init(scl_pin, sda_pin);
+    if (err == 0)
     {
-        err = k_mutex_init(&twi_mutex);
-        if (err != 0)
-        {
-            LOG_ERR("Unable to initialize a mutex for the TWI component, err: %d", err);
-        }
+        twi_arbiter_init();
     }
     else
     {
-        LOG_ERR("twi_init:nrfx_twi_init failed with error: %s", nrfx_err_string(nrfx_err));
+        LOG_ERR("twi_init:twi_port_init failed with error: %d", err);
     }
 
     return err;
@@ -80,29 +579,35 @@ int twi_init(const uint32_t scl_pin, const uint32_t sda_pin)
 
 /**
  * @brief Enables the TWI peripheral. The peripheral must be initialized beforehand
- * using \ref twi_init
+ * using \ref twi_init. With CONFIG_APP_TWI_POWER_GATING the bus is only
+ * marked usable here, the peripheral is powered up by the first transfer.
  * 
- * @return 0        Mutex locked.
- * @return -EBUSY   Returned without waiting.
- * @return -EINVAL  The mutex is not locked
+ * @return 0          on success
+ * @return -ETIMEDOUT The bus could not be owned in time
  */
 int twi_enable(void)
 {
     int err;
 
-    err = k_mutex_lock(&twi_mutex, K_FOREVER);
+    err = twi_arbiter_acquire(twi_current_prio(), NO_DEADLINE, twi_timeout(policy_timeout_us));
     if (err == 0)
     {
-        nrfx_twi_enable(&twi_instance);
-        err = k_mutex_unlock(&twi_mutex);
+#if defined(CONFIG_APP_TWI_POWER_GATING)
+        // powered up by the first transfer
+        bus_enabled = true;
+#else
+        twi_power_set(true);
+#endif
+        err = twi_arbiter_release();
         if (err != 0)
         {
-            LOG_ERR("twi_enable:k_mutex_unlock for unlocking twi_mutex failed with error: %d", err);
+            LOG_ERR("twi_enable:twi_arbiter_release failed with error: %d", err);
         }
     }
     else
     {
-        LOG_ERR("twi_enable:k_mutex_lock for locking twi_mutex failed with error: %d", err);
+        LOG_ERR("twi_enable:twi_arbiter_acquire failed with error: %d", err);
+        err = -ETIMEDOUT;
     }
 
     return err;
@@ -112,27 +617,39 @@ int twi_enable(void)
  * @brief Disables the TWI peripheral. The peripheral must be initialized beforehand
  * using \ref twi_init
  * 
- * @return 0        Mutex locked.
- * @return -EBUSY   Returned without waiting.
- * @return -EINVAL  The mutex is not locked
+ * @return 0          on success
+ * @return -ETIMEDOUT The bus could not be owned in time
+ * @return -EBUSY     A stream is running, see \ref twi_stream_stop
  */
 int twi_disable(void)
 {
     int err;
 
-    err = k_mutex_lock(&twi_mutex, K_FOREVER);
+    err = twi_arbiter_acquire(twi_current_prio(), NO_DEADLINE, twi_timeout(policy_timeout_us));
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+    if ((err == 0) && stream_active)
+    {
+        (void)twi_arbiter_release();
+        return -EBUSY;
+    }
+#endif
     if (err == 0)
     {
-        nrfx_twi_disable(&twi_instance);
-        err = k_mutex_unlock(&twi_mutex);
+#if defined(CONFIG_APP_TWI_POWER_GATING)
+        bus_enabled = false;
+        (void)k_work_cancel_delayable(&idle_work);
+#endif
+        twi_power_set(false);
+        err = twi_arbiter_release();
         if (err != 0)
         {
-            LOG_ERR("twi_enable:k_mutex_unlock for unlocking twi_mutex failed with error: %d", err);
+            LOG_ERR("twi_disable:twi_arbiter_release failed with error: %d", err);
         }
     }
     else
     {
-        LOG_ERR("twi_enable:k_mutex_lock for locking twi_mutex failed with error: %d", err);
+        LOG_ERR("twi_disable:twi_arbiter_acquire failed with error: %d", err);
+        err = -ETIMEDOUT;
     }
 
     return err;
@@ -148,50 +665,45 @@ int twi_disable(void)
  * @param[in] length         Length of the data buffer that has to be written
  *
  * @return 0 on success,
+ * @return -ETIMEDOUT if the bus or the transfer timed out
  * @return -ENOTTY on error.
  */
 int twi_write(const uint8_t device_address, uint8_t reg_address, uint8_t * p_data, const uint16_t length)
 {
-    int err;
-    nrfx_err_t nrfx_err = NRFX_SUCCESS;
+    twi_xfer_opts_t opts;
 
-    err = k_mutex_lock(&twi_mutex, K_FOREVER);
-    if (err == 0)
-    {
-        // Writing the device address and the target register address on the TWI line with a NO_STOP flag
-        nrfx_twi_xfer_desc_t xfer_desc_reg_address = NRFX_TWI_XFER_DESC_TX(device_address, &reg_address, sizeof(reg_address));
-        nrfx_err = nrfx_twi_xfer(&twi_instance, &xfer_desc_reg_address, NRFX_TWI_FLAG_TX_NO_STOP);
-        if (nrfx_err == NRFX_SUCCESS)
-        {
-            // Writing the data on the target register
-            nrfx_twi_xfer_desc_t xfer_desc_data = NRFX_TWI_XFER_DESC_TX(device_address, p_data, length);
-            nrfx_err = nrfx_twi_xfer(&twi_instance, &xfer_desc_data, NO_FLAGS);
-            if (nrfx_err == NRFX_SUCCESS)
-            {
-                err = 0;
-            }
-            else
-            {
-                LOG_ERR("twi_write:nrfx_twi_xfer for writing reg_address failed with error: %s", nrfx_err_string(nrfx_err));
-            }
-        }
-        else
-        {
-            LOG_ERR("twi_write:nrfx_twi_xfer for writing data failed with error: %s", nrfx_err_string(nrfx_err));
-        }
+    twi_current_opts(&opts);
 
-        err = k_mutex_unlock(&twi_mutex);
-        if (err != 0)
-        {
-            LOG_ERR("twi_write:k_mutex_unlock for unlocking twi_mutex failed with error: %d", err);
-        }
-    }
-    else
-    {
-        LOG_ERR("twi_write:k_mutex_lock for locking twi_mutex failed with error: %d", err);
-    }
+    return twi_write_opts(device_address, reg_address, p_data, length, &opts);
+}
+
+/**
+ * @brief Same as \ref twi_write but with explicit priority class and deadline.
+ *
+ * @param[in] device_address Address of the device
+ * @param[in] reg_address    Address of the register to write to
+ * @param[in] p_data         Pointer to the data buffer that has to be written
+ * @param[in] length         Length of the data buffer that has to be written
+ * @param[in] p_opts         Transfer options, NULL for the defaults
+ *
+ * @return 0 on success
+ * @return -ETIMEDOUT if the bus or the transfer timed out
+ * @return -ENOTTY on error.
+ */
+int twi_write_opts(const uint8_t device_address, uint8_t reg_address, uint8_t * p_data, const uint16_t length,
+                   const twi_xfer_opts_t * p_opts)
+{
+    static const twi_xfer_opts_t default_opts = TWI_XFER_OPTS_DEFAULT();
+    const twi_port_xfer_t xfer = {
+        .address     = device_address,
+        .has_reg     = true,
+        .reg_address = reg_address,
+        .read        = false,
+        .p_data      = p_data,
+        .length      = length,
+    };
 
-    return (nrfx_err != NRFX_SUCCESS) ? -ENOTTY : err;
+    return twi_transfer(&xfer, 1U, (p_opts != NULL) ? p_opts : &default_opts, "twi_write", NULL);
 }
 
 /**
@@ -204,50 +716,98 @@ int twi_write(const uint8_t device_address, uint8_t reg_address, uint8_t * p_dat
  * @param[in]  length         Length of the data that has to be read
  * 
  * @return 0 on success,
+ * @return -ETIMEDOUT if the bus or the transfer timed out
  * @return -ENOTTY on error.
  */
 int twi_read(const uint8_t device_address, uint8_t reg_address, uint8_t * p_data, const uint16_t length)
 {
-    int err;
-    nrfx_err_t nrfx_err = NRFX_SUCCESS;
-    
-    err = k_mutex_lock(&twi_mutex, K_FOREVER);
-    if (err == 0)
+    twi_xfer_opts_t opts;
+
+    twi_current_opts(&opts);
+
+    return twi_read_opts(device_address, reg_address, p_data, length, &opts);
+}
+
+/**
+ * @brief Same as \ref twi_read but with explicit priority class and deadline.
+ * 
+ * @param[in]  device_address Address of the device
+ * @param[in]  reg_address    Address of the register to read from 
+ * @param[out] p_data         Pointer to a buffer that will store the data
+ * @param[in]  length         Length of the data that has to be read
+ * @param[in]  p_opts         Transfer options, NULL for the defaults
+ * 
+ * @return 0 on success
+ * @return -ETIMEDOUT if the bus or the transfer timed out
+ * @return -ENOTTY on error.
+ */
+int twi_read_opts(const uint8_t device_address, uint8_t reg_address, uint8_t * p_data, const uint16_t length,
+                  const twi_xfer_opts_t * p_opts)
+{
+    static const twi_xfer_opts_t default_opts = TWI_XFER_OPTS_DEFAULT();
+    const twi_port_xfer_t xfer = {
+        .address     = device_address,
+        .has_reg     = true,
+        .reg_address = reg_address,
+        .read        = true,
+        .p_data      = p_data,
+        .length      = length,
+    };
+
+    return twi_transfer(&xfer, 1U, (p_opts != NULL) ? p_opts : &default_opts, "twi_read", NULL);
+}
+
+/**
+ * @brief Runs several register reads, usually of different devices, while
+ * owning the bus once, see \ref twi_read_batch_t. The peripheral is powered
+ * up and the idle power down pushed back once for all of them.
+ * 
+ * @param[in,out] p_reads reads to run, in order, their results are set
+ * @param[in]     count   number of reads, at most TWI_BATCH_MAX_READS
+ * @param[in]     p_opts  transfer options, NULL for those of the calling thread
+ * 
+ * @return 0 if every read succeeded
+ * @return -EINVAL on a NULL pointer or a count out of range
+ * @return -ETIMEDOUT or -ENOTTY, the error of the first read that failed.
+ */
+int twi_read_batch(twi_read_batch_t * p_reads, const uint8_t count, const twi_xfer_opts_t * p_opts)
+{
+    twi_port_xfer_t xfers[TWI_BATCH_MAX_READS];
+    int             errs[TWI_BATCH_MAX_READS];
+    twi_xfer_opts_t opts;
+    int             err;
+
+    if ((p_reads == NULL) || (count == 0U) || (count > TWI_BATCH_MAX_READS))
     {
-        // Writing the device address and the target register address on the TWI line with a NO_STOP flag
-        nrfx_twi_xfer_desc_t xfer_desc_reg_address = NRFX_TWI_XFER_DESC_TX(device_address, &reg_address, sizeof(reg_address));
-        nrfx_err = nrfx_twi_xfer(&twi_instance, &xfer_desc_reg_address, NRFX_TWI_FLAG_TX_NO_STOP);
-        if (nrfx_err == NRFX_SUCCESS)
-        {
-            // Reading the data on the target register
-            nrfx_twi_xfer_desc_t xfer_desc_data = NRFX_TWI_XFER_DESC_RX(device_address, p_data, length);
-            nrfx_err = nrfx_twi_xfer(&twi_instance, &xfer_desc_data, NO_FLAGS);
-            if (nrfx_err == NRFX_SUCCESS)
-            {
-                err = 0;
-            }
-            else
-            {
-                LOG_ERR("twi_read:nrfx_twi_xfer for writing reg_address failed with error: %s", nrfx_err_string(nrfx_err));
-            }
-        }
-        else
-        {
-            LOG_ERR("twi_read:nrfx_twi_xfer for reading data failed with error: %s", nrfx_err_string(nrfx_err));
-        }
+        return -EINVAL;
+    }
 
-        err = k_mutex_unlock(&twi_mutex);
-        if (err != 0)
-        {
-            LOG_ERR("twi_read:k_mutex_unlock for unlocking twi_mutex failed with error: %d", err);
-        }
+    if (p_opts == NULL)
+    {
+        twi_current_opts(&opts);
+        p_opts = &opts;
     }
-    else
+
+    for (uint8_t i = 0U; i < count; i++)
+    {
+        xfers[i] = (twi_port_xfer_t){
+            .address     = p_reads[i].address,
+            .has_reg     = true,
+            .reg_address = p_reads[i].reg_address,
+            .read        = true,
+            .p_data      = p_reads[i].p_data,
+            .length      = p_reads[i].length,
+        };
+    }
+
+    err = twi_transfer(xfers, count, p_opts, "twi_read_batch", errs);
+
+    for (uint8_t i = 0U; i < count; i++)
     {
-        LOG_ERR("twi_read:k_mutex_lock for locking twi_mutex failed with error: %d", err);
+        p_reads[i].err = errs[i];
     }
 
-    return (nrfx_err != NRFX_SUCCESS) ? -ENOTTY : err;
+    return err;
 }
 
 /**
@@ -259,67 +819,480 @@ int twi_read(const uint8_t device_address, uint8_t reg_address, uint8_t * p_data
  * @param[in]  length         Length of the data that has to be read
  * 
  * @return 0 on success
+ * @return -ETIMEDOUT if the bus or the transfer timed out
  * @return -ENOTTY on error.
  */
 int twi_read_single(const uint8_t device_address, uint8_t * p_data, const uint16_t length)
 {
-    int err;
-    nrfx_err_t nrfx_err = NRFX_SUCCESS;
-    
-    err = k_mutex_lock(&twi_mutex, K_FOREVER);
+    twi_xfer_opts_t opts;
+    const twi_port_xfer_t xfer = {
+        .address     = device_address,
+        .has_reg     = false,
+        .reg_address = 0U,
+        .read        = true,
+        .p_data      = p_data,
+        .length      = length,
+    };
+
+    twi_current_opts(&opts);
+
+    return twi_transfer(&xfer, 1U, &opts, "twi_read_single", NULL);
+}
+
+/**
+ * @brief Writes a single register value as one transfer of address and value.
+ * 
+ * @param[in] device_address Address of the device
+ * @param[in] reg_address    Address of the register to write to
+ * @param[in] reg_value      Value to write
+ * 
+ * @return 0 on success
+ * @return -ETIMEDOUT if the bus or the transfer timed out
+ * @return -ENOTTY on error.
+ */
+int twi_write_single(const uint8_t device_address, uint8_t reg_address, uint8_t reg_value)
+{
+    twi_xfer_opts_t opts;
+
+    twi_current_opts(&opts);
+
+    return twi_write_opts(device_address, reg_address, &reg_value, sizeof(reg_value), &opts);
+}
+
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+/**
+ * @brief Hands the last full block to the handler of the stream.
+ */
+static void twi_stream_work_fn(struct k_work * p_work)
+{
+    const uint32_t block_size = (uint32_t)stream_config.slot_count * stream_config.slot_length;
+
+    ARG_UNUSED(p_work);
+
+    stream_config.handler(&stream_config.p_buffer[stream_block * block_size], stream_config.slot_count,
+                          stream_config.p_context);
+}
+
+/**
+ * @brief Called from the interrupt of the stream once a block is full.
+ * 
+ * @param[in] block    block that was filled
+ * @param[in] replayed a trigger that came during the block switch was read
+ * @param[in] failed   a read of the block was not acknowledged
+ */
+static void twi_stream_block_done(const uint8_t block, const bool replayed, const bool failed)
+{
+    k_spinlock_key_t key = k_spin_lock(&stream_lock);
+
+    stream_stats.blocks++;
+    stream_stats.overruns += (k_work_busy_get(&stream_work) != 0) ? 1U : 0U;
+    stream_stats.replays  += replayed ? 1U : 0U;
+    stream_stats.failed   += failed ? 1U : 0U;
+    k_spin_unlock(&stream_lock, key);
+
+    stream_block = block;
+    (void)k_work_submit(&stream_work);
+}
+
+/**
+ * @brief Starts a hardware triggered stream of register reads, see
+ * \ref twi_stream_config_t. Only one stream can run, on the nRF52 it takes
+ * a GPIOTE channel, five PPI channels, a PPI group and TIMER1. The reads
+ * run at the clock of the speed profile of the device and keep the
+ * peripheral powered.
+ * 
+ * @param[in] p_config stream, copied, the buffer has to stay valid
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer, an empty or too long slot
+ * @return -EBUSY if a stream is running
+ * @return -ENODEV if the bus is not enabled or the hardware channels are taken
+ * @return -ETIMEDOUT if the bus could not be owned in time.
+ */
+int twi_stream_start(const twi_stream_config_t * p_config)
+{
+    twi_port_stream_t port_stream;
+    int               err;
+
+    if ((p_config == NULL) || (p_config->p_buffer == NULL) || (p_config->handler == NULL))
+    {
+        return -EINVAL;
+    }
+
+    err = twi_arbiter_acquire(twi_current_prio(), NO_DEADLINE, twi_timeout(policy_timeout_us));
     if (err != 0)
     {
-       LOG_ERR("twi_just_read:k_mutex_lock for locking twi_mutex failed with error: %d", err);
-       return err;
+        LOG_ERR("twi_stream_start:twi_arbiter_acquire failed with error: %d", err);
+        return -ETIMEDOUT;
     }
 
-    // Sending a read request to the device
-    nrfx_twi_xfer_desc_t xfer_desc_data = NRFX_TWI_XFER_DESC_RX(device_address, p_data, length);
-    nrfx_err = nrfx_twi_xfer(&twi_instance, &xfer_desc_data, NO_FLAGS);
-    if (nrfx_err != NRFX_SUCCESS)
+    if (stream_active)
     {
-        LOG_ERR("twi_just_read:nrfx_twi_xfer for writing reg_address failed with error: %s", nrfx_err_string(nrfx_err));
+        (void)twi_arbiter_release();
+        return -EBUSY;
     }
 
-    err = k_mutex_unlock(&twi_mutex);
+    // powered up and at the clock of the device, the stream keeps both
+    twi_bus_prepare(p_config->address);
+    if (!bus_powered)
+    {
+        (void)twi_arbiter_release();
+        return -ENODEV;
+    }
+
+    stream_config = *p_config;
+    port_stream   = (twi_port_stream_t){
+        .address      = p_config->address,
+        .reg_address  = p_config->reg_address,
+        .slot_length  = p_config->slot_length,
+        .slot_count   = p_config->slot_count,
+        .p_buffer     = p_config->p_buffer,
+        .trigger_pin  = p_config->trigger_pin,
+        .frequency_hz = speed_hz[bus_speed],
+        .handler      = twi_stream_block_done,
+    };
+
+    err           = twi_port_stream_start(&port_stream);
+    stream_active = (err == 0);
+
+    (void)twi_arbiter_release();
+
     if (err != 0)
     {
-        LOG_ERR("twi_just_read:k_mutex_unlock for unlocking twi_mutex failed with error: %d", err);
+        LOG_ERR("twi_stream_start:twi_port_stream_start failed with error: %d", err);
     }
 
-    return (nrfx_err != NRFX_SUCCESS) ? -ENOTTY : err;
+    return err;
 }
 
-int twi_write_single(const uint8_t device_address, uint8_t reg_address, uint8_t reg_value)
+/**
+ * @brief Stops the stream. A block that was not handed to the handler yet is
+ * dropped.
+ * 
+ * @return 0 on success
+ * @return -ETIMEDOUT if the bus could not be owned in time.
+ */
+int twi_stream_stop(void)
 {
-    int err;
-    nrfx_err_t nrfx_err = NRFX_SUCCESS;
-    uint8_t packet[2] = { reg_address, reg_value };
+    struct k_work_sync sync;
+    int                err;
 
-    err = k_mutex_lock(&twi_mutex, K_FOREVER);
-    if (err == 0)
+    err = twi_arbiter_acquire(twi_current_prio(), NO_DEADLINE, twi_timeout(policy_timeout_us));
+    if (err != 0)
+    {
+        LOG_ERR("twi_stream_stop:twi_arbiter_acquire failed with error: %d", err);
+        return -ETIMEDOUT;
+    }
+
+    if (stream_active)
     {
-        nrfx_twi_xfer_desc_t xfer_desc_full = NRFX_TWI_XFER_DESC_TX(device_address, packet, sizeof(packet));
-        nrfx_err = nrfx_twi_xfer(&twi_instance, &xfer_desc_full, NO_FLAGS);
-        if (nrfx_err == NRFX_SUCCESS)
+        twi_port_stream_stop();
+        stream_active = false;
+    }
+
+    (void)twi_arbiter_release();
+
+    // the handler may use the bus itself, so it is waited for without owning it
+    (void)k_work_cancel_sync(&stream_work, &sync);
+
+    return 0;
+}
+
+/**
+ * @brief Gets the statistics of the stream.
+ * 
+ * @param[out] p_stats statistics
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int twi_stream_stats_get(twi_stream_stats_t * p_stats)
+{
+    k_spinlock_key_t key;
+
+    if (p_stats == NULL)
+    {
+        return -EINVAL;
+    }
+
+    key      = k_spin_lock(&stream_lock);
+    *p_stats = stream_stats;
+    k_spin_unlock(&stream_lock, key);
+
+    return 0;
+}
+#endif
+
+#if defined(CONFIG_APP_TWI_TAP)
+/**
+ * @brief Sets the function every transfer attempt is handed to, with its
+ * result, once the backend is done with it. It runs in the thread that owns
+ * the bus so it has to be short.
+ * 
+ * @param[in] tap function to call, NULL to stop tapping
+ */
+void twi_tap_set(const twi_port_tap_t tap)
+{
+    xfer_tap = tap;
+}
+#endif
+
+/**
+ * @brief Sets the bus clock of the devices, the others run at
+ * TWI_SPEED_100K. The table is used in place and must stay valid, it is
+ * scanned on every transfer so it should stay short.
+ * 
+ * @param[in] p_profiles speed of each device, NULL to run all at TWI_SPEED_100K
+ * @param[in] count      number of entries
+ * 
+ * @return 0 on success
+ * @return -EINVAL on an invalid speed.
+ */
+int twi_speed_profiles_set(const twi_speed_profile_t * p_profiles, const uint8_t count)
+{
+    for (uint8_t i = 0U; (p_profiles != NULL) && (i < count); i++)
+    {
+        if (p_profiles[i].speed >= TWI_SPEED_COUNT)
         {
-            err = 0;
+            return -EINVAL;
         }
-        else
+    }
+
+    speed_profile_count = 0U;
+    p_speed_profiles    = p_profiles;
+    speed_profile_count = (p_profiles != NULL) ? count : 0U;
+
+    return 0;
+}
+
+/**
+ * @brief Sets how long the bus has to be idle before the peripheral is
+ * powered down.
+ * 
+ * @param[in] idle_us idle time, 0 keeps the peripheral powered
+ * 
+ * @return 0 on success
+ * @return -ENOTSUP if CONFIG_APP_TWI_POWER_GATING is disabled.
+ */
+int twi_idle_off_set(const uint32_t idle_us)
+{
+#if defined(CONFIG_APP_TWI_POWER_GATING)
+    idle_off_us = idle_us;
+    if (idle_us == 0U)
+    {
+        (void)k_work_cancel_delayable(&idle_work);
+    }
+
+    return 0;
+#else
+    ARG_UNUSED(idle_us);
+    return -ENOTSUP;
+#endif
+}
+
+/**
+ * @brief Sets the timeout and retry policy used by all the calls that do not
+ * take transfer options.
+ * 
+ * @param[in] timeout_us bound on waiting for the bus and on each attempt, 0 waits forever
+ * @param[in] retries    attempts after the first one that failed
+ */
+void twi_policy_set(const uint32_t timeout_us, const uint8_t retries)
+{
+    policy_timeout_us = timeout_us;
+    policy_retries    = retries;
+}
+
+/**
+ * @brief Toggles SCL until the bus is released, issues a stop condition and
+ * re-initializes the peripheral. This is done automatically after a transfer
+ * times out, but can be called after a target was power cycled.
+ * 
+ * @return 0 on success
+ * @return -ETIMEDOUT if the bus could not be owned
+ * @return -EIO if SDA is still held low.
+ */
+int twi_bus_recover(void)
+{
+    int err;
+
+    err = twi_arbiter_acquire(twi_current_prio(), NO_DEADLINE, twi_timeout(policy_timeout_us));
+    if (err != 0)
+    {
+        LOG_ERR("twi_bus_recover:twi_arbiter_acquire failed with error: %d", err);
+        return -ETIMEDOUT;
+    }
+
+    twi_stream_hold(true);
+    err = twi_recover_owned();
+    twi_stream_hold(false);
+
+    (void)twi_arbiter_release();
+
+    return err;
+}
+
+/**
+ * @brief Gets the statistics of failed transfers and bus recoveries.
+ * 
+ * @param[out] p_stats statistics
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer
+ * @return -ENOTSUP if CONFIG_APP_TWI_STATS is disabled.
+ */
+int twi_recovery_stats_get(twi_recovery_stats_t * p_stats)
+{
+    if (p_stats == NULL)
+    {
+        return -EINVAL;
+    }
+
+#if defined(CONFIG_APP_TWI_STATS)
+    k_spinlock_key_t key = k_spin_lock(&stats_lock);
+    *p_stats = recovery_stats;
+    k_spin_unlock(&stats_lock, key);
+
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+/**
+ * @brief Clears the statistics of failed transfers and bus recoveries.
+ */
+void twi_recovery_stats_reset(void)
+{
+#if defined(CONFIG_APP_TWI_STATS)
+    k_spinlock_key_t key = k_spin_lock(&stats_lock);
+    recovery_stats = (twi_recovery_stats_t){ 0 };
+    k_spin_unlock(&stats_lock, key);
+#endif
+}
+
+/**
+ * @brief Gets the statistics of the bus activity, the power gating and the
+ * speed profiles.
+ * 
+ * @param[out] p_stats statistics
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer
+ * @return -ENOTSUP if CONFIG_APP_TWI_STATS is disabled.
+ */
+int twi_power_stats_get(twi_power_stats_t * p_stats)
+{
+    if (p_stats == NULL)
+    {
+        return -EINVAL;
+    }
+
+#if defined(CONFIG_APP_TWI_STATS)
+    k_spinlock_key_t key = k_spin_lock(&stats_lock);
+    *p_stats = power_stats;
+    k_spin_unlock(&stats_lock, key);
+
+    // the time powered so far counts as well
+    if (bus_powered)
+    {
+        p_stats->powered_us += k_ticks_to_us_floor64((uint64_t)(k_uptime_ticks() - powered_ticks));
+    }
+
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+/**
+ * @brief Clears the statistics of the bus activity, the power gating and
+ * the speed profiles.
+ */
+void twi_power_stats_reset(void)
+{
+#if defined(CONFIG_APP_TWI_STATS)
+    k_spinlock_key_t key = k_spin_lock(&stats_lock);
+    power_stats   = (twi_power_stats_t){ 0 };
+    powered_ticks = k_uptime_ticks();
+    k_spin_unlock(&stats_lock, key);
+#endif
+}
+
+/**
+ * @brief Sets the priority class used by a thread for all the calls that do
+ * not take transfer options, so that drivers called from a sampling thread
+ * are prioritized without changing their API.
+ * 
+ * @param[in] thread thread to classify
+ * @param[in] prio   priority class, TWI_PRIO_NORMAL removes the thread from the table
+ * 
+ * @return 0 on success
+ * @return -EINVAL on an invalid class
+ * @return -ENOMEM if all the slots are used.
+ */
+int twi_thread_prio_set(const k_tid_t thread, const enum twi_prio prio)
+{
+    int free_slot = -1;
+
+    if (prio >= TWI_PRIO_COUNT)
+    {
+        return -EINVAL;
+    }
+
+    for (uint8_t i = 0U; i < THREAD_PRIO_SLOTS; i++)
+    {
+        if (thread_prio[i].thread == thread)
         {
-            LOG_ERR("twi_write:nrfx_twi_xfer for writing data failed with error: %s", nrfx_err_string(nrfx_err));
+            // an existing entry is updated, or freed when going back to the default class
+            thread_prio[i].thread = (prio == TWI_PRIO_NORMAL) ? NULL : thread;
+            thread_prio[i].prio   = prio;
+            return 0;
         }
 
-        err = k_mutex_unlock(&twi_mutex);
-        if (err != 0)
+        if ((thread_prio[i].thread == NULL) && (free_slot < 0))
         {
-            LOG_ERR("twi_write:k_mutex_unlock for unlocking twi_mutex failed with error: %d", err);
+            free_slot = (int)i;
         }
     }
-    else
+
+    if (prio == TWI_PRIO_NORMAL)
+    {
+        return 0;
+    }
+
+    if (free_slot < 0)
     {
-        LOG_ERR("twi_write:k_mutex_lock for locking twi_mutex failed with error: %d", err);
+        LOG_ERR("twi_thread_prio_set:no free slot for thread %p", (void *)thread);
+        return -ENOMEM;
     }
 
-    return (nrfx_err != NRFX_SUCCESS) ? -ENOTTY : err;
-}
\ No newline at end of file
+    thread_prio[free_slot].prio   = prio;
+    thread_prio[free_slot].thread = thread;
+
+    return 0;
+}
+
+/**
+ * @brief Gets the statistics of the time requests of a priority class waited
+ * for the bus.
+ * 
+ * @param[in]  prio    priority class
+ * @param[out] p_stats statistics
+ * 
+ * @return 0 on success
+ * @return -EINVAL on an invalid class or a NULL pointer
+ * @return -ENOTSUP if CONFIG_APP_TWI_STATS is disabled.
+ */
+int twi_wait_stats_get(const enum twi_prio prio, twi_wait_stats_t * p_stats)
+{
+    return twi_arbiter_stats_get(prio, p_stats);
+}
+
+/**
+ * @brief Clears the waiting time statistics of all priority classes.
+ */
+void twi_wait_stats_reset(void)
+{
+    twi_arbiter_stats_reset();
+}
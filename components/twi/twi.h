@@ -3,9 +3,9 @@
  * @author    Usman Mehmood (usmanmehmood55@gmail.com)
  * 
  * @brief     This is a very rudimentary implementation of a TWI or i2c library
- *            using the nrfx library. The read-write functions can be modified
- *            and expanded into more functions such as single-register read/write,
- *            non-stop write, device scanning etc.
+ *            on top of a peripheral backend, see twi_port.h. Every transfer
+ *            owns the bus through the arbiter, is bounded by a timeout and is
+ *            retried, with a bus recovery when the bus looks stuck.
  * 
  * @version   0.1
  * @date      2023-08-14
@@ -16,6 +16,194 @@
 #define TWI_H_
 
 #include <stdint.h>
+#include <zephyr/kernel.h>
+#if defined(CONFIG_APP_TWI_TAP)
+#include "twi_port.h"
+#endif
+
+/**
+ * @brief Priority classes of bus requests. When the bus is released it is
+ * handed to the oldest deadline of the most urgent class that is waiting.
+ */
+enum twi_prio
+{
+    TWI_PRIO_REALTIME = 0,  ///< periodic sampling that has to keep its timing
+    TWI_PRIO_NORMAL,        ///< default class of all requests
+    TWI_PRIO_BACKGROUND,    ///< configuration, calibration and other bulk traffic
+    TWI_PRIO_COUNT
+};
+
+/**
+ * @brief Bus clocks. Devices without a speed profile are run at
+ * TWI_SPEED_100K, which every device supports.
+ */
+enum twi_speed
+{
+    TWI_SPEED_100K = 0,  ///< standard mode
+    TWI_SPEED_250K,
+    TWI_SPEED_400K,      ///< fast mode
+    TWI_SPEED_COUNT
+};
+
+/**
+ * @brief Bus clock of one device, the bus is switched to it before every
+ * transfer to that device.
+ */
+typedef struct
+{
+    uint8_t        address;  ///< 7-bit device address
+    enum twi_speed speed;    ///< fastest clock the device and the board support
+} twi_speed_profile_t;
+
+#define TWI_DEFAULT_TIMEOUT_US 10000U  ///< default bound on waiting for the bus, and on each transfer attempt
+#define TWI_DEFAULT_RETRIES    2U      ///< default number of retries after a failed attempt
+
+/**
+ * @brief Per-call options of a transfer.
+ */
+typedef struct
+{
+    enum twi_prio prio;         ///< priority class of the request
+    uint32_t      deadline_us;  ///< time from the call by which the bus is needed, 0 for none
+    uint32_t      timeout_us;   ///< bound on waiting for the bus and on each attempt, 0 waits forever
+    uint8_t       retries;      ///< attempts after the first one that failed
+} twi_xfer_opts_t;
+
+/**@brief Transfer options used by the calls that do not take any. */
+#define TWI_XFER_OPTS_DEFAULT()                \
+    {                                          \
+        .prio        = TWI_PRIO_NORMAL,        \
+        .deadline_us = 0,                      \
+        .timeout_us  = TWI_DEFAULT_TIMEOUT_US, \
+        .retries     = TWI_DEFAULT_RETRIES,    \
+    }
+
+/**
+ * @brief Longest time a single transfer call can block: timeout_us waiting
+ * for the bus, then retries + 1 attempts that each time out and are followed
+ * by a bus recovery. A recovery clocks 9 pulses and a stop condition, about
+ * 200 us at 100 kHz, and the timeouts are rounded up to the next tick.
+ *
+ * @param[in] timeout_us  bound on waiting for the bus and on each attempt, not 0
+ * @param[in] retries     attempts after the first one
+ * @param[in] recovery_us longest bus recovery
+ */
+#define TWI_WORST_CASE_US(timeout_us, retries, recovery_us) \
+    ((uint64_t)(timeout_us) + (((uint64_t)(retries) + 1U) * ((uint64_t)(timeout_us) + (uint64_t)(recovery_us))))
+
+#define TWI_BATCH_MAX_READS 8U  ///< reads a single twi_read_batch() call can run
+
+/**
+ * @brief One register read of a batch. Batched reads share the bus
+ * ownership, so a sample of several devices costs one wait for the bus
+ * instead of one per device.
+ */
+typedef struct
+{
+    uint8_t   address;      ///< 7-bit device address
+    uint8_t   reg_address;  ///< register to read from
+    uint8_t * p_data;       ///< buffer for the data
+    uint16_t  length;       ///< number of bytes to read
+    int       err;          ///< result of this read, set by twi_read_batch()
+} twi_read_batch_t;
+
+/**
+ * @brief Statistics of the time requests of one priority class waited for
+ * the bus. Percentiles are rounded up to the next power of two.
+ */
+typedef struct
+{
+    uint32_t count;            ///< number of requests
+    uint64_t total_us;         ///< summed waiting time
+    uint32_t max_us;           ///< longest wait
+    uint32_t p50_us;           ///< median wait
+    uint32_t p99_us;           ///< 99th percentile wait
+    uint32_t deadline_misses;  ///< requests that got the bus after their deadline
+} twi_wait_stats_t;
+
+/**
+ * @brief Statistics of failed transfers and of the bus recoveries they caused.
+ */
+typedef struct
+{
+    uint32_t bus_timeouts;       ///< requests that did not get the bus in time
+    uint32_t xfer_timeouts;      ///< attempts that did not complete in time
+    uint32_t nacks;              ///< attempts that were not acknowledged
+    uint32_t retries;            ///< attempts after the first one
+    uint32_t failures;           ///< transfers that failed after all their attempts
+    uint32_t recoveries;         ///< bus recoveries done
+    uint32_t recovery_failures;  ///< bus recoveries after which SDA was still low
+    uint32_t last_recovery_us;   ///< duration of the last recovery
+    uint32_t max_recovery_us;    ///< duration of the longest recovery
+    uint64_t total_recovery_us;  ///< time spent in all recoveries
+} twi_recovery_stats_t;
+
+/**
+ * @brief Statistics of the bus activity and of the latency the power gating
+ * and the speed profiles add to the transfers. The latencies are the time
+ * spent powering the peripheral up and switching the clock before a
+ * transfer could start.
+ */
+typedef struct
+{
+    uint64_t busy_us;              ///< time spent in transfer attempts, the active bus time
+    uint64_t call_us;              ///< time the callers spent blocked in the transfer calls, waiting for the bus included
+    uint64_t powered_us;           ///< time the peripheral was powered
+    uint32_t power_ups;            ///< times the peripheral was powered up for a transfer
+    uint32_t power_downs;          ///< times it was powered down after the idle time
+    uint64_t power_up_ns;          ///< summed latency of the power ups
+    uint32_t power_up_max_ns;      ///< longest power up
+    uint32_t speed_changes;        ///< times the bus clock was switched for a transfer
+    uint64_t speed_change_ns;      ///< summed latency of the clock switches
+    uint32_t speed_change_max_ns;  ///< longest clock switch
+} twi_power_stats_t;
+
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+/**
+ * @brief Called from the system work queue with a full block of a stream.
+ * The block is written again once the other one is full, so the handler
+ * has slot_count trigger periods to use it.
+ * 
+ * @param[in] p_slots   the slots, oldest first, slot_length bytes each
+ * @param[in] count     number of slots
+ * @param[in] p_context pointer given with the stream
+ */
+typedef void (*twi_stream_handler_t)(const uint8_t * p_slots, const uint16_t count, void * p_context);
+
+/**
+ * @brief A register read that the rising edge of a pin starts in hardware,
+ * such as a data ready or FIFO watermark interrupt. The reads fill slots of
+ * two blocks in turn and the CPU only wakes once per block. Transfers of
+ * the other calls hold the triggers back while they own the bus, a trigger
+ * that came in the meantime is read once they are done.
+ */
+typedef struct
+{
+    uint8_t              address;      ///< 7-bit device address
+    uint8_t              reg_address;  ///< register the reads start at
+    uint16_t             slot_length;  ///< bytes of each read
+    uint16_t             slot_count;   ///< reads per block, the CPU wakes once per block
+    uint8_t *            p_buffer;     ///< TWI_STREAM_BUFFER_SIZE() bytes of RAM
+    uint32_t             trigger_pin;  ///< pin whose rising edge starts a read
+    twi_stream_handler_t handler;      ///< called for every full block
+    void *               p_context;    ///< passed to the handler
+} twi_stream_config_t;
+
+/**@brief Buffer of a stream, two blocks and a spare slot. */
+#define TWI_STREAM_BUFFER_SIZE(slot_length, slot_count) (((2U * (slot_count)) + 1U) * (slot_length))
+
+/**
+ * @brief Statistics of the stream.
+ */
+typedef struct
+{
+    uint32_t blocks;    ///< blocks filled
+    uint32_t overruns;  ///< blocks filled while the handler was still busy with the one before
+    uint32_t failed;    ///< blocks with a read that was not acknowledged
+    uint32_t pauses;    ///< bus ownerships that held the triggers back
+    uint32_t replays;   ///< triggers that came while held back and were read afterwards
+} twi_stream_stats_t;
+#endif
 
 /**
  * @brief Initializes the TWI peripheral based on given SCL and SDA pins, and 
@@ -31,11 +219,11 @@ int twi_init(const uint32_t scl_pin, const uint32_t sda_pin);
 
 /**
  * @brief Enables the TWI peripheral. The peripheral must be initialized beforehand
- * using \ref twi_init
+ * using \ref twi_init. With CONFIG_APP_TWI_POWER_GATING the bus is only
+ * marked usable here, the peripheral is powered up by the first transfer.
  * 
- * @return 0        Mutex locked.
- * @return -EBUSY   Returned without waiting.
- * @return -EINVAL  The mutex is not locked
+ * @return 0          on success
+ * @return -ETIMEDOUT The bus could not be owned in time
  */
 int twi_enable(void);
 
@@ -43,9 +231,9 @@ int twi_enable(void);
  * @brief Disables the TWI peripheral. The peripheral must be initialized beforehand
  * using \ref twi_init
  * 
- * @return 0        Mutex locked.
- * @return -EBUSY   Returned without waiting.
- * @return -EINVAL  The mutex is not locked
+ * @return 0          on success
+ * @return -ETIMEDOUT The bus could not be owned in time
+ * @return -EBUSY     A stream is running, see \ref twi_stream_stop
  */
 int twi_disable(void);
 
@@ -59,6 +247,7 @@ int twi_disable(void);
  * @param[in] length         Length of the data buffer that has to be written
  *
  * @return 0 on success
+ * @return -ETIMEDOUT if the bus or the transfer timed out
  * @return -ENOTTY on error.
  */
 int twi_write(uint8_t device_address, uint8_t reg_address, uint8_t * p_data, uint16_t length);
@@ -73,6 +262,7 @@ int twi_write(uint8_t device_address, uint8_t reg_address, uint8_t * p_data, uin
  * @param[in]  length         Length of the data that has to be read
  * 
  * @return 0 on success
+ * @return -ETIMEDOUT if the bus or the transfer timed out
  * @return -ENOTTY on error.
  */
 int twi_read(const uint8_t device_address, uint8_t reg_address, uint8_t * p_data, const uint16_t length);
@@ -86,10 +276,229 @@ int twi_read(const uint8_t device_address, uint8_t reg_address, uint8_t * p_data
  * @param[in]  length         Length of the data that has to be read
  * 
  * @return 0 on success
+ * @return -ETIMEDOUT if the bus or the transfer timed out
  * @return -ENOTTY on error.
  */
 int twi_read_single(const uint8_t device_address, uint8_t * p_data, const uint16_t length);
 
+/**
+ * @brief Writes a single register value as one transfer of address and value.
+ * 
+ * @param[in] device_address Address of the device
+ * @param[in] reg_address    Address of the register to write to
+ * @param[in] reg_value      Value to write
+ * 
+ * @return 0 on success
+ * @return -ETIMEDOUT if the bus or the transfer timed out
+ * @return -ENOTTY on error.
+ */
 int twi_write_single(const uint8_t device_address, uint8_t reg_address, uint8_t reg_value);
 
+/**
+ * @brief Same as \ref twi_write but with explicit priority class and deadline.
+ *
+ * @param[in] device_address Address of the device
+ * @param[in] reg_address    Address of the register to write to
+ * @param[in] p_data         Pointer to the data buffer that has to be written
+ * @param[in] length         Length of the data buffer that has to be written
+ * @param[in] p_opts         Transfer options, NULL for the defaults
+ *
+ * @return 0 on success
+ * @return -ETIMEDOUT if the bus or the transfer timed out
+ * @return -ENOTTY on error.
+ */
+int twi_write_opts(const uint8_t device_address, uint8_t reg_address, uint8_t * p_data, const uint16_t length,
+                   const twi_xfer_opts_t * p_opts);
+
+/**
+ * @brief Same as \ref twi_read but with explicit priority class and deadline.
+ * 
+ * @param[in]  device_address Address of the device
+ * @param[in]  reg_address    Address of the register to read from 
+ * @param[out] p_data         Pointer to a buffer that will store the data
+ * @param[in]  length         Length of the data that has to be read
+ * @param[in]  p_opts         Transfer options, NULL for the defaults
+ * 
+ * @return 0 on success
+ * @return -ETIMEDOUT if the bus or the transfer timed out
+ * @return -ENOTTY on error.
+ */
+int twi_read_opts(const uint8_t device_address, uint8_t reg_address, uint8_t * p_data, const uint16_t length,
+                  const twi_xfer_opts_t * p_opts);
+
+/**
+ * @brief Runs several register reads, usually of different devices, while
+ * owning the bus once. The peripheral is powered up and the idle power down
+ * pushed back once for all of them. A read that fails does not stop the
+ * ones after it.
+ * 
+ * @param[in,out] p_reads reads to run, in order, their results are set
+ * @param[in]     count   number of reads, at most TWI_BATCH_MAX_READS
+ * @param[in]     p_opts  transfer options, NULL for those of the calling thread
+ * 
+ * @return 0 if every read succeeded
+ * @return -EINVAL on a NULL pointer or a count out of range
+ * @return -ETIMEDOUT or -ENOTTY, the error of the first read that failed.
+ */
+int twi_read_batch(twi_read_batch_t * p_reads, const uint8_t count, const twi_xfer_opts_t * p_opts);
+
+/**
+ * @brief Sets the timeout and retry policy used by all the calls that do not
+ * take transfer options.
+ * 
+ * @param[in] timeout_us bound on waiting for the bus and on each attempt, 0 waits forever
+ * @param[in] retries    attempts after the first one that failed
+ */
+void twi_policy_set(const uint32_t timeout_us, const uint8_t retries);
+
+/**
+ * @brief Toggles SCL until the bus is released, issues a stop condition and
+ * re-initializes the peripheral. This is done automatically after a transfer
+ * times out, but can be called after a target was power cycled.
+ * 
+ * @return 0 on success
+ * @return -ETIMEDOUT if the bus could not be owned
+ * @return -EIO if SDA is still held low.
+ */
+int twi_bus_recover(void);
+
+/**
+ * @brief Gets the statistics of failed transfers and bus recoveries.
+ * 
+ * @param[out] p_stats statistics
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer
+ * @return -ENOTSUP if CONFIG_APP_TWI_STATS is disabled.
+ */
+int twi_recovery_stats_get(twi_recovery_stats_t * p_stats);
+
+/**
+ * @brief Clears the statistics of failed transfers and bus recoveries.
+ */
+void twi_recovery_stats_reset(void);
+
+/**
+ * @brief Sets the priority class used by a thread for all the calls that do
+ * not take transfer options, so that drivers called from a sampling thread
+ * are prioritized without changing their API.
+ * 
+ * @param[in] thread thread to classify
+ * @param[in] prio   priority class, TWI_PRIO_NORMAL removes the thread from the table
+ * 
+ * @return 0 on success
+ * @return -EINVAL on an invalid class
+ * @return -ENOMEM if all the slots are used.
+ */
+int twi_thread_prio_set(const k_tid_t thread, const enum twi_prio prio);
+
+/**
+ * @brief Gets the statistics of the time requests of a priority class waited
+ * for the bus.
+ * 
+ * @param[in]  prio    priority class
+ * @param[out] p_stats statistics
+ * 
+ * @return 0 on success
+ * @return -EINVAL on an invalid class or a NULL pointer
+ * @return -ENOTSUP if CONFIG_APP_TWI_STATS is disabled.
+ */
+int twi_wait_stats_get(const enum twi_prio prio, twi_wait_stats_t * p_stats);
+
+/**
+ * @brief Clears the waiting time statistics of all priority classes.
+ */
+void twi_wait_stats_reset(void);
+
+/**
+ * @brief Sets the bus clock of the devices, the others run at
+ * TWI_SPEED_100K. The table is used in place and must stay valid, it is
+ * scanned on every transfer so it should stay short.
+ * 
+ * @param[in] p_profiles speed of each device, NULL to run all at TWI_SPEED_100K
+ * @param[in] count      number of entries
+ * 
+ * @return 0 on success
+ * @return -EINVAL on an invalid speed.
+ */
+int twi_speed_profiles_set(const twi_speed_profile_t * p_profiles, const uint8_t count);
+
+/**
+ * @brief Sets how long the bus has to be idle before the peripheral is
+ * powered down.
+ * 
+ * @param[in] idle_us idle time, 0 keeps the peripheral powered
+ * 
+ * @return 0 on success
+ * @return -ENOTSUP if CONFIG_APP_TWI_POWER_GATING is disabled.
+ */
+int twi_idle_off_set(const uint32_t idle_us);
+
+/**
+ * @brief Gets the statistics of the bus activity, the power gating and the
+ * speed profiles.
+ * 
+ * @param[out] p_stats statistics
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer
+ * @return -ENOTSUP if CONFIG_APP_TWI_STATS is disabled.
+ */
+int twi_power_stats_get(twi_power_stats_t * p_stats);
+
+/**
+ * @brief Clears the statistics of the bus activity, the power gating and
+ * the speed profiles.
+ */
+void twi_power_stats_reset(void);
+
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+/**
+ * @brief Starts a hardware triggered stream of register reads, see
+ * \ref twi_stream_config_t. Only one stream can run, on the nRF52 it takes
+ * a GPIOTE channel, five PPI channels, a PPI group and TIMER1. The reads
+ * run at the clock of the speed profile of the device and keep the
+ * peripheral powered.
+ * 
+ * @param[in] p_config stream, copied, the buffer has to stay valid
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer, an empty or too long slot
+ * @return -EBUSY if a stream is running
+ * @return -ENODEV if the bus is not enabled or the hardware channels are taken
+ * @return -ETIMEDOUT if the bus could not be owned in time.
+ */
+int twi_stream_start(const twi_stream_config_t * p_config);
+
+/**
+ * @brief Stops the stream. A block that was not handed to the handler yet is
+ * dropped.
+ * 
+ * @return 0 on success
+ * @return -ETIMEDOUT if the bus could not be owned in time.
+ */
+int twi_stream_stop(void);
+
+/**
+ * @brief Gets the statistics of the stream.
+ * 
+ * @param[out] p_stats statistics
+ * 
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer.
+ */
+int twi_stream_stats_get(twi_stream_stats_t * p_stats);
+#endif
+
+#if defined(CONFIG_APP_TWI_TAP)
+/**
+ * @brief Sets the function every transfer attempt is handed to, with its
+ * result, once the backend is done with it. It runs in the thread that owns
+ * the bus so it has to be short.
+ * 
+ * @param[in] tap function to call, NULL to stop tapping
+ */
+void twi_tap_set(const twi_port_tap_t tap);
+#endif
+
 #endif // TWI_H_
\ No newline at end of file
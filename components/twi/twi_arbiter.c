@@ -0,0 +1,271 @@
+/**
+ * @file      twi_arbiter.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     Priority aware ownership of the TWI bus. Callers queue up per
+ *            priority class and, inside a class, in order of their deadline.
+ *            The bus is handed directly from the releasing owner to the most
+ *            urgent waiter, so each transaction is a preemption point.
+ * 
+ * @version   0.1
+ * @date      2024-06-20
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/dlist.h>
+#include "twi_arbiter.h"
+#include "utils.h"
+
+#define NO_DEADLINE INT64_MAX  ///< absolute deadline of requests without one, sorts them last in their class
+
+/**
+ * @brief A thread waiting for the bus. It lives on the stack of the waiting
+ * thread for as long as it is queued.
+ */
+typedef struct
+{
+    sys_dnode_t   node;      ///< link in the queue of its priority class
+    struct k_sem  granted;   ///< given by the releasing owner once the bus is handed over
+    int64_t       deadline;  ///< absolute deadline in ticks, NO_DEADLINE if there is none
+} twi_waiter_t;
+
+#if defined(CONFIG_APP_TWI_STATS)
+/**
+ * @brief Per class statistics, protected by arbiter_lock.
+ */
+typedef struct
+{
+    histogram_t wait_us;         ///< time from request to ownership
+    uint32_t    deadline_misses; ///< requests that got the bus after their deadline
+} twi_class_stats_t;
+#endif
+
+static struct k_spinlock  arbiter_lock;                   ///< protects everything below
+static bool               bus_owned = false;              ///< true while a thread owns the bus
+static sys_dlist_t        waiters[TWI_PRIO_COUNT];        ///< one queue per priority class, sorted by deadline
+#if defined(CONFIG_APP_TWI_STATS)
+static twi_class_stats_t  class_stats[TWI_PRIO_COUNT];    ///< waiting time statistics per class
+#endif
+
+/**
+ * @brief Inserts a waiter into the queue of its class, after all the waiters
+ * with an earlier or equal deadline.
+ * 
+ * @param[in] p_queue  queue of the priority class
+ * @param[in] p_waiter waiter to insert
+ */
+static void twi_waiter_enqueue(sys_dlist_t * p_queue, twi_waiter_t * p_waiter)
+{
+    twi_waiter_t * p_queued;
+
+    SYS_DLIST_FOR_EACH_CONTAINER(p_queue, p_queued, node)
+    {
+        if (p_waiter->deadline < p_queued->deadline)
+        {
+            sys_dlist_insert(&p_queued->node, &p_waiter->node);
+            return;
+        }
+    }
+
+    sys_dlist_append(p_queue, &p_waiter->node);
+}
+
+/**
+ * @brief Records how long a request waited for the bus.
+ * 
+ * @param[in] prio      priority class of the request
+ * @param[in] requested tick at which the bus was requested
+ * @param[in] deadline  absolute deadline of the request in ticks
+ */
+static void twi_arbiter_record(const enum twi_prio prio, const int64_t requested, const int64_t deadline)
+{
+#if defined(CONFIG_APP_TWI_STATS)
+    const int64_t     now     = k_uptime_ticks();
+    const uint32_t    wait_us = (uint32_t)k_ticks_to_us_floor64((uint64_t)(now - requested));
+    k_spinlock_key_t  key     = k_spin_lock(&arbiter_lock);
+
+    histogram_record(&class_stats[prio].wait_us, wait_us);
+    if (now > deadline)
+    {
+        class_stats[prio].deadline_misses++;
+    }
+
+    k_spin_unlock(&arbiter_lock, key);
+#else
+    ARG_UNUSED(prio);
+    ARG_UNUSED(requested);
+    ARG_UNUSED(deadline);
+#endif
+}
+
+/**
+ * @brief Initializes the waiting queues and the statistics of the arbiter.
+ * Must be called once before any other arbiter function.
+ */
+void twi_arbiter_init(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&arbiter_lock);
+
+    for (uint8_t prio = 0U; prio < TWI_PRIO_COUNT; prio++)
+    {
+        sys_dlist_init(&waiters[prio]);
+#if defined(CONFIG_APP_TWI_STATS)
+        histogram_reset(&class_stats[prio].wait_us);
+        class_stats[prio].deadline_misses = 0U;
+#endif
+    }
+    bus_owned = false;
+
+    k_spin_unlock(&arbiter_lock, key);
+}
+
+/**
+ * @brief Blocks until the calling thread owns the bus. Unlike a k_mutex there
+ * is no priority inheritance, the owner is expected to only hold the bus for
+ * a single transaction.
+ * 
+ * @param[in] prio        priority class of the request
+ * @param[in] deadline_us time in microseconds, from now, by which the bus is
+ *                        needed. 0 means no deadline.
+ * @param[in] timeout     longest time to wait for the bus
+ * 
+ * @return 0 once the bus is owned
+ * @return -EAGAIN if the bus was not handed over in time.
+ */
+int twi_arbiter_acquire(const enum twi_prio prio, const uint32_t deadline_us, const k_timeout_t timeout)
+{
+    const int64_t requested = k_uptime_ticks();
+    twi_waiter_t  waiter;
+    k_spinlock_key_t key;
+
+    waiter.deadline = (deadline_us == 0U) ? NO_DEADLINE
+                                          : requested + (int64_t)k_us_to_ticks_ceil64(deadline_us);
+
+    key = k_spin_lock(&arbiter_lock);
+    if (!bus_owned)
+    {
+        // nobody owns the bus, so nobody can be queued either
+        bus_owned = true;
+        k_spin_unlock(&arbiter_lock, key);
+    }
+    else
+    {
+        k_sem_init(&waiter.granted, 0, 1);
+        sys_dnode_init(&waiter.node);
+        twi_waiter_enqueue(&waiters[prio], &waiter);
+        k_spin_unlock(&arbiter_lock, key);
+
+        // ownership is handed over by twi_arbiter_release, bus_owned stays true
+        if (k_sem_take(&waiter.granted, timeout) != 0)
+        {
+            key = k_spin_lock(&arbiter_lock);
+            if (sys_dnode_is_linked(&waiter.node))
+            {
+                sys_dlist_remove(&waiter.node);
+                k_spin_unlock(&arbiter_lock, key);
+                return -EAGAIN;
+            }
+            k_spin_unlock(&arbiter_lock, key);
+
+            // the bus was handed over between the timeout and taking the lock, so it is ours;
+            // the releaser gives the semaphore after unlocking, waiting for it keeps it off a dead frame
+            (void)k_sem_take(&waiter.granted, K_FOREVER);
+        }
+    }
+
+    twi_arbiter_record(prio, requested, waiter.deadline);
+
+    return 0;
+}
+
+/**
+ * @brief Releases the bus and hands it to the most urgent waiter, if any.
+ * 
+ * @return 0 on success
+ * @return -EPERM if the bus was not owned.
+ */
+int twi_arbiter_release(void)
+{
+    sys_dnode_t * p_node = NULL;
+    k_spinlock_key_t key = k_spin_lock(&arbiter_lock);
+
+    if (!bus_owned)
+    {
+        k_spin_unlock(&arbiter_lock, key);
+        return -EPERM;
+    }
+
+    for (uint8_t prio = 0U; (prio < TWI_PRIO_COUNT) && (p_node == NULL); prio++)
+    {
+        p_node = sys_dlist_get(&waiters[prio]);
+    }
+
+    if (p_node == NULL)
+    {
+        bus_owned = false;
+    }
+    k_spin_unlock(&arbiter_lock, key);
+
+    if (p_node != NULL)
+    {
+        twi_waiter_t * p_waiter = CONTAINER_OF(p_node, twi_waiter_t, node);
+        k_sem_give(&p_waiter->granted);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Copies the waiting time statistics of a priority class.
+ * 
+ * @param[in]  prio    priority class
+ * @param[out] p_stats statistics
+ * 
+ * @return 0 on success
+ * @return -EINVAL on an invalid class or a NULL pointer
+ * @return -ENOTSUP if CONFIG_APP_TWI_STATS is disabled.
+ */
+int twi_arbiter_stats_get(const enum twi_prio prio, twi_wait_stats_t * p_stats)
+{
+    if ((prio >= TWI_PRIO_COUNT) || (p_stats == NULL))
+    {
+        return -EINVAL;
+    }
+
+#if defined(CONFIG_APP_TWI_STATS)
+    k_spinlock_key_t key = k_spin_lock(&arbiter_lock);
+    const histogram_t * p_hist = &class_stats[prio].wait_us;
+
+    p_stats->count           = p_hist->count;
+    p_stats->total_us        = p_hist->sum;
+    p_stats->max_us          = p_hist->max;
+    p_stats->p50_us          = histogram_percentile(p_hist, 50U);
+    p_stats->p99_us          = histogram_percentile(p_hist, 99U);
+    p_stats->deadline_misses = class_stats[prio].deadline_misses;
+
+    k_spin_unlock(&arbiter_lock, key);
+
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+/**
+ * @brief Clears the waiting time statistics of all priority classes.
+ */
+void twi_arbiter_stats_reset(void)
+{
+#if defined(CONFIG_APP_TWI_STATS)
+    k_spinlock_key_t key = k_spin_lock(&arbiter_lock);
+
+    for (uint8_t prio = 0U; prio < TWI_PRIO_COUNT; prio++)
+    {
+        histogram_reset(&class_stats[prio].wait_us);
+        class_stats[prio].deadline_misses = 0U;
+    }
+
+    k_spin_unlock(&arbiter_lock, key);
+#endif
+}
@@ -0,0 +1,68 @@
+/**
+ * @file      twi_arbiter.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     Priority aware ownership of the TWI bus. Callers queue up per
+ *            priority class and, inside a class, in order of their deadline.
+ *            The bus is handed directly from the releasing owner to the most
+ *            urgent waiter, so each transaction is a preemption point.
+ * 
+ * @version   0.1
+ * @date      2024-06-20
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef TWI_ARBITER_H_
+#define TWI_ARBITER_H_
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include "twi.h"
+
+/**
+ * @brief Initializes the waiting queues and the statistics of the arbiter.
+ * Must be called once before any other arbiter function.
+ */
+void twi_arbiter_init(void);
+
+/**
+ * @brief Blocks until the calling thread owns the bus. Unlike a k_mutex there
+ * is no priority inheritance, the owner is expected to only hold the bus for
+ * a single transaction.
+ * 
+ * @param[in] prio        priority class of the request
+ * @param[in] deadline_us time in microseconds, from now, by which the bus is
+ *                        needed. 0 means no deadline.
+ * @param[in] timeout     longest time to wait for the bus
+ * 
+ * @return 0 once the bus is owned
+ * @return -EAGAIN if the bus was not handed over in time.
+ */
+int twi_arbiter_acquire(const enum twi_prio prio, const uint32_t deadline_us, const k_timeout_t timeout);
+
+/**
+ * @brief Releases the bus and hands it to the most urgent waiter, if any.
+ * 
+ * @return 0 on success
+ * @return -EPERM if the bus was not owned.
+ */
+int twi_arbiter_release(void);
+
+/**
+ * @brief Copies the waiting time statistics of a priority class.
+ * 
+ * @param[in]  prio    priority class
+ * @param[out] p_stats statistics
+ * 
+ * @return 0 on success
+ * @return -EINVAL on an invalid class or a NULL pointer
+ * @return -ENOTSUP if CONFIG_APP_TWI_STATS is disabled.
+ */
+int twi_arbiter_stats_get(const enum twi_prio prio, twi_wait_stats_t * p_stats);
+
+/**
+ * @brief Clears the waiting time statistics of all priority classes.
+ */
+void twi_arbiter_stats_reset(void);
+
+#endif // TWI_ARBITER_H_
@@ -0,0 +1,59 @@
+/**
+ * @file      twi_emul.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     Emulated TWI bus for native_sim. Targets are plain register
+ *            files with auto-incrementing addresses, and faults can be
+ *            injected to measure the error recovery on the host.
+ * 
+ * @version   0.1
+ * @date      2024-06-24
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef TWI_EMUL_H_
+#define TWI_EMUL_H_
+
+#include <stdint.h>
+
+/**@brief Faults the emulated bus can inject. */
+enum twi_emul_fault
+{
+    TWI_EMUL_FAULT_NONE = 0,   // Transfers behave normally
+    TWI_EMUL_FAULT_ANACK,      // The address byte is not acknowledged
+    TWI_EMUL_FAULT_DNACK,      // The first data byte is not acknowledged
+    TWI_EMUL_FAULT_STUCK_SDA,  // SDA is held low, transfers hang until the bus is recovered
+};
+
+/**
+ * @brief Adds a target to the emulated bus.
+ * 
+ * @param[in] address     7-bit address of the target
+ * @param[in] p_registers register file of the target, it is read and written in place
+ * @param[in] size        number of registers, accesses wrap around at the end
+ * 
+ * @return 0 on success
+ * @return -ENOMEM if there are no free target slots
+ * @return -EINVAL on a NULL or empty register file.
+ */
+int twi_emul_target_add(const uint8_t address, uint8_t * p_registers, const uint16_t size);
+
+/**
+ * @brief Injects a fault into the next transfers.
+ * 
+ * @param[in] fault_type fault to inject
+ * @param[in] count      number of transfers that fail. A stuck SDA line stays
+ *                       stuck until this many bus recoveries have been done.
+ */
+void twi_emul_fault_inject(const enum twi_emul_fault fault_type, const uint32_t count);
+
+/**
+ * @brief Sets the emulated bus timing, by default that of a 100 kHz bus. A
+ * change of the bus clock sets the byte time again.
+ * 
+ * @param[in] byte_time    time for one byte including its acknowledge
+ * @param[in] recover_time time taken by a bus recovery
+ */
+void twi_emul_timing_set(const uint32_t byte_time, const uint32_t recover_time);
+
+#endif // TWI_EMUL_H_
@@ -0,0 +1,162 @@
+/**
+ * @file      twi_port.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     Interface between the TWI component and the peripheral that
+ *            actually moves the bytes. The nrfx backend drives the TWI0
+ *            peripheral, the emulated backend serves register files on
+ *            native_sim. Callers must own the bus through the arbiter.
+ * 
+ * @version   0.1
+ * @date      2024-06-24
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef TWI_PORT_H_
+#define TWI_PORT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+#define TWI_PORT_MAX_WRITE_LENGTH 32U  ///< longest register write, it is sent as one transfer with the register address
+
+/**
+ * @brief A single transfer. With a register address, writes go out as
+ * address + register + data, reads as address + register and a repeated
+ * start for the data.
+ */
+typedef struct
+{
+    uint8_t   address;      ///< 7-bit device address
+    bool      has_reg;      ///< true if reg_address is sent before the data
+    uint8_t   reg_address;  ///< register address, only used with has_reg
+    bool      read;         ///< true to read into p_data, false to write it
+    uint8_t * p_data;       ///< data to write or buffer to read into
+    uint16_t  length;       ///< number of data bytes
+} twi_port_xfer_t;
+
+/**
+ * @brief Observer of the transfers given to the backend, see twi_tap_set().
+ * 
+ * @param[in] p_xfer transfer, with the bytes read when it succeeded
+ * @param[in] err    result of the backend
+ */
+typedef void (*twi_port_tap_t)(const twi_port_xfer_t * p_xfer, int err);
+
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+/**
+ * @brief Called from the interrupt of the stream once a block of slots is
+ * filled.
+ *
+ * @param[in] block    block that was filled, 0 or 1
+ * @param[in] replayed a trigger that came while the block was switched was started by software
+ * @param[in] failed   a read of the block was not acknowledged, its slot kept the old data
+ */
+typedef void (*twi_port_stream_handler_t)(const uint8_t block, const bool replayed, const bool failed);
+
+/**
+ * @brief A register read started by the rising edge of a pin, without the
+ * CPU. Each read fills the next slot of two blocks of slot_count slots,
+ * followed by a spare slot.
+ */
+typedef struct
+{
+    uint8_t                   address;       ///< 7-bit device address
+    uint8_t                   reg_address;   ///< register the reads start at
+    uint16_t                  slot_length;   ///< bytes of each read
+    uint16_t                  slot_count;    ///< slots of each block, the CPU is woken once per block
+    uint8_t *                 p_buffer;      ///< two blocks and the spare slot, in RAM
+    uint32_t                  trigger_pin;   ///< pin whose rising edge starts a read
+    uint32_t                  frequency_hz;  ///< bus clock of the reads
+    twi_port_stream_handler_t handler;       ///< called for every filled block
+} twi_port_stream_t;
+#endif
+
+/**
+ * @brief Initializes the backend with the bus pins.
+ * 
+ * @param[in] scl_pin SCL pin number
+ * @param[in] sda_pin SDA pin number
+ * 
+ * @return 0 on success
+ * @return -ENOTTY on error.
+ */
+int twi_port_init(const uint32_t scl_pin, const uint32_t sda_pin);
+
+/**
+ * @brief Enables the peripheral. The state is kept over a bus recovery.
+ */
+void twi_port_enable(void);
+
+/**
+ * @brief Disables the peripheral. The state is kept over a bus recovery.
+ */
+void twi_port_disable(void);
+
+/**
+ * @brief Sets the bus clock of the following transfers. Only called between
+ * transfers, the clock is kept over a bus recovery.
+ * 
+ * @param[in] frequency_hz 100000, 250000 or 400000
+ */
+void twi_port_frequency_set(const uint32_t frequency_hz);
+
+/**
+ * @brief Runs one transfer and waits for it to complete.
+ * 
+ * @param[in] p_xfer  transfer to run
+ * @param[in] timeout longest time to wait for the transfer to complete
+ * 
+ * @return 0 on success
+ * @return -ENXIO if the address was not acknowledged
+ * @return -EIO on a data NACK or a bus error
+ * @return -ETIMEDOUT if the transfer did not complete in time
+ * @return -EBUSY if the peripheral is stuck in a previous transfer
+ * @return -EINVAL if the transfer is too long.
+ */
+int twi_port_transfer(const twi_port_xfer_t * p_xfer, const k_timeout_t timeout);
+
+/**
+ * @brief Clocks SCL until a target holding SDA low lets go, issues a stop
+ * condition and re-initializes the peripheral.
+ * 
+ * @return 0 if the bus is free again
+ * @return -EIO if SDA is still held low.
+ */
+int twi_port_bus_recover(void);
+
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+/**
+ * @brief Arms a hardware triggered stream. The peripheral has to be enabled.
+ *
+ * @param[in] p_stream stream, copied
+ *
+ * @return 0 on success
+ * @return -EINVAL if a slot does not fit a single read or the stream is armed already
+ * @return -ENODEV if the pin or the hardware channels could not be taken.
+ */
+int twi_port_stream_start(const twi_port_stream_t * p_stream);
+
+/**
+ * @brief Disarms the stream, lets a running read end and frees the pin and
+ * the hardware channels.
+ */
+void twi_port_stream_stop(void);
+
+/**
+ * @brief Holds the triggers back and lets a running read end, so the bus can
+ * be used for other transfers until \ref twi_port_stream_resume.
+ */
+void twi_port_stream_pause(void);
+
+/**
+ * @brief Arms the triggers again and starts the read of a trigger that came
+ * during the pause.
+ *
+ * @return true if such a read was started.
+ */
+bool twi_port_stream_resume(void);
+#endif
+
+#endif // TWI_PORT_H_
@@ -0,0 +1,249 @@
+/**
+ * @file      twi_port_emul.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     TWI backend for native_sim. Serves register files instead of
+ *            real devices, spends the time a real bus would take, and can
+ *            inject NACKs and a stuck bus.
+ * 
+ * @version   0.1
+ * @date      2024-06-24
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "twi_port.h"
+#include "twi_emul.h"
+
+LOG_MODULE_DECLARE(twi_component, CONFIG_APP_TWI_LOG_LEVEL);
+
+#define EMUL_MAX_TARGETS          4U    ///< number of targets the emulated bus can hold
+#define EMUL_DEFAULT_BYTE_TIME_US 90U   ///< 9 clocks at 100 kHz
+#define EMUL_DEFAULT_RECOVER_US   200U  ///< 9 clocks, a stop condition and the re-initialization
+
+/**@brief A target on the emulated bus. */
+typedef struct
+{
+    uint8_t   address;      ///< 7-bit address, 0 if the slot is free
+    uint8_t * p_registers;  ///< register file
+    uint16_t  size;         ///< number of registers
+    uint16_t  pointer;      ///< register accessed by the next data byte
+} emul_target_t;
+
+static emul_target_t        targets[EMUL_MAX_TARGETS] = { 0 };
+static enum twi_emul_fault  fault       = TWI_EMUL_FAULT_NONE;
+static uint32_t             fault_count = 0U;
+static bool                 sda_stuck   = false;
+static bool                 enabled     = false;
+static uint32_t             byte_time_us    = EMUL_DEFAULT_BYTE_TIME_US;
+static uint32_t             recover_time_us = EMUL_DEFAULT_RECOVER_US;
+
+/**
+ * @brief Finds the target answering an address.
+ * 
+ * @param[in] address 7-bit address
+ * 
+ * @return the target, or NULL if nobody answers
+ */
+static emul_target_t * emul_target_find(const uint8_t address)
+{
+    for (uint8_t i = 0U; i < EMUL_MAX_TARGETS; i++)
+    {
+        if ((targets[i].p_registers != NULL) && (targets[i].address == address))
+        {
+            return &targets[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Adds a target to the emulated bus.
+ * 
+ * @param[in] address     7-bit address of the target
+ * @param[in] p_registers register file of the target, it is read and written in place
+ * @param[in] size        number of registers, accesses wrap around at the end
+ * 
+ * @return 0 on success
+ * @return -ENOMEM if there are no free target slots
+ * @return -EINVAL on a NULL or empty register file.
+ */
+int twi_emul_target_add(const uint8_t address, uint8_t * p_registers, const uint16_t size)
+{
+    if ((p_registers == NULL) || (size == 0U))
+    {
+        return -EINVAL;
+    }
+
+    for (uint8_t i = 0U; i < EMUL_MAX_TARGETS; i++)
+    {
+        if (targets[i].p_registers == NULL)
+        {
+            targets[i].address     = address;
+            targets[i].p_registers = p_registers;
+            targets[i].size        = size;
+            targets[i].pointer     = 0U;
+            return 0;
+        }
+    }
+
+    return -ENOMEM;
+}
+
+/**
+ * @brief Injects a fault into the next transfers.
+ * 
+ * @param[in] fault_type fault to inject
+ * @param[in] count      number of transfers that fail. A stuck SDA line stays
+ *                       stuck until this many bus recoveries have been done.
+ */
+void twi_emul_fault_inject(const enum twi_emul_fault fault_type, const uint32_t count)
+{
+    fault       = fault_type;
+    fault_count = count;
+    sda_stuck   = (fault_type == TWI_EMUL_FAULT_STUCK_SDA) && (count != 0U);
+}
+
+/**
+ * @brief Sets the emulated bus timing, by default that of a 100 kHz bus. A
+ * change of the bus clock sets the byte time again.
+ * 
+ * @param[in] byte_time    time for one byte including its acknowledge
+ * @param[in] recover_time time taken by a bus recovery
+ */
+void twi_emul_timing_set(const uint32_t byte_time, const uint32_t recover_time)
+{
+    byte_time_us    = byte_time;
+    recover_time_us = recover_time;
+}
+
+/**
+ * @brief Nothing to initialize, the pins only exist on real hardware.
+ */
+int twi_port_init(const uint32_t scl_pin, const uint32_t sda_pin)
+{
+    ARG_UNUSED(scl_pin);
+    ARG_UNUSED(sda_pin);
+
+    return 0;
+}
+
+/**
+ * @brief Targets only answer while the emulated peripheral is enabled.
+ */
+void twi_port_enable(void)
+{
+    enabled = true;
+}
+
+/**
+ * @brief Disables the emulated peripheral, targets stop answering.
+ */
+void twi_port_disable(void)
+{
+    enabled = false;
+}
+
+/**
+ * @brief Scales the byte time to the bus clock, 9 clocks per byte. This
+ * replaces a byte time given to twi_emul_timing_set().
+ */
+void twi_port_frequency_set(const uint32_t frequency_hz)
+{
+    byte_time_us = DIV_ROUND_UP(9U * 1000000U, frequency_hz);
+}
+
+/**
+ * @brief Runs a transfer against the register file of the addressed target,
+ * applying the injected faults and the bus timing.
+ */
+int twi_port_transfer(const twi_port_xfer_t * p_xfer, const k_timeout_t timeout)
+{
+    emul_target_t * p_target;
+
+    if (sda_stuck)
+    {
+        // the transfer never completes, just like on a real bus
+        (void)k_sleep(timeout);
+        return -ETIMEDOUT;
+    }
+
+    if (!p_xfer->read && (p_xfer->length > TWI_PORT_MAX_WRITE_LENGTH))
+    {
+        return -EINVAL;
+    }
+
+    // address byte
+    k_busy_wait(byte_time_us);
+
+    p_target = emul_target_find(p_xfer->address);
+    if ((p_target == NULL) || !enabled || ((fault == TWI_EMUL_FAULT_ANACK) && (fault_count != 0U)))
+    {
+        if ((fault == TWI_EMUL_FAULT_ANACK) && (fault_count != 0U))
+        {
+            fault_count--;
+        }
+        return -ENXIO;
+    }
+
+    if ((fault == TWI_EMUL_FAULT_DNACK) && (fault_count != 0U))
+    {
+        fault_count--;
+        k_busy_wait(byte_time_us);
+        return -EIO;
+    }
+
+    if (p_xfer->has_reg)
+    {
+        p_target->pointer = p_xfer->reg_address % p_target->size;
+        k_busy_wait(byte_time_us);
+        if (p_xfer->read)
+        {
+            // repeated start and address byte
+            k_busy_wait(byte_time_us);
+        }
+    }
+
+    for (uint16_t i = 0U; i < p_xfer->length; i++)
+    {
+        if (p_xfer->read)
+        {
+            p_xfer->p_data[i] = p_target->p_registers[p_target->pointer];
+        }
+        else
+        {
+            p_target->p_registers[p_target->pointer] = p_xfer->p_data[i];
+        }
+        p_target->pointer = (p_target->pointer + 1U) % p_target->size;
+    }
+    k_busy_wait(byte_time_us * p_xfer->length);
+
+    return 0;
+}
+
+/**
+ * @brief Spends the recovery time and, once enough recoveries were done,
+ * releases a stuck SDA line.
+ */
+int twi_port_bus_recover(void)
+{
+    k_busy_wait(recover_time_us);
+
+    if (sda_stuck)
+    {
+        fault_count--;
+        if (fault_count == 0U)
+        {
+            sda_stuck = false;
+            fault     = TWI_EMUL_FAULT_NONE;
+        }
+        else
+        {
+            return -EIO;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,659 @@
+/**
+ * @file      twi_port_nrfx.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ * 
+ * @brief     TWI backend for the nrfx TWI driver. With CONFIG_APP_TWI_ASYNC
+ *            transfers run in the non-blocking mode of the driver so that a
+ *            stuck bus can be abandoned after a timeout instead of spinning
+ *            forever. Without it the driver blocks, which saves the
+ *            interrupt handler but leaves the timeouts unenforced.
+ *
+ *            With CONFIG_APP_TWI_HW_STREAM the same peripheral can run in
+ *            its EasyDMA mode as TWIM0: the edge of a sensor interrupt pin
+ *            starts a read through GPIOTE and (D)PPI, the reads fill an
+ *            array list of slots, and TIMER1 counts them in counter mode to
+ *            wake the CPU once a block of slots is full. The driver
+ *            transfers pause the stream and switch back to the TWI mode.
+ * 
+ * @version   0.1
+ * @date      2024-06-24
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/irq.h>
+#include <nrfx_twi.h>
+#include <nrfx_twi_twim.h>
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+#include <hal/nrf_twim.h>
+#include <hal/nrf_timer.h>
+#include <nrfx_gpiote.h>
+#include <helpers/nrfx_gppi.h>
+#endif
+#include <zephyr/logging/log.h>
+#include "twi_port.h"
+#include "utils.h"
+#if defined(CONFIG_APP_EVLOG)
+#include "evlog.h"
+#endif
+
+LOG_MODULE_DECLARE(twi_component, CONFIG_APP_TWI_LOG_LEVEL);
+
+#define TWI_INSTANCE_ID   0             ///< 0 -> NRFX_TWI0, which has been configured in prj.conf
+#define TWI_IRQ_PRIORITY  6             ///< interrupt priority of the transfer events
+#define NO_FLAGS          (uint32_t)0U  ///< 0 -> default settings for nrfx_twi_xfer
+#define NO_CONTEXT        NULL          ///< NULL -> no context passed to nrfx_twi_init 
+
+/**
+ * @brief This instance is being set/populated by the NRFX_TWI_INSTANCE macro
+ * which gives all the relevant parameters to a nrfx_twi_t variable. Any use
+ * of this instance must be guarded by owning the bus through the arbiter.
+ */
+static const nrfx_twi_t twi_instance = NRFX_TWI_INSTANCE(TWI_INSTANCE_ID);
+
+static nrfx_twi_config_t twi_config;                       ///< kept for re-initializing after a bus recovery
+static uint32_t          twi_scl_pin;                      ///< SCL pin, toggled by the bus recovery
+static uint32_t          twi_sda_pin;                      ///< SDA pin, watched by the bus recovery
+static bool              twi_enabled = false;              ///< restored after a bus recovery
+static uint8_t           tx_buffer[TWI_PORT_MAX_WRITE_LENGTH + 1U];  ///< register address followed by the data
+
+#if defined(CONFIG_APP_TWI_ASYNC)
+static K_SEM_DEFINE(xfer_done, 0, 1);                      ///< given by the event handler
+static volatile nrfx_twi_evt_type_t xfer_result;           ///< result of the last transfer
+
+/**
+ * @brief Called from the TWI interrupt once a transfer is over.
+ */
+static void twi_event_handler(nrfx_twi_evt_t const * p_event, void * p_context)
+{
+    xfer_result = p_event->type;
+    k_sem_give(&xfer_done);
+}
+
+#define TWI_EVENT_HANDLER twi_event_handler  ///< non-blocking mode
+#else
+#define TWI_EVENT_HANDLER NULL               ///< blocking mode
+#endif
+
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+#define STREAM_TIMER        NRF_TIMER1             ///< counts the reads of the stream, must not be used by anything else
+#define STREAM_IRQ_PRIORITY 1                      ///< switches the block before the next trigger comes
+#define STREAM_CC_WAKE      NRF_TIMER_CC_CHANNEL0  ///< read count at which the current block is full
+#define STREAM_CC_NOW       NRF_TIMER_CC_CHANNEL1  ///< read count, captured by software
+#define STREAM_CC_TRIGGER   NRF_TIMER_CC_CHANNEL2  ///< read count at the last trigger
+#define STREAM_NO_TRIGGER   UINT32_MAX             ///< CC_TRIGGER before the first trigger
+#define STREAM_POLL_US      10U                    ///< polling step while waiting for a read to end
+#define STREAM_MAX_SLOT     ((1UL << TWIM0_EASYDMA_MAXCNT_SIZE) - 1UL)  ///< longest EasyDMA read
+
+/**@brief (D)PPI channels of the stream. */
+enum stream_ppi
+{
+    STREAM_PPI_START = 0,  ///< trigger -> STARTTX, the only channel of the group
+    STREAM_PPI_TRIGGER,    ///< trigger -> capture of the read count, also while held back
+    STREAM_PPI_COUNT,      ///< STOPPED -> count of the reads
+    STREAM_PPI_WAKE,       ///< block full -> group disable, until the CPU switched the block
+    STREAM_PPI_ERROR,      ///< ERROR -> STOP, a NACK still ends the read
+    STREAM_PPI_CHANNELS
+};
+
+static NRF_TWIM_Type * const stream_twim = NRF_TWIM0;        ///< TWI0 in its EasyDMA mode
+static const nrfx_gpiote_t   stream_gpiote = NRFX_GPIOTE_INSTANCE(0);
+static uint8_t               stream_reg;                     ///< register address of every read, EasyDMA needs it in RAM
+
+static struct
+{
+    twi_port_stream_t         config;
+    bool                      armed;                         ///< between start and stop
+    volatile bool             paused;                        ///< triggers held back for the driver transfers
+    volatile uint8_t          block;                         ///< block being filled
+    uint32_t                  read_us;                       ///< longest time of one read
+    uint8_t                   gpiote_channel;
+    uint8_t                   ppi[STREAM_PPI_CHANNELS];
+    uint8_t                   ppi_count;                     ///< channels allocated so far
+    nrfx_gppi_channel_group_t group;
+    bool                      group_allocated;
+} stream;
+
+static void stream_timer_isr(const void * p_arg);
+#endif
+
+/**
+ * @brief Initializes the backend with the bus pins.
+ * 
+ * @param[in] scl_pin SCL pin number
+ * @param[in] sda_pin SDA pin number
+ * 
+ * @return 0 on success
+ * @return -ENOTTY on error.
+ */
+int twi_port_init(const uint32_t scl_pin, const uint32_t sda_pin)
+{
+    nrfx_err_t nrfx_err = NRFX_ERROR_NOT_SUPPORTED;
+
+    /**
+     * @brief NRFX_TWI_DEFAULT_CONFIG is used to fill the default values for the bus
+     * priority etc, but this nrfx_twi_config_t struct can be manually filled
+     * as well if any other settings are to be used
+     */
+    const nrfx_twi_config_t config = NRFX_TWI_DEFAULT_CONFIG(scl_pin, sda_pin);
+
+    twi_config  = config;
+    twi_scl_pin = scl_pin;
+    twi_sda_pin = sda_pin;
+
+#if defined(CONFIG_APP_TWI_ASYNC)
+    IRQ_CONNECT(NRFX_IRQ_NUMBER_GET(NRF_TWI0), TWI_IRQ_PRIORITY, nrfx_isr, nrfx_twi_0_irq_handler, 0);
+#endif
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+    IRQ_CONNECT(NRFX_IRQ_NUMBER_GET(STREAM_TIMER), STREAM_IRQ_PRIORITY, stream_timer_isr, NULL, 0);
+    irq_enable(NRFX_IRQ_NUMBER_GET(STREAM_TIMER));
+#endif
+
+    nrfx_err = nrfx_twi_init(&twi_instance, &twi_config, TWI_EVENT_HANDLER, NO_CONTEXT);
+    if (nrfx_err != NRFX_SUCCESS)
+    {
+        LOG_ERR("twi_port_init:nrfx_twi_init failed with error: %s", nrfx_err_string(nrfx_err));
+        return -ENOTTY;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Enables the peripheral. The state is kept over a bus recovery.
+ */
+void twi_port_enable(void)
+{
+    nrfx_twi_enable(&twi_instance);
+    twi_enabled = true;
+}
+
+/**
+ * @brief Disables the peripheral. The state is kept over a bus recovery.
+ */
+void twi_port_disable(void)
+{
+    nrfx_twi_disable(&twi_instance);
+    twi_enabled = false;
+}
+
+/**
+ * @brief Sets the bus clock of the following transfers. The register can be
+ * written while the peripheral is enabled as long as it is idle.
+ * 
+ * @param[in] frequency_hz 100000, 250000 or 400000
+ */
+void twi_port_frequency_set(const uint32_t frequency_hz)
+{
+    switch (frequency_hz)
+    {
+        case 400000U: twi_config.frequency = NRF_TWI_FREQ_400K; break;
+        case 250000U: twi_config.frequency = NRF_TWI_FREQ_250K; break;
+        default:      twi_config.frequency = NRF_TWI_FREQ_100K; break;
+    }
+
+    nrf_twi_frequency_set(twi_instance.p_twi, twi_config.frequency);
+}
+
+/**
+ * @brief Runs one transfer and waits for it to complete.
+ * 
+ * @param[in] p_xfer  transfer to run
+ * @param[in] timeout longest time to wait for the transfer to complete
+ * 
+ * @return 0 on success
+ * @return -ENXIO if the address was not acknowledged
+ * @return -EIO on a data NACK or a bus error
+ * @return -ETIMEDOUT if the transfer did not complete in time
+ * @return -EBUSY if the peripheral is stuck in a previous transfer
+ * @return -EINVAL if the transfer is too long.
+ */
+int twi_port_transfer(const twi_port_xfer_t * p_xfer, const k_timeout_t timeout)
+{
+    nrfx_err_t nrfx_err;
+    uint8_t reg_address = p_xfer->reg_address;
+    nrfx_twi_xfer_desc_t xfer_desc;
+
+    if (p_xfer->read)
+    {
+        if (p_xfer->has_reg)
+        {
+            // register address, repeated start, data
+            const nrfx_twi_xfer_desc_t desc = NRFX_TWI_XFER_DESC_TXRX(p_xfer->address, &reg_address, sizeof(reg_address),
+                                                                      p_xfer->p_data, p_xfer->length);
+            xfer_desc = desc;
+        }
+        else
+        {
+            const nrfx_twi_xfer_desc_t desc = NRFX_TWI_XFER_DESC_RX(p_xfer->address, p_xfer->p_data, p_xfer->length);
+            xfer_desc = desc;
+        }
+    }
+    else
+    {
+        uint16_t tx_length = 0U;
+
+        if (p_xfer->length > TWI_PORT_MAX_WRITE_LENGTH)
+        {
+            return -EINVAL;
+        }
+
+        // the register address and the data go out as a single transfer
+        if (p_xfer->has_reg)
+        {
+            tx_buffer[tx_length++] = reg_address;
+        }
+        memcpy(&tx_buffer[tx_length], p_xfer->p_data, p_xfer->length);
+        tx_length += p_xfer->length;
+
+        const nrfx_twi_xfer_desc_t desc = NRFX_TWI_XFER_DESC_TX(p_xfer->address, tx_buffer, tx_length);
+        xfer_desc = desc;
+    }
+
+#if defined(CONFIG_APP_TWI_ASYNC)
+    k_sem_reset(&xfer_done);
+    nrfx_err = nrfx_twi_xfer(&twi_instance, &xfer_desc, NO_FLAGS);
+    if (nrfx_err != NRFX_SUCCESS)
+    {
+#if defined(CONFIG_APP_EVLOG)
+        evlog_put(EVLOG_TWI_NRFX_XFER, p_xfer->address, reg_address, -EIO, (uint32_t)nrfx_err);
+#else
+        LOG_ERR("twi_port_transfer:nrfx_twi_xfer failed with error: %s", nrfx_err_string(nrfx_err));
+#endif
+        return (nrfx_err == NRFX_ERROR_BUSY) ? -EBUSY : -EIO;
+    }
+
+    if (k_sem_take(&xfer_done, timeout) != 0)
+    {
+        // stops the peripheral mid transfer, the driver is only usable again after a recovery
+        nrfx_twi_disable(&twi_instance);
+        return -ETIMEDOUT;
+    }
+
+    switch (xfer_result)
+    {
+        case NRFX_TWI_EVT_DONE:          return 0;
+        case NRFX_TWI_EVT_ADDRESS_NACK:  return -ENXIO;
+        default:                         return -EIO;
+    }
+#else
+    ARG_UNUSED(timeout);
+
+    // returns once the transfer is over
+    nrfx_err = nrfx_twi_xfer(&twi_instance, &xfer_desc, NO_FLAGS);
+    switch (nrfx_err)
+    {
+        case NRFX_SUCCESS:                  return 0;
+        case NRFX_ERROR_DRV_TWI_ERR_ANACK:  return -ENXIO;
+        case NRFX_ERROR_BUSY:               return -EBUSY;
+        default:                            return -EIO;
+    }
+#endif
+}
+
+/**
+ * @brief Clocks SCL until a target holding SDA low lets go, issues a stop
+ * condition and re-initializes the peripheral.
+ * 
+ * @return 0 if the bus is free again
+ * @return -EIO if SDA is still held low.
+ */
+int twi_port_bus_recover(void)
+{
+    int err = 0;
+    nrfx_err_t nrfx_err;
+
+    nrfx_twi_uninit(&twi_instance);
+
+    nrfx_err = nrfx_twi_twim_bus_recover(twi_scl_pin, twi_sda_pin);
+    if (nrfx_err != NRFX_SUCCESS)
+    {
+#if defined(CONFIG_APP_EVLOG)
+        evlog_put(EVLOG_TWI_NRFX_RECOVER, 0U, 0U, -EIO, (uint32_t)nrfx_err);
+#else
+        LOG_ERR("twi_port_bus_recover:nrfx_twi_twim_bus_recover failed with error: %s", nrfx_err_string(nrfx_err));
+#endif
+        err = -EIO;
+    }
+
+    // re-initialized even if SDA is still low, so a later recovery can try again
+    nrfx_err = nrfx_twi_init(&twi_instance, &twi_config, TWI_EVENT_HANDLER, NO_CONTEXT);
+    if (nrfx_err != NRFX_SUCCESS)
+    {
+#if defined(CONFIG_APP_EVLOG)
+        evlog_put(EVLOG_TWI_NRFX_INIT, 0U, 0U, -EIO, (uint32_t)nrfx_err);
+#else
+        LOG_ERR("twi_port_bus_recover:nrfx_twi_init failed with error: %s", nrfx_err_string(nrfx_err));
+#endif
+        return -EIO;
+    }
+
+    if (twi_enabled)
+    {
+        nrfx_twi_enable(&twi_instance);
+    }
+
+    return err;
+}
+
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+/**
+ * @brief Gets the number of reads the stream has done.
+ */
+static uint32_t stream_reads(void)
+{
+    nrf_timer_task_trigger(STREAM_TIMER, nrf_timer_capture_task_get(STREAM_CC_NOW));
+    return nrf_timer_cc_get(STREAM_TIMER, STREAM_CC_NOW);
+}
+
+/**
+ * @brief Tells whether a trigger came after the last read ended. While the
+ * stream is armed that read is still running, while it is held back the
+ * read has not been started.
+ */
+static bool stream_triggered(void)
+{
+    return nrf_timer_cc_get(STREAM_TIMER, STREAM_CC_TRIGGER) == stream_reads();
+}
+
+/**
+ * @brief Gets the slot the next read goes to, from the reads done in the
+ * current block.
+ */
+static uint8_t * stream_next_slot(void)
+{
+    const uint32_t done = stream_reads() - (nrf_timer_cc_get(STREAM_TIMER, STREAM_CC_WAKE) - stream.config.slot_count);
+    const uint32_t slot = ((uint32_t)stream.block * stream.config.slot_count) + done;
+
+    return &stream.config.p_buffer[slot * stream.config.slot_length];
+}
+
+/**
+ * @brief Starts the read of a trigger that was held back.
+ */
+static void stream_read_start(void)
+{
+    nrf_timer_task_trigger(STREAM_TIMER, nrf_timer_capture_task_get(STREAM_CC_TRIGGER));
+    nrf_twim_task_trigger(stream_twim, NRF_TWIM_TASK_STARTTX);
+}
+
+/**
+ * @brief Switches the peripheral from the TWI mode to the stream reads. The
+ * registers are set again every time, the TWI mode shares some of them.
+ *
+ * @param[in] p_slot slot the next read goes to
+ */
+static void stream_twim_setup(uint8_t * p_slot)
+{
+    nrfx_twi_disable(&twi_instance);
+
+    nrf_twim_int_disable(stream_twim, NRF_TWIM_ALL_INTS_MASK);
+    nrf_twim_pins_set(stream_twim, twi_scl_pin, twi_sda_pin);
+    nrf_twim_frequency_set(stream_twim, (stream.config.frequency_hz >= 400000U) ? NRF_TWIM_FREQ_400K :
+                                        (stream.config.frequency_hz >= 250000U) ? NRF_TWIM_FREQ_250K :
+                                                                                  NRF_TWIM_FREQ_100K);
+    nrf_twim_address_set(stream_twim, stream.config.address);
+    nrf_twim_tx_buffer_set(stream_twim, &stream_reg, sizeof(stream_reg));
+    nrf_twim_rx_buffer_set(stream_twim, p_slot, stream.config.slot_length);
+    nrf_twim_tx_list_disable(stream_twim);
+    nrf_twim_rx_list_enable(stream_twim);
+    nrf_twim_shorts_set(stream_twim, NRF_TWIM_SHORT_LASTTX_STARTRX_MASK | NRF_TWIM_SHORT_LASTRX_STOP_MASK);
+    (void)nrf_twim_errorsrc_get_and_clear(stream_twim);
+    nrf_twim_enable(stream_twim);
+}
+
+/**
+ * @brief Frees the pin and the (D)PPI channels of the stream.
+ */
+static void stream_release(void)
+{
+    for (uint8_t i = 0U; i < stream.ppi_count; i++)
+    {
+        nrfx_gppi_channels_disable(BIT(stream.ppi[i]));
+        (void)nrfx_gppi_channel_free(stream.ppi[i]);
+    }
+    stream.ppi_count = 0U;
+
+    if (stream.group_allocated)
+    {
+        (void)nrfx_gppi_group_free(stream.group);
+        stream.group_allocated = false;
+    }
+
+    nrfx_gpiote_trigger_disable(&stream_gpiote, stream.config.trigger_pin);
+    (void)nrfx_gpiote_pin_uninit(&stream_gpiote, stream.config.trigger_pin);
+    (void)nrfx_gpiote_channel_free(&stream_gpiote, stream.gpiote_channel);
+}
+
+/**
+ * @brief Runs once a block is full. The compare event has already held the
+ * triggers back, so no read is running: the next block is set up and the
+ * triggers armed again, unless the driver paused the stream, then it is done
+ * by the resume.
+ */
+static void stream_timer_isr(const void * p_arg)
+{
+    const uint8_t full     = stream.block;
+    bool          replayed = false;
+    bool          failed   = false;
+
+    ARG_UNUSED(p_arg);
+
+    nrf_timer_event_clear(STREAM_TIMER, nrf_timer_compare_event_get(STREAM_CC_WAKE));
+    nrf_timer_cc_set(STREAM_TIMER, STREAM_CC_WAKE,
+                     nrf_timer_cc_get(STREAM_TIMER, STREAM_CC_WAKE) + stream.config.slot_count);
+    stream.block = full ^ 1U;
+
+    if (!stream.paused)
+    {
+        failed = (nrf_twim_errorsrc_get_and_clear(stream_twim) != 0U);
+        nrf_twim_rx_buffer_set(stream_twim, stream_next_slot(), stream.config.slot_length);
+
+        // an edge in the few cycles between the check and the enable is missed
+        replayed = stream_triggered();
+        nrfx_gppi_group_enable(stream.group);
+        if (replayed)
+        {
+            stream_read_start();
+        }
+    }
+
+    stream.config.handler(full, replayed, failed);
+}
+
+/**
+ * @brief Arms a hardware triggered stream. The peripheral has to be enabled.
+ * 
+ * @param[in] p_stream stream, copied
+ * 
+ * @return 0 on success
+ * @return -EINVAL if a slot does not fit a single read or the stream is armed already
+ * @return -ENODEV if the pin or the hardware channels could not be taken.
+ */
+int twi_port_stream_start(const twi_port_stream_t * p_stream)
+{
+    const nrf_gpio_pin_pull_t          pull    = NRF_GPIO_PIN_NOPULL;
+    const nrfx_gpiote_trigger_config_t trigger = {
+        .trigger      = NRFX_GPIOTE_TRIGGER_LOTOHI,
+        .p_in_channel = &stream.gpiote_channel,
+    };
+    const nrfx_gpiote_input_pin_config_t input = {
+        .p_pull_config    = &pull,
+        .p_trigger_config = &trigger,
+        .p_handler_config = NULL,
+    };
+    nrfx_err_t nrfx_err;
+    uint32_t   trigger_event;
+
+    if (stream.armed || (p_stream->slot_length == 0U) || (p_stream->slot_length > STREAM_MAX_SLOT) ||
+        (p_stream->slot_count == 0U) || (p_stream->frequency_hz == 0U))
+    {
+        return -EINVAL;
+    }
+
+    // the GPIO driver initializes GPIOTE, the stream only takes a channel of it
+    if (!nrfx_gpiote_init_check(&stream_gpiote) ||
+        (nrfx_gpiote_channel_alloc(&stream_gpiote, &stream.gpiote_channel) != NRFX_SUCCESS))
+    {
+        LOG_ERR("twi_port_stream_start:no GPIOTE channel for pin %u", p_stream->trigger_pin);
+        return -ENODEV;
+    }
+
+    nrfx_err = nrfx_gpiote_input_configure(&stream_gpiote, p_stream->trigger_pin, &input);
+    if (nrfx_err != NRFX_SUCCESS)
+    {
+        LOG_ERR("twi_port_stream_start:nrfx_gpiote_input_configure failed with error: %s", nrfx_err_string(nrfx_err));
+        (void)nrfx_gpiote_channel_free(&stream_gpiote, stream.gpiote_channel);
+        return -ENODEV;
+    }
+
+    stream.config = *p_stream;
+
+    for (; (nrfx_err == NRFX_SUCCESS) && (stream.ppi_count < STREAM_PPI_CHANNELS); stream.ppi_count++)
+    {
+        nrfx_err = nrfx_gppi_channel_alloc(&stream.ppi[stream.ppi_count]);
+        if (nrfx_err != NRFX_SUCCESS)
+        {
+            break;
+        }
+    }
+    if (nrfx_err == NRFX_SUCCESS)
+    {
+        nrfx_err               = nrfx_gppi_group_alloc(&stream.group);
+        stream.group_allocated = (nrfx_err == NRFX_SUCCESS);
+    }
+
+    if (nrfx_err != NRFX_SUCCESS)
+    {
+        LOG_ERR("twi_port_stream_start:no free (D)PPI channel or group, error: %s", nrfx_err_string(nrfx_err));
+        stream_release();
+        return -ENODEV;
+    }
+
+    stream_reg     = p_stream->reg_address;
+    stream.block   = 0U;
+    stream.paused  = false;
+    // address, register, repeated start, address and the data, 9 bits each, twice for clock stretching
+    stream.read_us = (uint32_t)((((p_stream->slot_length + 3ULL) * 9ULL) + 2ULL) * 2000000ULL / p_stream->frequency_hz);
+
+    nrf_timer_task_trigger(STREAM_TIMER, NRF_TIMER_TASK_STOP);
+    nrf_timer_mode_set(STREAM_TIMER, NRF_TIMER_MODE_COUNTER);
+    nrf_timer_bit_width_set(STREAM_TIMER, NRF_TIMER_BIT_WIDTH_32);
+    nrf_timer_task_trigger(STREAM_TIMER, NRF_TIMER_TASK_CLEAR);
+    nrf_timer_cc_set(STREAM_TIMER, STREAM_CC_WAKE, p_stream->slot_count);
+    nrf_timer_cc_set(STREAM_TIMER, STREAM_CC_TRIGGER, STREAM_NO_TRIGGER);
+    nrf_timer_event_clear(STREAM_TIMER, nrf_timer_compare_event_get(STREAM_CC_WAKE));
+    nrf_timer_int_enable(STREAM_TIMER, NRF_TIMER_INT_COMPARE0_MASK);
+    nrf_timer_task_trigger(STREAM_TIMER, NRF_TIMER_TASK_START);
+
+    trigger_event = nrfx_gpiote_in_event_address_get(&stream_gpiote, p_stream->trigger_pin);
+    nrfx_gppi_channel_endpoints_setup(stream.ppi[STREAM_PPI_START], trigger_event,
+                                      nrf_twim_task_address_get(stream_twim, NRF_TWIM_TASK_STARTTX));
+    nrfx_gppi_channel_endpoints_setup(stream.ppi[STREAM_PPI_TRIGGER], trigger_event,
+                                      nrf_timer_task_address_get(STREAM_TIMER, nrf_timer_capture_task_get(STREAM_CC_TRIGGER)));
+    nrfx_gppi_channel_endpoints_setup(stream.ppi[STREAM_PPI_COUNT],
+                                      nrf_twim_event_address_get(stream_twim, NRF_TWIM_EVENT_STOPPED),
+                                      nrf_timer_task_address_get(STREAM_TIMER, NRF_TIMER_TASK_COUNT));
+    nrfx_gppi_channel_endpoints_setup(stream.ppi[STREAM_PPI_WAKE],
+                                      nrf_timer_event_address_get(STREAM_TIMER, nrf_timer_compare_event_get(STREAM_CC_WAKE)),
+                                      nrfx_gppi_task_address_get(nrfx_gppi_group_disable_task_get(stream.group)));
+    nrfx_gppi_channel_endpoints_setup(stream.ppi[STREAM_PPI_ERROR],
+                                      nrf_twim_event_address_get(stream_twim, NRF_TWIM_EVENT_ERROR),
+                                      nrf_twim_task_address_get(stream_twim, NRF_TWIM_TASK_STOP));
+    nrfx_gppi_channels_include_in_group(BIT(stream.ppi[STREAM_PPI_START]), stream.group);
+
+    stream_twim_setup(stream_next_slot());
+    nrfx_gppi_channels_enable(BIT(stream.ppi[STREAM_PPI_TRIGGER]) | BIT(stream.ppi[STREAM_PPI_COUNT]) |
+                              BIT(stream.ppi[STREAM_PPI_WAKE]) | BIT(stream.ppi[STREAM_PPI_ERROR]));
+    nrfx_gppi_group_enable(stream.group);
+    nrfx_gpiote_trigger_enable(&stream_gpiote, p_stream->trigger_pin, false);
+
+    stream.armed = true;
+
+    return 0;
+}
+
+/**
+ * @brief Holds the triggers back and lets a running read end, so the bus can
+ * be used for other transfers until \ref twi_port_stream_resume.
+ */
+void twi_port_stream_pause(void)
+{
+    if (!stream.armed || stream.paused)
+    {
+        return;
+    }
+
+    stream.paused = true;
+    nrfx_gppi_group_disable(stream.group);
+
+    // a read started before the group was disabled ends within read_us, a trigger still pending after that came later
+    for (uint32_t waited_us = 0U; stream_triggered() && (waited_us < stream.read_us); waited_us += STREAM_POLL_US)
+    {
+        k_busy_wait(STREAM_POLL_US);
+    }
+
+    // the TWI mode raises STOPPED and ERROR at the same addresses
+    nrfx_gppi_channels_disable(BIT(stream.ppi[STREAM_PPI_COUNT]) | BIT(stream.ppi[STREAM_PPI_ERROR]));
+    nrf_twim_disable(stream_twim);
+    nrf_twim_shorts_set(stream_twim, 0U);
+    nrf_twi_frequency_set(twi_instance.p_twi, twi_config.frequency);
+
+    if (twi_enabled)
+    {
+        nrfx_twi_enable(&twi_instance);
+    }
+}
+
+/**
+ * @brief Arms the triggers again and starts the read of a trigger that came
+ * during the pause.
+ * 
+ * @return true if such a read was started.
+ */
+bool twi_port_stream_resume(void)
+{
+    bool pending;
+
+    if (!stream.armed || !stream.paused)
+    {
+        return false;
+    }
+
+    stream_twim_setup(stream_next_slot());
+    nrfx_gppi_channels_enable(BIT(stream.ppi[STREAM_PPI_COUNT]) | BIT(stream.ppi[STREAM_PPI_ERROR]));
+
+    pending       = stream_triggered();
+    stream.paused = false;
+    nrfx_gppi_group_enable(stream.group);
+    if (pending)
+    {
+        stream_read_start();
+    }
+
+    return pending;
+}
+
+/**
+ * @brief Disarms the stream, lets a running read end and frees the pin and
+ * the hardware channels.
+ */
+void twi_port_stream_stop(void)
+{
+    if (!stream.armed)
+    {
+        return;
+    }
+
+    // back in the TWI mode with no read running
+    twi_port_stream_pause();
+
+    nrf_timer_int_disable(STREAM_TIMER, NRF_TIMER_INT_COMPARE0_MASK);
+    nrf_timer_task_trigger(STREAM_TIMER, NRF_TIMER_TASK_STOP);
+    stream_release();
+
+    stream.armed  = false;
+    stream.paused = false;
+}
+#endif
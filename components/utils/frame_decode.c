@@ -0,0 +1,153 @@
+/**
+ * @file      frame_decode.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Batch decoder of big-endian sensor frames into structure of
+ *            arrays, see frame_decode.h.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include "frame_decode.h"
+
+/**
+ * @brief Swaps the bytes of both halves of a word. GCC and clang turn this
+ * into a single REV16 on ARMv6 and later.
+ */
+static ALWAYS_INLINE uint32_t frame_rev16(const uint32_t word)
+{
+    return ((word & 0x00FF00FFU) << 8) | ((word >> 8) & 0x00FF00FFU);
+}
+
+/**
+ * @brief Loads two big-endian samples as one word, the first one in the
+ * lower half whatever the byte order of the host.
+ */
+static ALWAYS_INLINE uint32_t frame_pair_load(const uint8_t * p_raw)
+{
+    uint32_t word;
+
+    memcpy(&word, p_raw, sizeof(word));
+#if (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    return frame_rev16(word);
+#else
+    return (word << 16) | (word >> 16);
+#endif
+}
+
+/**
+ * @brief Decodes a batch, inlined into every decoder with a constant number
+ * of channels so both loops over the channels unroll. With an odd number of
+ * channels a sample pair can straddle two frames, two frames are decoded
+ * per step then.
+ *
+ * @param[in]  p_raw    frames as read from the sensor
+ * @param[in]  frames   number of frames
+ * @param[out] pp_out   array of every channel, in frame order
+ * @param[in]  channels samples per frame
+ */
+static ALWAYS_INLINE void frame_decode_batch(const uint8_t * p_raw, const uint16_t frames,
+                                             int16_t * const * pp_out, const uint8_t channels)
+{
+    const uint8_t step = (channels & 1U) ? 2U : 1U;
+    uint16_t      frame;
+
+    for (frame = 0U; (frame + step) <= frames; frame += step)
+    {
+        const uint8_t * p_step = &p_raw[frame * channels * 2U];
+
+#pragma GCC unroll 16
+        for (uint8_t i = 0U; i < (step * channels); i += 2U)
+        {
+            const uint32_t pair = frame_pair_load(&p_step[i * 2U]);
+
+            pp_out[i % channels][frame + (i / channels)]               = (int16_t)(uint16_t)pair;
+            pp_out[(i + 1U) % channels][frame + ((i + 1U) / channels)] = (int16_t)(uint16_t)(pair >> 16);
+        }
+    }
+
+    // the last frame of an odd batch with an odd number of channels
+    for (; frame < frames; frame++)
+    {
+        const uint8_t * p_frame = &p_raw[frame * channels * 2U];
+
+#pragma GCC unroll 16
+        for (uint8_t c = 0U; c < channels; c++)
+        {
+            pp_out[c][frame] = (int16_t)(uint16_t)((p_frame[c * 2U] << 8) | p_frame[(c * 2U) + 1U]);
+        }
+    }
+}
+
+uint8_t frame_decode_frame_bytes(const enum frame_layout layout)
+{
+    switch (layout)
+    {
+        case FRAME_LAYOUT_ACCEL:
+        case FRAME_LAYOUT_GYRO:            return 6U;
+        case FRAME_LAYOUT_ACCEL_GYRO:      return 12U;
+        case FRAME_LAYOUT_ACCEL_TEMP_GYRO: return 14U;
+        default:                           return 0U;
+    }
+}
+
+void frame_decode_accel(const uint8_t * p_raw, const uint16_t frames, const frame_soa_t * p_out)
+{
+    int16_t * const out[] = { p_out->p_accel[0], p_out->p_accel[1], p_out->p_accel[2] };
+
+    frame_decode_batch(p_raw, frames, out, ARRAY_SIZE(out));
+}
+
+void frame_decode_gyro(const uint8_t * p_raw, const uint16_t frames, const frame_soa_t * p_out)
+{
+    int16_t * const out[] = { p_out->p_gyro[0], p_out->p_gyro[1], p_out->p_gyro[2] };
+
+    frame_decode_batch(p_raw, frames, out, ARRAY_SIZE(out));
+}
+
+void frame_decode_accel_gyro(const uint8_t * p_raw, const uint16_t frames, const frame_soa_t * p_out)
+{
+    int16_t * const out[] = {
+        p_out->p_accel[0], p_out->p_accel[1], p_out->p_accel[2],
+        p_out->p_gyro[0],  p_out->p_gyro[1],  p_out->p_gyro[2],
+    };
+
+    frame_decode_batch(p_raw, frames, out, ARRAY_SIZE(out));
+}
+
+void frame_decode_accel_temp_gyro(const uint8_t * p_raw, const uint16_t frames, const frame_soa_t * p_out)
+{
+    int16_t * const out[] = {
+        p_out->p_accel[0], p_out->p_accel[1], p_out->p_accel[2],
+        p_out->p_temp,
+        p_out->p_gyro[0],  p_out->p_gyro[1],  p_out->p_gyro[2],
+    };
+
+    frame_decode_batch(p_raw, frames, out, ARRAY_SIZE(out));
+}
+
+int frame_decode(const enum frame_layout layout, const uint8_t * p_raw, const uint16_t frames,
+                 const frame_soa_t * p_out)
+{
+    if ((p_raw == NULL) || (p_out == NULL))
+    {
+        return -EINVAL;
+    }
+
+    switch (layout)
+    {
+        case FRAME_LAYOUT_ACCEL:            frame_decode_accel(p_raw, frames, p_out);            break;
+        case FRAME_LAYOUT_GYRO:             frame_decode_gyro(p_raw, frames, p_out);             break;
+        case FRAME_LAYOUT_ACCEL_GYRO:       frame_decode_accel_gyro(p_raw, frames, p_out);       break;
+        case FRAME_LAYOUT_ACCEL_TEMP_GYRO:  frame_decode_accel_temp_gyro(p_raw, frames, p_out);  break;
+        default:                            return -EINVAL;
+    }
+
+    return 0;
+}
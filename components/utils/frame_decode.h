@@ -0,0 +1,111 @@
+/**
+ * @file      frame_decode.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Batch decoder of big-endian sensor frames into structure of
+ *            arrays. A batch of N frames, as drained from a FIFO, is turned
+ *            into one contiguous int16 array per channel in a single pass,
+ *            so filters and FFTs can read every axis as a plain array. The
+ *            bytes are swapped a 32-bit word at a time, two samples per
+ *            REV16 on ARM, and a decoder is specialised at compile time for
+ *            each frame layout so the channel loop is fully unrolled.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef FRAME_DECODE_H_
+#define FRAME_DECODE_H_
+
+#include <stdint.h>
+
+/**@brief Channels of a frame, in the order a MPU9250 FIFO frame holds them. */
+enum frame_channel
+{
+    FRAME_CH_ACCEL = 0x01,  ///< accelerometer x, y, z
+    FRAME_CH_TEMP  = 0x02,  ///< temperature
+    FRAME_CH_GYRO  = 0x04,  ///< gyroscope x, y, z
+};
+
+/**@brief Frame layouts with a specialised decoder. */
+enum frame_layout
+{
+    FRAME_LAYOUT_ACCEL           = FRAME_CH_ACCEL,
+    FRAME_LAYOUT_GYRO            = FRAME_CH_GYRO,
+    FRAME_LAYOUT_ACCEL_GYRO      = FRAME_CH_ACCEL | FRAME_CH_GYRO,
+    FRAME_LAYOUT_ACCEL_TEMP_GYRO = FRAME_CH_ACCEL | FRAME_CH_TEMP | FRAME_CH_GYRO,
+};
+
+/**
+ * @brief Destination of a decoded batch, one array per axis with room for
+ * all the frames. Only the arrays of the channels in the layout are used.
+ */
+typedef struct
+{
+    int16_t * p_accel[3];  ///< accelerometer x, y, z
+    int16_t * p_temp;      ///< temperature
+    int16_t * p_gyro[3];   ///< gyroscope x, y, z
+} frame_soa_t;
+
+/**
+ * @brief Gets the size of a frame.
+ *
+ * @param[in] layout frame layout
+ *
+ * @return bytes per frame, 0 for an unknown layout
+ */
+uint8_t frame_decode_frame_bytes(const enum frame_layout layout);
+
+/**
+ * @brief Decodes a batch of frames holding only accelerometer samples.
+ *
+ * @param[in]  p_raw  frames as read from the sensor
+ * @param[in]  frames number of frames
+ * @param[out] p_out  arrays to decode into
+ */
+void frame_decode_accel(const uint8_t * p_raw, const uint16_t frames, const frame_soa_t * p_out);
+
+/**
+ * @brief Decodes a batch of frames holding only gyroscope samples.
+ *
+ * @param[in]  p_raw  frames as read from the sensor
+ * @param[in]  frames number of frames
+ * @param[out] p_out  arrays to decode into
+ */
+void frame_decode_gyro(const uint8_t * p_raw, const uint16_t frames, const frame_soa_t * p_out);
+
+/**
+ * @brief Decodes a batch of accelerometer and gyroscope frames.
+ *
+ * @param[in]  p_raw  frames as read from the sensor
+ * @param[in]  frames number of frames
+ * @param[out] p_out  arrays to decode into
+ */
+void frame_decode_accel_gyro(const uint8_t * p_raw, const uint16_t frames, const frame_soa_t * p_out);
+
+/**
+ * @brief Decodes a batch of accelerometer, temperature and gyroscope frames.
+ *
+ * @param[in]  p_raw  frames as read from the sensor
+ * @param[in]  frames number of frames
+ * @param[out] p_out  arrays to decode into
+ */
+void frame_decode_accel_temp_gyro(const uint8_t * p_raw, const uint16_t frames, const frame_soa_t * p_out);
+
+/**
+ * @brief Decodes a batch with the specialised decoder of its layout, for
+ * callers that only know the layout at run time.
+ *
+ * @param[in]  layout frame layout
+ * @param[in]  p_raw  frames as read from the sensor
+ * @param[in]  frames number of frames
+ * @param[out] p_out  arrays to decode into
+ *
+ * @return 0 on success
+ * @return -EINVAL on a NULL pointer or an unknown layout.
+ */
+int frame_decode(const enum frame_layout layout, const uint8_t * p_raw, const uint16_t frames,
+                 const frame_soa_t * p_out);
+
+#endif // FRAME_DECODE_H_
@@ -10,19 +10,115 @@
  */
 
 #include "utils.h"
+#include <string.h>
+#include <zephyr/sys/util.h>
 #include <zephyr/sys/printk.h>
 
+#define PRINT_BUFFER_ROW 16U  ///< bytes per printed row
+
+/**
+ * @brief Prints a buffer as rows of hex and ASCII, one printk per row
+ * 
+ * @param[in] p_data buffer to print
+ * @param[in] length length of the buffer
+ */
 void print_buffer(const void * p_data, const uint16_t length)
 {
+    const uint8_t * p_bytes = (const uint8_t *)p_data;
+    char            hex[(3U * PRINT_BUFFER_ROW) + 1U];
+    char            ascii[PRINT_BUFFER_ROW + 1U];
+
     printk("\r\n + ======= len: %03u ======= +\n", length);
-    for (uint16_t i = 0; i < length; i++)
+    for (uint16_t row = 0; row < length; row += PRINT_BUFFER_ROW)
     {
-        uint8_t data = ((uint8_t *)p_data)[i]; // cppcheck-suppress cstyleCast
-        printk("\r | data[%03u] = 0x%02X, %03u, %c |\n", i, data, data, data);
+        const uint16_t count = MIN(length - row, PRINT_BUFFER_ROW);
+
+        for (uint16_t i = 0; i < count; i++)
+        {
+            const uint8_t data = p_bytes[row + i];
+            (void)snprintk(&hex[3U * i], 4U, "%02X ", data);
+            ascii[i] = ((data >= 0x20U) && (data < 0x7FU)) ? (char)data : '.';
+        }
+        hex[3U * count] = '\0';
+        ascii[count]    = '\0';
+        printk("\r | %03u: %-48s %s\n", row, hex, ascii);
     }
     printk("\r + ======================== +\n");
 }
 
+/**
+ * @brief Adds a value to a histogram
+ * 
+ * @param[in,out] p_hist histogram to update
+ * @param[in]     value  value to record
+ */
+void histogram_record(histogram_t * p_hist, const uint32_t value)
+{
+    uint32_t bucket = (value == 0U) ? 0U : (32U - (uint32_t)__builtin_clz(value));
+
+    if (bucket >= HISTOGRAM_BUCKETS)
+    {
+        bucket = HISTOGRAM_BUCKETS - 1U;
+    }
+
+    p_hist->buckets[bucket]++;
+    p_hist->count++;
+    p_hist->sum += value;
+    if (value > p_hist->max)
+    {
+        p_hist->max = value;
+    }
+}
+
+/**
+ * @brief Clears all the buckets and counters of a histogram
+ * 
+ * @param[out] p_hist histogram to clear
+ */
+void histogram_reset(histogram_t * p_hist)
+{
+    memset(p_hist, 0, sizeof(*p_hist));
+}
+
+/**
+ * @brief Estimates a percentile from a histogram. The result is the upper
+ * bound of the bucket the percentile falls in, clamped to the recorded maximum.
+ * 
+ * @param[in] p_hist  histogram to evaluate
+ * @param[in] percent percentile to look up, 0 to 100
+ * 
+ * @return the estimated percentile, 0 if the histogram is empty
+ */
+uint32_t histogram_percentile(const histogram_t * p_hist, const uint8_t percent)
+{
+    uint32_t result = 0U;
+
+    if (p_hist->count != 0U)
+    {
+        // rank of the sample we are looking for, rounded up so p100 is the last sample
+        const uint32_t rank  = (uint32_t)(((uint64_t)p_hist->count * percent + 99U) / 100U);
+        uint32_t       seen  = 0U;
+
+        for (uint32_t bucket = 0U; bucket < HISTOGRAM_BUCKETS; bucket++)
+        {
+            seen += p_hist->buckets[bucket];
+            if ((seen >= rank) && (seen != 0U))
+            {
+                result = (bucket == 0U) ? 0U : (uint32_t)((1ULL << bucket) - 1U);
+                break;
+            }
+        }
+
+        if (result > p_hist->max)
+        {
+            result = p_hist->max;
+        }
+    }
+
+    return result;
+}
+
+#if defined(CONFIG_HAS_NRFX)
 /**
  * @brief Helper function to provide string representation of the nrfx error
  * 
@@ -34,6 +130,7 @@ const char * nrfx_err_string(const nrfx_err_t err)
 {
     const char * result;
 
+#if defined(CONFIG_APP_ERROR_STRINGS)
     switch (err) 
     {
         case NRFX_SUCCESS:                   result = "Operation performed successfully.";                  break;
@@ -54,6 +151,11 @@ const char * nrfx_err_string(const nrfx_err_t err)
         case NRFX_ERROR_DRV_TWI_ERR_DNACK:   result = "TWI error: Data not acknowledged.";                  break;
         default:                             result = "Unknown error.";                                     break;
     }
+#else
+    ARG_UNUSED(err);
+    result = "nrfx error";
+#endif
 
     return result;
 }
+#endif
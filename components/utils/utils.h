@@ -13,19 +13,70 @@
 #define UTILS_H_
 
 #include <stdint.h>
+#if defined(CONFIG_HAS_NRFX)
 #include <nrfx.h>
+#endif
 
 #define LENGTH_OF(array) (sizeof(array) / sizeof(array[0]))
 
+#define HISTOGRAM_BUCKETS 24  ///< log2 buckets, the last one also holds everything above 2^22
+
+/**
+ * @brief Log2-bucketed histogram used for latency and jitter statistics. It
+ * is small enough to keep one per statistic and cheap enough to update from
+ * the hot path, at the cost of percentiles being rounded up to a power of two.
+ */
+typedef struct
+{
+    uint32_t buckets[HISTOGRAM_BUCKETS]; ///< bucket 0 holds 0, bucket n holds [2^(n-1), 2^n)
+    uint32_t count;                      ///< number of recorded values
+    uint32_t max;                        ///< largest recorded value
+    uint64_t sum;                        ///< sum of all recorded values
+} histogram_t;
+
+#if defined(CONFIG_HAS_NRFX)
 /**
  * @brief Helper function to provide string representation of the nrfx error
  * 
  * @param[in] err error code
  * 
- * @return string of the error code
+ * @return string of the error code, a generic string without CONFIG_APP_ERROR_STRINGS
  */
 const char * nrfx_err_string(const nrfx_err_t err);
+#endif
 
+/**
+ * @brief Prints a buffer as rows of hex and ASCII, one printk per row
+ * 
+ * @param[in] p_data buffer to print
+ * @param[in] length length of the buffer
+ */
 void print_buffer(const void * p_data, const uint16_t length);
 
+/**
+ * @brief Adds a value to a histogram
+ * 
+ * @param[in,out] p_hist histogram to update
+ * @param[in]     value  value to record
+ */
+void histogram_record(histogram_t * p_hist, const uint32_t value);
+
+/**
+ * @brief Clears all the buckets and counters of a histogram
+ * 
+ * @param[out] p_hist histogram to clear
+ */
+void histogram_reset(histogram_t * p_hist);
+
+/**
+ * @brief Estimates a percentile from a histogram. The result is the upper
+ * bound of the bucket the percentile falls in, clamped to the recorded maximum.
+ * 
+ * @param[in] p_hist  histogram to evaluate
+ * @param[in] percent percentile to look up, 0 to 100
+ * 
+ * @return the estimated percentile, 0 if the histogram is empty
+ */
+uint32_t histogram_percentile(const histogram_t * p_hist, const uint8_t percent);
+
 #endif // UTILS_H_
\ No newline at end of file
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+"""
+Event log messages from a console capture.
+
+Formats the "evlog:" hex lines that the event log prints with
+CONFIG_APP_EVLOG_HOST, see components/evlog. The messages match the ones
+the target prints when it formats the records itself. Other console output
+is passed through, so the events stay in place among the rest of the log.
+
+    python3 scripts/evlog_decode.py --console capture.log
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+EVLOG_LINE_RE = re.compile(r"evlog:([0-9a-fA-F]+)\s*$")
+RECORD_FORMAT = "<IBBBbI"    # timestamp_us, event, address, reg_address, err, value
+
+# enum evlog_event, in components/evlog/evlog.h
+EVENTS = {
+    0:  "{value} records dropped",
+    1:  "twi: bus timed out for device 0x{address:02X}",
+    2:  "twi: read of device 0x{address:02X} register 0x{reg:02X} failed after {value} attempts with error: {err}",
+    3:  "twi: write of device 0x{address:02X} register 0x{reg:02X} failed after {value} attempts with error: {err}",
+    4:  "twi: twi_arbiter_release failed with error: {err}",
+    5:  "twi: bus recovery took {value} us, err: {err}",
+    6:  "twi: nrfx_twi_xfer failed with error: {nrfx}",
+    7:  "twi: nrfx_twi_twim_bus_recover failed with error: {nrfx}",
+    8:  "twi: nrfx_twi_init failed with error: {nrfx}",
+    9:  "mpu_spi: nrfx_spim_xfer failed with error: {nrfx}",
+    10: "mpu_spi: magnetometer register 0x{reg:02x} timed out",
+}
+
+# nrfx_err_t, offsets from NRFX_ERROR_BASE_NUM and NRFX_ERROR_DRIVERS_BASE_NUM
+NRFX_ERRORS = {
+    0x0BAD0000: "Operation performed successfully.",
+    0x0BAD0001: "Internal error.",
+    0x0BAD0002: "No memory for operation.",
+    0x0BAD0003: "Not supported.",
+    0x0BAD0004: "Invalid parameter.",
+    0x0BAD0005: "Invalid state, operation disallowed in this state.",
+    0x0BAD0006: "Invalid length.",
+    0x0BAD0007: "Operation timed out.",
+    0x0BAD0008: "Operation is forbidden.",
+    0x0BAD0009: "Null pointer.",
+    0x0BAD000A: "Bad memory address.",
+    0x0BAD000B: "Busy.",
+    0x0BAD000C: "Module already initialized.",
+    0x0BAE0000: "TWI error: Overrun.",
+    0x0BAE0001: "TWI error: Address not acknowledged.",
+    0x0BAE0002: "TWI error: Data not acknowledged.",
+}
+
+
+def decode(record):
+    """Formats one record, as the target would."""
+    timestamp_us, event, address, reg, err, value = struct.unpack(RECORD_FORMAT, record)
+    template = EVENTS.get(event, "unknown event {event}")
+    nrfx = NRFX_ERRORS.get(value, "0x{:08X}".format(value))
+    message = template.format(event=event, address=address, reg=reg, err=err, value=value, nrfx=nrfx)
+    return "[{:10.6f}] {}".format(timestamp_us / 1e6, message)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Event log messages from a console capture")
+    parser.add_argument("--console", required=True, help="console output, - for stdin")
+    args = parser.parse_args()
+
+    record_size = struct.calcsize(RECORD_FORMAT)
+    console = sys.stdin if args.console == "-" else open(args.console, "r", errors="replace")
+
+    with console:
+        for line in console:
+            match = EVLOG_LINE_RE.search(line)
+            if match and len(match.group(1)) == 2 * record_size:
+                print(decode(bytes.fromhex(match.group(1))))
+            else:
+                sys.stdout.write(line)
+
+
+if __name__ == "__main__":
+    main()
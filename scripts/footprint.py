@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+"""
+ROM and RAM footprint of every application component.
+
+Reads the GNU linker map of the image and adds up the input sections that
+came from the sources of each directory under components/. Initialized data
+counts against both ROM, where its initial value is stored, and RAM.
+
+    python3 scripts/footprint.py --map build/zephyr/zephyr.map --components components
+"""
+
+import argparse
+import os
+import re
+import sys
+
+OBJECT_RE  = re.compile(r"(?:\(|/|^)([^/()\s]+)\.c\.obj\)?$")
+SECTION_RE = re.compile(r"^\s*0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$")
+OUTPUT_RE  = re.compile(r"^(\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)(?:\s+load address 0x([0-9a-fA-F]+))?")
+OUTPUT_NAME_ONLY_RE = re.compile(r"^(\S+)$")
+OUTPUT_ADDR_RE      = re.compile(r"^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)(?:\s+load address 0x([0-9a-fA-F]+))?$")
+REGION_RE  = re.compile(r"^(\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)")
+
+
+def component_sources(components_dir):
+    """Maps the base name of every C source to the component it belongs to."""
+    sources = {}
+    for component in sorted(os.listdir(components_dir)):
+        root_dir = os.path.join(components_dir, component)
+        if not os.path.isdir(root_dir):
+            continue
+        for dir_path, _, files in os.walk(root_dir):
+            for name in files:
+                if name.endswith(".c"):
+                    sources[name[:-2]] = component
+    return sources
+
+
+def memory_regions(lines):
+    """Origin and length of every memory region, keyed by region name."""
+    regions = {}
+    in_table = False
+    for line in lines:
+        if line.startswith("Memory Configuration"):
+            in_table = True
+            continue
+        if in_table:
+            if line.startswith("Linker script and memory map"):
+                break
+            match = REGION_RE.match(line)
+            if match and match.group(1) not in ("Name", "*default*"):
+                regions[match.group(1)] = (int(match.group(2), 16), int(match.group(3), 16))
+    return regions
+
+
+def in_regions(address, regions, names):
+    for name in names:
+        if name in regions:
+            origin, length = regions[name]
+            if origin <= address < origin + length:
+                return True
+    return False
+
+
+def footprint(map_path, sources):
+    with open(map_path, encoding="utf-8", errors="replace") as map_file:
+        lines = map_file.read().splitlines()
+
+    regions   = memory_regions(lines)
+    rom_names = [name for name in regions if name.upper() in ("FLASH", "ROM")]
+    ram_names = [name for name in regions if name.upper() in ("SRAM", "RAM")]
+    if not rom_names or not ram_names:
+        sys.exit("footprint: no FLASH and RAM regions in " + map_path)
+
+    usage        = {}
+    output_ram   = False  # the current output section lives in RAM
+    output_load  = False  # and has an initial value stored in ROM
+    pending_name = None
+    started      = False
+
+    for line in lines:
+        if not started:
+            started = line.startswith("Linker script and memory map")
+            continue
+
+        # output sections start in the first column, long names wrap
+        if line and not line[0].isspace():
+            match = OUTPUT_RE.match(line)
+            if match:
+                address     = int(match.group(2), 16)
+                output_ram  = in_regions(address, regions, ram_names)
+                output_load = match.group(4) is not None and \
+                              in_regions(int(match.group(4), 16), regions, rom_names)
+                pending_name = None
+            elif OUTPUT_NAME_ONLY_RE.match(line):
+                pending_name = "output"
+            continue
+
+        if pending_name == "output":
+            match = OUTPUT_ADDR_RE.match(line)
+            if match:
+                address     = int(match.group(1), 16)
+                output_ram  = in_regions(address, regions, ram_names)
+                output_load = match.group(3) is not None and \
+                              in_regions(int(match.group(3), 16), regions, rom_names)
+            pending_name = None
+            continue
+
+        # input sections are indented by one space, long names wrap as well
+        stripped = line.strip()
+        parts    = stripped.split(None, 1)
+        if line.startswith(" ") and not line.startswith("  ") and len(parts) == 1 \
+                and not stripped.startswith("*"):
+            pending_name = parts[0]
+            continue
+
+        match = SECTION_RE.match(line) if pending_name else None
+        if match is None and line.startswith(" ") and not line.startswith("  ") \
+                and len(parts) == 2 and not stripped.startswith("*"):
+            match = SECTION_RE.match(" " + parts[1])
+        pending_name = None
+        if match is None:
+            continue
+
+        size   = int(match.group(2), 16)
+        origin = OBJECT_RE.search(match.group(3).strip())
+        if size == 0 or origin is None or origin.group(1) not in sources:
+            continue
+
+        entry = usage.setdefault(sources[origin.group(1)], [0, 0])
+        if output_ram:
+            entry[1] += size
+            if output_load:
+                entry[0] += size
+        else:
+            entry[0] += size
+
+    return usage
+
+
+def main():
+    parser = argparse.ArgumentParser(description="ROM and RAM footprint of every component")
+    parser.add_argument("--map", required=True, help="linker map of the image")
+    parser.add_argument("--components", required=True, help="directory holding the components")
+    args = parser.parse_args()
+
+    usage = footprint(args.map, component_sources(args.components))
+
+    print("{:<16} {:>8} {:>8}".format("component", "ROM", "RAM"))
+    rom_total = 0
+    ram_total = 0
+    for component in sorted(usage, key=lambda name: -usage[name][0]):
+        rom, ram = usage[component]
+        rom_total += rom
+        ram_total += ram
+        print("{:<16} {:>8} {:>8}".format(component, rom, ram))
+    print("{:<16} {:>8} {:>8}".format("total", rom_total, ram_total))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,430 @@
+#!/usr/bin/env python3
+"""
+Trains the machine state classifier of the motion_cls component and writes
+its int8 model as a C header.
+
+The training windows come from the same integer signal generator that
+tests/motion_cls uses, so the features computed here are bit for bit the
+ones motion_cls.c computes. A float dense net of FEATURES -> HIDDEN -> CLASSES
+is trained on them, then quantized: inputs standardized to int8, int8
+weights, int32 biases and fixed point requantization between the layers.
+The accuracy of the float and of the int8 model is printed for the windows
+the test runs. The float net and the results the test has to reproduce go
+to a header of the test, so the firmware only carries the int8 net.
+
+    python3 scripts/motion_cls_train.py --out components/motion_cls/motion_cls_model.h \
+        --ref-out tests/motion_cls/src/motion_cls_model_ref.h
+
+Only the standard library is needed.
+"""
+
+import argparse
+import math
+import random
+import sys
+
+WINDOW   = 64    # samples of a window, as MOTION_CLS_WINDOW
+RATE_HZ  = 100   # sample rate the model is trained for
+FEATURES = 8
+HIDDEN   = 16
+CLASSES  = 4
+CLASS_NAMES = ["off", "idle", "running", "fault"]
+
+INPUT_SCALE   = 32  # int8 steps per standard deviation of a feature
+EXP_STEPS     = 64  # entries of the confidence table, 1/8 nat each
+EXP_PER_NAT   = 8
+
+TEST_WINDOWS  = 64  # windows per class the test runs
+SET_TRAIN     = 1
+SET_TEST      = 2
+
+SIN_Q15 = [int(round(32767 * math.sin(2 * math.pi * k / WINDOW))) for k in range(WINDOW)]
+EXP_Q16 = [int(round(65535 * math.exp(-k / EXP_PER_NAT))) for k in range(EXP_STEPS)]
+
+BANDS = [(1, 2), (3, 6), (7, 14), (15, 31)]  # DFT bins of the band energies
+
+
+def cdiv(a, b):
+    """Integer division truncating toward zero, like C."""
+    q = abs(a) // abs(b)
+    return q if (a >= 0) == (b > 0) else -q
+
+
+class Rng:
+    """xorshift32, as motion_cls_rand()."""
+
+    def __init__(self, seed):
+        self.state = seed & 0xFFFFFFFF
+
+    def next(self):
+        s = self.state
+        s ^= (s << 13) & 0xFFFFFFFF
+        s ^= s >> 17
+        s ^= (s << 5) & 0xFFFFFFFF
+        self.state = s
+        return s
+
+    def uni(self, lo, hi):
+        return lo + self.next() % (hi - lo + 1)
+
+    def gauss(self, sigma):
+        s = 0
+        for _ in range(4):
+            s += self.next() & 0xFFFF
+        return cdiv((s - 131070) * sigma, 37837)
+
+
+def window_seed(set_id, cls, index):
+    """Seed of a window, as window_seed() of the test."""
+    return ((((set_id << 16) | (cls << 12) | index) * 2654435761) & 0xFFFFFFFF) | 1
+
+
+def synth(cls, seed):
+    """One window of a class in mg, as window_make() of the test."""
+    rng = Rng(seed)
+    gx = rng.uni(-300, 300)
+    gy = rng.uni(-300, 300)
+    gz = math.isqrt(1000000 - gx * gx - gy * gy)
+    if rng.next() & 1:
+        gz = -gz
+
+    amp = amp2 = period = impact = step = 0
+    if cls == 0:
+        sigma = 4
+    elif cls == 1:
+        amp   = rng.uni(8, 30)
+        step  = rng.uni(70, 90) * 21474836
+        sigma = 6
+    else:
+        amp   = rng.uni(60, 250)
+        amp2  = amp // 4
+        step  = rng.uni(16, 50) * 21474836
+        sigma = 12
+        if cls == 3:
+            period = rng.uni(6, 14)
+            impact = rng.uni(250, 700)
+            sigma  = 40
+
+    phase  = rng.next()
+    offset = rng.uni(0, period - 1) if period else 0
+
+    out = []
+    for i in range(WINDOW):
+        s = cdiv(SIN_Q15[phase >> 26] * amp, 32767) + cdiv(SIN_Q15[((2 * phase) & 0xFFFFFFFF) >> 26] * amp2, 32767)
+        if period:
+            k = (i + offset) % period
+            if k < 4:
+                s += impact >> k
+        phase = (phase + step) & 0xFFFFFFFF
+
+        x = gx + cdiv(gx * s, 1000) + rng.gauss(sigma)
+        y = gy + cdiv(gy * s, 1000) + rng.gauss(sigma)
+        z = gz + cdiv(gz * s, 1000) + rng.gauss(sigma)
+        out.append((x, y, z))
+    return out
+
+
+def log2_q3(value):
+    """log2 in eighths, as motion_cls_log2_q3()."""
+    if value == 0:
+        return 0
+    msb = value.bit_length() - 1
+    frac = (value >> (msb - 3)) if msb >= 3 else (value << (3 - msb))
+    return msb * 8 + (frac & 7)
+
+
+def features(window):
+    """Features of a window, as motion_cls_features()."""
+    mag = [math.isqrt(x * x + y * y + z * z) for x, y, z in window]
+    mean = sum(mag) // WINDOW
+    d = [m - mean for m in mag]
+
+    std = math.isqrt(sum(v * v for v in d) // WINDOW)
+    p2p = max(mag) - min(mag)
+    zc = sum(1 for i in range(1, WINDOW) if (d[i - 1] < 0) != (d[i] < 0))
+
+    energy = [0] * (WINDOW // 2)
+    for k in range(1, WINDOW // 2):
+        re = 0
+        im = 0
+        for n in range(WINDOW):
+            idx = (k * n) & (WINDOW - 1)
+            re += d[n] * SIN_Q15[(idx + WINDOW // 4) & (WINDOW - 1)]
+            im += d[n] * SIN_Q15[idx]
+        re >>= 15
+        im >>= 15
+        energy[k] = re * re + im * im
+
+    bands = [log2_q3(sum(energy[lo:hi + 1])) for lo, hi in BANDS]
+    dominant = max(range(1, WINDOW // 2), key=lambda k: (energy[k], -k))
+    return [std, p2p, zc] + bands + [dominant]
+
+
+def dataset(set_id, per_class):
+    xs, ys = [], []
+    for cls in range(CLASSES):
+        for index in range(per_class):
+            xs.append(features(synth(cls, window_seed(set_id, cls, index))))
+            ys.append(cls)
+    return xs, ys
+
+
+def standardize(xs, mu, sd):
+    return [[(f - m) / s for f, m, s in zip(x, mu, sd)] for x in xs]
+
+
+def forward(p, z):
+    w1, b1, w2, b2 = p
+    h = [max(0.0, b1[k] + sum(w * v for w, v in zip(w1[k], z))) for k in range(HIDDEN)]
+    logits = [b2[c] + sum(w * v for w, v in zip(w2[c], h)) for c in range(CLASSES)]
+    return h, logits
+
+
+def softmax(logits):
+    top = max(logits)
+    e = [math.exp(v - top) for v in logits]
+    total = sum(e)
+    return [v / total for v in e]
+
+
+def train(zs, ys, seed, epochs, lr):
+    rnd = random.Random(seed)
+    w1 = [[rnd.gauss(0, math.sqrt(2 / FEATURES)) for _ in range(FEATURES)] for _ in range(HIDDEN)]
+    b1 = [0.0] * HIDDEN
+    w2 = [[rnd.gauss(0, math.sqrt(2 / HIDDEN)) for _ in range(HIDDEN)] for _ in range(CLASSES)]
+    b2 = [0.0] * CLASSES
+    order = list(range(len(zs)))
+
+    for epoch in range(epochs):
+        rnd.shuffle(order)
+        rate = lr * (0.5 ** (epoch * 3 // epochs))
+        for i in order:
+            z, y = zs[i], ys[i]
+            h, logits = forward((w1, b1, w2, b2), z)
+            p = softmax(logits)
+            g2 = [p[c] - (1.0 if c == y else 0.0) for c in range(CLASSES)]
+            gh = [sum(g2[c] * w2[c][k] for c in range(CLASSES)) if h[k] > 0.0 else 0.0 for k in range(HIDDEN)]
+            for c in range(CLASSES):
+                for k in range(HIDDEN):
+                    w2[c][k] -= rate * g2[c] * h[k]
+                b2[c] -= rate * g2[c]
+            for k in range(HIDDEN):
+                for j in range(FEATURES):
+                    w1[k][j] -= rate * gh[k] * z[j]
+                b1[k] -= rate * gh[k]
+    return w1, b1, w2, b2
+
+
+def requant(ratio):
+    """Multiplier and shift of ratio, the multiplier in [2^30, 2^31)."""
+    shift = 0
+    while ratio * (1 << (shift + 1)) < (1 << 31):
+        shift += 1
+    return int(round(ratio * (1 << shift))), shift
+
+
+def rshift_round(value, shift):
+    return (value + (1 << (shift - 1))) >> shift
+
+
+def quantize(p, mu, sd, zs):
+    w1, b1, w2, b2 = p
+    s_in = 1.0 / INPUT_SCALE
+    s_w1 = max(abs(w) for row in w1 for w in row) / 127.0
+    s_w2 = max(abs(w) for row in w2 for w in row) / 127.0
+    s_h = max(max(forward(p, z)[0]) for z in zs) / 127.0
+
+    m1, s1 = requant(s_in * s_w1 / s_h)
+    m2, s2 = requant(s_h * s_w2 * EXP_PER_NAT)
+    return {
+        "in_offset": [int(round(m)) for m in mu],
+        "in_mult": [int(round(INPUT_SCALE * 65536 / s)) for s in sd],
+        "w1": [[int(round(w / s_w1)) for w in row] for row in w1],
+        "b1": [int(round(b / (s_in * s_w1))) for b in b1],
+        "m1": m1, "s1": s1,
+        "w2": [[int(round(w / s_w2)) for w in row] for row in w2],
+        "b2": [int(round(b / (s_h * s_w2))) for b in b2],
+        "m2": m2, "s2": s2,
+    }
+
+
+def infer_int8(q, f):
+    """Class and confidence in percent, as motion_cls_infer()."""
+    x = [max(-128, min(127, rshift_round((f[j] - q["in_offset"][j]) * q["in_mult"][j], 16))) for j in range(FEATURES)]
+    h = []
+    for k in range(HIDDEN):
+        acc = q["b1"][k] + sum(w * v for w, v in zip(q["w1"][k], x))
+        h.append(max(0, min(127, rshift_round(acc * q["m1"], q["s1"]))))
+    acc2 = [q["b2"][c] + sum(w * v for w, v in zip(q["w2"][c], h)) for c in range(CLASSES)]
+    best = max(range(CLASSES), key=lambda c: (acc2[c], -c))
+    total = 0
+    for c in range(CLASSES):
+        step = rshift_round((acc2[best] - acc2[c]) * q["m2"], q["s2"])
+        total += EXP_Q16[step] if step < EXP_STEPS else 0
+    return best, (100 * EXP_Q16[0] + total // 2) // total
+
+
+def infer_float(p, mu, sd, f):
+    _, logits = forward(p, standardize([f], mu, sd)[0])
+    prob = softmax(logits)
+    best = max(range(CLASSES), key=lambda c: (logits[c], -c))
+    return best, prob[best]
+
+
+def c_array(values):
+    return ", ".join(str(v) for v in values)
+
+
+def c_float_array(values):
+    return ", ".join("%.8ef" % v for v in values)
+
+
+def c_header(path, guard, brief, report, body):
+    lines = [
+        "/**",
+        " * @file      %s" % path.split("/")[-1],
+        " * @author    Usman Mehmood (usmanmehmood55@gmail.com)",
+        " *",
+    ]
+    lines += [(" * @brief     " if i == 0 else " *            ") + line for i, line in enumerate(brief)]
+    lines += [" *"]
+    lines += [" *            " + line for line in report]
+    lines += [
+        " *",
+        " * @version   0.1",
+        " * @date      2024-08-05",
+        " * @copyright 2024, Usman Mehmood",
+        " */",
+        "",
+        "#ifndef %s" % guard,
+        "#define %s" % guard,
+        "",
+    ]
+    lines += body
+    lines += [
+        "",
+        "#endif // %s" % guard,
+        "",
+    ]
+    with open(path, "w") as out:
+        out.write("\n".join(lines))
+
+
+def write_header(path, q, report):
+    body = [
+        "#include <stdint.h>",
+        "",
+        "#define MOTION_CLS_MODEL_RATE_HZ  %d  ///< sample rate the model was trained for" % RATE_HZ,
+        "#define MOTION_CLS_MODEL_FEATURES %d" % FEATURES,
+        "#define MOTION_CLS_MODEL_HIDDEN   %d" % HIDDEN,
+        "#define MOTION_CLS_MODEL_CLASSES  %d" % CLASSES,
+        "",
+        "// input quantization: q = ((feature - offset) * mult) >> 16, %d steps per standard deviation" % INPUT_SCALE,
+        "static const int32_t motion_cls_in_offset[MOTION_CLS_MODEL_FEATURES] = { %s };" % c_array(q["in_offset"]),
+        "static const int32_t motion_cls_in_mult[MOTION_CLS_MODEL_FEATURES]   = { %s };" % c_array(q["in_mult"]),
+        "",
+        "static const int8_t motion_cls_w1[MOTION_CLS_MODEL_HIDDEN][MOTION_CLS_MODEL_FEATURES] = {",
+    ]
+    body += ["    { %s }," % c_array(row) for row in q["w1"]]
+    body += [
+        "};",
+        "static const int32_t motion_cls_b1[MOTION_CLS_MODEL_HIDDEN] = { %s };" % c_array(q["b1"]),
+        "#define MOTION_CLS_M1 %dLL  ///< hidden layer requantization, (acc * M1) >> S1" % q["m1"],
+        "#define MOTION_CLS_S1 %d" % q["s1"],
+        "",
+        "static const int8_t motion_cls_w2[MOTION_CLS_MODEL_CLASSES][MOTION_CLS_MODEL_HIDDEN] = {",
+    ]
+    body += ["    { %s }," % c_array(row) for row in q["w2"]]
+    body += [
+        "};",
+        "static const int32_t motion_cls_b2[MOTION_CLS_MODEL_CLASSES] = { %s };" % c_array(q["b2"]),
+        "#define MOTION_CLS_M2 %dLL  ///< logit differences to eighths of a nat, (diff * M2) >> S2" % q["m2"],
+        "#define MOTION_CLS_S2 %d" % q["s2"],
+    ]
+    brief = ["Generated by scripts/motion_cls_train.py, do not edit. Int8",
+             "dense net of the motion_cls component."]
+    c_header(path, "MOTION_CLS_MODEL_H_", brief, report, body)
+
+
+def write_ref_header(path, p, mu, sd, expected, report):
+    w1, b1, w2, b2 = p
+    body = [
+        "#define MOTION_CLS_REF_SET     %-3d ///< seeds of the test windows, the training used %d" % (SET_TEST, SET_TRAIN),
+        "#define MOTION_CLS_REF_WINDOWS %-3d ///< test windows per class" % TEST_WINDOWS,
+        "",
+        "// what the script got for the test windows, motion_cls.c has to get the same",
+        "#define MOTION_CLS_REF_INT8_CORRECT    %d" % expected["int8_correct"],
+        "#define MOTION_CLS_REF_FLOAT_CORRECT   %d" % expected["float_correct"],
+        "#define MOTION_CLS_REF_AGREE           %d" % expected["agree"],
+        "#define MOTION_CLS_REF_INT8_CONFIDENCE %d  ///< sum of the confidences in percent" % expected["int8_confidence"],
+        "",
+        "// float net the int8 one was quantized from",
+        "static const float motion_cls_ref_mu[MOTION_CLS_MODEL_FEATURES] = { %s };" % c_float_array(mu),
+        "static const float motion_cls_ref_sd[MOTION_CLS_MODEL_FEATURES] = { %s };" % c_float_array(sd),
+        "static const float motion_cls_ref_w1[MOTION_CLS_MODEL_HIDDEN][MOTION_CLS_MODEL_FEATURES] = {",
+    ]
+    body += ["    { %s }," % c_float_array(row) for row in w1]
+    body += [
+        "};",
+        "static const float motion_cls_ref_b1[MOTION_CLS_MODEL_HIDDEN] = { %s };" % c_float_array(b1),
+        "static const float motion_cls_ref_w2[MOTION_CLS_MODEL_CLASSES][MOTION_CLS_MODEL_HIDDEN] = {",
+    ]
+    body += ["    { %s }," % c_float_array(row) for row in w2]
+    body += [
+        "};",
+        "static const float motion_cls_ref_b2[MOTION_CLS_MODEL_CLASSES] = { %s };" % c_float_array(b2),
+    ]
+    brief = ["Generated by scripts/motion_cls_train.py, do not edit. Float",
+             "dense net the int8 one of motion_cls_model.h was quantized",
+             "from, and what the script got for the windows of the test."]
+    c_header(path, "MOTION_CLS_MODEL_REF_H_", brief, report, body)
+
+
+def evaluate(name, xs, ys, q, p, mu, sd):
+    int_ok = float_ok = agree = confidence = 0
+    for f, y in zip(xs, ys):
+        ci, pct = infer_int8(q, f)
+        cf, _ = infer_float(p, mu, sd, f)
+        int_ok += ci == y
+        float_ok += cf == y
+        agree += ci == cf
+        confidence += pct
+    n = len(ys)
+    line = "%s: %d windows, int8 %.1f %%, float %.1f %%, agreement %.1f %%" % (
+        name, n, 100.0 * int_ok / n, 100.0 * float_ok / n, 100.0 * agree / n)
+    return line, {"int8_correct": int_ok, "float_correct": float_ok, "agree": agree, "int8_confidence": confidence}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--out", required=True, help="header of the int8 net to write")
+    parser.add_argument("--ref-out", help="header of the float net and the test results to write")
+    parser.add_argument("--windows", type=int, default=300, help="training windows per class")
+    parser.add_argument("--epochs", type=int, default=40)
+    parser.add_argument("--lr", type=float, default=0.02)
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    xs, ys = dataset(SET_TRAIN, args.windows)
+    mu = [sum(x[j] for x in xs) / len(xs) for j in range(FEATURES)]
+    sd = [max(1e-3, math.sqrt(sum((x[j] - mu[j]) ** 2 for x in xs) / len(xs))) for j in range(FEATURES)]
+    zs = standardize(xs, mu, sd)
+
+    p = train(zs, ys, args.seed, args.epochs, args.lr)
+    q = quantize(p, mu, sd, zs)
+
+    tx, ty = dataset(SET_TEST, TEST_WINDOWS)
+    train_line, _ = evaluate("training", xs, ys, q, p, mu, sd)
+    test_line, expected = evaluate("test", tx, ty, q, p, mu, sd)
+    report = [train_line, test_line]
+    for line in report:
+        print(line)
+
+    write_header(args.out, q, report)
+    if args.ref_out:
+        write_ref_header(args.ref_out, p, mu, sd, expected, report)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""
+Sensor trace from a console capture.
+
+Collects the "trace:" hex lines the recorder streams to the console, see
+components/trace, writes them out as a trace file and checks that every
+record in it is complete. Other console output between the lines is skipped.
+
+    python3 scripts/trace_extract.py --console capture.log --out bench.trace
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+TRACE_LINE_RE = re.compile(r"trace:([0-9a-fA-F]+)\s*$")
+
+TRACE_MAGIC    = 0x31435254
+TRACE_VERSION  = 1
+HEADER_FORMAT  = "<IHH"       # magic, version, record size
+RECORD_FORMAT  = "<IHBBBb"    # timestamp_us, length, address, reg_address, flags, err
+FLAG_READ      = 0x01
+FLAG_GAP       = 0x04
+
+
+def extract(console_path):
+    """Joins the bytes of all the trace lines of a console capture."""
+    data = bytearray()
+    with open(console_path, "r", errors="replace") as console:
+        for line in console:
+            match = TRACE_LINE_RE.search(line)
+            if match and (len(match.group(1)) % 2) == 0:
+                data += bytes.fromhex(match.group(1))
+    return bytes(data)
+
+
+def summary(trace):
+    """Walks the records of a trace, returns (records, reads, gaps, duration_us, trailing bytes)."""
+    header_size = struct.calcsize(HEADER_FORMAT)
+    record_size = struct.calcsize(RECORD_FORMAT)
+
+    if len(trace) < header_size:
+        raise ValueError("no trace header")
+    magic, version, size = struct.unpack_from(HEADER_FORMAT, trace)
+    if (magic != TRACE_MAGIC) or (version != TRACE_VERSION) or (size != record_size):
+        raise ValueError("not a version {} trace".format(TRACE_VERSION))
+
+    records = reads = gaps = duration_us = 0
+    offset = header_size
+    while offset + record_size <= len(trace):
+        timestamp_us, length, _, _, flags, err = struct.unpack_from(RECORD_FORMAT, trace, offset)
+        end = offset + record_size + (length if err == 0 else 0)
+        if end > len(trace):
+            break
+        records += 1
+        reads += 1 if (flags & FLAG_READ) else 0
+        gaps += 1 if (flags & FLAG_GAP) else 0
+        duration_us = timestamp_us
+        offset = end
+
+    return records, reads, gaps, duration_us, len(trace) - offset
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Sensor trace from a console capture")
+    parser.add_argument("--console", required=True, help="console output captured while recording")
+    parser.add_argument("--out", required=True, help="trace file to write")
+    args = parser.parse_args()
+
+    trace = extract(args.console)
+    try:
+        records, reads, gaps, duration_us, trailing = summary(trace)
+    except ValueError as error:
+        sys.exit("{}: {}".format(args.console, error))
+
+    # a record cut off at the end of the capture is left out
+    with open(args.out, "wb") as out:
+        out.write(trace[:len(trace) - trailing])
+
+    print("{} records, {} reads, {:.3f} s".format(records, reads, duration_us / 1e6))
+    if gaps:
+        print("warning: {} gaps, the recording buffer overflowed".format(gaps))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,6 +1,480 @@
 #include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/logging/log.h>
 
-int main(void)
+#if defined(CONFIG_APP_TWI)
+#include "twi.h"
+#endif
+#if defined(CONFIG_APP_BRINGUP)
+#include "bringup.h"
+#endif
+#if defined(CONFIG_APP_ACQ_SCHED)
+#include "acq_sched.h"
+#endif
+#if defined(CONFIG_APP_TRACE_RECORD)
+#include "trace.h"
+#endif
+#if defined(CONFIG_APP_MPU9250)
+#include "mpu9250.h"
+#endif
+#if defined(CONFIG_APP_LIS2DH12)
+#include "lis2dh12.h"
+#endif
+#if defined(CONFIG_APP_EVCAP)
+#include "evcap.h"
+#endif
+#if defined(CONFIG_APP_MOTION_EVT)
+#include "motion_evt.h"
+#endif
+#if defined(CONFIG_APP_SEQCHK)
+#include "seqchk.h"
+#endif
+#if defined(CONFIG_APP_LOADSTAT)
+#include "loadstat.h"
+#endif
+#if defined(CONFIG_APP_MOTION_CLS)
+#include "motion_cls.h"
+#endif
+
+LOG_MODULE_REGISTER(main, LOG_LEVEL_INF);
+
+#define TWI_SCL_PIN             27     // Arduino SCL of the nRF52 DK
+#define TWI_SDA_PIN             26     // Arduino SDA of the nRF52 DK
+#define ACQ_PERIOD_US           10000  // 100 Hz, the LIS2DH12 output data rate
+#define ACQ_RATE_MHZ            (1000000000U / ACQ_PERIOD_US)
+#define STATS_INTERVAL_MS       10000
+#define EVCAP_ACCEL_THRESHOLD   24576  // 1.5 g at +-2 g, well above gravity alone
+#define MPU_INT_PIN             28     // INT of the first MPU, read through PPI on every data ready pulse
+#define MPU_STREAM_SAMPLES      25     // samples of the first MPU per CPU wake-up, 200 ms at its 125 Hz
+#define LIS2DH12_LSB_PER_G      16384  // left-justified samples at +-2 g
+
+#if defined(CONFIG_APP_TWI)
+// an MPU9250 and the AK8963 behind its bypass, if it is used
+#define MPU_SPEED_PROFILES(node)                                                  \
+    { .address = DT_PROP(node, twi_address), .speed = TWI_SPEED_400K },           \
+    COND_CODE_1(DT_NODE_HAS_PROP(node, magn_address),                             \
+                ({ .address = DT_PROP(node, magn_address), .speed = TWI_SPEED_400K },), ())
+#define LIS2DH12_SPEED_PROFILE(node) { .address = DT_PROP(node, twi_address), .speed = TWI_SPEED_400K },
+
+// every sensor of the devicetree runs in fast mode, the rest would stay at 100 kHz
+static const twi_speed_profile_t twi_speed_profiles[] = {
+    DT_FOREACH_STATUS_OKAY(app_mpu9250, MPU_SPEED_PROFILES)
+    DT_FOREACH_STATUS_OKAY(app_lis2dh12, LIS2DH12_SPEED_PROFILE)
+};
+
+static int twi_start(void)
 {
+    int err = twi_init(TWI_SCL_PIN, TWI_SDA_PIN);
+
+    if (err == 0)
+    {
+        err = twi_speed_profiles_set(twi_speed_profiles, ARRAY_SIZE(twi_speed_profiles));
+    }
+    if (err == 0)
+    {
+        err = twi_enable();
+    }
+
+    return err;
+}
+#endif
+
+static inline int64_t sample_time_us(void)
+{
+    return (int64_t)k_ticks_to_us_floor64((uint64_t)k_uptime_ticks());
+}
+
+#if defined(CONFIG_APP_MPU9250)
+// every MPU is read in the same job, the ones on the TWI bus in one bus ownership
+static app_mpu_t * mpus[APP_MPU_COUNT];
+static uint8_t     mpus_streamed;  // the first ones, read in hardware instead of by the job
+#if defined(CONFIG_APP_SEQCHK)
+static seqchk_stream_t mpu_seq[APP_MPU_COUNT];
+#endif
+
+#if defined(CONFIG_APP_ACQ_SCHED)
+static accel_values_t mpu_accel[APP_MPU_COUNT];
+
+static int mpu_read_job(void * p_context)
+{
+    accel_values_t * p_accel = &((accel_values_t *)p_context)[mpus_streamed];
+    const uint8_t    count   = APP_MPU_COUNT - mpus_streamed;
+
+    if (count == 0U)
+    {
         return 0;
+    }
+
+    int errs[APP_MPU_COUNT];
+#if defined(CONFIG_APP_EVCAP)
+    gyro_values_t gyro[APP_MPU_COUNT];
+    int           err = app_mpu_read_multi(&mpus[mpus_streamed], count, p_accel, gyro, errs);
+#else
+    int err = app_mpu_read_multi(&mpus[mpus_streamed], count, p_accel, NULL, errs);
+#endif
+
+#if defined(CONFIG_APP_SEQCHK) || defined(CONFIG_APP_EVCAP)
+    const int64_t t_us = sample_time_us();
+#endif
+#if defined(CONFIG_APP_SEQCHK)
+    // an MPU that failed kept its last sample, the next read shows whether one was lost
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (errs[i] == 0)
+        {
+            (void)seqchk_batch(&mpu_seq[mpus_streamed + i], &p_accel[i], 1U, t_us, false, NULL);
+        }
+    }
+#endif
+#if defined(CONFIG_APP_EVCAP)
+    // captures follow the first MPU
+    if ((mpus_streamed == 0U) && (errs[0] == 0))
+    {
+        evcap_push(&p_accel[0], &gyro[0], t_us);
+    }
+#endif
+
+    return err;
+}
+#endif
+
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+static uint8_t mpu_stream_buffer[NRF_DRV_MPU_STREAM_BUFFER_SIZE(APP_MPU_STREAM_GYRO_BYTES, MPU_STREAM_SAMPLES)];
+
+// a block of the first MPU, the last sample was read just before the wake-up
+static void mpu_stream_handler(const uint8_t * p_samples, const uint16_t count, void * p_context)
+{
+    accel_values_t accel[MPU_STREAM_SAMPLES];
+    gyro_values_t  gyro;
+    const uint32_t period_us = 1000000000U / app_mpu_sample_rate_mhz_get(APP_MPU_DEFAULT);
+    const int64_t  t_us      = sample_time_us() - ((int64_t)(count - 1U) * period_us);
+
+    ARG_UNUSED(p_context);
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        app_mpu_stream_decode(&p_samples[i * APP_MPU_STREAM_GYRO_BYTES], &accel[i], &gyro);
+#if defined(CONFIG_APP_EVCAP)
+        evcap_push(&accel[i], &gyro, t_us + ((int64_t)i * period_us));
+#endif
+    }
+#if defined(CONFIG_APP_ACQ_SCHED)
+    mpu_accel[0] = accel[count - 1U];
+#endif
+
+#if defined(CONFIG_APP_SEQCHK)
+    (void)seqchk_batch(&mpu_seq[0], accel, count, t_us, false, NULL);
+#endif
+}
+
+static void mpu_stream_start(void)
+{
+    int err = app_mpu_stream_start(APP_MPU_DEFAULT, MPU_INT_PIN, true, MPU_STREAM_SAMPLES, mpu_stream_buffer,
+                                   mpu_stream_handler, NULL);
+
+    if (err != 0)
+    {
+        // the job keeps polling it
+        LOG_WRN("mpu_stream_start:failed with error: %d", err);
+        return;
+    }
+
+#if defined(CONFIG_APP_SEQCHK)
+    (void)seqchk_stream_rate_set(&mpu_seq[0], app_mpu_sample_rate_mhz_get(APP_MPU_DEFAULT));
+#endif
+    mpus_streamed = 1U;
+}
+#endif
+#endif
+
+#if defined(CONFIG_APP_LIS2DH12)
+static lis2dh12_t * lis2dh12s[LIS2DH12_COUNT];
+#if defined(CONFIG_APP_SEQCHK)
+static seqchk_stream_t lis2dh12_seq[LIS2DH12_COUNT];
+#endif
+
+#if defined(CONFIG_APP_ACQ_SCHED)
+static accel_values_t lis2dh12_accel[LIS2DH12_COUNT];
+
+static int lis2dh12_read_job(void * p_context)
+{
+    int errs[LIS2DH12_COUNT];
+    int err = lis2dh12_read_accel_multi(lis2dh12s, LIS2DH12_COUNT, (accel_values_t *)p_context, errs);
+
+#if defined(CONFIG_APP_SEQCHK)
+    const int64_t t_us = sample_time_us();
+
+    // -ENODATA is a read without a new sample, the next one shows whether one was lost
+    for (uint8_t i = 0; i < LIS2DH12_COUNT; i++)
+    {
+        if (errs[i] == 0)
+        {
+            (void)seqchk_batch(&lis2dh12_seq[i], &((accel_values_t *)p_context)[i], 1U, t_us, false, NULL);
+        }
+    }
+#endif
+#if defined(CONFIG_APP_MOTION_CLS)
+    // the machine state follows the first LIS2DH12, at the 100 Hz it samples at
+    if (errs[0] == 0)
+    {
+        motion_cls_push(&((accel_values_t *)p_context)[0]);
+    }
+#endif
+
+    return err;
+}
+#endif
+#endif
+
+#if defined(CONFIG_APP_MOTION_CLS)
+static void motion_cls_logger(const motion_cls_event_t * p_evt, void * p_user_data)
+{
+    ARG_UNUSED(p_user_data);
+
+    LOG_INF("machine %s, %u %% confident, at %u ms", motion_cls_class_str(p_evt->cls), p_evt->confidence_pct,
+            (uint32_t)p_evt->timestamp_ms);
+}
+#endif
+
+#if defined(CONFIG_APP_MOTION_EVT)
+// detected on the sensors, the interrupt handlers of the board call motion_evt_irq_notify()
+static const struct
+{
+    enum motion_evt_sensor sensor;
+    motion_evt_detector_t  detector;
+} motion_detectors[] = {
+#if !defined(CONFIG_APP_TWI_HW_STREAM)
+    // the stream takes the INT pin of the MPU
+    { MOTION_EVT_MPU9250,  { .type = MOTION_EVT_MOTION,       .pin = MOTION_EVT_PIN_INT1, .threshold_mg = 200U, .duration_ms = 5U } },
+#endif
+    { MOTION_EVT_LIS2DH12, { .type = MOTION_EVT_FREE_FALL,    .pin = MOTION_EVT_PIN_INT1, .threshold_mg = 350U, .duration_ms = 30U } },
+    { MOTION_EVT_LIS2DH12, { .type = MOTION_EVT_DOUBLE_CLICK, .pin = MOTION_EVT_PIN_INT2, .threshold_mg = 1200U, .duration_ms = 50U,
+                             .latency_ms = 100U, .window_ms = 300U } },
+};
+
+static void motion_evt_logger(const motion_evt_t * p_evt, void * p_user_data)
+{
+    ARG_UNUSED(p_user_data);
+
+    LOG_INF("motion event %u of sensor %u, axes 0x%02X flags 0x%02X at %u ms", p_evt->type, p_evt->sensor,
+            p_evt->axes, p_evt->flags, (uint32_t)p_evt->timestamp_ms);
+}
+
+static void motion_events_start(void)
+{
+    int err = motion_evt_init();
+
+    if (err == 0)
+    {
+        err = motion_evt_subscribe(MOTION_EVT_MASK_ALL, motion_evt_logger, NULL);
+    }
+
+    // a sensor without one of the detectors keeps the others
+    for (uint8_t i = 0; (err == 0) && (i < ARRAY_SIZE(motion_detectors)); i++)
+    {
+        (void)motion_evt_detector_set(motion_detectors[i].sensor, &motion_detectors[i].detector);
+    }
+
+    if (err != 0)
+    {
+        LOG_WRN("motion_events_start:failed with error: %d", err);
+    }
+}
+#endif
+
+#if defined(CONFIG_APP_ACQ_SCHED)
+static const acq_job_t acq_jobs[] = {
+#if defined(CONFIG_APP_MPU9250)
+    { .p_name = "mpu9250",  .read = mpu_read_job,      .p_context = mpu_accel,      .divider = 1U },
+#endif
+#if defined(CONFIG_APP_LIS2DH12)
+    { .p_name = "lis2dh12", .read = lis2dh12_read_job, .p_context = lis2dh12_accel, .divider = 1U },
+#endif
+};
+
+static int acquisition_start(void)
+{
+    acq_sched_config_t config = ACQ_SCHED_CONFIG_DEFAULT(ACQ_PERIOD_US);
+    int                err    = acq_sched_init(&config);
+
+    for (uint8_t i = 0; (err == 0) && (i < ARRAY_SIZE(acq_jobs)); i++)
+    {
+        err = acq_sched_job_add(&acq_jobs[i]);
+        err = (err < 0) ? err : 0;
+    }
+
+    if (err == 0)
+    {
+        err = acq_sched_start();
+    }
+
+    return err;
+}
+
+static void acquisition_stats_log(void)
+{
+    acq_job_stats_t stats;
+
+    for (uint8_t i = 0; i < ARRAY_SIZE(acq_jobs); i++)
+    {
+        (void)acq_sched_job_stats_get(i, &stats);
+        LOG_INF("%s: %u runs, %u errors, %u skipped, jitter p99 %u us max %u us, exec p99 %u us",
+                acq_jobs[i].p_name, stats.runs, stats.errors, stats.skipped,
+                stats.jitter_p99_us, stats.jitter_max_us, stats.exec_p99_us);
+    }
+}
+#endif
+
+#if defined(CONFIG_APP_SEQCHK)
+// integrity of the sampled streams, one per sensor at the read rate of the scheduler
+static const struct
+{
+    seqchk_stream_t * p_streams;
+    uint8_t           count;
+} seq_streams[] = {
+#if defined(CONFIG_APP_MPU9250)
+    { mpu_seq,      APP_MPU_COUNT },
+#endif
+#if defined(CONFIG_APP_LIS2DH12)
+    { lis2dh12_seq, LIS2DH12_COUNT },
+#endif
+};
+#endif
+
+int main(void)
+{
+    int err = 0;
+
+#if defined(CONFIG_APP_TWI)
+    err = twi_start();
+    if (err != 0)
+    {
+        LOG_ERR("main:twi bring-up failed with error: %d", err);
+        return err;
+    }
+#endif
+
+#if defined(CONFIG_APP_TRACE_RECORD)
+    // from the first transfer on, so a replay goes through the same bring-up
+    (void)trace_record_start();
+#endif
+
+#if defined(CONFIG_APP_BRINGUP)
+    err = bringup_sensors(NULL);
+    if (err != 0)
+    {
+        LOG_ERR("main:bringup_sensors failed with error: %d", err);
+        return err;
+    }
+#endif
+
+#if defined(CONFIG_APP_MOTION_EVT)
+    motion_events_start();
+#endif
+
+#if defined(CONFIG_APP_EVCAP)
+    // captures go to the log
+    const evcap_config_t evcap_config = { .accel_threshold_lsb = EVCAP_ACCEL_THRESHOLD };
+    (void)evcap_init(&evcap_config);
+#endif
+
+#if defined(CONFIG_APP_MOTION_CLS)
+    const motion_cls_config_t motion_cls_config = { .lsb_per_g = LIS2DH12_LSB_PER_G, .handler = motion_cls_logger };
+    (void)motion_cls_init(&motion_cls_config);
+#endif
+
+#if defined(CONFIG_APP_MPU9250)
+    for (uint8_t i = 0; i < APP_MPU_COUNT; i++)
+    {
+        mpus[i] = &app_mpu_instances[i];
+#if defined(CONFIG_APP_SEQCHK)
+        (void)seqchk_stream_init(&mpu_seq[i], app_mpu_instances[i].p_name, ACQ_RATE_MHZ);
+#endif
+    }
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+    mpu_stream_start();
+#endif
+#endif
+#if defined(CONFIG_APP_LIS2DH12)
+    for (uint8_t i = 0; i < LIS2DH12_COUNT; i++)
+    {
+        lis2dh12s[i] = &lis2dh12_instances[i];
+#if defined(CONFIG_APP_SEQCHK)
+        (void)seqchk_stream_init(&lis2dh12_seq[i], lis2dh12_instances[i].p_name, ACQ_RATE_MHZ);
+#endif
+    }
+#endif
+
+#if defined(CONFIG_APP_ACQ_SCHED)
+    err = acquisition_start();
+    if (err != 0)
+    {
+        LOG_ERR("main:acquisition start failed with error: %d", err);
+        return err;
+    }
+#endif
+
+    while (true)
+    {
+        k_msleep(STATS_INTERVAL_MS);
+
+#if defined(CONFIG_APP_ACQ_SCHED)
+        acquisition_stats_log();
+#endif
+
+#if defined(CONFIG_APP_SEQCHK)
+        for (uint8_t i = 0; i < ARRAY_SIZE(seq_streams); i++)
+        {
+            for (uint8_t j = 0; j < seq_streams[i].count; j++)
+            {
+                seqchk_stream_t * p_stream = &seq_streams[i].p_streams[j];
+                seqchk_stats_t    seq;
+
+                (void)seqchk_stats_get(p_stream, &seq);
+                LOG_INF("%s: %u of %u samples, %u lost in %u gaps, %u duplicates, %u overflows",
+                        p_stream->p_name, seq.received, seq.expected, seq.lost, seq.gaps, seq.duplicates,
+                        seq.overflows);
+            }
+        }
+#endif
+
+#if defined(CONFIG_APP_TWI_STATS)
+        twi_power_stats_t power;
+        (void)twi_power_stats_get(&power);
+        LOG_INF("twi: busy %u ms, powered %u ms, %u power ups avg %u ns max %u ns, "
+                "%u speed changes avg %u ns max %u ns",
+                (uint32_t)(power.busy_us / 1000U), (uint32_t)(power.powered_us / 1000U), power.power_ups,
+                (uint32_t)(power.power_up_ns / MAX(power.power_ups, 1U)), power.power_up_max_ns, power.speed_changes,
+                (uint32_t)(power.speed_change_ns / MAX(power.speed_changes, 1U)), power.speed_change_max_ns);
+#endif
+
+#if defined(CONFIG_APP_LOADSTAT)
+        loadstat_report_t load;
+        if (loadstat_sample(&load) == 0)
+        {
+            LOG_INF("load over %u ms: bus busy %u.%u %%, bus wait %u.%u %%, twi calls %u.%u %%, "
+                    "sampling cpu %u.%u %%, idle %u.%u %%",
+                    load.interval_ms, load.bus_busy_permille / 10U, load.bus_busy_permille % 10U,
+                    load.bus_wait_permille / 10U, load.bus_wait_permille % 10U, load.twi_call_permille / 10U,
+                    load.twi_call_permille % 10U, load.sampling_permille / 10U, load.sampling_permille % 10U,
+                    load.idle_permille / 10U, load.idle_permille % 10U);
+        }
+#endif
+
+#if defined(CONFIG_APP_MOTION_CLS)
+        motion_cls_stats_t cls;
+        (void)motion_cls_stats_get(&cls);
+        LOG_INF("motion classifier: %u windows, %u changes, %u dropped, avg %u us max %u us", cls.windows,
+                cls.changes, cls.dropped, cls.avg_window_us, cls.max_window_us);
+#endif
+
+#if defined(CONFIG_APP_TWI_HW_STREAM)
+        twi_stream_stats_t stream;
+        (void)twi_stream_stats_get(&stream);
+        LOG_INF("twi stream: %u blocks, %u overruns, %u failed, %u pauses, %u replays", stream.blocks,
+                stream.overruns, stream.failed, stream.pauses, stream.replays);
+#endif
+    }
+
+    return 0;
 }
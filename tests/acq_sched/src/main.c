@@ -0,0 +1,197 @@
+/**
+ * @file      main.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Jitter and overrun accounting of the acquisition scheduler.
+ *            Two jobs share a 1 ms period, the first one busy waits a
+ *            scripted time and so sets the start of the second one. The
+ *            percentiles of the second job have to land in the log2
+ *            buckets of the scripted delays, 2% of long runs have to show
+ *            in the 99th percentile but not in the median. A single run
+ *            overrunning two periods has to be skipped or caught up as
+ *            configured. The delays are busy waits, which take simulated
+ *            time on native_sim, so the results are the same every run.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "acq_sched.h"
+
+#define PERIOD_US   1000U
+#define PERIODS     200U
+#define LEAD_US     200U   ///< usual run of the first job
+#define LONG_US     800U   ///< run of the first job once every LONG_EVERY runs
+#define LONG_EVERY  50U
+#define FOLLOW_US   100U   ///< run of the second job
+#define OVERRUN_US  2500U  ///< a single run of the first job across two more periods
+#define OVERRUN_RUN 10U
+
+static uint32_t lead_runs;
+static uint32_t lead_overrun_at;  ///< run of the first job that overruns, 0 for none
+
+static int lead_read(void * p_context)
+{
+    ARG_UNUSED(p_context);
+
+    lead_runs++;
+    if ((lead_overrun_at != 0U) && (lead_runs == lead_overrun_at))
+    {
+        k_busy_wait(OVERRUN_US);
+    }
+    else
+    {
+        k_busy_wait(((lead_runs % LONG_EVERY) == 0U) ? LONG_US : LEAD_US);
+    }
+
+    return 0;
+}
+
+static int follow_read(void * p_context)
+{
+    ARG_UNUSED(p_context);
+
+    k_busy_wait(FOLLOW_US);
+    return 0;
+}
+
+/**
+ * @brief Runs the two jobs for the given number of periods and gets their
+ * statistics.
+ */
+static void sched_run(const enum acq_sched_overrun overrun, const uint32_t periods, acq_job_stats_t * p_lead,
+                      acq_job_stats_t * p_follow)
+{
+    const acq_job_t lead   = { .p_name = "lead", .read = lead_read };
+    const acq_job_t follow = { .p_name = "follow", .read = follow_read };
+
+    acq_sched_config_t config = ACQ_SCHED_CONFIG_DEFAULT(PERIOD_US);
+
+    config.overrun = overrun;
+    zassert_ok(acq_sched_init(&config));
+    zassert_equal(acq_sched_job_add(&lead), 0);
+    zassert_equal(acq_sched_job_add(&follow), 1);
+
+    zassert_ok(acq_sched_start());
+    k_usleep((periods * PERIOD_US) + (PERIOD_US / 2U));
+    zassert_ok(acq_sched_stop());
+
+    zassert_ok(acq_sched_job_stats_get(0U, p_lead));
+    zassert_ok(acq_sched_job_stats_get(1U, p_follow));
+}
+
+static void stats_print(const char * p_name, const acq_job_stats_t * p_stats)
+{
+    TC_PRINT("%s: %u runs, %u skipped, %u caught up, jitter p50 %u us p99 %u us max %u us, "
+             "exec p50 %u us p99 %u us max %u us\n",
+             p_name, p_stats->runs, p_stats->skipped, p_stats->caught_up, p_stats->jitter_p50_us,
+             p_stats->jitter_p99_us, p_stats->jitter_max_us, p_stats->exec_p50_us, p_stats->exec_p99_us,
+             p_stats->exec_max_us);
+}
+
+static void acq_sched_before(void * p_fixture)
+{
+    ARG_UNUSED(p_fixture);
+
+    lead_runs       = 0U;
+    lead_overrun_at = 0U;
+}
+
+ZTEST_SUITE(acq_sched, NULL, NULL, acq_sched_before, NULL, NULL);
+
+ZTEST(acq_sched, test_jitter_percentiles)
+{
+    acq_job_stats_t lead;
+    acq_job_stats_t follow;
+
+    sched_run(ACQ_SCHED_CATCH_UP, PERIODS, &lead, &follow);
+    stats_print("lead", &lead);
+    stats_print("follow", &follow);
+
+    zassert_equal(lead.runs, PERIODS);
+    zassert_equal(follow.runs, PERIODS);
+    zassert_equal(lead.skipped + lead.caught_up + follow.skipped + follow.caught_up, 0U);
+
+    // the first job starts on the period, give or take a tick
+    zassert_true(lead.jitter_max_us <= 100U, "lead jitter max %u us", lead.jitter_max_us);
+
+    // percentiles are the top of their log2 bucket, clamped to the maximum
+    zassert_between_inclusive(lead.exec_p50_us, LEAD_US, 255U);
+    zassert_equal(lead.exec_p99_us, LONG_US);
+    zassert_equal(lead.exec_max_us, LONG_US);
+
+    // the second job starts once the first one is done
+    zassert_between_inclusive(follow.jitter_p50_us, LEAD_US, 255U);
+    zassert_equal(follow.jitter_p99_us, LONG_US);
+    zassert_equal(follow.jitter_max_us, LONG_US);
+    zassert_between_inclusive(follow.exec_p50_us, 64U, 127U);
+    zassert_equal(follow.exec_max_us, FOLLOW_US);
+
+    // cleared, nothing left of the long runs
+    acq_sched_stats_reset();
+    zassert_ok(acq_sched_job_stats_get(1U, &follow));
+    zassert_equal(follow.runs, 0U);
+    zassert_equal(follow.jitter_p99_us, 0U);
+    zassert_equal(follow.jitter_max_us, 0U);
+}
+
+ZTEST(acq_sched, test_overrun_skipped)
+{
+    acq_job_stats_t lead;
+    acq_job_stats_t follow;
+
+    lead_overrun_at = OVERRUN_RUN;
+    sched_run(ACQ_SCHED_SKIP, 20U, &lead, &follow);
+    stats_print("lead", &lead);
+
+    // two periods expired during the long run and the second job after it, the older one is dropped
+    zassert_equal(lead.skipped, 1U);
+    zassert_equal(follow.skipped, 1U);
+    zassert_equal(lead.caught_up, 0U);
+    zassert_equal(lead.runs, 19U);
+    zassert_equal(lead.jitter_max_us, OVERRUN_US + FOLLOW_US - (2U * PERIOD_US));
+}
+
+ZTEST(acq_sched, test_overrun_caught_up)
+{
+    acq_job_stats_t lead;
+    acq_job_stats_t follow;
+
+    lead_overrun_at = OVERRUN_RUN;
+    sched_run(ACQ_SCHED_CATCH_UP, 20U, &lead, &follow);
+    stats_print("lead", &lead);
+
+    // the older period runs right away, late by the overrun and the second job
+    zassert_equal(lead.skipped, 0U);
+    zassert_equal(lead.caught_up, 1U);
+    zassert_equal(follow.caught_up, 1U);
+    zassert_equal(lead.runs, 20U);
+    zassert_equal(lead.jitter_max_us, OVERRUN_US + FOLLOW_US - PERIOD_US);
+}
+
+ZTEST(acq_sched, test_invalid)
+{
+    const acq_job_t    job    = { .p_name = "job", .read = follow_read };
+    acq_sched_config_t config = ACQ_SCHED_CONFIG_DEFAULT(0U);
+    acq_job_stats_t    stats;
+
+    zassert_equal(acq_sched_init(&config), -EINVAL);
+    config.period_us = PERIOD_US;
+    zassert_ok(acq_sched_init(&config));
+
+    for (uint8_t i = 0U; i < ACQ_SCHED_MAX_JOBS; i++)
+    {
+        zassert_equal(acq_sched_job_add(&job), i);
+    }
+    zassert_equal(acq_sched_job_add(&job), -ENOMEM);
+    zassert_equal(acq_sched_job_stats_get(ACQ_SCHED_MAX_JOBS, &stats), -EINVAL);
+
+    zassert_ok(acq_sched_start());
+    zassert_equal(acq_sched_start(), -EBUSY);
+    zassert_equal(acq_sched_init(&config), -EBUSY);
+    zassert_ok(acq_sched_stop());
+    zassert_equal(acq_sched_stop(), -EALREADY);
+}
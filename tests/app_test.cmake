@@ -0,0 +1,13 @@
+# Shared set-up of the tests, included before find_package(Zephyr). A test
+# is built with the Kconfig, the devicetree and the components of the
+# application, its prj.conf leaves out the components it does not need.
+#
+#   west twister -T tests
+
+get_filename_component(APP_ROOT ${CMAKE_CURRENT_LIST_DIR}/.. ABSOLUTE)
+
+set(KCONFIG_ROOT ${APP_ROOT}/Kconfig)
+list(APPEND DTS_ROOT ${APP_ROOT})
+set(DTC_OVERLAY_FILE ${APP_ROOT}/app.overlay)
+
+include(${APP_ROOT}/components/components.cmake)
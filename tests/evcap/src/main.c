@@ -0,0 +1,249 @@
+/**
+ * @file      main.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Pre-trigger capture of made up samples. Every sample carries
+ *            its sequence number, so a capture shows exactly which samples
+ *            it holds. A threshold crossing has to freeze the history
+ *            before it, the trigger sample and the samples after it, a
+ *            trigger right after a capture has only the shorter history
+ *            there is. With every ring handed out the samples have to be
+ *            skipped until one is released, and a trigger during the
+ *            samples after another one has to be merged into it.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "evcap.h"
+
+#define ONE_G            16384
+#define ACCEL_THRESHOLD  20000U
+#define GYRO_THRESHOLD   5000U
+
+static const evcap_capture_t * held[2U * EVCAP_BUFFERS];  ///< captures the handler was given
+static uint32_t                held_count;
+static int16_t                 seq;                        ///< sequence number of the next sample
+static int64_t                 t_us;
+
+/**@brief Keeps the captures until the test releases them. */
+static void capture_handler(const evcap_capture_t * p_capture, void * p_user_data)
+{
+    ARG_UNUSED(p_user_data);
+
+    zassert_true(held_count < ARRAY_SIZE(held));
+    held[held_count++] = p_capture;
+}
+
+/**@brief Pushes a sample at rest, or with the given x, and a gyroscope part if given. */
+static void push(const int16_t x, const gyro_values_t * p_gyro)
+{
+    const accel_values_t accel = { .x = x, .y = seq++, .z = ONE_G };
+
+    evcap_push(&accel, p_gyro, t_us);
+    t_us += 1000;
+}
+
+static void push_quiet(const uint32_t count)
+{
+    for (uint32_t i = 0U; i < count; i++)
+    {
+        push(0, NULL);
+    }
+}
+
+/**@brief Lets the work queue hand over the frozen captures. */
+static void handover(void)
+{
+    k_msleep(1);
+}
+
+/**@brief Checks that a capture holds consecutive samples around a trigger sample. */
+static void capture_check(const evcap_capture_t * p_capture, const int16_t trigger_seq, const uint16_t pre)
+{
+    TC_PRINT("trigger %u, %u samples, %u before\n", p_capture->trigger, p_capture->count, p_capture->pre);
+    zassert_equal(p_capture->pre, pre);
+    zassert_equal(p_capture->count, pre + 1U + EVCAP_POST_SAMPLES);
+
+    for (uint16_t i = 0U; i < p_capture->count; i++)
+    {
+        const evcap_sample_t * p_sample = evcap_capture_sample(p_capture, i);
+
+        zassert_equal(p_sample->accel.y, trigger_seq - (int16_t)pre + (int16_t)i, "sample %u is %d", i,
+                      p_sample->accel.y);
+        zassert_equal(p_sample->t_us - evcap_capture_sample(p_capture, 0U)->t_us, (int64_t)i * 1000);
+    }
+}
+
+static void evcap_before(void * p_fixture)
+{
+    const evcap_config_t config = {
+        .accel_threshold_lsb = ACCEL_THRESHOLD,
+        .gyro_threshold_lsb  = GYRO_THRESHOLD,
+        .handler             = capture_handler,
+    };
+
+    ARG_UNUSED(p_fixture);
+
+    while (held_count > 0U)
+    {
+        evcap_release(held[--held_count]);
+    }
+
+    // a full history of quiet samples
+    zassert_ok(evcap_init(&config));
+    push_quiet(EVCAP_RING_SAMPLES);
+}
+
+ZTEST_SUITE(evcap, NULL, NULL, evcap_before, NULL, NULL);
+
+ZTEST(evcap, test_threshold_window)
+{
+    const int16_t  trigger_seq = seq;
+    evcap_stats_t  before;
+    evcap_stats_t  stats;
+
+    zassert_ok(evcap_stats_get(&before));
+
+    push((int16_t)ACCEL_THRESHOLD, NULL);
+    push_quiet(EVCAP_POST_SAMPLES - 1U);
+    handover();
+    zassert_equal(held_count, 0U, "frozen before its last sample");
+
+    push_quiet(1U);
+    handover();
+    zassert_equal(held_count, 1U);
+
+    zassert_equal(held[0]->trigger, EVCAP_TRIGGER_ACCEL);
+    zassert_equal(held[0]->int_src, 0U);
+    capture_check(held[0], trigger_seq, EVCAP_PRE_SAMPLES);
+    zassert_equal(evcap_capture_sample(held[0], EVCAP_PRE_SAMPLES)->accel.x, (int16_t)ACCEL_THRESHOLD);
+
+    zassert_ok(evcap_stats_get(&stats));
+    zassert_equal(stats.captures - before.captures, 1U);
+    zassert_equal(stats.samples - before.samples, 1U + EVCAP_POST_SAMPLES);
+    zassert_equal(stats.skipped, before.skipped);
+}
+
+ZTEST(evcap, test_short_history)
+{
+    int16_t trigger_seq;
+
+    evcap_trigger(EVCAP_TRIGGER_MANUAL, 0U);
+    push_quiet(1U + EVCAP_POST_SAMPLES);
+
+    // the next ring starts empty, three samples of history before the interrupt
+    push_quiet(3U);
+    evcap_trigger(EVCAP_TRIGGER_INT1, 0x48U);
+    evcap_trigger(EVCAP_TRIGGER_CLICK, 0x51U);
+    trigger_seq = seq;
+    push_quiet(1U + EVCAP_POST_SAMPLES);
+    handover();
+
+    zassert_equal(held_count, 2U);
+    zassert_equal(held[0]->trigger, EVCAP_TRIGGER_MANUAL);
+    zassert_equal(held[0]->pre, EVCAP_PRE_SAMPLES);
+
+    // the first trigger until the sample wins
+    zassert_equal(held[1]->trigger, EVCAP_TRIGGER_INT1);
+    zassert_equal(held[1]->int_src, 0x48U);
+    capture_check(held[1], trigger_seq, 3U);
+}
+
+ZTEST(evcap, test_all_handed_out)
+{
+    evcap_stats_t before;
+    evcap_stats_t stats;
+    int16_t       trigger_seq;
+
+    for (uint8_t i = 0U; i < EVCAP_BUFFERS; i++)
+    {
+        evcap_trigger(EVCAP_TRIGGER_MANUAL, 0U);
+        push_quiet(1U + EVCAP_POST_SAMPLES);
+    }
+    handover();
+    zassert_equal(held_count, EVCAP_BUFFERS);
+    zassert_ok(evcap_stats_get(&before));
+
+    // no ring to record into, a trigger has nothing to capture
+    push_quiet(5U);
+    evcap_trigger(EVCAP_TRIGGER_MANUAL, 0U);
+    push_quiet(1U);
+
+    zassert_ok(evcap_stats_get(&stats));
+    zassert_equal(stats.skipped - before.skipped, 6U);
+    zassert_equal(stats.merged, before.merged);
+    zassert_equal(stats.captures, before.captures);
+
+    // released, recording starts over with an empty history
+    evcap_release(held[0]);
+    held[0] = held[--held_count];
+    push_quiet(2U);
+    evcap_trigger(EVCAP_TRIGGER_MANUAL, 0U);
+    trigger_seq = seq;
+    push_quiet(1U + EVCAP_POST_SAMPLES);
+    handover();
+
+    zassert_equal(held_count, EVCAP_BUFFERS);
+    capture_check(held[EVCAP_BUFFERS - 1U], trigger_seq, 2U);
+    zassert_ok(evcap_stats_get(&stats));
+    zassert_equal(stats.skipped - before.skipped, 6U);
+}
+
+ZTEST(evcap, test_merged_and_gyro)
+{
+    const gyro_values_t turn = { .x = 0, .y = (int16_t)(GYRO_THRESHOLD + 1000U), .z = 0 };
+    evcap_stats_t       before;
+    evcap_stats_t       stats;
+    int16_t             trigger_seq;
+
+    zassert_ok(evcap_stats_get(&before));
+
+    trigger_seq = seq;
+    push(0, &turn);
+    push_quiet(1U);
+
+    // part of the capture being completed
+    evcap_trigger(EVCAP_TRIGGER_MANUAL, 0U);
+    push((int16_t)ACCEL_THRESHOLD, NULL);
+    push_quiet(EVCAP_POST_SAMPLES - 2U);
+    handover();
+
+    zassert_equal(held_count, 1U);
+    zassert_equal(held[0]->trigger, EVCAP_TRIGGER_GYRO);
+    capture_check(held[0], trigger_seq, EVCAP_PRE_SAMPLES);
+    zassert_equal(evcap_capture_sample(held[0], EVCAP_PRE_SAMPLES)->gyro.y, turn.y);
+    zassert_equal(evcap_capture_sample(held[0], EVCAP_PRE_SAMPLES + 1U)->gyro.y, 0);
+
+    zassert_ok(evcap_stats_get(&stats));
+    zassert_equal(stats.merged - before.merged, 1U);
+    zassert_equal(stats.captures - before.captures, 1U);
+}
+
+ZTEST(evcap, test_default_handler)
+{
+    const evcap_config_t config = { .accel_threshold_lsb = ACCEL_THRESHOLD };
+    evcap_stats_t        before;
+    evcap_stats_t        stats;
+
+    // logged and released at once, so no ring is ever missing
+    zassert_ok(evcap_init(&config));
+    zassert_ok(evcap_stats_get(&before));
+    for (uint8_t i = 0U; i < (2U * EVCAP_BUFFERS); i++)
+    {
+        push((int16_t)ACCEL_THRESHOLD, NULL);
+        push_quiet(EVCAP_POST_SAMPLES);
+        handover();
+    }
+
+    zassert_ok(evcap_stats_get(&stats));
+    zassert_equal(stats.captures - before.captures, 2U * EVCAP_BUFFERS);
+    zassert_equal(stats.skipped, before.skipped);
+    zassert_equal(held_count, 0U);
+
+    zassert_equal(evcap_init(NULL), -EINVAL);
+    zassert_equal(evcap_stats_get(NULL), -EINVAL);
+}
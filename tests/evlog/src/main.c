@@ -0,0 +1,154 @@
+/**
+ * @file      main.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Binary event log ring. A burst of more records than the ring
+ *            holds has to keep the oldest ones and count the rest as
+ *            dropped, and once the drain thread has run the whole ring has
+ *            to be free again. Many laps of the ring in small bursts must
+ *            not drop anything, and producers in two threads and a timer
+ *            putting at the same time have to account for every record.
+ *            The test thread never sleeps during a burst, so the drain
+ *            thread only runs between them.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "evlog.h"
+
+#define RECORDS          CONFIG_APP_EVLOG_RECORDS
+#define DRAIN_WAIT_MS    (2 * CONFIG_APP_EVLOG_DRAIN_INTERVAL_MS)
+#define PRODUCER_PUTS    40U
+#define PRODUCER_STACK   1024
+
+static K_THREAD_STACK_DEFINE(producer_stacks[2], PRODUCER_STACK);
+static struct k_thread producer_threads[2];
+static struct k_timer  producer_timer;
+static uint32_t        timer_puts;
+
+/**@brief Puts its records a few at a time, letting the others in between. */
+static void producer_fn(void * p1, void * p2, void * p3)
+{
+    const uint8_t address = (uint8_t)(uintptr_t)p1;
+
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    for (uint32_t i = 0U; i < PRODUCER_PUTS; i++)
+    {
+        evlog_put(EVLOG_TWI_READ_FAILED, address, 0x3BU, -EIO, i);
+        if ((i % 4U) == 3U)
+        {
+            k_msleep(1);
+        }
+    }
+}
+
+/**@brief Puts a record from the timer interrupt. */
+static void producer_timer_fn(struct k_timer * p_timer)
+{
+    ARG_UNUSED(p_timer);
+
+    if (timer_puts < PRODUCER_PUTS)
+    {
+        evlog_put(EVLOG_TWI_RECOVERY, 0U, 0U, 0, timer_puts++);
+    }
+}
+
+static void evlog_before(void * p_fixture)
+{
+    ARG_UNUSED(p_fixture);
+
+    // every test starts with the ring drained
+    k_msleep(DRAIN_WAIT_MS);
+}
+
+ZTEST_SUITE(evlog, NULL, NULL, evlog_before, NULL, NULL);
+
+ZTEST(evlog, test_full_ring)
+{
+    evlog_stats_t before;
+    evlog_stats_t stats;
+
+    zassert_ok(evlog_stats_get(&before));
+
+    for (uint32_t i = 0U; i < (RECORDS + 10U); i++)
+    {
+        evlog_put(EVLOG_TWI_WRITE_FAILED, 0x68U, 0x6BU, -ENXIO, i);
+    }
+
+    zassert_ok(evlog_stats_get(&stats));
+    zassert_equal(stats.records - before.records, RECORDS);
+    zassert_equal(stats.dropped - before.dropped, 10U);
+
+    // drained, the whole ring takes records again
+    k_msleep(DRAIN_WAIT_MS);
+    for (uint32_t i = 0U; i < RECORDS; i++)
+    {
+        evlog_put(EVLOG_TWI_WRITE_FAILED, 0x68U, 0x6BU, -ENXIO, i);
+    }
+
+    zassert_ok(evlog_stats_get(&stats));
+    zassert_equal(stats.records - before.records, 2U * RECORDS);
+    zassert_equal(stats.dropped - before.dropped, 10U);
+
+    zassert_equal(evlog_stats_get(NULL), -EINVAL);
+}
+
+ZTEST(evlog, test_many_laps)
+{
+    const uint32_t burst = (3U * RECORDS) / 4U;
+    evlog_stats_t  before;
+    evlog_stats_t  stats;
+
+    zassert_ok(evlog_stats_get(&before));
+
+    // bursts that do not line up with the ring, so every slot is used at every offset
+    for (uint32_t lap = 0U; lap < 20U; lap++)
+    {
+        for (uint32_t i = 0U; i < burst; i++)
+        {
+            evlog_put(EVLOG_TWI_BUS_TIMEOUT, 0x18U, 0U, -EBUSY, lap);
+        }
+        k_msleep(DRAIN_WAIT_MS);
+    }
+
+    zassert_ok(evlog_stats_get(&stats));
+    zassert_equal(stats.records - before.records, 20U * burst);
+    zassert_equal(stats.dropped, before.dropped);
+}
+
+ZTEST(evlog, test_concurrent_producers)
+{
+    evlog_stats_t before;
+    evlog_stats_t stats;
+
+    zassert_ok(evlog_stats_get(&before));
+
+    timer_puts = 0U;
+    k_timer_init(&producer_timer, producer_timer_fn, NULL);
+    k_timer_start(&producer_timer, K_USEC(500), K_USEC(500));
+
+    for (uint8_t i = 0U; i < ARRAY_SIZE(producer_threads); i++)
+    {
+        (void)k_thread_create(&producer_threads[i], producer_stacks[i], PRODUCER_STACK, producer_fn,
+                              (void *)(uintptr_t)(0x68U + i), NULL, NULL, K_PRIO_PREEMPT(1), 0, K_NO_WAIT);
+    }
+    for (uint8_t i = 0U; i < ARRAY_SIZE(producer_threads); i++)
+    {
+        zassert_ok(k_thread_join(&producer_threads[i], K_SECONDS(1)));
+    }
+
+    k_msleep(DRAIN_WAIT_MS);
+    k_timer_stop(&producer_timer);
+
+    // every put is either in the ring or counted as dropped
+    zassert_ok(evlog_stats_get(&stats));
+    TC_PRINT("%u records, %u dropped\n", stats.records - before.records, stats.dropped - before.dropped);
+    zassert_equal(timer_puts, PRODUCER_PUTS);
+    zassert_equal((stats.records - before.records) + (stats.dropped - before.dropped), 3U * PRODUCER_PUTS);
+}
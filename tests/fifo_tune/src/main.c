@@ -0,0 +1,273 @@
+/**
+ * @file      main.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Simulation of the FIFO batch size policy. A sensor FIFO is
+ *            filled at its output data rate and drained by a reader that
+ *            wakes on the watermark, reads the fill level and then the batch
+ *            in bursts, byte by byte at the bus clock. For a sweep of age
+ *            targets and rates the simulated wakeups per second, sample age
+ *            and fill level are checked against the plan of the policy: the
+ *            target has to be met without an overflow, and one sample more
+ *            per batch has to miss it or leave no room for the samples that
+ *            come during its drain.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "fifo_tune.h"
+
+#define SIM_DURATION_S 10U  ///< sensor time simulated per configuration
+
+/**@brief Age targets of the sweep, in us. */
+static const uint32_t sweep_targets_us[] = { 5000U, 10000U, 20000U, 50000U, 100000U, 200000U, 500000U };
+
+/**@brief Result of a simulation. */
+typedef struct
+{
+    uint32_t drains;          ///< wakeups of the reader
+    uint32_t wakeups_mhz;     ///< drains per 1000 s
+    uint32_t worst_age_us;    ///< oldest sample when its drain ended
+    uint32_t max_fill;        ///< most samples in the FIFO at once
+    uint32_t max_drain_ns;    ///< longest time from the watermark to the end of its drain
+    uint32_t bus_bytes_per_s; ///< bytes on the bus, overhead included
+} sim_result_t;
+
+/**
+ * @brief Time a transaction of some bytes takes on the bus, 9 clocks a byte.
+ */
+static uint64_t sim_xfer_ns(const uint32_t bytes, const uint32_t bus_hz)
+{
+    return ((uint64_t)bytes * 9U * 1000000000U) / bus_hz;
+}
+
+/**
+ * @brief Simulates a FIFO drained in batches for SIM_DURATION_S.
+ *
+ * The reader is woken when the FIFO holds a batch, after the wake latency
+ * it reads the fill level and then the batch, at most frames_per_read
+ * samples per read. A sample leaves the FIFO when the read carrying it
+ * ends. Samples that come in meanwhile stay for the next drain, which
+ * starts at once if they already make a batch.
+ *
+ * @param[in]  p_sensor        sensor
+ * @param[in]  odr_mhz         output data rate
+ * @param[in]  batch           samples per drain, the watermark
+ * @param[in]  wake_latency_us time from the watermark to the first bus byte
+ * @param[in]  bus_hz          bus clock
+ * @param[out] p_result        result
+ */
+static void sim_run(const fifo_tune_sensor_t * p_sensor, const uint32_t odr_mhz, const uint32_t batch,
+                    const uint32_t wake_latency_us, const uint32_t bus_hz, sim_result_t * p_result)
+{
+    const uint64_t period_ns = 1000000000000ULL / odr_mhz;
+    const uint64_t end_ns    = (uint64_t)SIM_DURATION_S * 1000000000U;
+    uint64_t       free_ns   = 0U;  // end of the last drain
+    uint64_t       read      = 0U;  // samples read so far, the oldest sample in the FIFO
+    uint64_t       bytes     = 0U;
+    uint64_t       worst_ns  = 0U;
+
+    *p_result = (sim_result_t){ 0 };
+
+    while (true)
+    {
+        // the watermark is reached when the last sample of the batch comes
+        const uint64_t irq_ns   = (read + batch - 1U) * period_ns;
+        const uint64_t start_ns = MAX(irq_ns, free_ns);
+        uint64_t       t_ns     = start_ns + ((uint64_t)wake_latency_us * 1000U);
+
+        if (t_ns > end_ns)
+        {
+            break;
+        }
+
+        t_ns  += sim_xfer_ns(p_sensor->status_bytes + FIFO_TUNE_XFER_OVERHEAD, bus_hz);
+        bytes += p_sensor->status_bytes + FIFO_TUNE_XFER_OVERHEAD;
+
+        for (uint32_t left = batch; left > 0U;)
+        {
+            const uint32_t frames     = MIN(left, p_sensor->frames_per_read);
+            const uint32_t read_bytes = (frames * p_sensor->frame_bytes) + FIFO_TUNE_XFER_OVERHEAD;
+
+            t_ns  += sim_xfer_ns(read_bytes, bus_hz);
+            bytes += read_bytes;
+
+            // the fill level peaks just before the read takes its samples out
+            const uint64_t arrived = (t_ns / period_ns) + 1U;
+
+            p_result->max_fill = MAX(p_result->max_fill, (uint32_t)(arrived - read));
+
+            read += frames;
+            left -= frames;
+        }
+
+        // the consumer gets the batch when the drain ends
+        worst_ns               = MAX(worst_ns, t_ns - ((read - batch) * period_ns));
+        p_result->max_drain_ns = MAX(p_result->max_drain_ns, (uint32_t)(t_ns - start_ns));
+        free_ns  = t_ns;
+        p_result->drains++;
+    }
+
+    p_result->wakeups_mhz     = (uint32_t)(((uint64_t)p_result->drains * 1000U) / SIM_DURATION_S);
+    p_result->worst_age_us    = (uint32_t)(worst_ns / 1000U);
+    p_result->bus_bytes_per_s = (uint32_t)(bytes / SIM_DURATION_S);
+}
+
+/**
+ * @brief Simulates the plan of every age target at a rate and checks it.
+ *
+ * @param[in] p_sensor sensor
+ * @param[in] odr_mhz  output data rate
+ * @param[in] print    prints the wakeups per second against the age
+ */
+static void sweep_check(const fifo_tune_sensor_t * p_sensor, const uint32_t odr_mhz, const bool print)
+{
+    uint32_t last_wakeups_mhz = UINT32_MAX;
+    uint32_t last_age_us      = 0U;
+
+    if (print)
+    {
+        TC_PRINT("%s at %u Hz\n", p_sensor->p_name, odr_mhz / 1000U);
+        TC_PRINT("  target us  batch  wakeups/s  worst age us  fill  B/s\n");
+    }
+
+    for (uint8_t i = 0U; i < ARRAY_SIZE(sweep_targets_us); i++)
+    {
+        const uint32_t   target_us = sweep_targets_us[i];
+        fifo_tune_plan_t plan;
+        sim_result_t     sim;
+        sim_result_t     sim_next;
+
+        const int err = fifo_tune_plan_compute(p_sensor, odr_mhz, target_us, FIFO_TUNE_WAKE_LATENCY_US,
+                                               FIFO_TUNE_BUS_HZ, &plan);
+
+        zassert_true((err == 0) || (err == -ERANGE), "plan failed with error: %d", err);
+        sim_run(p_sensor, odr_mhz, plan.batch, FIFO_TUNE_WAKE_LATENCY_US, FIFO_TUNE_BUS_HZ, &sim);
+
+        if (print)
+        {
+            TC_PRINT("  %9u  %5u  %5u.%03u  %12u  %4u  %u\n", target_us, plan.batch, sim.wakeups_mhz / 1000U,
+                     sim.wakeups_mhz % 1000U, sim.worst_age_us, sim.max_fill, sim.bus_bytes_per_s);
+        }
+
+        // the plan predicts the simulation, up to the one drain the simulated time may cut off
+        const uint32_t drain_mhz   = 1000U / SIM_DURATION_S;
+        const uint32_t drain_bytes = (sim.bus_bytes_per_s * SIM_DURATION_S) / MAX(sim.drains, 1U);
+
+        zassert_within(sim.wakeups_mhz, plan.wakeups_mhz, drain_mhz,
+                       "%s %u mHz batch %u: %u wakeups mHz simulated, %u planned", p_sensor->p_name, odr_mhz,
+                       plan.batch, sim.wakeups_mhz, plan.wakeups_mhz);
+        zassert_within(sim.worst_age_us, plan.worst_age_us, 1U, "%s %u mHz batch %u: %u us old simulated, %u planned",
+                       p_sensor->p_name, odr_mhz, plan.batch, sim.worst_age_us, plan.worst_age_us);
+        zassert_within(sim.bus_bytes_per_s, plan.bus_bytes_per_s, (drain_bytes / SIM_DURATION_S) + 1U);
+        zassert_true(sim.max_fill <= p_sensor->fifo_depth, "%s %u mHz batch %u: overflow, %u samples",
+                     p_sensor->p_name, odr_mhz, plan.batch, sim.max_fill);
+
+        if (err == -ERANGE)
+        {
+            // single samples already miss the target
+            zassert_equal(plan.batch, 1U);
+            continue;
+        }
+
+        zassert_true(sim.worst_age_us <= target_us, "%s %u mHz: %u us old, target %u us", p_sensor->p_name,
+                     odr_mhz, sim.worst_age_us, target_us);
+
+        // a larger batch misses the target or does not leave room for the samples coming during its drain
+        if (plan.batch < p_sensor->fifo_depth)
+        {
+            sim_run(p_sensor, odr_mhz, plan.batch + 1U, FIFO_TUNE_WAKE_LATENCY_US, FIFO_TUNE_BUS_HZ, &sim_next);
+
+            const uint32_t headroom = (uint32_t)DIV_ROUND_UP((uint64_t)sim_next.max_drain_ns * odr_mhz,
+                                                             1000000000000ULL);
+
+            zassert_true((sim_next.worst_age_us > target_us) || ((plan.batch + 1U + headroom) > p_sensor->fifo_depth),
+                         "%s %u mHz target %u us: batch %u would do, %u us old, %u samples during the drain",
+                         p_sensor->p_name, odr_mhz, target_us, plan.batch + 1U, sim_next.worst_age_us, headroom);
+        }
+
+        // a looser target never costs more wakeups
+        zassert_true(sim.wakeups_mhz <= last_wakeups_mhz);
+        zassert_true(sim.worst_age_us >= last_age_us);
+        last_wakeups_mhz = sim.wakeups_mhz;
+        last_age_us      = sim.worst_age_us;
+    }
+}
+
+ZTEST_SUITE(fifo_tune, NULL, NULL, NULL, NULL, NULL);
+
+ZTEST(fifo_tune, test_lis2dh12_sweep)
+{
+    static const uint32_t odrs_hz[] = { 10U, 25U, 50U, 100U, 200U, 400U };
+
+    for (uint8_t i = 0U; i < ARRAY_SIZE(odrs_hz); i++)
+    {
+        sweep_check(&fifo_tune_lis2dh12, odrs_hz[i] * 1000U, (odrs_hz[i] == 100U) || (odrs_hz[i] == 400U));
+    }
+}
+
+ZTEST(fifo_tune, test_mpu9250_sweep)
+{
+    static const uint32_t odrs_hz[] = { 50U, 100U, 200U, 500U, 1000U };
+
+    for (uint8_t i = 0U; i < ARRAY_SIZE(odrs_hz); i++)
+    {
+        sweep_check(&fifo_tune_mpu9250, odrs_hz[i] * 1000U, (odrs_hz[i] == 100U) || (odrs_hz[i] == 1000U));
+    }
+}
+
+/**@brief Rate of the sensor of the retune test. */
+static uint32_t         test_odr_mhz = 100000U;
+static fifo_tune_plan_t test_applied;
+
+static uint32_t test_odr_mhz_get(void)
+{
+    return test_odr_mhz;
+}
+
+static int test_apply(const fifo_tune_plan_t * p_plan)
+{
+    test_applied = *p_plan;
+    return 0;
+}
+
+ZTEST(fifo_tune, test_retune_on_odr_change)
+{
+    static const fifo_tune_sensor_t sensor = {
+        .p_name          = "test",
+        .fifo_depth      = 32U,
+        .frame_bytes     = 6U,
+        .status_bytes    = 1U,
+        .frames_per_read = 8U,
+        .odr_mhz_get     = test_odr_mhz_get,
+        .apply           = test_apply,
+    };
+    static const uint32_t odrs_hz[] = { 400U, 100U, 25U, 10U, 100U };
+    const uint32_t        target_us = 100000U;
+    fifo_tune_plan_t      plan;
+    sim_result_t          sim;
+    int                   index;
+
+    zassert_ok(fifo_tune_init(target_us, FIFO_TUNE_WAKE_LATENCY_US, FIFO_TUNE_BUS_HZ));
+    index = fifo_tune_sensor_add(&sensor);
+    zassert_true(index >= 0);
+
+    for (uint8_t i = 0U; i < ARRAY_SIZE(odrs_hz); i++)
+    {
+        test_odr_mhz = odrs_hz[i] * 1000U;
+        zassert_ok(fifo_tune_retune());
+        zassert_ok(fifo_tune_plan_get((uint8_t)index, &plan));
+        zassert_equal(plan.batch, test_applied.batch);
+
+        sim_run(&sensor, test_odr_mhz, plan.batch, FIFO_TUNE_WAKE_LATENCY_US, FIFO_TUNE_BUS_HZ, &sim);
+        zassert_true(sim.worst_age_us <= target_us, "%u Hz: %u us old", odrs_hz[i], sim.worst_age_us);
+        zassert_true(sim.max_fill <= sensor.fifo_depth);
+
+        TC_PRINT("retuned at %3u Hz: batch %2u, %u.%03u wakeups/s, %u us old\n", odrs_hz[i], plan.batch,
+                 sim.wakeups_mhz / 1000U, sim.wakeups_mhz % 1000U, sim.worst_age_us);
+    }
+}
@@ -0,0 +1,177 @@
+/**
+ * @file      main.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Batch frame decoder against a byte by byte reference. Every
+ *            layout has to decode the same samples as the reference for
+ *            even, odd and FIFO sized batches from any alignment, and must
+ *            not write past the batch. On the target the batch decoder is
+ *            also timed against the byte by byte decoding the drivers did
+ *            per sample, native_sim cycles say nothing about the target.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "frame_decode.h"
+#include "sensor_types.h"
+
+#define MAX_FRAMES   256U     ///< a full MPU9250 FIFO is 85 accelerometer frames
+#define MAX_CHANNELS 7U
+#define GUARD        0x5A5A   ///< written after the last frame, the decoder must leave it
+#define BENCH_ROUNDS 16U
+
+static uint8_t raw_buffer[(MAX_FRAMES * MAX_CHANNELS * 2U) + 1U];
+static int16_t out[MAX_CHANNELS][MAX_FRAMES + 1U];
+static int16_t expected[MAX_CHANNELS][MAX_FRAMES];
+
+/**
+ * @brief Decodes big-endian frames one byte at a time.
+ */
+static void reference_decode(const uint8_t * p_raw, const uint16_t frames, const uint8_t channels)
+{
+    for (uint16_t frame = 0U; frame < frames; frame++)
+    {
+        for (uint8_t c = 0U; c < channels; c++)
+        {
+            const uint8_t * p_sample = &p_raw[((frame * channels) + c) * 2U];
+
+            expected[c][frame] = (int16_t)(uint16_t)((p_sample[0] << 8) | p_sample[1]);
+        }
+    }
+}
+
+static void * frame_decode_setup(void)
+{
+    for (uint32_t i = 0U; i < sizeof(raw_buffer); i++)
+    {
+        raw_buffer[i] = (uint8_t)((i * 37U) + 11U);
+    }
+
+    return NULL;
+}
+
+ZTEST_SUITE(frame_decode, NULL, frame_decode_setup, NULL, NULL, NULL);
+
+ZTEST(frame_decode, test_layouts_match)
+{
+    // arrays of out that the channels of every layout go to, in frame order
+    static const struct
+    {
+        enum frame_layout layout;
+        uint8_t           channels;
+        uint8_t           arrays[MAX_CHANNELS];
+    } layouts[] = {
+        { FRAME_LAYOUT_ACCEL,           3U, { 0U, 1U, 2U } },
+        { FRAME_LAYOUT_GYRO,            3U, { 4U, 5U, 6U } },
+        { FRAME_LAYOUT_ACCEL_GYRO,      6U, { 0U, 1U, 2U, 4U, 5U, 6U } },
+        { FRAME_LAYOUT_ACCEL_TEMP_GYRO, 7U, { 0U, 1U, 2U, 3U, 4U, 5U, 6U } },
+    };
+    static const uint16_t batches[] = { 1U, 2U, 3U, 85U, MAX_FRAMES - 1U, MAX_FRAMES };
+    const frame_soa_t     soa       = {
+        .p_accel = { out[0], out[1], out[2] },
+        .p_temp  = out[3],
+        .p_gyro  = { out[4], out[5], out[6] },
+    };
+
+    for (uint8_t l = 0U; l < ARRAY_SIZE(layouts); l++)
+    {
+        const uint8_t channels = layouts[l].channels;
+
+        zassert_equal(frame_decode_frame_bytes(layouts[l].layout), channels * 2U);
+
+        for (uint8_t b = 0U; b < ARRAY_SIZE(batches); b++)
+        {
+            // word aligned and not
+            for (uint8_t offset = 0U; offset < 2U; offset++)
+            {
+                const uint8_t * p_raw = &raw_buffer[offset];
+
+                for (uint8_t c = 0U; c < MAX_CHANNELS; c++)
+                {
+                    for (uint16_t f = 0U; f <= MAX_FRAMES; f++)
+                    {
+                        out[c][f] = GUARD;
+                    }
+                }
+
+                reference_decode(p_raw, batches[b], channels);
+                zassert_ok(frame_decode(layouts[l].layout, p_raw, batches[b], &soa));
+
+                for (uint8_t c = 0U; c < channels; c++)
+                {
+                    const int16_t * p_out = out[layouts[l].arrays[c]];
+
+                    zassert_mem_equal(p_out, expected[c], batches[b] * sizeof(int16_t),
+                                      "layout 0x%02X, %u frames at offset %u: channel %u differs", layouts[l].layout,
+                                      batches[b], offset, c);
+                    zassert_equal(p_out[batches[b]], GUARD, "layout 0x%02X, %u frames: channel %u overrun",
+                                  layouts[l].layout, batches[b], c);
+                }
+            }
+        }
+    }
+}
+
+ZTEST(frame_decode, test_invalid)
+{
+    const frame_soa_t soa = { .p_accel = { out[0], out[1], out[2] } };
+
+    zassert_equal(frame_decode_frame_bytes(FRAME_LAYOUT_ACCEL), 6U);
+    zassert_equal(frame_decode_frame_bytes(FRAME_LAYOUT_ACCEL_TEMP_GYRO), 14U);
+    zassert_equal(frame_decode_frame_bytes((enum frame_layout)FRAME_CH_TEMP), 0U);
+
+    zassert_equal(frame_decode(FRAME_LAYOUT_ACCEL, NULL, 1U, &soa), -EINVAL);
+    zassert_equal(frame_decode(FRAME_LAYOUT_ACCEL, raw_buffer, 1U, NULL), -EINVAL);
+    zassert_equal(frame_decode((enum frame_layout)FRAME_CH_TEMP, raw_buffer, 1U, &soa), -EINVAL);
+}
+
+ZTEST(frame_decode, test_batch_faster)
+{
+    static accel_values_t aos[MAX_FRAMES];
+    const frame_soa_t     soa             = { .p_accel = { out[0], out[1], out[2] } };
+    uint32_t              bytewise_cycles = 0U;
+    uint32_t              batch_cycles    = 0U;
+    uint32_t              start;
+
+    if (IS_ENABLED(CONFIG_ARCH_POSIX))
+    {
+        ztest_test_skip();
+    }
+
+    for (uint32_t round = 0U; round < BENCH_ROUNDS; round++)
+    {
+        // what app_mpu_read_accel() did, reversing the bytes into the z, y, x struct
+        start = k_cycle_get_32();
+        for (uint32_t frame = 0U; frame < MAX_FRAMES; frame++)
+        {
+            uint8_t * p_data = (uint8_t *)&aos[frame];
+
+            for (uint8_t i = 0U; i < 6U; i++)
+            {
+                p_data[i] = raw_buffer[(frame * 6U) + 5U - i];
+            }
+        }
+        bytewise_cycles += k_cycle_get_32() - start;
+
+        start = k_cycle_get_32();
+        frame_decode_accel(raw_buffer, MAX_FRAMES, &soa);
+        batch_cycles += k_cycle_get_32() - start;
+    }
+
+    for (uint32_t frame = 0U; frame < MAX_FRAMES; frame++)
+    {
+        zassert_equal(aos[frame].x, out[0][frame]);
+        zassert_equal(aos[frame].y, out[1][frame]);
+        zassert_equal(aos[frame].z, out[2][frame]);
+    }
+
+    TC_PRINT("frame decode: %u frames, bytewise %u ns, batch %u ns\n", MAX_FRAMES * BENCH_ROUNDS,
+             (uint32_t)k_cyc_to_ns_floor64(bytewise_cycles), (uint32_t)k_cyc_to_ns_floor64(batch_cycles));
+    zassert_true(batch_cycles < bytewise_cycles, "batch %u cycles, bytewise %u cycles", batch_cycles,
+                 bytewise_cycles);
+}
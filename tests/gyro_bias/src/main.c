@@ -0,0 +1,185 @@
+/**
+ * @file      main.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Temperature fit of the gyroscope bias engine. A made up
+ *            gyroscope at rest has a bias that moves linearly with the
+ *            temperature on two axes and stays put on the third. Stationary
+ *            windows are fed at three temperatures on the nodes of the
+ *            table, the bias in between has to follow the line and the
+ *            bias beyond the learned nodes has to hold the closest one. A
+ *            rotating window and one off 1 g must not be learned.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "gyro_bias.h"
+
+#define WINDOW            128U
+#define WINDOWS_PER_NODE  4U      ///< enough for a node to be used
+#define ONE_G             16384
+
+static gyro_values_t  gyro[WINDOW];
+static accel_values_t accel[WINDOW];
+
+/**@brief Bias of the made up gyroscope at a temperature in centi-degrees. */
+static gyro_values_t bias_at(const int32_t temp_cc)
+{
+    const int32_t from_25c = temp_cc - 2500;
+
+    return (gyro_values_t){
+        .x = (int16_t)(50 + ((4 * from_25c) / 100)),
+        .y = (int16_t)(-30 - ((2 * from_25c) / 100)),
+        .z = 10,
+    };
+}
+
+/**
+ * @brief Sets the temperature of the engine to the given one, or the next
+ * one the raw reading can give.
+ */
+static void temp_set(const int32_t temp_cc)
+{
+    gyro_bias_stats_t stats;
+    temp_value_t      raw = (temp_value_t)(((temp_cc - 2100) * 33387) / 10000);
+
+    do
+    {
+        gyro_bias_temp_update(raw++);
+        zassert_ok(gyro_bias_stats_get(&stats));
+    } while (stats.temp_cc < temp_cc);
+
+    zassert_true(stats.temp_cc <= (temp_cc + 1), "%d for %d", stats.temp_cc, temp_cc);
+}
+
+/**
+ * @brief Fills one window of a sensor at the given gyroscope mean and
+ * acceleration, with a few LSB of noise.
+ */
+static void window_fill(const gyro_values_t mean, const int16_t accel_z)
+{
+    for (uint16_t i = 0U; i < WINDOW; i++)
+    {
+        const int16_t noise = (int16_t)(((i * 7U) % 5U) - 2);
+
+        gyro[i]  = (gyro_values_t){ .x = mean.x + noise, .y = mean.y - noise, .z = mean.z + noise };
+        accel[i] = (accel_values_t){ .x = 10 * noise, .y = -10 * noise, .z = accel_z + (10 * noise) };
+    }
+}
+
+static void learn_at(const int32_t temp_cc)
+{
+    temp_set(temp_cc);
+    window_fill(bias_at(temp_cc), ONE_G);
+
+    for (uint8_t i = 0U; i < WINDOWS_PER_NODE; i++)
+    {
+        zassert_ok(gyro_bias_feed(gyro, accel, WINDOW));
+    }
+}
+
+static void bias_check(const int32_t temp_cc, const gyro_values_t expected)
+{
+    gyro_bias_stats_t stats;
+
+    temp_set(temp_cc);
+    zassert_ok(gyro_bias_stats_get(&stats));
+
+    TC_PRINT("%d cC: bias %d %d %d, line %d %d %d\n", stats.temp_cc, stats.bias_x, stats.bias_y, stats.bias_z,
+             expected.x, expected.y, expected.z);
+    zassert_within(stats.bias_x, expected.x, 1);
+    zassert_within(stats.bias_y, expected.y, 1);
+    zassert_within(stats.bias_z, expected.z, 1);
+}
+
+static void gyro_bias_before(void * p_fixture)
+{
+    gyro_bias_config_t config = GYRO_BIAS_CONFIG_DEFAULT;
+
+    ARG_UNUSED(p_fixture);
+
+    config.window  = WINDOW;
+    config.persist = false;
+    zassert_ok(gyro_bias_init(&config));
+}
+
+ZTEST_SUITE(gyro_bias, NULL, NULL, gyro_bias_before, NULL, NULL);
+
+ZTEST(gyro_bias, test_temperature_fit)
+{
+    gyro_bias_stats_t stats;
+    gyro_values_t     sample;
+
+    learn_at(1500);
+    learn_at(2500);
+    learn_at(3500);
+
+    zassert_ok(gyro_bias_stats_get(&stats));
+    zassert_equal(stats.windows, 3U * WINDOWS_PER_NODE);
+    zassert_equal(stats.stationary_windows, 3U * WINDOWS_PER_NODE);
+    zassert_equal(stats.learned_nodes, 3U);
+
+    // on the nodes and halfway between them, on the line
+    bias_check(1500, bias_at(1500));
+    bias_check(2000, bias_at(2000));
+    bias_check(2500, bias_at(2500));
+    bias_check(3000, bias_at(3000));
+    bias_check(3500, bias_at(3500));
+
+    // beyond the learned nodes the closest one holds
+    bias_check(500, bias_at(1500));
+    bias_check(4500, bias_at(3500));
+
+    // a sample at 30 C loses the bias of 30 C
+    temp_set(3000);
+    sample = (gyro_values_t){ .x = bias_at(3000).x + 5, .y = bias_at(3000).y - 5, .z = 10 };
+    gyro_bias_apply(&sample, 1U);
+    zassert_within(sample.x, 5, 1);
+    zassert_within(sample.y, -5, 1);
+    zassert_within(sample.z, 0, 1);
+}
+
+ZTEST(gyro_bias, test_moving_not_learned)
+{
+    gyro_bias_stats_t stats;
+
+    temp_set(2500);
+
+    // a steady rotation
+    window_fill((gyro_values_t){ .x = 0, .y = 0, .z = 2000 }, ONE_G);
+    zassert_ok(gyro_bias_feed(gyro, accel, WINDOW));
+
+    // at rest but 1.2 g, the sensor is accelerated
+    window_fill(bias_at(2500), (ONE_G * 6) / 5);
+    zassert_ok(gyro_bias_feed(gyro, accel, WINDOW));
+
+    zassert_ok(gyro_bias_stats_get(&stats));
+    zassert_equal(stats.windows, 2U);
+    zassert_equal(stats.stationary_windows, 0U);
+    zassert_equal(stats.learned_nodes, 0U);
+    zassert_equal(stats.bias_x, 0);
+    zassert_equal(stats.bias_z, 0);
+}
+
+ZTEST(gyro_bias, test_reset)
+{
+    gyro_bias_stats_t stats;
+
+    learn_at(2500);
+    zassert_ok(gyro_bias_stats_get(&stats));
+    zassert_equal(stats.learned_nodes, 1U);
+    zassert_within(stats.bias_x, bias_at(2500).x, 1);
+
+    zassert_ok(gyro_bias_reset());
+    zassert_ok(gyro_bias_stats_get(&stats));
+    zassert_equal(stats.learned_nodes, 0U);
+    zassert_equal(stats.bias_x, 0);
+    zassert_equal(stats.bias_y, 0);
+
+    zassert_equal(gyro_bias_feed(NULL, accel, WINDOW), -EINVAL);
+    zassert_equal(gyro_bias_save(), -ENOTSUP);
+}
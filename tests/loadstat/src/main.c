@@ -0,0 +1,153 @@
+/**
+ * @file      main.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Load accounting of a known sampling load. A scheduler job
+ *            reads 14 bytes from a sensor on the emulated bus every period,
+ *            17 bytes on the wire with the register address and the
+ *            repeated start, so the bus share is known from the byte time
+ *            alone. Reading every other period has to halve it. The job is
+ *            the only thing that runs, so the sampling thread and the idle
+ *            thread have to share the wall time between them. The shares
+ *            of made up snapshots check the arithmetic and the totals that
+ *            went down with a reset.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "acq_sched.h"
+#include "loadstat.h"
+#include "twi.h"
+#include "twi_emul.h"
+
+#define SENSOR_ADDRESS  0x68U
+#define READ_LENGTH     14U
+#define WIRE_BYTES      (READ_LENGTH + 3U)          ///< address, register, address again, then the data
+#define BYTE_TIME_US    DIV_ROUND_UP(9U * 1000000U, 400000U)
+#define PERIOD_US       1000U
+#define RUN_MS          500
+
+static uint8_t registers[128];
+
+static int sensor_read(void * p_context)
+{
+    uint8_t data[READ_LENGTH];
+
+    ARG_UNUSED(p_context);
+
+    return twi_read(SENSOR_ADDRESS, 0x3BU, data, sizeof(data));
+}
+
+/**
+ * @brief Runs the job every divider periods and gets the shares of the run.
+ */
+static void load_run(const uint16_t divider, loadstat_report_t * p_report)
+{
+    const acq_job_t    job    = { .p_name = "sensor", .read = sensor_read, .divider = divider };
+    acq_sched_config_t config = ACQ_SCHED_CONFIG_DEFAULT(PERIOD_US);
+
+    zassert_ok(acq_sched_init(&config));
+    zassert_equal(acq_sched_job_add(&job), 0);
+
+    // counted from here, what came before does not matter and may not even be an interval
+    (void)loadstat_sample(p_report);
+
+    zassert_ok(acq_sched_start());
+    k_msleep(RUN_MS);
+    zassert_ok(acq_sched_stop());
+
+    zassert_ok(loadstat_sample(p_report));
+    TC_PRINT("every %u periods, %u ms: bus busy %u, waited %u, in calls %u, sampling %u, idle %u permille\n",
+             divider, p_report->interval_ms, p_report->bus_busy_permille, p_report->bus_wait_permille,
+             p_report->twi_call_permille, p_report->sampling_permille, p_report->idle_permille);
+}
+
+static void shares_check(const loadstat_report_t * p_report, const uint32_t busy_permille)
+{
+    zassert_within(p_report->interval_ms, RUN_MS, 2);
+    zassert_within(p_report->bus_busy_permille, busy_permille, 10U);
+
+    // a single caller never waits, and its calls are the bus time and a little more
+    zassert_true(p_report->bus_wait_permille <= 5U);
+    zassert_between_inclusive(p_report->twi_call_permille, p_report->bus_busy_permille,
+                              p_report->bus_busy_permille + 20U);
+
+    // the transfers are CPU time of the sampling thread, the rest is idle
+    zassert_true(p_report->sampling_permille >= p_report->twi_call_permille - 5U);
+    zassert_within(p_report->idle_permille, 1000U - p_report->sampling_permille, 20U);
+}
+
+static void * loadstat_setup(void)
+{
+    static const twi_speed_profile_t profiles[] = {
+        { .address = SENSOR_ADDRESS, .speed = TWI_SPEED_400K },
+    };
+
+    zassert_ok(twi_emul_target_add(SENSOR_ADDRESS, registers, sizeof(registers)));
+    zassert_ok(twi_init(0U, 0U));
+    zassert_ok(twi_speed_profiles_set(profiles, ARRAY_SIZE(profiles)));
+    zassert_ok(twi_idle_off_set(0U));
+    zassert_ok(twi_enable());
+
+    return NULL;
+}
+
+ZTEST_SUITE(loadstat, NULL, loadstat_setup, NULL, NULL, NULL);
+
+ZTEST(loadstat, test_sampling_load)
+{
+    const uint32_t    busy_permille = (WIRE_BYTES * BYTE_TIME_US * 1000U) / PERIOD_US;
+    loadstat_report_t every;
+    loadstat_report_t every_other;
+
+    load_run(1U, &every);
+    shares_check(&every, busy_permille);
+
+    load_run(2U, &every_other);
+    shares_check(&every_other, busy_permille / 2U);
+}
+
+ZTEST(loadstat, test_interval)
+{
+    const loadstat_snapshot_t from = {
+        .wall_us     = 1000000,
+        .bus_busy_us = 100000U,
+        .bus_wait_us = 5000U,
+        .twi_call_us = 120000U,
+        .sampling_us = 200000U,
+        .idle_us     = 700000U,
+    };
+    loadstat_snapshot_t to = {
+        .wall_us     = 3000000,
+        .bus_busy_us = 600000U,
+        .bus_wait_us = 5000U,
+        .twi_call_us = 20000U,  // the statistics were reset in between
+        .sampling_us = 1200000U,
+        .idle_us     = 1600000U,
+    };
+    loadstat_report_t report;
+
+    zassert_ok(loadstat_interval(&from, &to, &report));
+    zassert_equal(report.interval_ms, 2000U);
+    zassert_equal(report.bus_busy_permille, 250U);
+    zassert_equal(report.bus_wait_permille, 0U);
+    zassert_equal(report.twi_call_permille, 0U);
+    zassert_equal(report.sampling_permille, 500U);
+    zassert_equal(report.idle_permille, 450U);
+
+    zassert_equal(loadstat_interval(&from, &from, &report), -EINVAL);
+    zassert_equal(loadstat_interval(&to, &from, &report), -EINVAL);
+    zassert_equal(loadstat_interval(NULL, &to, &report), -EINVAL);
+    zassert_equal(loadstat_interval(&from, &to, NULL), -EINVAL);
+
+    to.wall_us = from.wall_us + 1;
+    zassert_ok(loadstat_interval(&from, &to, &report));
+    zassert_equal(report.interval_ms, 0U);
+
+    zassert_equal(loadstat_sample(NULL), -EINVAL);
+    zassert_equal(loadstat_snapshot(NULL), -EINVAL);
+}
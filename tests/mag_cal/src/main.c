@@ -0,0 +1,234 @@
+/**
+ * @file      main.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Ellipsoid fit of the magnetometer calibration. Directions
+ *            spread evenly over the sphere are distorted by a known soft
+ *            iron matrix and hard iron offset and fed as raw samples. The
+ *            fit has to find the offset, and since the made up matrix is
+ *            symmetric the correction has to map every sample back onto its
+ *            own direction, at the geometric mean radius. A much too
+ *            eccentric distortion has to be rejected, and samples from a
+ *            single plane must not start a solve at all.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <math.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "mag_cal.h"
+
+#define POINTS     512U
+#define FIELD_LSB  330.0   ///< earth field of the AK8963 in 16 bit mode
+
+static const double offset[3] = { 120.0, -80.0, 40.0 };
+
+/**@brief Soft iron distortion, symmetric so its correction is its inverse. */
+static const double soft_iron[3][3] = {
+    { 1.20, 0.05, 0.00 },
+    { 0.05, 0.90, 0.03 },
+    { 0.00, 0.03, 1.00 },
+};
+
+/**@brief Too eccentric to be a plausible distortion, 300% between the axes. */
+static const double stretched[3][3] = {
+    { 3.00, 0.00, 0.00 },
+    { 0.00, 1.00, 0.00 },
+    { 0.00, 0.00, 1.00 },
+};
+
+static magn_values_t raw[POINTS];
+
+/**@brief Direction of point n of a Fibonacci sphere. */
+static void direction_get(const uint32_t n, double u[3])
+{
+    const double golden = M_PI * (3.0 - sqrt(5.0));
+    const double z      = 1.0 - ((2.0 * (n + 0.5)) / POINTS);
+    const double rho    = sqrt(1.0 - (z * z));
+
+    u[0] = rho * cos(golden * n);
+    u[1] = rho * sin(golden * n);
+    u[2] = z;
+}
+
+/**@brief The raw sample the distorted magnetometer gives for a direction. */
+static magn_values_t distort(const double matrix[3][3], const double u[3])
+{
+    double value[3];
+
+    for (uint8_t i = 0U; i < 3U; i++)
+    {
+        value[i] = offset[i] + (FIELD_LSB * ((matrix[i][0] * u[0]) + (matrix[i][1] * u[1]) + (matrix[i][2] * u[2])));
+    }
+
+    return (magn_values_t){ .x = (int16_t)lround(value[0]), .y = (int16_t)lround(value[1]),
+                            .z = (int16_t)lround(value[2]) };
+}
+
+static double determinant(const double m[3][3])
+{
+    return (m[0][0] * ((m[1][1] * m[2][2]) - (m[1][2] * m[2][1]))) -
+           (m[0][1] * ((m[1][0] * m[2][2]) - (m[1][2] * m[2][0]))) +
+           (m[0][2] * ((m[1][0] * m[2][1]) - (m[1][1] * m[2][0])));
+}
+
+static void sphere_fill(const double matrix[3][3])
+{
+    double u[3];
+
+    for (uint32_t n = 0U; n < POINTS; n++)
+    {
+        direction_get(n, u);
+        raw[n] = distort(matrix, u);
+    }
+}
+
+static void quality_print(const mag_cal_quality_t * p_quality)
+{
+    TC_PRINT("%u accepted, %u solves, %u rejected, coverage %u, radius %u, axis ratio %u%%, residual %u permille\n",
+             p_quality->accepted, p_quality->solves, p_quality->rejected, p_quality->coverage, p_quality->radius,
+             p_quality->axis_ratio_pct, p_quality->residual_permille);
+}
+
+static void mag_cal_before(void * p_fixture)
+{
+    const mag_cal_config_t config = MAG_CAL_CONFIG_DEFAULT;
+
+    ARG_UNUSED(p_fixture);
+
+    zassert_ok(mag_cal_init(&config));
+}
+
+ZTEST_SUITE(mag_cal, NULL, NULL, mag_cal_before, NULL, NULL);
+
+ZTEST(mag_cal, test_hard_and_soft_iron)
+{
+    mag_cal_params_t  params;
+    mag_cal_quality_t quality;
+    magn_values_t     sample;
+    double            u[3];
+    double            radius;
+
+    zassert_equal(mag_cal_params_get(&params), -ENODATA);
+
+    sphere_fill(soft_iron);
+    zassert_ok(mag_cal_feed(raw, POINTS));
+    zassert_ok(mag_cal_feed(raw, POINTS));
+
+    zassert_ok(mag_cal_quality_get(&quality));
+    quality_print(&quality);
+    zassert_true(quality.calibrated);
+    zassert_true(quality.solves >= 1U);
+    zassert_equal(quality.rejected, 0U);
+    zassert_between_inclusive(quality.axis_ratio_pct, 130U, 145U);
+
+    zassert_ok(mag_cal_params_get(&params));
+    TC_PRINT("offset %d %d %d\n", params.offset[0], params.offset[1], params.offset[2]);
+    for (uint8_t axis = 0U; axis < 3U; axis++)
+    {
+        zassert_within(params.offset[axis], (int16_t)offset[axis], 2);
+    }
+
+    // the geometric mean of the semi-axes
+    radius = FIELD_LSB * cbrt(determinant(soft_iron));
+    zassert_within(params.radius, (uint16_t)lround(radius), 2, "radius %u, expected %d", params.radius, (int)radius);
+
+    // every sample back on its own direction
+    for (uint32_t n = 0U; n < POINTS; n++)
+    {
+        direction_get(n, u);
+        sample = raw[n];
+        mag_cal_apply(&sample, 1U);
+
+        zassert_within(sample.x, (int16_t)lround(params.radius * u[0]), 3, "x of %u: %d", n, sample.x);
+        zassert_within(sample.y, (int16_t)lround(params.radius * u[1]), 3, "y of %u: %d", n, sample.y);
+        zassert_within(sample.z, (int16_t)lround(params.radius * u[2]), 3, "z of %u: %d", n, sample.z);
+    }
+
+    zassert_ok(mag_cal_quality_get(&quality));
+    zassert_true(quality.residual_permille <= 5U, "residual %u permille", quality.residual_permille);
+
+    mag_cal_reset();
+    zassert_equal(mag_cal_params_get(&params), -ENODATA);
+    zassert_ok(mag_cal_quality_get(&quality));
+    zassert_false(quality.calibrated);
+    zassert_equal(quality.solves, 0U);
+}
+
+ZTEST(mag_cal, test_too_eccentric)
+{
+    mag_cal_params_t  params;
+    mag_cal_quality_t quality;
+
+    sphere_fill(stretched);
+    zassert_ok(mag_cal_feed(raw, POINTS));
+    zassert_ok(mag_cal_feed(raw, POINTS));
+
+    zassert_ok(mag_cal_quality_get(&quality));
+    quality_print(&quality);
+    zassert_true(quality.rejected >= 1U);
+    zassert_equal(quality.solves, 0U);
+    zassert_false(quality.calibrated);
+    zassert_equal(mag_cal_params_get(&params), -ENODATA);
+}
+
+ZTEST(mag_cal, test_single_plane)
+{
+    mag_cal_quality_t quality;
+    const double      no_distortion[3][3] = { { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 0.0, 0.0, 1.0 } };
+
+    // turned about z only, x and y take turns as the dominant axis
+    for (uint32_t n = 0U; n < POINTS; n++)
+    {
+        const double u[3] = { cos((2.0 * M_PI * n) / 64.0), sin((2.0 * M_PI * n) / 64.0), 0.0 };
+
+        raw[n] = distort(no_distortion, u);
+    }
+    zassert_ok(mag_cal_feed(raw, POINTS));
+
+    zassert_ok(mag_cal_quality_get(&quality));
+    quality_print(&quality);
+    zassert_true(quality.accepted >= 256U);
+    zassert_equal(quality.coverage, 4U);
+    zassert_equal(quality.solves + quality.rejected, 0U);
+    zassert_false(quality.calibrated);
+}
+
+ZTEST(mag_cal, test_known_params)
+{
+    mag_cal_config_t       config = MAG_CAL_CONFIG_DEFAULT;
+    const mag_cal_params_t known  = {
+        .offset = { 10, 0, 0 },
+        .matrix = { 2 << MAG_CAL_MATRIX_SHIFT, 0, 0, 0, 1 << MAG_CAL_MATRIX_SHIFT, 0, 0, 0, 1 << MAG_CAL_MATRIX_SHIFT },
+        .radius = 200U,
+    };
+    mag_cal_params_t params;
+    magn_values_t    sample = { .x = 110, .y = -50, .z = 7 };
+
+    // left as it is without a calibration
+    mag_cal_apply(&sample, 1U);
+    zassert_equal(sample.x, 110);
+
+    zassert_ok(mag_cal_params_set(&known));
+    zassert_ok(mag_cal_params_get(&params));
+    zassert_mem_equal(&params, &known, sizeof(params));
+
+    mag_cal_apply(&sample, 1U);
+    zassert_equal(sample.x, 200);
+    zassert_equal(sample.y, -50);
+    zassert_equal(sample.z, 7);
+
+    zassert_equal(mag_cal_params_set(NULL), -EINVAL);
+    zassert_equal(mag_cal_feed(NULL, 1U), -EINVAL);
+
+    config.solve_interval = 0U;
+    zassert_equal(mag_cal_init(&config), -EINVAL);
+    config.solve_interval     = 256U;
+    config.max_axis_ratio_pct = 99U;
+    zassert_equal(mag_cal_init(&config), -EINVAL);
+    zassert_equal(mag_cal_init(NULL), -EINVAL);
+}
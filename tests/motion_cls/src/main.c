@@ -0,0 +1,374 @@
+/**
+ * @file      main.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Machine state classifier against scripts/motion_cls_train.py.
+ *            Synthetic windows of every class are made by the generator the
+ *            script trains on, from seeds it does not train on, and
+ *            classified with the int8 net of the component and with the
+ *            float net it was quantized from. Both have to give exactly the
+ *            results the script got, which holds only while the features
+ *            and the int8 arithmetic mirror the script bit for bit. The
+ *            windows are also pushed as a sample stream to check the
+ *            confirmation of the changes, and on the target the time of a
+ *            window is measured.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "motion_cls.h"
+#include "motion_cls_model.h"
+#include "motion_cls_model_ref.h"
+
+#define TEST_LSB_PER_G   1000U  ///< samples in mg, pushed as they were made
+#define EVENTS_MAX       16U
+
+/**@brief sin(2 pi k / MOTION_CLS_WINDOW) in Q15, SIN_Q15 of the script. */
+static const int16_t sin_q15[MOTION_CLS_WINDOW] = {
+         0,   3212,   6393,   9512,  12539,  15446,  18204,  20787,
+     23170,  25329,  27245,  28898,  30273,  31356,  32137,  32609,
+     32767,  32609,  32137,  31356,  30273,  28898,  27245,  25329,
+     23170,  20787,  18204,  15446,  12539,   9512,   6393,   3212,
+         0,  -3212,  -6393,  -9512, -12539, -15446, -18204, -20787,
+    -23170, -25329, -27245, -28898, -30273, -31356, -32137, -32609,
+    -32767, -32609, -32137, -31356, -30273, -28898, -27245, -25329,
+    -23170, -20787, -18204, -15446, -12539,  -9512,  -6393,  -3212,
+};
+
+static motion_cls_window_t window;
+static motion_cls_event_t  events[EVENTS_MAX];
+static uint32_t            event_count;
+
+/**
+ * @brief Floor of the square root, math.isqrt() of the script.
+ */
+static uint32_t isqrt(const uint32_t value)
+{
+    uint32_t root = (uint32_t)sqrt((double)value);
+
+    while (((uint64_t)root * root) > value)
+    {
+        root--;
+    }
+    while (((uint64_t)(root + 1U) * (root + 1U)) <= value)
+    {
+        root++;
+    }
+
+    return root;
+}
+
+/**
+ * @brief xorshift32, Rng.next() of the script.
+ */
+static inline uint32_t rand_next(uint32_t * p_state)
+{
+    uint32_t s = *p_state;
+
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    *p_state = s;
+
+    return s;
+}
+
+static inline int32_t rand_uni(uint32_t * p_state, const int32_t lo, const int32_t hi)
+{
+    return lo + (int32_t)(rand_next(p_state) % (uint32_t)(hi - lo + 1));
+}
+
+/**
+ * @brief Roughly normal noise, the sum of four uniform draws.
+ */
+static int32_t rand_gauss(uint32_t * p_state, const int32_t sigma)
+{
+    int32_t s = 0;
+
+    for (uint32_t i = 0U; i < 4U; i++)
+    {
+        s += (int32_t)(rand_next(p_state) & 0xFFFFU);
+    }
+
+    return (int32_t)(((int64_t)(s - 131070) * sigma) / 37837);
+}
+
+static inline uint32_t window_seed(const uint32_t set, const uint32_t cls, const uint32_t index)
+{
+    return (((set << 16) | (cls << 12) | index) * 2654435761U) | 1U;
+}
+
+/**
+ * @brief Makes a window of a class: gravity in a random tilt, vibration
+ * along it, impacts for a fault and noise on every axis. synth() of the
+ * script.
+ */
+static void window_make(const enum motion_cls_class cls, uint32_t seed, motion_cls_window_t * p_window)
+{
+    const int32_t gx     = rand_uni(&seed, -300, 300);
+    const int32_t gy     = rand_uni(&seed, -300, 300);
+    int32_t       gz     = (int32_t)isqrt((uint32_t)(1000000 - (gx * gx) - (gy * gy)));
+    int32_t       amp    = 0;
+    int32_t       amp2   = 0;
+    int32_t       period = 0;
+    int32_t       impact = 0;
+    int32_t       sigma  = 4;
+    uint32_t      step   = 0U;
+    uint32_t      phase;
+    int32_t       offset = 0;
+
+    if ((rand_next(&seed) & 1U) != 0U)
+    {
+        gz = -gz;
+    }
+
+    if (cls == MOTION_CLS_IDLE)
+    {
+        amp   = rand_uni(&seed, 8, 30);
+        step  = (uint32_t)rand_uni(&seed, 70, 90) * 21474836U;  // 35 - 45 Hz in half Hz steps
+        sigma = 6;
+    }
+    else if (cls != MOTION_CLS_OFF)
+    {
+        amp   = rand_uni(&seed, 60, 250);
+        amp2  = amp / 4;
+        step  = (uint32_t)rand_uni(&seed, 16, 50) * 21474836U;  // 8 - 25 Hz
+        sigma = 12;
+        if (cls == MOTION_CLS_FAULT)
+        {
+            period = rand_uni(&seed, 6, 14);
+            impact = rand_uni(&seed, 250, 700);
+            sigma  = 40;
+        }
+    }
+
+    phase = rand_next(&seed);
+    if (period != 0)
+    {
+        offset = rand_uni(&seed, 0, period - 1);
+    }
+
+    for (int32_t i = 0; i < (int32_t)MOTION_CLS_WINDOW; i++)
+    {
+        int32_t s = ((sin_q15[phase >> 26] * amp) / 32767) + ((sin_q15[(phase * 2U) >> 26] * amp2) / 32767);
+
+        if ((period != 0) && (((i + offset) % period) < 4))
+        {
+            s += impact >> ((i + offset) % period);
+        }
+        phase += step;
+
+        // one draw after the other, the script draws in this order
+        p_window->x[i] = (int16_t)(gx + ((gx * s) / 1000) + rand_gauss(&seed, sigma));
+        p_window->y[i] = (int16_t)(gy + ((gy * s) / 1000) + rand_gauss(&seed, sigma));
+        p_window->z[i] = (int16_t)(gz + ((gz * s) / 1000) + rand_gauss(&seed, sigma));
+    }
+}
+
+/**
+ * @brief Runs the float net the int8 one was quantized from.
+ */
+static enum motion_cls_class infer_float(const int32_t * p_f, float * p_confidence)
+{
+    float    in[MOTION_CLS_MODEL_FEATURES];
+    float    hidden[MOTION_CLS_MODEL_HIDDEN];
+    float    logits[MOTION_CLS_MODEL_CLASSES];
+    float    total = 0.0f;
+    uint32_t best  = 0U;
+
+    for (uint32_t j = 0U; j < MOTION_CLS_MODEL_FEATURES; j++)
+    {
+        in[j] = ((float)p_f[j] - motion_cls_ref_mu[j]) / motion_cls_ref_sd[j];
+    }
+
+    for (uint32_t k = 0U; k < MOTION_CLS_MODEL_HIDDEN; k++)
+    {
+        float acc = motion_cls_ref_b1[k];
+
+        for (uint32_t j = 0U; j < MOTION_CLS_MODEL_FEATURES; j++)
+        {
+            acc += motion_cls_ref_w1[k][j] * in[j];
+        }
+        hidden[k] = MAX(acc, 0.0f);
+    }
+
+    for (uint32_t c = 0U; c < MOTION_CLS_MODEL_CLASSES; c++)
+    {
+        float acc = motion_cls_ref_b2[c];
+
+        for (uint32_t k = 0U; k < MOTION_CLS_MODEL_HIDDEN; k++)
+        {
+            acc += motion_cls_ref_w2[c][k] * hidden[k];
+        }
+        logits[c] = acc;
+
+        if (acc > logits[best])
+        {
+            best = c;
+        }
+    }
+
+    for (uint32_t c = 0U; c < MOTION_CLS_MODEL_CLASSES; c++)
+    {
+        total += expf(logits[c] - logits[best]);
+    }
+    *p_confidence = 1.0f / total;
+
+    return (enum motion_cls_class)best;
+}
+
+static void events_record(const motion_cls_event_t * p_evt, void * p_user_data)
+{
+    ARG_UNUSED(p_user_data);
+
+    if (event_count < EVENTS_MAX)
+    {
+        events[event_count] = *p_evt;
+    }
+    event_count++;
+}
+
+/**
+ * @brief Pushes windows of a class as samples, back to back, and lets the
+ * work queue classify every window before the next one is due.
+ */
+static void windows_push(const enum motion_cls_class cls, const uint32_t first, const uint32_t count)
+{
+    for (uint32_t w = first; w < (first + count); w++)
+    {
+        window_make(cls, window_seed(MOTION_CLS_REF_SET, cls, w), &window);
+
+        for (uint32_t n = 0U; n < MOTION_CLS_WINDOW; n++)
+        {
+            const accel_values_t sample = { .x = window.x[n], .y = window.y[n], .z = window.z[n] };
+
+            motion_cls_push(&sample);
+            if (((n + 1U) % MOTION_CLS_HOP) == 0U)
+            {
+                k_msleep(1);
+            }
+        }
+    }
+}
+
+ZTEST_SUITE(motion_cls, NULL, NULL, NULL, NULL, NULL);
+
+ZTEST(motion_cls, test_matches_script)
+{
+    uint32_t int8_correct    = 0U;
+    uint32_t float_correct   = 0U;
+    uint32_t agree           = 0U;
+    uint32_t int8_confidence = 0U;
+    uint32_t max_diff_pct    = 0U;
+
+    for (uint32_t cls = 0U; cls < MOTION_CLS_COUNT; cls++)
+    {
+        for (uint32_t i = 0U; i < MOTION_CLS_REF_WINDOWS; i++)
+        {
+            int32_t               features[MOTION_CLS_FEATURES];
+            enum motion_cls_class int8_cls;
+            enum motion_cls_class float_cls;
+            uint8_t               int8_pct;
+            float                 float_conf;
+
+            window_make((enum motion_cls_class)cls, window_seed(MOTION_CLS_REF_SET, cls, i), &window);
+            motion_cls_features(&window, features);
+            int8_cls  = motion_cls_infer(features, &int8_pct);
+            float_cls = infer_float(features, &float_conf);
+
+            int8_correct    += (int8_cls == (enum motion_cls_class)cls) ? 1U : 0U;
+            float_correct   += (float_cls == (enum motion_cls_class)cls) ? 1U : 0U;
+            agree           += (int8_cls == float_cls) ? 1U : 0U;
+            int8_confidence += int8_pct;
+
+            if (int8_cls == float_cls)
+            {
+                const int32_t float_pct = (int32_t)lroundf(100.0f * float_conf);
+
+                max_diff_pct = MAX(max_diff_pct, (uint32_t)abs(float_pct - (int32_t)int8_pct));
+            }
+        }
+    }
+
+    TC_PRINT("%u windows: int8 %u right, float %u right, %u agree, confidence within %u %%\n",
+             MOTION_CLS_COUNT * MOTION_CLS_REF_WINDOWS, int8_correct, float_correct, agree, max_diff_pct);
+
+    zassert_equal(int8_correct, MOTION_CLS_REF_INT8_CORRECT);
+    zassert_equal(int8_confidence, MOTION_CLS_REF_INT8_CONFIDENCE, "the int8 net does not mirror the script");
+    zassert_equal(float_correct, MOTION_CLS_REF_FLOAT_CORRECT);
+    zassert_equal(agree, MOTION_CLS_REF_AGREE);
+    zassert_true(max_diff_pct <= 5U, "int8 confidence %u %% off the float one", max_diff_pct);
+}
+
+ZTEST(motion_cls, test_stream_changes)
+{
+    const motion_cls_config_t config = { .lsb_per_g = TEST_LSB_PER_G, .handler = events_record };
+    motion_cls_stats_t        stats;
+
+    event_count = 0U;
+    zassert_ok(motion_cls_init(&config));
+
+    // a window every hop once the first one is full, the first class is reported too
+    windows_push(MOTION_CLS_OFF, 0U, 4U);
+    zassert_equal(event_count, 1U);
+    zassert_equal(events[0].cls, MOTION_CLS_OFF);
+
+    // the windows across the switch may go either way, the running ones confirm it
+    windows_push(MOTION_CLS_RUNNING, 0U, 4U);
+    zassert_true((event_count >= 2U) && (event_count <= EVENTS_MAX), "%u changes", event_count);
+    zassert_equal(events[event_count - 1U].cls, MOTION_CLS_RUNNING);
+
+    zassert_ok(motion_cls_stats_get(&stats));
+    zassert_equal(stats.windows, ((8U * MOTION_CLS_WINDOW) - MOTION_CLS_WINDOW) / MOTION_CLS_HOP + 1U);
+    zassert_equal(stats.changes, event_count);
+    zassert_equal(stats.dropped, 0U);
+
+    zassert_equal(motion_cls_init(NULL), -EINVAL);
+}
+
+ZTEST(motion_cls, test_window_time)
+{
+    uint32_t max_cycles   = 0U;
+    uint64_t total_cycles = 0U;
+    uint32_t windows      = 0U;
+
+    if (IS_ENABLED(CONFIG_ARCH_POSIX))
+    {
+        ztest_test_skip();
+    }
+
+    for (uint32_t cls = 0U; cls < MOTION_CLS_COUNT; cls++)
+    {
+        for (uint32_t i = 0U; i < MOTION_CLS_REF_WINDOWS; i++)
+        {
+            int32_t  features[MOTION_CLS_FEATURES];
+            uint8_t  pct;
+            uint32_t start;
+
+            window_make((enum motion_cls_class)cls, window_seed(MOTION_CLS_REF_SET, cls, i), &window);
+
+            start = k_cycle_get_32();
+            motion_cls_features(&window, features);
+            (void)motion_cls_infer(features, &pct);
+            const uint32_t cycles = k_cycle_get_32() - start;
+
+            max_cycles    = MAX(max_cycles, cycles);
+            total_cycles += cycles;
+            windows++;
+        }
+    }
+
+    const uint32_t max_us = k_cyc_to_us_floor32(max_cycles);
+
+    TC_PRINT("features and int8 net: avg %u us, max %u us per window\n",
+             (uint32_t)(k_cyc_to_us_floor64(total_cycles) / windows), max_us);
+
+    // a window has to be classified before the next one is handed over, a hop later
+    zassert_true(max_us < ((MOTION_CLS_HOP * 1000000U) / MOTION_CLS_MODEL_RATE_HZ), "%u us per window", max_us);
+}
@@ -0,0 +1,59 @@
+/**
+ * @file      motion_cls_model_ref.h
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Generated by scripts/motion_cls_train.py, do not edit. Float
+ *            dense net the int8 one of motion_cls_model.h was quantized
+ *            from, and what the script got for the windows of the test.
+ *
+ *            training: 1200 windows, int8 100.0 %, float 100.0 %, agreement 100.0 %
+ *            test: 256 windows, int8 100.0 %, float 100.0 %, agreement 100.0 %
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#ifndef MOTION_CLS_MODEL_REF_H_
+#define MOTION_CLS_MODEL_REF_H_
+
+#define MOTION_CLS_REF_SET     2   ///< seeds of the test windows, the training used 1
+#define MOTION_CLS_REF_WINDOWS 64  ///< test windows per class
+
+// what the script got for the test windows, motion_cls.c has to get the same
+#define MOTION_CLS_REF_INT8_CORRECT    256
+#define MOTION_CLS_REF_FLOAT_CORRECT   256
+#define MOTION_CLS_REF_AGREE           256
+#define MOTION_CLS_REF_INT8_CONFIDENCE 25566  ///< sum of the confidences in percent
+
+// float net the int8 one was quantized from
+static const float motion_cls_ref_mu[MOTION_CLS_MODEL_FEATURES] = { 7.78116667e+01f, 3.07419167e+02f, 2.98808333e+01f, 1.10252500e+02f, 1.28185833e+02f, 1.48236667e+02f, 1.52293333e+02f, 1.53208333e+01f };
+static const float motion_cls_ref_sd[MOTION_CLS_MODEL_FEATURES] = { 8.13871583e+01f, 3.39177562e+02f, 1.15209939e+01f, 2.69992360e+01f, 3.73839712e+01f, 4.45569933e+01f, 3.19098828e+01f, 8.35770499e+00f };
+static const float motion_cls_ref_w1[MOTION_CLS_MODEL_HIDDEN][MOTION_CLS_MODEL_FEATURES] = {
+    { 8.85763764e-01f, 9.50390448e-01f, 1.99392319e-01f, -6.73372448e-01f, -1.00877650e+00f, -5.13039856e-01f, -1.42686625e+00f, -3.68578039e-01f },
+    { -2.36028706e-01f, -2.47101689e-01f, 5.92644482e-01f, -7.82328449e-01f, -3.80905779e-01f, -5.38225637e-01f, -1.15861967e+00f, 4.30770940e-01f },
+    { -5.03752047e-01f, 1.98119582e+00f, 1.04474423e-01f, 1.84537790e-01f, 7.90708887e-01f, 3.22873335e-01f, 7.66188752e-01f, -8.33618938e-01f },
+    { 7.31767581e-02f, -3.43775271e-01f, 5.99474789e-01f, -1.27179178e-01f, -7.11314037e-01f, 2.86908206e-01f, 8.79156577e-01f, 6.84137376e-01f },
+    { -5.88408413e-01f, 1.32291346e+00f, 1.53668294e-01f, 2.64595789e-01f, 3.61502839e-01f, -4.05979110e-01f, 4.08698087e-02f, -8.88733425e-01f },
+    { 1.57535109e+00f, -4.85456648e-01f, 4.22157242e-02f, 3.43704170e-01f, -1.68267087e-01f, -6.08537734e-01f, 9.81815494e-01f, -2.97700043e-02f },
+    { 6.07623755e-01f, -3.62844661e-01f, -1.77489099e-01f, 3.37795910e-01f, 3.45849708e-01f, -9.46314988e-01f, -1.18018576e+00f, 1.11425872e-01f },
+    { 9.23472599e-01f, -9.80214794e-01f, -5.64898014e-01f, -1.41721144e-01f, 4.55257745e-02f, 1.12645222e+00f, -1.40524968e+00f, -2.43656010e-01f },
+    { 2.30582450e-01f, -1.62577729e-01f, -1.17296249e+00f, 1.49066811e-01f, -4.11024392e-01f, 3.79850874e-01f, 3.14967547e-01f, 1.94949695e-01f },
+    { 1.38737154e-01f, -3.30451572e-01f, 1.66996322e+00f, 1.79028707e-01f, -1.74365647e-03f, 2.62145733e-01f, -5.23154525e-01f, 2.77081515e-01f },
+    { 4.38393072e-01f, -2.86477035e-01f, 1.25255608e-01f, -1.80554647e-01f, -1.16788694e+00f, -2.00183002e-02f, -5.79250710e-01f, -3.31154108e-01f },
+    { -3.64220868e-01f, -2.58785844e-02f, 6.51138512e-01f, -2.85822573e-01f, 8.79493892e-02f, -1.11956744e+00f, 1.17652934e+00f, -1.26994254e-01f },
+    { 5.88474363e-01f, -9.43362947e-01f, -7.53158951e-01f, -7.55633653e-02f, 7.98703955e-01f, 6.28430583e-01f, -7.93482907e-01f, -5.19099639e-02f },
+    { 5.85236592e-01f, 5.43855064e-01f, -1.29644704e+00f, 2.87757970e-01f, -7.65916915e-01f, -8.68705792e-02f, -2.01131775e+00f, -2.02247039e-01f },
+    { -1.35031468e-01f, 6.06943169e-01f, 4.15250049e-01f, 6.34889591e-01f, 6.21619408e-01f, -6.05995738e-01f, 2.78820358e-01f, -1.21307935e+00f },
+    { -1.90413314e-01f, 9.41420533e-01f, -3.11023973e-01f, -7.45157419e-02f, 1.14664083e-01f, 2.47154056e-01f, 1.10861727e-01f, -5.60354424e-01f },
+};
+static const float motion_cls_ref_b1[MOTION_CLS_MODEL_HIDDEN] = { -5.70327757e-01f, 3.55627872e-01f, 2.17682261e-01f, 7.08468334e-01f, 1.63129185e-01f, 5.25306735e-01f, -5.27105105e-01f, 4.16511007e-01f, 5.16927640e-01f, 7.31048817e-01f, -4.53203328e-01f, 6.02906118e-01f, 5.39816929e-02f, 2.01784450e-01f, -1.47304565e-01f, 3.35175944e-01f };
+static const float motion_cls_ref_w2[MOTION_CLS_MODEL_CLASSES][MOTION_CLS_MODEL_HIDDEN] = {
+    { 1.84951653e+00f, 1.07705343e+00f, -6.22537972e-01f, -5.96761588e-01f, 1.42871380e-01f, 1.37544807e-01f, 8.61255259e-01f, 8.15727855e-02f, -2.65815425e-01f, -3.36234647e-01f, 8.70329488e-01f, -3.86028496e-01f, -7.66239485e-02f, 1.24385248e+00f, -4.62041439e-01f, -2.26865143e-01f },
+    { -7.03785768e-01f, 8.05301101e-01f, -8.08686328e-01f, 3.99872917e-01f, -6.00736448e-01f, -8.63908764e-01f, -5.63577498e-01f, -2.57591914e-01f, -1.32355867e-01f, 8.40092896e-01f, -9.36564521e-02f, 9.88842912e-01f, -3.79259769e-01f, -1.42054460e+00f, -3.92837587e-02f, 6.58003914e-01f },
+    { -1.26349317e-01f, -1.31796247e+00f, -5.62337996e-01f, 1.21248368e+00f, -1.13434420e+00f, 1.34771883e+00f, -1.81755756e-02f, 1.55134337e+00f, 9.54913989e-01f, -2.51679360e-01f, 1.75837713e-01f, 4.13831717e-01f, 1.04733752e+00f, 9.69581050e-01f, -7.56124413e-01f, 4.45995958e-01f },
+    { 6.31414151e-02f, -5.44914476e-01f, 1.76186841e+00f, -3.69533404e-01f, 1.01716564e+00f, -4.41738761e-01f, 9.21115098e-02f, -1.49100066e+00f, -2.27095645e-01f, -1.67275739e-01f, 5.18028097e-01f, -1.03880868e+00f, -8.01882326e-01f, -8.88652171e-01f, 6.88904137e-01f, 1.18256515e+00f },
+};
+static const float motion_cls_ref_b2[MOTION_CLS_MODEL_CLASSES] = { -1.05502468e+00f, 2.67606957e-01f, 1.09631480e+00f, -3.08897079e-01f };
+
+#endif // MOTION_CLS_MODEL_REF_H_
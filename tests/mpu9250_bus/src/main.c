@@ -0,0 +1,300 @@
+/**
+ * @file      main.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Sensor reads of the MPU over its TWI and SPI buses, on their
+ *            emulated targets. Both have to return the same registers, and
+ *            back to back reads of one sample of every sensor are timed on
+ *            each. The emulated buses spend the time the transfers would
+ *            take at their clocks, so the read times are those of fast mode
+ *            TWI and of SPI at the sensor read clock. The driver functions
+ *            on top of the buses are checked against the TWI target.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+#include "twi.h"
+#include "twi_emul.h"
+#include "mpu9250.h"
+#include "nrf_drv_mpu.h"
+#include "nrf_drv_mpu_spi_emul.h"
+#include "mpu9150_register_map.h"
+
+#define MPU_ADDRESS     0x68U
+#define MAGN_ADDRESS    0x0CU
+#define ABSENT_ADDRESS  0x69U                                 ///< second MPU, AD0 high, not on the emulated bus
+#define BENCH_READS     1000U
+#define TWI_BYTE_US     DIV_ROUND_UP(9U * 1000000U, 400000U)  ///< 9 clocks of fast mode
+#define SPI_OVERHEAD_US 2U                                    ///< chip select and DMA set-up of the emulated SPIM
+
+static uint8_t twi_registers[128];
+static uint8_t spi_registers[128];
+static uint8_t magn_registers[32];
+
+/**@brief Result of bus_time(). */
+typedef struct
+{
+    uint32_t errors;       ///< reads that failed
+    uint32_t read_us;      ///< average time of one read
+    uint32_t bytes_per_s;  ///< sensor bytes moved per second
+} bench_t;
+
+/**
+ * @brief Times back to back reads of one sample of every sensor over a bus.
+ *
+ * @param[in]  p_bus    bus
+ * @param[out] p_result timing of the reads
+ */
+static void bus_time(const nrf_drv_mpu_bus_t * p_bus, bench_t * p_result)
+{
+    const nrf_drv_mpu_t mpu = { .p_bus = p_bus, .address = MPU_ADDRESS };
+    uint8_t             raw_values[NRF_DRV_MPU_SAMPLE_BYTES];
+
+    *p_result = (bench_t){ 0 };
+    zassert_ok(nrf_drv_mpu_init(&mpu));
+
+    const int64_t start = k_uptime_ticks();
+
+    for (uint32_t i = 0U; i < BENCH_READS; i++)
+    {
+        if (nrf_drv_mpu_read_registers(&mpu, MPU_REG_ACCEL_XOUT_H, raw_values, sizeof(raw_values)) != 0)
+        {
+            p_result->errors++;
+        }
+    }
+
+    const uint64_t duration_us = k_ticks_to_us_floor64((uint64_t)(k_uptime_ticks() - start));
+
+    zassert_true(duration_us != 0U);
+    p_result->read_us     = (uint32_t)(duration_us / BENCH_READS);
+    p_result->bytes_per_s = (uint32_t)(((uint64_t)(BENCH_READS - p_result->errors) * sizeof(raw_values) * 1000000U) /
+                                       duration_us);
+}
+
+static void * mpu9250_bus_setup(void)
+{
+    static const twi_speed_profile_t profile = { .address = MPU_ADDRESS, .speed = TWI_SPEED_400K };
+
+    // one sample of every sensor, different on each bus so a read cannot come from the wrong one
+    for (uint8_t i = 0U; i < NRF_DRV_MPU_SAMPLE_BYTES; i++)
+    {
+        twi_registers[MPU_REG_ACCEL_XOUT_H + i] = (uint8_t)(0x10U + i);
+        spi_registers[MPU_REG_ACCEL_XOUT_H + i] = (uint8_t)(0x80U + i);
+    }
+
+    zassert_ok(twi_emul_target_add(MPU_ADDRESS, twi_registers, sizeof(twi_registers)));
+    zassert_ok(twi_emul_target_add(MAGN_ADDRESS, magn_registers, sizeof(magn_registers)));
+    nrf_drv_mpu_spi_emul_registers_set(spi_registers, NULL);
+    zassert_ok(twi_init(0U, 0U));
+    zassert_ok(twi_speed_profiles_set(&profile, 1U));
+    zassert_ok(twi_enable());
+
+    return NULL;
+}
+
+ZTEST_SUITE(mpu9250_bus, NULL, mpu9250_bus_setup, NULL, NULL, NULL);
+
+ZTEST(mpu9250_bus, test_reads_match)
+{
+    static const struct
+    {
+        const nrf_drv_mpu_bus_t * p_bus;
+        const uint8_t *           p_registers;
+    } buses[] = {
+        { &nrf_drv_mpu_bus_twi, twi_registers },
+        { &nrf_drv_mpu_bus_spi, spi_registers },
+    };
+
+    for (uint8_t i = 0U; i < ARRAY_SIZE(buses); i++)
+    {
+        const nrf_drv_mpu_t mpu = { .p_bus = buses[i].p_bus, .address = MPU_ADDRESS };
+        uint8_t             raw_values[NRF_DRV_MPU_SAMPLE_BYTES];
+
+        zassert_ok(nrf_drv_mpu_init(&mpu));
+        zassert_ok(nrf_drv_mpu_read_registers(&mpu, MPU_REG_ACCEL_XOUT_H, raw_values, sizeof(raw_values)));
+        zassert_mem_equal(raw_values, &buses[i].p_registers[MPU_REG_ACCEL_XOUT_H], sizeof(raw_values),
+                          "%s read other registers", buses[i].p_bus->p_name);
+    }
+}
+
+ZTEST(mpu9250_bus, test_spi_faster)
+{
+    bench_t twi;
+    bench_t spi;
+
+    // TWI first, the SPI bus switches the MPU to SPI only
+    bus_time(&nrf_drv_mpu_bus_twi, &twi);
+    bus_time(&nrf_drv_mpu_bus_spi, &spi);
+
+    TC_PRINT("twi: %u reads of %u bytes, %u us per read, %u bytes/s\n", BENCH_READS, NRF_DRV_MPU_SAMPLE_BYTES,
+             twi.read_us, twi.bytes_per_s);
+    TC_PRINT("spi: %u reads of %u bytes, %u us per read, %u bytes/s\n", BENCH_READS, NRF_DRV_MPU_SAMPLE_BYTES,
+             spi.read_us, spi.bytes_per_s);
+
+    zassert_equal(twi.errors, 0U);
+    zassert_equal(spi.errors, 0U);
+
+    // address, register, repeated start and the sample on TWI, the address byte and the sample on SPI
+    zassert_within(twi.read_us, (NRF_DRV_MPU_SAMPLE_BYTES + 3U) * TWI_BYTE_US, 1U, "twi read took %u us",
+                   twi.read_us);
+    zassert_within(spi.read_us,
+                   SPI_OVERHEAD_US + DIV_ROUND_UP((NRF_DRV_MPU_SAMPLE_BYTES + 1U) * 8U * 1000000U,
+                                                  CONFIG_APP_MPU9250_SPI_READ_HZ),
+                   1U, "spi read took %u us", spi.read_us);
+    zassert_true((spi.read_us * 10U) < twi.read_us, "spi %u us, twi %u us", spi.read_us, twi.read_us);
+}
+
+ZTEST(mpu9250_bus, test_mpu9150_only_detectors)
+{
+    app_mpu_t mpu = { .drv = { .p_bus = &nrf_drv_mpu_bus_twi, .address = MPU_ADDRESS } };
+
+    zassert_ok(nrf_drv_mpu_init(&mpu.drv));
+
+    // ACCEL_CONFIG2, LP_ACCEL_ODR, WOM_THR and the registers after them on the MPU9250
+    memset(&twi_registers[MPU_REG_FF_THR], 0x5A, (MPU_REG_ZRMOT_DUR - MPU_REG_FF_THR) + 1U);
+    twi_registers[MPU_REG_WHO_AM_I] = MPU_WHO_AM_I_MPU9250;
+
+    zassert_equal(app_mpu_config_ff_detection(&mpu, 100U, 10U), -ENOTSUP);
+    zassert_equal(app_mpu_config_motion_detection(&mpu, 100U, 1U), -ENOTSUP);
+    zassert_equal(app_mpu_config_zero_motion_detection(&mpu, 100U, 640U), -ENOTSUP);
+    for (uint8_t reg = MPU_REG_FF_THR; reg <= MPU_REG_ZRMOT_DUR; reg++)
+    {
+        zassert_equal(twi_registers[reg], 0x5AU, "register 0x%02X written on an MPU9250", reg);
+    }
+
+    twi_registers[MPU_REG_WHO_AM_I] = MPU_WHO_AM_I_MPU9150;
+
+    zassert_ok(app_mpu_config_ff_detection(&mpu, 100U, 10U));
+    zassert_ok(app_mpu_config_motion_detection(&mpu, 100U, 1U));
+    zassert_ok(app_mpu_config_zero_motion_detection(&mpu, 100U, 640U));
+    zassert_equal(twi_registers[MPU_REG_FF_THR], 100U / MPU_MG_PR_LSB_FF_THR);
+    zassert_equal(twi_registers[MPU_REG_FF_DUR], 10U);
+    zassert_equal(twi_registers[MPU_REG_MOT_THR], 100U / MPU_MG_PR_LSB_MOT_THR);
+    zassert_equal(twi_registers[MPU_REG_MOT_DUR], 1U);
+    zassert_equal(twi_registers[MPU_REG_ZRMOT_THR], 100U / MPU_MG_PR_LSB_MOT_THR);
+    zassert_equal(twi_registers[MPU_REG_ZRMOT_DUR], 640U / MPU_MS_PR_LSB_ZRMOT);
+}
+
+/**
+ * @brief Puts a measurement into the emulated magnetometer, ST1, HXL..HZH and
+ * ST2.
+ */
+static void magn_measurement_set(const uint8_t st1, const int16_t * p_values, const uint8_t st2)
+{
+    magn_registers[MPU_AK89XX_REG_ST1] = st1;
+    for (uint8_t i = 0U; i < 3U; i++)
+    {
+        sys_put_le16((uint16_t)p_values[i], &magn_registers[MPU_AK89XX_REG_HXL + (2U * i)]);
+    }
+    magn_registers[MPU_AK89XX_REG_ST2] = st2;
+}
+
+ZTEST(mpu9250_bus, test_magnetometer_cntl)
+{
+    app_mpu_t             mpu    = { .drv = { .p_bus = &nrf_drv_mpu_bus_twi, .address = MPU_ADDRESS,
+                                              .magn_address = MAGN_ADDRESS } };
+    app_mpu_magn_config_t config = { .mode = CONTINUOUS_MEASUREMENT_8Hz_MODE, .resolution = MAGN_RESOLUTION_14_BIT };
+
+    // 16-bit output unless the node asks for 14, in the bring-up sequence too
+    zassert_equal(APP_MPU_DEFAULT->magn_cntl, MPU_AK89XX_CNTL_BIT | CONTINUOUS_MEASUREMENT_100Hz_MODE);
+    zassert_equal(APP_MPU_DEFAULT->magn_regseq_device.p_sequence[1].value, APP_MPU_DEFAULT->magn_cntl);
+
+    // a configuration given at run time replaces it, in the bring-up sequence as well
+    zassert_ok(nrf_drv_mpu_init(&mpu.drv));
+    zassert_ok(app_mpu_magnetometer_init(&mpu, &config));
+    zassert_equal(magn_registers[MPU_AK89XX_REG_CNTL], CONTINUOUS_MEASUREMENT_8Hz_MODE);
+    zassert_equal(mpu.magn_cntl, CONTINUOUS_MEASUREMENT_8Hz_MODE);
+    zassert_equal(mpu.magn_init_sequence[1].value, CONTINUOUS_MEASUREMENT_8Hz_MODE);
+}
+
+ZTEST(mpu9250_bus, test_magnetometer_decode)
+{
+    app_mpu_t                  mpu      = { .drv = { .p_bus = &nrf_drv_mpu_bus_twi, .address = MPU_ADDRESS,
+                                                       .magn_address = MAGN_ADDRESS } };
+    app_mpu_magn_config_t      config   = { .mode = CONTINUOUS_MEASUREMENT_100Hz_MODE,
+                                            .resolution = MAGN_RESOLUTION_16_BIT };
+    const int16_t              raw[3]   = { 1000, -1000, 30000 };
+    const magn_values_t        previous = { .x = 1, .y = 2, .z = 3 };
+    magn_values_t              values;
+    app_mpu_magn_read_status_t status;
+
+    // adjustments of 1, 0.5 and 383 / 256
+    magn_registers[MPU_AK89XX_REG_WIA]  = MPU_AK89XX_WIA_VALUE;
+    magn_registers[MPU_AK89XX_REG_ASAX] = 128U;
+    magn_registers[MPU_AK89XX_REG_ASAY] = 0U;
+    magn_registers[MPU_AK89XX_REG_ASAZ] = 255U;
+
+    zassert_ok(nrf_drv_mpu_init(&mpu.drv));
+    zassert_ok(app_mpu_magnetometer_init(&mpu, &config));
+    zassert_equal(magn_registers[MPU_AK89XX_REG_CNTL], MPU_AK89XX_CNTL_BIT | CONTINUOUS_MEASUREMENT_100Hz_MODE);
+    zassert_true(mpu.magn_asa_loaded);
+
+    // a new measurement, ASA applied and clamped to the 16-bit range
+    magn_measurement_set(MPU_AK89XX_ST1_DRDY | MPU_AK89XX_ST1_DOR, raw, MPU_AK89XX_ST2_BITM);
+    zassert_ok(app_mpu_read_magnetometer(&mpu, &values, &status));
+    zassert_equal(values.x, 1000);
+    zassert_equal(values.y, -500);
+    zassert_equal(values.z, INT16_MAX);
+    zassert_equal(status.data_overrun, 1U);
+    zassert_equal(status.overflow, 0U);
+    zassert_equal(status.res_mirror, 1U);
+
+    // no new measurement, the values are left alone
+    values = previous;
+    magn_measurement_set(0U, raw, MPU_AK89XX_ST2_BITM);
+    zassert_equal(app_mpu_read_magnetometer(&mpu, &values, &status), -ENODATA);
+    zassert_mem_equal(&values, &previous, sizeof(values));
+    zassert_equal(status.data_overrun, 0U);
+
+    // an overflowed measurement is reported and not decoded
+    magn_measurement_set(MPU_AK89XX_ST1_DRDY, raw, MPU_AK89XX_ST2_HOFL | MPU_AK89XX_ST2_BITM);
+    zassert_equal(app_mpu_read_magnetometer(&mpu, &values, &status), -ERANGE);
+    zassert_mem_equal(&values, &previous, sizeof(values));
+    zassert_equal(status.overflow, 1U);
+}
+
+ZTEST(mpu9250_bus, test_read_multi_partial_failure)
+{
+    app_mpu_t            present    = { .drv = { .p_bus = &nrf_drv_mpu_bus_twi, .address = MPU_ADDRESS } };
+    app_mpu_t            absent     = { .drv = { .p_bus = &nrf_drv_mpu_bus_twi, .address = ABSENT_ADDRESS } };
+    const accel_values_t kept_accel = { .x = 7, .y = 7, .z = 7 };
+    const gyro_values_t  kept_gyro  = { .x = 9, .y = 9, .z = 9 };
+
+    zassert_ok(nrf_drv_mpu_init(&present.drv));
+
+    // the MPU that does not answer first and last, the other one is read either way
+    for (uint8_t failed = 0U; failed < 2U; failed++)
+    {
+        app_mpu_t * const mpus[2]  = { (failed == 0U) ? &absent : &present, (failed == 0U) ? &present : &absent };
+        const uint8_t     read     = 1U - failed;
+        accel_values_t    accel[2] = { kept_accel, kept_accel };
+        gyro_values_t     gyro[2]  = { kept_gyro, kept_gyro };
+        int               errs[2]  = { 1, 1 };
+        int               err;
+
+        err = app_mpu_read_multi(mpus, 2U, accel, gyro, errs);
+
+        zassert_not_equal(errs[failed], 0);
+        zassert_equal(err, errs[failed]);
+        zassert_equal(errs[read], 0);
+        zassert_mem_equal(&accel[failed], &kept_accel, sizeof(kept_accel), "slot %u of a failed MPU changed", failed);
+        zassert_mem_equal(&gyro[failed], &kept_gyro, sizeof(kept_gyro), "slot %u of a failed MPU changed", failed);
+
+        // big endian, the temperature between the accelerometer and the gyroscopes
+        zassert_equal(accel[read].x, 0x1011);
+        zassert_equal(accel[read].y, 0x1213);
+        zassert_equal(accel[read].z, 0x1415);
+        zassert_equal(gyro[read].x, 0x1819);
+        zassert_equal(gyro[read].y, 0x1A1B);
+        zassert_equal(gyro[read].z, 0x1C1D);
+    }
+
+    zassert_equal(app_mpu_read_multi((app_mpu_t * const[]){ &present }, 1U, (accel_values_t[1]){ 0 }, NULL, NULL),
+                  -EINVAL);
+}
@@ -0,0 +1,455 @@
+/**
+ * @file      main.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Replays a motion trace of an asset through the output data rate
+ *            controller. The trace is served by the LIS2DH12 on the emulated
+ *            bus and read at the rate the controller asks for, every byte on
+ *            the bus is counted through the TWI tap. The same trace read at
+ *            the fixed full rate is the baseline the saved bytes/s are
+ *            measured against. The MPU on the same bus checks the registers
+ *            each part is put to sleep with.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "odr_ctrl.h"
+#include "twi.h"
+#include "twi_emul.h"
+
+#define LSB_PER_G        16384U  ///< left-aligned output at +-2 g
+#define ACTIVE_RATE_HZ   100U
+#define IDLE_RATE_HZ     10U
+#define IDLE_AFTER_MS    2000U
+#define THRESHOLD_MG     100U
+#define BYTES_PER_SAMPLE 10U     ///< address, register, repeated start, STATUS_REG and the 6 output bytes
+#define NOISE_MG         8       ///< sensor noise at rest, well below the threshold
+
+/**@brief Kinds of motion in the trace. */
+enum trace_motion
+{
+    TRACE_STILL = 0,  ///< gravity and noise
+    TRACE_CARRY,      ///< slow swings of a few hundred mg
+    TRACE_VIBRATION,  ///< fast vibration of a running machine
+};
+
+/**@brief A stretch of the trace with one kind of motion. */
+typedef struct
+{
+    enum trace_motion motion;
+    uint32_t          duration_ms;
+} trace_segment_t;
+
+/**
+ * @brief Handling of an asset over about a minute: stored, carried, set down
+ * for less than the idle time, carried again, parked, shaken by a machine
+ * and moved once more.
+ */
+static const trace_segment_t motion_trace[] = {
+    { TRACE_STILL,     12000U },
+    { TRACE_CARRY,      4000U },
+    { TRACE_STILL,      1500U },
+    { TRACE_CARRY,      3000U },
+    { TRACE_STILL,     20000U },
+    { TRACE_VIBRATION,  2500U },
+    { TRACE_STILL,     15000U },
+    { TRACE_CARRY,      1000U },
+    { TRACE_STILL,      6000U },
+};
+
+/**@brief Result of one replay. */
+typedef struct
+{
+    uint32_t duration_ms;     ///< length of the trace
+    uint32_t samples;         ///< samples read
+    uint64_t bus_bytes;       ///< bytes on the bus, configuration writes included
+    uint32_t max_wake_ms;     ///< longest time from the start of motion to the full rate
+    uint32_t transitions;     ///< changes of the state seen by the callback
+} replay_result_t;
+
+static uint8_t  lis2dh12_registers[128];
+static uint8_t  mpu_registers[128];
+static uint64_t bus_bytes      = 0U;
+static int64_t  replay_now_ms  = 0;   ///< timestamp of the sample being fed
+static int64_t  motion_since   = -1;  ///< start of the motion segment being replayed, -1 while still
+static uint32_t max_wake_ms    = 0U;
+static uint32_t transitions    = 0U;
+static uint32_t rand_state     = 0x2545F491U;
+
+/**
+ * @brief Counts the bytes of every transfer on the bus, see twi_port_xfer_t.
+ */
+static void bus_tap(const twi_port_xfer_t * p_xfer, int err)
+{
+    ARG_UNUSED(err);
+
+    bus_bytes += 1U + p_xfer->length;
+    if (p_xfer->has_reg)
+    {
+        bus_bytes += p_xfer->read ? 2U : 1U;
+    }
+}
+
+static void state_changed(enum odr_ctrl_state state)
+{
+    transitions++;
+
+    if ((state == ODR_CTRL_ACTIVE) && (motion_since >= 0))
+    {
+        max_wake_ms = MAX(max_wake_ms, (uint32_t)(replay_now_ms - motion_since));
+    }
+}
+
+/**
+ * @brief Triangle wave starting at its negative peak.
+ */
+static int32_t triangle_mg(const uint32_t t_ms, const uint32_t period_ms, const int32_t amplitude_mg)
+{
+    const int32_t phase = (int32_t)(t_ms % period_ms);
+    const int32_t half  = (int32_t)period_ms / 2;
+
+    return (phase < half) ? (-amplitude_mg + ((4 * amplitude_mg * phase) / (int32_t)period_ms))
+                          : ((3 * amplitude_mg) - ((4 * amplitude_mg * phase) / (int32_t)period_ms));
+}
+
+static int32_t noise_mg(void)
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+
+    return (int32_t)(rand_state % (2U * NOISE_MG + 1U)) - NOISE_MG;
+}
+
+/**
+ * @brief Acceleration of the trace at a time, in mg.
+ *
+ * @param[in]  t_ms      time from the start of the trace
+ * @param[out] p_mg      x, y and z
+ * @param[out] p_moving  the segment is not still
+ * @param[out] p_seg_ms  start of the segment
+ *
+ * @return false past the end of the trace
+ */
+static bool trace_sample(const uint32_t t_ms, int32_t * p_mg, bool * p_moving, uint32_t * p_seg_ms)
+{
+    uint32_t start_ms = 0U;
+
+    for (uint8_t i = 0U; i < ARRAY_SIZE(motion_trace); i++)
+    {
+        if (t_ms < (start_ms + motion_trace[i].duration_ms))
+        {
+            const uint32_t in_ms = t_ms - start_ms;
+
+            p_mg[0] = noise_mg();
+            p_mg[1] = noise_mg();
+            p_mg[2] = 1000 + noise_mg();
+
+            switch (motion_trace[i].motion)
+            {
+                case TRACE_CARRY:
+                    p_mg[0] += triangle_mg(in_ms, 600U, 400);
+                    p_mg[1] += triangle_mg(in_ms, 900U, 150);
+                    break;
+                case TRACE_VIBRATION:
+                    p_mg[2] += triangle_mg(in_ms, 140U, 400);
+                    break;
+                default:
+                    break;
+            }
+
+            *p_moving = (motion_trace[i].motion != TRACE_STILL);
+            *p_seg_ms = start_ms;
+            return true;
+        }
+        start_ms += motion_trace[i].duration_ms;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Length of the trace.
+ */
+static uint32_t trace_ms(void)
+{
+    uint32_t total_ms = 0U;
+
+    for (uint8_t i = 0U; i < ARRAY_SIZE(motion_trace); i++)
+    {
+        total_ms += motion_trace[i].duration_ms;
+    }
+
+    return total_ms;
+}
+
+/**
+ * @brief Puts a sample into the output registers of the emulated LIS2DH12.
+ */
+static void lis2dh12_sample_set(const int32_t * p_mg)
+{
+    lis2dh12_registers[LIS2DH12_STATUS_REG] = LIS2DH12_STATUS_ZYXDA;
+
+    for (uint8_t i = 0U; i < 3U; i++)
+    {
+        const int16_t raw = (int16_t)((p_mg[i] * (int32_t)LSB_PER_G) / 1000);
+
+        lis2dh12_registers[LIS2DH12_OUT_X_L + (2U * i)]      = (uint8_t)((uint16_t)raw & 0xFFU);
+        lis2dh12_registers[LIS2DH12_OUT_X_L + (2U * i) + 1U] = (uint8_t)((uint16_t)raw >> 8);
+    }
+}
+
+/**
+ * @brief Replays the trace, read at the rate the controller asks for or at
+ * the full rate all along.
+ *
+ * @param[in]  adaptive  feed the controller and follow its state
+ * @param[out] p_result  bytes and timing of the replay
+ */
+static void replay(const bool adaptive, replay_result_t * p_result)
+{
+    const odr_ctrl_config_t config = {
+        .motion_threshold_mg = THRESHOLD_MG,
+        .idle_after_ms       = IDLE_AFTER_MS,
+        .lsb_per_g           = LSB_PER_G,
+        .use_lis2dh12        = true,
+        .lis2dh12_active_odr = LIS2DH12_ODR_100HZ,
+        .lis2dh12_idle_odr   = LIS2DH12_ODR_10HZ,
+        .use_mpu             = false,
+        .active_rate_hz      = ACTIVE_RATE_HZ,
+        .idle_rate_hz        = IDLE_RATE_HZ,
+        .bytes_per_sample    = BYTES_PER_SAMPLE,
+        .state_changed       = state_changed,
+    };
+    int64_t        start_ms;
+    accel_values_t accel;
+    int32_t        mg[3];
+    bool           moving;
+    uint32_t       seg_ms;
+    uint32_t       t_ms     = 0U;
+
+    max_wake_ms  = 0U;
+    transitions  = 0U;
+    motion_since = -1;
+    rand_state   = 0x2545F491U;
+    *p_result    = (replay_result_t){ 0 };
+
+    if (adaptive)
+    {
+        zassert_ok(odr_ctrl_init(&config));
+    }
+    start_ms  = k_uptime_get();
+    bus_bytes = 0U;
+
+    while (trace_sample(t_ms, mg, &moving, &seg_ms))
+    {
+        replay_now_ms = start_ms + t_ms;
+        motion_since  = moving ? (start_ms + seg_ms) : -1;
+
+        lis2dh12_sample_set(mg);
+        zassert_ok(lis2dh12_read_accel(LIS2DH12_DEFAULT, &accel));
+        p_result->samples++;
+
+        if (adaptive)
+        {
+            zassert_ok(odr_ctrl_feed(&accel, replay_now_ms));
+        }
+
+        t_ms += 1000U / ((adaptive && (odr_ctrl_state_get() == ODR_CTRL_IDLE)) ? IDLE_RATE_HZ : ACTIVE_RATE_HZ);
+    }
+
+    p_result->duration_ms = MIN(t_ms, trace_ms());
+    p_result->bus_bytes   = bus_bytes;
+    p_result->max_wake_ms = max_wake_ms;
+    p_result->transitions = transitions;
+}
+
+/**
+ * @brief Idle time the trace allows: every still segment longer than the
+ * idle time, less the idle time.
+ */
+static uint32_t trace_idle_ms(void)
+{
+    uint32_t idle_ms = 0U;
+
+    for (uint8_t i = 0U; i < ARRAY_SIZE(motion_trace); i++)
+    {
+        if ((motion_trace[i].motion == TRACE_STILL) && (motion_trace[i].duration_ms > IDLE_AFTER_MS))
+        {
+            idle_ms += motion_trace[i].duration_ms - IDLE_AFTER_MS;
+        }
+    }
+
+    return idle_ms;
+}
+
+/**
+ * @brief Runs the controller on the MPU alone, from full rate to idle, with
+ * the given WHO_AM_I.
+ *
+ * @param[in] who_am_i WHO_AM_I the emulated MPU answers with
+ *
+ * @return time of the first sample fed
+ */
+static int64_t mpu_to_idle(const uint8_t who_am_i)
+{
+    const odr_ctrl_config_t config = {
+        .motion_threshold_mg = THRESHOLD_MG,
+        .idle_after_ms       = IDLE_AFTER_MS,
+        .lsb_per_g           = LSB_PER_G,
+        .use_lis2dh12        = false,
+        .use_mpu             = true,
+        .mpu_active_div      = 9U,
+        .mpu_wake_rate       = LP_WAKE_5HZ,
+        .mpu_wom_odr         = LP_ACCEL_ODR_15_63HZ,
+        .active_rate_hz      = ACTIVE_RATE_HZ,
+        .idle_rate_hz        = IDLE_RATE_HZ,
+        .bytes_per_sample    = BYTES_PER_SAMPLE,
+    };
+    const accel_values_t still = { .x = 0, .y = 0, .z = (int16_t)LSB_PER_G };
+    int64_t              start_ms;
+
+    memset(mpu_registers, 0, sizeof(mpu_registers));
+    mpu_registers[MPU_REG_WHO_AM_I]   = who_am_i;
+    mpu_registers[MPU_REG_PWR_MGMT_1] = 0x01U;
+    mpu_registers[MPU_REG_INT_ENABLE] = MPU_INT_ENABLE_DATA_RDY;
+
+    zassert_ok(odr_ctrl_init(&config));
+    zassert_equal(mpu_registers[MPU_REG_SMPLRT_DIV], 9U);
+
+    start_ms = k_uptime_get();
+    zassert_ok(odr_ctrl_feed(&still, start_ms));
+    zassert_ok(odr_ctrl_feed(&still, start_ms + IDLE_AFTER_MS));
+    zassert_equal(odr_ctrl_state_get(), ODR_CTRL_IDLE);
+    zassert_equal(mpu_registers[MPU_REG_PWR_MGMT_1], 0x01U | MPU_PWR_MGMT_1_CYCLE | MPU_PWR_MGMT_1_TEMP_DIS);
+
+    return start_ms;
+}
+
+/**
+ * @brief Brings the controller back to full rate and checks the MPU left its
+ * cycle mode.
+ *
+ * @param[in] start_ms time returned by mpu_to_idle()
+ */
+static void mpu_back_to_active(const int64_t start_ms)
+{
+    const accel_values_t moving = { .x = (int16_t)(LSB_PER_G / 2U), .y = 0, .z = (int16_t)LSB_PER_G };
+
+    zassert_ok(odr_ctrl_feed(&moving, start_ms + IDLE_AFTER_MS + 100));
+    zassert_equal(odr_ctrl_state_get(), ODR_CTRL_ACTIVE);
+    zassert_equal(mpu_registers[MPU_REG_PWR_MGMT_1], 0x01U);
+    zassert_equal(mpu_registers[MPU_REG_PWR_MGMT_2], 0U);
+}
+
+static void * odr_ctrl_setup(void)
+{
+    mpu_registers[MPU_REG_WHO_AM_I] = MPU_WHO_AM_I_MPU9250;
+
+    zassert_ok(twi_emul_target_add(LIS2DH12_DEFAULT->address, lis2dh12_registers, sizeof(lis2dh12_registers)));
+    zassert_ok(twi_emul_target_add(APP_MPU_DEFAULT->drv.address, mpu_registers, sizeof(mpu_registers)));
+    zassert_ok(twi_init(0U, 0U));
+    zassert_ok(twi_enable());
+    zassert_ok(app_mpu_init(APP_MPU_DEFAULT));
+    twi_tap_set(bus_tap);
+
+    return NULL;
+}
+
+ZTEST_SUITE(odr_ctrl, NULL, odr_ctrl_setup, NULL, NULL, NULL);
+
+ZTEST(odr_ctrl, test_trace_bytes_saved)
+{
+    replay_result_t  baseline;
+    replay_result_t  adaptive;
+    odr_ctrl_stats_t stats;
+
+    replay(false, &baseline);
+    replay(true, &adaptive);
+    zassert_ok(odr_ctrl_stats_get(&stats, replay_now_ms));
+
+    zassert_equal(baseline.duration_ms, adaptive.duration_ms);
+    zassert_equal(baseline.bus_bytes, (uint64_t)baseline.samples * BYTES_PER_SAMPLE);
+
+    // measured on the bus, the configuration written on every transition included
+    const uint32_t measured = (uint32_t)(((baseline.bus_bytes - adaptive.bus_bytes) * 1000U) / adaptive.duration_ms);
+    // the rate saved over the idle time the trace allows
+    const uint32_t expected = (uint32_t)(((uint64_t)trace_idle_ms() * (ACTIVE_RATE_HZ - IDLE_RATE_HZ) *
+                                          BYTES_PER_SAMPLE) / adaptive.duration_ms);
+
+    TC_PRINT("baseline %u B/s, adaptive %u B/s\n",
+             (uint32_t)((baseline.bus_bytes * 1000U) / baseline.duration_ms),
+             (uint32_t)((adaptive.bus_bytes * 1000U) / adaptive.duration_ms));
+    TC_PRINT("saved: measured %u B/s, reported %u B/s, expected %u B/s, %u transitions\n", measured,
+             stats.avg_bytes_per_s_saved, expected, stats.transitions);
+
+    zassert_within(measured, expected, expected / 10U, "measured %u B/s, expected %u B/s", measured, expected);
+    zassert_within(stats.avg_bytes_per_s_saved, measured, measured / 20U, "reported %u B/s, measured %u B/s",
+                   stats.avg_bytes_per_s_saved, measured);
+    zassert_equal(stats.errors, 0U);
+}
+
+ZTEST(odr_ctrl, test_trace_transitions)
+{
+    replay_result_t  adaptive;
+    odr_ctrl_stats_t stats;
+    uint32_t         expected = 0U;
+
+    replay(true, &adaptive);
+    zassert_ok(odr_ctrl_stats_get(&stats, replay_now_ms));
+
+    // down in every still segment longer than the idle time, up again in the motion that follows it
+    for (uint8_t i = 0U; i < ARRAY_SIZE(motion_trace); i++)
+    {
+        if ((motion_trace[i].motion == TRACE_STILL) && (motion_trace[i].duration_ms > IDLE_AFTER_MS))
+        {
+            expected += (i < (ARRAY_SIZE(motion_trace) - 1U)) ? 2U : 1U;
+        }
+    }
+
+    zassert_equal(adaptive.transitions, expected);
+    zassert_equal(stats.transitions, expected);
+    zassert_equal(odr_ctrl_state_get(), ODR_CTRL_IDLE);
+
+    // motion is caught by one of the next two reads at the low rate
+    TC_PRINT("longest wake-up %u ms\n", adaptive.max_wake_ms);
+    zassert_true(adaptive.max_wake_ms <= (2U * 1000U / IDLE_RATE_HZ), "wake-up took %u ms", adaptive.max_wake_ms);
+}
+
+ZTEST(odr_ctrl, test_mpu9250_wake_on_motion)
+{
+    const int64_t start_ms = mpu_to_idle(MPU_WHO_AM_I_MPU9250);
+
+    // 4 mg per LSB, the wake-up rate in LP_ACCEL_ODR and the gyroscopes in standby
+    zassert_equal(mpu_registers[MPU_REG_WOM_THR], THRESHOLD_MG / 4U);
+    zassert_equal(mpu_registers[MPU_REG_ACCEL_INTEL_CTRL], MPU_ACCEL_INTEL_EN_CMP);
+    zassert_equal(mpu_registers[MPU_REG_LP_ACCEL_ODR], LP_ACCEL_ODR_15_63HZ);
+    zassert_equal(mpu_registers[MPU_REG_INT_ENABLE], MPU_INT_ENABLE_WOM | MPU_INT_ENABLE_DATA_RDY);
+    zassert_equal(mpu_registers[MPU_REG_PWR_MGMT_2], MPU_PWR_MGMT_2_STBY_G);
+    // MOT_DUR of the MPU9150 is not written
+    zassert_equal(mpu_registers[MPU_REG_MOT_DUR], 0U);
+
+    mpu_back_to_active(start_ms);
+    zassert_equal(mpu_registers[MPU_REG_ACCEL_INTEL_CTRL], 0U);
+    zassert_equal(mpu_registers[MPU_REG_INT_ENABLE], MPU_INT_ENABLE_DATA_RDY);
+}
+
+ZTEST(odr_ctrl, test_mpu9150_motion_detection)
+{
+    const int64_t start_ms = mpu_to_idle(MPU_WHO_AM_I_MPU9150);
+
+    // 2 mg per LSB, the wake-up rate in LP_WAKE_CTRL, no MPU9250 register written
+    zassert_equal(mpu_registers[MPU_REG_MOT_THR], THRESHOLD_MG / 2U);
+    zassert_equal(mpu_registers[MPU_REG_MOT_DUR], 1U);
+    zassert_equal(mpu_registers[MPU_REG_PWR_MGMT_2], (LP_WAKE_5HZ << 6) | MPU_PWR_MGMT_2_STBY_G);
+    zassert_equal(mpu_registers[MPU_REG_LP_ACCEL_ODR], 0U);
+    zassert_equal(mpu_registers[MPU_REG_ACCEL_INTEL_CTRL], 0U);
+    zassert_equal(mpu_registers[MPU_REG_INT_ENABLE], MPU_INT_ENABLE_DATA_RDY);
+
+    mpu_back_to_active(start_ms);
+}
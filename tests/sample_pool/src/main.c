@@ -0,0 +1,187 @@
+/**
+ * @file      main.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Lifetime of the reference counted sample blocks. One
+ *            subscriber keeps the blocks it is given until the test lets
+ *            go of them, the others release them right away. A published
+ *            block has to reach every subscriber as the same block, stay
+ *            allocated while any reference is held and go back to the pool
+ *            with the last one. The pool running dry has to fail the
+ *            allocation and count it, and the high-water mark has to follow
+ *            the blocks in use.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "sample_pool.h"
+
+#define DROPPERS (SAMPLE_POOL_MAX_SUBSCRIBERS - 1U)
+
+static sample_block_t * held[SAMPLE_POOL_BLOCKS];  ///< blocks the keeper holds a reference on
+static uint32_t         held_count;
+static sample_block_t * dropped[DROPPERS];         ///< last block each dropper was given
+static uint32_t         dropped_count[DROPPERS];
+
+/**@brief Keeps a reference on every block, as a consumer handing them to its thread. */
+static void keeper(sample_block_t * p_block, void * p_user_data)
+{
+    ARG_UNUSED(p_user_data);
+
+    zassert_true(held_count < ARRAY_SIZE(held));
+    held[held_count++] = p_block;
+}
+
+/**@brief Looks at the block and releases it right away. */
+static void dropper(sample_block_t * p_block, void * p_user_data)
+{
+    const uint32_t index = (uint32_t)(uintptr_t)p_user_data;
+
+    zassert_true(atomic_get(&p_block->refs) > 1, "the producer reference is held until every subscriber had the block");
+
+    dropped[index] = p_block;
+    dropped_count[index]++;
+    sample_block_unref(p_block);
+}
+
+static void held_release(void)
+{
+    while (held_count > 0U)
+    {
+        sample_block_unref(held[--held_count]);
+    }
+}
+
+static void in_use_check(const uint32_t in_use)
+{
+    sample_pool_stats_t stats;
+
+    zassert_ok(sample_pool_stats_get(&stats));
+    zassert_equal(stats.in_use, in_use, "%u blocks in use, expected %u", stats.in_use, in_use);
+}
+
+static void * sample_pool_setup(void)
+{
+    zassert_equal(sample_pool_subscribe(NULL, NULL), -EINVAL);
+
+    zassert_ok(sample_pool_subscribe(keeper, NULL));
+    for (uint32_t i = 0U; i < DROPPERS; i++)
+    {
+        zassert_ok(sample_pool_subscribe(dropper, (void *)(uintptr_t)i));
+    }
+    zassert_equal(sample_pool_subscribe(dropper, NULL), -ENOMEM);
+
+    return NULL;
+}
+
+static void sample_pool_before(void * p_fixture)
+{
+    ARG_UNUSED(p_fixture);
+
+    held_release();
+    memset(dropped, 0, sizeof(dropped));
+    memset(dropped_count, 0, sizeof(dropped_count));
+    sample_pool_stats_reset();
+}
+
+ZTEST_SUITE(sample_pool, NULL, sample_pool_setup, sample_pool_before, NULL, NULL);
+
+ZTEST(sample_pool, test_published_block_lifetime)
+{
+    sample_pool_stats_t stats;
+    sample_block_t *    p_block = sample_pool_alloc(K_NO_WAIT);
+
+    zassert_not_null(p_block);
+    zassert_equal(atomic_get(&p_block->refs), 1);
+    zassert_equal(p_block->count, 0U);
+    in_use_check(1U);
+
+    p_block->source     = 3U;
+    p_block->count      = 2U;
+    p_block->samples[1] = (accel_values_t){ .x = 1, .y = 2, .z = 3 };
+    zassert_ok(sample_pool_publish(p_block));
+
+    // the same block for everyone, no copies
+    zassert_equal(held_count, 1U);
+    zassert_equal_ptr(held[0], p_block);
+    for (uint32_t i = 0U; i < DROPPERS; i++)
+    {
+        zassert_equal_ptr(dropped[i], p_block);
+        zassert_equal(dropped_count[i], 1U);
+    }
+
+    // the producer and the droppers let go, the keeper still holds it
+    zassert_equal(atomic_get(&p_block->refs), 1);
+    zassert_equal(held[0]->samples[1].z, 3);
+    in_use_check(1U);
+
+    held_release();
+    in_use_check(0U);
+
+    zassert_ok(sample_pool_stats_get(&stats));
+    zassert_equal(stats.published, 1U);
+    zassert_equal(stats.high_water, 1U);
+    zassert_equal(stats.alloc_failures, 0U);
+}
+
+ZTEST(sample_pool, test_extra_reference)
+{
+    sample_block_t * p_block = sample_pool_alloc(K_NO_WAIT);
+
+    zassert_not_null(p_block);
+
+    // the producer keeps the block past the publish, as for a replay of the last block
+    sample_block_ref(p_block);
+    zassert_ok(sample_pool_publish(p_block));
+    zassert_equal(atomic_get(&p_block->refs), 2);
+
+    held_release();
+    in_use_check(1U);
+
+    sample_block_unref(p_block);
+    in_use_check(0U);
+}
+
+ZTEST(sample_pool, test_pool_dry)
+{
+    sample_pool_stats_t stats;
+    sample_block_t *    p_block;
+
+    for (uint32_t i = 0U; i < SAMPLE_POOL_BLOCKS; i++)
+    {
+        p_block = sample_pool_alloc(K_NO_WAIT);
+        zassert_not_null(p_block, "block %u", i);
+        zassert_ok(sample_pool_publish(p_block));
+    }
+    in_use_check(SAMPLE_POOL_BLOCKS);
+
+    zassert_is_null(sample_pool_alloc(K_NO_WAIT));
+    zassert_is_null(sample_pool_alloc(K_MSEC(5)));
+
+    // a released block can be allocated again
+    sample_block_unref(held[--held_count]);
+    p_block = sample_pool_alloc(K_NO_WAIT);
+    zassert_not_null(p_block);
+    sample_block_unref(p_block);
+
+    zassert_ok(sample_pool_stats_get(&stats));
+    zassert_equal(stats.alloc_failures, 2U);
+    zassert_equal(stats.high_water, SAMPLE_POOL_BLOCKS);
+    zassert_equal(stats.published, SAMPLE_POOL_BLOCKS);
+
+    // the high-water mark restarts from the blocks still in use
+    sample_pool_stats_reset();
+    zassert_ok(sample_pool_stats_get(&stats));
+    zassert_equal(stats.high_water, SAMPLE_POOL_BLOCKS - 1U);
+    zassert_equal(stats.alloc_failures, 0U);
+
+    held_release();
+    in_use_check(0U);
+    zassert_equal(sample_pool_publish(NULL), -EINVAL);
+    zassert_equal(sample_pool_stats_get(NULL), -EINVAL);
+}
@@ -0,0 +1,197 @@
+/**
+ * @file      main.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Accounting of the sequence checks on made up batches of a
+ *            100 Hz stream: batches one period apart, a gap of lost
+ *            samples, a batch read again within the period of the last
+ *            sample, a reported FIFO overflow and a rate change. A sensor
+ *            at rest repeats its output, which must not count as a
+ *            duplicate. The gap fill modes are checked against the samples
+ *            around a gap, and against an output buffer shorter than the gap.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "seqchk.h"
+
+#define ODR_MHZ     100000U  ///< 100 Hz
+#define PERIOD_US   10000
+#define BATCH_COUNT 4U
+
+/**@brief A batch of a sensor at rest, every sample the same. */
+static const accel_values_t rest[BATCH_COUNT] = {
+    { .x = 12, .y = -7, .z = 16384 },
+    { .x = 12, .y = -7, .z = 16384 },
+    { .x = 12, .y = -7, .z = 16384 },
+    { .x = 12, .y = -7, .z = 16384 },
+};
+
+static seqchk_stream_t stream;
+
+static void seqchk_before(void * p_fixture)
+{
+    ARG_UNUSED(p_fixture);
+
+    zassert_ok(seqchk_stream_init(&stream, "test", ODR_MHZ));
+}
+
+ZTEST_SUITE(seqchk, NULL, NULL, seqchk_before, NULL, NULL);
+
+ZTEST(seqchk, test_rest_is_not_duplicate)
+{
+    seqchk_batch_t batch;
+    seqchk_stats_t stats;
+
+    // batches one after the other, a sensor at rest gives the same sample every period
+    for (uint32_t i = 0U; i < 3U; i++)
+    {
+        zassert_ok(seqchk_batch(&stream, rest, BATCH_COUNT, (int64_t)i * BATCH_COUNT * PERIOD_US, false, &batch));
+        zassert_equal(batch.seq, i * BATCH_COUNT);
+        zassert_equal(batch.expected, BATCH_COUNT);
+        zassert_equal(batch.received, BATCH_COUNT);
+        zassert_equal(batch.flags, 0U, "batch %u flagged 0x%02X", i, batch.flags);
+    }
+
+    zassert_ok(seqchk_stats_get(&stream, &stats));
+    zassert_equal(stats.batches, 3U);
+    zassert_equal(stats.received, 3U * BATCH_COUNT);
+    zassert_equal(stats.expected, 3U * BATCH_COUNT);
+    zassert_equal(stats.duplicates, 0U);
+    zassert_equal(stats.lost, 0U);
+}
+
+ZTEST(seqchk, test_gap)
+{
+    accel_values_t samples[BATCH_COUNT];
+    seqchk_batch_t batch;
+    seqchk_stats_t stats;
+
+    for (uint8_t i = 0U; i < BATCH_COUNT; i++)
+    {
+        samples[i] = (accel_values_t){ .x = (int16_t)i, .y = 0, .z = 0 };
+    }
+
+    zassert_ok(seqchk_batch(&stream, samples, BATCH_COUNT, 0, false, NULL));
+
+    // the last sample was at 30 ms, two periods missing before 60 ms, 62 ms rounds to the same
+    zassert_ok(seqchk_batch(&stream, rest, BATCH_COUNT, 62000, false, &batch));
+    zassert_equal(batch.seq, BATCH_COUNT + 2U);
+    zassert_equal(batch.expected, BATCH_COUNT + 2U);
+    zassert_equal(batch.received, BATCH_COUNT);
+    zassert_equal(seqchk_batch_lost(&batch), 2U);
+    zassert_equal(batch.flags, SEQCHK_FLAG_GAP);
+    zassert_mem_equal(&batch.before, &samples[BATCH_COUNT - 1U], sizeof(batch.before));
+
+    // the next one is on time again, the numbers go on after the lost ones
+    zassert_ok(seqchk_batch(&stream, rest, BATCH_COUNT, 62000 + (BATCH_COUNT * PERIOD_US), false, &batch));
+    zassert_equal(batch.seq, (2U * BATCH_COUNT) + 2U);
+    zassert_equal(batch.flags, 0U);
+
+    zassert_ok(seqchk_stats_get(&stream, &stats));
+    zassert_equal(stats.received, 3U * BATCH_COUNT);
+    zassert_equal(stats.expected, (3U * BATCH_COUNT) + 2U);
+    zassert_equal(stats.lost, 2U);
+    zassert_equal(stats.gaps, 1U);
+}
+
+ZTEST(seqchk, test_read_again_is_duplicate)
+{
+    seqchk_batch_t batch;
+    seqchk_stats_t stats;
+
+    zassert_ok(seqchk_batch(&stream, rest, 1U, 0, false, NULL));
+
+    // a read 3 ms after the last sample finds the same register contents
+    zassert_ok(seqchk_batch(&stream, rest, 1U, 3000, false, &batch));
+    zassert_equal(batch.flags, SEQCHK_FLAG_DUPLICATE);
+    zassert_equal(batch.expected, 0U);
+    zassert_equal(batch.received, 1U);
+
+    // back on time
+    zassert_ok(seqchk_batch(&stream, rest, 1U, 3000 + PERIOD_US, false, &batch));
+    zassert_equal(batch.flags, 0U);
+    zassert_equal(batch.expected, 1U);
+
+    zassert_ok(seqchk_stats_get(&stream, &stats));
+    zassert_equal(stats.duplicates, 1U);
+    zassert_equal(stats.received, 3U);
+    zassert_equal(stats.expected, 2U);
+    zassert_equal(stats.lost, 0U);
+}
+
+ZTEST(seqchk, test_overflow_and_rate_change)
+{
+    seqchk_batch_t batch;
+    seqchk_stats_t stats;
+
+    zassert_ok(seqchk_batch(&stream, rest, BATCH_COUNT, 0, false, NULL));
+    zassert_ok(seqchk_batch(&stream, rest, BATCH_COUNT, BATCH_COUNT * PERIOD_US, true, &batch));
+    zassert_equal(batch.flags, SEQCHK_FLAG_OVERFLOW);
+
+    // after a rate change the first batch is a new reference, whatever its time
+    zassert_ok(seqchk_stream_rate_set(&stream, 2U * ODR_MHZ));
+    zassert_ok(seqchk_batch(&stream, rest, BATCH_COUNT, 1000000, false, &batch));
+    zassert_equal(batch.seq, 2U * BATCH_COUNT);
+    zassert_equal(batch.flags, 0U);
+
+    // 5 ms periods from here on, one of them missing
+    zassert_ok(seqchk_batch(&stream, rest, BATCH_COUNT, 1000000 + ((BATCH_COUNT + 1U) * PERIOD_US / 2), false,
+                            &batch));
+    zassert_equal(seqchk_batch_lost(&batch), 1U);
+
+    zassert_ok(seqchk_stats_get(&stream, &stats));
+    zassert_equal(stats.overflows, 1U);
+    zassert_equal(stats.gaps, 1U);
+    zassert_equal(stats.duplicates, 0U);
+
+    zassert_equal(seqchk_stream_rate_set(&stream, 0U), -EINVAL);
+    zassert_equal(seqchk_batch(&stream, rest, 0U, 0, false, NULL), -EINVAL);
+}
+
+ZTEST(seqchk, test_gap_fill)
+{
+    const accel_values_t before = { .x = 100, .y = -100, .z = 0 };
+    const accel_values_t after  = { .x = 140, .y = -140, .z = 400 };
+    const accel_values_t unused = { .x = 1, .y = 2, .z = 3 };
+    accel_values_t       out[4];
+
+    // three lost samples evenly between the ones around the gap
+    zassert_equal(seqchk_gap_fill(SEQCHK_FILL_LINEAR, &before, &after, 3U, out, ARRAY_SIZE(out)), 3);
+    for (uint8_t i = 0U; i < 3U; i++)
+    {
+        zassert_equal(out[i].x, 100 + (10 * (i + 1)));
+        zassert_equal(out[i].y, -100 - (10 * (i + 1)));
+        zassert_equal(out[i].z, 100 * (i + 1));
+    }
+
+    zassert_equal(seqchk_gap_fill(SEQCHK_FILL_HOLD, &before, &after, 3U, out, ARRAY_SIZE(out)), 3);
+    for (uint8_t i = 0U; i < 3U; i++)
+    {
+        zassert_mem_equal(&out[i], &before, sizeof(before));
+    }
+
+    zassert_equal(seqchk_gap_fill(SEQCHK_FILL_ZERO, &before, &after, 3U, out, ARRAY_SIZE(out)), 3);
+    for (uint8_t i = 0U; i < 3U; i++)
+    {
+        zassert_true((out[i].x == 0) && (out[i].y == 0) && (out[i].z == 0));
+    }
+
+    // a gap longer than the buffer fills the start of the line, nothing past max
+    for (uint8_t i = 0U; i < ARRAY_SIZE(out); i++)
+    {
+        out[i] = unused;
+    }
+    zassert_equal(seqchk_gap_fill(SEQCHK_FILL_LINEAR, &before, &after, 7U, out, 2U), 2);
+    zassert_equal(out[0].z, 50);
+    zassert_equal(out[1].z, 100);
+    zassert_mem_equal(&out[2], &unused, sizeof(unused));
+
+    zassert_equal(seqchk_gap_fill(SEQCHK_FILL_LINEAR + 1, &before, &after, 3U, out, ARRAY_SIZE(out)), -EINVAL);
+    zassert_equal(seqchk_gap_fill(SEQCHK_FILL_HOLD, NULL, &after, 3U, out, ARRAY_SIZE(out)), -EINVAL);
+}
@@ -0,0 +1,276 @@
+/**
+ * @file      main.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Record and replay of the TWI traffic. A trace built by the
+ *            test is served on the bus by the replay backend while the
+ *            recorder taps the same transfers, so what comes out of the
+ *            recorder has to be the served records again, at their
+ *            recorded times when replaying in real time. A record the
+ *            transfers do not ask for has to be passed over, a NACK has to
+ *            replay as a NACK and be retried, and the trace has to start
+ *            over at its end. A full recording buffer has to drop whole
+ *            records and flag the next stored one.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "trace.h"
+#include "twi.h"
+
+#define MPU_ADDRESS  0x68U
+#define LIS_ADDRESS  0x18U
+#define READ_REG     (TRACE_FLAG_READ | TRACE_FLAG_HAS_REG)
+
+/**@brief A record of the made up trace and its bytes. */
+typedef struct
+{
+    trace_record_t record;
+    uint8_t        data[6];
+} test_record_t;
+
+static const test_record_t records[] = {
+    { { 1000U, 1U, MPU_ADDRESS, 0x75U, READ_REG, 0 }, { 0x71U } },
+    { { 2000U, 1U, MPU_ADDRESS, 0x3AU, READ_REG, 0 }, { 0x01U } },  // a status poll the test does not repeat
+    { { 3000U, 6U, MPU_ADDRESS, 0x3BU, READ_REG, 0 }, { 1U, 2U, 3U, 4U, 5U, 6U } },
+    { { 4000U, 1U, MPU_ADDRESS, 0x6BU, TRACE_FLAG_HAS_REG, -ENXIO }, { 0U } },
+    { { 4100U, 1U, MPU_ADDRESS, 0x6BU, TRACE_FLAG_HAS_REG, 0 }, { 0x00U } },
+    { { 5000U, 6U, LIS_ADDRESS, 0xA8U, READ_REG, 0 }, { 0x10U, 0x20U, 0x30U, 0x40U, 0x50U, 0x60U } },
+};
+
+static uint8_t  trace[256];
+static uint32_t trace_size;
+static uint8_t  recording[CONFIG_APP_TRACE_BUFFER_SIZE];
+
+/**@brief Builds the trace file of the made up records. */
+static void trace_build(void)
+{
+    const trace_file_header_t header = {
+        .magic       = TRACE_MAGIC,
+        .version     = TRACE_VERSION,
+        .record_size = sizeof(trace_record_t),
+    };
+
+    memcpy(trace, &header, sizeof(header));
+    trace_size = sizeof(header);
+
+    for (uint32_t i = 0U; i < ARRAY_SIZE(records); i++)
+    {
+        const uint16_t length = (records[i].record.err == 0) ? records[i].record.length : 0U;
+
+        memcpy(&trace[trace_size], &records[i].record, sizeof(trace_record_t));
+        trace_size += sizeof(trace_record_t);
+        memcpy(&trace[trace_size], records[i].data, length);
+        trace_size += length;
+    }
+}
+
+/**
+ * @brief Checks the next recorded record against a made up one.
+ *
+ * @return offset of the record after it
+ */
+static uint32_t record_check(const uint32_t offset, const test_record_t * p_expected)
+{
+    const uint16_t length = (p_expected->record.err == 0) ? p_expected->record.length : 0U;
+    trace_record_t record;
+
+    memcpy(&record, &recording[offset], sizeof(record));
+    TC_PRINT("0x%02X 0x%02X at %u us, expected at %u us\n", record.address, record.reg_address,
+             record.timestamp_us, p_expected->record.timestamp_us);
+
+    zassert_equal(record.address, p_expected->record.address);
+    zassert_equal(record.reg_address, p_expected->record.reg_address);
+    zassert_equal(record.flags, p_expected->record.flags);
+    zassert_equal(record.length, p_expected->record.length);
+    zassert_equal(record.err, p_expected->record.err);
+    zassert_mem_equal(&recording[offset + sizeof(record)], p_expected->data, length);
+    zassert_within(record.timestamp_us, p_expected->record.timestamp_us, 100U);
+
+    return offset + sizeof(record) + length;
+}
+
+static void * trace_setup(void)
+{
+    trace_build();
+    zassert_ok(twi_init(0U, 0U));
+    zassert_ok(twi_enable());
+
+    return NULL;
+}
+
+static void trace_after(void * p_fixture)
+{
+    ARG_UNUSED(p_fixture);
+
+    trace_record_stop();
+    while (trace_record_read(recording, sizeof(recording)) != 0U)
+    {
+    }
+}
+
+ZTEST_SUITE(trace, NULL, trace_setup, NULL, trace_after, NULL);
+
+ZTEST(trace, test_round_trip)
+{
+    trace_file_header_t  header;
+    trace_replay_stats_t replay;
+    trace_record_stats_t recorded;
+    uint8_t              data[6];
+    uint8_t              value = 0x00U;
+    uint32_t             offset;
+    uint32_t             size;
+
+    trace_replay_speed_set(TRACE_REPLAY_REALTIME);
+    zassert_ok(trace_replay_load(trace, trace_size));
+    zassert_ok(trace_record_start());
+    zassert_equal(trace_record_start(), -EALREADY);
+
+    zassert_ok(twi_read(MPU_ADDRESS, 0x75U, data, 1U));
+    zassert_equal(data[0], 0x71U);
+
+    // the status poll is passed over
+    zassert_ok(twi_read(MPU_ADDRESS, 0x3BU, data, 6U));
+    zassert_mem_equal(data, records[2].data, 6U);
+
+    // NACKed once, as recorded, and retried
+    zassert_ok(twi_write(MPU_ADDRESS, 0x6BU, &value, 1U));
+
+    zassert_ok(twi_read(LIS_ADDRESS, 0xA8U, data, 6U));
+    zassert_mem_equal(data, records[5].data, 6U);
+
+    // nothing in the trace answers it, every attempt is missed
+    zassert_equal(twi_read(0x50U, 0x00U, data, 1U), -ENOTTY);
+
+    zassert_ok(trace_replay_stats_get(&replay));
+    zassert_equal(replay.served, 5U);
+    zassert_equal(replay.skipped, 1U);
+    zassert_equal(replay.missed, TWI_DEFAULT_RETRIES + 1U);
+    zassert_equal(replay.loops, 0U);
+    zassert_equal(replay.max_lag_us, 0U);
+
+    trace_record_stop();
+    zassert_ok(trace_record_stats_get(&recorded));
+    zassert_equal(recorded.records, 5U + TWI_DEFAULT_RETRIES + 1U);
+    zassert_equal(recorded.dropped, 0U);
+
+    size = trace_record_read(recording, sizeof(recording));
+    zassert_equal(size, recorded.bytes);
+
+    // the served records again, the skipped one left out
+    memcpy(&header, recording, sizeof(header));
+    zassert_equal(header.magic, TRACE_MAGIC);
+    zassert_equal(header.version, TRACE_VERSION);
+    zassert_equal(header.record_size, sizeof(trace_record_t));
+
+    offset = record_check(sizeof(header), &records[0]);
+    offset = record_check(offset, &records[2]);
+    offset = record_check(offset, &records[3]);
+    offset = record_check(offset, &records[4]);
+    offset = record_check(offset, &records[5]);
+
+    // then the missed attempts, NACKed
+    for (uint8_t i = 0U; i <= TWI_DEFAULT_RETRIES; i++)
+    {
+        trace_record_t record;
+
+        memcpy(&record, &recording[offset], sizeof(record));
+        zassert_equal(record.address, 0x50U);
+        zassert_equal(record.err, -ENXIO);
+        offset += sizeof(record);
+    }
+    zassert_equal(offset, size);
+}
+
+ZTEST(trace, test_loop_and_lag)
+{
+    trace_replay_stats_t replay;
+    uint8_t              data[6];
+
+    trace_replay_speed_set(TRACE_REPLAY_MAX_SPEED);
+    zassert_ok(trace_replay_load(trace, trace_size));
+
+    // the rest of the trace is passed over to find the first record again
+    zassert_ok(twi_read(MPU_ADDRESS, 0x75U, data, 1U));
+    zassert_ok(twi_read(MPU_ADDRESS, 0x75U, data, 1U));
+    zassert_equal(data[0], 0x71U);
+
+    zassert_ok(trace_replay_stats_get(&replay));
+    zassert_equal(replay.served, 2U);
+    zassert_equal(replay.skipped, ARRAY_SIZE(records) - 1U);
+    zassert_equal(replay.loops, 1U);
+
+    // in real time, a transfer asked for well after its recorded time is late
+    trace_replay_speed_set(TRACE_REPLAY_REALTIME);
+    zassert_ok(trace_replay_load(trace, trace_size));
+    zassert_ok(twi_read(MPU_ADDRESS, 0x75U, data, 1U));
+    k_busy_wait(5000U);
+    zassert_ok(twi_read(MPU_ADDRESS, 0x3BU, data, 6U));
+
+    zassert_ok(trace_replay_stats_get(&replay));
+    TC_PRINT("largest lag %u us\n", replay.max_lag_us);
+    zassert_between_inclusive(replay.max_lag_us, 3000U, 3200U);
+}
+
+ZTEST(trace, test_full_buffer)
+{
+    const uint32_t       record_size = sizeof(trace_record_t) + 1U;
+    const uint32_t       fit = (CONFIG_APP_TRACE_BUFFER_SIZE - sizeof(trace_file_header_t)) / record_size;
+    trace_record_stats_t recorded;
+    trace_record_t       record;
+    uint8_t              data;
+    uint32_t             size;
+
+    trace_replay_speed_set(TRACE_REPLAY_MAX_SPEED);
+    zassert_ok(trace_replay_load(trace, trace_size));
+    zassert_ok(trace_record_start());
+
+    for (uint32_t i = 0U; i < (fit + 3U); i++)
+    {
+        zassert_ok(twi_read(MPU_ADDRESS, 0x75U, &data, 1U));
+    }
+
+    zassert_ok(trace_record_stats_get(&recorded));
+    zassert_equal(recorded.records, fit);
+    zassert_equal(recorded.dropped, 3U);
+
+    size = trace_record_read(recording, sizeof(recording));
+    zassert_equal(size, sizeof(trace_file_header_t) + (fit * record_size));
+    memcpy(&record, &recording[size - record_size], sizeof(record));
+    zassert_equal(record.flags, READ_REG);
+
+    // room again, the next record follows the dropped ones
+    zassert_ok(twi_read(MPU_ADDRESS, 0x75U, &data, 1U));
+    zassert_ok(twi_read(MPU_ADDRESS, 0x75U, &data, 1U));
+    zassert_equal(trace_record_read(recording, sizeof(recording)), 2U * record_size);
+
+    memcpy(&record, &recording[0], sizeof(record));
+    zassert_equal(record.flags, READ_REG | TRACE_FLAG_GAP);
+    memcpy(&record, &recording[record_size], sizeof(record));
+    zassert_equal(record.flags, READ_REG);
+}
+
+ZTEST(trace, test_invalid)
+{
+    trace_file_header_t header = {
+        .magic       = TRACE_MAGIC,
+        .version     = TRACE_VERSION + 1U,
+        .record_size = sizeof(trace_record_t),
+    };
+
+    zassert_equal(trace_replay_load(NULL, trace_size), -EINVAL);
+    zassert_equal(trace_replay_load(trace, sizeof(header) - 1U), -EINVAL);
+    zassert_equal(trace_replay_load((const uint8_t *)&header, sizeof(header)), -EINVAL);
+    header.version     = TRACE_VERSION;
+    header.record_size = sizeof(trace_record_t) + 1U;
+    zassert_equal(trace_replay_load((const uint8_t *)&header, sizeof(header)), -EINVAL);
+
+    zassert_equal(trace_replay_stats_get(NULL), -EINVAL);
+    zassert_equal(trace_record_stats_get(NULL), -EINVAL);
+    zassert_equal(trace_record_read(NULL, 1U), 0U);
+}
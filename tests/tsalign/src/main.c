@@ -0,0 +1,219 @@
+/**
+ * @file      main.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Resampling of made up streams onto a common timebase. Two
+ *            streams at different rates and phases carry ramps, which the
+ *            linear interpolation has to reproduce exactly at every output
+ *            time. A sine carried by one stream is resampled with both
+ *            interpolations, the polyphase one has to stay much closer to
+ *            the sine. A stream running past its history while the other
+ *            one lags behind has to restart the outputs. The interrupt
+ *            times are set by the test, so nothing depends on the clock.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "tsalign.h"
+
+#define START_US     1000000
+#define A_PERIOD_US  10000   ///< 100 Hz
+#define B_PERIOD_US  25000   ///< 40 Hz
+#define B_OFFSET_US  3000    ///< first sample of B after the first one of A
+#define OUT_RATE_HZ  200U
+#define OUT_US       (1000000 / OUT_RATE_HZ)
+
+static tsalign_stream_t    stream_a;
+static tsalign_stream_t    stream_b;
+static tsalign_resampler_t resampler;
+
+/**@brief Ramp of stream A, 100 counts per period. */
+static int16_t ramp_a(const int64_t t_us)
+{
+    return (int16_t)((t_us - START_US) / 100);
+}
+
+/**@brief Falling ramp of stream B, 200 counts per period. */
+static int16_t ramp_b(const int64_t t_us)
+{
+    return (int16_t)(2000 - ((t_us - START_US - B_OFFSET_US) / 125));
+}
+
+/**
+ * @brief Tags a single read sample as if its data ready interrupt had been
+ * stamped at the given time.
+ */
+static void sample_at(tsalign_stream_t * p_stream, const int64_t t_us, const int16_t x)
+{
+    const accel_values_t value = { .x = x, .y = (int16_t)-x, .z = 16384 };
+    tsalign_sample_t     tagged;
+
+    // in place of tsalign_irq_stamp(), at a chosen time
+    p_stream->irq_us = t_us;
+    zassert_ok(tsalign_tag_single(p_stream, &value, &tagged));
+    zassert_equal(tagged.t_us, t_us);
+}
+
+static void tsalign_before(void * p_fixture)
+{
+    ARG_UNUSED(p_fixture);
+
+    zassert_ok(tsalign_stream_init(&stream_a, "a", 1000000U * 1000U / A_PERIOD_US));
+    zassert_ok(tsalign_stream_init(&stream_b, "b", 1000000U * 1000U / B_PERIOD_US));
+}
+
+ZTEST_SUITE(tsalign, NULL, NULL, tsalign_before, NULL, NULL);
+
+ZTEST(tsalign, test_linear_ramps)
+{
+    accel_values_t values[2];
+    int64_t        t_us;
+    int64_t        last_b_us = 0;
+    uint32_t       outputs   = 0U;
+
+    zassert_ok(tsalign_resampler_init(&resampler, OUT_RATE_HZ, TSALIGN_LINEAR));
+    zassert_ok(tsalign_resampler_add(&resampler, &stream_a));
+    zassert_ok(tsalign_resampler_add(&resampler, &stream_b));
+    zassert_equal(tsalign_resampler_next(&resampler, &t_us, values), -EAGAIN);
+
+    for (int64_t k = 0; k < 20; k++)
+    {
+        sample_at(&stream_a, START_US + (k * A_PERIOD_US), ramp_a(START_US + (k * A_PERIOD_US)));
+    }
+    for (int64_t k = 0; k < 8; k++)
+    {
+        last_b_us = START_US + B_OFFSET_US + (k * B_PERIOD_US);
+        sample_at(&stream_b, last_b_us, ramp_b(last_b_us));
+    }
+
+    // from the later first sample, one output period apart, up to the last sample of B
+    while (tsalign_resampler_next(&resampler, &t_us, values) == 0)
+    {
+        zassert_equal(t_us, START_US + B_OFFSET_US + ((int64_t)outputs * OUT_US));
+        zassert_equal(values[0].x, ramp_a(t_us), "a at %d us: %d", (int32_t)t_us, values[0].x);
+        zassert_equal(values[0].y, -ramp_a(t_us));
+        zassert_equal(values[0].z, 16384);
+        zassert_equal(values[1].x, ramp_b(t_us), "b at %d us: %d", (int32_t)t_us, values[1].x);
+        outputs++;
+    }
+
+    zassert_equal(outputs, ((last_b_us - (START_US + B_OFFSET_US)) / OUT_US) + 1);
+    zassert_equal(resampler.skipped, 0U);
+
+    // the next output waits for B
+    sample_at(&stream_b, last_b_us + B_PERIOD_US, ramp_b(last_b_us + B_PERIOD_US));
+    zassert_ok(tsalign_resampler_next(&resampler, &t_us, values));
+    zassert_equal(values[1].x, ramp_b(t_us));
+}
+
+/**
+ * @brief Resamples a 5 Hz sine sampled at 100 Hz to 400 Hz and gets the
+ * largest error against the sine.
+ */
+static int32_t sine_error_max(const enum tsalign_interp interp)
+{
+    const double   amplitude = 8000.0;
+    const double   hz        = 5.0;
+    accel_values_t value;
+    int64_t        t_us;
+    int32_t        error_max = 0;
+    uint32_t       outputs   = 0U;
+
+    zassert_ok(tsalign_stream_init(&stream_a, "a", 1000000U * 1000U / A_PERIOD_US));
+    zassert_ok(tsalign_resampler_init(&resampler, 400U, interp));
+    zassert_ok(tsalign_resampler_add(&resampler, &stream_a));
+
+    for (int64_t k = 0; k < 30; k++)
+    {
+        const int64_t sample_us = START_US + (k * A_PERIOD_US);
+        const double  sample    = amplitude * sin(2.0 * M_PI * hz * (sample_us - START_US) / 1e6);
+
+        sample_at(&stream_a, sample_us, (int16_t)lround(sample));
+
+        while (tsalign_resampler_next(&resampler, &t_us, &value) == 0)
+        {
+            const int32_t expected = (int32_t)lround(amplitude * sin(2.0 * M_PI * hz * (t_us - START_US) / 1e6));
+
+            error_max = MAX(error_max, abs(value.x - expected));
+            outputs++;
+        }
+    }
+
+    zassert_true(outputs > 100U, "%u outputs", outputs);
+    return error_max;
+}
+
+ZTEST(tsalign, test_polyphase_sine)
+{
+    const int32_t linear    = sine_error_max(TSALIGN_LINEAR);
+    const int32_t polyphase = sine_error_max(TSALIGN_POLYPHASE);
+
+    TC_PRINT("largest error: linear %d, polyphase %d\n", linear, polyphase);
+    zassert_true(polyphase * 4 < linear, "linear %d, polyphase %d", linear, polyphase);
+}
+
+ZTEST(tsalign, test_restart_after_lag)
+{
+    accel_values_t values[2];
+    int64_t        t_us;
+    int64_t        a_us = START_US;
+    int64_t        b_us = START_US + B_OFFSET_US;
+
+    zassert_ok(tsalign_resampler_init(&resampler, OUT_RATE_HZ, TSALIGN_LINEAR));
+    zassert_ok(tsalign_resampler_add(&resampler, &stream_a));
+    zassert_ok(tsalign_resampler_add(&resampler, &stream_b));
+
+    for (uint8_t k = 0U; k < 3U; k++, a_us += A_PERIOD_US, b_us += B_PERIOD_US)
+    {
+        sample_at(&stream_a, a_us, ramp_a(a_us));
+        sample_at(&stream_b, b_us, ramp_b(b_us));
+    }
+    while (tsalign_resampler_next(&resampler, &t_us, values) == 0)
+    {
+    }
+
+    // A runs on past its history while B stays away, the waiting output is gone from A
+    for (uint8_t k = 0U; k < (2U * TSALIGN_HISTORY); k++, a_us += A_PERIOD_US)
+    {
+        sample_at(&stream_a, a_us, ramp_a(a_us));
+    }
+    zassert_equal(tsalign_resampler_next(&resampler, &t_us, values), -EAGAIN);
+    zassert_equal(resampler.skipped, 1U);
+
+    // the outputs restart at the oldest sample of A and wait for B
+    zassert_equal(tsalign_resampler_next(&resampler, &t_us, values), -EAGAIN);
+    zassert_equal(resampler.skipped, 1U);
+
+    for (; b_us < a_us; b_us += B_PERIOD_US)
+    {
+        sample_at(&stream_b, b_us, ramp_b(b_us));
+    }
+    zassert_ok(tsalign_resampler_next(&resampler, &t_us, values));
+    zassert_equal(t_us, a_us - (TSALIGN_HISTORY * A_PERIOD_US));
+    zassert_equal(values[0].x, ramp_a(t_us));
+    zassert_equal(values[1].x, ramp_b(t_us));
+    zassert_equal(resampler.skipped, 1U);
+}
+
+ZTEST(tsalign, test_invalid)
+{
+    accel_values_t values[1];
+    int64_t        t_us;
+
+    zassert_equal(tsalign_resampler_init(&resampler, 0U, TSALIGN_LINEAR), -EINVAL);
+    zassert_ok(tsalign_resampler_init(&resampler, OUT_RATE_HZ, TSALIGN_LINEAR));
+    zassert_equal(tsalign_resampler_next(&resampler, &t_us, values), -EINVAL);
+
+    for (uint8_t i = 0U; i < TSALIGN_MAX_STREAMS; i++)
+    {
+        zassert_ok(tsalign_resampler_add(&resampler, &stream_a));
+    }
+    zassert_equal(tsalign_resampler_add(&resampler, &stream_b), -ENOMEM);
+    zassert_equal(tsalign_resampler_add(&resampler, NULL), -EINVAL);
+}
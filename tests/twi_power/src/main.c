@@ -0,0 +1,128 @@
+/**
+ * @file      main.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Power gating of the TWI peripheral on the emulated bus. The
+ *            same sampling load, a fast mode sensor read every period and
+ *            a standard mode one every few periods, runs once with the
+ *            peripheral powered down after the idle time and once with it
+ *            always on. The bus time, the powered time and the latency of
+ *            the power ups and clock switches are printed for both. Gating
+ *            has to keep the bus time and cut the powered time. The
+ *            emulated port powers up and switches its clock at once, so
+ *            the latencies are those of the driver alone.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "twi.h"
+#include "twi_emul.h"
+
+#define FAST_ADDRESS  0x68U  ///< read every period at 400 kHz
+#define SLOW_ADDRESS  0x18U  ///< read every SLOW_EVERY periods at 100 kHz
+#define SLOW_EVERY    10U
+#define PERIOD_MS     10U
+#define PERIODS       200U
+#define IDLE_OFF_US   2000U  ///< well below the period, the peripheral goes down between the reads
+
+static uint8_t fast_registers[128];
+static uint8_t slow_registers[64];
+
+/**
+ * @brief Runs the sampling load with the given idle time and gets the
+ * statistics of the run.
+ *
+ * @param[in]  idle_us  idle time before powering down, 0 for always on
+ * @param[out] p_stats  statistics of the run
+ */
+static void sample_run(const uint32_t idle_us, twi_power_stats_t * p_stats)
+{
+    uint8_t data[14];
+
+    // both runs start powered down and at the clock of the fast sensor
+    zassert_ok(twi_idle_off_set(IDLE_OFF_US));
+    zassert_ok(twi_read(FAST_ADDRESS, 0x3BU, data, sizeof(data)));
+    k_msleep(PERIOD_MS);
+
+    zassert_ok(twi_idle_off_set(idle_us));
+    twi_power_stats_reset();
+
+    for (uint32_t i = 0U; i < PERIODS; i++)
+    {
+        zassert_ok(twi_read(FAST_ADDRESS, 0x3BU, data, sizeof(data)));
+        if ((i % SLOW_EVERY) == 0U)
+        {
+            zassert_ok(twi_read(SLOW_ADDRESS, 0xA8U, data, 6U));
+        }
+        k_msleep(PERIOD_MS);
+    }
+
+    zassert_ok(twi_power_stats_get(p_stats));
+}
+
+static void stats_print(const char * p_name, const twi_power_stats_t * p_stats)
+{
+    TC_PRINT("%s: busy %u us, powered %u us, %u power ups (avg %u ns, max %u ns), %u power downs\n", p_name,
+             (uint32_t)p_stats->busy_us, (uint32_t)p_stats->powered_us, p_stats->power_ups,
+             (p_stats->power_ups != 0U) ? (uint32_t)(p_stats->power_up_ns / p_stats->power_ups) : 0U,
+             p_stats->power_up_max_ns, p_stats->power_downs);
+    TC_PRINT("%s: %u clock switches (avg %u ns, max %u ns)\n", p_name, p_stats->speed_changes,
+             (p_stats->speed_changes != 0U) ? (uint32_t)(p_stats->speed_change_ns / p_stats->speed_changes) : 0U,
+             p_stats->speed_change_max_ns);
+}
+
+static void * twi_power_setup(void)
+{
+    static const twi_speed_profile_t profiles[] = {
+        { .address = FAST_ADDRESS, .speed = TWI_SPEED_400K },
+        { .address = SLOW_ADDRESS, .speed = TWI_SPEED_100K },
+    };
+
+    zassert_ok(twi_emul_target_add(FAST_ADDRESS, fast_registers, sizeof(fast_registers)));
+    zassert_ok(twi_emul_target_add(SLOW_ADDRESS, slow_registers, sizeof(slow_registers)));
+    zassert_ok(twi_init(0U, 0U));
+    zassert_ok(twi_speed_profiles_set(profiles, ARRAY_SIZE(profiles)));
+    zassert_ok(twi_enable());
+
+    return NULL;
+}
+
+ZTEST_SUITE(twi_power, NULL, twi_power_setup, NULL, NULL, NULL);
+
+ZTEST(twi_power, test_gated_and_always_on)
+{
+    const uint32_t    slow_reads = DIV_ROUND_UP(PERIODS, SLOW_EVERY);
+    twi_power_stats_t gated;
+    twi_power_stats_t always_on;
+
+    sample_run(IDLE_OFF_US, &gated);
+    sample_run(0U, &always_on);
+
+    stats_print("gated", &gated);
+    stats_print("always on", &always_on);
+
+    // the same transfers either way, down to the clock switches to the slow sensor and back
+    zassert_within(gated.busy_us, always_on.busy_us, always_on.busy_us / 100U, "busy %u us gated, %u us always on",
+                   (uint32_t)gated.busy_us, (uint32_t)always_on.busy_us);
+    zassert_equal(gated.speed_changes, 2U * slow_reads);
+    zassert_equal(always_on.speed_changes, 2U * slow_reads);
+
+    // gated: up for every period and down after its idle time
+    zassert_equal(gated.power_ups, PERIODS);
+    zassert_equal(gated.power_downs, PERIODS);
+    zassert_true(gated.powered_us <= (gated.busy_us + ((uint64_t)PERIODS * (IDLE_OFF_US + 1000U))),
+                 "powered %u us", (uint32_t)gated.powered_us);
+
+    // always on: up once at the first read, powered from there to the end
+    zassert_true(always_on.power_ups <= 1U);
+    zassert_equal(always_on.power_downs, 0U);
+    zassert_true(always_on.powered_us >= ((uint64_t)(PERIODS - 1U) * PERIOD_MS * 1000U), "powered %u us",
+                 (uint32_t)always_on.powered_us);
+
+    zassert_true((gated.powered_us * 3U) < always_on.powered_us, "powered %u us gated, %u us always on",
+                 (uint32_t)gated.powered_us, (uint32_t)always_on.powered_us);
+}
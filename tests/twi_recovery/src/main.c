@@ -0,0 +1,257 @@
+/**
+ * @file      main.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Error recovery of the TWI component on the emulated bus. Stuck
+ *            SDA lines, address and data NACKs and timeouts are injected,
+ *            and every call has to return within TWI_WORST_CASE_US() of its
+ *            options with the recoveries the policy calls for. The emulated
+ *            bus spends simulated time, so the durations are the same on
+ *            every run.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "twi.h"
+#include "twi_emul.h"
+
+#define TARGET_ADDRESS 0x68U
+#define BYTE_US        90U   ///< 100 kHz
+#define RECOVERY_US    200U  ///< 9 clocks, a stop condition and the re-initialization
+
+static uint8_t target_registers[128];
+
+/**
+ * @brief Rounding of a timeout up to the next tick, once per sleep.
+ */
+static uint32_t tick_us(void)
+{
+    return (uint32_t)k_ticks_to_us_floor64(1U);
+}
+
+/**
+ * @brief Reads a register with the given policy and returns how long the
+ * call blocked.
+ *
+ * @param[in]  timeout_us bound on waiting for the bus and on each attempt
+ * @param[in]  retries    attempts after the first one
+ * @param[out] p_err      result of the read
+ *
+ * @return duration of the call in us
+ */
+static uint32_t timed_read(const uint32_t timeout_us, const uint8_t retries, int * p_err)
+{
+    const twi_xfer_opts_t opts = {
+        .prio        = TWI_PRIO_NORMAL,
+        .deadline_us = 0U,
+        .timeout_us  = timeout_us,
+        .retries     = retries,
+    };
+    uint8_t       data[6];
+    const int64_t start = k_uptime_ticks();
+
+    *p_err = twi_read_opts(TARGET_ADDRESS, 0x3BU, data, sizeof(data), &opts);
+
+    return (uint32_t)k_ticks_to_us_floor64((uint64_t)(k_uptime_ticks() - start));
+}
+
+/**
+ * @brief Bound a call with the given policy has to meet, with a tick of
+ * rounding for every sleep in it.
+ */
+static uint32_t bound_us(const uint32_t timeout_us, const uint8_t retries)
+{
+    return (uint32_t)TWI_WORST_CASE_US(timeout_us, retries, RECOVERY_US) + ((retries + 2U) * tick_us());
+}
+
+static void * twi_recovery_setup(void)
+{
+    zassert_ok(twi_emul_target_add(TARGET_ADDRESS, target_registers, sizeof(target_registers)));
+    zassert_ok(twi_init(0U, 0U));
+    zassert_ok(twi_enable());
+
+    return NULL;
+}
+
+static void twi_recovery_before(void * p_fixture)
+{
+    ARG_UNUSED(p_fixture);
+
+    twi_emul_fault_inject(TWI_EMUL_FAULT_NONE, 0U);
+    twi_emul_timing_set(BYTE_US, RECOVERY_US);
+    twi_recovery_stats_reset();
+}
+
+ZTEST_SUITE(twi_recovery, NULL, twi_recovery_setup, twi_recovery_before, NULL, NULL);
+
+ZTEST(twi_recovery, test_clean_bus)
+{
+    twi_recovery_stats_t stats;
+    int                  err;
+    const uint32_t       duration_us = timed_read(TWI_DEFAULT_TIMEOUT_US, TWI_DEFAULT_RETRIES, &err);
+
+    zassert_ok(err);
+    zassert_ok(twi_recovery_stats_get(&stats));
+    zassert_equal(stats.retries, 0U);
+    zassert_equal(stats.recoveries, 0U);
+
+    // address, register, repeated start and 6 data bytes, measured in ticks
+    zassert_within(duration_us, 9U * BYTE_US, tick_us(), "clean read took %u us", duration_us);
+}
+
+ZTEST(twi_recovery, test_stuck_sda_released)
+{
+    twi_recovery_stats_t stats;
+    int                  err;
+
+    // the first recovery frees the line, the retry goes through
+    twi_emul_fault_inject(TWI_EMUL_FAULT_STUCK_SDA, 1U);
+
+    const uint32_t duration_us = timed_read(TWI_DEFAULT_TIMEOUT_US, TWI_DEFAULT_RETRIES, &err);
+
+    zassert_ok(err);
+    zassert_ok(twi_recovery_stats_get(&stats));
+    zassert_equal(stats.xfer_timeouts, 1U);
+    zassert_equal(stats.retries, 1U);
+    zassert_equal(stats.recoveries, 1U);
+    zassert_equal(stats.recovery_failures, 0U);
+    zassert_equal(stats.failures, 0U);
+    zassert_within(stats.max_recovery_us, RECOVERY_US, tick_us());
+    zassert_true(duration_us >= TWI_DEFAULT_TIMEOUT_US, "took %u us", duration_us);
+    zassert_true(duration_us <= bound_us(TWI_DEFAULT_TIMEOUT_US, TWI_DEFAULT_RETRIES), "took %u us", duration_us);
+
+    TC_PRINT("stuck SDA released by the first recovery: %u us, recovery %u us\n", duration_us,
+             stats.max_recovery_us);
+}
+
+ZTEST(twi_recovery, test_stuck_sda_held)
+{
+    static const uint32_t timeouts_us[] = { 1000U, 5000U, TWI_DEFAULT_TIMEOUT_US };
+    static const uint8_t  retries[]     = { 0U, 1U, TWI_DEFAULT_RETRIES, 5U };
+    twi_recovery_stats_t  stats;
+    int                   err;
+
+    for (uint8_t t = 0U; t < ARRAY_SIZE(timeouts_us); t++)
+    {
+        for (uint8_t r = 0U; r < ARRAY_SIZE(retries); r++)
+        {
+            // stays stuck over every attempt of the call
+            twi_emul_fault_inject(TWI_EMUL_FAULT_STUCK_SDA, 100U);
+            twi_recovery_stats_reset();
+
+            const uint32_t duration_us = timed_read(timeouts_us[t], retries[r], &err);
+            const uint32_t worst_us    = bound_us(timeouts_us[t], retries[r]);
+
+            zassert_equal(err, -ETIMEDOUT);
+            zassert_ok(twi_recovery_stats_get(&stats));
+            zassert_equal(stats.xfer_timeouts, retries[r] + 1U);
+            zassert_equal(stats.recoveries, retries[r] + 1U);
+            zassert_equal(stats.recovery_failures, retries[r] + 1U);
+            zassert_equal(stats.failures, 1U);
+            zassert_true(stats.max_recovery_us <= (RECOVERY_US + tick_us()), "recovery took %u us",
+                         stats.max_recovery_us);
+            zassert_true(duration_us >= ((retries[r] + 1U) * timeouts_us[t]), "took %u us", duration_us);
+            zassert_true(duration_us <= worst_us, "took %u us, bound %u us", duration_us, worst_us);
+
+            TC_PRINT("stuck SDA, timeout %5u us, %u retries: %6u us, bound %6u us\n", timeouts_us[t], retries[r],
+                     duration_us, worst_us);
+        }
+    }
+
+    // the bus works again once the line is let go
+    twi_emul_fault_inject(TWI_EMUL_FAULT_NONE, 0U);
+    zassert_ok(twi_bus_recover());
+    (void)timed_read(TWI_DEFAULT_TIMEOUT_US, TWI_DEFAULT_RETRIES, &err);
+    zassert_ok(err);
+}
+
+ZTEST(twi_recovery, test_address_nack)
+{
+    twi_recovery_stats_t stats;
+    int                  err;
+    uint32_t             duration_us;
+
+    // the last attempt goes through, NACKs are retried without a recovery
+    twi_emul_fault_inject(TWI_EMUL_FAULT_ANACK, TWI_DEFAULT_RETRIES);
+    duration_us = timed_read(TWI_DEFAULT_TIMEOUT_US, TWI_DEFAULT_RETRIES, &err);
+
+    zassert_ok(err);
+    zassert_ok(twi_recovery_stats_get(&stats));
+    zassert_equal(stats.nacks, TWI_DEFAULT_RETRIES);
+    zassert_equal(stats.retries, TWI_DEFAULT_RETRIES);
+    zassert_equal(stats.recoveries, 0U);
+    zassert_within(duration_us, (TWI_DEFAULT_RETRIES * BYTE_US) + (9U * BYTE_US), tick_us(), "took %u us",
+                   duration_us);
+
+    // one NACK more than there are attempts
+    twi_recovery_stats_reset();
+    twi_emul_fault_inject(TWI_EMUL_FAULT_ANACK, TWI_DEFAULT_RETRIES + 2U);
+    duration_us = timed_read(TWI_DEFAULT_TIMEOUT_US, TWI_DEFAULT_RETRIES, &err);
+
+    zassert_equal(err, -ENOTTY);
+    zassert_ok(twi_recovery_stats_get(&stats));
+    zassert_equal(stats.nacks, TWI_DEFAULT_RETRIES + 1U);
+    zassert_equal(stats.failures, 1U);
+    zassert_equal(stats.recoveries, 0U);
+    zassert_true(duration_us <= bound_us(TWI_DEFAULT_TIMEOUT_US, TWI_DEFAULT_RETRIES), "took %u us", duration_us);
+}
+
+ZTEST(twi_recovery, test_data_nack)
+{
+    twi_recovery_stats_t stats;
+    int                  err;
+    uint32_t             duration_us;
+
+    twi_emul_fault_inject(TWI_EMUL_FAULT_DNACK, 1U);
+    duration_us = timed_read(TWI_DEFAULT_TIMEOUT_US, TWI_DEFAULT_RETRIES, &err);
+
+    zassert_ok(err);
+    zassert_ok(twi_recovery_stats_get(&stats));
+    zassert_equal(stats.nacks, 1U);
+    zassert_equal(stats.retries, 1U);
+    zassert_equal(stats.recoveries, 0U);
+    zassert_within(duration_us, (2U * BYTE_US) + (9U * BYTE_US), tick_us(), "took %u us", duration_us);
+
+    twi_recovery_stats_reset();
+    twi_emul_fault_inject(TWI_EMUL_FAULT_DNACK, 10U);
+    duration_us = timed_read(TWI_DEFAULT_TIMEOUT_US, 0U, &err);
+
+    zassert_equal(err, -ENOTTY);
+    zassert_ok(twi_recovery_stats_get(&stats));
+    zassert_equal(stats.failures, 1U);
+    zassert_true(duration_us <= bound_us(TWI_DEFAULT_TIMEOUT_US, 0U), "took %u us", duration_us);
+}
+
+ZTEST(twi_recovery, test_recovery_time)
+{
+    static const uint32_t recoveries_us[] = { 50U, RECOVERY_US, 1000U };
+    twi_recovery_stats_t  stats;
+    int                   err;
+
+    for (uint8_t i = 0U; i < ARRAY_SIZE(recoveries_us); i++)
+    {
+        twi_emul_timing_set(BYTE_US, recoveries_us[i]);
+        twi_emul_fault_inject(TWI_EMUL_FAULT_STUCK_SDA, 2U);
+        twi_recovery_stats_reset();
+
+        const uint32_t duration_us = timed_read(TWI_DEFAULT_TIMEOUT_US, TWI_DEFAULT_RETRIES, &err);
+        const uint32_t worst_us    = (uint32_t)TWI_WORST_CASE_US(TWI_DEFAULT_TIMEOUT_US, TWI_DEFAULT_RETRIES,
+                                                                 recoveries_us[i]) +
+                                     ((TWI_DEFAULT_RETRIES + 2U) * tick_us());
+
+        // released by the second recovery, the third attempt goes through
+        zassert_ok(err);
+        zassert_ok(twi_recovery_stats_get(&stats));
+        zassert_equal(stats.recoveries, 2U);
+        zassert_equal(stats.recovery_failures, 1U);
+        zassert_true(stats.max_recovery_us <= (recoveries_us[i] + tick_us()), "recovery took %u us",
+                     stats.max_recovery_us);
+        zassert_true(stats.total_recovery_us <= (2U * (recoveries_us[i] + tick_us())));
+        zassert_true(duration_us <= worst_us, "took %u us, bound %u us", duration_us, worst_us);
+    }
+}
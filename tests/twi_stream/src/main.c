@@ -0,0 +1,234 @@
+/**
+ * @file      main.c
+ * @author    Usman Mehmood (usmanmehmood55@gmail.com)
+ *
+ * @brief     Hardware triggered reads of the TWI component on the simulated
+ *            nRF52 peripherals. The test drives the level of the interrupt
+ *            pin through the GPIO model, and GPIOTE, PPI and TIMER1 start
+ *            the reads as they would on the chip. Blocks have to reach the
+ *            handler in turn, a block filled while the handler still runs
+ *            has to count as an overrun, and a trigger that comes while
+ *            twi_transfer() owns the bus has to be held back and read once
+ *            it is done. The simulated bus has no sensor on it, so the
+ *            contents of the slots are not checked.
+ *
+ * @version   0.1
+ * @date      2024-08-05
+ * @copyright 2024, Usman Mehmood
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <NHW_GPIO.h>
+#include "twi.h"
+#include "twi_port.h"
+
+#define SCL_PIN        27U
+#define SDA_PIN        26U
+#define INT_PORT       0U
+#define INT_PIN        4U
+#define SENSOR_ADDRESS 0x68U
+#define SLOT_LENGTH    6U
+#define SLOT_COUNT     4U
+#define HIGH_US        50U    ///< length of a data ready pulse
+#define PERIOD_US      1000U  ///< time between the pulses, a 6 byte read takes about 200 us at 400 kHz
+
+static uint8_t buffer[TWI_STREAM_BUFFER_SIZE(SLOT_LENGTH, SLOT_COUNT)];
+
+static K_SEM_DEFINE(handler_release, 0, 1);
+
+static volatile uint32_t block_count;     ///< blocks handed to the handler
+static const uint8_t *   p_blocks[8];     ///< start of each block handed to the handler
+static volatile uint16_t slot_count;      ///< slots of the last block handed to the handler
+static void * volatile   p_context_seen;  ///< context the handler was called with last
+static volatile bool     handler_blocks;  ///< the handler waits for handler_release
+static volatile bool     tap_pulse;       ///< the next transfer attempt raises the interrupt pin
+
+static void stream_handler(const uint8_t * p_slots, const uint16_t count, void * p_context)
+{
+    // runs in the system work queue, the tests check what it saw
+    slot_count     = count;
+    p_context_seen = p_context;
+
+    if (block_count < ARRAY_SIZE(p_blocks))
+    {
+        p_blocks[block_count] = p_slots;
+    }
+    block_count++;
+
+    if (handler_blocks)
+    {
+        (void)k_sem_take(&handler_release, K_FOREVER);
+    }
+}
+
+/**
+ * @brief Raises the interrupt pin in the middle of a transfer, while the
+ * stream is held back.
+ */
+static void bus_tap(const twi_port_xfer_t * p_xfer, int err)
+{
+    ARG_UNUSED(p_xfer);
+    ARG_UNUSED(err);
+
+    if (tap_pulse)
+    {
+        tap_pulse = false;
+        nrf_gpio_test_change_pin_level(INT_PORT, INT_PIN, true);
+    }
+}
+
+/**
+ * @brief Gives the given number of data ready pulses, one every period.
+ */
+static void int_pulses(const uint32_t count)
+{
+    for (uint32_t i = 0U; i < count; i++)
+    {
+        nrf_gpio_test_change_pin_level(INT_PORT, INT_PIN, true);
+        k_usleep(HIGH_US);
+        nrf_gpio_test_change_pin_level(INT_PORT, INT_PIN, false);
+        k_usleep(PERIOD_US - HIGH_US);
+    }
+}
+
+static void stream_start(void)
+{
+    const twi_stream_config_t config = {
+        .address     = SENSOR_ADDRESS,
+        .reg_address = 0x3BU,
+        .slot_length = SLOT_LENGTH,
+        .slot_count  = SLOT_COUNT,
+        .p_buffer    = buffer,
+        .trigger_pin = INT_PIN,
+        .handler     = stream_handler,
+        .p_context   = buffer,
+    };
+
+    zassert_ok(twi_stream_start(&config));
+}
+
+static void * twi_stream_setup(void)
+{
+    static const twi_speed_profile_t profiles[] = {
+        { .address = SENSOR_ADDRESS, .speed = TWI_SPEED_400K },
+    };
+
+    zassert_ok(twi_init(SCL_PIN, SDA_PIN));
+    zassert_ok(twi_speed_profiles_set(profiles, ARRAY_SIZE(profiles)));
+    zassert_ok(twi_enable());
+    twi_tap_set(bus_tap);
+
+    return NULL;
+}
+
+static void twi_stream_before(void * p_fixture)
+{
+    ARG_UNUSED(p_fixture);
+
+    nrf_gpio_test_change_pin_level(INT_PORT, INT_PIN, false);
+    block_count    = 0U;
+    slot_count     = 0U;
+    p_context_seen = NULL;
+    handler_blocks = false;
+    tap_pulse      = false;
+    k_sem_reset(&handler_release);
+    memset(p_blocks, 0, sizeof(p_blocks));
+
+    stream_start();
+}
+
+static void twi_stream_after(void * p_fixture)
+{
+    ARG_UNUSED(p_fixture);
+
+    handler_blocks = false;
+    k_sem_give(&handler_release);
+    zassert_ok(twi_stream_stop());
+}
+
+ZTEST_SUITE(twi_stream, NULL, twi_stream_setup, twi_stream_before, twi_stream_after, NULL);
+
+ZTEST(twi_stream, test_blocks_in_turn)
+{
+    twi_stream_stats_t before;
+    twi_stream_stats_t after;
+
+    zassert_ok(twi_stream_stats_get(&before));
+
+    // a pulse short of a block wakes nobody
+    int_pulses(SLOT_COUNT - 1U);
+    zassert_equal(block_count, 0U);
+
+    int_pulses(1U + (2U * SLOT_COUNT));
+    zassert_equal(block_count, 3U);
+    zassert_equal(slot_count, SLOT_COUNT);
+    zassert_equal_ptr(p_context_seen, buffer);
+    zassert_equal_ptr(p_blocks[0], &buffer[0]);
+    zassert_equal_ptr(p_blocks[1], &buffer[SLOT_COUNT * SLOT_LENGTH]);
+    zassert_equal_ptr(p_blocks[2], &buffer[0]);
+
+    zassert_ok(twi_stream_stats_get(&after));
+    TC_PRINT("%u blocks, %u failed\n", after.blocks - before.blocks, after.failed - before.failed);
+    zassert_equal(after.blocks - before.blocks, 3U);
+    zassert_equal(after.overruns - before.overruns, 0U);
+    zassert_equal(after.pauses - before.pauses, 0U);
+    zassert_equal(after.replays - before.replays, 0U);
+}
+
+ZTEST(twi_stream, test_overrun)
+{
+    twi_stream_stats_t before;
+    twi_stream_stats_t after;
+
+    zassert_ok(twi_stream_stats_get(&before));
+
+    // the handler sits on the first block while the second one fills
+    handler_blocks = true;
+    int_pulses(2U * SLOT_COUNT);
+    zassert_equal(block_count, 1U);
+
+    zassert_ok(twi_stream_stats_get(&after));
+    zassert_equal(after.blocks - before.blocks, 2U);
+    zassert_equal(after.overruns - before.overruns, 1U);
+
+    // let go, the second block is handed over late
+    handler_blocks = false;
+    k_sem_give(&handler_release);
+    k_usleep(PERIOD_US);
+    zassert_equal(block_count, 2U);
+    zassert_equal_ptr(p_blocks[1], &buffer[SLOT_COUNT * SLOT_LENGTH]);
+}
+
+ZTEST(twi_stream, test_pause_around_transfer)
+{
+    twi_stream_stats_t before;
+    twi_stream_stats_t after;
+    uint8_t            data[2];
+
+    zassert_ok(twi_stream_stats_get(&before));
+
+    int_pulses(1U);
+
+    // a data ready pulse in the middle of twi_transfer() is held back, the
+    // bus has no sensor so the transfer itself may fail
+    tap_pulse = true;
+    (void)twi_read(SENSOR_ADDRESS, 0x75U, data, sizeof(data));
+    zassert_false(tap_pulse, "the transfer never reached the backend");
+
+    zassert_ok(twi_stream_stats_get(&after));
+    zassert_equal(after.pauses - before.pauses, 1U);
+    zassert_equal(after.replays - before.replays, 1U);
+
+    // the replayed read took its slot, two more fill the block
+    k_usleep(PERIOD_US);
+    nrf_gpio_test_change_pin_level(INT_PORT, INT_PIN, false);
+    k_usleep(PERIOD_US);
+    int_pulses(SLOT_COUNT - 2U);
+    zassert_equal(block_count, 1U);
+
+    zassert_ok(twi_stream_stats_get(&after));
+    zassert_equal(after.blocks - before.blocks, 1U);
+    zassert_equal(after.overruns - before.overruns, 0U);
+}